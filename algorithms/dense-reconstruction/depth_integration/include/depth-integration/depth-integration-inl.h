@@ -15,6 +15,7 @@
 #include <aslam/common/pose-types.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <landmark-triangulation/pose-interpolation-cache.h>
 #include <landmark-triangulation/pose-interpolator.h>
 #include <map-resources/resource-conversion.h>
 #include <map-resources/temporal-resource-id-buffer.h>
@@ -247,6 +248,10 @@ void integrateAllSensorDepthResourcesOfType(
     sigint_breaker.reset(new common::SigintBreaker);
   }
 
+  // The IMU trajectory of a mission is only integrated once and then shared by
+  // all sensors of this mission.
+  landmark_triangulation::PoseInterpolationCache pose_interpolation_cache;
+
   // Start integration.
   for (const vi_map::MissionId& mission_id : mission_ids) {
     VLOG(1) << "Integrating mission " << mission_id;
@@ -394,7 +399,7 @@ void integrateAllSensorDepthResourcesOfType(
       }
       // Interpolate poses for every resource.
       aslam::TransformationVector poses_M_B;
-      pose_interpolator.getPosesAtTime(
+      pose_interpolation_cache.getPosesAtTime(
           vi_map, mission_id, resource_timestamps, &poses_M_B);
       CHECK_EQ(static_cast<int>(poses_M_B.size()), resource_timestamps.size());
       CHECK_EQ(poses_M_B.size(), num_resources);
@@ -2,7 +2,9 @@
 #define DENSE_RECONSTRUCTION_STEREO_MATCHER_H_
 
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <Eigen/Dense>
 #include <aslam/cameras/camera.h>
@@ -66,7 +68,8 @@ struct StereoMatcherConfig {
 
 // Stereo matcher convenience class that uses OpenCV stereo matches to compute
 // disparity, depth maps or point cloud based on a stereo camera setup and the
-// provided images.
+// provided images. The undistortion/rectification maps are computed once and
+// shared, all compute functions can be called concurrently.
 class StereoMatcher {
  public:
   // Initialize the stereo matcher with the stereo camera intrinsics and
@@ -75,7 +78,7 @@ class StereoMatcher {
       const aslam::Camera& first_camera, const aslam::Camera& second_camera,
       const aslam::Transformation& T_C2_C1, const StereoMatcherConfig& config);
 
-  // Compute a disparity map for the stereo pair.
+  // Compute a disparity map for the stereo pair. Thread-safe.
   void computeDisparityMap(
       const cv::Mat& first_image, const cv::Mat& second_image,
       cv::Mat* disparity_map, cv::Mat* first_image_undistorted,
@@ -116,6 +119,14 @@ class StereoMatcher {
   }
 
  private:
+  // The OpenCV stereo matchers keep internal buffers and can't be shared
+  // between threads. Every concurrent caller takes its own instance from the
+  // pool, which grows up to the number of concurrent callers.
+  cv::Ptr<cv::StereoMatcher> createOpenCvStereoMatcher() const;
+  cv::Ptr<cv::StereoMatcher> acquireOpenCvStereoMatcher() const;
+  void releaseOpenCvStereoMatcher(
+      const cv::Ptr<cv::StereoMatcher>& stereo_matcher) const;
+
   const StereoMatcherConfig config_;
 
   const aslam::Camera& first_camera_;
@@ -132,7 +143,8 @@ class StereoMatcher {
   std::unique_ptr<Undistorter> undistorter_first_;
   std::unique_ptr<Undistorter> undistorter_second_;
 
-  cv::Ptr<cv::StereoMatcher> stereo_matcher_;
+  mutable std::mutex idle_stereo_matchers_mutex_;
+  mutable std::vector<cv::Ptr<cv::StereoMatcher>> idle_stereo_matchers_;
 
   // Cached intrinsics:
   double focal_length_;
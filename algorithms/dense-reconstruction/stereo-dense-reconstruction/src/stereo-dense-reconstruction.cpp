@@ -1,12 +1,19 @@
 #include "dense-reconstruction/stereo-dense-reconstruction.h"
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #include <Eigen/Dense>
 #include <aslam/cameras/camera.h>
+#include <aslam/common/statistics/statistics.h>
 #include <map-resources/resource-common.h>
+#include <maplab-common/parallel-process.h>
 #include <maplab-common/progress-bar.h>
+#include <maplab-common/threading-helpers.h>
 #include <vi-map/sensor-manager.h>
 #include <vi-map/unique-id.h>
 #include <vi-map/vi-map.h>
@@ -39,7 +46,29 @@ DEFINE_bool(
     "This affects the number of disparities and the p1/p2 parameter for the "
     "SGBM.");
 
+DEFINE_int32(
+    dense_stereo_num_threads, 0,
+    "Number of stereo frames that are matched concurrently. Every thread holds "
+    "its own stereo matcher buffers, so reduce this for very large images. If "
+    "0, the number of hardware threads is used.");
+
 namespace dense_reconstruction {
+namespace {
+// A stereo frame of a vertex together with its reconstruction. The images are
+// loaded and the results stored sequentially as they access the map, the
+// matching in between runs concurrently.
+struct StereoFrameJob {
+  vi_map::Vertex* vertex_ptr;
+  cv::Mat first_image;
+  cv::Mat second_image;
+  cv::Mat disparity_map;
+  cv::Mat first_image_rectified;
+  cv::Mat second_image_rectified;
+  resources::PointCloud point_cloud;
+  cv::Mat depth_map;
+};
+}  // namespace
+
 static std::unordered_set<backend::ResourceType, backend::ResourceTypeHash>
     kSupportedDepthTypes{backend::ResourceType::kRawDepthMap,
                          backend::ResourceType::kPointCloudXYZRGBN};
@@ -181,6 +210,12 @@ void computeDepthForStereoCamerasOfMission(
   const size_t second_camera_idx = ncamera.getCameraIndex(second_camera_id);
   const aslam::Camera& second_camera = ncamera.getCamera(second_camera_idx);
 
+  pose_graph::VertexIdList all_vertices;
+  vi_map->getAllVertexIdsInMissionAlongGraph(mission_id, &all_vertices);
+  if (all_vertices.empty()) {
+    return;
+  }
+
   static const std::string kDisparityMapWindowName = "Disparity Map";
   static const std::string kFirstImageWindowName = "First Image";
   static const std::string kSecondImageWindowName = "Second Image";
@@ -196,125 +231,171 @@ void computeDepthForStereoCamerasOfMission(
   stereo::StereoMatcherConfig config =
       stereo::StereoMatcherConfig::getFromGflags();
 
+  // The images are rectified directly into the downscaled resolution, hence
+  // the disparity range only needs to cover the downscaled image.
   if (FLAGS_dense_stereo_adapt_params_to_image_size) {
-    config.adaptParamsBasedOnImageSize(first_camera.imageWidth());
+    config.adaptParamsBasedOnImageSize(static_cast<size_t>(
+        first_camera.imageWidth() * config.downscaling_factor));
   }
 
-  stereo::StereoMatcher matcher(first_camera, second_camera, T_C2_C1, config);
-
-  pose_graph::VertexIdList all_vertices;
-  vi_map->getAllVertexIdsInMissionAlongGraph(mission_id, &all_vertices);
+  // Computes the rectification maps once for this stereo pair.
+  const stereo::StereoMatcher matcher(
+      first_camera, second_camera, T_C2_C1, config);
 
   // Use these flags if you only want to reconstruct parts of the trajectory for
   // tuning or debugging purposes.
   const size_t start = static_cast<size_t>(
       FLAGS_dense_stereo_debug_reconstruction_start_fraction_of_trajectory *
       static_cast<double>(all_vertices.size()));
-  const size_t end = static_cast<size_t>(
-      FLAGS_dense_stereo_debug_reconstruction_end_fraction_of_trajectory *
-      static_cast<double>(all_vertices.size()));
-  size_t counter = 0u;
+  const size_t end = std::min(
+      static_cast<size_t>(
+          FLAGS_dense_stereo_debug_reconstruction_end_fraction_of_trajectory *
+          static_cast<double>(all_vertices.size())),
+      all_vertices.size() - 1u);
+
+  const size_t num_threads = FLAGS_dense_stereo_num_threads > 0
+                                 ? FLAGS_dense_stereo_num_threads
+                                 : common::getNumHardwareThreads();
+
+  std::vector<StereoFrameJob> jobs;
+  std::function<void(const std::vector<size_t>&)> reconstruct =
+      [&jobs, &matcher, &first_camera,
+       &depth_resource_type](const std::vector<size_t>& batch) {
+        for (const size_t job_idx : batch) {
+          CHECK_LT(job_idx, jobs.size());
+          StereoFrameJob& job = jobs[job_idx];
+          matcher.computeDisparityMap(
+              job.first_image, job.second_image, &job.disparity_map,
+              &job.first_image_rectified, &job.second_image_rectified);
+
+          switch (depth_resource_type) {
+            case backend::ResourceType::kPointCloudXYZRGBN:
+              stereo::convertDisparityMapToPointCloud(
+                  job.disparity_map, job.first_image_rectified,
+                  matcher.baseline(), matcher.focal_length(), matcher.cx(),
+                  matcher.cy(), matcher.sad_window_size(),
+                  matcher.min_disparity(), matcher.num_disparities(),
+                  &job.point_cloud);
+              break;
+            case backend::ResourceType::kRawDepthMap:
+              stereo::convertDisparityMapToDepthMap(
+                  job.disparity_map, job.first_image_rectified,
+                  matcher.baseline(), matcher.focal_length(), matcher.cx(),
+                  matcher.cy(), matcher.sad_window_size(),
+                  matcher.min_disparity(), matcher.num_disparities(),
+                  first_camera, &job.depth_map);
+              break;
+            default:
+              LOG(FATAL) << "Resource type '"
+                         << backend::ResourceTypeNames[static_cast<int>(
+                                depth_resource_type)]
+                         << "' is not supported as output format of the "
+                         << "stereo dense reconstruction.";
+          }
+        }
+      };
+
+  const std::chrono::steady_clock::time_point pair_start_time =
+      std::chrono::steady_clock::now();
+  size_t num_reconstructed_frames = 0u;
 
   common::ProgressBar progress_bar(all_vertices.size());
   progress_bar.update(start);
-  for (const pose_graph::VertexId& vertex_id : all_vertices) {
-    if (counter < start) {
-      ++counter;
-      continue;
-    } else if (counter > end) {
-      break;
-    }
-    ++counter;
-
-    vi_map::Vertex* vertex_ptr = vi_map->getVertexPtr(vertex_id);
-
-    cv::Mat first_image, second_image;
-    const bool has_first_image = getSuitableGrayscaleImageForFrame(
-        *vi_map, *vertex_ptr, first_camera_idx, &first_image);
-    const bool has_second_image = getSuitableGrayscaleImageForFrame(
-        *vi_map, *vertex_ptr, second_camera_idx, &second_image);
-    if (!(has_first_image && has_second_image)) {
-      VLOG(3) << "Skipping vertex " << vertex_ptr->id()
-              << " - no suitable image was found.";
-      progress_bar.increment();
-      continue;
-    }
-
-    VLOG(3) << "Computing disparity map for vertex " << vertex_ptr->id();
-
-    CHECK(!first_image.empty());
-    CHECK(!second_image.empty());
-    CHECK_EQ(first_image.type(), CV_8UC1);
-    CHECK_EQ(second_image.type(), CV_8UC1);
-    CHECK_EQ(first_image.cols, second_image.cols);
-    CHECK_EQ(first_image.rows, second_image.rows);
+  // Bound the number of frames in flight to one per thread, such that the
+  // memory usage doesn't depend on the length of the mission.
+  for (size_t batch_start = start; batch_start <= end;
+       batch_start += num_threads) {
+    const size_t batch_end = std::min(batch_start + num_threads, end + 1u);
+
+    jobs.clear();
+    for (size_t vertex_idx = batch_start; vertex_idx < batch_end;
+         ++vertex_idx) {
+      vi_map::Vertex* vertex_ptr =
+          vi_map->getVertexPtr(all_vertices[vertex_idx]);
+
+      StereoFrameJob job;
+      job.vertex_ptr = vertex_ptr;
+      const bool has_first_image = getSuitableGrayscaleImageForFrame(
+          *vi_map, *vertex_ptr, first_camera_idx, &job.first_image);
+      const bool has_second_image = getSuitableGrayscaleImageForFrame(
+          *vi_map, *vertex_ptr, second_camera_idx, &job.second_image);
+      if (!(has_first_image && has_second_image)) {
+        VLOG(3) << "Skipping vertex " << vertex_ptr->id()
+                << " - no suitable image was found.";
+        progress_bar.increment();
+        continue;
+      }
 
-    if (FLAGS_dense_stereo_images_and_result_in_ocv_windows) {
-      cv::imshow(kFirstImageWindowName, first_image);
-      cv::imshow(kSecondImageWindowName, second_image);
+      CHECK(!job.first_image.empty());
+      CHECK(!job.second_image.empty());
+      CHECK_EQ(job.first_image.type(), CV_8UC1);
+      CHECK_EQ(job.second_image.type(), CV_8UC1);
+      CHECK_EQ(job.first_image.cols, job.second_image.cols);
+      CHECK_EQ(job.first_image.rows, job.second_image.rows);
+      jobs.emplace_back(std::move(job));
     }
-
-    cv::Mat disparity_map, first_image_rectified, second_image_rectified;
-    matcher.computeDisparityMap(
-        first_image, second_image, &disparity_map, &first_image_rectified,
-        &second_image_rectified);
-
-    if (FLAGS_dense_stereo_images_and_result_in_ocv_windows) {
-      cv::Mat color_map_disparity;
-      generateColorMap(disparity_map, &color_map_disparity);
-      cv::imshow(kDisparityMapWindowName, color_map_disparity);
+    if (jobs.empty()) {
+      continue;
     }
 
-    switch (depth_resource_type) {
-      case backend::ResourceType::kPointCloudXYZRGBN: {
-        resources::PointCloud point_cloud;
-        stereo::convertDisparityMapToPointCloud(
-            disparity_map, first_image_rectified, matcher.baseline(),
-            matcher.focal_length(), matcher.cx(), matcher.cy(),
-            matcher.sad_window_size(), matcher.min_disparity(),
-            matcher.num_disparities(), &point_cloud);
+    VLOG(3) << "Computing disparity maps for " << jobs.size()
+            << " vertices.";
+    constexpr bool kAlwaysParallelize = true;
+    common::ParallelProcess(
+        jobs.size(), reconstruct, kAlwaysParallelize, num_threads);
+
+    for (StereoFrameJob& job : jobs) {
+      if (FLAGS_dense_stereo_images_and_result_in_ocv_windows) {
+        cv::imshow(kFirstImageWindowName, job.first_image);
+        cv::imshow(kSecondImageWindowName, job.second_image);
+        cv::Mat color_map_disparity;
+        generateColorMap(job.disparity_map, &color_map_disparity);
+        cv::imshow(kDisparityMapWindowName, color_map_disparity);
+      }
 
-        if (point_cloud.size() > 0) {
+      if (depth_resource_type == backend::ResourceType::kPointCloudXYZRGBN) {
+        if (job.point_cloud.size() > 0) {
           storeFrameResourceWithOptionalOverwrite(
-              point_cloud, first_camera_idx, depth_resource_type, vertex_ptr,
-              vi_map);
+              job.point_cloud, first_camera_idx, depth_resource_type,
+              job.vertex_ptr, vi_map);
         } else {
           VLOG(3) << "No 3D points reconstructed.";
         }
-
-        break;
-      }
-      case backend::ResourceType::kRawDepthMap: {
-        cv::Mat depth_map;
-        stereo::convertDisparityMapToDepthMap(
-            disparity_map, first_image_rectified, matcher.baseline(),
-            matcher.focal_length(), matcher.cx(), matcher.cy(),
-            matcher.sad_window_size(), matcher.min_disparity(),
-            matcher.num_disparities(), first_camera, &depth_map);
-
+      } else {
         storeFrameResourceWithOptionalOverwrite(
-            depth_map, first_camera_idx, depth_resource_type, vertex_ptr,
-            vi_map);
+            job.depth_map, first_camera_idx, depth_resource_type,
+            job.vertex_ptr, vi_map);
 
         if (FLAGS_dense_stereo_images_and_result_in_ocv_windows) {
           cv::Mat color_map_depth;
-          generateColorMap(depth_map, &color_map_depth);
+          generateColorMap(job.depth_map, &color_map_depth);
           cv::imshow(kDepthMapWindowName, color_map_depth);
         }
-        break;
       }
-      default:
-        LOG(FATAL)
-            << "Resource type '"
-            << backend::ResourceTypeNames[static_cast<int>(depth_resource_type)]
-            << "' is not supported as output format of the stereo dense "
-            << "reconstruction.";
-    }
 
-    if (FLAGS_dense_stereo_images_and_result_in_ocv_windows) {
-      cv::waitKey(1);
+      if (FLAGS_dense_stereo_images_and_result_in_ocv_windows) {
+        cv::waitKey(1);
+      }
+      ++num_reconstructed_frames;
+      progress_bar.increment();
     }
-    progress_bar.increment();
+  }
+
+  const double pair_duration_s =
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - pair_start_time)
+          .count();
+  if (num_reconstructed_frames > 0u) {
+    const double time_per_frame_ms =
+        1e3 * pair_duration_s / num_reconstructed_frames;
+    statistics::StatsCollector stats_time_per_frame(
+        "Stereo dense reconstruction: time per frame [ms]");
+    stats_time_per_frame.AddSample(time_per_frame_ms);
+    LOG(INFO) << "Reconstructed " << num_reconstructed_frames
+              << " frames of stereo pair [" << first_camera_id << "/"
+              << second_camera_id << "] in " << pair_duration_s << "s ("
+              << time_per_frame_ms << "ms per frame, " << num_threads
+              << " threads).";
   }
 
   if (FLAGS_dense_stereo_images_and_result_in_ocv_windows) {
@@ -1,6 +1,7 @@
 #include "dense-reconstruction/stereo-matcher.h"
 
 #include <memory>
+#include <mutex>
 
 #include <Eigen/Dense>
 #include <aslam/cameras/camera.h>
@@ -127,35 +128,16 @@ StereoMatcher::StereoMatcher(
 
   if (config_.use_sgbm) {
     VLOG(1) << "Stereo matching algorithm used: SGBM";
-    stereo_matcher_ = cv::StereoSGBM::create(
-        config_.sgbm_min_disparity, config_.sgbm_num_disparities,
-        config_.sgbm_sad_window_size, config_.sgbm_p1, config_.sgbm_p2,
-        config_.sgbm_disp12_max_diff, config_.sgbm_pre_filter_cap,
-        config_.sgbm_uniqueness_ratio, config_.sgbm_speckle_window_size,
-        config_.sgbm_speckle_range, config_.sgbm_mode);
-
     min_disparity_ = config_.sgbm_min_disparity;
     num_disparities_ = config_.sgbm_num_disparities;
     sad_window_size_ = config_.sgbm_sad_window_size;
   } else {
     VLOG(1) << "Stereo matching algorithm used: BM";
-    stereo_matcher_ = cv::StereoBM::create(
-        config_.bm_num_disparities, config_.bm_sad_window_size);
-
-    cv::StereoBM* bm_ptr = static_cast<cv::StereoBM*>(stereo_matcher_.get());
-    bm_ptr->setPreFilterCap(config_.bm_pre_filter_cap);
-    bm_ptr->setPreFilterSize(config_.bm_pre_filter_size);
-    bm_ptr->setMinDisparity(config_.bm_min_disparity);
-    bm_ptr->setTextureThreshold(config_.bm_texture_threshold);
-    bm_ptr->setUniquenessRatio(config_.bm_uniqueness_ratio);
-    bm_ptr->setSpeckleRange(config_.bm_speckle_range);
-    bm_ptr->setSpeckleWindowSize(config_.bm_speckle_window_size);
-    bm_ptr->setDisp12MaxDiff(config_.bm_disp12_max_diff);
-
     min_disparity_ = config_.bm_min_disparity;
     num_disparities_ = config_.bm_num_disparities;
     sad_window_size_ = config_.bm_sad_window_size;
   }
+  idle_stereo_matchers_.emplace_back(createOpenCvStereoMatcher());
 
   // Cache some intrinsics values:
   const std::shared_ptr<OutputCameraParameters> left_params =
@@ -177,6 +159,48 @@ StereoMatcher::StereoMatcher(
   CHECK_GT(std::abs(baseline_), 1e-6);
 }
 
+cv::Ptr<cv::StereoMatcher> StereoMatcher::createOpenCvStereoMatcher() const {
+  if (config_.use_sgbm) {
+    return cv::StereoSGBM::create(
+        config_.sgbm_min_disparity, config_.sgbm_num_disparities,
+        config_.sgbm_sad_window_size, config_.sgbm_p1, config_.sgbm_p2,
+        config_.sgbm_disp12_max_diff, config_.sgbm_pre_filter_cap,
+        config_.sgbm_uniqueness_ratio, config_.sgbm_speckle_window_size,
+        config_.sgbm_speckle_range, config_.sgbm_mode);
+  }
+
+  cv::Ptr<cv::StereoBM> bm_ptr = cv::StereoBM::create(
+      config_.bm_num_disparities, config_.bm_sad_window_size);
+  bm_ptr->setPreFilterCap(config_.bm_pre_filter_cap);
+  bm_ptr->setPreFilterSize(config_.bm_pre_filter_size);
+  bm_ptr->setMinDisparity(config_.bm_min_disparity);
+  bm_ptr->setTextureThreshold(config_.bm_texture_threshold);
+  bm_ptr->setUniquenessRatio(config_.bm_uniqueness_ratio);
+  bm_ptr->setSpeckleRange(config_.bm_speckle_range);
+  bm_ptr->setSpeckleWindowSize(config_.bm_speckle_window_size);
+  bm_ptr->setDisp12MaxDiff(config_.bm_disp12_max_diff);
+  return bm_ptr;
+}
+
+cv::Ptr<cv::StereoMatcher> StereoMatcher::acquireOpenCvStereoMatcher() const {
+  {
+    std::lock_guard<std::mutex> lock(idle_stereo_matchers_mutex_);
+    if (!idle_stereo_matchers_.empty()) {
+      cv::Ptr<cv::StereoMatcher> stereo_matcher = idle_stereo_matchers_.back();
+      idle_stereo_matchers_.pop_back();
+      return stereo_matcher;
+    }
+  }
+  return createOpenCvStereoMatcher();
+}
+
+void StereoMatcher::releaseOpenCvStereoMatcher(
+    const cv::Ptr<cv::StereoMatcher>& stereo_matcher) const {
+  CHECK(stereo_matcher);
+  std::lock_guard<std::mutex> lock(idle_stereo_matchers_mutex_);
+  idle_stereo_matchers_.emplace_back(stereo_matcher);
+}
+
 void StereoMatcher::computeDisparityMap(
     const cv::Mat& first_image, const cv::Mat& second_image,
     cv::Mat* disparity_map, cv::Mat* first_image_undistorted,
@@ -186,15 +210,17 @@ void StereoMatcher::computeDisparityMap(
   CHECK_NOTNULL(second_image_undistorted);
   CHECK(undistorter_first_);
   CHECK(undistorter_second_);
-  CHECK(stereo_matcher_);
 
   VLOG(5) << "Undistorting and rectifying images...";
   undistorter_first_->undistortImage(first_image, first_image_undistorted);
   undistorter_second_->undistortImage(second_image, second_image_undistorted);
 
   VLOG(5) << "Computing disparity map...";
-  stereo_matcher_->compute(
+  const cv::Ptr<cv::StereoMatcher> stereo_matcher =
+      acquireOpenCvStereoMatcher();
+  stereo_matcher->compute(
       *first_image_undistorted, *second_image_undistorted, *disparity_map);
+  releaseOpenCvStereoMatcher(stereo_matcher);
   VLOG(5) << "Done.";
 }
 
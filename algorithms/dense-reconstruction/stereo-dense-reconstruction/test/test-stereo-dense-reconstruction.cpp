@@ -1,9 +1,11 @@
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <Eigen/Dense>
 #include <aslam/cameras/camera-pinhole.h>
+#include <aslam/common/pose-types.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 #include <map-resources/resource-common.h>
@@ -384,6 +386,46 @@ TEST_F(StereoDenseReconstructionTest, TestStereoDenseReconstructionKitti) {
   computeStereoReconstruction("kitti", 559200u);
 }
 
+TEST_F(StereoDenseReconstructionTest, TestConcurrentStereoMatcher) {
+  setupBikeStereoDataset();
+
+  Eigen::VectorXd intrinsics_left(4), intrinsics_right(4);
+  intrinsics_left << K_left_(0, 0), K_left_(1, 1), K_left_(0, 2),
+      K_left_(1, 2);
+  intrinsics_right << K_right_(0, 0), K_right_(1, 1), K_right_(0, 2),
+      K_right_(1, 2);
+  const aslam::PinholeCamera camera_left(
+      intrinsics_left, resolution_.width, resolution_.height);
+  const aslam::PinholeCamera camera_right(
+      intrinsics_right, resolution_.width, resolution_.height);
+  const aslam::Transformation T_C2_C1(T_C2_G_);
+  const StereoMatcher matcher(camera_left, camera_right, T_C2_C1, config_);
+
+  cv::Mat expected_disparity, first_rectified, second_rectified;
+  matcher.computeDisparityMap(
+      img_left_, img_right_, &expected_disparity, &first_rectified,
+      &second_rectified);
+
+  constexpr size_t kNumThreads = 4u;
+  std::vector<cv::Mat> disparities(kNumThreads);
+  std::vector<std::thread> threads;
+  for (size_t thread_idx = 0u; thread_idx < kNumThreads; ++thread_idx) {
+    threads.emplace_back([&matcher, &disparities, thread_idx, this]() {
+      cv::Mat first_image_rectified, second_image_rectified;
+      matcher.computeDisparityMap(
+          img_left_, img_right_, &disparities[thread_idx],
+          &first_image_rectified, &second_image_rectified);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (const cv::Mat& disparity : disparities) {
+    EXPECT_TRUE(compareImages(disparity, expected_disparity));
+  }
+}
+
 }  // namespace stereo
 }  // namespace dense_reconstruction
 
@@ -0,0 +1,122 @@
+#ifndef LANDMARK_TRIANGULATION_POSE_INTERPOLATION_CACHE_H_
+#define LANDMARK_TRIANGULATION_POSE_INTERPOLATION_CACHE_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+#include <vi-map/unique-id.h>
+#include <vi-map/vi-map.h>
+
+#include "landmark-triangulation/pose-interpolator.h"
+
+namespace landmark_triangulation {
+
+// Caches the IMU-integrated trajectory of missions, such that repeated pose
+// queries, e.g. for every resource type of a mission, do not need to integrate
+// the IMU measurements of the whole mission again.
+//
+// On the first query of a mission, the IMU edges of the mission are
+// integrated in parallel and the resulting IMU-rate states are stored
+// contiguously per edge. Queries are then answered by a binary search and an
+// interpolation (lerp for position, velocity and biases, slerp for the
+// orientation) between the two neighboring IMU-rate states. This is slightly
+// less accurate than the PoseInterpolator, which integrates up to the exact
+// requested timestamp, but the difference is negligible at IMU rate.
+//
+// The cached trajectory of a mission is validated against the map on the
+// first query of the mission and on every call to update(). Validation checks
+// whether the state of the start vertex or the IMU measurements of an edge
+// have changed, e.g. after an optimization, and only integrates these edges
+// again. Structural changes of the mission, e.g. added or removed vertices,
+// rebuild the mission trajectory. Validation visits every IMU edge of the
+// mission, hence later queries skip it and use the cached trajectory as is.
+// Callers that change the map while keeping the cache need to call update()
+// or one of the invalidate functions.
+//
+// This class is not thread-safe.
+class PoseInterpolationCache {
+ public:
+  PoseInterpolationCache();
+  // num_threads is the number of threads used to integrate the IMU edges.
+  explicit PoseInterpolationCache(const size_t num_threads);
+
+  // Same as PoseInterpolator::getPosesAtTime(...), but uses the cached
+  // trajectory of the mission. The trajectory is only updated if the mission
+  // has not been validated yet or has been invalidated since.
+  void getPosesAtTime(
+      const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
+      const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& pose_timestamps,
+      aslam::TransformationVector* poses_M_I,
+      std::vector<Eigen::Vector3d>* velocities_M_I = nullptr,
+      std::vector<Eigen::Vector3d>* gyro_biases = nullptr,
+      std::vector<Eigen::Vector3d>* accel_biases = nullptr);
+
+  // Validates the cached trajectory of the mission against the map and brings
+  // it up to date. Returns the number of IMU edges that were integrated.
+  size_t update(const vi_map::VIMap& map, const vi_map::MissionId& mission_id);
+
+  // Forces the integration of this edge on the next update or query of its
+  // mission.
+  void invalidateEdge(const pose_graph::EdgeId& edge_id);
+  void invalidateMission(const vi_map::MissionId& mission_id);
+  void clear();
+
+  // Time range covered by the cached trajectory of the mission. The mission
+  // needs to be cached already.
+  void getTimeRange(
+      const vi_map::MissionId& mission_id, int64_t* min_timestamp_ns,
+      int64_t* max_timestamp_ns) const;
+
+ private:
+  struct EdgeTrajectory {
+    pose_graph::VertexId vertex_id;
+    pose_graph::EdgeId edge_id;
+    // State of the start vertex and summary of the IMU measurements this
+    // trajectory has been integrated with, used to detect changes.
+    Eigen::Matrix<double, 16, 1> start_state;
+    int64_t num_imu_measurements = 0;
+    int64_t first_imu_timestamp_ns = 0;
+    int64_t last_imu_timestamp_ns = 0;
+    bool is_valid = false;
+
+    std::vector<int64_t> timestamps_ns;
+    StateLinearizationPointVector states;
+  };
+  typedef std::vector<EdgeTrajectory> EdgeTrajectoryVector;
+
+  struct MissionTrajectory {
+    size_t num_vertices = 0u;
+    // True if the trajectory has been validated against the map and not been
+    // invalidated since.
+    bool is_validated = false;
+    // Edge trajectories in temporal order.
+    EdgeTrajectoryVector edges;
+    // Timestamp of the first state of every edge trajectory.
+    std::vector<int64_t> edge_start_times_ns;
+    std::unordered_map<pose_graph::EdgeId, size_t> edge_id_to_index;
+  };
+
+  static void getVertexState(
+      const vi_map::Vertex& vertex, Eigen::Matrix<double, 16, 1>* state);
+  static bool isEdgeTrajectoryUpToDate(
+      const vi_map::VIMap& map, const EdgeTrajectory& edge);
+  bool isMissionStructureUpToDate(
+      const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
+      const MissionTrajectory& trajectory) const;
+  void rebuildMissionTrajectory(
+      const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
+      MissionTrajectory* trajectory) const;
+
+  void interpolateState(
+      const MissionTrajectory& trajectory, const int64_t timestamp_ns,
+      StateLinearizationPoint* state) const;
+
+  const size_t num_threads_;
+  const PoseInterpolator pose_interpolator_;
+  std::unordered_map<vi_map::MissionId, MissionTrajectory> missions_;
+};
+
+}  // namespace landmark_triangulation
+
+#endif  // LANDMARK_TRIANGULATION_POSE_INTERPOLATION_CACHE_H_
@@ -37,6 +37,10 @@ struct StateLinearizationPoint {
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
+typedef std::vector<
+    StateLinearizationPoint, Eigen::aligned_allocator<StateLinearizationPoint>>
+    StateLinearizationPointVector;
+
 typedef std::unordered_map<pose_graph::VertexId, int64_t> VertexToTimeStampMap;
 
 // Interpolate position using linear approximation between two vertices.
@@ -45,6 +49,16 @@ bool interpolateLinear(
     const vi_map::VIMap& map, const vi_map::Vertex& vertex,
     int64_t offset_ns, aslam::Transformation* T_inter);
 
+// Integrates the given IMU measurements of the outgoing IMU edge of
+// vertex_begin_id, starting from the state of this vertex. Returns one state
+// for every IMU measurement.
+void integrateImuMeasurements(
+    const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
+    const pose_graph::VertexId& vertex_begin_id,
+    const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps,
+    const Eigen::Matrix<double, 6, Eigen::Dynamic>& imu_data,
+    StateLinearizationPointVector* states);
+
 class PoseInterpolator {
  public:
   // Returns interpolated poses for the mission specified by mission_id.
@@ -83,6 +97,12 @@ class PoseInterpolator {
       const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
       std::vector<int64_t>* vertex_timestamps_nanoseconds) const;
 
+  // Returns the vertices of the mission along the graph that have an outgoing
+  // IMU edge with measurements, together with the time range of this edge.
+  void buildVertexToTimeList(
+      const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
+      std::vector<VertexInformation>* vertices_and_time) const;
+
  private:
   typedef std::pair<const int64_t, StateLinearizationPoint>
       state_buffer_value_type;
@@ -104,10 +124,6 @@ class PoseInterpolator {
       Eigen::Matrix<int64_t, 1, Eigen::Dynamic>* imu_timestamps,
       Eigen::Matrix<double, 6, Eigen::Dynamic>* imu_data) const;
 
-  void buildVertexToTimeList(
-      const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
-      std::vector<VertexInformation>* vertices_and_time) const;
-
   void computeRequestedPosesInRange(
       const vi_map::VIMap& map, const vi_map::VIMission& mission,
       const pose_graph::VertexId& vertex_begin_id,
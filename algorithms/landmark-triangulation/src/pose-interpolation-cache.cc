@@ -0,0 +1,337 @@
+#include "landmark-triangulation/pose-interpolation-cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include <glog/logging.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
+
+namespace landmark_triangulation {
+
+PoseInterpolationCache::PoseInterpolationCache()
+    : PoseInterpolationCache(common::getNumHardwareThreads()) {}
+
+PoseInterpolationCache::PoseInterpolationCache(const size_t num_threads)
+    : num_threads_(std::max<size_t>(1u, num_threads)) {}
+
+void PoseInterpolationCache::getVertexState(
+    const vi_map::Vertex& vertex, Eigen::Matrix<double, 16, 1>* state) {
+  CHECK_NOTNULL(state);
+  const aslam::Transformation& T_M_I = vertex.get_T_M_I();
+  *state << T_M_I.getRotation().toImplementation().coeffs(),
+      T_M_I.getPosition(), vertex.get_v_M(), vertex.getGyroBias(),
+      vertex.getAccelBias();
+}
+
+bool PoseInterpolationCache::isEdgeTrajectoryUpToDate(
+    const vi_map::VIMap& map, const EdgeTrajectory& edge) {
+  if (!edge.is_valid) {
+    return false;
+  }
+  Eigen::Matrix<double, 16, 1> start_state;
+  getVertexState(map.getVertex(edge.vertex_id), &start_state);
+  if (start_state != edge.start_state) {
+    return false;
+  }
+  const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps =
+      map.getEdgeAs<vi_map::ViwlsEdge>(edge.edge_id).getImuTimestamps();
+  return imu_timestamps.cols() == edge.num_imu_measurements &&
+         imu_timestamps.cols() > 0 &&
+         imu_timestamps(0, 0) == edge.first_imu_timestamp_ns &&
+         imu_timestamps(0, imu_timestamps.cols() - 1) ==
+             edge.last_imu_timestamp_ns;
+}
+
+bool PoseInterpolationCache::isMissionStructureUpToDate(
+    const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
+    const MissionTrajectory& trajectory) const {
+  if (trajectory.edges.empty() ||
+      trajectory.num_vertices != map.numVerticesInMission(mission_id)) {
+    return false;
+  }
+  for (const EdgeTrajectory& edge : trajectory.edges) {
+    if (!map.hasVertex(edge.vertex_id) || !map.hasEdge(edge.edge_id)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PoseInterpolationCache::rebuildMissionTrajectory(
+    const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
+    MissionTrajectory* trajectory) const {
+  CHECK_NOTNULL(trajectory);
+  std::vector<VertexInformation> vertices_and_time;
+  pose_interpolator_.buildVertexToTimeList(
+      map, mission_id, &vertices_and_time);
+
+  // Keep the trajectories of the edges that are still part of the mission,
+  // they are checked for changes before they are used.
+  EdgeTrajectoryVector edges;
+  edges.reserve(vertices_and_time.size());
+  for (const VertexInformation& vertex_information : vertices_and_time) {
+    std::unordered_map<pose_graph::EdgeId, size_t>::const_iterator it =
+        trajectory->edge_id_to_index.find(
+            vertex_information.outgoing_imu_edge_id);
+    if (it != trajectory->edge_id_to_index.end() &&
+        trajectory->edges[it->second].vertex_id ==
+            vertex_information.vertex_id) {
+      edges.emplace_back(std::move(trajectory->edges[it->second]));
+    } else {
+      edges.emplace_back();
+      edges.back().vertex_id = vertex_information.vertex_id;
+      edges.back().edge_id = vertex_information.outgoing_imu_edge_id;
+    }
+  }
+
+  trajectory->edges.swap(edges);
+  trajectory->num_vertices = map.numVerticesInMission(mission_id);
+  trajectory->edge_id_to_index.clear();
+  trajectory->edge_start_times_ns.clear();
+  for (size_t edge_idx = 0u; edge_idx < trajectory->edges.size(); ++edge_idx) {
+    trajectory->edge_id_to_index.emplace(
+        trajectory->edges[edge_idx].edge_id, edge_idx);
+    trajectory->edge_start_times_ns.emplace_back(
+        vertices_and_time[edge_idx].timestamp_ns);
+  }
+}
+
+size_t PoseInterpolationCache::update(
+    const vi_map::VIMap& map, const vi_map::MissionId& mission_id) {
+  CHECK(mission_id.isValid());
+  MissionTrajectory& trajectory = missions_[mission_id];
+  if (!isMissionStructureUpToDate(map, mission_id, trajectory)) {
+    VLOG(3) << "Rebuilding the cached trajectory of mission " << mission_id;
+    rebuildMissionTrajectory(map, mission_id, &trajectory);
+  }
+
+  std::vector<size_t> outdated_edge_indices;
+  for (size_t edge_idx = 0u; edge_idx < trajectory.edges.size(); ++edge_idx) {
+    if (!isEdgeTrajectoryUpToDate(map, trajectory.edges[edge_idx])) {
+      outdated_edge_indices.emplace_back(edge_idx);
+    }
+  }
+  if (outdated_edge_indices.empty()) {
+    trajectory.is_validated = true;
+    return 0u;
+  }
+
+  // The edges are independent of each other since every edge is integrated
+  // starting from the state of its own start vertex.
+  std::function<void(const std::vector<size_t>&)> integrate_edges =
+      [&](const std::vector<size_t>& batch) {
+        for (const size_t outdated_idx : batch) {
+          EdgeTrajectory& edge =
+              trajectory.edges[outdated_edge_indices[outdated_idx]];
+          const vi_map::ViwlsEdge& imu_edge =
+              map.getEdgeAs<vi_map::ViwlsEdge>(edge.edge_id);
+          const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps =
+              imu_edge.getImuTimestamps();
+          CHECK_GT(imu_timestamps.cols(), 0);
+
+          integrateImuMeasurements(
+              map, mission_id, edge.vertex_id, imu_timestamps,
+              imu_edge.getImuData(), &edge.states);
+          edge.timestamps_ns.resize(edge.states.size());
+          for (size_t state_idx = 0u; state_idx < edge.states.size();
+               ++state_idx) {
+            edge.timestamps_ns[state_idx] = edge.states[state_idx].timestamp;
+          }
+
+          getVertexState(map.getVertex(edge.vertex_id), &edge.start_state);
+          edge.num_imu_measurements = imu_timestamps.cols();
+          edge.first_imu_timestamp_ns = imu_timestamps(0, 0);
+          edge.last_imu_timestamp_ns =
+              imu_timestamps(0, imu_timestamps.cols() - 1);
+          edge.is_valid = true;
+        }
+      };
+  constexpr bool kAlwaysParallelize = false;
+  common::ParallelProcess(
+      outdated_edge_indices.size(), integrate_edges, kAlwaysParallelize,
+      num_threads_);
+
+  for (const size_t edge_idx : outdated_edge_indices) {
+    trajectory.edge_start_times_ns[edge_idx] =
+        trajectory.edges[edge_idx].timestamps_ns.front();
+  }
+  trajectory.is_validated = true;
+  VLOG(3) << "Integrated " << outdated_edge_indices.size() << " out of "
+          << trajectory.edges.size() << " IMU edges of mission " << mission_id;
+  return outdated_edge_indices.size();
+}
+
+void PoseInterpolationCache::invalidateEdge(const pose_graph::EdgeId& edge_id) {
+  for (std::unordered_map<vi_map::MissionId, MissionTrajectory>::value_type&
+           mission_trajectory : missions_) {
+    MissionTrajectory& trajectory = mission_trajectory.second;
+    std::unordered_map<pose_graph::EdgeId, size_t>::const_iterator it =
+        trajectory.edge_id_to_index.find(edge_id);
+    if (it != trajectory.edge_id_to_index.end()) {
+      trajectory.edges[it->second].is_valid = false;
+      trajectory.is_validated = false;
+      return;
+    }
+  }
+}
+
+void PoseInterpolationCache::invalidateMission(
+    const vi_map::MissionId& mission_id) {
+  missions_.erase(mission_id);
+}
+
+void PoseInterpolationCache::clear() {
+  missions_.clear();
+}
+
+void PoseInterpolationCache::getTimeRange(
+    const vi_map::MissionId& mission_id, int64_t* min_timestamp_ns,
+    int64_t* max_timestamp_ns) const {
+  CHECK_NOTNULL(min_timestamp_ns);
+  CHECK_NOTNULL(max_timestamp_ns);
+  std::unordered_map<vi_map::MissionId, MissionTrajectory>::const_iterator it =
+      missions_.find(mission_id);
+  CHECK(it != missions_.end() && !it->second.edges.empty())
+      << "Mission " << mission_id << " is not cached.";
+  *min_timestamp_ns = it->second.edges.front().timestamps_ns.front();
+  *max_timestamp_ns = it->second.edges.back().timestamps_ns.back();
+}
+
+void PoseInterpolationCache::interpolateState(
+    const MissionTrajectory& trajectory, const int64_t timestamp_ns,
+    StateLinearizationPoint* state) const {
+  CHECK_NOTNULL(state);
+  const std::vector<int64_t>& edge_start_times_ns =
+      trajectory.edge_start_times_ns;
+
+  // Find the last edge that starts at or before the requested time. If
+  // consecutive edges share a timestamp, the later edge is used, like in the
+  // PoseInterpolator.
+  const size_t edge_idx =
+      std::distance(
+          edge_start_times_ns.begin(),
+          std::upper_bound(
+              edge_start_times_ns.begin(), edge_start_times_ns.end(),
+              timestamp_ns)) -
+      1u;
+  CHECK_LT(edge_idx, trajectory.edges.size());
+  const EdgeTrajectory& edge = trajectory.edges[edge_idx];
+  const std::vector<int64_t>& timestamps_ns = edge.timestamps_ns;
+
+  const StateLinearizationPoint* state_before = nullptr;
+  const StateLinearizationPoint* state_after = nullptr;
+  if (timestamp_ns <= timestamps_ns.back()) {
+    const size_t state_idx = std::distance(
+        timestamps_ns.begin(),
+        std::lower_bound(
+            timestamps_ns.begin(), timestamps_ns.end(), timestamp_ns));
+    CHECK_LT(state_idx, timestamps_ns.size());
+    if (timestamps_ns[state_idx] == timestamp_ns) {
+      *state = edge.states[state_idx];
+      return;
+    }
+    CHECK_GT(state_idx, 0u);
+    state_before = &edge.states[state_idx - 1u];
+    state_after = &edge.states[state_idx];
+  } else {
+    // The requested time lies in between the last measurement of this edge
+    // and the first measurement of the next edge.
+    CHECK_LT(edge_idx + 1u, trajectory.edges.size());
+    state_before = &edge.states.back();
+    state_after = &trajectory.edges[edge_idx + 1u].states.front();
+  }
+
+  const double alpha =
+      static_cast<double>(timestamp_ns - state_before->timestamp) /
+      static_cast<double>(state_after->timestamp - state_before->timestamp);
+  CHECK_GT(alpha, 0.0);
+  CHECK_LT(alpha, 1.0);
+  state->timestamp = timestamp_ns;
+  state->q_M_I = state_before->q_M_I.slerp(alpha, state_after->q_M_I);
+  state->p_M_I = (1.0 - alpha) * state_before->p_M_I +
+                 alpha * state_after->p_M_I;
+  state->v_M = (1.0 - alpha) * state_before->v_M + alpha * state_after->v_M;
+  state->gyro_bias = (1.0 - alpha) * state_before->gyro_bias +
+                     alpha * state_after->gyro_bias;
+  state->accel_bias = (1.0 - alpha) * state_before->accel_bias +
+                      alpha * state_after->accel_bias;
+}
+
+void PoseInterpolationCache::getPosesAtTime(
+    const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
+    const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& pose_timestamps,
+    aslam::TransformationVector* poses_M_I,
+    std::vector<Eigen::Vector3d>* velocities_M_I,
+    std::vector<Eigen::Vector3d>* gyro_biases,
+    std::vector<Eigen::Vector3d>* accel_biases) {
+  CHECK_NOTNULL(poses_M_I)->clear();
+  CHECK_GT(pose_timestamps.rows(), 0);
+
+  CHECK(
+      map.getGraphTraversalEdgeType(mission_id) ==
+      pose_graph::Edge::EdgeType::kViwls);
+
+  std::unordered_map<vi_map::MissionId, MissionTrajectory>::const_iterator it =
+      missions_.find(mission_id);
+  if (it == missions_.end() || !it->second.is_validated) {
+    update(map, mission_id);
+    it = missions_.find(mission_id);
+  }
+  CHECK(it != missions_.end());
+  const MissionTrajectory& trajectory = it->second;
+  CHECK_GT(trajectory.edges.size(), 1u)
+      << "The Viwls edges of mission " << mission_id
+      << " include none at all or only a single IMU "
+      << "measurement. Interpolation is not possible!";
+
+  int64_t smallest_time;
+  int64_t largest_time;
+  getTimeRange(mission_id, &smallest_time, &largest_time);
+
+  const size_t num_poses = pose_timestamps.cols();
+  poses_M_I->resize(num_poses);
+  if (velocities_M_I != nullptr) {
+    velocities_M_I->resize(num_poses);
+  }
+  if (gyro_biases != nullptr) {
+    gyro_biases->resize(num_poses);
+  }
+  if (accel_biases != nullptr) {
+    accel_biases->resize(num_poses);
+  }
+
+  std::function<void(const std::vector<size_t>&)> interpolate_poses =
+      [&](const std::vector<size_t>& batch) {
+        StateLinearizationPoint state;
+        for (const size_t pose_idx : batch) {
+          const int64_t timestamp_ns = pose_timestamps(0, pose_idx);
+          CHECK_GE(timestamp_ns, smallest_time)
+              << "Requested sample out of bounds! First available time is "
+              << smallest_time << " but " << timestamp_ns
+              << " was requested.";
+          CHECK_LE(timestamp_ns, largest_time)
+              << "Requested sample out of bounds! Last available time is "
+              << largest_time << " but " << timestamp_ns << " was requested.";
+          interpolateState(trajectory, timestamp_ns, &state);
+
+          (*poses_M_I)[pose_idx] =
+              aslam::Transformation(state.q_M_I, state.p_M_I);
+          if (velocities_M_I != nullptr) {
+            (*velocities_M_I)[pose_idx] = state.v_M;
+          }
+          if (gyro_biases != nullptr) {
+            (*gyro_biases)[pose_idx] = state.gyro_bias;
+          }
+          if (accel_biases != nullptr) {
+            (*accel_biases)[pose_idx] = state.accel_bias;
+          }
+        }
+      };
+  constexpr bool kAlwaysParallelize = false;
+  common::ParallelProcess(
+      num_poses, interpolate_poses, kAlwaysParallelize, num_threads_);
+}
+
+}  // namespace landmark_triangulation
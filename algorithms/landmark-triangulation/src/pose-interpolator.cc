@@ -118,21 +118,20 @@ void PoseInterpolator::buildListOfAllRequiredIMUMeasurements(
   }
 }
 
-void PoseInterpolator::computeRequestedPosesInRange(
-    const vi_map::VIMap& map, const vi_map::VIMission& mission,
+void integrateImuMeasurements(
+    const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
     const pose_graph::VertexId& vertex_begin_id,
-    const pose_graph::EdgeId& /*imu_edge_id*/,
     const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps,
     const Eigen::Matrix<double, 6, Eigen::Dynamic>& imu_data,
-    StateBuffer* state_buffer) const {
-  CHECK_NOTNULL(state_buffer);
+    StateLinearizationPointVector* states) {
+  CHECK_NOTNULL(states)->clear();
   CHECK_EQ(imu_timestamps.cols(), imu_data.cols());
   if (imu_data.cols() == 0) {
     return;
   }
+  states->reserve(imu_data.cols());
 
   using imu_integrator::ImuIntegratorRK4;
-  const vi_map::MissionId& mission_id = mission.id();
   CHECK(mission_id.isValid());
   const vi_map::Imu& imu_sensor = map.getMissionImu(mission_id);
   const vi_map::ImuSigmas& imu_sigmas = imu_sensor.getImuSigmas();
@@ -195,9 +194,7 @@ void PoseInterpolator::computeRequestedPosesInRange(
       current_state.segment<kAccelBiasBlockSize>(kStateAccelBiasOffset);
   state_linearization_point_begin.gyro_bias =
       current_state.segment<kGyroBiasBlockSize>(kStateGyroBiasOffset);
-  state_buffer->addValue(
-      state_linearization_point_begin.timestamp,
-      state_linearization_point_begin);
+  states->emplace_back(state_linearization_point_begin);
 
   // Now compute all the integrated values.
   for (int i = 0; i < imu_data.cols() - 1; ++i) {
@@ -235,13 +232,28 @@ void PoseInterpolator::computeRequestedPosesInRange(
         current_state.segment<kAccelBiasBlockSize>(kStateAccelBiasOffset);
     state_linearization_point.gyro_bias =
         current_state.segment<kGyroBiasBlockSize>(kStateGyroBiasOffset);
-    state_buffer->addValue(
-        state_linearization_point.timestamp, state_linearization_point);
+    states->emplace_back(state_linearization_point);
 
     current_state = next_state;
   }
 }
 
+void PoseInterpolator::computeRequestedPosesInRange(
+    const vi_map::VIMap& map, const vi_map::VIMission& mission,
+    const pose_graph::VertexId& vertex_begin_id,
+    const pose_graph::EdgeId& /*imu_edge_id*/,
+    const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps,
+    const Eigen::Matrix<double, 6, Eigen::Dynamic>& imu_data,
+    StateBuffer* state_buffer) const {
+  CHECK_NOTNULL(state_buffer);
+  StateLinearizationPointVector states;
+  integrateImuMeasurements(
+      map, mission.id(), vertex_begin_id, imu_timestamps, imu_data, &states);
+  for (const StateLinearizationPoint& state : states) {
+    state_buffer->addValue(state.timestamp, state);
+  }
+}
+
 void PoseInterpolator::getVertexToTimeStampMap(
     const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
     VertexToTimeStampMap* vertex_to_time_map, int64_t* min_timestamp_ns,
@@ -14,6 +14,7 @@
 #include <vi-map/pose-graph.h>
 #include <vi-map/vi-map.h>
 
+#include "landmark-triangulation/pose-interpolation-cache.h"
 #include "landmark-triangulation/pose-interpolator.h"
 
 namespace landmark_triangulation {
@@ -138,6 +139,80 @@ TEST_F(ViwlsGraph, PoseInterpolationTestBetweenVertices) {
   }
 }
 
+TEST_F(ViwlsGraph, PoseInterpolationCacheMatchesPoseInterpolator) {
+  vimap_gen_.generateVIMap();
+  vi_map::VIMap& vi_map = vimap_gen_.vi_map_;
+  vi_map::SixDofPoseGraphGenerator& graph_generator = vimap_gen_.graph_gen_;
+
+  vi_map::MissionIdList mission_ids;
+  vi_map.getAllMissionIds(&mission_ids);
+  CHECK_EQ(mission_ids.size(), 1u);
+  const vi_map::MissionId mission_id = mission_ids[0];
+
+  // Request the poses at the IMU timestamps and in between them.
+  const Eigen::VectorXd& imu_timestamps_seconds =
+      graph_generator.imu_timestamps_seconds_;
+  ASSERT_GT(imu_timestamps_seconds.rows(), 1);
+  const int num_requests = imu_timestamps_seconds.rows() / 2;
+  Eigen::Matrix<int64_t, 1, Eigen::Dynamic> timestamps_ns(2 * num_requests);
+  constexpr double kSecondsToNanoSeconds = 1e9;
+  for (int i = 0; i < num_requests; ++i) {
+    const int64_t t_ns = kSecondsToNanoSeconds * imu_timestamps_seconds(i);
+    const int64_t t_next_ns =
+        kSecondsToNanoSeconds * imu_timestamps_seconds(i + 1);
+    timestamps_ns(0, 2 * i) = t_ns;
+    timestamps_ns(0, 2 * i + 1) = (t_ns + t_next_ns) / 2;
+  }
+
+  PoseInterpolator pose_interpolator;
+  aslam::TransformationVector T_M_I_expected;
+  pose_interpolator.getPosesAtTime(
+      vi_map, mission_id, timestamps_ns, &T_M_I_expected);
+
+  PoseInterpolationCache pose_interpolation_cache;
+  aslam::TransformationVector T_M_I_cached;
+  std::vector<Eigen::Vector3d> velocities;
+  pose_interpolation_cache.getPosesAtTime(
+      vi_map, mission_id, timestamps_ns, &T_M_I_cached, &velocities);
+  ASSERT_EQ(T_M_I_cached.size(), T_M_I_expected.size());
+  ASSERT_EQ(velocities.size(), T_M_I_expected.size());
+  for (size_t i = 0u; i < T_M_I_cached.size(); ++i) {
+    EXPECT_NEAR_ASLAM_TRANSFORMATION(T_M_I_cached[i], T_M_I_expected[i], 1e-4);
+  }
+
+  // Nothing changed, hence nothing needs to be integrated again.
+  EXPECT_EQ(pose_interpolation_cache.update(vi_map, mission_id), 0u);
+
+  // Changing the state of a vertex only invalidates its outgoing IMU edge.
+  pose_graph::VertexIdList vertex_ids;
+  vi_map.getAllVertexIdsInMissionAlongGraph(mission_id, &vertex_ids);
+  ASSERT_GT(vertex_ids.size(), 2u);
+  vi_map::Vertex& vertex = vi_map.getVertex(vertex_ids[1]);
+  vertex.set_p_M_I(vertex.get_p_M_I() + Eigen::Vector3d(0.1, 0.0, 0.0));
+  // Queries of a validated mission don't check the map again, the change is
+  // only picked up by the explicit update.
+  pose_interpolation_cache.getPosesAtTime(
+      vi_map, mission_id, timestamps_ns, &T_M_I_cached);
+  EXPECT_EQ(pose_interpolation_cache.update(vi_map, mission_id), 1u);
+  EXPECT_EQ(pose_interpolation_cache.update(vi_map, mission_id), 0u);
+
+  // An invalidated edge is integrated again on the next update.
+  pose_graph::EdgeIdSet outgoing_edges;
+  vertex.getOutgoingEdges(&outgoing_edges);
+  pose_graph::EdgeId imu_edge_id;
+  for (const pose_graph::EdgeId& edge_id : outgoing_edges) {
+    if (vi_map.getEdgeType(edge_id) == pose_graph::Edge::EdgeType::kViwls) {
+      imu_edge_id = edge_id;
+    }
+  }
+  ASSERT_TRUE(imu_edge_id.isValid());
+  pose_interpolation_cache.invalidateEdge(imu_edge_id);
+  EXPECT_EQ(pose_interpolation_cache.update(vi_map, mission_id), 1u);
+
+  pose_interpolation_cache.invalidateMission(mission_id);
+  EXPECT_GT(pose_interpolation_cache.update(vi_map, mission_id), 1u);
+}
+
 }  // namespace landmark_triangulation
 
 MAPLAB_UNITTEST_ENTRYPOINT
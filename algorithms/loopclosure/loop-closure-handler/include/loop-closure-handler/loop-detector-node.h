@@ -2,6 +2,7 @@
 #define LOOP_CLOSURE_HANDLER_LOOP_DETECTOR_NODE_H_
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -62,6 +63,11 @@ class LoopDetectorNode final {
   void addLocalizationSummaryMapToDatabase(
       const summary_map::LocalizationSummaryMap& localization_summary_map);
 
+  // Localizes the nframe against the summary maps in the database. Multiple
+  // threads may call this concurrently, as long as the database isn't modified
+  // at the same time, i.e. summary maps, missions or vertices are only added
+  // and loop closures with landmark merging only run before or after the
+  // concurrent queries.
   bool findNFrameInSummaryMapDatabase(
       const aslam::VisualNFrame& n_frame, const bool skip_untracked_keypoints,
       const summary_map::LocalizationSummaryMap& localization_summary_map,
@@ -167,6 +173,8 @@ class LoopDetectorNode final {
       std::mutex* map_mutex) const;
 
   loop_closure_visualization::LoopClosureVisualizer::UniquePtr visualizer_;
+  // Serializes the visualization of concurrent summary map queries.
+  mutable std::mutex visualizer_mutex_;
   std::shared_ptr<matching_based_loopclosure::LoopDetector> loop_detector_;
   vi_map::MissionIdSet missions_in_database_;
   summary_map::LocalizationSummaryMapIdSet summary_maps_in_database_;
@@ -0,0 +1,110 @@
+#ifndef LOOP_CLOSURE_HANDLER_SUMMARY_MAP_TILE_CACHE_H_
+#define LOOP_CLOSURE_HANDLER_SUMMARY_MAP_TILE_CACHE_H_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+#include <localization-summary-map/localization-summary-map-queries.h>
+#include <localization-summary-map/localization-summary-map-tiling.h>
+#include <localization-summary-map/localization-summary-map.h>
+#include <maplab-common/macros.h>
+#include <maplab-common/pose_types.h>
+
+#include "loop-closure-handler/loop-detector-node.h"
+
+namespace loop_detector_node {
+
+// Keeps the tiles of a tiled localization summary map that are close to the
+// current position estimate resident, each with its own descriptor index.
+// Tiles are loaded and evicted on a background thread, such that queries never
+// block on disk access. As long as no position estimate is available, the
+// resident window sweeps over all tiles to allow for global localization.
+class SummaryMapTileCache {
+ public:
+  MAPLAB_POINTER_TYPEDEFS(SummaryMapTileCache);
+
+  struct ResidentTile {
+    MAPLAB_POINTER_TYPEDEFS(ResidentTile);
+    summary_map::SummaryMapTileIndex index;
+    summary_map::LocalizationSummaryMap::ConstPtr summary_map;
+    std::unique_ptr<const summary_map::SummaryMapCachedLookups> cached_lookups;
+    LoopDetectorNode::UniquePtr loop_detector;
+  };
+  typedef std::vector<ResidentTile::ConstPtr> ResidentTileList;
+
+  SummaryMapTileCache(
+      const summary_map::TiledLocalizationSummaryMap& tiled_map,
+      const bool visualize_localization);
+  ~SummaryMapTileCache();
+
+  // Returns the tiles that are currently resident. The returned tiles remain
+  // valid even if they are evicted in the meantime.
+  void getResidentTiles(ResidentTileList* resident_tiles) const;
+  // Returns the resident tiles a localization is queried against. With a
+  // position estimate these are the resident tiles within
+  // --lc_summary_map_tile_query_radius_m, sorted by increasing distance,
+  // otherwise all resident tiles.
+  void getTilesToQuery(ResidentTileList* tiles) const;
+
+  // Localizes the nframe against the tiles returned by getTilesToQuery and
+  // keeps the result with the most inliers. Updates the position estimate on
+  // success and reports a failure otherwise. Returns the tile the nframe was
+  // localized in, or nullptr if the localization failed.
+  ResidentTile::ConstPtr findNFrameInTiles(
+      const aslam::VisualNFrame& n_frame, const bool skip_untracked_keypoints,
+      pose::Transformation* T_G_I,
+      vi_map::VertexKeyPointToStructureMatchList* inlier_structure_matches);
+
+  // Updates the position the resident tiles are centered around, typically
+  // the position of the last successful localization.
+  void updatePositionEstimate(const Eigen::Vector3d& p_G);
+  // Reports a failed localization. After too many consecutive failures the
+  // position estimate is dropped and the cache falls back to sweeping.
+  // Failures are ignored while tiles are being loaded.
+  void reportLocalizationFailure();
+
+  size_t numResidentTiles() const;
+
+ private:
+  void tileManagementThread();
+  // Determines the tiles that should be resident given the current position
+  // estimate or sweep state.
+  void getDesiredTiles(summary_map::SummaryMapTileIndexList* desired_tiles);
+  ResidentTile::ConstPtr loadTile(
+      const summary_map::SummaryMapTileIndex& index) const;
+
+  // Only holds the tile index, so it is cheap to copy.
+  const summary_map::TiledLocalizationSummaryMap tiled_map_;
+  const bool visualize_localization_;
+  const double load_radius_m_;
+  const double query_radius_m_;
+  const size_t max_num_resident_tiles_;
+  const int max_num_consecutive_failures_;
+
+  mutable std::mutex m_resident_tiles_;
+  std::unordered_map<summary_map::SummaryMapTileIndex, ResidentTile::ConstPtr>
+      resident_tiles_;
+
+  mutable std::mutex m_position_estimate_;
+  std::condition_variable cv_position_estimate_;
+  bool has_position_estimate_;
+  Eigen::Vector3d p_G_estimate_;
+  int num_consecutive_failures_;
+  // Sweep state used without position estimate.
+  summary_map::SummaryMapTileIndexList all_tiles_;
+  size_t sweep_start_index_;
+  bool update_requested_;
+  bool is_updating_tiles_;
+  bool shutdown_requested_;
+
+  std::thread tile_management_thread_;
+};
+
+}  // namespace loop_detector_node
+
+#endif  // LOOP_CLOSURE_HANDLER_SUMMARY_MAP_TILE_CACHE_H_
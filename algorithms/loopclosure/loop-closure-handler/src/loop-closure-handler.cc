@@ -585,6 +585,7 @@ void LoopClosureHandler::updateQueryKeyframeInvalidLandmarkAssociations(
 
       query_vertex->setObservedLandmarkId(
           query_frame_idx, query_keypoint_idx, map_landmark_id);
+      map_->invalidateCovisibilityGraph();
 
       vi_map::Vertex& map_landmark_vertex =
           map_->getLandmarkStoreVertex(map_landmark_id);
@@ -612,6 +613,10 @@ void LoopClosureHandler::mergeLandmarks(
   statistics::StatsCollector stats_total_merge_calls(
       "0.4 Loop closure: Total merge calls");
 
+  // The merges are applied in bulk after all inliers have been processed.
+  std::vector<std::pair<vi_map::LandmarkId, vi_map::LandmarkId>>
+      landmark_merges;
+  landmark_merges.reserve(inliers.size());
   for (unsigned int i = 0; i < inliers.size(); ++i) {
     vi_map::LandmarkId query_landmark_to_be_deleted =
         query_landmark_to_map_landmark_pairs[inliers[i]].first;
@@ -664,12 +669,13 @@ void LoopClosureHandler::mergeLandmarks(
       Eigen::Vector3d p_G_landmark_map = map_->getLandmark_G_p_fi(map_landmark);
 
       stats_total_merge_calls.IncrementOne();
-      map_->mergeLandmarks(query_landmark_to_be_deleted, map_landmark);
+      landmark_merges.emplace_back(query_landmark_to_be_deleted, map_landmark);
 
       landmark_pairs_actually_merged->emplace_back(
           p_G_landmark_query, p_G_landmark_map);
     }
   }
+  map_->mergeLandmarks(landmark_merges);
 }
 
 pose_graph::VertexId
@@ -466,6 +466,7 @@ bool LoopDetectorNode::findNFrameInSummaryMapDatabase(
       inlier_structure_matches, kVertexIdClosestToStructureMatches);
 
   if (visualizer_ && success) {
+    std::lock_guard<std::mutex> lock(visualizer_mutex_);
     visualizer_->visualizeSummaryMapDatabase(localization_summary_map);
     visualizer_->visualizeKeyframeToStructureMatch(
         *inlier_structure_matches, T_G_I->getPosition(),
@@ -0,0 +1,296 @@
+#include "loop-closure-handler/summary-map-tile-cache.h"
+
+#include <algorithm>
+#include <unordered_set>
+#include <utility>
+
+#include <aslam/common/memory.h>
+#include <aslam/common/statistics/statistics.h>
+#include <aslam/common/timer.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+DEFINE_double(
+    lc_summary_map_tile_load_radius_m, 50.0,
+    "Tiles of a tiled localization summary map that are closer than this to "
+    "the current position estimate are kept resident.");
+DEFINE_double(
+    lc_summary_map_tile_query_radius_m, 20.0,
+    "Once the position in a tiled localization summary map is known, only the "
+    "resident tiles closer than this to the position estimate are used for "
+    "localization.");
+DEFINE_int32(
+    lc_summary_map_max_num_resident_tiles, 16,
+    "Maximum number of tiles of a tiled localization summary map that are "
+    "resident at the same time. Bounds the memory usage independent of the "
+    "total map size.");
+DEFINE_int32(
+    lc_summary_map_tile_max_num_consecutive_failures, 10,
+    "Number of consecutive failed localizations after which the position "
+    "estimate is dropped and the resident tiles sweep over the whole map, or, "
+    "while sweeping, after which the next tiles are loaded.");
+
+namespace loop_detector_node {
+
+SummaryMapTileCache::SummaryMapTileCache(
+    const summary_map::TiledLocalizationSummaryMap& tiled_map,
+    const bool visualize_localization)
+    : tiled_map_(tiled_map),
+      visualize_localization_(visualize_localization),
+      load_radius_m_(FLAGS_lc_summary_map_tile_load_radius_m),
+      query_radius_m_(FLAGS_lc_summary_map_tile_query_radius_m),
+      max_num_resident_tiles_(FLAGS_lc_summary_map_max_num_resident_tiles),
+      max_num_consecutive_failures_(
+          FLAGS_lc_summary_map_tile_max_num_consecutive_failures),
+      has_position_estimate_(false),
+      p_G_estimate_(Eigen::Vector3d::Zero()),
+      num_consecutive_failures_(0),
+      sweep_start_index_(0u),
+      update_requested_(true),
+      is_updating_tiles_(false),
+      shutdown_requested_(false) {
+  CHECK_GE(load_radius_m_, 0.0);
+  CHECK_GE(query_radius_m_, 0.0);
+  CHECK_GT(FLAGS_lc_summary_map_max_num_resident_tiles, 0);
+  CHECK_GT(max_num_consecutive_failures_, 0);
+  tiled_map_.getAllTileIndices(&all_tiles_);
+  LOG_IF(WARNING, all_tiles_.empty())
+      << "The tiled localization summary map contains no tiles.";
+  tile_management_thread_ =
+      std::thread(&SummaryMapTileCache::tileManagementThread, this);
+}
+
+SummaryMapTileCache::~SummaryMapTileCache() {
+  {
+    std::lock_guard<std::mutex> lock(m_position_estimate_);
+    shutdown_requested_ = true;
+  }
+  cv_position_estimate_.notify_all();
+  tile_management_thread_.join();
+}
+
+void SummaryMapTileCache::getResidentTiles(
+    ResidentTileList* resident_tiles) const {
+  CHECK_NOTNULL(resident_tiles)->clear();
+  std::lock_guard<std::mutex> lock(m_resident_tiles_);
+  resident_tiles->reserve(resident_tiles_.size());
+  for (const std::pair<
+           const summary_map::SummaryMapTileIndex, ResidentTile::ConstPtr>&
+           value : resident_tiles_) {
+    resident_tiles->push_back(value.second);
+  }
+}
+
+void SummaryMapTileCache::getTilesToQuery(ResidentTileList* tiles) const {
+  CHECK_NOTNULL(tiles)->clear();
+  bool has_position_estimate;
+  Eigen::Vector3d p_G_estimate;
+  {
+    std::lock_guard<std::mutex> lock(m_position_estimate_);
+    has_position_estimate = has_position_estimate_;
+    p_G_estimate = p_G_estimate_;
+  }
+  if (!has_position_estimate) {
+    getResidentTiles(tiles);
+    return;
+  }
+
+  summary_map::SummaryMapTileIndexList nearby_tiles;
+  tiled_map_.getTileIndicesWithinRadius(
+      p_G_estimate, query_radius_m_, &nearby_tiles);
+  std::lock_guard<std::mutex> lock(m_resident_tiles_);
+  for (const summary_map::SummaryMapTileIndex& index : nearby_tiles) {
+    const auto it = resident_tiles_.find(index);
+    if (it != resident_tiles_.end()) {
+      tiles->push_back(it->second);
+    }
+  }
+}
+
+SummaryMapTileCache::ResidentTile::ConstPtr
+SummaryMapTileCache::findNFrameInTiles(
+    const aslam::VisualNFrame& n_frame, const bool skip_untracked_keypoints,
+    pose::Transformation* T_G_I,
+    vi_map::VertexKeyPointToStructureMatchList* inlier_structure_matches) {
+  CHECK_NOTNULL(T_G_I);
+  CHECK_NOTNULL(inlier_structure_matches)->clear();
+
+  ResidentTileList tiles;
+  getTilesToQuery(&tiles);
+  statistics::StatsCollector stat_queried(
+      "SummaryMapTileCache: num queried tiles");
+  stat_queried.AddSample(tiles.size());
+
+  // Every tile has its own database, keep the localization with the most
+  // inliers.
+  ResidentTile::ConstPtr best_tile;
+  for (const ResidentTile::ConstPtr& tile : tiles) {
+    CHECK(tile);
+    pose::Transformation T_G_I_tile;
+    unsigned int num_lc_matches;
+    vi_map::VertexKeyPointToStructureMatchList tile_inlier_structure_matches;
+    const bool success = tile->loop_detector->findNFrameInSummaryMapDatabase(
+        n_frame, skip_untracked_keypoints, *tile->summary_map, &T_G_I_tile,
+        &num_lc_matches, &tile_inlier_structure_matches);
+    if (success && tile_inlier_structure_matches.size() >
+                       inlier_structure_matches->size()) {
+      best_tile = tile;
+      inlier_structure_matches->swap(tile_inlier_structure_matches);
+      *T_G_I = T_G_I_tile;
+    }
+  }
+
+  if (best_tile == nullptr) {
+    reportLocalizationFailure();
+    return nullptr;
+  }
+  updatePositionEstimate(T_G_I->getPosition());
+  return best_tile;
+}
+
+size_t SummaryMapTileCache::numResidentTiles() const {
+  std::lock_guard<std::mutex> lock(m_resident_tiles_);
+  return resident_tiles_.size();
+}
+
+void SummaryMapTileCache::updatePositionEstimate(const Eigen::Vector3d& p_G) {
+  {
+    std::lock_guard<std::mutex> lock(m_position_estimate_);
+    has_position_estimate_ = true;
+    p_G_estimate_ = p_G;
+    num_consecutive_failures_ = 0;
+    update_requested_ = true;
+  }
+  cv_position_estimate_.notify_one();
+}
+
+void SummaryMapTileCache::reportLocalizationFailure() {
+  {
+    std::lock_guard<std::mutex> lock(m_position_estimate_);
+    if (update_requested_ || is_updating_tiles_) {
+      return;
+    }
+    ++num_consecutive_failures_;
+    if (num_consecutive_failures_ < max_num_consecutive_failures_) {
+      return;
+    }
+    num_consecutive_failures_ = 0;
+    if (has_position_estimate_) {
+      VLOG(1) << "Lost track of the position in the tiled summary map, "
+              << "sweeping over all tiles.";
+      has_position_estimate_ = false;
+    } else if (!all_tiles_.empty()) {
+      sweep_start_index_ =
+          (sweep_start_index_ + max_num_resident_tiles_) % all_tiles_.size();
+    }
+    update_requested_ = true;
+  }
+  cv_position_estimate_.notify_one();
+}
+
+void SummaryMapTileCache::getDesiredTiles(
+    summary_map::SummaryMapTileIndexList* desired_tiles) {
+  CHECK_NOTNULL(desired_tiles)->clear();
+  if (has_position_estimate_) {
+    tiled_map_.getTileIndicesWithinRadius(
+        p_G_estimate_, load_radius_m_, desired_tiles);
+    if (desired_tiles->size() > max_num_resident_tiles_) {
+      desired_tiles->resize(max_num_resident_tiles_);
+    }
+    return;
+  }
+
+  const size_t num_tiles = std::min(max_num_resident_tiles_, all_tiles_.size());
+  for (size_t i = 0u; i < num_tiles; ++i) {
+    desired_tiles->push_back(
+        all_tiles_[(sweep_start_index_ + i) % all_tiles_.size()]);
+  }
+}
+
+SummaryMapTileCache::ResidentTile::ConstPtr SummaryMapTileCache::loadTile(
+    const summary_map::SummaryMapTileIndex& index) const {
+  timing::Timer timer("SummaryMapTileCache: load tile");
+  summary_map::LocalizationSummaryMap::Ptr summary_map =
+      tiled_map_.loadTile(index);
+  if (!summary_map) {
+    LOG(ERROR) << "Failed to load " << index.toString() << ".";
+    return nullptr;
+  }
+
+  ResidentTile::Ptr tile = std::make_shared<ResidentTile>();
+  tile->index = index;
+  tile->summary_map = summary_map;
+  tile->cached_lookups.reset(
+      new summary_map::SummaryMapCachedLookups(*summary_map));
+  tile->loop_detector = aligned_unique<LoopDetectorNode>();
+  if (visualize_localization_) {
+    tile->loop_detector->instantiateVisualizer();
+  }
+  tile->loop_detector->addLocalizationSummaryMapToDatabase(*summary_map);
+  timer.Stop();
+  return tile;
+}
+
+void SummaryMapTileCache::tileManagementThread() {
+  while (true) {
+    summary_map::SummaryMapTileIndexList desired_tiles;
+    {
+      std::unique_lock<std::mutex> lock(m_position_estimate_);
+      cv_position_estimate_.wait(
+          lock, [this]() { return update_requested_ || shutdown_requested_; });
+      if (shutdown_requested_) {
+        return;
+      }
+      update_requested_ = false;
+      is_updating_tiles_ = true;
+      getDesiredTiles(&desired_tiles);
+    }
+
+    // Evict first, such that the number of resident tiles stays bounded.
+    const std::unordered_set<summary_map::SummaryMapTileIndex> desired_set(
+        desired_tiles.begin(), desired_tiles.end());
+    summary_map::SummaryMapTileIndexList tiles_to_load;
+    {
+      std::lock_guard<std::mutex> lock(m_resident_tiles_);
+      for (auto it = resident_tiles_.begin(); it != resident_tiles_.end();) {
+        if (desired_set.count(it->first) == 0u) {
+          VLOG(2) << "Evicting " << it->first.toString() << ".";
+          it = resident_tiles_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      for (const summary_map::SummaryMapTileIndex& index : desired_tiles) {
+        if (resident_tiles_.count(index) == 0u) {
+          tiles_to_load.push_back(index);
+        }
+      }
+    }
+
+    // The desired tiles are sorted by distance, so the closest ones become
+    // available first.
+    for (const summary_map::SummaryMapTileIndex& index : tiles_to_load) {
+      {
+        std::lock_guard<std::mutex> lock(m_position_estimate_);
+        if (shutdown_requested_) {
+          return;
+        }
+      }
+      ResidentTile::ConstPtr tile = loadTile(index);
+      if (!tile) {
+        continue;
+      }
+      VLOG(2) << "Loaded " << index.toString() << ".";
+      std::lock_guard<std::mutex> lock(m_resident_tiles_);
+      resident_tiles_.emplace(index, tile);
+      statistics::StatsCollector stat_resident(
+          "SummaryMapTileCache: num resident tiles");
+      stat_resident.AddSample(resident_tiles_.size());
+    }
+
+    std::lock_guard<std::mutex> lock(m_position_estimate_);
+    is_updating_tiles_ = false;
+  }
+}
+
+}  // namespace loop_detector_node
@@ -0,0 +1,389 @@
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/cameras/random-camera-generator.h>
+#include <aslam/common/unique-id.h>
+#include <gflags/gflags.h>
+#include <localization-summary-map/localization-summary-map-creation.h>
+#include <localization-summary-map/localization-summary-map-tiling.h>
+#include <localization-summary-map/localization-summary-map.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/map-manager-config.h>
+#include <maplab-common/pose_types.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <maplab-common/test/testing-predicates.h>
+#include <posegraph/unique-id.h>
+#include <vi-map/test/vi-map-generator.h>
+#include <vi-map/vi-map.h>
+
+#include "loop-closure-handler/loop-detector-node.h"
+#include "loop-closure-handler/summary-map-tile-cache.h"
+
+DECLARE_double(lc_min_image_time_seconds);
+DECLARE_double(lc_summary_map_tile_load_radius_m);
+DECLARE_double(lc_summary_map_tile_query_radius_m);
+DECLARE_int32(lc_summary_map_max_num_resident_tiles);
+DECLARE_int32(lc_summary_map_tile_max_num_consecutive_failures);
+
+namespace loop_detector_node {
+
+namespace {
+constexpr size_t kNumVertices = 10u;
+constexpr double kVertexSpacingMeters = 1.0;
+constexpr size_t kNumLandmarks = 300u;
+// Landmarks are only observed by vertices that are at most this far away
+// along the trajectory, such that they are well within the field of view.
+constexpr double kMaxLateralLandmarkOffsetMeters = 3.0;
+constexpr double kPositionToleranceMeters = 1e-3;
+// The vertices span the tiles (0, 0), (0, 1) and (0, 2).
+constexpr double kTileSizeMeters = 4.0;
+constexpr size_t kNumTiles = 3u;
+
+// Polls the predicate until it holds or the timeout expires.
+template <typename Predicate>
+bool waitUntil(const Predicate& predicate) {
+  constexpr int kNumPolls = 1000;
+  for (int poll = 0; poll < kNumPolls; ++poll) {
+    if (predicate()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return predicate();
+}
+
+std::unordered_set<summary_map::SummaryMapTileIndex> getTileIndices(
+    const SummaryMapTileCache::ResidentTileList& tiles) {
+  std::unordered_set<summary_map::SummaryMapTileIndex> indices;
+  for (const SummaryMapTileCache::ResidentTile::ConstPtr& tile : tiles) {
+    indices.insert(tile->index);
+  }
+  return indices;
+}
+
+std::unordered_set<summary_map::SummaryMapTileIndex> getResidentTileIndices(
+    const SummaryMapTileCache& tile_cache) {
+  SummaryMapTileCache::ResidentTileList resident_tiles;
+  tile_cache.getResidentTiles(&resident_tiles);
+  return getTileIndices(resident_tiles);
+}
+}  // namespace
+
+class SummaryMapLocalizationTest : public ::testing::Test {
+ protected:
+  struct QueryResult {
+    bool success;
+    pose::Transformation T_G_I;
+    unsigned int num_lc_matches;
+    size_t num_inliers;
+  };
+
+  SummaryMapLocalizationTest() : tiled_map_folder_("./tiled_summary_map") {}
+
+  virtual void SetUp() {
+    FLAGS_lc_min_image_time_seconds = 0.0;
+    original_load_radius_m_ = FLAGS_lc_summary_map_tile_load_radius_m;
+    original_query_radius_m_ = FLAGS_lc_summary_map_tile_query_radius_m;
+    original_max_num_resident_tiles_ =
+        FLAGS_lc_summary_map_max_num_resident_tiles;
+    original_max_num_consecutive_failures_ =
+        FLAGS_lc_summary_map_tile_max_num_consecutive_failures;
+    constructMap();
+  }
+
+  virtual void TearDown() {
+    FLAGS_lc_summary_map_tile_load_radius_m = original_load_radius_m_;
+    FLAGS_lc_summary_map_tile_query_radius_m = original_query_radius_m_;
+    FLAGS_lc_summary_map_max_num_resident_tiles =
+        original_max_num_resident_tiles_;
+    FLAGS_lc_summary_map_tile_max_num_consecutive_failures =
+        original_max_num_consecutive_failures_;
+    if (common::pathExists(tiled_map_folder_)) {
+      common::removePath(tiled_map_folder_);
+    }
+  }
+
+  // The vertices move along the y-axis of the map frame and their camera looks
+  // along the x-axis at a wall of landmarks.
+  void constructMap();
+
+  void createSummaryMap(
+      const vi_map::LandmarkIdList& landmark_ids,
+      summary_map::LocalizationSummaryMap* summary_map) const;
+
+  QueryResult localizeVertex(
+      const LoopDetectorNode& loop_detector,
+      const summary_map::LocalizationSummaryMap& summary_map,
+      const pose_graph::VertexId& vertex_id) const;
+
+  void expectLocalizedAtVertex(
+      const QueryResult& result, const pose_graph::VertexId& vertex_id) const;
+
+  // Splits the summary map of all landmarks into tiles and stores them on
+  // disk.
+  void createTiledSummaryMap(
+      summary_map::TiledLocalizationSummaryMap* tiled_map) const;
+
+  const std::string tiled_map_folder_;
+  double original_load_radius_m_;
+  double original_query_radius_m_;
+  int original_max_num_resident_tiles_;
+  int original_max_num_consecutive_failures_;
+
+  vi_map::VIMap map_;
+  pose_graph::VertexIdList vertex_ids_;
+  vi_map::LandmarkIdList landmark_ids_;
+};
+
+void SummaryMapLocalizationTest::constructMap() {
+  vi_map::VIMapGenerator generator(map_, 42);
+  generator.setCameraRig(aslam::createTestNCamera(1u));
+  const vi_map::MissionId mission_id =
+      generator.createMission(pose::Transformation());
+
+  for (size_t vertex_idx = 0u; vertex_idx < kNumVertices; ++vertex_idx) {
+    const pose::Transformation T_G_I(
+        pose::Quaternion(), Eigen::Vector3d(
+                                0.0, kVertexSpacingMeters * vertex_idx, 0.0));
+    vertex_ids_.emplace_back(generator.createVertex(mission_id, T_G_I));
+  }
+
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> depth_distribution(8.0, 12.0);
+  std::uniform_real_distribution<double> lateral_distribution(
+      -kMaxLateralLandmarkOffsetMeters,
+      kVertexSpacingMeters * (kNumVertices - 1u) +
+          kMaxLateralLandmarkOffsetMeters);
+  std::uniform_real_distribution<double> height_distribution(-2.0, 2.0);
+  for (size_t landmark_idx = 0u; landmark_idx < kNumLandmarks;
+       ++landmark_idx) {
+    const Eigen::Vector3d p_G_fi(
+        depth_distribution(rng), lateral_distribution(rng),
+        height_distribution(rng));
+    pose_graph::VertexIdList observers;
+    for (size_t vertex_idx = 0u; vertex_idx < kNumVertices; ++vertex_idx) {
+      if (std::abs(p_G_fi.y() - kVertexSpacingMeters * vertex_idx) <
+          kMaxLateralLandmarkOffsetMeters) {
+        observers.emplace_back(vertex_ids_[vertex_idx]);
+      }
+    }
+    if (observers.size() < 2u) {
+      continue;
+    }
+    const pose_graph::VertexId storing_vertex_id = observers.front();
+    observers.erase(observers.begin());
+    landmark_ids_.emplace_back(
+        generator.createLandmark(p_G_fi, storing_vertex_id, observers));
+  }
+
+  generator.generateMap();
+}
+
+void SummaryMapLocalizationTest::createSummaryMap(
+    const vi_map::LandmarkIdList& landmark_ids,
+    summary_map::LocalizationSummaryMap* summary_map) const {
+  CHECK_NOTNULL(summary_map);
+  summary_map::LocalizationSummaryMapId summary_map_id;
+  aslam::generateId(&summary_map_id);
+  summary_map->setId(summary_map_id);
+  summary_map::createLocalizationSummaryMapFromLandmarkList(
+      map_, landmark_ids, summary_map);
+}
+
+SummaryMapLocalizationTest::QueryResult
+SummaryMapLocalizationTest::localizeVertex(
+    const LoopDetectorNode& loop_detector,
+    const summary_map::LocalizationSummaryMap& summary_map,
+    const pose_graph::VertexId& vertex_id) const {
+  constexpr bool kSkipUntrackedKeypoints = false;
+  QueryResult result;
+  vi_map::VertexKeyPointToStructureMatchList inlier_structure_matches;
+  result.success = loop_detector.findNFrameInSummaryMapDatabase(
+      map_.getVertex(vertex_id).getVisualNFrame(), kSkipUntrackedKeypoints,
+      summary_map, &result.T_G_I, &result.num_lc_matches,
+      &inlier_structure_matches);
+  result.num_inliers = inlier_structure_matches.size();
+  return result;
+}
+
+void SummaryMapLocalizationTest::expectLocalizedAtVertex(
+    const QueryResult& result, const pose_graph::VertexId& vertex_id) const {
+  ASSERT_TRUE(result.success);
+  EXPECT_GT(result.num_inliers, 0u);
+  EXPECT_NEAR_EIGEN(
+      result.T_G_I.getPosition(), map_.getVertex_G_p_I(vertex_id),
+      kPositionToleranceMeters);
+}
+
+void SummaryMapLocalizationTest::createTiledSummaryMap(
+    summary_map::TiledLocalizationSummaryMap* tiled_map) const {
+  CHECK_NOTNULL(tiled_map);
+  summary_map::LocalizationSummaryMap summary_map;
+  createSummaryMap(landmark_ids_, &summary_map);
+  summary_map::SummaryMapTiles tiles;
+  summary_map::splitLocalizationSummaryMapIntoTiles(
+      summary_map, kTileSizeMeters, &tiles);
+  ASSERT_EQ(tiles.size(), kNumTiles);
+
+  backend::SaveConfig save_config;
+  save_config.overwrite_existing_files = true;
+  ASSERT_TRUE(
+      summary_map::TiledLocalizationSummaryMap::saveToFolder(
+          tiles, kTileSizeMeters, tiled_map_folder_, save_config));
+  ASSERT_TRUE(tiled_map->loadFromFolder(tiled_map_folder_));
+}
+
+TEST_F(SummaryMapLocalizationTest, ConcurrentQueriesMatchSerialQueries) {
+  summary_map::LocalizationSummaryMap summary_map;
+  createSummaryMap(landmark_ids_, &summary_map);
+  LoopDetectorNode loop_detector;
+  loop_detector.addLocalizationSummaryMapToDatabase(summary_map);
+
+  std::vector<QueryResult> serial_results;
+  for (const pose_graph::VertexId& vertex_id : vertex_ids_) {
+    serial_results.emplace_back(
+        localizeVertex(loop_detector, summary_map, vertex_id));
+    expectLocalizedAtVertex(serial_results.back(), vertex_id);
+  }
+
+  // Every thread localizes all vertices, starting at a different one, such
+  // that different queries overlap.
+  constexpr size_t kNumThreads = 4u;
+  constexpr size_t kNumRepetitions = 3u;
+  std::vector<std::vector<QueryResult>> concurrent_results(
+      kNumThreads,
+      std::vector<QueryResult>(kNumRepetitions * vertex_ids_.size()));
+  std::vector<std::thread> threads;
+  for (size_t thread_idx = 0u; thread_idx < kNumThreads; ++thread_idx) {
+    threads.emplace_back([&, thread_idx]() {
+      std::vector<QueryResult>& results = concurrent_results[thread_idx];
+      for (size_t query_idx = 0u; query_idx < results.size(); ++query_idx) {
+        const size_t vertex_idx =
+            (query_idx + thread_idx) % vertex_ids_.size();
+        results[query_idx] =
+            localizeVertex(loop_detector, summary_map, vertex_ids_[vertex_idx]);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t thread_idx = 0u; thread_idx < kNumThreads; ++thread_idx) {
+    const std::vector<QueryResult>& results = concurrent_results[thread_idx];
+    for (size_t query_idx = 0u; query_idx < results.size(); ++query_idx) {
+      const size_t vertex_idx = (query_idx + thread_idx) % vertex_ids_.size();
+      const QueryResult& serial_result = serial_results[vertex_idx];
+      expectLocalizedAtVertex(results[query_idx], vertex_ids_[vertex_idx]);
+      EXPECT_EQ(
+          results[query_idx].num_lc_matches, serial_result.num_lc_matches);
+      EXPECT_EQ(results[query_idx].num_inliers, serial_result.num_inliers);
+    }
+  }
+}
+
+TEST_F(SummaryMapLocalizationTest, TileCacheEvictsTilesFarFromPosition) {
+  summary_map::TiledLocalizationSummaryMap tiled_map;
+  createTiledSummaryMap(&tiled_map);
+
+  FLAGS_lc_summary_map_tile_load_radius_m = 1.0;
+  FLAGS_lc_summary_map_max_num_resident_tiles = 2;
+  constexpr bool kVisualizeLocalization = false;
+  SummaryMapTileCache tile_cache(tiled_map, kVisualizeLocalization);
+
+  // Without a position estimate the cache sweeps over the tiles.
+  EXPECT_TRUE(waitUntil(
+      [&tile_cache]() { return tile_cache.numResidentTiles() == 2u; }));
+
+  // Only the tile that contains the position is within the load radius, all
+  // other tiles are evicted.
+  const std::unordered_set<summary_map::SummaryMapTileIndex> last_tile = {
+      summary_map::SummaryMapTileIndex(0, 2)};
+  tile_cache.updatePositionEstimate(Eigen::Vector3d(0.0, 10.0, 0.0));
+  EXPECT_TRUE(waitUntil([&tile_cache, &last_tile]() {
+    return getResidentTileIndices(tile_cache) == last_tile;
+  }));
+
+  const std::unordered_set<summary_map::SummaryMapTileIndex> first_tile = {
+      summary_map::SummaryMapTileIndex(0, 0)};
+  tile_cache.updatePositionEstimate(Eigen::Vector3d(0.0, 2.0, 0.0));
+  EXPECT_TRUE(waitUntil([&tile_cache, &first_tile]() {
+    return getResidentTileIndices(tile_cache) == first_tile;
+  }));
+}
+
+TEST_F(SummaryMapLocalizationTest, TileCacheSweepsOverAllTiles) {
+  summary_map::TiledLocalizationSummaryMap tiled_map;
+  createTiledSummaryMap(&tiled_map);
+
+  FLAGS_lc_summary_map_max_num_resident_tiles = 1;
+  FLAGS_lc_summary_map_tile_max_num_consecutive_failures = 2;
+  constexpr bool kVisualizeLocalization = false;
+  SummaryMapTileCache tile_cache(tiled_map, kVisualizeLocalization);
+
+  // Failed localizations move the resident window to the next tile, at no
+  // point more than one tile is resident.
+  std::unordered_set<summary_map::SummaryMapTileIndex> visited_tiles;
+  EXPECT_TRUE(waitUntil([&tile_cache, &visited_tiles]() {
+    EXPECT_LE(tile_cache.numResidentTiles(), 1u);
+    const std::unordered_set<summary_map::SummaryMapTileIndex> resident_tiles =
+        getResidentTileIndices(tile_cache);
+    visited_tiles.insert(resident_tiles.begin(), resident_tiles.end());
+    tile_cache.reportLocalizationFailure();
+    return visited_tiles.size() == kNumTiles;
+  }));
+}
+
+TEST_F(SummaryMapLocalizationTest, LocalizesInTilesNearPositionEstimate) {
+  summary_map::TiledLocalizationSummaryMap tiled_map;
+  createTiledSummaryMap(&tiled_map);
+
+  FLAGS_lc_summary_map_tile_query_radius_m = 0.5;
+  constexpr bool kVisualizeLocalization = false;
+  SummaryMapTileCache tile_cache(tiled_map, kVisualizeLocalization);
+  ASSERT_TRUE(waitUntil(
+      [&tile_cache]() { return tile_cache.numResidentTiles() == kNumTiles; }));
+
+  // Without a position estimate all resident tiles are queried.
+  SummaryMapTileCache::ResidentTileList tiles_to_query;
+  tile_cache.getTilesToQuery(&tiles_to_query);
+  EXPECT_EQ(tiles_to_query.size(), kNumTiles);
+
+  // The last vertex is localized in its own tile, which has the most inliers.
+  constexpr bool kSkipUntrackedKeypoints = false;
+  const pose_graph::VertexId& last_vertex_id = vertex_ids_.back();
+  QueryResult result;
+  vi_map::VertexKeyPointToStructureMatchList inlier_structure_matches;
+  SummaryMapTileCache::ResidentTile::ConstPtr tile =
+      tile_cache.findNFrameInTiles(
+          map_.getVertex(last_vertex_id).getVisualNFrame(),
+          kSkipUntrackedKeypoints, &result.T_G_I, &inlier_structure_matches);
+  ASSERT_TRUE(tile != nullptr);
+  EXPECT_EQ(tile->index, summary_map::SummaryMapTileIndex(0, 2));
+  result.success = true;
+  result.num_inliers = inlier_structure_matches.size();
+  expectLocalizedAtVertex(result, last_vertex_id);
+
+  // The successful localization restricts the queries to the nearby tile.
+  tile_cache.getTilesToQuery(&tiles_to_query);
+  const std::unordered_set<summary_map::SummaryMapTileIndex> last_tile = {
+      summary_map::SummaryMapTileIndex(0, 2)};
+  EXPECT_EQ(getTileIndices(tiles_to_query), last_tile);
+
+  // The first vertex doesn't share any landmarks with the last tile.
+  tile = tile_cache.findNFrameInTiles(
+      map_.getVertex(vertex_ids_.front()).getVisualNFrame(),
+      kSkipUntrackedKeypoints, &result.T_G_I, &inlier_structure_matches);
+  EXPECT_TRUE(tile == nullptr);
+  EXPECT_TRUE(inlier_structure_matches.empty());
+}
+
+}  // namespace loop_detector_node
+
+MAPLAB_UNITTEST_ENTRYPOINT
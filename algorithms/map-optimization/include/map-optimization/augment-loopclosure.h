@@ -8,6 +8,9 @@ int augmentOptimizationProblemWithLoopclosureEdges(
     OptimizationProblem* problem);
 
 int numLoopclosureEdges(const vi_map::VIMap& map);
+// Only counts the loop closure edges between vertices of the given missions.
+int numLoopclosureEdges(
+    const vi_map::VIMap& map, const vi_map::MissionIdSet& mission_ids);
 
 }  // namespace map_optimization
 #endif  // MAP_OPTIMIZATION_AUGMENT_LOOPCLOSURE_H_
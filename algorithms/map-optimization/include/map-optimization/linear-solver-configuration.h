@@ -0,0 +1,59 @@
+#ifndef MAP_OPTIMIZATION_LINEAR_SOLVER_CONFIGURATION_H_
+#define MAP_OPTIMIZATION_LINEAR_SOLVER_CONFIGURATION_H_
+
+#include <memory>
+#include <string>
+
+#include <ceres/ceres.h>
+
+#include "map-optimization/optimization-problem.h"
+
+namespace map_optimization {
+
+// Elimination groups of the parameter blocks, lower groups are eliminated
+// first.
+enum EliminationGroup : int {
+  kLandmarkGroup = 0,
+  kVelocityAndBiasGroup = 1,
+  kVertexPoseGroup = 2,
+  kOtherStatesGroup = 3
+};
+
+struct ProblemSizeStatistics {
+  size_t num_vertices = 0u;
+  size_t num_landmarks = 0u;
+  // Landmarks whose position isn't held constant, i.e. the blocks that can be
+  // eliminated by a Schur complement.
+  size_t num_free_landmarks = 0u;
+  size_t num_parameter_blocks = 0u;
+
+  std::string toString() const;
+};
+
+// Assigns all parameter blocks of the ceres problem to an elimination group:
+// landmark positions first, then velocities and biases, then vertex poses and
+// finally all remaining states such as baseframes, extrinsics and intrinsics.
+// Returns nullptr if the problem contains no landmarks, in which case the
+// first group wouldn't be an independent set.
+std::shared_ptr<ceres::ParameterBlockOrdering> buildEliminationOrdering(
+    const ceres::Problem& problem, OptimizationProblem* optimization_problem,
+    ProblemSizeStatistics* statistics);
+
+// Picks a Schur solver if landmarks are optimized and a solver for pose graphs
+// otherwise. Above --ba_auto_linear_solver_max_vertices_for_factorization
+// vertices, the iterative variant with a Jacobi preconditioner is used instead
+// of a sparse factorization.
+void selectLinearSolver(
+    const ProblemSizeStatistics& statistics,
+    ceres::Solver::Options* solver_options);
+
+// Picks the linear solver and preconditioner based on the problem size if
+// --ba_linear_solver_type is AUTO and installs the elimination ordering for
+// Schur solvers if enabled with --ba_use_elimination_ordering.
+void configureLinearSolverForProblem(
+    const ceres::Problem& problem, OptimizationProblem* optimization_problem,
+    ceres::Solver::Options* solver_options);
+
+}  // namespace map_optimization
+
+#endif  // MAP_OPTIMIZATION_LINEAR_SOLVER_CONFIGURATION_H_
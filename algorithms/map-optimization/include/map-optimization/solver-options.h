@@ -54,7 +54,10 @@ inline ceres::Solver::Options initSolverOptionsFromFlags() {
 
   options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
 
-  if (FLAGS_ba_linear_solver_type == "CGNR") {
+  if (FLAGS_ba_linear_solver_type == "AUTO") {
+    // Refined for each problem in configureLinearSolverForProblem.
+    options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+  } else if (FLAGS_ba_linear_solver_type == "CGNR") {
     options.linear_solver_type = ceres::CGNR;
   } else if (FLAGS_ba_linear_solver_type == "SPARSE_NORMAL_CHOLESKY") {
     options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
@@ -2,6 +2,7 @@
 #define MAP_OPTIMIZATION_VI_MAP_OPTIMIZER_H_
 
 #include <string>
+#include <vector>
 
 #include <ceres/ceres.h>
 #include <map-optimization/outlier-rejection-solver.h>
@@ -34,10 +35,32 @@ class VIMapOptimizer {
       const vi_map::MissionIdSet& missions_to_optimize, vi_map::VIMap* map);
 
  private:
+  // Builds and solves a single problem containing all given missions.
+  void optimizeJointly(
+      const map_optimization::ViProblemOptions& options,
+      const vi_map::MissionIdSet& missions_to_optimize, vi_map::VIMap* map,
+      OptimizationProblemResult* result);
+
+  // Solves every cluster as a separate problem, multiple clusters at the same
+  // time. The clusters must not share any states, see
+  // getIndependentMissionClusters().
+  void optimizeClustersInParallel(
+      const map_optimization::ViProblemOptions& options,
+      const std::vector<vi_map::MissionIdSet>& mission_clusters,
+      vi_map::VIMap* map, OptimizationProblemResult* result);
+
   const visualization::ViwlsGraphRvizPlotter* plotter_;
   bool signal_handler_enabled_;
 };
 
+// Splits the missions into clusters that don't share any optimization state,
+// i.e. missions of different clusters neither co-observe landmarks, nor are
+// connected by loop closure edges, nor share a sensor whose calibration is
+// part of the problem. Such clusters can be optimized independently.
+void getIndependentMissionClusters(
+    const vi_map::VIMap& map, const vi_map::MissionIdSet& mission_ids,
+    std::vector<vi_map::MissionIdSet>* mission_clusters);
+
 }  // namespace map_optimization
 
 #endif  // MAP_OPTIMIZATION_VI_MAP_OPTIMIZER_H_
@@ -207,4 +207,23 @@ int numLoopclosureEdges(const vi_map::VIMap& map) {
   return num_lc_edges;
 }
 
+int numLoopclosureEdges(
+    const vi_map::VIMap& map, const vi_map::MissionIdSet& mission_ids) {
+  pose_graph::EdgeIdList edges;
+  map.getAllEdgeIds(&edges);
+
+  int num_lc_edges = 0;
+  for (const pose_graph::EdgeId edge_id : edges) {
+    if (map.getEdgeType(edge_id) == pose_graph::Edge::EdgeType::kLoopClosure) {
+      const vi_map::Edge& edge = map.getEdgeAs<vi_map::Edge>(edge_id);
+      if (mission_ids.count(map.getVertex(edge.from()).getMissionId()) > 0u &&
+          mission_ids.count(map.getVertex(edge.to()).getMissionId()) > 0u) {
+        ++num_lc_edges;
+      }
+    }
+  }
+
+  return num_lc_edges;
+}
+
 }  // namespace map_optimization
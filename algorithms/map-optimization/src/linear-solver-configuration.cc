@@ -0,0 +1,176 @@
+#include "map-optimization/linear-solver-configuration.h"
+
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include <aslam/common/timer.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "map-optimization/solver-options.h"
+
+DEFINE_bool(
+    ba_use_elimination_ordering, true,
+    "If enabled, the parameter blocks are ordered such that landmarks are "
+    "eliminated first, followed by velocities and biases, vertex poses and "
+    "all other states.");
+DEFINE_int32(
+    ba_auto_linear_solver_max_vertices_for_factorization, 20000,
+    "If --ba_linear_solver_type is AUTO, problems with more vertices than "
+    "this are solved with an iterative linear solver instead of a sparse "
+    "factorization.");
+
+namespace map_optimization {
+
+std::string ProblemSizeStatistics::toString() const {
+  std::stringstream ss;
+  ss << num_vertices << " vertices, " << num_landmarks << " landmarks ("
+     << num_free_landmarks << " free), " << num_parameter_blocks
+     << " parameter blocks";
+  return ss.str();
+}
+
+std::shared_ptr<ceres::ParameterBlockOrdering> buildEliminationOrdering(
+    const ceres::Problem& problem, OptimizationProblem* optimization_problem,
+    ProblemSizeStatistics* statistics) {
+  CHECK_NOTNULL(optimization_problem);
+  CHECK_NOTNULL(statistics);
+  *statistics = ProblemSizeStatistics();
+
+  vi_map::VIMap* map = CHECK_NOTNULL(optimization_problem->getMapMutable());
+  OptimizationStateBuffer* state_buffer =
+      CHECK_NOTNULL(optimization_problem->getOptimizationStateBufferMutable());
+
+  std::unordered_map<const double*, int> parameter_block_to_group;
+  auto assign_to_group = [&](double* parameter_block, const int group) {
+    if (problem.HasParameterBlock(parameter_block)) {
+      parameter_block_to_group[parameter_block] = group;
+    }
+  };
+
+  // The landmark positions are stored in the map itself.
+  const OptimizationProblem::ProblemBookkeeping& bookkeeping =
+      *optimization_problem->getProblemBookkeepingMutable();
+  for (auto it = bookkeeping.landmarks_in_problem.begin();
+       it != bookkeeping.landmarks_in_problem.end();
+       it = bookkeeping.landmarks_in_problem.equal_range(it->first).second) {
+    double* p_B = map->getLandmark(it->first).get_p_B_Mutable();
+    if (!problem.HasParameterBlock(p_B)) {
+      continue;
+    }
+    parameter_block_to_group[p_B] = EliminationGroup::kLandmarkGroup;
+    ++statistics->num_landmarks;
+    if (!problem.IsParameterBlockConstant(p_B)) {
+      ++statistics->num_free_landmarks;
+    }
+  }
+
+  pose_graph::VertexIdList mission_vertex_ids;
+  for (const vi_map::MissionId& mission_id :
+       optimization_problem->getMissionIds()) {
+    map->getAllVertexIdsInMissionAlongGraph(mission_id, &mission_vertex_ids);
+    statistics->num_vertices += mission_vertex_ids.size();
+    for (const pose_graph::VertexId& vertex_id : mission_vertex_ids) {
+      vi_map::Vertex& vertex = map->getVertex(vertex_id);
+      assign_to_group(
+          vertex.get_v_M_Mutable(), EliminationGroup::kVelocityAndBiasGroup);
+      assign_to_group(
+          vertex.getAccelBiasMutable(),
+          EliminationGroup::kVelocityAndBiasGroup);
+      assign_to_group(
+          vertex.getGyroBiasMutable(), EliminationGroup::kVelocityAndBiasGroup);
+      assign_to_group(
+          state_buffer->get_vertex_q_IM__M_p_MI_JPL(vertex_id),
+          EliminationGroup::kVertexPoseGroup);
+    }
+  }
+
+  std::vector<double*> parameter_blocks;
+  problem.GetParameterBlocks(&parameter_blocks);
+  statistics->num_parameter_blocks = parameter_blocks.size();
+  if (statistics->num_landmarks == 0u) {
+    return nullptr;
+  }
+
+  // Every parameter block of the problem needs to be part of the ordering,
+  // all unclassified ones are eliminated last.
+  std::shared_ptr<ceres::ParameterBlockOrdering> ordering(
+      new ceres::ParameterBlockOrdering);
+  for (double* parameter_block : parameter_blocks) {
+    const std::unordered_map<const double*, int>::const_iterator it =
+        parameter_block_to_group.find(parameter_block);
+    ordering->AddElementToGroup(
+        parameter_block, it != parameter_block_to_group.end()
+                             ? it->second
+                             : EliminationGroup::kOtherStatesGroup);
+  }
+  return ordering;
+}
+
+void selectLinearSolver(
+    const ProblemSizeStatistics& statistics,
+    ceres::Solver::Options* solver_options) {
+  CHECK_NOTNULL(solver_options);
+  const bool use_factorization =
+      statistics.num_vertices <=
+      static_cast<size_t>(
+          FLAGS_ba_auto_linear_solver_max_vertices_for_factorization);
+  // Only landmarks that are actually optimized can be eliminated by the Schur
+  // complement, otherwise the problem is a pure pose graph.
+  if (statistics.num_free_landmarks > 0u) {
+    if (use_factorization) {
+      solver_options->linear_solver_type = ceres::SPARSE_SCHUR;
+    } else {
+      solver_options->linear_solver_type = ceres::ITERATIVE_SCHUR;
+      solver_options->preconditioner_type = ceres::SCHUR_JACOBI;
+    }
+  } else {
+    if (use_factorization) {
+      solver_options->linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+    } else {
+      solver_options->linear_solver_type = ceres::CGNR;
+      solver_options->preconditioner_type = ceres::JACOBI;
+    }
+  }
+}
+
+void configureLinearSolverForProblem(
+    const ceres::Problem& problem, OptimizationProblem* optimization_problem,
+    ceres::Solver::Options* solver_options) {
+  CHECK_NOTNULL(optimization_problem);
+  CHECK_NOTNULL(solver_options);
+  const bool select_linear_solver = FLAGS_ba_linear_solver_type == "AUTO";
+  if (!select_linear_solver && !FLAGS_ba_use_elimination_ordering) {
+    return;
+  }
+
+  timing::Timer timer("BA: Linear solver configuration");
+  ProblemSizeStatistics statistics;
+  std::shared_ptr<ceres::ParameterBlockOrdering> ordering =
+      buildEliminationOrdering(problem, optimization_problem, &statistics);
+
+  if (select_linear_solver) {
+    selectLinearSolver(statistics, solver_options);
+  }
+  // Without landmarks Ceres picks the ordering on its own. The ordering is
+  // only used to define the eliminated blocks of the Schur solvers, the
+  // fill-reducing ordering of the other solvers is left to Ceres.
+  if (FLAGS_ba_use_elimination_ordering && ordering != nullptr &&
+      ceres::IsSchurType(solver_options->linear_solver_type)) {
+    solver_options->linear_solver_ordering = ordering;
+  }
+  timer.Stop();
+
+  VLOG(1) << "Problem size: " << statistics.toString() << ", using "
+          << ceres::LinearSolverTypeToString(solver_options->linear_solver_type)
+          << " with "
+          << ceres::PreconditionerTypeToString(
+                 solver_options->preconditioner_type)
+          << " preconditioner"
+          << (solver_options->linear_solver_ordering != nullptr
+                  ? " and an explicit elimination ordering."
+                  : ".");
+}
+
+}  // namespace map_optimization
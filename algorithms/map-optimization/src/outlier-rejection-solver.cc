@@ -3,6 +3,7 @@
 #include <aslam/common/timer.h>
 #include <ceres/ceres.h>
 #include <gflags/gflags.h>
+#include <map-optimization/linear-solver-configuration.h>
 #include <maplab-common/parallel-process.h>
 #include <vi-map/landmark-quality-metrics.h>
 
@@ -116,6 +117,8 @@ ceres::TerminationType solveStep(
 
   ceres::Solver::Options local_options = solver_options;
   local_options.callbacks.push_back(callback);
+  configureLinearSolverForProblem(
+      problem, optimization_problem, &local_options);
 
   // Reusing the trust region size from the last iteration.
   if (!callback->iteration_summaries_.empty()) {
@@ -12,8 +12,9 @@ DEFINE_bool(
 DEFINE_bool(ba_use_jacobi_scaling, true, "Use jacobin scaling.");
 DEFINE_string(
     ba_linear_solver_type, "SPARSE_NORMAL_CHOLESKY",
-    "Options: 'CGNR', 'SPARSE_NORMAL_CHOLESKY', 'SPARSE_SCHUR', "
-    "'ITERATIVE_SCHUR'.");
+    "Options: 'AUTO', 'CGNR', 'SPARSE_NORMAL_CHOLESKY', 'SPARSE_SCHUR', "
+    "'ITERATIVE_SCHUR'. AUTO picks the solver and preconditioner based on the "
+    "size of each problem.");
 DEFINE_bool(
     ba_use_nonmonotonic_steps, false,
     "If enabled, the objective function is allowed to get worse for a max "
@@ -3,6 +3,8 @@
 #include <ceres-error-terms/problem-information.h>
 #include <ceres/ceres.h>
 
+#include "map-optimization/linear-solver-configuration.h"
+
 namespace map_optimization {
 
 ceres::TerminationType solve(
@@ -24,13 +26,17 @@ ceres::TerminationType solve(
 
   IterationSummaryCallback callback;
   ceres::Solver::Options local_options = solver_options;
+  configureLinearSolverForProblem(
+      problem, optimization_problem, &local_options);
   if (result != nullptr) {
     // Install callback to retrieve IterationSummaries.
     local_options.callbacks.push_back(&callback);
   }
 
   ceres::Solver::Summary summary;
-  ceres::Solve(solver_options, &problem, &summary);
+  ceres::Solve(local_options, &problem, &summary);
+  VLOG(1) << "Linear solver time: " << summary.linear_solver_time_in_seconds
+          << "s of " << summary.total_time_in_seconds << "s total.";
 
   optimization_problem->getOptimizationStateBufferMutable()
       ->copyAllStatesBackToMap(optimization_problem->getMapMutable());
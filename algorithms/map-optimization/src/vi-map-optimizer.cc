@@ -7,10 +7,16 @@
 #include <map-optimization/solver.h>
 #include <map-optimization/vi-optimization-builder.h>
 #include <maplab-common/file-logger.h>
+#include <maplab-common/parallel-process.h>
 #include <maplab-common/progress-bar.h>
+#include <maplab-common/threading-helpers.h>
+#include <maplab-common/union-find.h>
+#include <vi-map-helpers/mission-clustering-coobservation.h>
 #include <visualization/viwls-graph-plotter.h>
 
+#include <algorithm>
 #include <functional>
+#include <numeric>
 #include <string>
 #include <unordered_map>
 
@@ -18,8 +24,106 @@ DEFINE_int32(
     ba_visualize_every_n_iterations, 3,
     "Update the visualization every n optimization iterations.");
 
+DEFINE_bool(
+    ba_optimize_independent_mission_clusters_in_parallel, false,
+    "If enabled, missions that don't share any landmarks, loop closure edges "
+    "or sensors are optimized as separate problems in parallel. The "
+    "iteration-wise visualization is disabled in this case.");
+
+DEFINE_int32(
+    ba_max_num_parallel_mission_clusters, 0,
+    "Maximum number of independent mission clusters that are optimized at the "
+    "same time. 0 uses one per hardware thread.");
+
 namespace map_optimization {
 
+namespace {
+
+void getSensorIdsOfMission(
+    const vi_map::VIMap& map, const vi_map::MissionId& mission_id,
+    std::vector<aslam::SensorId>* sensor_ids) {
+  CHECK_NOTNULL(sensor_ids)->clear();
+  const vi_map::VIMission& mission = map.getMission(mission_id);
+  if (mission.hasNCamera()) {
+    const aslam::NCamera& ncamera = map.getMissionNCamera(mission_id);
+    sensor_ids->emplace_back(ncamera.getId());
+    for (size_t cam_idx = 0u; cam_idx < ncamera.getNumCameras(); ++cam_idx) {
+      sensor_ids->emplace_back(ncamera.getCamera(cam_idx).getId());
+    }
+  }
+  if (mission.hasAbsolute6DoFSensor()) {
+    sensor_ids->emplace_back(mission.getAbsolute6DoFSensor());
+  }
+  if (mission.hasOdometry6DoFSensor()) {
+    sensor_ids->emplace_back(mission.getOdometry6DoFSensor());
+  }
+  if (mission.hasWheelOdometrySensor()) {
+    sensor_ids->emplace_back(mission.getWheelOdometrySensor());
+  }
+}
+
+void solveProblem(
+    const map_optimization::ViProblemOptions& options,
+    const ceres::Solver::Options& solver_options,
+    OptimizationProblem* optimization_problem,
+    OptimizationProblemResult* result) {
+  CHECK_NOTNULL(optimization_problem);
+  if (options.enable_visual_outlier_rejection) {
+    map_optimization::solveWithOutlierRejection(
+        solver_options, options.visual_outlier_rejection_options,
+        optimization_problem, result);
+  } else {
+    map_optimization::solve(solver_options, optimization_problem, result);
+  }
+}
+
+}  // namespace
+
+void getIndependentMissionClusters(
+    const vi_map::VIMap& map, const vi_map::MissionIdSet& mission_ids,
+    std::vector<vi_map::MissionIdSet>* mission_clusters) {
+  CHECK_NOTNULL(mission_clusters)->clear();
+  const std::vector<vi_map::MissionIdSet> coobservation_clusters =
+      vi_map_helpers::clusterMissionByLandmarkCoobservations(map, mission_ids);
+  const size_t num_clusters = coobservation_clusters.size();
+
+  // Sensor calibrations are shared states, hence clusters using a common
+  // sensor are merged.
+  common::UnionFind<size_t> cluster_sets;
+  cluster_sets.reserve(num_clusters);
+  std::unordered_map<aslam::SensorId, size_t> sensor_id_to_cluster_idx;
+  std::vector<aslam::SensorId> sensor_ids;
+  for (size_t cluster_idx = 0u; cluster_idx < num_clusters; ++cluster_idx) {
+    cluster_sets.add(cluster_idx);
+    for (const vi_map::MissionId& mission_id :
+         coobservation_clusters[cluster_idx]) {
+      getSensorIdsOfMission(map, mission_id, &sensor_ids);
+      for (const aslam::SensorId& sensor_id : sensor_ids) {
+        const std::pair<std::unordered_map<aslam::SensorId, size_t>::iterator,
+                        bool>
+            insertion =
+                sensor_id_to_cluster_idx.emplace(sensor_id, cluster_idx);
+        if (!insertion.second) {
+          cluster_sets.merge(cluster_idx, insertion.first->second);
+        }
+      }
+    }
+  }
+
+  std::unordered_map<size_t, size_t> root_to_output_idx;
+  for (size_t cluster_idx = 0u; cluster_idx < num_clusters; ++cluster_idx) {
+    const size_t root = cluster_sets.find(cluster_idx);
+    const std::pair<std::unordered_map<size_t, size_t>::iterator, bool>
+        insertion = root_to_output_idx.emplace(root, mission_clusters->size());
+    if (insertion.second) {
+      mission_clusters->emplace_back();
+    }
+    (*mission_clusters)[insertion.first->second].insert(
+        coobservation_clusters[cluster_idx].begin(),
+        coobservation_clusters[cluster_idx].end());
+  }
+}
+
 VIMapOptimizer::VIMapOptimizer(
     const visualization::ViwlsGraphRvizPlotter* plotter,
     bool signal_handler_enabled)
@@ -43,6 +147,30 @@ bool VIMapOptimizer::optimize(
     return false;
   }
 
+  std::vector<vi_map::MissionIdSet> mission_clusters;
+  if (FLAGS_ba_optimize_independent_mission_clusters_in_parallel &&
+      missions_to_optimize.size() > 1u) {
+    getIndependentMissionClusters(
+        *map, missions_to_optimize, &mission_clusters);
+  }
+
+  if (mission_clusters.size() > 1u) {
+    optimizeClustersInParallel(options, mission_clusters, map, result);
+  } else {
+    optimizeJointly(options, missions_to_optimize, map, result);
+  }
+
+  if (plotter_ != nullptr) {
+    plotter_->visualizeMap(*map);
+  }
+  return true;
+}
+
+void VIMapOptimizer::optimizeJointly(
+    const map_optimization::ViProblemOptions& options,
+    const vi_map::MissionIdSet& missions_to_optimize, vi_map::VIMap* map,
+    OptimizationProblemResult* result) {
+  CHECK_NOTNULL(map);
   map_optimization::OptimizationProblem::UniquePtr optimization_problem(
       map_optimization::constructOptimizationProblem(
           missions_to_optimize, options, map));
@@ -62,19 +190,113 @@ bool VIMapOptimizer::optimize(
   map_optimization::addCallbacksToSolverOptions(
       callbacks, &solver_options_with_callbacks);
 
-  if (options.enable_visual_outlier_rejection) {
-    map_optimization::solveWithOutlierRejection(
-        solver_options_with_callbacks, options.visual_outlier_rejection_options,
-        optimization_problem.get(), result);
-  } else {
-    map_optimization::solve(
-        solver_options_with_callbacks, optimization_problem.get(), result);
+  solveProblem(
+      options, solver_options_with_callbacks, optimization_problem.get(),
+      result);
+}
+
+void VIMapOptimizer::optimizeClustersInParallel(
+    const map_optimization::ViProblemOptions& options,
+    const std::vector<vi_map::MissionIdSet>& mission_clusters,
+    vi_map::VIMap* map, OptimizationProblemResult* result) {
+  CHECK_NOTNULL(map);
+  const size_t num_clusters = mission_clusters.size();
+  CHECK_GT(num_clusters, 1u);
+
+  size_t max_num_workers = common::getNumHardwareThreads();
+  if (FLAGS_ba_max_num_parallel_mission_clusters > 0) {
+    max_num_workers =
+        static_cast<size_t>(FLAGS_ba_max_num_parallel_mission_clusters);
   }
+  const size_t num_workers =
+      std::max<size_t>(1u, std::min(num_clusters, max_num_workers));
 
-  if (plotter_ != nullptr) {
-    plotter_->visualizeMap(*map);
+  // Assign the largest clusters first, always to the worker with the least
+  // work so far, which balances the workers without knowing the solve times.
+  std::vector<size_t> cluster_sizes(num_clusters, 0u);
+  for (size_t cluster_idx = 0u; cluster_idx < num_clusters; ++cluster_idx) {
+    for (const vi_map::MissionId& mission_id : mission_clusters[cluster_idx]) {
+      cluster_sizes[cluster_idx] += map->numVerticesInMission(mission_id);
+    }
+  }
+  std::vector<size_t> ordered_cluster_indices(num_clusters);
+  std::iota(ordered_cluster_indices.begin(), ordered_cluster_indices.end(), 0u);
+  std::sort(
+      ordered_cluster_indices.begin(), ordered_cluster_indices.end(),
+      [&cluster_sizes](const size_t lhs, const size_t rhs) {
+        return cluster_sizes[lhs] > cluster_sizes[rhs];
+      });
+  std::vector<std::vector<size_t>> worker_cluster_indices(num_workers);
+  std::vector<size_t> worker_load(num_workers, 0u);
+  for (const size_t cluster_idx : ordered_cluster_indices) {
+    const size_t worker_idx = std::distance(
+        worker_load.begin(),
+        std::min_element(worker_load.begin(), worker_load.end()));
+    worker_cluster_indices[worker_idx].emplace_back(cluster_idx);
+    worker_load[worker_idx] += cluster_sizes[cluster_idx];
+  }
+
+  // Every worker gets an equal share of the thread budget of the solver.
+  ceres::Solver::Options cluster_solver_options = options.solver_options;
+  cluster_solver_options.num_threads = std::max(
+      1, options.solver_options.num_threads / static_cast<int>(num_workers));
+  // The progress of concurrent solves would be interleaved.
+  cluster_solver_options.minimizer_progress_to_stdout = false;
+
+  // Signal handlers need to be registered from this thread and each of them
+  // can only be used by one solver at a time. The visualization callbacks
+  // read the whole map and can therefore not be used.
+  std::vector<std::vector<std::shared_ptr<ceres::IterationCallback>>>
+      cluster_callbacks(num_clusters);
+  if (FLAGS_ba_enable_signal_handler) {
+    for (size_t cluster_idx = 0u; cluster_idx < num_clusters; ++cluster_idx) {
+      map_optimization::appendSignalHandlerCallback(
+          &cluster_callbacks[cluster_idx]);
+    }
+  }
+
+  LOG(INFO) << "Optimizing " << num_clusters << " independent mission "
+            << "clusters with " << num_workers << " workers and "
+            << cluster_solver_options.num_threads << " solver thread(s) each.";
+
+  std::vector<OptimizationProblemResult> cluster_results(num_clusters);
+  std::function<void(const std::vector<size_t>&)> worker =
+      [&](const std::vector<size_t>& worker_indices) {
+        for (const size_t worker_idx : worker_indices) {
+          for (const size_t cluster_idx : worker_cluster_indices[worker_idx]) {
+            map_optimization::OptimizationProblem::UniquePtr
+                optimization_problem(
+                    map_optimization::constructOptimizationProblem(
+                        mission_clusters[cluster_idx], options, map));
+            CHECK(optimization_problem);
+
+            ceres::Solver::Options solver_options = cluster_solver_options;
+            map_optimization::addCallbacksToSolverOptions(
+                cluster_callbacks[cluster_idx], &solver_options);
+            solveProblem(
+                options, solver_options, optimization_problem.get(),
+                &cluster_results[cluster_idx]);
+            VLOG(1) << "Finished the optimization of mission cluster "
+                    << cluster_idx + 1 << "/" << num_clusters << " with "
+                    << cluster_sizes[cluster_idx] << " vertices.";
+          }
+        }
+      };
+  constexpr bool kAlwaysParallelize = true;
+  common::ParallelProcess(num_workers, worker, kAlwaysParallelize, num_workers);
+
+  if (result != nullptr) {
+    for (const OptimizationProblemResult& cluster_result : cluster_results) {
+      result->iteration_summaries.insert(
+          result->iteration_summaries.end(),
+          cluster_result.iteration_summaries.begin(),
+          cluster_result.iteration_summaries.end());
+      result->solver_summaries.insert(
+          result->solver_summaries.end(),
+          cluster_result.solver_summaries.begin(),
+          cluster_result.solver_summaries.end());
+    }
   }
-  return true;
 }
 
 }  // namespace map_optimization
@@ -218,7 +218,7 @@ OptimizationProblem* constructOptimizationProblem(
 
   size_t num_lc_edges = 0u;
   if (options.add_loop_closure_edges) {
-    num_lc_edges = numLoopclosureEdges(*map);
+    num_lc_edges = numLoopclosureEdges(*map, mission_ids);
     if (num_lc_edges == 0u) {
       LOG(WARNING) << "WARNING: Loop closure edges are enabled, but none "
                    << "were found.";
@@ -0,0 +1,228 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ceres-error-terms/problem-information.h>
+#include <ceres/ceres.h>
+#include <gflags/gflags.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <vi-map/test/vi-map-test-helpers.h>
+#include <vi-map/vi-map.h>
+
+#include "map-optimization/linear-solver-configuration.h"
+#include "map-optimization/optimization-problem.h"
+#include "map-optimization/optimization-terms-addition.h"
+
+DECLARE_uint64(elq_min_observers);
+DECLARE_string(ba_linear_solver_type);
+DECLARE_bool(ba_use_elimination_ordering);
+DECLARE_int32(ba_auto_linear_solver_max_vertices_for_factorization);
+
+namespace map_optimization {
+
+class LinearSolverConfigurationTest : public ::testing::Test {
+ public:
+  void SetUp() {
+    FLAGS_elq_min_observers = 1u;
+    constexpr size_t kNumAdditionalVertices = 10u;
+    vi_map::test::generateMap<vi_map::ViwlsEdge>(kNumAdditionalVertices, &map_);
+    map_.getAllMissionIds(&mission_ids_);
+  }
+
+ protected:
+  void addTerms(
+      const bool add_landmark_terms, const bool fix_landmark_positions,
+      OptimizationProblem* optimization_problem) {
+    CHECK_NOTNULL(optimization_problem);
+    if (add_landmark_terms) {
+      constexpr bool kFixIntrinsics = false;
+      constexpr bool kFixExtrinsicsRotation = false;
+      constexpr bool kFixExtrinsicsTranslation = false;
+      constexpr size_t kMinLandmarksPerFrame = 0u;
+      ASSERT_GT(
+          addLandmarkTerms(
+              vi_map::FeatureType::kBinary, fix_landmark_positions,
+              kFixIntrinsics, kFixExtrinsicsRotation, kFixExtrinsicsTranslation,
+              kMinLandmarksPerFrame, optimization_problem),
+          0u);
+    }
+    constexpr bool kFixGyroBias = false;
+    constexpr bool kFixAccelBias = false;
+    constexpr bool kFixVelocity = false;
+    constexpr double kGravityMagnitude = 9.81;
+    ASSERT_GT(
+        addInertialTerms(
+            kFixGyroBias, kFixAccelBias, kFixVelocity, kGravityMagnitude,
+            optimization_problem),
+        0u);
+  }
+
+  static ProblemSizeStatistics makeStatistics(
+      const size_t num_vertices, const size_t num_free_landmarks) {
+    ProblemSizeStatistics statistics;
+    statistics.num_vertices = num_vertices;
+    statistics.num_landmarks = num_free_landmarks + 10u;
+    statistics.num_free_landmarks = num_free_landmarks;
+    return statistics;
+  }
+
+  vi_map::VIMap map_;
+  vi_map::MissionIdSet mission_ids_;
+};
+
+TEST_F(LinearSolverConfigurationTest, EliminationOrderingGroups) {
+  OptimizationProblem optimization_problem(&map_, mission_ids_);
+  constexpr bool kAddLandmarkTerms = true;
+  constexpr bool kFixLandmarkPositions = false;
+  addTerms(kAddLandmarkTerms, kFixLandmarkPositions, &optimization_problem);
+
+  ceres::Problem problem(ceres_error_terms::getDefaultProblemOptions());
+  ceres_error_terms::buildCeresProblemFromProblemInformation(
+      optimization_problem.getProblemInformationMutable(), &problem);
+
+  ProblemSizeStatistics statistics;
+  std::shared_ptr<ceres::ParameterBlockOrdering> ordering =
+      buildEliminationOrdering(problem, &optimization_problem, &statistics);
+  ASSERT_TRUE(ordering != nullptr);
+
+  EXPECT_EQ(statistics.num_vertices, map_.numVertices());
+  EXPECT_GT(statistics.num_landmarks, 0u);
+  EXPECT_EQ(statistics.num_free_landmarks, statistics.num_landmarks);
+  EXPECT_EQ(
+      statistics.num_parameter_blocks,
+      static_cast<size_t>(problem.NumParameterBlocks()));
+  // Every parameter block is part of the ordering.
+  EXPECT_EQ(ordering->NumElements(), problem.NumParameterBlocks());
+
+  const OptimizationProblem::ProblemBookkeeping& bookkeeping =
+      *optimization_problem.getProblemBookkeepingMutable();
+  size_t num_checked_landmarks = 0u;
+  for (const auto& landmark_entry : bookkeeping.landmarks_in_problem) {
+    double* p_B = map_.getLandmark(landmark_entry.first).get_p_B_Mutable();
+    if (problem.HasParameterBlock(p_B)) {
+      EXPECT_EQ(ordering->GroupId(p_B), EliminationGroup::kLandmarkGroup);
+      ++num_checked_landmarks;
+    }
+  }
+  EXPECT_GT(num_checked_landmarks, 0u);
+  EXPECT_EQ(
+      static_cast<size_t>(
+          ordering->GroupSize(EliminationGroup::kLandmarkGroup)),
+      statistics.num_landmarks);
+
+  OptimizationStateBuffer* state_buffer =
+      optimization_problem.getOptimizationStateBufferMutable();
+  pose_graph::VertexIdList vertex_ids;
+  map_.getAllVertexIds(&vertex_ids);
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    vi_map::Vertex& vertex = map_.getVertex(vertex_id);
+    EXPECT_EQ(
+        ordering->GroupId(vertex.get_v_M_Mutable()),
+        EliminationGroup::kVelocityAndBiasGroup);
+    EXPECT_EQ(
+        ordering->GroupId(vertex.getAccelBiasMutable()),
+        EliminationGroup::kVelocityAndBiasGroup);
+    EXPECT_EQ(
+        ordering->GroupId(vertex.getGyroBiasMutable()),
+        EliminationGroup::kVelocityAndBiasGroup);
+    EXPECT_EQ(
+        ordering->GroupId(
+            state_buffer->get_vertex_q_IM__M_p_MI_JPL(vertex_id)),
+        EliminationGroup::kVertexPoseGroup);
+  }
+  EXPECT_EQ(
+      static_cast<size_t>(
+          ordering->GroupSize(EliminationGroup::kVelocityAndBiasGroup)),
+      3u * vertex_ids.size());
+  EXPECT_EQ(
+      static_cast<size_t>(
+          ordering->GroupSize(EliminationGroup::kVertexPoseGroup)),
+      vertex_ids.size());
+  // The camera and the baseframe states are eliminated last.
+  EXPECT_GT(ordering->GroupSize(EliminationGroup::kOtherStatesGroup), 0);
+}
+
+TEST_F(LinearSolverConfigurationTest, NoEliminationOrderingWithoutLandmarks) {
+  OptimizationProblem optimization_problem(&map_, mission_ids_);
+  constexpr bool kAddLandmarkTerms = false;
+  constexpr bool kFixLandmarkPositions = false;
+  addTerms(kAddLandmarkTerms, kFixLandmarkPositions, &optimization_problem);
+
+  ceres::Problem problem(ceres_error_terms::getDefaultProblemOptions());
+  ceres_error_terms::buildCeresProblemFromProblemInformation(
+      optimization_problem.getProblemInformationMutable(), &problem);
+
+  ProblemSizeStatistics statistics;
+  EXPECT_TRUE(
+      buildEliminationOrdering(problem, &optimization_problem, &statistics) ==
+      nullptr);
+  EXPECT_EQ(statistics.num_vertices, map_.numVertices());
+  EXPECT_EQ(statistics.num_landmarks, 0u);
+}
+
+TEST_F(LinearSolverConfigurationTest, AutoSelectionThresholds) {
+  const int original_max_vertices =
+      FLAGS_ba_auto_linear_solver_max_vertices_for_factorization;
+  FLAGS_ba_auto_linear_solver_max_vertices_for_factorization = 100;
+
+  ceres::Solver::Options solver_options;
+  // Optimized landmarks are eliminated with a Schur complement.
+  selectLinearSolver(makeStatistics(100u, 5u), &solver_options);
+  EXPECT_EQ(solver_options.linear_solver_type, ceres::SPARSE_SCHUR);
+  selectLinearSolver(makeStatistics(101u, 5u), &solver_options);
+  EXPECT_EQ(solver_options.linear_solver_type, ceres::ITERATIVE_SCHUR);
+  EXPECT_EQ(solver_options.preconditioner_type, ceres::SCHUR_JACOBI);
+
+  // With fixed landmarks the problem is a pose graph.
+  solver_options = ceres::Solver::Options();
+  selectLinearSolver(makeStatistics(100u, 0u), &solver_options);
+  EXPECT_EQ(solver_options.linear_solver_type, ceres::SPARSE_NORMAL_CHOLESKY);
+  selectLinearSolver(makeStatistics(101u, 0u), &solver_options);
+  EXPECT_EQ(solver_options.linear_solver_type, ceres::CGNR);
+  EXPECT_EQ(solver_options.preconditioner_type, ceres::JACOBI);
+
+  FLAGS_ba_auto_linear_solver_max_vertices_for_factorization =
+      original_max_vertices;
+}
+
+TEST_F(LinearSolverConfigurationTest, ConfigurationDependsOnSolverType) {
+  OptimizationProblem optimization_problem(&map_, mission_ids_);
+  constexpr bool kAddLandmarkTerms = true;
+  constexpr bool kFixLandmarkPositions = false;
+  addTerms(kAddLandmarkTerms, kFixLandmarkPositions, &optimization_problem);
+
+  ceres::Problem problem(ceres_error_terms::getDefaultProblemOptions());
+  ceres_error_terms::buildCeresProblemFromProblemInformation(
+      optimization_problem.getProblemInformationMutable(), &problem);
+
+  const std::string original_solver_type = FLAGS_ba_linear_solver_type;
+  const bool original_use_ordering = FLAGS_ba_use_elimination_ordering;
+  FLAGS_ba_use_elimination_ordering = true;
+
+  // The default solver and its ordering are left untouched.
+  EXPECT_EQ(FLAGS_ba_linear_solver_type, "SPARSE_NORMAL_CHOLESKY");
+  ceres::Solver::Options solver_options;
+  solver_options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+  configureLinearSolverForProblem(
+      problem, &optimization_problem, &solver_options);
+  EXPECT_EQ(solver_options.linear_solver_type, ceres::SPARSE_NORMAL_CHOLESKY);
+  EXPECT_TRUE(solver_options.linear_solver_ordering == nullptr);
+
+  // AUTO picks a Schur solver with the landmarks eliminated first.
+  FLAGS_ba_linear_solver_type = "AUTO";
+  solver_options = ceres::Solver::Options();
+  configureLinearSolverForProblem(
+      problem, &optimization_problem, &solver_options);
+  EXPECT_EQ(solver_options.linear_solver_type, ceres::SPARSE_SCHUR);
+  ASSERT_TRUE(solver_options.linear_solver_ordering != nullptr);
+  EXPECT_EQ(
+      solver_options.linear_solver_ordering->NumElements(),
+      problem.NumParameterBlocks());
+
+  FLAGS_ba_linear_solver_type = original_solver_type;
+  FLAGS_ba_use_elimination_ordering = original_use_ordering;
+}
+
+}  // namespace map_optimization
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -1,14 +1,17 @@
+#include <algorithm>
 #include <aslam/cameras/camera-pinhole.h>
 #include <aslam/cameras/distortion-fisheye.h>
 #include <aslam/cameras/ncamera.h>
 #include <aslam/cameras/random-camera-generator.h>
 #include <ceres/ceres.h>
+#include <gflags/gflags.h>
 #include <map-manager/map-manager.h>
 #include <map-optimization/solver-options.h>
 #include <map-optimization/solver.h>
 #include <maplab-common/test/testing-entrypoint.h>
 #include <maplab-common/test/testing-predicates.h>
 #include <memory>
+#include <vector>
 #include <vi-map-helpers/vi-map-landmark-quality-evaluation.h>
 #include <vi-map/test/vi-map-generator.h>
 #include <vi-map/vi-map.h>
@@ -19,6 +22,8 @@
 
 #include "map-optimization/vi-map-optimizer.h"
 
+DECLARE_bool(ba_optimize_independent_mission_clusters_in_parallel);
+
 namespace visual_inertial_mapping {
 
 class ViMappingTest : public ::testing::Test {
@@ -670,6 +675,189 @@ TEST_F(ViMappingTest, TestWheelOdometryExtrinsics) {
   testWheelCalibrationThreeVertices();
 }
 
+TEST_F(ViMappingTest, TestIndependentMissionClusters) {
+  const vi_map::VIMap& map = *CHECK_NOTNULL(test_app_.getMapMutable());
+  vi_map::MissionIdSet mission_ids;
+  map.getAllMissionIds(&mission_ids);
+  ASSERT_FALSE(mission_ids.empty());
+
+  std::vector<vi_map::MissionIdSet> mission_clusters;
+  map_optimization::getIndependentMissionClusters(
+      map, mission_ids, &mission_clusters);
+
+  // Every mission ends up in exactly one cluster.
+  vi_map::MissionIdSet clustered_mission_ids;
+  size_t num_clustered_missions = 0u;
+  for (const vi_map::MissionIdSet& mission_cluster : mission_clusters) {
+    EXPECT_FALSE(mission_cluster.empty());
+    num_clustered_missions += mission_cluster.size();
+    clustered_mission_ids.insert(
+        mission_cluster.begin(), mission_cluster.end());
+  }
+  EXPECT_EQ(num_clustered_missions, mission_ids.size());
+  EXPECT_TRUE(clustered_mission_ids == mission_ids);
+}
+
+namespace {
+
+// Adds a wheel odometry mission of three vertices, whose edges agree with the
+// vertex poses if the extrinsics of the wheel odometry sensor are the
+// identity.
+void addWheelOdometryMission(
+    const aslam::SensorId& wheel_odometry_sensor_id,
+    const aslam::Transformation& T_S_B, vi_map::VIMap* map,
+    pose_graph::VertexIdList* vertex_ids) {
+  CHECK_NOTNULL(map);
+  CHECK_NOTNULL(vertex_ids)->clear();
+
+  const vi_map::MissionId mission_id =
+      aslam::createRandomId<vi_map::MissionId>();
+  map->addNewMissionWithBaseframe(
+      mission_id, aslam::Transformation(),
+      Eigen::Matrix<double, 6, 6>::Identity(),
+      vi_map::Mission::BackBone::kWheelOdometry);
+
+  if (!map->getSensorManager().hasSensor(wheel_odometry_sensor_id)) {
+    vi_map::WheelOdometry::UniquePtr wheel_odometry_sensor(
+        new vi_map::WheelOdometry(wheel_odometry_sensor_id, "wheel_topic"));
+    map->getSensorManager().addSensor<vi_map::WheelOdometry>(
+        std::move(wheel_odometry_sensor), wheel_odometry_sensor_id, T_S_B);
+  }
+  aslam::SensorIdSet sensor_ids;
+  sensor_ids.emplace(wheel_odometry_sensor_id);
+  map->associateMissionSensors(sensor_ids, mission_id);
+
+  const aslam::NCamera::Ptr cameras = aslam::createTestNCamera(1);
+  const std::vector<aslam::Position3D> positions = {
+      aslam::Position3D(0, 0, 0), aslam::Position3D(2, 0, 0),
+      aslam::Position3D(2, 2, 0)};
+  for (const aslam::Position3D& p_M_I : positions) {
+    vi_map::Vertex::UniquePtr vertex(new vi_map::Vertex(cameras));
+    vertex->setMissionId(mission_id);
+    vertex->set_T_M_I(aslam::Transformation(aslam::Quaternion(), p_M_I));
+    vertex_ids->emplace_back(vertex->id());
+    map->addVertex(std::move(vertex));
+  }
+  map->getMission(mission_id).setRootVertexId(vertex_ids->front());
+
+  const Eigen::Matrix<double, 6, 6> T_A_B_covariance_p_q =
+      Eigen::Matrix<double, 6, 6>::Identity() * 0.01;
+  for (size_t idx = 1u; idx < vertex_ids->size(); ++idx) {
+    const pose_graph::VertexId& id_A = (*vertex_ids)[idx - 1u];
+    const pose_graph::VertexId& id_B = (*vertex_ids)[idx];
+    const aslam::Transformation T_A_B =
+        map->getVertex(id_A).get_T_M_I().inverse() *
+        map->getVertex(id_B).get_T_M_I();
+    pose_graph::EdgeId edge_id;
+    aslam::generateId(&edge_id);
+    map->addEdge(vi_map::Edge::UniquePtr(new vi_map::TransformationEdge(
+        vi_map::Edge::EdgeType::kWheelOdometry, edge_id, id_A, id_B, T_A_B,
+        T_A_B_covariance_p_q, wheel_odometry_sensor_id)));
+  }
+}
+
+// Wheel odometry missions with corrupted extrinsics, the first two missions
+// share a sensor, the last two have a sensor of their own.
+void createWheelOdometryMissions(
+    const std::vector<aslam::SensorId>& sensor_ids, vi_map::VIMap* map) {
+  CHECK_NOTNULL(map);
+  CHECK_EQ(sensor_ids.size(), 3u);
+  const std::vector<aslam::Transformation> corrupted_T_S_B = {
+      aslam::Transformation(
+          aslam::Quaternion(0.9961947, 0.0871557, 0, 0),
+          aslam::Position3D(0, 0, 0)),
+      aslam::Transformation(
+          aslam::Quaternion(0.9961947, 0, 0.0871557, 0),
+          aslam::Position3D(0, 0, 0)),
+      aslam::Transformation(
+          aslam::Quaternion(0.9961947, 0, 0, 0.0871557),
+          aslam::Position3D(0, 0, 0))};
+  pose_graph::VertexIdList vertex_ids;
+  addWheelOdometryMission(sensor_ids[0], corrupted_T_S_B[0], map, &vertex_ids);
+  addWheelOdometryMission(sensor_ids[0], corrupted_T_S_B[0], map, &vertex_ids);
+  addWheelOdometryMission(sensor_ids[1], corrupted_T_S_B[1], map, &vertex_ids);
+  addWheelOdometryMission(sensor_ids[2], corrupted_T_S_B[2], map, &vertex_ids);
+}
+
+}  // namespace
+
+TEST_F(ViMappingTest, TestIndependentMissionClustersOfMultipleMissions) {
+  std::vector<aslam::SensorId> sensor_ids(3u);
+  for (aslam::SensorId& sensor_id : sensor_ids) {
+    aslam::generateId(&sensor_id);
+  }
+  vi_map::VIMap map;
+  createWheelOdometryMissions(sensor_ids, &map);
+
+  vi_map::MissionIdSet mission_ids;
+  map.getAllMissionIds(&mission_ids);
+  ASSERT_EQ(mission_ids.size(), 4u);
+
+  std::vector<vi_map::MissionIdSet> mission_clusters;
+  map_optimization::getIndependentMissionClusters(
+      map, mission_ids, &mission_clusters);
+
+  // The two missions sharing a sensor form one cluster.
+  ASSERT_EQ(mission_clusters.size(), 3u);
+  std::vector<size_t> cluster_sizes;
+  for (const vi_map::MissionIdSet& mission_cluster : mission_clusters) {
+    cluster_sizes.emplace_back(mission_cluster.size());
+  }
+  std::sort(cluster_sizes.begin(), cluster_sizes.end());
+  EXPECT_EQ(cluster_sizes, std::vector<size_t>({1u, 1u, 2u}));
+}
+
+TEST_F(ViMappingTest, TestParallelClusterOptimizationMatchesJoint) {
+  std::vector<aslam::SensorId> sensor_ids(3u);
+  for (aslam::SensorId& sensor_id : sensor_ids) {
+    aslam::generateId(&sensor_id);
+  }
+  vi_map::VIMap joint_map;
+  createWheelOdometryMissions(sensor_ids, &joint_map);
+  vi_map::VIMap parallel_map;
+  createWheelOdometryMissions(sensor_ids, &parallel_map);
+
+  map_optimization::ViProblemOptions options =
+      map_optimization::ViProblemOptions::initFromGFlags();
+  options.fix_wheel_extrinsics = false;
+  options.fix_vertices = true;
+  options.add_inertial_constraints = false;
+  options.add_visual_constraints = false;
+  options.add_wheel_odometry_constraints = true;
+  options.enable_visual_outlier_rejection = false;
+  options.solver_options.max_num_iterations = 60;
+
+  visualization::ViwlsGraphRvizPlotter* plotter = nullptr;
+  constexpr bool kSignalHandlerEnabled = false;
+  map_optimization::VIMapOptimizer optimizer(plotter, kSignalHandlerEnabled);
+
+  const bool original_flag =
+      FLAGS_ba_optimize_independent_mission_clusters_in_parallel;
+  vi_map::MissionIdSet mission_ids;
+  joint_map.getAllMissionIds(&mission_ids);
+  FLAGS_ba_optimize_independent_mission_clusters_in_parallel = false;
+  ASSERT_TRUE(optimizer.optimize(options, mission_ids, &joint_map));
+
+  parallel_map.getAllMissionIds(&mission_ids);
+  FLAGS_ba_optimize_independent_mission_clusters_in_parallel = true;
+  ASSERT_TRUE(optimizer.optimize(options, mission_ids, &parallel_map));
+  FLAGS_ba_optimize_independent_mission_clusters_in_parallel = original_flag;
+
+  // Both recover the clean extrinsics of every sensor.
+  for (const aslam::SensorId& sensor_id : sensor_ids) {
+    const aslam::Transformation joint_T_S_B =
+        joint_map.getSensorManager().getSensor_T_B_S(sensor_id);
+    const aslam::Transformation parallel_T_S_B =
+        parallel_map.getSensorManager().getSensor_T_B_S(sensor_id);
+    EXPECT_NEAR_KINDR_QUATERNION(
+        aslam::Quaternion(), joint_T_S_B.getRotation(), 1e-4);
+    EXPECT_NEAR_KINDR_QUATERNION(
+        joint_T_S_B.getRotation(), parallel_T_S_B.getRotation(), 1e-6);
+    EXPECT_NEAR_EIGEN(
+        joint_T_S_B.getPosition(), parallel_T_S_B.getPosition(), 1e-6);
+  }
+}
+
 }  // namespace visual_inertial_mapping
 
 MAPLAB_UNITTEST_ENTRYPOINT
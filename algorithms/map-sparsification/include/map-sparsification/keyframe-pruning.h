@@ -36,5 +36,11 @@ size_t selectKeyframesBasedOnHeuristics(
 size_t removeVerticesBetweenKeyframes(
     const pose_graph::VertexIdList& keyframe_ids, vi_map::VIMap* map);
 
+// Same as above for several missions at once, given one list of keyframes per
+// mission. The missions are processed in parallel.
+size_t removeVerticesBetweenKeyframes(
+    const std::vector<pose_graph::VertexIdList>& keyframe_ids_per_mission,
+    vi_map::VIMap* map);
+
 }  // namespace map_sparsification
 #endif  // MAP_SPARSIFICATION_KEYFRAME_PRUNING_H_
@@ -2,9 +2,7 @@
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
-#include <maplab-common/progress-bar.h>
 #include <posegraph/unique-id.h>
-#include <vi-map-helpers/vi-map-queries.h>
 #include <vi-map/vi-map.h>
 
 #include <Eigen/Core>
@@ -23,75 +21,6 @@ DEFINE_uint64(
     "Coobserved landmark number to add a new keyframe.");
 
 namespace map_sparsification {
-namespace {
-size_t removeAllVerticesBetweenTwoVertices(
-    const pose_graph::VertexId& start_kf_id,
-    const pose_graph::VertexId& end_kf_id, vi_map::VIMap* map) {
-  CHECK_NOTNULL(map);
-  CHECK(start_kf_id.isValid());
-  CHECK(end_kf_id.isValid());
-
-  pose_graph::VertexId current_vertex_id = start_kf_id;
-
-  // First check which edge types we can merge
-  bool merge_viwls_edges = true;
-  bool merge_odometry_edges = true;
-  bool merge_wheel_odometry_edges = true;
-
-  do {
-    const bool edge_found =
-        map->getNextVertex(current_vertex_id, &current_vertex_id);
-    CHECK(edge_found)
-        << "Cannot merge vertice ids " << start_kf_id << " and " << end_kf_id
-        << " since no traversable path between them in the graph was found!";
-    CHECK(current_vertex_id.isValid());
-
-    // Since we iterate inclusively to the last vertex it's enough to check only
-    // incoming edge types
-    pose_graph::EdgeIdSet current_vertex_incoming_edge_ids;
-    map->getVertex(current_vertex_id)
-        .getIncomingEdges(&current_vertex_incoming_edge_ids);
-
-    bool found_viwls_edge = false;
-    bool found_odometry_edge = false;
-    bool found_wheel_odometry_edge = false;
-    for (const pose_graph::EdgeId& incoming_edge :
-         current_vertex_incoming_edge_ids) {
-      if (map->getEdgeType(incoming_edge) ==
-          pose_graph::Edge::EdgeType::kViwls) {
-        found_viwls_edge = true;
-      }
-      if (map->getEdgeType(incoming_edge) ==
-          pose_graph::Edge::EdgeType::kOdometry) {
-        found_odometry_edge = true;
-      }
-      if (map->getEdgeType(incoming_edge) ==
-          pose_graph::Edge::EdgeType::kWheelOdometry) {
-        found_wheel_odometry_edge = true;
-      }
-    }
-
-    // If we are missing even one edge then drop the entire edge merger
-    // between the two vertices. TODO(ben): improve logic to deal with
-    // missing edges e.g. by interpolating using IMU measurements.
-    merge_viwls_edges &= found_viwls_edge;
-    merge_odometry_edges &= found_odometry_edge;
-    merge_wheel_odometry_edges &= found_wheel_odometry_edge;
-  } while (current_vertex_id != end_kf_id);
-
-  // Merge consecutive vertices adding up the edges we are able to merge
-  size_t num_merged_vertices = 0u;
-  while (map->getNextVertex(start_kf_id, &current_vertex_id) &&
-         current_vertex_id != end_kf_id) {
-    map->mergeNeighboringVertices(
-        start_kf_id, current_vertex_id, merge_viwls_edges, merge_odometry_edges,
-        merge_wheel_odometry_edges);
-    ++num_merged_vertices;
-  }
-
-  return num_merged_vertices;
-}
-}  // namespace
 
 KeyframingHeuristicsOptions
 KeyframingHeuristicsOptions::initializeFromGFlags() {
@@ -151,6 +80,9 @@ size_t selectKeyframesBasedOnHeuristics(
   // The first vertex in the range is always a keyframe.
   insert_keyframe(start_keyframe_id);
 
+  const vi_map::CovisibilityGraph& covisibility_graph =
+      map.getCovisibilityGraph();
+
   // Traverse the posegraph and select keyframes to keep based on the
   // following conditions. The ordering of the condition evaluation is
   // important.
@@ -178,9 +110,11 @@ size_t selectKeyframesBasedOnHeuristics(
 
     // Insert a keyframe if the common landmark observations between the last
     // keyframe and this current vertex frame drop below a certain threshold.
-    vi_map_helpers::VIMapQueries queries(map);
+    DCHECK(covisibility_graph.isConsistentWithVertex(
+        map.getVertex(current_vertex_id)));
     const size_t common_observations =
-        queries.getNumberOfCommonLandmarks(current_vertex_id, last_keyframe_id);
+        covisibility_graph.getNumberOfCommonLandmarks(
+            current_vertex_id, last_keyframe_id);
     if (common_observations < options.kf_min_shared_landmarks_obs) {
       VLOG(3) << "Adding keyframe " << current_vertex_id
               << ". Condition: number of common landmarks ("
@@ -257,28 +191,15 @@ size_t selectKeyframesBasedOnHeuristics(
 
 size_t removeVerticesBetweenKeyframes(
     const pose_graph::VertexIdList& keyframe_ids, vi_map::VIMap* map) {
-  // Nothing to remove if there are less than two keyframes.
-  if (keyframe_ids.size() < 2) {
-    return 0u;
-  }
-
-  const vi_map::MissionId& mission_id =
-      map->getMissionIdForVertex(keyframe_ids.front());
-
-  size_t num_removed_vertices = 0u;
-  const size_t num_keyframe_id_pairs = keyframe_ids.size() - 1;
-  common::ProgressBar progress_bar(num_keyframe_id_pairs);
-  for (size_t idx = 0u; idx < num_keyframe_id_pairs; ++idx) {
-    CHECK_EQ(mission_id, map->getMissionIdForVertex(keyframe_ids[idx + 1]))
-        << "All keyframes must be of the same mission.";
-    num_removed_vertices += removeAllVerticesBetweenTwoVertices(
-        keyframe_ids[idx], keyframe_ids[idx + 1], map);
+  return removeVerticesBetweenKeyframes(
+      std::vector<pose_graph::VertexIdList>{keyframe_ids}, map);
+}
 
-    if (idx % 10 == 0u) {
-      progress_bar.update(idx);
-    }
-  }
-  return num_removed_vertices;
+size_t removeVerticesBetweenKeyframes(
+    const std::vector<pose_graph::VertexIdList>& keyframe_ids_per_mission,
+    vi_map::VIMap* map) {
+  CHECK_NOTNULL(map);
+  return map->removeVerticesBetweenKeyframes(keyframe_ids_per_mission);
 }
 
 }  // namespace map_sparsification
@@ -3,6 +3,7 @@
 
 #include <Eigen/Dense>
 #include <algorithm>
+#include <deque>
 #include <feature-tracking/vo-outlier-rejection-pipeline.h>
 #include <landmark-triangulation/pose-interpolator.h>
 #include <map-resources/resource-conversion.h>
@@ -23,6 +24,8 @@
 #include <vi-map/vi-mission.h>
 #include <vio-common/vio-types.h>
 
+#include "online-map-builders/visual-frame-spill-store.h"
+
 DECLARE_bool(map_builder_save_point_clouds_as_resources);
 DECLARE_bool(map_builder_save_point_cloud_maps_as_resources);
 DECLARE_bool(
@@ -95,6 +98,16 @@ class StreamMapBuilder {
 
   void updateMapDependentData();
 
+  // With --map_builder_spill_visual_frames, the descriptors of vertices that
+  // are older than the active window are moved to a spill file. This restores
+  // the descriptors of a single vertex, e.g. before it is accessed by code
+  // outside of the map builder. Returns false if the vertex wasn't spilled.
+  bool reloadSpilledVisualFrames(const pose_graph::VertexId& vertex_id);
+  // Restores all spilled descriptors, needs to be called before the map is
+  // processed or saved.
+  void reloadAllSpilledVisualFrames();
+  size_t numSpilledVertices() const;
+
  private:
   inline void getMissionTimeLimitsNs(
       int64_t* start_time_ns, int64_t* end_time_ns) const {
@@ -120,6 +133,17 @@ class StreamMapBuilder {
   void notifyWheelOdometryConstraintBuffer();
   void notifyExternalFeaturesMeasurementBuffer();
 
+  // All external features measurements of one sensor that are attached to
+  // the same vertex.
+  struct ExternalFeaturesBatch {
+    aslam::SensorId sensor_id;
+    pose_graph::VertexId vertex_id;
+    std::vector<vi_map::ExternalFeaturesMeasurement::ConstPtr> measurements;
+  };
+  // Extends the visual frame of the vertex once with the keypoints of all
+  // measurements of the batch and runs the outlier rejection on them.
+  void attachExternalFeaturesBatch(const ExternalFeaturesBatch& batch);
+
   void addRootViwlsVertex(
       const std::shared_ptr<aslam::VisualNFrame>& nframe,
       const vio::ViNodeState& vinode_state);
@@ -144,6 +168,19 @@ class StreamMapBuilder {
       const pose_graph::VertexId& target_vertex_id,
       const aslam::Transformation& wheel_transformation);
 
+  // With --map_builder_compact_visual_frames, removes the untracked keypoints
+  // of all vertices that left the active window.
+  void compactFinalizedVertices();
+
+  // Spills the descriptors of all vertices that left the active window, once
+  // enough of them have accumulated.
+  void spillFinalizedVertices();
+  // Returns the vertex with its descriptors in memory, reloads them if the
+  // vertex has been spilled. All accesses to the visual frames of vertices
+  // that might have left the active window need to go through this.
+  vi_map::Vertex& getVertexWithDescriptors(
+      const pose_graph::VertexId& vertex_id);
+
   inline const vi_map::VIMap* constMap() const;
 
   vi_map::VIMap* const map_;
@@ -209,6 +246,15 @@ class StreamMapBuilder {
       std::unique_ptr<feature_tracking::VOOutlierRejectionPipeline>>
       external_features_outlier_rejection_pipelines_;
 
+  // Vertices whose descriptors are in memory, from oldest to newest. Only
+  // used if spilling is enabled.
+  std::deque<pose_graph::VertexId> unspilled_vertex_ids_;
+  std::unique_ptr<VisualFrameSpillStore> spill_store_;
+
+  // Vertices whose visual frames haven't been compacted yet, from oldest to
+  // newest. Only used if compaction is enabled.
+  std::deque<pose_graph::VertexId> uncompacted_vertex_ids_;
+
   static constexpr size_t kKeepNMostRecentImages = 10u;
 };
 
@@ -0,0 +1,94 @@
+#ifndef ONLINE_MAP_BUILDERS_VISUAL_FRAME_SPILL_STORE_H_
+#define ONLINE_MAP_BUILDERS_VISUAL_FRAME_SPILL_STORE_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <posegraph/unique-id.h>
+
+namespace vi_map {
+class Vertex;
+}  // namespace vi_map
+
+namespace online_map_builders {
+
+// Moves the descriptors of the visual frames of finalized vertices out of
+// memory and into an append-only spill file, such that long mapping sessions
+// don't keep the descriptors of the whole session in RAM. The keypoints and
+// all other frame data stay in memory, only the descriptor blocks are
+// released and restored, which keeps the descriptor types and the keypoint
+// <-> descriptor association untouched.
+//
+// Reloading or discarding a vertex leaves its bytes in the spill file behind.
+// Once these dead bytes outnumber the bytes of the spilled vertices, the
+// spilled descriptors are moved to the front of the file and the file is
+// truncated. The spill file is deleted on destruction.
+//
+// This class is not thread-safe.
+class VisualFrameSpillStore {
+ public:
+  explicit VisualFrameSpillStore(const std::string& spill_folder);
+  ~VisualFrameSpillStore();
+
+  // Writes the descriptors of all frames of the vertex to the spill file and
+  // releases their memory. Returns the number of released bytes.
+  size_t spillVertex(vi_map::Vertex* vertex);
+
+  // Restores the descriptors of a spilled vertex. Returns false if the vertex
+  // is not spilled.
+  bool reloadVertex(vi_map::Vertex* vertex);
+
+  // Forgets a spilled vertex, e.g. after it has been removed from the map.
+  void discardVertex(const pose_graph::VertexId& vertex_id);
+
+  bool isSpilled(const pose_graph::VertexId& vertex_id) const;
+
+  // Returns the spilled vertices in the order they have been spilled.
+  void getSpilledVertexIds(pose_graph::VertexIdList* vertex_ids) const;
+
+  size_t numSpilledVertices() const {
+    return index_.size();
+  }
+  // Number of bytes in the spill file that belong to spilled vertices.
+  size_t numSpilledBytes() const {
+    return num_spilled_bytes_;
+  }
+  // Size of the spill file, including the bytes of reloaded or discarded
+  // vertices that have not been compacted yet.
+  size_t spillFileSizeBytes() const {
+    return spill_file_size_;
+  }
+
+ private:
+  struct FrameEntry {
+    unsigned int frame_idx;
+    uint64_t offset;
+    uint64_t num_bytes;
+  };
+  struct VertexEntry {
+    uint64_t spill_idx;
+    std::vector<FrameEntry> frames;
+  };
+
+  void openSpillFile();
+  void readFromSpillFile(
+      const uint64_t offset, const size_t num_bytes, std::string* data) const;
+  void writeToSpillFile(const uint64_t offset, const std::string& data);
+  // Moves the spilled descriptors to the front of the spill file and
+  // truncates it, once most of the file consists of dead bytes.
+  void compactIfMostlyDead();
+
+  const std::string spill_file_path_;
+  int spill_file_descriptor_;
+  uint64_t spill_file_size_;
+  size_t num_spilled_bytes_;
+  uint64_t next_spill_idx_;
+
+  std::unordered_map<pose_graph::VertexId, VertexEntry> index_;
+};
+
+}  // namespace online_map_builders
+
+#endif  // ONLINE_MAP_BUILDERS_VISUAL_FRAME_SPILL_STORE_H_
@@ -3,8 +3,10 @@
 #include <aslam/frames/visual-frame.h>
 #include <aslam/frames/visual-nframe.h>
 #include <glog/logging.h>
+#include <maplab-common/file-system-tools.h>
 #include <vi-map-helpers/vi-map-manipulation.h>
 #include <vi-map-helpers/vi-map-queries.h>
+#include <vi-map-helpers/vi-map-visual-frame-compaction.h>
 #include <vi-map/check-map-consistency.h>
 #include <vi-map/sensor-utils.h>
 #include <vi-map/vi-map.h>
@@ -46,8 +48,176 @@ DEFINE_bool(
     "If enabled, opencv windows with the result of the lidar scan to lidar "
     "depth map conversion will be opened.");
 
+DEFINE_bool(
+    map_builder_spill_visual_frames, false,
+    "If enabled, the descriptors of vertices that are older than the active "
+    "window are moved from memory to a spill file and restored before the map "
+    "is processed or saved. Reduces the memory usage of long sessions.");
+
+DEFINE_int32(
+    map_builder_spill_keep_n_most_recent_vertices, 200,
+    "Number of most recent vertices whose descriptors are always kept in "
+    "memory if --map_builder_spill_visual_frames is enabled.");
+
+DEFINE_int32(
+    map_builder_spill_batch_size, 50,
+    "Number of vertices that need to leave the active window before their "
+    "descriptors are spilled together.");
+
+DEFINE_string(
+    map_builder_spill_folder, "",
+    "Folder for the spill file of --map_builder_spill_visual_frames. If empty, "
+    "the folder <map_folder>_visual_frame_spill next to the map folder is "
+    "used.");
+
+DEFINE_bool(
+    map_builder_compact_visual_frames, false,
+    "If enabled, keypoints without a feature track are removed from the visual "
+    "frames of vertices that left the active window, including all their "
+    "descriptors and keypoint channels.");
+
+DEFINE_int32(
+    map_builder_compact_keep_n_most_recent_vertices, 10,
+    "Number of most recent vertices that are not compacted yet, as the track "
+    "ids of their keypoints may still change.");
+
 namespace online_map_builders {
 
+namespace {
+
+// The keypoint data of all external features measurements that are attached
+// to the same visual frame, concatenated column-wise.
+struct ExternalFeaturesColumns {
+  Eigen::Matrix2Xd keypoint_measurements;
+  Eigen::VectorXd keypoint_uncertainties;
+  // The optional properties are empty if no measurement provides them.
+  Eigen::VectorXd keypoint_orientations;
+  Eigen::VectorXd keypoint_scores;
+  Eigen::VectorXd keypoint_scales;
+  Eigen::Matrix3Xd keypoint_3d_positions;
+  Eigen::VectorXi keypoint_time_offsets;
+  aslam::VisualFrame::DescriptorsT descriptors;
+  Eigen::VectorXi track_ids;
+};
+
+void getExternalFeaturesColumns(
+    const vi_map::ExternalFeaturesMeasurement& measurement,
+    const bool is_lidar_feature, ExternalFeaturesColumns* columns) {
+  CHECK_NOTNULL(columns);
+  measurement.getKeypointMeasurements(&columns->keypoint_measurements);
+  measurement.getKeypointUncertainties(&columns->keypoint_uncertainties);
+  if (!measurement.getKeypointOrientations(&columns->keypoint_orientations)) {
+    columns->keypoint_orientations.resize(0);
+  }
+  if (!measurement.getKeypointScores(&columns->keypoint_scores)) {
+    columns->keypoint_scores.resize(0);
+  }
+  if (!measurement.getKeypointScales(&columns->keypoint_scales)) {
+    columns->keypoint_scales.resize(0);
+  }
+  if (is_lidar_feature) {
+    const bool has_3d_positions =
+        measurement.getKeypoint3DPositions(&columns->keypoint_3d_positions);
+    const bool has_time_offsets =
+        measurement.getKeypointTimeOffsets(&columns->keypoint_time_offsets);
+    CHECK(has_3d_positions && has_time_offsets)
+        << "No depth and time offsets provided for 3D LiDAR feature.";
+  } else {
+    columns->keypoint_3d_positions.resize(Eigen::NoChange, 0);
+    columns->keypoint_time_offsets.resize(0);
+  }
+  measurement.getDescriptors(&columns->descriptors);
+  measurement.getTrackIds(&columns->track_ids);
+}
+
+// Copies the optional property into the segment of the output, which is
+// allocated and filled with the default value the first time a measurement
+// provides the property.
+template <typename VectorType>
+void copyOptionalSegment(
+    const VectorType& part, const size_t offset, const size_t num_total,
+    const typename VectorType::Scalar default_value, VectorType* output) {
+  CHECK_NOTNULL(output);
+  if (part.size() == 0) {
+    return;
+  }
+  if (output->size() == 0) {
+    output->setConstant(num_total, default_value);
+  }
+  output->segment(offset, part.size()) = part;
+}
+
+void concatenateExternalFeaturesMeasurements(
+    const std::vector<vi_map::ExternalFeaturesMeasurement::ConstPtr>&
+        measurements,
+    const bool is_lidar_feature, ExternalFeaturesColumns* columns) {
+  CHECK_NOTNULL(columns);
+  CHECK(!measurements.empty());
+  // Most of the time there is a single measurement per frame, which can be
+  // used as is.
+  if (measurements.size() == 1u) {
+    getExternalFeaturesColumns(
+        *CHECK_NOTNULL(measurements.front()), is_lidar_feature, columns);
+    return;
+  }
+
+  size_t num_total = 0u;
+  for (const vi_map::ExternalFeaturesMeasurement::ConstPtr& measurement :
+       measurements) {
+    num_total += CHECK_NOTNULL(measurement)->getNumKeypointMeasurements();
+  }
+
+  columns->keypoint_measurements.resize(Eigen::NoChange, num_total);
+  columns->keypoint_uncertainties.resize(num_total);
+  columns->keypoint_orientations.resize(0);
+  columns->keypoint_scores.resize(0);
+  columns->keypoint_scales.resize(0);
+  columns->keypoint_3d_positions.resize(
+      Eigen::NoChange, is_lidar_feature ? num_total : 0u);
+  columns->keypoint_time_offsets.resize(is_lidar_feature ? num_total : 0u);
+  columns->track_ids.resize(num_total);
+
+  size_t offset = 0u;
+  ExternalFeaturesColumns part;
+  for (const vi_map::ExternalFeaturesMeasurement::ConstPtr& measurement :
+       measurements) {
+    getExternalFeaturesColumns(*measurement, is_lidar_feature, &part);
+    const size_t num_part = part.keypoint_measurements.cols();
+    if (offset == 0u) {
+      columns->descriptors.resize(part.descriptors.rows(), num_total);
+    }
+    CHECK_EQ(part.descriptors.rows(), columns->descriptors.rows())
+        << "All measurements of an external features sensor need to have the "
+        << "same descriptor size.";
+
+    columns->keypoint_measurements.middleCols(offset, num_part) =
+        part.keypoint_measurements;
+    columns->keypoint_uncertainties.segment(offset, num_part) =
+        part.keypoint_uncertainties;
+    copyOptionalSegment(
+        part.keypoint_orientations, offset, num_total, 0.0,
+        &columns->keypoint_orientations);
+    copyOptionalSegment(
+        part.keypoint_scores, offset, num_total, 0.0,
+        &columns->keypoint_scores);
+    copyOptionalSegment(
+        part.keypoint_scales, offset, num_total, 0.0,
+        &columns->keypoint_scales);
+    if (is_lidar_feature) {
+      columns->keypoint_3d_positions.middleCols(offset, num_part) =
+          part.keypoint_3d_positions;
+      columns->keypoint_time_offsets.segment(offset, num_part) =
+          part.keypoint_time_offsets;
+    }
+    columns->descriptors.middleCols(offset, num_part) = part.descriptors;
+    columns->track_ids.segment(offset, num_part) = part.track_ids;
+    offset += num_part;
+  }
+  CHECK_EQ(offset, num_total);
+}
+
+}  // namespace
+
 const vi_map::VIMap* StreamMapBuilder::constMap() const {
   return map_;
 }
@@ -167,6 +337,32 @@ void StreamMapBuilder::updateMapDependentData() {
     done_current_vertex_wheel_odometry_ = true;
   }
 
+  // Forget about vertices that have been removed from the map, e.g. after
+  // saving a submap.
+  if (spill_store_) {
+    pose_graph::VertexIdList spilled_vertex_ids;
+    spill_store_->getSpilledVertexIds(&spilled_vertex_ids);
+    for (const pose_graph::VertexId& vertex_id : spilled_vertex_ids) {
+      if (!map_->hasVertex(vertex_id)) {
+        spill_store_->discardVertex(vertex_id);
+      }
+    }
+  }
+  unspilled_vertex_ids_.erase(
+      std::remove_if(
+          unspilled_vertex_ids_.begin(), unspilled_vertex_ids_.end(),
+          [this](const pose_graph::VertexId& vertex_id) {
+            return !map_->hasVertex(vertex_id);
+          }),
+      unspilled_vertex_ids_.end());
+  uncompacted_vertex_ids_.erase(
+      std::remove_if(
+          uncompacted_vertex_ids_.begin(), uncompacted_vertex_ids_.end(),
+          [this](const pose_graph::VertexId& vertex_id) {
+            return !map_->hasVertex(vertex_id);
+          }),
+      uncompacted_vertex_ids_.end());
+
   // Update first and last vertex information
   pose_graph::VertexIdList vertex_ids;
   map_->getAllVertexIdsInMissionAlongGraph(mission_id_, &vertex_ids);
@@ -235,6 +431,14 @@ void StreamMapBuilder::apply(
         update.imu_measurements);
   }
   notifyBuffers();
+
+  // Compact first, such that only the remaining descriptors are spilled.
+  if (FLAGS_map_builder_compact_visual_frames) {
+    compactFinalizedVertices();
+  }
+  if (FLAGS_map_builder_spill_visual_frames) {
+    spillFinalizedVertices();
+  }
 }
 
 void StreamMapBuilder::addRootViwlsVertex(
@@ -304,6 +508,12 @@ pose_graph::VertexId StreamMapBuilder::addViwlsVertex(
   map_vertex->set_T_M_I(T_M0_M * vinode_state.get_T_M_I());
   map_vertex->set_v_M(T_M0_M * vinode_state.get_v_M_I());
   map_->addVertex(vi_map::Vertex::UniquePtr(map_vertex));
+  if (FLAGS_map_builder_spill_visual_frames) {
+    unspilled_vertex_ids_.emplace_back(vertex_id);
+  }
+  if (FLAGS_map_builder_compact_visual_frames) {
+    uncompacted_vertex_ids_.emplace_back(vertex_id);
+  }
 
   // Optionally dump the image to disk.
   if (FLAGS_map_builder_save_image_as_resources) {
@@ -330,6 +540,141 @@ void StreamMapBuilder::removeAllVerticesAfterVertexId(
   CHECK_NOTNULL(removed_vertex_ids);
   manipulation_.removePosegraphAfter(vertex_id_from, removed_vertex_ids);
   last_vertex_ = vertex_id_from;
+
+  if (!removed_vertex_ids->empty()) {
+    const pose_graph::VertexIdSet removed_vertex_id_set(
+        removed_vertex_ids->begin(), removed_vertex_ids->end());
+    unspilled_vertex_ids_.erase(
+        std::remove_if(
+            unspilled_vertex_ids_.begin(), unspilled_vertex_ids_.end(),
+            [&removed_vertex_id_set](const pose_graph::VertexId& vertex_id) {
+              return removed_vertex_id_set.count(vertex_id) > 0u;
+            }),
+        unspilled_vertex_ids_.end());
+    uncompacted_vertex_ids_.erase(
+        std::remove_if(
+            uncompacted_vertex_ids_.begin(), uncompacted_vertex_ids_.end(),
+            [&removed_vertex_id_set](const pose_graph::VertexId& vertex_id) {
+              return removed_vertex_id_set.count(vertex_id) > 0u;
+            }),
+        uncompacted_vertex_ids_.end());
+    if (spill_store_) {
+      for (const pose_graph::VertexId& vertex_id : *removed_vertex_ids) {
+        spill_store_->discardVertex(vertex_id);
+      }
+    }
+  }
+}
+
+void StreamMapBuilder::compactFinalizedVertices() {
+  const size_t num_vertices_to_keep = static_cast<size_t>(
+      std::max(FLAGS_map_builder_compact_keep_n_most_recent_vertices, 1));
+  if (uncompacted_vertex_ids_.size() <= num_vertices_to_keep) {
+    return;
+  }
+
+  // The map builder doesn't create landmarks, hence all tracked keypoints are
+  // kept for the later landmark initialization.
+  vi_map_helpers::VisualFrameCompactionOptions options;
+  options.keep_tracked_keypoints = true;
+  vi_map_helpers::VisualFrameCompactionStatistics statistics;
+  while (uncompacted_vertex_ids_.size() > num_vertices_to_keep) {
+    const pose_graph::VertexId vertex_id = uncompacted_vertex_ids_.front();
+    uncompacted_vertex_ids_.pop_front();
+    // The descriptors of spilled vertices are not in memory.
+    if (!map_->hasVertex(vertex_id) ||
+        (spill_store_ && spill_store_->isSpilled(vertex_id))) {
+      continue;
+    }
+    statistics.accumulate(vi_map_helpers::compactVisualFramesOfVertex(
+        options, vertex_id, map_));
+  }
+  VLOG(3) << "[StreamMapBuilder] " << statistics.toString();
+}
+
+void StreamMapBuilder::spillFinalizedVertices() {
+  const size_t num_vertices_to_keep = static_cast<size_t>(
+      std::max(FLAGS_map_builder_spill_keep_n_most_recent_vertices, 1));
+  const size_t batch_size =
+      static_cast<size_t>(std::max(FLAGS_map_builder_spill_batch_size, 1));
+  if (unspilled_vertex_ids_.size() < num_vertices_to_keep + batch_size) {
+    return;
+  }
+
+  if (!spill_store_) {
+    std::string spill_folder = FLAGS_map_builder_spill_folder;
+    if (spill_folder.empty()) {
+      CHECK(map_->hasMapFolder())
+          << "[StreamMapBuilder] Spilling visual frames requires either a map "
+          << "folder or --map_builder_spill_folder.";
+      std::string map_folder = map_->getMapFolder();
+      while (!map_folder.empty() && map_folder.back() == '/') {
+        map_folder.pop_back();
+      }
+      spill_folder = map_folder + "_visual_frame_spill";
+    }
+    VLOG(1) << "[StreamMapBuilder] Spilling the descriptors of finalized "
+            << "vertices to " << spill_folder;
+    spill_store_.reset(new VisualFrameSpillStore(spill_folder));
+  }
+
+  size_t num_spilled_vertices = 0u;
+  size_t num_released_bytes = 0u;
+  while (unspilled_vertex_ids_.size() > num_vertices_to_keep) {
+    const pose_graph::VertexId vertex_id = unspilled_vertex_ids_.front();
+    unspilled_vertex_ids_.pop_front();
+    if (!map_->hasVertex(vertex_id)) {
+      continue;
+    }
+    num_released_bytes +=
+        spill_store_->spillVertex(&map_->getVertex(vertex_id));
+    ++num_spilled_vertices;
+  }
+  VLOG(2) << "[StreamMapBuilder] Spilled the descriptors of "
+          << num_spilled_vertices << " vertices, released "
+          << num_released_bytes / 1024u << " kB. "
+          << spill_store_->numSpilledVertices() << " vertices with "
+          << spill_store_->numSpilledBytes() / (1024u * 1024u)
+          << " MB of descriptors are spilled in total.";
+}
+
+bool StreamMapBuilder::reloadSpilledVisualFrames(
+    const pose_graph::VertexId& vertex_id) {
+  if (!spill_store_ || !spill_store_->isSpilled(vertex_id)) {
+    return false;
+  }
+  CHECK(spill_store_->reloadVertex(&map_->getVertex(vertex_id)));
+  // The vertex will be spilled again once it leaves the active window.
+  unspilled_vertex_ids_.emplace_back(vertex_id);
+  return true;
+}
+
+vi_map::Vertex& StreamMapBuilder::getVertexWithDescriptors(
+    const pose_graph::VertexId& vertex_id) {
+  reloadSpilledVisualFrames(vertex_id);
+  return map_->getVertex(vertex_id);
+}
+
+void StreamMapBuilder::reloadAllSpilledVisualFrames() {
+  if (!spill_store_ || spill_store_->numSpilledVertices() == 0u) {
+    return;
+  }
+  pose_graph::VertexIdList spilled_vertex_ids;
+  spill_store_->getSpilledVertexIds(&spilled_vertex_ids);
+  for (const pose_graph::VertexId& vertex_id : spilled_vertex_ids) {
+    CHECK(spill_store_->reloadVertex(&map_->getVertex(vertex_id)));
+  }
+  // Restore the temporal order, such that the oldest vertices are spilled
+  // first again.
+  unspilled_vertex_ids_.insert(
+      unspilled_vertex_ids_.begin(), spilled_vertex_ids.begin(),
+      spilled_vertex_ids.end());
+  VLOG(1) << "[StreamMapBuilder] Reloaded the descriptors of "
+          << spilled_vertex_ids.size() << " spilled vertices.";
+}
+
+size_t StreamMapBuilder::numSpilledVertices() const {
+  return spill_store_ ? spill_store_->numSpilledVertices() : 0u;
 }
 
 void StreamMapBuilder::addImuEdge(
@@ -1055,7 +1400,14 @@ void StreamMapBuilder::notifyExternalFeaturesMeasurementBuffer() {
   VLOG(3) << "[StreamMapBuilder] Processing " << processed_measurements
           << " external feature measurements.";
 
-  for (const vi_map::ExternalFeaturesMeasurement::ConstPtr measurement_ptr :
+  // Group the measurements by sensor and by the vertex they are attached to,
+  // such that every visual frame is extended only once per sensor. The
+  // batches of every sensor are ordered by time.
+  std::vector<ExternalFeaturesBatch> batches;
+  std::unordered_map<
+      aslam::SensorId, std::unordered_map<pose_graph::VertexId, size_t>>
+      sensor_to_vertex_to_batch_index;
+  for (const vi_map::ExternalFeaturesMeasurement::ConstPtr& measurement_ptr :
        all_measurements) {
     CHECK(measurement_ptr);
     CHECK_LE(
@@ -1064,17 +1416,9 @@ void StreamMapBuilder::notifyExternalFeaturesMeasurementBuffer() {
     CHECK_GE(
         measurement_ptr->getTimestampNanoseconds(),
         oldest_vertex_time_ns - external_features_sync_tolerance_ns_);
-    const vi_map::ExternalFeaturesMeasurement& external_features_measurement =
-        *measurement_ptr;
-
-    const aslam::SensorId external_features_sensor_id =
-        external_features_measurement.getSensorId();
-    const vi_map::ExternalFeatures& external_features_sensor =
-        map_->getSensorManager().getSensor<vi_map::ExternalFeatures>(
-            external_features_sensor_id);
 
     const int64_t timestamp_ns_measurement =
-        external_features_measurement.getTimestampNanoseconds();
+        measurement_ptr->getTimestampNanoseconds();
 
     pose_graph::VertexId closest_vertex_id;
     uint64_t delta_ns = 0u;
@@ -1090,131 +1434,132 @@ void StreamMapBuilder::notifyExternalFeaturesMeasurementBuffer() {
       continue;
     }
 
-    vi_map::Vertex& closest_vertex = map_->getVertex(closest_vertex_id);
-
-    const aslam::SensorId& target_ncamera_sensor_id =
-        external_features_sensor.getTargetNCameraId();
-    CHECK(closest_vertex.getNCameras()->getId() == target_ncamera_sensor_id)
-        << "Target NCamera " << target_ncamera_sensor_id
-        << " of external feature sensor " << external_features_sensor_id
-        << " is not attached to ";
-
-    const size_t cam_idx = external_features_sensor.getTargetCameraIndex();
-    aslam::VisualFrame::Ptr frame =
-        closest_vertex.getVisualFrameShared(cam_idx);
-
-    frame->lock();
-
-    Eigen::Matrix2Xd keypoint_measurements;
-    external_features_measurement.getKeypointMeasurements(
-        &keypoint_measurements);
-    frame->extendKeypointMeasurements(keypoint_measurements);
-
-    aslam::VisualFrame::DescriptorsT descriptors;
-    external_features_measurement.getDescriptors(&descriptors);
-    const int feature_type =
-        static_cast<int>(external_features_sensor.getFeatureType());
-    frame->extendDescriptors(descriptors, feature_type);
-
-    Eigen::VectorXd keypoint_uncertainties;
-    external_features_measurement.getKeypointUncertainties(
-        &keypoint_uncertainties);
-    frame->extendKeypointMeasurementUncertainties(keypoint_uncertainties);
-
-    Eigen::VectorXd keypoint_orientations;
-    if (external_features_measurement.getKeypointOrientations(
-            &keypoint_orientations)) {
-      frame->extendKeypointOrientations(keypoint_orientations);
-    }
-
-    Eigen::VectorXd keypoint_scores;
-    if (external_features_measurement.getKeypointScores(&keypoint_scores)) {
-      frame->extendKeypointScores(keypoint_scores);
-    }
-
-    Eigen::VectorXd keypoint_scales;
-    if (external_features_measurement.getKeypointScales(&keypoint_scales)) {
-      frame->extendKeypointScales(keypoint_scales);
-    }
-
-    if (vi_map::isLidarFeature(external_features_sensor.getFeatureType())) {
-      Eigen::Matrix3Xd keypoint_3d_positions;
-      const bool has_3d_positions =
-          external_features_measurement.getKeypoint3DPositions(
-              &keypoint_3d_positions);
-
-      Eigen::VectorXi keypoint_time_offsets;
-      const bool has_time_offsets =
-          external_features_measurement.getKeypointTimeOffsets(
-              &keypoint_time_offsets);
-
-      CHECK(has_3d_positions && has_time_offsets)
-          << "No depth and time offsets provided for 3D LiDAR feature.";
-
-      frame->extendKeypoint3DPositions(keypoint_3d_positions);
-      frame->extendKeypointTimeOffsets(keypoint_time_offsets);
+    auto insertion =
+        sensor_to_vertex_to_batch_index[measurement_ptr->getSensorId()]
+            .emplace(closest_vertex_id, batches.size());
+    if (insertion.second) {
+      batches.emplace_back();
+      batches.back().sensor_id = measurement_ptr->getSensorId();
+      batches.back().vertex_id = closest_vertex_id;
     }
+    batches[insertion.first->second].measurements.emplace_back(
+        measurement_ptr);
+  }
 
-    Eigen::VectorXi track_ids;
-    external_features_measurement.getTrackIds(&track_ids);
-    frame->extendTrackIds(track_ids);
-
-    frame->unlock();
-
-    closest_vertex.expandVisualObservationContainersIfNecessary();
-
-    // Perform outlier rejection on the externally added tracks
-    // TODO(smauq): add parameter in config file for this
-    auto it_vertex_id = external_features_previous_vertex_ids_.find(
-        external_features_sensor_id);
-    if (it_vertex_id == external_features_previous_vertex_ids_.end()) {
-      aslam::Camera::ConstPtr camera = closest_vertex.getCamera(cam_idx);
-      aslam::Quaternion q_C_B =
-          closest_vertex.getNCameras()->get_T_C_B(cam_idx).getRotation();
-      const feature_tracking::FeatureTrackingOutlierSettings outlier_settings;
-
-      external_features_outlier_rejection_pipelines_.emplace(
-          external_features_sensor_id,
-          new feature_tracking::VOOutlierRejectionPipeline(
-              camera, cam_idx, q_C_B, external_features_sensor.getFeatureType(),
-              outlier_settings));
-      external_features_previous_vertex_ids_.emplace(
-          external_features_sensor_id, closest_vertex_id);
-    } else {
-      CHECK(external_features_outlier_rejection_pipelines_.count(
-          external_features_sensor_id));
-      feature_tracking::VOOutlierRejectionPipeline& outlier_pipeline =
-          *external_features_outlier_rejection_pipelines_
-              [external_features_sensor_id];
-
-      if (!map_->hasVertex(it_vertex_id->second)) {
-        outlier_pipeline.reset();
-        LOG(WARNING) << "Skipping outlier removal because previous vertex is "
-                     << "no longer in map due to submapping.";
-      } else {
-        vi_map::Vertex& prev_vertex = map_->getVertex(it_vertex_id->second);
-
-        aslam::VisualFrame::Ptr prev_frame =
-            prev_vertex.getVisualFrameShared(cam_idx);
-
-        // TODO(smauq): Interpolate here would improve accuracy
-        aslam::Quaternion q_Bkp1_Bk =
-            closest_vertex.get_T_M_I().getRotation().inverse() *
-            prev_vertex.get_T_M_I().getRotation();
-
-        outlier_pipeline.rejectMatchesFrame(
-            q_Bkp1_Bk, frame.get(), prev_frame.get());
-      }
+  for (const ExternalFeaturesBatch& batch : batches) {
+    attachExternalFeaturesBatch(batch);
+  }
+}
 
-      // Current vertex is now the previously seen one
-      external_features_previous_vertex_ids_[external_features_sensor_id] =
-          closest_vertex_id;
+void StreamMapBuilder::attachExternalFeaturesBatch(
+    const ExternalFeaturesBatch& batch) {
+  CHECK(!batch.measurements.empty());
+  const aslam::SensorId& external_features_sensor_id = batch.sensor_id;
+  const pose_graph::VertexId& closest_vertex_id = batch.vertex_id;
+  const vi_map::ExternalFeatures& external_features_sensor =
+      map_->getSensorManager().getSensor<vi_map::ExternalFeatures>(
+          external_features_sensor_id);
+
+  // Late measurements may belong to a vertex that has been spilled already.
+  vi_map::Vertex& closest_vertex = getVertexWithDescriptors(closest_vertex_id);
+
+  const aslam::SensorId& target_ncamera_sensor_id =
+      external_features_sensor.getTargetNCameraId();
+  CHECK(closest_vertex.getNCameras()->getId() == target_ncamera_sensor_id)
+      << "Target NCamera " << target_ncamera_sensor_id
+      << " of external feature sensor " << external_features_sensor_id
+      << " is not attached to ";
+
+  const size_t cam_idx = external_features_sensor.getTargetCameraIndex();
+  aslam::VisualFrame::Ptr frame = closest_vertex.getVisualFrameShared(cam_idx);
+
+  // Concatenate all measurements before touching the frame, every extension
+  // of the frame reallocates all of its keypoint data.
+  ExternalFeaturesColumns columns;
+  concatenateExternalFeaturesMeasurements(
+      batch.measurements,
+      vi_map::isLidarFeature(external_features_sensor.getFeatureType()),
+      &columns);
+
+  frame->lock();
+  frame->extendKeypointMeasurements(columns.keypoint_measurements);
+  frame->extendDescriptors(
+      std::move(columns.descriptors),
+      static_cast<int>(external_features_sensor.getFeatureType()));
+  frame->extendKeypointMeasurementUncertainties(
+      columns.keypoint_uncertainties);
+  if (columns.keypoint_orientations.size() > 0) {
+    frame->extendKeypointOrientations(columns.keypoint_orientations);
+  }
+  if (columns.keypoint_scores.size() > 0) {
+    frame->extendKeypointScores(columns.keypoint_scores);
+  }
+  if (columns.keypoint_scales.size() > 0) {
+    frame->extendKeypointScales(columns.keypoint_scales);
+  }
+  if (columns.keypoint_3d_positions.cols() > 0) {
+    frame->extendKeypoint3DPositions(columns.keypoint_3d_positions);
+    frame->extendKeypointTimeOffsets(columns.keypoint_time_offsets);
+  }
+  frame->extendTrackIds(columns.track_ids);
+  frame->unlock();
+
+  closest_vertex.expandVisualObservationContainersIfNecessary();
+
+  // Perform outlier rejection on the externally added tracks, once for all
+  // measurements of this vertex.
+  // TODO(smauq): add parameter in config file for this
+  auto it_vertex_id =
+      external_features_previous_vertex_ids_.find(external_features_sensor_id);
+  if (it_vertex_id == external_features_previous_vertex_ids_.end()) {
+    aslam::Camera::ConstPtr camera = closest_vertex.getCamera(cam_idx);
+    aslam::Quaternion q_C_B =
+        closest_vertex.getNCameras()->get_T_C_B(cam_idx).getRotation();
+    const feature_tracking::FeatureTrackingOutlierSettings outlier_settings;
+
+    external_features_outlier_rejection_pipelines_.emplace(
+        external_features_sensor_id,
+        new feature_tracking::VOOutlierRejectionPipeline(
+            camera, cam_idx, q_C_B, external_features_sensor.getFeatureType(),
+            outlier_settings));
+    external_features_previous_vertex_ids_.emplace(
+        external_features_sensor_id, closest_vertex_id);
+  } else {
+    CHECK(external_features_outlier_rejection_pipelines_.count(
+        external_features_sensor_id));
+    feature_tracking::VOOutlierRejectionPipeline& outlier_pipeline =
+        *external_features_outlier_rejection_pipelines_
+            [external_features_sensor_id];
+
+    if (!map_->hasVertex(it_vertex_id->second)) {
+      outlier_pipeline.reset();
+      LOG(WARNING) << "Skipping outlier removal because previous vertex is "
+                   << "no longer in map due to submapping.";
+    } else if (it_vertex_id->second != closest_vertex_id) {
+      vi_map::Vertex& prev_vertex =
+          getVertexWithDescriptors(it_vertex_id->second);
+
+      aslam::VisualFrame::Ptr prev_frame =
+          prev_vertex.getVisualFrameShared(cam_idx);
+
+      // TODO(smauq): Interpolate here would improve accuracy
+      aslam::Quaternion q_Bkp1_Bk =
+          closest_vertex.get_T_M_I().getRotation().inverse() *
+          prev_vertex.get_T_M_I().getRotation();
+
+      outlier_pipeline.rejectMatchesFrame(
+          q_Bkp1_Bk, frame.get(), prev_frame.get());
     }
 
-    // Make info message more verbose
-    VLOG(3) << "[StreamMapBuilder] Attached a new external features "
-            << "measurement for vertex " << closest_vertex_id;
+    // Current vertex is now the previously seen one
+    external_features_previous_vertex_ids_[external_features_sensor_id] =
+        closest_vertex_id;
   }
+
+  VLOG(3) << "[StreamMapBuilder] Attached " << batch.measurements.size()
+          << " external features measurements with "
+          << columns.keypoint_measurements.cols() << " keypoints to vertex "
+          << closest_vertex_id;
 }
 
 }  // namespace online_map_builders
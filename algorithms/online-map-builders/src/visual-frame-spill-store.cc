@@ -0,0 +1,253 @@
+#include "online-map-builders/visual-frame-spill-store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <aslam/frames/visual-frame.h>
+#include <aslam/frames/visual-nframe.h>
+#include <glog/logging.h>
+#include <maplab-common/file-system-tools.h>
+#include <vi-map/vertex.h>
+
+namespace online_map_builders {
+
+namespace {
+
+const std::string kSpillFileName = "visual_frame_descriptors.spill";  // NOLINT
+
+size_t getDescriptorMemory(const aslam::VisualFrame& frame) {
+  size_t num_bytes = 0u;
+  const size_t num_blocks =
+      static_cast<size_t>(frame.getDescriptorTypes().size());
+  for (size_t block = 0u; block < num_blocks; ++block) {
+    num_bytes += frame.getDescriptors(block).size();
+  }
+  return num_bytes;
+}
+
+}  // namespace
+
+VisualFrameSpillStore::VisualFrameSpillStore(const std::string& spill_folder)
+    : spill_file_path_(
+          common::concatenateFolderAndFileName(spill_folder, kSpillFileName)),
+      spill_file_descriptor_(-1),
+      spill_file_size_(0u),
+      num_spilled_bytes_(0u),
+      next_spill_idx_(0u) {
+  CHECK(!spill_folder.empty());
+  CHECK(common::createPath(spill_folder))
+      << "Unable to create spill folder: " << spill_folder;
+  openSpillFile();
+}
+
+VisualFrameSpillStore::~VisualFrameSpillStore() {
+  if (!index_.empty()) {
+    LOG(WARNING) << "[VisualFrameSpillStore] Discarding the spilled "
+                 << "descriptors of " << index_.size() << " vertices.";
+  }
+  if (spill_file_descriptor_ >= 0) {
+    ::close(spill_file_descriptor_);
+  }
+  common::deleteFile(spill_file_path_);
+}
+
+void VisualFrameSpillStore::openSpillFile() {
+  spill_file_descriptor_ = ::open(
+      spill_file_path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  CHECK_GE(spill_file_descriptor_, 0)
+      << "Unable to open spill file " << spill_file_path_ << ": "
+      << std::strerror(errno);
+  spill_file_size_ = 0u;
+}
+
+size_t VisualFrameSpillStore::spillVertex(vi_map::Vertex* vertex) {
+  CHECK_NOTNULL(vertex);
+  const pose_graph::VertexId& vertex_id = vertex->id();
+  CHECK(!isSpilled(vertex_id)) << "Vertex " << vertex_id << " is already "
+                               << "spilled.";
+
+  VertexEntry vertex_entry;
+  vertex_entry.spill_idx = next_spill_idx_;
+  size_t num_released_bytes = 0u;
+  const aslam::VisualNFrame& nframe = vertex->getVisualNFrame();
+  for (unsigned int frame_idx = 0u; frame_idx < nframe.getNumFrames();
+       ++frame_idx) {
+    if (!nframe.isFrameSet(frame_idx)) {
+      continue;
+    }
+    aslam::VisualFrame& frame = vertex->getVisualFrame(frame_idx);
+    if (!frame.hasDescriptors() || getDescriptorMemory(frame) == 0u) {
+      continue;
+    }
+
+    std::string blob;
+    frame.serializeDescriptorsToString(&blob);
+
+    FrameEntry frame_entry;
+    frame_entry.frame_idx = frame_idx;
+    frame_entry.offset = spill_file_size_;
+    frame_entry.num_bytes = blob.size();
+    writeToSpillFile(spill_file_size_, blob);
+    spill_file_size_ += blob.size();
+    num_spilled_bytes_ += blob.size();
+    vertex_entry.frames.emplace_back(frame_entry);
+
+    // Swapping in empty blocks releases the memory but keeps the descriptor
+    // types of the frame intact.
+    num_released_bytes += getDescriptorMemory(frame);
+    const size_t num_blocks =
+        static_cast<size_t>(frame.getDescriptorTypes().size());
+    for (size_t block = 0u; block < num_blocks; ++block) {
+      aslam::VisualFrame::DescriptorsT empty_descriptors;
+      frame.getDescriptorsMutable(block)->swap(empty_descriptors);
+    }
+  }
+
+  if (!vertex_entry.frames.empty()) {
+    ++next_spill_idx_;
+    index_.emplace(vertex_id, std::move(vertex_entry));
+  }
+  return num_released_bytes;
+}
+
+bool VisualFrameSpillStore::reloadVertex(vi_map::Vertex* vertex) {
+  CHECK_NOTNULL(vertex);
+  std::unordered_map<pose_graph::VertexId, VertexEntry>::iterator it =
+      index_.find(vertex->id());
+  if (it == index_.end()) {
+    return false;
+  }
+
+  std::string blob;
+  for (const FrameEntry& frame_entry : it->second.frames) {
+    readFromSpillFile(frame_entry.offset, frame_entry.num_bytes, &blob);
+    vertex->getVisualFrame(frame_entry.frame_idx)
+        .deserializeDescriptorsFromString(blob);
+    num_spilled_bytes_ -= frame_entry.num_bytes;
+  }
+  index_.erase(it);
+  compactIfMostlyDead();
+  return true;
+}
+
+void VisualFrameSpillStore::discardVertex(
+    const pose_graph::VertexId& vertex_id) {
+  std::unordered_map<pose_graph::VertexId, VertexEntry>::iterator it =
+      index_.find(vertex_id);
+  if (it == index_.end()) {
+    return;
+  }
+  for (const FrameEntry& frame_entry : it->second.frames) {
+    num_spilled_bytes_ -= frame_entry.num_bytes;
+  }
+  index_.erase(it);
+  compactIfMostlyDead();
+}
+
+bool VisualFrameSpillStore::isSpilled(
+    const pose_graph::VertexId& vertex_id) const {
+  return index_.count(vertex_id) > 0u;
+}
+
+void VisualFrameSpillStore::getSpilledVertexIds(
+    pose_graph::VertexIdList* vertex_ids) const {
+  CHECK_NOTNULL(vertex_ids)->clear();
+  std::vector<std::pair<uint64_t, pose_graph::VertexId>> ordered_vertex_ids;
+  ordered_vertex_ids.reserve(index_.size());
+  for (const std::pair<const pose_graph::VertexId, VertexEntry>& entry :
+       index_) {
+    ordered_vertex_ids.emplace_back(entry.second.spill_idx, entry.first);
+  }
+  std::sort(
+      ordered_vertex_ids.begin(), ordered_vertex_ids.end(),
+      [](const std::pair<uint64_t, pose_graph::VertexId>& lhs,
+         const std::pair<uint64_t, pose_graph::VertexId>& rhs) {
+        return lhs.first < rhs.first;
+      });
+  vertex_ids->reserve(ordered_vertex_ids.size());
+  for (const std::pair<uint64_t, pose_graph::VertexId>& entry :
+       ordered_vertex_ids) {
+    vertex_ids->emplace_back(entry.second);
+  }
+}
+
+void VisualFrameSpillStore::readFromSpillFile(
+    const uint64_t offset, const size_t num_bytes, std::string* data) const {
+  CHECK_NOTNULL(data)->resize(num_bytes);
+  size_t num_bytes_read = 0u;
+  while (num_bytes_read < num_bytes) {
+    const ssize_t result = ::pread(
+        spill_file_descriptor_, &(*data)[num_bytes_read],
+        num_bytes - num_bytes_read,
+        static_cast<off_t>(offset + num_bytes_read));
+    CHECK_GT(result, 0) << "Failed to read from spill file "
+                        << spill_file_path_ << ": " << std::strerror(errno);
+    num_bytes_read += static_cast<size_t>(result);
+  }
+}
+
+void VisualFrameSpillStore::writeToSpillFile(
+    const uint64_t offset, const std::string& data) {
+  size_t num_bytes_written = 0u;
+  while (num_bytes_written < data.size()) {
+    const ssize_t result = ::pwrite(
+        spill_file_descriptor_, data.data() + num_bytes_written,
+        data.size() - num_bytes_written,
+        static_cast<off_t>(offset + num_bytes_written));
+    CHECK_GE(result, 0) << "Failed to write to spill file "
+                        << spill_file_path_ << ": " << std::strerror(errno);
+    num_bytes_written += static_cast<size_t>(result);
+  }
+}
+
+void VisualFrameSpillStore::compactIfMostlyDead() {
+  CHECK_LE(num_spilled_bytes_, spill_file_size_);
+  const uint64_t num_dead_bytes = spill_file_size_ - num_spilled_bytes_;
+  if (num_dead_bytes <= num_spilled_bytes_) {
+    return;
+  }
+
+  // Moving the frames in the order of their offsets only ever moves data
+  // towards the front of the file, i.e. never overwrites a frame that still
+  // has to be moved. The cost of a compaction is bounded by the number of
+  // dead bytes that have accumulated since the last one.
+  std::vector<FrameEntry*> frame_entries;
+  for (std::pair<const pose_graph::VertexId, VertexEntry>& entry : index_) {
+    for (FrameEntry& frame_entry : entry.second.frames) {
+      frame_entries.emplace_back(&frame_entry);
+    }
+  }
+  std::sort(
+      frame_entries.begin(), frame_entries.end(),
+      [](const FrameEntry* lhs, const FrameEntry* rhs) {
+        return lhs->offset < rhs->offset;
+      });
+
+  uint64_t compacted_file_size = 0u;
+  std::string blob;
+  for (FrameEntry* frame_entry : frame_entries) {
+    CHECK_LE(compacted_file_size, frame_entry->offset);
+    if (frame_entry->offset != compacted_file_size) {
+      readFromSpillFile(frame_entry->offset, frame_entry->num_bytes, &blob);
+      writeToSpillFile(compacted_file_size, blob);
+      frame_entry->offset = compacted_file_size;
+    }
+    compacted_file_size += frame_entry->num_bytes;
+  }
+  CHECK_EQ(compacted_file_size, num_spilled_bytes_);
+
+  CHECK_EQ(
+      ::ftruncate(
+          spill_file_descriptor_, static_cast<off_t>(compacted_file_size)),
+      0)
+      << "Failed to truncate spill file " << spill_file_path_ << ": "
+      << std::strerror(errno);
+  spill_file_size_ = compacted_file_size;
+}
+
+}  // namespace online_map_builders
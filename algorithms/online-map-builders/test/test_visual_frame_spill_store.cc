@@ -0,0 +1,243 @@
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/cameras/random-camera-generator.h>
+#include <aslam/common/memory.h>
+#include <aslam/common/unique-id.h>
+#include <aslam/frames/visual-frame.h>
+#include <aslam/frames/visual-nframe.h>
+#include <gtest/gtest.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <posegraph/unique-id.h>
+#include <vi-map/unique-id.h>
+#include <vi-map/vertex.h>
+
+#include "online-map-builders/visual-frame-spill-store.h"
+
+namespace online_map_builders {
+
+class VisualFrameSpillStoreTest : public ::testing::Test {
+ protected:
+  VisualFrameSpillStoreTest() : spill_folder_("./visual_frame_spill_test") {}
+
+  virtual void SetUp() {
+    cameras_ = aslam::createTestNCamera(kNumFrames);
+    aslam::generateId(&mission_id_);
+  }
+
+  // Every frame has a block of 48 byte descriptors, the first frame has an
+  // additional block of 16 byte descriptors of another type.
+  vi_map::Vertex::UniquePtr createVertex() {
+    aslam::NFramesId n_frame_id;
+    aslam::generateId(&n_frame_id);
+    aslam::VisualNFrame::Ptr n_frame(
+        new aslam::VisualNFrame(n_frame_id, cameras_));
+    for (unsigned int frame_idx = 0u; frame_idx < kNumFrames; ++frame_idx) {
+      aslam::FrameId frame_id;
+      aslam::generateId(&frame_id);
+      aslam::VisualFrame::Ptr frame(new aslam::VisualFrame);
+      frame->setId(frame_id);
+      frame->setTimestampNanoseconds(frame_idx);
+      frame->setCameraGeometry(cameras_->getCameraShared(frame_idx));
+
+      Eigen::Matrix2Xd keypoints(2, kNumKeypoints);
+      keypoints.setRandom();
+      aslam::VisualFrame::DescriptorsT descriptors(48, kNumKeypoints);
+      descriptors.setRandom();
+      frame->extendKeypointMeasurements(keypoints);
+      frame->extendDescriptors(descriptors, 0);
+      if (frame_idx == 0u) {
+        Eigen::Matrix2Xd other_keypoints(2, kNumOtherKeypoints);
+        other_keypoints.setRandom();
+        aslam::VisualFrame::DescriptorsT other_descriptors(
+            16, kNumOtherKeypoints);
+        other_descriptors.setRandom();
+        frame->extendKeypointMeasurements(other_keypoints);
+        frame->extendDescriptors(other_descriptors, 1);
+      }
+      n_frame->setFrame(frame_idx, frame);
+    }
+
+    pose_graph::VertexId vertex_id;
+    aslam::generateId(&vertex_id);
+    return aligned_unique<vi_map::Vertex>(vertex_id, n_frame, mission_id_);
+  }
+
+  // Deep copies all keypoints and descriptor blocks of the vertex.
+  struct FrameData {
+    Eigen::Matrix2Xd keypoints;
+    Eigen::VectorXi descriptor_types;
+    std::vector<aslam::VisualFrame::DescriptorsT> descriptors;
+  };
+  static std::vector<FrameData> copyFrameData(const vi_map::Vertex& vertex) {
+    std::vector<FrameData> frame_data(vertex.numFrames());
+    for (unsigned int frame_idx = 0u; frame_idx < frame_data.size();
+         ++frame_idx) {
+      const aslam::VisualFrame& frame = vertex.getVisualFrame(frame_idx);
+      frame_data[frame_idx].keypoints = frame.getKeypointMeasurements();
+      frame_data[frame_idx].descriptor_types = frame.getDescriptorTypes();
+      for (int block = 0; block < frame.getDescriptorTypes().size(); ++block) {
+        frame_data[frame_idx].descriptors.emplace_back(
+            frame.getDescriptors(block));
+      }
+    }
+    return frame_data;
+  }
+
+  static void expectFrameDataEqual(
+      const std::vector<FrameData>& expected, const vi_map::Vertex& vertex) {
+    const std::vector<FrameData> actual = copyFrameData(vertex);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t frame_idx = 0u; frame_idx < expected.size(); ++frame_idx) {
+      EXPECT_EQ(expected[frame_idx].keypoints, actual[frame_idx].keypoints);
+      EXPECT_EQ(
+          expected[frame_idx].descriptor_types,
+          actual[frame_idx].descriptor_types);
+      ASSERT_EQ(
+          expected[frame_idx].descriptors.size(),
+          actual[frame_idx].descriptors.size());
+      for (size_t block = 0u; block < expected[frame_idx].descriptors.size();
+           ++block) {
+        EXPECT_EQ(
+            expected[frame_idx].descriptors[block],
+            actual[frame_idx].descriptors[block]);
+      }
+    }
+  }
+
+  static constexpr unsigned int kNumFrames = 2u;
+  static constexpr int kNumKeypoints = 100;
+  static constexpr int kNumOtherKeypoints = 20;
+
+  const std::string spill_folder_;
+  aslam::NCamera::Ptr cameras_;
+  vi_map::MissionId mission_id_;
+};
+
+TEST_F(VisualFrameSpillStoreTest, SpillAndReloadRoundTrip) {
+  VisualFrameSpillStore spill_store(spill_folder_);
+  vi_map::Vertex::UniquePtr vertex = createVertex();
+  const std::vector<FrameData> original_frame_data = copyFrameData(*vertex);
+
+  const size_t num_released_bytes = spill_store.spillVertex(vertex.get());
+  EXPECT_EQ(
+      num_released_bytes,
+      static_cast<size_t>(
+          48 * kNumKeypoints * kNumFrames + 16 * kNumOtherKeypoints));
+  EXPECT_TRUE(spill_store.isSpilled(vertex->id()));
+  EXPECT_EQ(spill_store.numSpilledVertices(), 1u);
+  EXPECT_GT(spill_store.numSpilledBytes(), 0u);
+
+  // Only the descriptors are released, the keypoints and the descriptor
+  // types stay in memory.
+  for (unsigned int frame_idx = 0u; frame_idx < kNumFrames; ++frame_idx) {
+    const aslam::VisualFrame& frame = vertex->getVisualFrame(frame_idx);
+    EXPECT_EQ(
+        frame.getKeypointMeasurements(),
+        original_frame_data[frame_idx].keypoints);
+    EXPECT_EQ(
+        frame.getDescriptorTypes(),
+        original_frame_data[frame_idx].descriptor_types);
+    for (int block = 0; block < frame.getDescriptorTypes().size(); ++block) {
+      EXPECT_EQ(frame.getDescriptors(block).size(), 0);
+    }
+  }
+
+  EXPECT_TRUE(spill_store.reloadVertex(vertex.get()));
+  expectFrameDataEqual(original_frame_data, *vertex);
+  EXPECT_FALSE(spill_store.isSpilled(vertex->id()));
+  EXPECT_EQ(spill_store.numSpilledVertices(), 0u);
+  EXPECT_EQ(spill_store.numSpilledBytes(), 0u);
+
+  // A vertex that isn't spilled can't be reloaded.
+  EXPECT_FALSE(spill_store.reloadVertex(vertex.get()));
+  expectFrameDataEqual(original_frame_data, *vertex);
+}
+
+TEST_F(VisualFrameSpillStoreTest, SpillDiscardAndReloadMultipleVertices) {
+  constexpr size_t kNumVertices = 5u;
+  VisualFrameSpillStore spill_store(spill_folder_);
+  std::vector<vi_map::Vertex::UniquePtr> vertices;
+  std::vector<std::vector<FrameData>> original_frame_data;
+  pose_graph::VertexIdList vertex_ids;
+  for (size_t idx = 0u; idx < kNumVertices; ++idx) {
+    vertices.emplace_back(createVertex());
+    original_frame_data.emplace_back(copyFrameData(*vertices.back()));
+    vertex_ids.emplace_back(vertices.back()->id());
+    spill_store.spillVertex(vertices.back().get());
+  }
+
+  pose_graph::VertexIdList spilled_vertex_ids;
+  spill_store.getSpilledVertexIds(&spilled_vertex_ids);
+  EXPECT_EQ(spilled_vertex_ids, vertex_ids);
+
+  // Discarding a vertex keeps the others reloadable.
+  spill_store.discardVertex(vertex_ids[2u]);
+  EXPECT_FALSE(spill_store.isSpilled(vertex_ids[2u]));
+  EXPECT_EQ(spill_store.numSpilledVertices(), kNumVertices - 1u);
+
+  // Reload in reverse order to read from all over the spill file.
+  for (size_t idx = kNumVertices; idx-- > 0u;) {
+    if (idx == 2u) {
+      EXPECT_FALSE(spill_store.reloadVertex(vertices[idx].get()));
+      continue;
+    }
+    EXPECT_TRUE(spill_store.reloadVertex(vertices[idx].get()));
+    expectFrameDataEqual(original_frame_data[idx], *vertices[idx]);
+  }
+  EXPECT_EQ(spill_store.numSpilledVertices(), 0u);
+  EXPECT_EQ(spill_store.numSpilledBytes(), 0u);
+
+  // Vertices can be spilled again once they have been reloaded.
+  spill_store.spillVertex(vertices[0u].get());
+  EXPECT_TRUE(spill_store.reloadVertex(vertices[0u].get()));
+  expectFrameDataEqual(original_frame_data[0u], *vertices[0u]);
+}
+
+TEST_F(VisualFrameSpillStoreTest, CompactsSpillFile) {
+  constexpr size_t kNumVertices = 4u;
+  VisualFrameSpillStore spill_store(spill_folder_);
+  std::vector<vi_map::Vertex::UniquePtr> vertices;
+  std::vector<std::vector<FrameData>> original_frame_data;
+  for (size_t idx = 0u; idx < kNumVertices; ++idx) {
+    vertices.emplace_back(createVertex());
+    original_frame_data.emplace_back(copyFrameData(*vertices.back()));
+    spill_store.spillVertex(vertices.back().get());
+  }
+  const size_t num_bytes_per_vertex =
+      spill_store.numSpilledBytes() / kNumVertices;
+  EXPECT_EQ(spill_store.spillFileSizeBytes(), spill_store.numSpilledBytes());
+
+  // As long as the dead bytes don't outnumber the spilled bytes, the spill
+  // file is left as is.
+  EXPECT_TRUE(spill_store.reloadVertex(vertices[0u].get()));
+  EXPECT_TRUE(spill_store.reloadVertex(vertices[1u].get()));
+  EXPECT_EQ(spill_store.numSpilledBytes(), 2u * num_bytes_per_vertex);
+  EXPECT_EQ(spill_store.spillFileSizeBytes(), 4u * num_bytes_per_vertex);
+
+  // Afterwards, the remaining vertices are moved to the front of the file.
+  spill_store.discardVertex(vertices[2u]->id());
+  EXPECT_EQ(spill_store.numSpilledBytes(), num_bytes_per_vertex);
+  EXPECT_EQ(spill_store.spillFileSizeBytes(), num_bytes_per_vertex);
+
+  // Repeatedly spilling and reloading doesn't grow the file without bound.
+  for (size_t iteration = 0u; iteration < 10u; ++iteration) {
+    spill_store.spillVertex(vertices[0u].get());
+    EXPECT_TRUE(spill_store.reloadVertex(vertices[0u].get()));
+    expectFrameDataEqual(original_frame_data[0u], *vertices[0u]);
+    EXPECT_LE(
+        spill_store.spillFileSizeBytes(),
+        2u * spill_store.numSpilledBytes());
+  }
+
+  // The moved vertex is still reloaded correctly.
+  EXPECT_TRUE(spill_store.reloadVertex(vertices[3u].get()));
+  expectFrameDataEqual(original_frame_data[3u], *vertices[3u]);
+  EXPECT_EQ(spill_store.numSpilledBytes(), 0u);
+  EXPECT_EQ(spill_store.spillFileSizeBytes(), 0u);
+}
+
+}  // namespace online_map_builders
+
+MAPLAB_UNITTEST_ENTRYPOINT
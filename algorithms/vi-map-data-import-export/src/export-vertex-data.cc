@@ -3,7 +3,7 @@
 #include <aslam/common/unique-id.h>
 #include <console-common/command-registerer.h>
 #include <glog/logging.h>
-#include <landmark-triangulation/pose-interpolator.h>
+#include <landmark-triangulation/pose-interpolation-cache.h>
 #include <maplab-common/file-logger.h>
 #include <maplab-common/progress-bar.h>
 #include <sensors/sensor-types.h>
@@ -121,6 +121,9 @@ int exportPosesVelocitiesAndBiasesToCsv(
     return common::kStupidUserError;
   }
 
+  // The poses of all vertices of a mission are interpolated from the same
+  // integrated trajectory.
+  landmark_triangulation::PoseInterpolationCache pose_interpolation_cache;
   for (const vi_map::MissionId& mission_id : mission_ids) {
     CHECK(mission_id.isValid());
     pose_graph::VertexIdList vertex_ids_along_mission_graph;
@@ -128,17 +131,16 @@ int exportPosesVelocitiesAndBiasesToCsv(
         mission_id, &vertex_ids_along_mission_graph);
     const size_t num_vertices_in_mission =
         vertex_ids_along_mission_graph.size();
-    for (size_t idx = 0u; idx < num_vertices_in_mission; ++idx) {
-      const pose_graph::VertexId& vertex_id =
-          vertex_ids_along_mission_graph[idx];
-      CHECK(vertex_id.isValid());
-      const vi_map::Vertex& vertex = map.getVertex(vertex_id);
-      const vi_map::MissionId& mission_id = vertex.getMissionId();
-      CHECK(mission_id.isValid());
-      if (use_imu_timestamps) {
-        const landmark_triangulation::PoseInterpolator pose_interpolator;
-        const aslam::Transformation& T_G_M =
-            map.getMissionBaseFrameForMission(mission_id).get_T_G_M();
+    if (use_imu_timestamps) {
+      // Gather the IMU timestamps of the whole mission, such that all poses
+      // are interpolated in a single query.
+      std::vector<int64_t> imu_timestamps_along_mission;
+      pose_graph::VertexIdList vertex_id_per_timestamp;
+      for (size_t idx = 0u; idx < num_vertices_in_mission; ++idx) {
+        const pose_graph::VertexId& vertex_id =
+            vertex_ids_along_mission_graph[idx];
+        CHECK(vertex_id.isValid());
+        const vi_map::Vertex& vertex = map.getVertex(vertex_id);
         pose_graph::EdgeIdSet outgoing_edges;
         vertex.getOutgoingEdges(&outgoing_edges);
         pose_graph::EdgeId outgoing_imu_edge_id;
@@ -155,40 +157,58 @@ int exportPosesVelocitiesAndBiasesToCsv(
 
         const vi_map::ViwlsEdge& imu_edge =
             map.getEdgeAs<vi_map::ViwlsEdge>(outgoing_imu_edge_id);
-        Eigen::Matrix<int64_t, 1, Eigen::Dynamic> imu_timestamps =
+        const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>& imu_timestamps =
             imu_edge.getImuTimestamps();
-        if (idx + 2u < num_vertices_in_mission) {
-          // The last measurement of an IMU edge and the first measurement of
-          // the following IMU edge are the same, therefore we remove the first
-          // one to avoid duplicates unless it is the first vertex of the
-          // mission.
-          imu_timestamps.conservativeResize(imu_timestamps.cols() - 1u);
+        // The last measurement of an IMU edge and the first measurement of
+        // the following IMU edge are the same, therefore we remove the last
+        // one to avoid duplicates unless it is the last edge of the mission.
+        int num_imu_timestamps = imu_timestamps.cols();
+        if (idx + 2u < num_vertices_in_mission && num_imu_timestamps > 0) {
+          --num_imu_timestamps;
         }
-        if (imu_timestamps.cols() == 0) {
-          continue;
+        for (int col_idx = 0; col_idx < num_imu_timestamps; ++col_idx) {
+          imu_timestamps_along_mission.emplace_back(imu_timestamps(col_idx));
+          vertex_id_per_timestamp.emplace_back(vertex_id);
         }
-        aslam::TransformationVector imu_poses_vector;
-        std::vector<Eigen::Vector3d> velocity_vector;
-        std::vector<Eigen::Vector3d> accel_biases_vector;
-        std::vector<Eigen::Vector3d> gyro_biases_vector;
-        pose_interpolator.getPosesAtTime(
-            map, mission_id, imu_timestamps, &imu_poses_vector,
-            &velocity_vector, &gyro_biases_vector, &accel_biases_vector);
-
-        for (size_t idx = 0u; idx < imu_poses_vector.size(); ++idx) {
-          const int64_t timestamp_nanoseconds = imu_timestamps[idx];
-          const aslam::Transformation& T_M_I = imu_poses_vector[idx];
-          const aslam::Transformation T_G_I = T_G_M * T_M_I;
-          const aslam::Transformation T_G_S = T_G_I * T_I_S;
-          const aslam::Transformation T_M_S = T_M_I * T_I_S;
-          const Eigen::Vector3d& v_M = velocity_vector[idx];
-          const Eigen::Vector3d& gyro_bias = gyro_biases_vector[idx];
-          const Eigen::Vector3d& acc_bias = accel_biases_vector[idx];
-          writeLineToCsv(
-              format, mission_id, vertex_id, timestamp_nanoseconds, T_G_S,
-              T_M_S, v_M, gyro_bias, acc_bias, &csv_file);
-        }
-      } else {
+      }
+      if (imu_timestamps_along_mission.empty()) {
+        continue;
+      }
+
+      const Eigen::Matrix<int64_t, 1, Eigen::Dynamic> imu_timestamps =
+          Eigen::Map<const Eigen::Matrix<int64_t, 1, Eigen::Dynamic>>(
+              imu_timestamps_along_mission.data(),
+              imu_timestamps_along_mission.size());
+      aslam::TransformationVector imu_poses_vector;
+      std::vector<Eigen::Vector3d> velocity_vector;
+      std::vector<Eigen::Vector3d> accel_biases_vector;
+      std::vector<Eigen::Vector3d> gyro_biases_vector;
+      pose_interpolation_cache.getPosesAtTime(
+          map, mission_id, imu_timestamps, &imu_poses_vector, &velocity_vector,
+          &gyro_biases_vector, &accel_biases_vector);
+
+      const aslam::Transformation& T_G_M =
+          map.getMissionBaseFrameForMission(mission_id).get_T_G_M();
+      for (size_t idx = 0u; idx < imu_poses_vector.size(); ++idx) {
+        const int64_t timestamp_nanoseconds = imu_timestamps_along_mission[idx];
+        const aslam::Transformation& T_M_I = imu_poses_vector[idx];
+        const aslam::Transformation T_G_I = T_G_M * T_M_I;
+        const aslam::Transformation T_G_S = T_G_I * T_I_S;
+        const aslam::Transformation T_M_S = T_M_I * T_I_S;
+        const Eigen::Vector3d& v_M = velocity_vector[idx];
+        const Eigen::Vector3d& gyro_bias = gyro_biases_vector[idx];
+        const Eigen::Vector3d& acc_bias = accel_biases_vector[idx];
+        writeLineToCsv(
+            format, mission_id, vertex_id_per_timestamp[idx],
+            timestamp_nanoseconds, T_G_S, T_M_S, v_M, gyro_bias, acc_bias,
+            &csv_file);
+      }
+    } else {
+      for (size_t idx = 0u; idx < num_vertices_in_mission; ++idx) {
+        const pose_graph::VertexId& vertex_id =
+            vertex_ids_along_mission_graph[idx];
+        CHECK(vertex_id.isValid());
+        const vi_map::Vertex& vertex = map.getVertex(vertex_id);
         const int64_t timestamp_nanoseconds =
             vertex.getMinTimestampNanoseconds();
         const aslam::Transformation& T_G_I = map.getVertex_T_G_I(vertex_id);
@@ -9,6 +9,9 @@
 
 namespace vi_map_helpers {
 
+// Answers whether missions observe common landmarks or are connected by a
+// loop-closure edge. The coobserving missions are collected in a single pass
+// over all landmarks and their observations.
 class MissionCoobservationCachedQuery {
  public:
   MissionCoobservationCachedQuery(
@@ -19,16 +22,20 @@ class MissionCoobservationCachedQuery {
       const vi_map::MissionIdSet& other_mission_ids) const;
 
  private:
-  typedef std::unordered_map<vi_map::MissionId, vi_map::LandmarkIdSet>
-      MissionLandmarksMap;
-  MissionLandmarksMap mission_landmark_map_;
-  typedef std::unordered_map<vi_map::MissionId, pose_graph::EdgeIdSet>
-      MissionEdgeMap;
-  MissionEdgeMap mission_lc_edge_;
+  typedef std::unordered_map<vi_map::MissionId, vi_map::MissionIdSet>
+      MissionCoobservationMap;
+  MissionCoobservationMap coobserving_missions_;
 };
 
+// Clusters the missions that are connected through commonly observed
+// landmarks or loop-closure edges. Every landmark is visited once and the
+// missions are grouped with a union-find. The landmarks are split by their
+// storing vertices into one shard per thread.
 std::vector<vi_map::MissionIdSet> clusterMissionByLandmarkCoobservations(
     const vi_map::VIMap& vi_map, const vi_map::MissionIdSet& mission_ids);
+std::vector<vi_map::MissionIdSet> clusterMissionByLandmarkCoobservations(
+    const vi_map::VIMap& vi_map, const vi_map::MissionIdSet& mission_ids,
+    const size_t num_threads);
 
 size_t getNumAbsolute6DoFConstraintsForMissionCluster(
     const vi_map::VIMap& vi_map, const vi_map::MissionIdSet& mission_ids);
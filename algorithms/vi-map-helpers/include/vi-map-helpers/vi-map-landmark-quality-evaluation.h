@@ -15,6 +15,42 @@ typedef std::unordered_map<int, vi_map::KeypointIdentifierList>
 }  // namespace vi_map
 
 namespace vi_map_helpers {
+// Evaluates the landmark quality of all given missions in a single parallel
+// pass. The geometric inputs of the quality of every landmark, i.e. its
+// position, its observations and the poses of the observing cameras, are
+// fingerprinted and cached together with the resulting quality. Subsequent
+// evaluations only re-evaluate landmarks whose inputs changed since the last
+// pass, whose quality was modified in the meantime or if any of the quality
+// parameters changed.
+class LandmarkQualityEvaluator {
+ public:
+  LandmarkQualityEvaluator();
+
+  void evaluate(const vi_map::MissionIdList& mission_ids, vi_map::VIMap* map);
+  void evaluate(vi_map::VIMap* map);
+
+  void clear();
+  inline size_t numCachedLandmarks() const {
+    return cache_.size();
+  }
+  inline size_t numLandmarksEvaluatedInLastPass() const {
+    return num_evaluated_in_last_pass_;
+  }
+
+ private:
+  struct CachedQuality {
+    CachedQuality()
+        : inputs_hash(0u), quality(vi_map::Landmark::Quality::kUnknown) {}
+    size_t inputs_hash;
+    vi_map::Landmark::Quality quality;
+  };
+
+  std::unordered_map<vi_map::LandmarkId, CachedQuality> cache_;
+  size_t parameters_hash_;
+  size_t num_evaluated_in_last_pass_;
+};
+
+// Re-evaluates the quality of all landmarks without caching.
 void evaluateLandmarkQuality(vi_map::VIMap* map);
 void evaluateLandmarkQuality(
     const vi_map::MissionIdList& mission_ids, vi_map::VIMap* map);
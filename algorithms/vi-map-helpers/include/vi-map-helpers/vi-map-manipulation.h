@@ -80,6 +80,16 @@ class VIMapManipulation {
       const vi_map::MissionId& mission_id,
       const pose_graph::VertexId& starting_vertex_id,
       vi_map::LandmarkIdList* initialized_landmark_ids = nullptr);
+  // Same as above, but the track id to landmark id association is kept in
+  // trackid_landmarkid_map across calls. This allows to initialize the
+  // landmarks incrementally without duplicating landmarks of tracks that span
+  // several calls. Afterwards, only the tracks that are still observed in the
+  // last processed vertex remain in the map. Returns the number of new
+  // landmarks.
+  size_t initializeLandmarksFromUnusedFeatureTracksOfMission(
+      const vi_map::MissionId& mission_id,
+      const pose_graph::VertexId& starting_vertex_id,
+      MultiTrackIndexToLandmarkIdMap* trackid_landmarkid_map);
   void initializeLandmarksFromUnusedFeatureTracksOfOrderedVertices(
       const pose_graph::VertexIdList& ordered_vertex_ids,
       MultiTrackIndexToLandmarkIdMap* trackid_landmarkid_map);
@@ -188,14 +188,6 @@ class VIMapQueries {
           const vi_map::Vertex& storing_vertex)>& action) const;
 
  private:
-  struct VertexCommonLandmarksCountComparator {
-    bool operator()(
-        const VertexCommonLandmarksCount& i,
-        const VertexCommonLandmarksCount& j) const {
-      return i.in_common > j.in_common;
-    }
-  };
-
   const vi_map::VIMap& map_;
 };
 
@@ -0,0 +1,67 @@
+#ifndef VI_MAP_HELPERS_VI_MAP_VISUAL_FRAME_COMPACTION_H_
+#define VI_MAP_HELPERS_VI_MAP_VISUAL_FRAME_COMPACTION_H_
+
+#include <string>
+
+#include <vi-map/vi-map.h>
+
+namespace vi_map_helpers {
+
+struct VisualFrameCompactionOptions {
+  // Reads the options from the visual_frame_compaction_* flags.
+  static VisualFrameCompactionOptions getFromGflags();
+
+  // Keeps keypoints that belong to a feature track (track id >= 0) even if
+  // they are not associated with a landmark, such that landmarks can still be
+  // (re-)initialized from these tracks.
+  bool keep_tracked_keypoints = false;
+  // Replaces the descriptors of all observations of a landmark with the
+  // medoid of these descriptors, i.e. the observed descriptor with the
+  // smallest summed Hamming distance to all others.
+  bool use_representative_descriptors = false;
+};
+
+struct VisualFrameCompactionStatistics {
+  size_t num_frames = 0u;
+  size_t num_keypoints_before = 0u;
+  size_t num_keypoints_after = 0u;
+  // Number of bytes of all keypoint channels and descriptors.
+  size_t num_bytes_before = 0u;
+  size_t num_bytes_after = 0u;
+  size_t num_landmarks_with_representative_descriptor = 0u;
+
+  void accumulate(const VisualFrameCompactionStatistics& other);
+  std::string toString() const;
+};
+
+// Removes all keypoints that are not associated with a landmark from the
+// visual frames of the given vertices. All keypoint channels and descriptor
+// blocks are compacted and the keypoint indices of the landmark observations
+// are updated accordingly. The removed keypoints can't be used for landmark
+// initialization or descriptor based loop closure queries anymore, landmark
+// based loop closure is not affected.
+VisualFrameCompactionStatistics compactVisualFrames(
+    const VisualFrameCompactionOptions& options,
+    const pose_graph::VertexIdList& vertex_ids, vi_map::VIMap* map);
+VisualFrameCompactionStatistics compactVisualFrames(
+    const VisualFrameCompactionOptions& options,
+    const vi_map::MissionIdList& mission_ids, vi_map::VIMap* map);
+
+// Compacts the frames of a single vertex without touching the descriptors of
+// the landmarks, which is safe to use while a map is being built.
+VisualFrameCompactionStatistics compactVisualFramesOfVertex(
+    const VisualFrameCompactionOptions& options,
+    const pose_graph::VertexId& vertex_id, vi_map::VIMap* map);
+
+// Overwrites the descriptors of all observations of the landmark with the
+// medoid descriptor of these observations. Returns false if the landmark has
+// less than two observations with descriptors.
+bool setRepresentativeLandmarkDescriptor(
+    const vi_map::LandmarkId& landmark_id, vi_map::VIMap* map);
+
+// Memory of all keypoint channels and descriptors of a frame.
+size_t getVisualFrameMemoryBytes(const aslam::VisualFrame& frame);
+
+}  // namespace vi_map_helpers
+
+#endif  // VI_MAP_HELPERS_VI_MAP_VISUAL_FRAME_COMPACTION_H_
@@ -1,73 +1,124 @@
 #include "vi-map-helpers/mission-clustering-coobservation.h"
 
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <numeric>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include <maplab-common/accessors.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
+#include <maplab-common/union-find.h>
 #include <vi-map/vi-map.h>
 
-#include "vi-map-helpers/vi-map-queries.h"
-
 namespace vi_map_helpers {
 namespace {
 
-template <typename IdType>
-bool haveCommonElements(
-    const std::unordered_set<IdType>& set_a,
-    const std::unordered_set<IdType>& set_b) {
-  // Make sure we loop over the smaller set.
-  if (set_b.size() < set_a.size()) {
-    return haveCommonElements<IdType>(set_b, set_a);
-  }
+// Calls the action with the queried missions that observe the same landmark
+// or that are connected by a loop-closure edge, for the landmarks stored in
+// the given vertices and the loop-closure edges leaving them. The action is
+// only called for at least two distinct missions.
+void forEachGroupOfConnectedMissions(
+    const vi_map::VIMap& vi_map, const vi_map::MissionIdSet& mission_ids,
+    const pose_graph::VertexIdList& vertex_ids,
+    const std::vector<size_t>& vertex_indices,
+    const std::function<void(const vi_map::MissionIdList&)>& action) {
+  CHECK(action);
+  vi_map::MissionIdList connected_mission_ids;
+  auto add_mission_of_vertex = [&](const pose_graph::VertexId& vertex_id) {
+    if (!vi_map.hasVertex(vertex_id)) {
+      return;
+    }
+    const vi_map::MissionId& mission_id =
+        vi_map.getMissionIdForVertex(vertex_id);
+    if (mission_ids.count(mission_id) > 0u &&
+        std::find(
+            connected_mission_ids.begin(), connected_mission_ids.end(),
+            mission_id) == connected_mission_ids.end()) {
+      connected_mission_ids.emplace_back(mission_id);
+    }
+  };
 
-  for (const IdType& id : set_a) {
-    if (set_b.count(id) > 0u) {
-      return true;
+  for (const size_t vertex_idx : vertex_indices) {
+    CHECK_LT(vertex_idx, vertex_ids.size());
+    const vi_map::Vertex& vertex = vi_map.getVertex(vertex_ids[vertex_idx]);
+
+    for (const vi_map::Landmark& landmark : vertex.getLandmarks()) {
+      connected_mission_ids.clear();
+      pose_graph::VertexId last_observer_id;
+      landmark.forEachObservation(
+          [&](const vi_map::KeypointIdentifier& observation) {
+            // The observations of a vertex are usually consecutive.
+            if (observation.frame_id.vertex_id != last_observer_id) {
+              last_observer_id = observation.frame_id.vertex_id;
+              add_mission_of_vertex(last_observer_id);
+            }
+          });
+      if (connected_mission_ids.size() > 1u) {
+        action(connected_mission_ids);
+      }
+    }
+
+    if (mission_ids.count(vertex.getMissionId()) == 0u) {
+      continue;
+    }
+    pose_graph::EdgeIdSet outgoing_edge_ids;
+    vertex.getOutgoingEdges(&outgoing_edge_ids);
+    for (const pose_graph::EdgeId& edge_id : outgoing_edge_ids) {
+      if (vi_map.getEdgeType(edge_id) !=
+          pose_graph::Edge::EdgeType::kLoopClosure) {
+        continue;
+      }
+      connected_mission_ids.clear();
+      connected_mission_ids.emplace_back(vertex.getMissionId());
+      add_mission_of_vertex(vi_map.getEdgeAs<vi_map::Edge>(edge_id).to());
+      if (connected_mission_ids.size() > 1u) {
+        action(connected_mission_ids);
+      }
     }
   }
-  return false;
 }
 }  // namespace
 
 MissionCoobservationCachedQuery::MissionCoobservationCachedQuery(
     const vi_map::VIMap& vi_map, const vi_map::MissionIdSet& mission_ids) {
   for (const vi_map::MissionId& mission_id : mission_ids) {
-    vi_map_helpers::VIMapQueries queries(vi_map);
-    queries.getLandmarksObservedByMission(
-        mission_id, &mission_landmark_map_[mission_id]);
+    coobserving_missions_[mission_id];
   }
 
-  for (const vi_map::MissionId& mission_id : mission_ids) {
-    pose_graph::EdgeIdList mission_lc_edges;
-    vi_map.getAllEdgeIdsInMissionAlongGraph(
-        mission_id, pose_graph::Edge::EdgeType::kLoopClosure,
-        &mission_lc_edges);
-    pose_graph::EdgeIdSet mission_lc_edges_set;
-    std::copy(
-        mission_lc_edges.begin(), mission_lc_edges.end(),
-        std::inserter(mission_lc_edges_set, mission_lc_edges_set.end()));
-    mission_lc_edge_[mission_id] = mission_lc_edges_set;
-  }
+  pose_graph::VertexIdList vertex_ids;
+  vi_map.getAllVertexIds(&vertex_ids);
+  std::vector<size_t> vertex_indices(vertex_ids.size());
+  std::iota(vertex_indices.begin(), vertex_indices.end(), 0u);
+  forEachGroupOfConnectedMissions(
+      vi_map, mission_ids, vertex_ids, vertex_indices,
+      [this](const vi_map::MissionIdList& connected_mission_ids) {
+        for (const vi_map::MissionId& mission_id : connected_mission_ids) {
+          vi_map::MissionIdSet& coobserving_missions =
+              coobserving_missions_[mission_id];
+          for (const vi_map::MissionId& other_mission_id :
+               connected_mission_ids) {
+            if (other_mission_id != mission_id) {
+              coobserving_missions.emplace(other_mission_id);
+            }
+          }
+        }
+      });
 }
 
 bool MissionCoobservationCachedQuery::hasCommonObservations(
     const vi_map::MissionId& mission_id,
     const vi_map::MissionIdSet& other_mission_ids) const {
   CHECK(mission_id.isValid());
-  const vi_map::LandmarkIdSet& landmarks_of_mission =
-      common::getChecked(mission_landmark_map_, mission_id);
-  const pose_graph::EdgeIdSet& edge_ids_of_mission =
-      common::getChecked(mission_lc_edge_, mission_id);
+  const vi_map::MissionIdSet& coobserving_missions =
+      common::getChecked(coobserving_missions_, mission_id);
 
   for (const vi_map::MissionId& other_mission_id : other_mission_ids) {
-    const vi_map::LandmarkIdSet& landmarks_of_other_mission =
-        common::getChecked(mission_landmark_map_, other_mission_id);
-    const pose_graph::EdgeIdSet& edge_ids_of_other_mission =
-        common::getChecked(mission_lc_edge_, other_mission_id);
-
-    if (haveCommonElements(landmarks_of_mission, landmarks_of_other_mission) ||
-        haveCommonElements(edge_ids_of_mission, edge_ids_of_other_mission)) {
+    CHECK_GT(coobserving_missions_.count(other_mission_id), 0u);
+    if (coobserving_missions.count(other_mission_id) > 0u) {
       return true;
     }
   }
@@ -76,27 +127,69 @@ bool MissionCoobservationCachedQuery::hasCommonObservations(
 
 std::vector<vi_map::MissionIdSet> clusterMissionByLandmarkCoobservations(
     const vi_map::VIMap& vi_map, const vi_map::MissionIdSet& mission_ids) {
-  std::vector<vi_map::MissionIdSet> components;
+  return clusterMissionByLandmarkCoobservations(
+      vi_map, mission_ids, common::getNumHardwareThreads());
+}
 
-  MissionCoobservationCachedQuery coobservations(vi_map, mission_ids);
+std::vector<vi_map::MissionIdSet> clusterMissionByLandmarkCoobservations(
+    const vi_map::VIMap& vi_map, const vi_map::MissionIdSet& mission_ids,
+    const size_t num_threads) {
+  CHECK_GT(num_threads, 0u);
+  common::UnionFind<vi_map::MissionId> mission_clusters;
+  mission_clusters.reserve(mission_ids.size());
+  for (const vi_map::MissionId& mission_id : mission_ids) {
+    CHECK(vi_map.hasMission(mission_id));
+    mission_clusters.add(mission_id);
+  }
+
+  if (mission_ids.size() > 1u) {
+    pose_graph::VertexIdList vertex_ids;
+    vi_map.getAllVertexIds(&vertex_ids);
+
+    // Every shard merges the missions in its own union-find, which are
+    // combined at the end.
+    std::mutex mission_clusters_mutex;
+    std::function<void(const std::vector<size_t>&)> cluster_function =
+        [&](const std::vector<size_t>& batch) {
+          common::UnionFind<vi_map::MissionId> shard_mission_clusters;
+          forEachGroupOfConnectedMissions(
+              vi_map, mission_ids, vertex_ids, batch,
+              [&shard_mission_clusters](
+                  const vi_map::MissionIdList& connected_mission_ids) {
+                for (size_t idx = 1u; idx < connected_mission_ids.size();
+                     ++idx) {
+                  shard_mission_clusters.merge(
+                      connected_mission_ids[idx], connected_mission_ids[0]);
+                }
+              });
 
+          std::lock_guard<std::mutex> lock(mission_clusters_mutex);
+          shard_mission_clusters.forEachElement(
+              [&mission_clusters](
+                  const vi_map::MissionId& mission_id,
+                  const vi_map::MissionId& representative_mission_id) {
+                mission_clusters.merge(mission_id, representative_mission_id);
+              });
+        };
+    constexpr bool kAlwaysParallelize = false;
+    common::ParallelProcess(
+        vertex_ids.size(), cluster_function, kAlwaysParallelize, num_threads);
+  }
+
+  std::vector<vi_map::MissionIdSet> clusters;
+  clusters.reserve(mission_clusters.numSets());
+  std::unordered_map<vi_map::MissionId, size_t> cluster_indices;
   for (const vi_map::MissionId& mission_id : mission_ids) {
-    vi_map::MissionIdSet new_component;
-    new_component.emplace(mission_id);
-    for (std::vector<vi_map::MissionIdSet>::iterator it = components.begin();
-         it != components.end();) {
-      if (coobservations.hasCommonObservations(mission_id, *it)) {
-        // Add the existing component items to the new component.
-        new_component.insert(it->begin(), it->end());
-        // Remove the old component from the components list.
-        it = components.erase(it);
-      } else {
-        ++it;
-      }
+    const vi_map::MissionId representative_mission_id =
+        mission_clusters.find(mission_id);
+    if (cluster_indices.count(representative_mission_id) == 0u) {
+      cluster_indices.emplace(representative_mission_id, clusters.size());
+      clusters.emplace_back();
     }
-    components.emplace_back(new_component);
+    clusters[cluster_indices.at(representative_mission_id)].emplace(
+        mission_id);
   }
-  return components;
+  return clusters;
 }
 
 size_t getNumAbsolute6DoFConstraintsForMissionCluster(
@@ -1,5 +1,9 @@
 #include "vi-map-helpers/vi-map-landmark-quality-evaluation.h"
 
+#include <functional>
+#include <mutex>
+
+#include <aslam/common/statistics/statistics.h>
 #include <glog/logging.h>
 #include <landmark-triangulation/landmark-triangulation.h>
 #include <maplab-common/multi-threaded-progress-bar.h>
@@ -11,46 +15,177 @@
 
 namespace vi_map_helpers {
 
-void evaluateLandmarkQuality(
+namespace {
+inline void combineHash(const size_t value, size_t* seed) {
+  *seed ^= value + 0x9e3779b9 + (*seed << 6) + (*seed >> 2);
+}
+
+template <typename Derived>
+inline void combineHash(
+    const Eigen::MatrixBase<Derived>& values, size_t* seed) {
+  const std::hash<double> hasher;
+  for (int i = 0; i < values.size(); ++i) {
+    combineHash(hasher(values(i)), seed);
+  }
+}
+
+// Fingerprint of everything the geometric landmark quality depends on. The
+// keypoint measurements and the camera intrinsics enter the reprojection
+// error check of --elq_max_reprojection_error_px.
+size_t hashLandmarkQualityInputs(
+    const vi_map::VIMap& map, const vi_map::Landmark& landmark) {
+  size_t seed = static_cast<size_t>(landmark.getFeatureType());
+  combineHash(map.getLandmark_G_p_fi(landmark.id()), &seed);
+
+  const std::hash<vi_map::KeypointIdentifier> keypoint_hasher;
+  for (const vi_map::KeypointIdentifier& observation :
+       landmark.getObservations()) {
+    combineHash(keypoint_hasher(observation), &seed);
+    const vi_map::Vertex& vertex =
+        map.getVertex(observation.frame_id.vertex_id);
+    const unsigned int frame_index = observation.frame_id.frame_index;
+    const pose::Transformation T_G_C =
+        map.getVertex_T_G_I(observation.frame_id.vertex_id) *
+        map.getMissionNCamera(vertex.getMissionId())
+            .get_T_C_B(frame_index)
+            .inverse();
+    combineHash(T_G_C.getPosition(), &seed);
+    combineHash(T_G_C.getRotation().toImplementation().coeffs(), &seed);
+
+    combineHash(
+        vertex.getVisualFrame(frame_index)
+            .getKeypointMeasurement(observation.keypoint_index),
+        &seed);
+    const aslam::Camera::ConstPtr camera = vertex.getCamera(frame_index);
+    CHECK(camera);
+    combineHash(camera->getParameters(), &seed);
+    combineHash(camera->getDistortion().getParameters(), &seed);
+  }
+  return seed;
+}
+}  // namespace
+
+LandmarkQualityEvaluator::LandmarkQualityEvaluator()
+    : parameters_hash_(vi_map::getLandmarkQualityParametersHash()),
+      num_evaluated_in_last_pass_(0u) {}
+
+void LandmarkQualityEvaluator::clear() {
+  cache_.clear();
+  num_evaluated_in_last_pass_ = 0u;
+}
+
+void LandmarkQualityEvaluator::evaluate(vi_map::VIMap* map) {
+  vi_map::MissionIdList mission_ids;
+  CHECK_NOTNULL(map)->getAllMissionIds(&mission_ids);
+  evaluate(mission_ids, map);
+}
+
+void LandmarkQualityEvaluator::evaluate(
     const vi_map::MissionIdList& mission_ids, vi_map::VIMap* map) {
   CHECK_NOTNULL(map);
   constexpr bool kReEvaluateLandmarkQuality = true;
+  num_evaluated_in_last_pass_ = 0u;
+
+  const size_t parameters_hash = vi_map::getLandmarkQualityParametersHash();
+  if (parameters_hash != parameters_hash_) {
+    VLOG(1) << "Landmark quality parameters changed, discarding the cached "
+            << "landmark qualities.";
+    cache_.clear();
+    parameters_hash_ = parameters_hash;
+  }
+
+  // Drop the cache entries of landmarks that were removed from the map.
+  for (auto it = cache_.begin(); it != cache_.end();) {
+    if (!map->hasLandmark(it->first)) {
+      it = cache_.erase(it);
+    } else {
+      ++it;
+    }
+  }
 
+  // Collect the landmarks of all missions and create their cache entries up
+  // front, such that the parallel pass only touches existing entries.
+  vi_map::LandmarkIdList landmark_ids;
   for (const vi_map::MissionId& mission_id : mission_ids) {
     CHECK(map->hasMission(mission_id));
+    vi_map::LandmarkIdList mission_landmark_ids;
+    map->getAllLandmarkIdsInMission(mission_id, &mission_landmark_ids);
+    landmark_ids.insert(
+        landmark_ids.end(), mission_landmark_ids.begin(),
+        mission_landmark_ids.end());
+  }
+  const size_t num_landmarks = landmark_ids.size();
+  if (num_landmarks == 0u) {
+    return;
+  }
+  std::vector<CachedQuality*> cache_entries(num_landmarks);
+  for (size_t idx = 0u; idx < num_landmarks; ++idx) {
+    cache_entries[idx] = &cache_[landmark_ids[idx]];
+  }
 
-    vi_map::LandmarkIdList landmark_ids;
-    map->getAllLandmarkIdsInMission(mission_id, &landmark_ids);
-    const size_t num_landmarks = landmark_ids.size();
-
-    VLOG(1) << "Evaluating quality of landmarks of " << num_landmarks
-            << " landmarks of mission " << mission_id.hexString();
-
-    common::MultiThreadedProgressBar progress_bar;
-
-    std::function<void(const std::vector<size_t>&)> evaluator =
-        [&landmark_ids, map, &progress_bar](const std::vector<size_t>& batch) {
-          progress_bar.setNumElements(batch.size());
-          size_t num_processed = 0u;
-          for (size_t idx : batch) {
-            CHECK_LT(idx, landmark_ids.size());
-            const vi_map::LandmarkId& landmark_id = landmark_ids[idx];
-            CHECK(landmark_id.isValid());
-            vi_map::Landmark& landmark = map->getLandmark(landmark_id);
+  VLOG(1) << "Evaluating quality of " << num_landmarks << " landmarks of "
+          << mission_ids.size() << " missions.";
+
+  common::MultiThreadedProgressBar progress_bar;
+  std::mutex reducer_mutex;
+  size_t num_evaluated = 0u;
+  size_t num_good = 0u;
+
+  std::function<void(const std::vector<size_t>&)> evaluator =
+      [&landmark_ids, &cache_entries, map, &progress_bar, &reducer_mutex,
+       &num_evaluated, &num_good](const std::vector<size_t>& batch) {
+        progress_bar.setNumElements(batch.size());
+        size_t num_processed = 0u;
+        size_t thread_num_evaluated = 0u;
+        size_t thread_num_good = 0u;
+        for (size_t idx : batch) {
+          CHECK_LT(idx, landmark_ids.size());
+          const vi_map::LandmarkId& landmark_id = landmark_ids[idx];
+          CHECK(landmark_id.isValid());
+          vi_map::Landmark& landmark = map->getLandmark(landmark_id);
+          CachedQuality& cached_quality = *cache_entries[idx];
+
+          const size_t inputs_hash = hashLandmarkQualityInputs(*map, landmark);
+          if (inputs_hash != cached_quality.inputs_hash ||
+              landmark.getQuality() != cached_quality.quality ||
+              cached_quality.quality == vi_map::Landmark::Quality::kUnknown) {
             landmark.setQuality(
                 vi_map::isLandmarkWellConstrained(
                     *map, landmark, kReEvaluateLandmarkQuality)
                     ? vi_map::Landmark::Quality::kGood
                     : vi_map::Landmark::Quality::kBad);
-            progress_bar.update(++num_processed);
+            cached_quality.inputs_hash = inputs_hash;
+            cached_quality.quality = landmark.getQuality();
+            ++thread_num_evaluated;
           }
-        };
+          if (cached_quality.quality == vi_map::Landmark::Quality::kGood) {
+            ++thread_num_good;
+          }
+          progress_bar.update(++num_processed);
+        }
 
-    static constexpr bool kAlwaysParallelize = false;
-    const size_t num_threads = common::getNumHardwareThreads();
-    common::ParallelProcess(
-        num_landmarks, evaluator, kAlwaysParallelize, num_threads);
-  }
+        std::lock_guard<std::mutex> lock(reducer_mutex);
+        num_evaluated += thread_num_evaluated;
+        num_good += thread_num_good;
+      };
+
+  static constexpr bool kAlwaysParallelize = false;
+  const size_t num_threads = common::getNumHardwareThreads();
+  common::ParallelProcess(
+      num_landmarks, evaluator, kAlwaysParallelize, num_threads);
+
+  num_evaluated_in_last_pass_ = num_evaluated;
+  statistics::StatsCollector stats_evaluated(
+      "Landmark quality: evaluated landmarks per pass");
+  stats_evaluated.AddSample(num_evaluated);
+  VLOG(1) << "Evaluated " << num_evaluated << " of " << num_landmarks
+          << " landmarks, " << num_good << " landmarks are well constrained.";
+}
+
+void evaluateLandmarkQuality(
+    const vi_map::MissionIdList& mission_ids, vi_map::VIMap* map) {
+  LandmarkQualityEvaluator evaluator;
+  evaluator.evaluate(mission_ids, map);
 }
 
 void evaluateLandmarkQuality(vi_map::VIMap* map) {
@@ -69,6 +204,8 @@ void removeInvalidLandmarkObservations(
     const vi_map::MissionIdList& mission_ids, vi_map::VIMap* map) {
   CHECK_NOTNULL(map);
   VIMapManipulation manipulation(map);
+  // The observations are detached directly on the vertices.
+  map->invalidateCovisibilityGraph();
   for (const vi_map::MissionId& mission_id : mission_ids) {
     CHECK(map->hasMission(mission_id));
 
@@ -402,6 +402,59 @@ size_t VIMapManipulation::initializeLandmarksFromUnusedFeatureTracksOfMission(
       mission_id, starting_vertex_id, initialized_landmark_ids);
 }
 
+size_t VIMapManipulation::initializeLandmarksFromUnusedFeatureTracksOfMission(
+    const vi_map::MissionId& mission_id,
+    const pose_graph::VertexId& starting_vertex_id,
+    MultiTrackIndexToLandmarkIdMap* trackid_landmarkid_map) {
+  CHECK(mission_id.isValid());
+  CHECK_NOTNULL(trackid_landmarkid_map);
+  pose_graph::VertexIdList all_vertices_in_missions;
+  map_.getAllVertexIdsInMissionAlongGraph(
+      mission_id, starting_vertex_id, &all_vertices_in_missions);
+  if (all_vertices_in_missions.empty()) {
+    return 0u;
+  }
+
+  const size_t num_landmarks_initial = map_.numLandmarks();
+  initializeLandmarksFromUnusedFeatureTracksOfOrderedVertices(
+      all_vertices_in_missions, trackid_landmarkid_map);
+
+  // Drop the tracks that have ended, otherwise the association grows without
+  // bound over the lifetime of the mission.
+  MultiTrackIndexToLandmarkIdMap active_tracks;
+  const vi_map::Vertex& last_vertex =
+      map_.getVertex(all_vertices_in_missions.back());
+  last_vertex.forEachFrame([trackid_landmarkid_map, &active_tracks](
+                               const size_t frame_index,
+                               const aslam::VisualFrame& frame) {
+    if (!frame.hasTrackIds()) {
+      return;
+    }
+    const Eigen::VectorXi& track_ids = frame.getTrackIds();
+    for (int keypoint_i = 0; keypoint_i < track_ids.rows(); ++keypoint_i) {
+      const int track_id = track_ids(keypoint_i);
+      if (track_id < 0) {
+        continue;
+      }
+      const MultiTrackIndexKey track_index_key =
+          std::make_pair(frame_index, frame.getDescriptorType(keypoint_i));
+      const MultiTrackIndexToLandmarkIdMap::const_iterator it =
+          trackid_landmarkid_map->find(track_index_key);
+      if (it == trackid_landmarkid_map->end()) {
+        continue;
+      }
+      const vi_map::LandmarkId* landmark_id_ptr =
+          common::getValuePtr(it->second, track_id);
+      if (landmark_id_ptr != nullptr) {
+        active_tracks[track_index_key].emplace(track_id, *landmark_id_ptr);
+      }
+    }
+  });
+  trackid_landmarkid_map->swap(active_tracks);
+
+  return map_.numLandmarks() - num_landmarks_initial;
+}
+
 void VIMapManipulation::
     initializeLandmarksFromUnusedFeatureTracksOfOrderedVertices(
         const pose_graph::VertexIdList& ordered_vertex_ids,
@@ -485,7 +538,13 @@ size_t VIMapManipulation::mergeLandmarksBasedOnTrackIds(
   CHECK(map_.hasMission(mission_id));
   typedef std::unordered_map<int, vi_map::LandmarkId> TrackIdToLandmarkIdMap;
   TrackIdToLandmarkIdMap track_id_to_store_landmark_id;
-  size_t num_merges = 0u;
+
+  // Only collect the merges here, they are applied in bulk afterwards. The
+  // landmark id stored per track may have been merged into another landmark
+  // in the meantime (e.g. if the dataset was loop-closed before), which is
+  // resolved by the bulk merge.
+  std::vector<std::pair<vi_map::LandmarkId, vi_map::LandmarkId>>
+      landmark_merges;
 
   pose_graph::VertexIdList vertex_ids;
   map_.getAllVertexIdsInMission(mission_id, &vertex_ids);
@@ -494,8 +553,8 @@ size_t VIMapManipulation::mergeLandmarksBasedOnTrackIds(
     const vi_map::Vertex& vertex = map_.getVertex(vertex_id);
 
     for (size_t frame_idx = 0u; frame_idx < vertex.numFrames(); ++frame_idx) {
-      vi_map::LandmarkIdList landmark_ids;
-      vertex.getFrameObservedLandmarkIds(frame_idx, &landmark_ids);
+      const vi_map::LandmarkIdList& landmark_ids =
+          vertex.getFrameObservedLandmarkIds(frame_idx);
 
       CHECK(vertex.getVisualFrame(frame_idx).hasTrackIds());
       const Eigen::VectorXi& track_ids =
@@ -506,43 +565,22 @@ size_t VIMapManipulation::mergeLandmarksBasedOnTrackIds(
            ++keypoint_idx) {
         if (landmark_ids[keypoint_idx].isValid() &&
             track_ids(keypoint_idx) < 0) {
-          const vi_map::LandmarkId landmark_id = landmark_ids[keypoint_idx];
+          const vi_map::LandmarkId& landmark_id = landmark_ids[keypoint_idx];
           CHECK(map_.hasLandmark(landmark_id));
 
-          if (track_id_to_store_landmark_id
-                  .emplace(track_ids(keypoint_idx), landmark_id)
-                  .second) {
-            // Emplace succeeded so this track ID was not used before.
-          } else {
-            // Emplace failed so this track ID is already used, we need to
-            // merge landmarks.
-            TrackIdToLandmarkIdMap::const_iterator it =
-                track_id_to_store_landmark_id.find(track_ids(keypoint_idx));
-            CHECK(it != track_id_to_store_landmark_id.end());
-            CHECK(it->second.isValid());
-            CHECK(map_.hasLandmark(it->second))
-                << "Landmark " << it->second.hexString()
-                << " not found in the map.";
-
-            if (it->second != landmark_id) {
-              map_.mergeLandmarks(landmark_id, it->second);
-              ++num_merges;
-
-              // As the dataset could be loop-closed before (so more than
-              // a single track id pointing to the same store landmark, we need
-              // to update the track id to store landmark id map.
-              for (TrackIdToLandmarkIdMap::value_type& track_id_to_landmark :
-                   track_id_to_store_landmark_id) {
-                if (track_id_to_landmark.second == landmark_id) {
-                  track_id_to_landmark.second = it->second;
-                }
-              }
-            }
+          const std::pair<TrackIdToLandmarkIdMap::iterator, bool> result =
+              track_id_to_store_landmark_id.emplace(
+                  track_ids(keypoint_idx), landmark_id);
+          // If the emplace failed, this track ID is already used and we need
+          // to merge the landmarks.
+          if (!result.second && result.first->second != landmark_id) {
+            landmark_merges.emplace_back(landmark_id, result.first->second);
           }
         }
       }
     }
   }
+  const size_t num_merges = map_.mergeLandmarks(landmark_merges);
   VLOG(2) << "Number of merges " << num_merges;
   return num_merges;
 }
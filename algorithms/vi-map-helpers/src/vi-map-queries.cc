@@ -1,6 +1,7 @@
 #include "vi-map-helpers/vi-map-queries.h"
 
 #include <algorithm>
+#include <limits>
 #include <unordered_set>
 
 #include <glog/logging.h>
@@ -9,6 +10,51 @@
 #include <vi-map/vi-map.h>
 
 namespace vi_map_helpers {
+namespace {
+// Returns up to max_num_vertices vertices of the selected missions that share
+// at least min_number_common_landmarks with the given vertex, sorted by
+// decreasing number of common landmarks.
+void getSelectedCoobserverVertices(
+    const vi_map::VIMap& map, const pose_graph::VertexId& vertex_id,
+    const int min_number_common_landmarks, const size_t max_num_vertices,
+    vi_map::CovisibilityGraph::VertexCountList* coobserver_vertices) {
+  CHECK_NOTNULL(coobserver_vertices)->clear();
+  const vi_map::CovisibilityGraph& covisibility_graph =
+      map.getCovisibilityGraph();
+  DCHECK(covisibility_graph.isConsistentWithVertex(map.getVertex(vertex_id)))
+      << "The observations of vertex " << vertex_id << " changed without "
+      << "invalidating the covisibility graph.";
+  const size_t min_count =
+      static_cast<size_t>(std::max(min_number_common_landmarks, 0));
+
+  vi_map::CovisibilityGraph::VertexCountList candidates;
+  size_t num_candidates = max_num_vertices;
+  while (true) {
+    covisibility_graph.getCoobserverVertices(
+        vertex_id, min_count, num_candidates, &candidates);
+    coobserver_vertices->clear();
+    for (const vi_map::CovisibilityGraph::VertexCount& candidate :
+         candidates) {
+      if (coobserver_vertices->size() == max_num_vertices) {
+        break;
+      }
+      if (map.hasVertex(candidate.first)) {
+        coobserver_vertices->emplace_back(candidate);
+      }
+    }
+    // The vertices of missions that are not selected were skipped, query
+    // more candidates if there are any.
+    if (coobserver_vertices->size() == max_num_vertices ||
+        candidates.size() < num_candidates) {
+      return;
+    }
+    num_candidates =
+        (num_candidates > std::numeric_limits<size_t>::max() / 2u)
+            ? std::numeric_limits<size_t>::max()
+            : 2u * num_candidates;
+  }
+}
+}  // namespace
 
 VIMapQueries::VIMapQueries(const vi_map::VIMap& map) : map_(map) {}
 
@@ -316,18 +362,19 @@ int VIMapQueries::getVerticesWithCommonLandmarks(
     pose_graph::VertexIdList* coobserver_vertex_ids) const {
   CHECK_NOTNULL(coobserver_vertex_ids)->clear();
   CHECK(map_.hasVertex(vertex_id));
+  if (num_matches_to_return <= 0) {
+    return 0;
+  }
 
-  VertexCommonLandmarksCountVector coobserver_vertices_with_counts;
-  getVerticesWithCommonLandmarks(
-      vertex_id, min_number_common_landmarks, &coobserver_vertices_with_counts);
-
-  unsigned int total_count = std::min(
-      coobserver_vertices_with_counts.size(),
-      static_cast<size_t>(num_matches_to_return));
-  coobserver_vertex_ids->reserve(total_count);
-  for (unsigned int i = 0; i < total_count; ++i) {
-    coobserver_vertex_ids->push_back(
-        coobserver_vertices_with_counts[i].vertex_id);
+  vi_map::CovisibilityGraph::VertexCountList coobserver_vertices;
+  getSelectedCoobserverVertices(
+      map_, vertex_id, min_number_common_landmarks,
+      static_cast<size_t>(num_matches_to_return), &coobserver_vertices);
+
+  coobserver_vertex_ids->reserve(coobserver_vertices.size());
+  for (const vi_map::CovisibilityGraph::VertexCount& coobserver :
+       coobserver_vertices) {
+    coobserver_vertex_ids->emplace_back(coobserver.first);
   }
   CHECK_LE(
       static_cast<int>(coobserver_vertex_ids->size()), num_matches_to_return);
@@ -340,31 +387,17 @@ int VIMapQueries::getVerticesWithCommonLandmarks(
   CHECK_NOTNULL(coobserver_vertex_ids)->clear();
   CHECK(map_.hasVertex(vertex_id));
 
-  vi_map::LandmarkIdList landmark_ids;
-  pose_graph::VertexIdSet visited_vertices;
-  map_.getVertexPtr(vertex_id)->getAllObservedLandmarkIds(&landmark_ids);
-  for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
-    if (landmark_id.isValid()) {
-      const vi_map::Landmark& landmark = map_.getLandmark(landmark_id);
-      landmark.forEachObservation(
-          [&](const vi_map::KeypointIdentifier& backlink) {
-            if (visited_vertices.insert(backlink.frame_id.vertex_id).second) {
-              // This vertex was not yet visited and was successfully inserted.
-              if (map_.hasVertex(backlink.frame_id.vertex_id)) {
-                int common = getNumberOfCommonLandmarks(
-                    vertex_id, backlink.frame_id.vertex_id);
-                if (common >= min_number_common_landmarks) {
-                  coobserver_vertex_ids->push_back(VertexCommonLandmarksCount(
-                      common, backlink.frame_id.vertex_id));
-                }
-              }
-            }
-          });
-    }
+  vi_map::CovisibilityGraph::VertexCountList coobserver_vertices;
+  getSelectedCoobserverVertices(
+      map_, vertex_id, min_number_common_landmarks,
+      std::numeric_limits<size_t>::max(), &coobserver_vertices);
+
+  coobserver_vertex_ids->reserve(coobserver_vertices.size());
+  for (const vi_map::CovisibilityGraph::VertexCount& coobserver :
+       coobserver_vertices) {
+    coobserver_vertex_ids->emplace_back(
+        static_cast<int>(coobserver.second), coobserver.first);
   }
-  std::sort(
-      coobserver_vertex_ids->begin(), coobserver_vertex_ids->end(),
-      VertexCommonLandmarksCountComparator());
   return coobserver_vertex_ids->size();
 }
 
@@ -422,7 +455,11 @@ bool VIMapQueries::getClosestVertexIdByTimestamp(
 int VIMapQueries::getNumberOfCommonLandmarks(
     const pose_graph::VertexId& vertex_1,
     const pose_graph::VertexId& vertex_2) const {
-  return getNumberOfCommonLandmarks(vertex_1, vertex_2, nullptr);
+  const vi_map::CovisibilityGraph& covisibility_graph =
+      map_.getCovisibilityGraph();
+  DCHECK(covisibility_graph.isConsistentWithVertex(map_.getVertex(vertex_1)));
+  DCHECK(covisibility_graph.isConsistentWithVertex(map_.getVertex(vertex_2)));
+  return covisibility_graph.getNumberOfCommonLandmarks(vertex_1, vertex_2);
 }
 
 // Returns the number of common landmarks of vertex 1 and 2
@@ -472,29 +509,19 @@ int VIMapQueries::getVertexWithMostLandmarksInCommon(
   int max = 0;
   pose_graph::VertexId max_vertex;
 
-  vi_map::LandmarkIdList landmark_ids;
-  pose_graph::VertexIdSet visited_vertices;
-  map_.getVertexPtr(vertex_id)->getAllObservedLandmarkIds(&landmark_ids);
-  for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
-    if (landmark_id.isValid()) {
-      const vi_map::Landmark& landmark = map_.getLandmark(landmark_id);
-      landmark.forEachObservation(
-          [&](const vi_map::KeypointIdentifier& backlink) {
-            if ((backlink.frame_id.vertex_id != vertex_id) &&
-                (visited_vertices.find(backlink.frame_id.vertex_id) ==
-                 visited_vertices.end())) {
-              visited_vertices.insert(backlink.frame_id.vertex_id);
-
-              if (map_.hasVertex(backlink.frame_id.vertex_id)) {
-                int common = getNumberOfCommonLandmarks(
-                    vertex_id, backlink.frame_id.vertex_id);
-                if (common > max) {
-                  max = common;
-                  max_vertex = backlink.frame_id.vertex_id;
-                }
-              }
-            }
-          });
+  // At most one of the two best coobservers is the vertex itself.
+  constexpr int kMinNumberCommonLandmarks = 1;
+  constexpr size_t kNumCoobserverVertices = 2u;
+  vi_map::CovisibilityGraph::VertexCountList coobserver_vertices;
+  getSelectedCoobserverVertices(
+      map_, vertex_id, kMinNumberCommonLandmarks, kNumCoobserverVertices,
+      &coobserver_vertices);
+  for (const vi_map::CovisibilityGraph::VertexCount& coobserver :
+       coobserver_vertices) {
+    if (coobserver.first != vertex_id) {
+      max = static_cast<int>(coobserver.second);
+      max_vertex = coobserver.first;
+      break;
     }
   }
   if ((max > 0) && (max_vertex.isValid())) {
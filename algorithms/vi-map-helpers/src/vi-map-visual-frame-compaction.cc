@@ -0,0 +1,349 @@
+#include "vi-map-helpers/vi-map-visual-frame-compaction.h"
+
+#include <limits>
+#include <sstream>  // NOLINT
+#include <unordered_set>
+#include <vector>
+
+#include <aslam/frames/visual-frame.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
+#include <vi-map/landmark.h>
+#include <vi-map/vertex.h>
+
+DEFINE_bool(
+    visual_frame_compaction_keep_tracked_keypoints, false,
+    "Keep keypoints with a valid track id, even if they are not associated "
+    "with a landmark.");
+DEFINE_bool(
+    visual_frame_compaction_use_representative_descriptors, false,
+    "Replace the descriptors of all observations of a landmark by the medoid "
+    "descriptor of the landmark track.");
+
+namespace vi_map_helpers {
+
+namespace {
+
+size_t getNumBitsDifferent(
+    const unsigned char* descriptor_A, const unsigned char* descriptor_B,
+    const int num_bytes) {
+  size_t num_bits_different = 0u;
+  for (int byte = 0; byte < num_bytes; ++byte) {
+    num_bits_different +=
+        __builtin_popcount(descriptor_A[byte] ^ descriptor_B[byte]);
+  }
+  return num_bits_different;
+}
+
+// Finds the descriptor block and the column within the block of a keypoint.
+void getDescriptorBlockAndColumn(
+    const aslam::VisualFrame& frame, const size_t keypoint_idx, size_t* block,
+    size_t* column) {
+  CHECK_NOTNULL(block);
+  CHECK_NOTNULL(column);
+  const size_t num_blocks =
+      static_cast<size_t>(frame.getDescriptorTypes().size());
+  size_t block_start = 0u;
+  for (size_t block_idx = 0u; block_idx < num_blocks; ++block_idx) {
+    const size_t block_size =
+        static_cast<size_t>(frame.getDescriptors(block_idx).cols());
+    if (keypoint_idx < block_start + block_size) {
+      *block = block_idx;
+      *column = keypoint_idx - block_start;
+      return;
+    }
+    block_start += block_size;
+  }
+  LOG(FATAL) << "Keypoint " << keypoint_idx << " has no descriptor in frame "
+             << frame.getId() << ".";
+}
+
+void compactFrame(
+    const VisualFrameCompactionOptions& options,
+    const pose_graph::VertexId& vertex_id, const unsigned int frame_idx,
+    vi_map::VIMap* map, VisualFrameCompactionStatistics* statistics) {
+  CHECK_NOTNULL(map);
+  CHECK_NOTNULL(statistics);
+  vi_map::Vertex& vertex = map->getVertex(vertex_id);
+  const aslam::VisualFrame& frame = vertex.getVisualFrame(frame_idx);
+  if (!frame.hasKeypointMeasurements()) {
+    return;
+  }
+  const size_t num_keypoints = frame.getNumKeypointMeasurements();
+  ++statistics->num_frames;
+  statistics->num_keypoints_before += num_keypoints;
+  statistics->num_bytes_before += getVisualFrameMemoryBytes(frame);
+
+  vi_map::LandmarkIdList landmark_ids;
+  vertex.getFrameObservedLandmarkIds(frame_idx, &landmark_ids);
+  CHECK_EQ(landmark_ids.size(), num_keypoints);
+  const bool keep_tracked_keypoints =
+      options.keep_tracked_keypoints && frame.hasTrackIds();
+
+  std::vector<size_t> discarded_indices;
+  for (size_t keypoint_idx = 0u; keypoint_idx < num_keypoints;
+       ++keypoint_idx) {
+    if (landmark_ids[keypoint_idx].isValid()) {
+      continue;
+    }
+    if (keep_tracked_keypoints && frame.getTrackId(keypoint_idx) >= 0) {
+      continue;
+    }
+    discarded_indices.emplace_back(keypoint_idx);
+  }
+
+  if (!discarded_indices.empty()) {
+    // The keypoint indices of the kept keypoints shift, hence all landmark
+    // observations of this frame are re-added with their new index.
+    std::unordered_set<vi_map::LandmarkId> observed_landmark_ids;
+    for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+      if (landmark_id.isValid() && map->hasLandmark(landmark_id)) {
+        observed_landmark_ids.emplace(landmark_id);
+      }
+    }
+    for (const vi_map::LandmarkId& landmark_id : observed_landmark_ids) {
+      map->getLandmark(landmark_id)
+          .removeAllObservationsOfVertexAndFrame(vertex_id, frame_idx);
+    }
+
+    vertex.discardKeypointsOfFrame(frame_idx, discarded_indices);
+
+    vertex.getFrameObservedLandmarkIds(frame_idx, &landmark_ids);
+    for (size_t keypoint_idx = 0u; keypoint_idx < landmark_ids.size();
+         ++keypoint_idx) {
+      const vi_map::LandmarkId& landmark_id = landmark_ids[keypoint_idx];
+      if (observed_landmark_ids.count(landmark_id) > 0u) {
+        map->getLandmark(landmark_id)
+            .addObservation(vertex_id, frame_idx, keypoint_idx);
+      }
+    }
+  }
+
+  statistics->num_keypoints_after += frame.getNumKeypointMeasurements();
+  statistics->num_bytes_after += getVisualFrameMemoryBytes(frame);
+}
+
+}  // namespace
+
+VisualFrameCompactionOptions VisualFrameCompactionOptions::getFromGflags() {
+  VisualFrameCompactionOptions options;
+  options.keep_tracked_keypoints =
+      FLAGS_visual_frame_compaction_keep_tracked_keypoints;
+  options.use_representative_descriptors =
+      FLAGS_visual_frame_compaction_use_representative_descriptors;
+  return options;
+}
+
+void VisualFrameCompactionStatistics::accumulate(
+    const VisualFrameCompactionStatistics& other) {
+  num_frames += other.num_frames;
+  num_keypoints_before += other.num_keypoints_before;
+  num_keypoints_after += other.num_keypoints_after;
+  num_bytes_before += other.num_bytes_before;
+  num_bytes_after += other.num_bytes_after;
+  num_landmarks_with_representative_descriptor +=
+      other.num_landmarks_with_representative_descriptor;
+}
+
+std::string VisualFrameCompactionStatistics::toString() const {
+  std::stringstream ss;
+  ss << "Compacted " << num_frames << " visual frames: " << num_keypoints_before
+     << " -> " << num_keypoints_after << " keypoints, " << num_bytes_before
+     << " -> " << num_bytes_after << " bytes";
+  if (num_landmarks_with_representative_descriptor > 0u) {
+    ss << ", " << num_landmarks_with_representative_descriptor
+       << " landmarks with a representative descriptor";
+  }
+  ss << ".";
+  return ss.str();
+}
+
+size_t getVisualFrameMemoryBytes(const aslam::VisualFrame& frame) {
+  size_t num_bytes = 0u;
+  if (frame.hasKeypointMeasurements()) {
+    num_bytes += frame.getKeypointMeasurements().size() * sizeof(double);
+  }
+  if (frame.hasKeypointMeasurementUncertainties()) {
+    num_bytes +=
+        frame.getKeypointMeasurementUncertainties().size() * sizeof(double);
+  }
+  if (frame.hasKeypointOrientations()) {
+    num_bytes += frame.getKeypointOrientations().size() * sizeof(double);
+  }
+  if (frame.hasKeypointScores()) {
+    num_bytes += frame.getKeypointScores().size() * sizeof(double);
+  }
+  if (frame.hasKeypointScales()) {
+    num_bytes += frame.getKeypointScales().size() * sizeof(double);
+  }
+  if (frame.hasKeypoint3DPositions()) {
+    num_bytes += frame.getKeypoint3DPositions().size() * sizeof(double);
+  }
+  if (frame.hasKeypointTimeOffsets()) {
+    num_bytes += frame.getKeypointTimeOffsets().size() * sizeof(int);
+  }
+  if (frame.hasTrackIds()) {
+    num_bytes += frame.getTrackIds().size() * sizeof(int);
+  }
+  if (frame.hasDescriptors()) {
+    const size_t num_blocks =
+        static_cast<size_t>(frame.getDescriptorTypes().size());
+    for (size_t block = 0u; block < num_blocks; ++block) {
+      num_bytes += frame.getDescriptors(block).size();
+    }
+  }
+  return num_bytes;
+}
+
+bool setRepresentativeLandmarkDescriptor(
+    const vi_map::LandmarkId& landmark_id, vi_map::VIMap* map) {
+  CHECK_NOTNULL(map);
+  const vi_map::KeypointIdentifierList& observations =
+      map->getLandmark(landmark_id).getObservations();
+
+  struct DescriptorLocation {
+    aslam::VisualFrame* frame;
+    size_t block;
+    size_t column;
+  };
+  std::vector<DescriptorLocation> locations;
+  locations.reserve(observations.size());
+  int descriptor_rows = -1;
+  for (const vi_map::KeypointIdentifier& observation : observations) {
+    vi_map::Vertex& vertex = map->getVertex(observation.frame_id.vertex_id);
+    aslam::VisualFrame& frame =
+        vertex.getVisualFrame(observation.frame_id.frame_index);
+    if (!frame.hasDescriptors()) {
+      continue;
+    }
+    DescriptorLocation location;
+    location.frame = &frame;
+    getDescriptorBlockAndColumn(
+        frame, observation.keypoint_index, &location.block, &location.column);
+    const int rows = frame.getDescriptors(location.block).rows();
+    if (descriptor_rows < 0) {
+      descriptor_rows = rows;
+    }
+    CHECK_EQ(rows, descriptor_rows)
+        << "Landmark " << landmark_id << " is observed with descriptors of "
+        << "different sizes.";
+    locations.emplace_back(location);
+  }
+  if (locations.size() < 2u) {
+    return false;
+  }
+
+  const size_t num_descriptors = locations.size();
+  std::vector<const unsigned char*> descriptors(num_descriptors);
+  for (size_t idx = 0u; idx < num_descriptors; ++idx) {
+    const DescriptorLocation& location = locations[idx];
+    descriptors[idx] = location.frame->getDescriptors(location.block)
+                           .col(location.column)
+                           .data();
+  }
+
+  // The medoid keeps the descriptor binary and is an actually observed
+  // descriptor, unlike a bitwise majority vote.
+  size_t best_idx = 0u;
+  size_t best_summed_distance = std::numeric_limits<size_t>::max();
+  for (size_t idx = 0u; idx < num_descriptors; ++idx) {
+    size_t summed_distance = 0u;
+    for (size_t other_idx = 0u; other_idx < num_descriptors; ++other_idx) {
+      summed_distance += getNumBitsDifferent(
+          descriptors[idx], descriptors[other_idx], descriptor_rows);
+    }
+    if (summed_distance < best_summed_distance) {
+      best_summed_distance = summed_distance;
+      best_idx = idx;
+    }
+  }
+
+  const DescriptorLocation& best_location = locations[best_idx];
+  const Eigen::Matrix<unsigned char, Eigen::Dynamic, 1> representative =
+      best_location.frame->getDescriptors(best_location.block)
+          .col(best_location.column);
+  for (const DescriptorLocation& location : locations) {
+    location.frame->getDescriptorsMutable(location.block)
+        ->col(location.column) = representative;
+  }
+  return true;
+}
+
+VisualFrameCompactionStatistics compactVisualFramesOfVertex(
+    const VisualFrameCompactionOptions& options,
+    const pose_graph::VertexId& vertex_id, vi_map::VIMap* map) {
+  CHECK_NOTNULL(map);
+  VisualFrameCompactionStatistics statistics;
+  const vi_map::Vertex& vertex = map->getVertex(vertex_id);
+  const unsigned int num_frames = vertex.numFrames();
+  for (unsigned int frame_idx = 0u; frame_idx < num_frames; ++frame_idx) {
+    if (vertex.isVisualFrameSet(frame_idx)) {
+      compactFrame(options, vertex_id, frame_idx, map, &statistics);
+    }
+  }
+  return statistics;
+}
+
+VisualFrameCompactionStatistics compactVisualFrames(
+    const VisualFrameCompactionOptions& options,
+    const pose_graph::VertexIdList& vertex_ids, vi_map::VIMap* map) {
+  CHECK_NOTNULL(map);
+  // Landmarks are shared between vertices, hence the frames are compacted
+  // sequentially.
+  VisualFrameCompactionStatistics statistics;
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    statistics.accumulate(compactVisualFramesOfVertex(options, vertex_id, map));
+  }
+
+  if (options.use_representative_descriptors) {
+    vi_map::LandmarkIdList landmark_ids;
+    for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+      vi_map::LandmarkIdList vertex_landmark_ids;
+      map->getVertex(vertex_id).getStoredLandmarkIdList(&vertex_landmark_ids);
+      landmark_ids.insert(
+          landmark_ids.end(), vertex_landmark_ids.begin(),
+          vertex_landmark_ids.end());
+    }
+    // Every landmark only writes the descriptor columns of its own
+    // observations, hence landmarks can be processed in parallel.
+    std::vector<size_t> num_representatives_per_landmark(
+        landmark_ids.size(), 0u);
+    std::function<void(const std::vector<size_t>&)> worker =
+        [&landmark_ids, &num_representatives_per_landmark,
+         map](const std::vector<size_t>& batch) {
+          for (const size_t idx : batch) {
+            num_representatives_per_landmark[idx] =
+                setRepresentativeLandmarkDescriptor(landmark_ids[idx], map)
+                    ? 1u
+                    : 0u;
+          }
+        };
+    constexpr bool kAlwaysParallelize = false;
+    common::ParallelProcess(
+        landmark_ids.size(), worker, kAlwaysParallelize,
+        common::getNumHardwareThreads());
+    for (const size_t num : num_representatives_per_landmark) {
+      statistics.num_landmarks_with_representative_descriptor += num;
+    }
+  }
+  return statistics;
+}
+
+VisualFrameCompactionStatistics compactVisualFrames(
+    const VisualFrameCompactionOptions& options,
+    const vi_map::MissionIdList& mission_ids, vi_map::VIMap* map) {
+  CHECK_NOTNULL(map);
+  pose_graph::VertexIdList all_vertex_ids;
+  for (const vi_map::MissionId& mission_id : mission_ids) {
+    CHECK(map->hasMission(mission_id));
+    pose_graph::VertexIdList vertex_ids;
+    map->getAllVertexIdsInMission(mission_id, &vertex_ids);
+    all_vertex_ids.insert(
+        all_vertex_ids.end(), vertex_ids.begin(), vertex_ids.end());
+  }
+  return compactVisualFrames(options, all_vertex_ids, map);
+}
+
+}  // namespace vi_map_helpers
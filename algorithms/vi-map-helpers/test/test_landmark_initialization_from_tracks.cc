@@ -0,0 +1,214 @@
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/frames/visual-frame.h>
+#include <glog/logging.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <posegraph/unique-id.h>
+#include <vi-map/test/vi-map-generator.h>
+#include <vi-map/vi-map.h>
+
+#include "vi-map-helpers/vi-map-manipulation.h"
+
+namespace vi_map_helpers {
+
+namespace {
+constexpr int kRandomSeed = 42;
+constexpr size_t kNumVertices = 10u;
+constexpr size_t kTrackLength = 3u;
+constexpr size_t kNumTracksStartingPerVertex = 2u;
+constexpr int kNumTracks = static_cast<int>(
+    (kNumVertices - kTrackLength + 1u) * kNumTracksStartingPerVertex);
+constexpr unsigned int kFrameIdx = 0u;
+constexpr int kFeatureType = 0;
+}  // namespace
+
+class LandmarkInitializationFromTracksTest : public ::testing::Test {
+ protected:
+  LandmarkInitializationFromTracksTest() : generator_(map_, kRandomSeed) {}
+
+  virtual void SetUp() {
+    mission_id_ = generator_.createMission();
+    for (size_t vertex_idx = 0u; vertex_idx < kNumVertices; ++vertex_idx) {
+      pose::Transformation T_G_I;
+      T_G_I.getPosition() << static_cast<double>(vertex_idx), 0.0, 0.0;
+      vertex_ids_.emplace_back(generator_.createVertex(mission_id_, T_G_I));
+    }
+    generator_.generateMap();
+  }
+
+  // Track t is observed by kTrackLength consecutive vertices, starting at
+  // vertex t / kNumTracksStartingPerVertex.
+  static size_t getFirstVertexOfTrack(const int track_id) {
+    return static_cast<size_t>(track_id) / kNumTracksStartingPerVertex;
+  }
+  static bool isTrackObservedByVertex(
+      const int track_id, const size_t vertex_idx) {
+    const size_t first_vertex_idx = getFirstVertexOfTrack(track_id);
+    return first_vertex_idx <= vertex_idx &&
+           vertex_idx < first_vertex_idx + kTrackLength;
+  }
+
+  // Adds a tracked keypoint for every track observed by the vertex, as the
+  // feature tracking of an online map builder would.
+  void addTrackedKeypoints(const size_t vertex_idx) {
+    std::vector<int> observed_track_ids;
+    for (int track_id = 0; track_id < kNumTracks; ++track_id) {
+      if (isTrackObservedByVertex(track_id, vertex_idx)) {
+        observed_track_ids.emplace_back(track_id);
+      }
+    }
+    const int num_keypoints = static_cast<int>(observed_track_ids.size());
+
+    vi_map::Vertex& vertex = map_.getVertex(vertex_ids_[vertex_idx]);
+    aslam::VisualFrame& frame = vertex.getVisualFrame(kFrameIdx);
+    Eigen::Matrix2Xd keypoints(2, num_keypoints);
+    keypoints.setRandom();
+    aslam::VisualFrame::DescriptorsT descriptors(
+        vi_map::kDescriptorSize, num_keypoints);
+    descriptors.setRandom();
+    frame.extendKeypointMeasurements(keypoints);
+    frame.extendKeypointMeasurementUncertainties(
+        Eigen::VectorXd::Ones(num_keypoints));
+    frame.extendDescriptors(descriptors, kFeatureType);
+    frame.extendTrackIds(
+        Eigen::Map<const Eigen::VectorXi>(
+            observed_track_ids.data(), num_keypoints));
+    vertex.expandVisualObservationContainersIfNecessary();
+  }
+
+  // Returns the track id shared by all observations of the landmark.
+  int getTrackIdOfLandmark(const vi_map::LandmarkId& landmark_id) const {
+    const vi_map::Landmark& landmark = map_.getLandmark(landmark_id);
+    CHECK_GT(landmark.numberOfObservations(), 0u);
+    const vi_map::KeypointIdentifier& first_observation =
+        landmark.getObservations().front();
+    const int track_id =
+        map_.getVertex(first_observation.frame_id.vertex_id)
+            .getVisualFrame(first_observation.frame_id.frame_index)
+            .getTrackId(first_observation.keypoint_index);
+    landmark.forEachObservation(
+        [this, track_id](const vi_map::KeypointIdentifier& observation) {
+          EXPECT_EQ(
+              map_.getVertex(observation.frame_id.vertex_id)
+                  .getVisualFrame(observation.frame_id.frame_index)
+                  .getTrackId(observation.keypoint_index),
+              track_id);
+        });
+    return track_id;
+  }
+
+  // The association has to contain exactly the tracks observed by the last
+  // vertex, each mapped to the landmark created for this track.
+  void expectAssociationOfActiveTracks(
+      const VIMapManipulation::MultiTrackIndexToLandmarkIdMap&
+          track_id_to_landmark_id,
+      const size_t last_vertex_idx) const {
+    ASSERT_EQ(track_id_to_landmark_id.size(), 1u);
+    const VIMapManipulation::MultiTrackIndexKey expected_key(
+        kFrameIdx, kFeatureType);
+    ASSERT_EQ(track_id_to_landmark_id.begin()->first, expected_key);
+    const VIMapManipulation::TrackIndexToLandmarkIdMap& track_map =
+        track_id_to_landmark_id.begin()->second;
+
+    size_t num_active_tracks = 0u;
+    for (int track_id = 0; track_id < kNumTracks; ++track_id) {
+      if (isTrackObservedByVertex(track_id, last_vertex_idx)) {
+        ++num_active_tracks;
+      }
+    }
+    EXPECT_EQ(track_map.size(), num_active_tracks);
+
+    for (const VIMapManipulation::TrackIndexToLandmarkIdMap::value_type&
+             track_with_landmark : track_map) {
+      EXPECT_TRUE(
+          isTrackObservedByVertex(track_with_landmark.first, last_vertex_idx));
+      ASSERT_TRUE(map_.hasLandmark(track_with_landmark.second));
+      EXPECT_EQ(
+          getTrackIdOfLandmark(track_with_landmark.second),
+          track_with_landmark.first);
+      // The landmark is observed by all vertices of the track up to the last
+      // vertex.
+      EXPECT_EQ(
+          map_.getLandmark(track_with_landmark.second).numberOfObservations(),
+          last_vertex_idx -
+              getFirstVertexOfTrack(track_with_landmark.first) + 1u);
+    }
+  }
+
+  vi_map::VIMap map_;
+  vi_map::VIMapGenerator generator_;
+  vi_map::MissionId mission_id_;
+  pose_graph::VertexIdList vertex_ids_;
+};
+
+TEST_F(
+    LandmarkInitializationFromTracksTest,
+    IncrementalInitializationKeepsTracks) {
+  // The first initialization only sees the vertices up to the cut, as if the
+  // later ones hadn't been added to the map yet.
+  constexpr size_t kNumVerticesFirstPart = 5u;
+  pose_graph::EdgeIdSet outgoing_edges;
+  map_.getVertex(vertex_ids_[kNumVerticesFirstPart - 1u])
+      .getOutgoingEdges(&outgoing_edges);
+  ASSERT_EQ(outgoing_edges.size(), 1u);
+  const pose_graph::EdgeId cut_edge_id = *outgoing_edges.begin();
+  vi_map::Edge* cut_edge = nullptr;
+  map_.getEdgeAs<vi_map::Edge>(cut_edge_id).copyEdgeInto(&cut_edge);
+  map_.removeEdge(cut_edge_id);
+
+  for (size_t vertex_idx = 0u; vertex_idx < kNumVerticesFirstPart;
+       ++vertex_idx) {
+    addTrackedKeypoints(vertex_idx);
+  }
+
+  VIMapManipulation manipulation(&map_);
+  VIMapManipulation::MultiTrackIndexToLandmarkIdMap track_id_to_landmark_id;
+  const size_t num_landmarks_first_part =
+      manipulation.initializeLandmarksFromUnusedFeatureTracksOfMission(
+          mission_id_, vertex_ids_.front(), &track_id_to_landmark_id);
+  // All tracks starting in the first part.
+  EXPECT_EQ(
+      num_landmarks_first_part,
+      kNumVerticesFirstPart * kNumTracksStartingPerVertex);
+  EXPECT_EQ(map_.numLandmarks(), num_landmarks_first_part);
+  expectAssociationOfActiveTracks(
+      track_id_to_landmark_id, kNumVerticesFirstPart - 1u);
+
+  // Continue the mission and initialize starting from the last vertex of the
+  // previous initialization.
+  map_.addEdge(vi_map::Edge::UniquePtr(cut_edge));
+  for (size_t vertex_idx = kNumVerticesFirstPart; vertex_idx < kNumVertices;
+       ++vertex_idx) {
+    addTrackedKeypoints(vertex_idx);
+  }
+  const size_t num_landmarks_second_part =
+      manipulation.initializeLandmarksFromUnusedFeatureTracksOfMission(
+          mission_id_, vertex_ids_[kNumVerticesFirstPart - 1u],
+          &track_id_to_landmark_id);
+  EXPECT_EQ(
+      num_landmarks_second_part,
+      static_cast<size_t>(kNumTracks) - num_landmarks_first_part);
+  expectAssociationOfActiveTracks(track_id_to_landmark_id, kNumVertices - 1u);
+
+  // Tracks spanning both parts didn't get a duplicate landmark, every track
+  // ends up as exactly one landmark observed by all its keypoints.
+  ASSERT_EQ(map_.numLandmarks(), static_cast<size_t>(kNumTracks));
+  vi_map::LandmarkIdList landmark_ids;
+  map_.getAllLandmarkIds(&landmark_ids);
+  std::unordered_map<int, vi_map::LandmarkId> track_id_to_landmark;
+  for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+    EXPECT_EQ(
+        map_.getLandmark(landmark_id).numberOfObservations(), kTrackLength);
+    const int track_id = getTrackIdOfLandmark(landmark_id);
+    EXPECT_TRUE(track_id_to_landmark.emplace(track_id, landmark_id).second)
+        << "Track " << track_id << " has more than one landmark.";
+  }
+  EXPECT_EQ(track_id_to_landmark.size(), static_cast<size_t>(kNumTracks));
+}
+
+}  // namespace vi_map_helpers
+
+MAPLAB_UNITTEST_ENTRYPOINT
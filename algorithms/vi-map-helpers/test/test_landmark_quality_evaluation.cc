@@ -116,6 +116,83 @@ TEST_F(ViMappingTest, TestLandmarkQualityEvaluation) {
   CHECK_LE(ratio_good, 0.90);
 }
 
+TEST_F(ViMappingTest, TestCachedLandmarkQualityEvaluation) {
+  vi_map::VIMap* map = CHECK_NOTNULL(test_app_.getMapMutable());
+  vi_map::MissionIdList mission_ids;
+  map->getAllMissionIds(&mission_ids);
+
+  // A fresh evaluator evaluates all landmarks and agrees with the uncached
+  // evaluation.
+  resetLandmarkQualityToUnknown(mission_ids, map);
+  LandmarkQualityEvaluator evaluator;
+  evaluator.evaluate(map);
+  EXPECT_EQ(evaluator.numLandmarksEvaluatedInLastPass(), map->numLandmarks());
+  EXPECT_EQ(evaluator.numCachedLandmarks(), map->numLandmarks());
+  int num_unknown_cached, num_good_cached, num_bad_cached;
+  countLandmarkQualityInView(
+      *map, &num_unknown_cached, &num_good_cached, &num_bad_cached);
+  evaluateLandmarkQuality(map);
+  int num_unknown, num_good, num_bad;
+  countLandmarkQualityInView(*map, &num_unknown, &num_good, &num_bad);
+  EXPECT_EQ(num_unknown_cached, 0);
+  EXPECT_EQ(num_good_cached, num_good);
+  EXPECT_EQ(num_bad_cached, num_bad);
+
+  // Nothing changed, so nothing is re-evaluated.
+  evaluator.evaluate(map);
+  EXPECT_EQ(evaluator.numLandmarksEvaluatedInLastPass(), 0u);
+
+  // Only the corrupted landmarks are re-evaluated and the result matches the
+  // full evaluation.
+  corruptLandmarks();
+  evaluator.evaluate(map);
+  EXPECT_GT(evaluator.numLandmarksEvaluatedInLastPass(), 0u);
+  EXPECT_LT(evaluator.numLandmarksEvaluatedInLastPass(), map->numLandmarks());
+  countLandmarkQualityInView(
+      *map, &num_unknown_cached, &num_good_cached, &num_bad_cached);
+  evaluateLandmarkQuality(map);
+  countLandmarkQualityInView(*map, &num_unknown, &num_good, &num_bad);
+  EXPECT_EQ(num_good_cached, num_good);
+  EXPECT_EQ(num_bad_cached, num_bad);
+
+  // Landmarks whose quality was reset are evaluated again.
+  resetLandmarkQualityToUnknown(mission_ids, map);
+  evaluator.evaluate(map);
+  EXPECT_EQ(evaluator.numLandmarksEvaluatedInLastPass(), map->numLandmarks());
+}
+
+TEST_F(ViMappingTest, TestCachedLandmarkQualityDependsOnMeasurements) {
+  vi_map::VIMap* map = CHECK_NOTNULL(test_app_.getMapMutable());
+  LandmarkQualityEvaluator evaluator;
+  evaluator.evaluate(map);
+  evaluator.evaluate(map);
+  ASSERT_EQ(evaluator.numLandmarksEvaluatedInLastPass(), 0u);
+
+  // Moving a single keypoint only re-evaluates the landmark it observes.
+  vi_map::LandmarkIdList landmark_ids;
+  map->getAllLandmarkIds(&landmark_ids);
+  ASSERT_FALSE(landmark_ids.empty());
+  const vi_map::KeypointIdentifier observation =
+      map->getLandmark(landmark_ids.front()).getObservations().front();
+  vi_map::Vertex& vertex = map->getVertex(observation.frame_id.vertex_id);
+  Eigen::Matrix2Xd& keypoints = *vertex.getVisualFrame(
+      observation.frame_id.frame_index).getKeypointMeasurementsMutable();
+  keypoints.col(observation.keypoint_index) += Eigen::Vector2d(3.0, -2.0);
+  evaluator.evaluate(map);
+  EXPECT_EQ(evaluator.numLandmarksEvaluatedInLastPass(), 1u);
+
+  // Changing the intrinsics of the camera re-evaluates the landmarks observed
+  // by this camera.
+  const aslam::Camera::Ptr camera =
+      vertex.getCamera(observation.frame_id.frame_index);
+  ASSERT_TRUE(camera != nullptr);
+  camera->getParametersMutable()[0] *= 1.01;
+  evaluator.evaluate(map);
+  EXPECT_GT(evaluator.numLandmarksEvaluatedInLastPass(), 1u);
+  evaluator.evaluate(map);
+  EXPECT_EQ(evaluator.numLandmarksEvaluatedInLastPass(), 0u);
+}
+
 }  // namespace vi_map_helpers
 
 MAPLAB_UNITTEST_ENTRYPOINT
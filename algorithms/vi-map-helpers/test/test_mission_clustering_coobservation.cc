@@ -1,10 +1,25 @@
+#include <chrono>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
 #include <Eigen/Core>
+#include <aslam/common/memory.h>
 #include <aslam/common/pose-types.h>
+#include <aslam/common/unique-id.h>
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 #include <maplab-common/test/testing-entrypoint.h>
+#include <vi-map/loopclosure-edge.h>
 #include <vi-map/test/vi-map-generator.h>
 
 #include "vi-map-helpers/mission-clustering-coobservation.h"
+#include "vi-map-helpers/vi-map-queries.h"
+
+DEFINE_int32(
+    mission_clustering_test_num_missions, 100,
+    "Number of simulated missions. Set to 1000 to benchmark the clustering "
+    "against the pairwise intersection of the landmarks of the missions.");
 
 namespace vi_map_helpers {
 // Create the following test map:
@@ -107,6 +122,176 @@ TEST(MissionClusteringCoobservation, ClusterMissionByLandmarkCoobservations) {
   EXPECT_TRUE(clustersEqualWithoutOrdering(expected_clusters, clusters));
 }
 
+TEST(MissionClusteringCoobservation, CachedQuery) {
+  vi_map::VIMap map;
+  vi_map::MissionIdList M;
+  createTestMap(&map, &M);
+
+  MissionCoobservationCachedQuery query(
+      map, vi_map::MissionIdSet(M.begin(), M.end()));
+  EXPECT_TRUE(query.hasCommonObservations(M[0], {M[1]}));
+  EXPECT_TRUE(query.hasCommonObservations(M[2], {M[0], M[6]}));
+  EXPECT_TRUE(query.hasCommonObservations(M[5], {M[4]}));
+  EXPECT_FALSE(query.hasCommonObservations(M[3], {M[0], M[1], M[4]}));
+  EXPECT_FALSE(query.hasCommonObservations(M[6], {M[0], M[4], M[5]}));
+}
+
+TEST(MissionClusteringCoobservation, LoopClosureEdgesConnectMissions) {
+  vi_map::VIMap map;
+  vi_map::MissionIdList M;
+  createTestMap(&map, &M);
+
+  pose_graph::EdgeId edge_id;
+  aslam::generateId(&edge_id);
+  constexpr double kSwitchVariable = 1.0;
+  constexpr double kSwitchVariableVariance = 1e-4;
+  map.addEdge(
+      aligned_unique<vi_map::LoopClosureEdge>(
+          edge_id, map.getMission(M[6]).getRootVertexId(),
+          map.getMission(M[4]).getRootVertexId(), kSwitchVariable,
+          kSwitchVariableVariance, aslam::Transformation(),
+          Eigen::Matrix<double, 6, 6>::Identity()));
+
+  std::vector<vi_map::MissionIdSet> expected_clusters;
+  expected_clusters.emplace_back(vi_map::MissionIdSet{M[0], M[1], M[2], M[3]});
+  expected_clusters.emplace_back(vi_map::MissionIdSet{M[4], M[5], M[6]});
+  EXPECT_TRUE(clustersEqualWithoutOrdering(
+      expected_clusters, clusterMissionByLandmarkCoobservations(
+                             map, vi_map::MissionIdSet(M.begin(), M.end()))));
+
+  // The edge is ignored if one of its missions is not clustered.
+  expected_clusters.clear();
+  expected_clusters.emplace_back(vi_map::MissionIdSet{M[0], M[1], M[2], M[3]});
+  expected_clusters.emplace_back(vi_map::MissionIdSet{M[6]});
+  EXPECT_TRUE(clustersEqualWithoutOrdering(
+      expected_clusters, clusterMissionByLandmarkCoobservations(
+                             map, vi_map::MissionIdSet{
+                                      M[0], M[1], M[2], M[3], M[6]})));
+}
+
+// Greedily merges the components of missions that have common landmarks,
+// intersecting the landmark sets of all pairs of missions.
+std::vector<vi_map::MissionIdSet> clusterByPairwiseIntersections(
+    const vi_map::VIMap& map, const vi_map::MissionIdSet& mission_ids) {
+  VIMapQueries queries(map);
+  std::unordered_map<vi_map::MissionId, vi_map::LandmarkIdSet>
+      mission_landmarks;
+  for (const vi_map::MissionId& mission_id : mission_ids) {
+    queries.getLandmarksObservedByMission(
+        mission_id, &mission_landmarks[mission_id]);
+  }
+  auto have_common_landmarks = [&mission_landmarks](
+                                   const vi_map::MissionId& mission_id,
+                                   const vi_map::MissionIdSet& component) {
+    const vi_map::LandmarkIdSet& landmarks = mission_landmarks[mission_id];
+    for (const vi_map::MissionId& other_mission_id : component) {
+      for (const vi_map::LandmarkId& landmark_id :
+           mission_landmarks[other_mission_id]) {
+        if (landmarks.count(landmark_id) > 0u) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+
+  std::vector<vi_map::MissionIdSet> components;
+  for (const vi_map::MissionId& mission_id : mission_ids) {
+    vi_map::MissionIdSet new_component{mission_id};
+    for (std::vector<vi_map::MissionIdSet>::iterator it = components.begin();
+         it != components.end();) {
+      if (have_common_landmarks(mission_id, *it)) {
+        new_component.insert(it->begin(), it->end());
+        it = components.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    components.emplace_back(new_component);
+  }
+  return components;
+}
+
+TEST(MissionClusteringCoobservation, ManyMissionsMatchPairwiseIntersections) {
+  const size_t num_missions = FLAGS_mission_clustering_test_num_missions;
+  constexpr size_t kNumVerticesPerMission = 2u;
+  constexpr size_t kNumLandmarksPerMission = 5u;
+  constexpr size_t kPercentOfSharedLandmarks = 15u;
+
+  vi_map::VIMap map;
+  vi_map::VIMapGenerator generator(map, /*random_seed=*/0);
+  std::vector<pose_graph::VertexIdList> vertex_ids(num_missions);
+  aslam::Transformation dummy_pose;
+  for (size_t mission_idx = 0u; mission_idx < num_missions; ++mission_idx) {
+    const vi_map::MissionId mission_id = generator.createMission(dummy_pose);
+    for (size_t idx = 0u; idx < kNumVerticesPerMission; ++idx) {
+      vertex_ids[mission_idx].emplace_back(
+          generator.createVertex(mission_id, dummy_pose));
+    }
+  }
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> mission_distribution(
+      0u, num_missions - 1u);
+  std::uniform_int_distribution<size_t> vertex_distribution(
+      0u, kNumVerticesPerMission - 1u);
+  std::uniform_int_distribution<size_t> percent_distribution(0u, 99u);
+  const Eigen::Vector3d dummy_position(0, 0, 100);
+  for (size_t mission_idx = 0u; mission_idx < num_missions; ++mission_idx) {
+    for (size_t idx = 0u; idx < kNumLandmarksPerMission; ++idx) {
+      const pose_graph::VertexId& storing_vertex_id =
+          vertex_ids[mission_idx][vertex_distribution(rng)];
+      pose_graph::VertexIdList observer_ids{
+          vertex_ids[mission_idx][vertex_distribution(rng)]};
+      if (percent_distribution(rng) < kPercentOfSharedLandmarks) {
+        observer_ids.emplace_back(
+            vertex_ids[mission_distribution(rng)][vertex_distribution(rng)]);
+      }
+      generator.createLandmark(
+          dummy_position, storing_vertex_id, observer_ids);
+    }
+  }
+  generator.generateMap();
+
+  vi_map::MissionIdList mission_id_list;
+  map.getAllMissionIds(&mission_id_list);
+  const vi_map::MissionIdSet mission_ids(
+      mission_id_list.begin(), mission_id_list.end());
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  const std::vector<vi_map::MissionIdSet> expected_clusters =
+      clusterByPairwiseIntersections(map, mission_ids);
+  const double pairwise_time_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  start = std::chrono::steady_clock::now();
+  const std::vector<vi_map::MissionIdSet> serial_clusters =
+      clusterMissionByLandmarkCoobservations(map, mission_ids, 1u);
+  const double serial_time_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  constexpr size_t kNumThreads = 4u;
+  start = std::chrono::steady_clock::now();
+  const std::vector<vi_map::MissionIdSet> parallel_clusters =
+      clusterMissionByLandmarkCoobservations(map, mission_ids, kNumThreads);
+  const double parallel_time_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  LOG(INFO) << "Clustered " << num_missions << " missions into "
+            << expected_clusters.size() << " clusters: pairwise "
+            << pairwise_time_s << "s, union-find " << serial_time_s
+            << "s, union-find on " << kNumThreads << " threads "
+            << parallel_time_s << "s.";
+  EXPECT_GT(expected_clusters.size(), 1u);
+  EXPECT_TRUE(clustersEqualWithoutOrdering(expected_clusters, serial_clusters));
+  EXPECT_TRUE(
+      clustersEqualWithoutOrdering(expected_clusters, parallel_clusters));
+}
+
 }  // namespace vi_map_helpers
 
 MAPLAB_UNITTEST_ENTRYPOINT
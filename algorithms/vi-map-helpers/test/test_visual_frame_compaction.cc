@@ -0,0 +1,150 @@
+#include <unordered_map>
+
+#include <glog/logging.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <vi-map/vi-map.h>
+
+#include <vi-mapping-test-app/vi-mapping-test-app.h>
+
+#include "vi-map-helpers/vi-map-visual-frame-compaction.h"
+
+namespace vi_map_helpers {
+
+class VisualFrameCompactionTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    test_app_.loadDataset("./test_maps/common_test_map");
+    CHECK_NOTNULL(test_app_.getMapMutable());
+  }
+
+  void countLandmarkObservations(
+      std::unordered_map<vi_map::LandmarkId, size_t>* num_observations);
+  // Checks that every landmark observation points to a keypoint that is
+  // associated with this landmark.
+  void expectObservationsPointToLandmarkKeypoints();
+
+  visual_inertial_mapping::VIMappingTestApp test_app_;
+};
+
+void VisualFrameCompactionTest::countLandmarkObservations(
+    std::unordered_map<vi_map::LandmarkId, size_t>* num_observations) {
+  CHECK_NOTNULL(num_observations)->clear();
+  const vi_map::VIMap& map = *CHECK_NOTNULL(test_app_.getMapMutable());
+  vi_map::LandmarkIdList landmark_ids;
+  map.getAllLandmarkIds(&landmark_ids);
+  for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+    (*num_observations)[landmark_id] =
+        map.getLandmark(landmark_id).numberOfObservations();
+  }
+}
+
+void VisualFrameCompactionTest::expectObservationsPointToLandmarkKeypoints() {
+  const vi_map::VIMap& map = *CHECK_NOTNULL(test_app_.getMapMutable());
+  vi_map::LandmarkIdList landmark_ids;
+  map.getAllLandmarkIds(&landmark_ids);
+  for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+    map.getLandmark(landmark_id)
+        .forEachObservation(
+            [&](const vi_map::KeypointIdentifier& observation) {
+              const vi_map::Vertex& vertex =
+                  map.getVertex(observation.frame_id.vertex_id);
+              EXPECT_EQ(
+                  vertex.getObservedLandmarkId(
+                      observation.frame_id.frame_index,
+                      observation.keypoint_index),
+                  landmark_id);
+            });
+  }
+}
+
+TEST_F(VisualFrameCompactionTest, DropsUnassociatedKeypoints) {
+  vi_map::VIMap* map = test_app_.getMapMutable();
+  std::unordered_map<vi_map::LandmarkId, size_t> num_observations_before;
+  countLandmarkObservations(&num_observations_before);
+
+  vi_map::MissionIdList mission_ids;
+  map->getAllMissionIds(&mission_ids);
+  const VisualFrameCompactionStatistics statistics =
+      compactVisualFrames(VisualFrameCompactionOptions(), mission_ids, map);
+  LOG(INFO) << statistics.toString();
+  EXPECT_GT(statistics.num_frames, 0u);
+  EXPECT_LT(statistics.num_keypoints_after, statistics.num_keypoints_before);
+  EXPECT_LT(statistics.num_bytes_after, statistics.num_bytes_before);
+
+  // Only keypoints that observe a landmark remain.
+  pose_graph::VertexIdList vertex_ids;
+  map->getAllVertexIds(&vertex_ids);
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    const vi_map::Vertex& vertex = map->getVertex(vertex_id);
+    for (unsigned int frame_idx = 0u; frame_idx < vertex.numFrames();
+         ++frame_idx) {
+      if (!vertex.isVisualFrameSet(frame_idx)) {
+        continue;
+      }
+      vi_map::LandmarkIdList landmark_ids;
+      vertex.getFrameObservedLandmarkIds(frame_idx, &landmark_ids);
+      EXPECT_EQ(
+          landmark_ids.size(),
+          vertex.getVisualFrame(frame_idx).getNumKeypointMeasurements());
+      for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+        EXPECT_TRUE(landmark_id.isValid());
+      }
+    }
+  }
+
+  std::unordered_map<vi_map::LandmarkId, size_t> num_observations_after;
+  countLandmarkObservations(&num_observations_after);
+  EXPECT_TRUE(num_observations_before == num_observations_after);
+  expectObservationsPointToLandmarkKeypoints();
+  EXPECT_TRUE(test_app_.isMapConsistent());
+
+  // Compacting again doesn't change anything.
+  const VisualFrameCompactionStatistics second_statistics =
+      compactVisualFrames(VisualFrameCompactionOptions(), mission_ids, map);
+  EXPECT_EQ(
+      second_statistics.num_keypoints_after,
+      second_statistics.num_keypoints_before);
+}
+
+TEST_F(VisualFrameCompactionTest, RepresentativeDescriptors) {
+  vi_map::VIMap* map = test_app_.getMapMutable();
+  VisualFrameCompactionOptions options;
+  options.use_representative_descriptors = true;
+
+  vi_map::MissionIdList mission_ids;
+  map->getAllMissionIds(&mission_ids);
+  const VisualFrameCompactionStatistics statistics =
+      compactVisualFrames(options, mission_ids, map);
+  EXPECT_GT(statistics.num_landmarks_with_representative_descriptor, 0u);
+  expectObservationsPointToLandmarkKeypoints();
+  EXPECT_TRUE(test_app_.isMapConsistent());
+
+  // All observations of a landmark share the same descriptor.
+  vi_map::LandmarkIdList landmark_ids;
+  map->getAllLandmarkIds(&landmark_ids);
+  for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+    const vi_map::KeypointIdentifierList& observations =
+        map->getLandmark(landmark_id).getObservations();
+    if (observations.size() < 2u) {
+      continue;
+    }
+    Eigen::Matrix<unsigned char, Eigen::Dynamic, 1> reference_descriptor;
+    for (const vi_map::KeypointIdentifier& observation : observations) {
+      const aslam::VisualFrame& frame =
+          map->getVertex(observation.frame_id.vertex_id)
+              .getVisualFrame(observation.frame_id.frame_index);
+      ASSERT_EQ(static_cast<size_t>(frame.getDescriptorTypes().size()), 1u);
+      const Eigen::Matrix<unsigned char, Eigen::Dynamic, 1> descriptor =
+          frame.getDescriptors().col(observation.keypoint_index);
+      if (reference_descriptor.size() == 0) {
+        reference_descriptor = descriptor;
+      } else {
+        EXPECT_TRUE(descriptor == reference_descriptor);
+      }
+    }
+  }
+}
+
+}  // namespace vi_map_helpers
+
+MAPLAB_UNITTEST_ENTRYPOINT
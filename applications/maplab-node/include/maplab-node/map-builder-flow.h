@@ -10,6 +10,7 @@
 #include <message-flow/message-flow.h>
 #include <online-map-builders/stream-map-builder.h>
 #include <sensors/imu.h>
+#include <vi-map-helpers/vi-map-manipulation.h>
 #include <vi-map/vi-map.h>
 #include <vio-common/vio-types.h>
 
@@ -38,6 +39,10 @@ class MapBuilderFlow {
 
   VIMapWithMutex::Ptr map_with_mutex_;
   pose_graph::VertexId last_vertex_of_previous_map_saving_;
+  // Association of feature tracks to landmarks that is kept across map
+  // savings, such that tracks spanning several savings map to one landmark.
+  vi_map_helpers::VIMapManipulation::MultiTrackIndexToLandmarkIdMap
+      track_id_to_landmark_id_;
 
   // If set then all incoming callbacks that cause operations on the map will be
   // rejected. This is used during shutdown.
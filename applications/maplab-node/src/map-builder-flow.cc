@@ -286,6 +286,10 @@ bool MapBuilderFlow::saveMapAndOptionallyOptimize(
     return false;
   }
 
+  // All further processing needs the descriptors of the whole map.
+  stream_map_builder_.reloadAllSpilledVisualFrames();
+  CHECK_EQ(stream_map_builder_.numSpilledVertices(), 0u);
+
   visualization::ViwlsGraphRvizPlotter::UniquePtr plotter;
   if (FLAGS_visualize_map) {
     plotter = aligned_unique<visualization::ViwlsGraphRvizPlotter>();
@@ -304,12 +308,16 @@ bool MapBuilderFlow::saveMapAndOptionallyOptimize(
         &map_with_mutex_->vi_map);
     if (!last_vertex_of_previous_map_saving_.isValid()) {
       landmark_manipulation.initializeLandmarksFromUnusedFeatureTracksOfMission(
-          id_of_first_mission);
+          id_of_first_mission,
+          map_with_mutex_->vi_map.getMission(id_of_first_mission)
+              .getRootVertexId(),
+          &track_id_to_landmark_id_);
       landmark_triangulation::retriangulateLandmarksOfMission(
           id_of_first_mission, &map_with_mutex_->vi_map);
     } else {
       landmark_manipulation.initializeLandmarksFromUnusedFeatureTracksOfMission(
-          id_of_first_mission, last_vertex_of_previous_map_saving_);
+          id_of_first_mission, last_vertex_of_previous_map_saving_,
+          &track_id_to_landmark_id_);
       landmark_triangulation::retriangulateLandmarksAlongMissionAfterVertex(
           id_of_first_mission, last_vertex_of_previous_map_saving_,
           &map_with_mutex_->vi_map);
@@ -7,6 +7,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -131,6 +132,24 @@ class MaplabServerNode final {
 
   void saveMapEveryInterval();
 
+  // Map saving functions:
+
+  // Returns a deep copy of the merged map or nullptr if there is none yet. The
+  // caller needs to hold 'mutex_'.
+  std::shared_ptr<vi_map::VIMap> copyMergedMap();
+
+  // Writes the copy of the merged map to a temporary folder next to 'path'
+  // and then moves it in place of the previous map, such that there is always
+  // a complete map on disk. Resources are never moved out of the merged map,
+  // migrating them always copies the files.
+  bool writeMergedMapCopy(
+      const std::string& path, const backend::SaveConfig& config,
+      vi_map::VIMap* map_copy);
+
+  // Copies the merged map and writes the copy on a low priority thread. Returns
+  // false if there is no merged map or the previous save is still running.
+  bool saveMapInBackground(const std::string& path);
+
   void runOneIterationOfMapMergingAlgorithms();
 
   void publishDenseMap();
@@ -166,6 +185,9 @@ class MaplabServerNode final {
   // Fast status loop that reads current the thread status from merging and
   // submap thread and summarizes it.
   std::thread status_thread_;
+  // Writes the periodic backups of the merged map, such that neither the
+  // merging nor the requests to the server are blocked by the disk access.
+  std::thread map_saving_thread_;
 
   // Map management
   /////////////////
@@ -196,6 +218,13 @@ class MaplabServerNode final {
   // Keep strack of the total number of merged submaps into the global map.
   std::atomic<uint32_t> total_num_merged_submaps_;
 
+  // Map saving thread status variables.
+  // Accessed by merging and status thread.
+  std::atomic<bool> map_saving_thread_busy_;
+  // Serializes writing maps to the file system, such that a background and
+  // an explicitly requested save never write to the same folder at once.
+  std::mutex map_saving_mutex_;
+
   // Server status and map management variables
   // Accessed by all threads to map between robot names and missions.
   mutable std::mutex robot_to_mission_id_map_mutex_;
@@ -14,7 +14,11 @@
 #include <maplab-common/file-system-tools.h>
 #include <maplab-common/sigint-breaker.h>
 #include <maplab-common/threading-helpers.h>
+#include <resources-common/point-cloud-voxel-accumulator.h>
 #include <signal.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <vi-map-basic-plugin/vi-map-basic-plugin.h>
 #include <vi-map-helpers/vi-map-landmark-quality-evaluation.h>
 #include <vi-map-helpers/vi-map-manipulation.h>
@@ -22,6 +26,9 @@
 #include <visualization/spatially-distribute-missions.h>
 
 #include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <memory>
 #include <string>
 
@@ -47,6 +54,17 @@ DEFINE_int32(
     maplab_server_backup_interval_s, 300,
     "Create a backup of the current map every n seconds. 0 = no backups.");
 
+DEFINE_bool(
+    maplab_server_background_map_saving, true,
+    "If enabled, the backups are written by a low priority thread from a copy "
+    "of the merged map, such that merging and requests are only blocked while "
+    "the map is copied. Resources are not migrated by backups.");
+
+DEFINE_int32(
+    maplab_server_map_saving_thread_nice_value, 10,
+    "Nice value of the background map saving thread, higher values lower its "
+    "scheduling priority.");
+
 DEFINE_bool(
     maplab_server_remove_outliers_in_absolute_pose_constraints, true,
     "If enabled, the submap processing will after optimization run "
@@ -110,12 +128,51 @@ DEFINE_bool(
     "If enabled, lidar loop closure & mapping is used to derrive constraints "
     "within and across missions.");
 
+DEFINE_double(
+    maplab_server_dense_map_voxel_size_m, 0.0,
+    "Resolution of the voxel grid the dense map requests are accumulated in, "
+    "every occupied voxel results in a single point. This bounds the size of "
+    "the response by the requested volume instead of the number of scans. If "
+    "0, all points of all scans are returned. A voxel size of 0.05 keeps the "
+    "responses for large dense maps manageable.");
+
+DEFINE_string(
+    maplab_server_dense_map_voxel_reduction, "mean",
+    "How the points within a voxel of the dense map requests are reduced to "
+    "a single point: 'mean', 'first' or 'max_intensity'.");
+
 DEFINE_bool(
     maplab_server_spatially_distribute_missions, true,
     "Spatially distribute missions from robots that have not yet been merged "
     "into the main map. See flags \"spatially_*\" for more options.");
 
 namespace maplab {
+
+namespace {
+
+const std::string kTemporaryMapFolderSuffix = ".saving";  // NOLINT
+const std::string kPreviousMapFolderSuffix = ".previous";  // NOLINT
+
+std::string removeTrailingSlashes(const std::string& path) {
+  std::string result = path;
+  while (result.size() > 1u && result.back() == '/') {
+    result.pop_back();
+  }
+  return result;
+}
+
+void lowerSchedulingPriorityOfThisThread() {
+  // On Linux the nice value is an attribute of the individual thread.
+  const pid_t thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+  if (setpriority(
+          PRIO_PROCESS, thread_id,
+          FLAGS_maplab_server_map_saving_thread_nice_value) != 0) {
+    LOG(WARNING) << "[MaplabServerNode] Unable to lower the priority of the "
+                 << "map saving thread: " << std::strerror(errno);
+  }
+}
+
+}  // namespace
 MaplabServerNode::MaplabServerNode()
     : submap_loading_thread_pool_(
           FLAGS_maplab_server_submap_loading_thread_pool_size),
@@ -126,6 +183,7 @@ MaplabServerNode::MaplabServerNode()
       duration_last_merging_loop_s_(0.0),
       optimization_trust_region_radius_(FLAGS_ba_initial_trust_region_radius),
       total_num_merged_submaps_(0u),
+      map_saving_thread_busy_(false),
       time_of_last_map_backup_s_(0.0),
       is_running_(false) {
   if (!FLAGS_ros_free) {
@@ -138,6 +196,9 @@ MaplabServerNode::~MaplabServerNode() {
   if (is_running_) {
     shutdown();
   }
+  if (map_saving_thread_.joinable()) {
+    map_saving_thread_.join();
+  }
 }
 
 void MaplabServerNode::start() {
@@ -256,6 +317,16 @@ void MaplabServerNode::shutdown() {
     LOG(ERROR) << "Unable to stop map submap processing threads: " << e.what();
   }
 
+  try {
+    LOG(INFO) << "[MaplabServerNode] Waiting for MapSaving thread...";
+    if (map_saving_thread_.joinable()) {
+      map_saving_thread_.join();
+    }
+    LOG(INFO) << "[MaplabServerNode] Done waiting for MapSaving thread.";
+  } catch (std::exception& e) {
+    LOG(ERROR) << "Unable to stop map saving thread: " << e.what();
+  }
+
   try {
     LOG(INFO) << "[MaplabServerNode] Stopping Status thread...";
     if (status_thread_.joinable()) {
@@ -270,14 +341,17 @@ void MaplabServerNode::shutdown() {
 }
 
 bool MaplabServerNode::saveMap(const std::string& path) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  LOG(INFO) << "[MaplabServerNode] Saving map to '" << path << "'.";
-  if (map_manager_.hasMap(kMergedMapKey)) {
-    return map_manager_.saveMapToFolder(
-        kMergedMapKey, path, vi_map::parseSaveConfigFromGFlags());
-  } else {
+  std::shared_ptr<vi_map::VIMap> map_copy;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    LOG(INFO) << "[MaplabServerNode] Saving map to '" << path << "'.";
+    map_copy = copyMergedMap();
+  }
+  if (!map_copy) {
     return false;
   }
+  return writeMergedMapCopy(
+      path, vi_map::parseSaveConfigFromGFlags(), map_copy.get());
 }
 
 bool MaplabServerNode::isSubmapBlacklisted(const std::string& map_key) {
@@ -411,22 +485,124 @@ bool MaplabServerNode::loadAndProcessSubmap(
 }
 
 bool MaplabServerNode::saveMap() {
-  std::lock_guard<std::mutex> lock(mutex_);
   if (FLAGS_maplab_server_merged_map_folder.empty()) {
     LOG(ERROR) << "[MaplabServerNode] Cannot save map because "
                   "--maplab_server_merged_map_folder is empty!";
     return false;
   }
+  return saveMap(FLAGS_maplab_server_merged_map_folder);
+}
 
-  LOG(INFO) << "[MaplabServerNode] Saving map to '"
-            << FLAGS_maplab_server_merged_map_folder << "'.";
-  if (map_manager_.hasMap(kMergedMapKey)) {
-    return map_manager_.saveMapToFolder(
-        kMergedMapKey, FLAGS_maplab_server_merged_map_folder,
-        vi_map::parseSaveConfigFromGFlags());
-  } else {
+std::shared_ptr<vi_map::VIMap> MaplabServerNode::copyMergedMap() {
+  if (!map_manager_.hasMap(kMergedMapKey)) {
+    return nullptr;
+  }
+  timing::Timer timer_copy("map-saving: copy merged map");
+  std::shared_ptr<vi_map::VIMap> map_copy(new vi_map::VIMap);
+  vi_map::VIMapManager::MapReadAccess map =
+      map_manager_.getMapReadAccess(kMergedMapKey);
+  map_copy->deepCopy(*map);
+  return map_copy;
+}
+
+bool MaplabServerNode::writeMergedMapCopy(
+    const std::string& path, const backend::SaveConfig& config,
+    vi_map::VIMap* map_copy) {
+  CHECK_NOTNULL(map_copy);
+  CHECK(!path.empty());
+  std::lock_guard<std::mutex> lock(map_saving_mutex_);
+  timing::TimerImpl timer_write("map-saving: write merged map");
+
+  const std::string map_folder = removeTrailingSlashes(path);
+  if (!config.overwrite_existing_files &&
+      vi_map::VIMap::hasMapOnFileSystem(map_folder)) {
+    LOG(ERROR) << "[MaplabServerNode] Cannot save map because there is "
+               << "already a map in '" << map_folder << "'.";
+    return false;
+  }
+
+  // Leftovers of an interrupted save are incomplete and can be discarded.
+  const std::string temporary_folder = map_folder + kTemporaryMapFolderSuffix;
+  if (common::pathExists(temporary_folder) &&
+      !common::removePath(temporary_folder)) {
+    LOG(ERROR) << "[MaplabServerNode] Unable to remove '" << temporary_folder
+               << "'.";
     return false;
   }
+  // The copy references the same resource files as the live merged map, hence
+  // a resource migration may only copy them, moving would take them away from
+  // the merged map.
+  backend::SaveConfig temporary_config = config;
+  temporary_config.overwrite_existing_files = true;
+  temporary_config.move_resources_when_migrating = false;
+  if (!map_copy->saveToFolder(temporary_folder, temporary_config)) {
+    LOG(ERROR) << "[MaplabServerNode] Failed to write map to '"
+               << temporary_folder << "'.";
+    return false;
+  }
+
+  // Keep the previous map until the new one is in place, such that a complete
+  // map exists on disk at any point in time.
+  const std::string previous_folder = map_folder + kPreviousMapFolderSuffix;
+  if (common::pathExists(previous_folder)) {
+    common::removePath(previous_folder);
+  }
+  if (common::pathExists(map_folder) &&
+      std::rename(map_folder.c_str(), previous_folder.c_str()) != 0) {
+    LOG(ERROR) << "[MaplabServerNode] Unable to move '" << map_folder
+               << "' out of the way: " << std::strerror(errno);
+    return false;
+  }
+  if (std::rename(temporary_folder.c_str(), map_folder.c_str()) != 0) {
+    LOG(ERROR) << "[MaplabServerNode] Unable to move '" << temporary_folder
+               << "' to '" << map_folder << "': " << std::strerror(errno);
+    return false;
+  }
+  if (common::pathExists(previous_folder)) {
+    common::removePath(previous_folder);
+  }
+
+  LOG(INFO) << "[MaplabServerNode] Saved map to '" << map_folder << "' in "
+            << timer_write.Stop() << "s.";
+  return true;
+}
+
+bool MaplabServerNode::saveMapInBackground(const std::string& path) {
+  if (path.empty()) {
+    LOG(ERROR) << "[MaplabServerNode] Cannot save map because "
+                  "--maplab_server_merged_map_folder is empty!";
+    return false;
+  }
+  if (map_saving_thread_busy_.load()) {
+    return false;
+  }
+
+  std::shared_ptr<vi_map::VIMap> map_copy;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    map_copy = copyMergedMap();
+  }
+  if (!map_copy) {
+    return false;
+  }
+
+  // The resources of the merged map are already stored in the folders of the
+  // submaps or the resource folder of the server, hence only the map itself
+  // and the resource references need to be written.
+  backend::SaveConfig config = vi_map::parseSaveConfigFromGFlags();
+  config.migrate_resources_settings =
+      backend::SaveConfig::MigrateResourcesSettings::kDontMigrateResourceFolder;
+
+  if (map_saving_thread_.joinable()) {
+    map_saving_thread_.join();
+  }
+  map_saving_thread_busy_ = true;
+  map_saving_thread_ = std::thread([this, path, config, map_copy]() {
+    lowerSchedulingPriorityOfThisThread();
+    writeMergedMapCopy(path, config, map_copy.get());
+    map_saving_thread_busy_ = false;
+  });
+  return true;
 }
 
 void MaplabServerNode::visualizeMap() {
@@ -911,13 +1087,29 @@ void MaplabServerNode::saveMapEveryInterval() {
   if ((time_now_s - time_of_last_map_backup_s_) >
           FLAGS_maplab_server_backup_interval_s &&
       FLAGS_maplab_server_backup_interval_s > 0) {
-    LOG(INFO) << "[MaplabServerNode] MapMerging - saving map as backup.";
-    {
-      std::lock_guard<std::mutex> merge_status_lock(
-          running_merging_process_mutex_);
-      running_merging_process_ = "save map";
+    if (FLAGS_maplab_server_background_map_saving) {
+      if (map_saving_thread_busy_.load()) {
+        VLOG(1) << "[MaplabServerNode] MapMerging - previous backup is still "
+                << "being written, postponing the next one.";
+        return;
+      }
+      LOG(INFO) << "[MaplabServerNode] MapMerging - saving map as backup in "
+                << "the background.";
+      {
+        std::lock_guard<std::mutex> merge_status_lock(
+            running_merging_process_mutex_);
+        running_merging_process_ = "copy map for backup";
+      }
+      saveMapInBackground(FLAGS_maplab_server_merged_map_folder);
+    } else {
+      LOG(INFO) << "[MaplabServerNode] MapMerging - saving map as backup.";
+      {
+        std::lock_guard<std::mutex> merge_status_lock(
+            running_merging_process_mutex_);
+        running_merging_process_ = "save map";
+      }
+      saveMap();
     }
-    saveMap();
 
     time_of_last_map_backup_s_ = time_now_s;
   }
@@ -1127,6 +1319,8 @@ void MaplabServerNode::printAndPublishServerStatus() {
      << optimization_trust_region_radius_.load() << "\n";
   ss << "   - num merged submaps:         " << total_num_merged_submaps_.load()
      << "\n";
+  ss << " - Active map saving thread: "
+     << (map_saving_thread_busy_.load() ? "yes" : "no") << "\n";
   ss << "================================================================"
      << "==\n";
   {
@@ -1573,11 +1767,28 @@ bool MaplabServerNode::getDenseMapInRange(
 
   std::lock_guard<std::mutex> lock(mutex_);
 
+  std::unique_ptr<resources::PointCloudVoxelAccumulator> accumulator;
+  if (FLAGS_maplab_server_dense_map_voxel_size_m > 0.0) {
+    resources::PointCloudVoxelAccumulator::Reduction reduction;
+    if (!resources::PointCloudVoxelAccumulator::reductionFromString(
+            FLAGS_maplab_server_dense_map_voxel_reduction, &reduction)) {
+      LOG(ERROR) << "[MaplabServerNode] Unknown voxel reduction '"
+                 << FLAGS_maplab_server_dense_map_voxel_reduction << "'!";
+      return false;
+    }
+    accumulator.reset(new resources::PointCloudVoxelAccumulator(
+        FLAGS_maplab_server_dense_map_voxel_size_m, reduction));
+  }
+
   depth_integration::IntegrationFunctionPointCloudMaplab integration_function =
-      [&point_cloud_G](
+      [&point_cloud_G, &accumulator](
           const aslam::Transformation& T_G_S,
           const resources::PointCloud& points_S) {
-        point_cloud_G->appendTransformed(points_S, T_G_S);
+        if (accumulator) {
+          accumulator->insertTransformed(points_S, T_G_S);
+        } else {
+          point_cloud_G->appendTransformed(points_S, T_G_S);
+        }
       };
 
   // Select within a radius.
@@ -1598,6 +1809,11 @@ bool MaplabServerNode::getDenseMapInRange(
       false /*use_undistorted_camera_for_depth_maps*/, *map,
       integration_function, get_resources_in_radius);
 
+  if (accumulator) {
+    resources::PointCloud voxelized_point_cloud_G;
+    accumulator->exportPointCloud(&voxelized_point_cloud_G);
+    point_cloud_G->append(voxelized_point_cloud_G);
+  }
   return true;
 }
 
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <memory>
 #include <stdio.h>
 #include <string>
 #include <unistd.h>
@@ -12,11 +13,18 @@
 #include <maplab-server-node/maplab-server-node.h>
 #include <maplab-server-node/maplab-server-ros-node.h>
 
+DECLARE_bool(move_resources_to_map_folder);
 DECLARE_bool(overwrite);
 DECLARE_bool(ros_free);
 
 namespace maplab {
 
+// Gives the tests access to the merged map of the server.
+class MaplabServerNodeForTest : public MaplabServerNode {
+ public:
+  using MaplabServerNode::copyMergedMap;
+};
+
 class MaplabServerNodeTest : public ::testing::Test {
  protected:
   virtual void SetUp() {
@@ -70,6 +78,38 @@ TEST_F(MaplabServerNodeTest, TestMaplabServerNode) {
   maplab_server_node.shutdown();
 }
 
+TEST_F(MaplabServerNodeTest, SavingTwiceKeepsResourcesOfMergedMap) {
+  const bool original_move_resources = FLAGS_move_resources_to_map_folder;
+  FLAGS_move_resources_to_map_folder = true;
+
+  MaplabServerNodeForTest maplab_server_node;
+  maplab_server_node.start();
+  ros::Time::init();
+
+  const uint32_t kSleepBetweenSubmapsSec = 3;
+  const uint32_t kNumSubmapsToMerge = 2;
+  EXPECT_TRUE(maplab_server_node.loadAndProcessSubmap(kRobotName, kSubmap0));
+  std::this_thread::sleep_for(std::chrono::seconds(kSleepBetweenSubmapsSec));
+  EXPECT_TRUE(maplab_server_node.loadAndProcessSubmap(kRobotName, kSubmap1));
+  while (maplab_server_node.getNumMergedSubmaps() < kNumSubmapsToMerge) {
+    std::this_thread::sleep_for(std::chrono::seconds(kSleepBetweenSubmapsSec));
+  }
+
+  // Each save migrates the resources into the folder of the saved copy, this
+  // must not take them away from the merged map.
+  EXPECT_TRUE(maplab_server_node.saveMap("./merged_map_first"));
+  EXPECT_TRUE(maplab_server_node.saveMap("./merged_map_second"));
+  maplab_server_node.shutdown();
+
+  // No other thread accesses the merged map after the shutdown.
+  std::shared_ptr<vi_map::VIMap> merged_map =
+      maplab_server_node.copyMergedMap();
+  ASSERT_TRUE(merged_map != nullptr);
+  EXPECT_TRUE(merged_map->checkResourceFileSystem());
+
+  FLAGS_move_resources_to_map_folder = original_move_resources;
+}
+
 }  // namespace maplab
 
 MAPLAB_UNITTEST_ENTRYPOINT
@@ -4,6 +4,7 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <localization-summary-map/localization-summary-map-creation.h>
+#include <localization-summary-map/localization-summary-map-tiling.h>
 #include <localization-summary-map/localization-summary-map.h>
 #include <maplab-common/sigint-breaker.h>
 #include <maplab-common/threading-helpers.h>
@@ -21,8 +22,8 @@
 
 DEFINE_string(
     vio_localization_map_folder, "",
-    "Path to a localization summary map or a full VI-map used for "
-    "localization.");
+    "Path to a localization summary map, a tiled localization summary map or a "
+    "full VI-map used for localization.");
 DEFINE_string(sensor_calibration_file, "", "Path to sensor calibration yaml.");
 
 DEFINE_string(
@@ -116,7 +117,19 @@ int main(int argc, char** argv) {
 
   // Optionally load localization map.
   std::unique_ptr<summary_map::LocalizationSummaryMap> localization_map;
-  if (!FLAGS_vio_localization_map_folder.empty()) {
+  std::unique_ptr<summary_map::TiledLocalizationSummaryMap>
+      tiled_localization_map;
+  if (!FLAGS_vio_localization_map_folder.empty() &&
+      summary_map::TiledLocalizationSummaryMap::hasMapOnFileSystem(
+          FLAGS_vio_localization_map_folder)) {
+    // Only the tile index is loaded here, the tiles themselves are loaded on
+    // demand by the localizer.
+    tiled_localization_map.reset(new summary_map::TiledLocalizationSummaryMap);
+    CHECK(tiled_localization_map->loadFromFolder(
+        FLAGS_vio_localization_map_folder))
+        << "[OPENVINSLI] Loading the tiled localization map from "
+        << FLAGS_vio_localization_map_folder << " failed.";
+  } else if (!FLAGS_vio_localization_map_folder.empty()) {
     localization_map.reset(new summary_map::LocalizationSummaryMap);
     if (!localization_map->loadFromFolder(FLAGS_vio_localization_map_folder)) {
       LOG(WARNING)
@@ -178,7 +191,7 @@ int main(int argc, char** argv) {
 
   openvins_localization_node = std::make_shared<openvinsli::OpenvinsliNode>(
       sensor_manager, openvins_imu_sigmas, save_map_folder, localization_map.get(),
-      flow.get());
+      tiled_localization_map.get(), flow.get());
 
   // Start the pipeline. The ROS spinner will handle SIGINT for us and abort
   // the application on CTRL+C.
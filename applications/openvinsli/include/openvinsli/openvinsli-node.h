@@ -27,6 +27,8 @@ class OpenvinsliNode final {
       const vi_map::ImuSigmas& openvins_imu_sigmas,
       const std::string& save_map_folder,
       const summary_map::LocalizationSummaryMap* const localization_map,
+      const summary_map::TiledLocalizationSummaryMap* const
+          tiled_localization_map,
       message_flow::MessageFlow* flow);
   ~OpenvinsliNode();
 
@@ -3,6 +3,7 @@
 #include <string>
 
 #include <aslam/cameras/ncamera.h>
+#include <localization-summary-map/localization-summary-map-tiling.h>
 #include <localization-summary-map/localization-summary-map.h>
 #include <message-flow/message-flow.h>
 #include <message-flow/message-topic-registration.h>
@@ -39,10 +40,14 @@ OpenvinsliNode::OpenvinsliNode(
     const vi_map::ImuSigmas& openvins_imu_sigmas,
     const std::string& save_map_folder,
     const summary_map::LocalizationSummaryMap* const localization_map,
+    const summary_map::TiledLocalizationSummaryMap* const
+        tiled_localization_map,
     message_flow::MessageFlow* flow)
     : is_datasource_exhausted_(false) {
-  // localization_summary_map is optional and can be a nullptr.
+  // The localization maps are optional and can be nullptrs, at most one of
+  // them may be set.
   CHECK_NOTNULL(flow);
+  CHECK(localization_map == nullptr || tiled_localization_map == nullptr);
 
   aslam::NCamera::Ptr camera_system = getSelectedNCamera(sensor_manager);
   CHECK(camera_system) << "No NCamera found in the sensor manager.";
@@ -69,14 +74,20 @@ OpenvinsliNode::OpenvinsliNode(
     openvins_flow_->attachToMessageFlow(flow);
   }
 
-  const bool localization_enabled = localization_map != nullptr;
+  const bool localization_enabled =
+      localization_map != nullptr || tiled_localization_map != nullptr;
   if (FLAGS_openvinsli_run_map_builder || localization_enabled) {
     // If there's no localization and no map should be built, no maplab feature
     // tracking is needed.
     if (localization_enabled) {
       constexpr bool kVisualizeLocalization = true;
-      localizer_flow_.reset(
-          new LocalizerFlow(*localization_map, kVisualizeLocalization));
+      if (tiled_localization_map != nullptr) {
+        localizer_flow_.reset(
+            new LocalizerFlow(*tiled_localization_map, kVisualizeLocalization));
+      } else {
+        localizer_flow_.reset(
+            new LocalizerFlow(*localization_map, kVisualizeLocalization));
+      }
       localizer_flow_->attachToMessageFlow(flow);
     }
 
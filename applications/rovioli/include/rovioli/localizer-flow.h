@@ -1,6 +1,14 @@
 #ifndef ROVIOLI_LOCALIZER_FLOW_H_
 #define ROVIOLI_LOCALIZER_FLOW_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <localization-summary-map/localization-summary-map-tiling.h>
 #include <localization-summary-map/localization-summary-map.h>
 #include <message-flow/message-flow.h>
 #include <vio-common/vio-types.h>
@@ -13,14 +21,30 @@ class LocalizerFlow {
   explicit LocalizerFlow(
       const summary_map::LocalizationSummaryMap& localization_map,
       const bool visualize_localization);
+  explicit LocalizerFlow(
+      const summary_map::TiledLocalizationSummaryMap& tiled_localization_map,
+      const bool visualize_localization);
+  ~LocalizerFlow();
 
   void attachToMessageFlow(message_flow::MessageFlow* flow);
 
  private:
+  explicit LocalizerFlow(std::unique_ptr<Localizer> localizer);
+
   void processTrackedNFrameAndImu(
       const vio::SynchronizedNFrameImu::ConstPtr& nframe_imu);
 
-  Localizer localizer_;
+  // Localizes the nframe and publishes the result, unless it has become
+  // stale or was superseded by a more recent result in the meantime.
+  void localizeAndPublish(
+      const vio::SynchronizedNFrameImu::ConstPtr& nframe_imu,
+      const int64_t received_time_ns);
+
+  // Worker of the latest-frame-wins scheduling: waits for a pending nframe
+  // and localizes it.
+  void localizationWorker();
+
+  const std::unique_ptr<Localizer> localizer_;
 
   std::function<void(vio::LocalizationResult::ConstPtr)>
       publish_localization_result_;
@@ -29,6 +53,23 @@ class LocalizerFlow {
   const int64_t min_localization_timestamp_diff_ns_;
   int64_t previous_nframe_timestamp_ns_;
   mutable std::mutex m_previous_nframe_timestamp_ns_;
+
+  // All members below are used for the latest-frame-wins scheduling. Only the
+  // most recent nframe waits for a free worker, older ones are dropped.
+  const bool latest_frame_wins_;
+  // Results whose nframe is older than this compared to the most recently
+  // received nframe are discarded.
+  const int64_t max_result_age_ns_;
+  std::atomic<int64_t> latest_received_timestamp_ns_;
+  std::vector<std::thread> localization_workers_;
+  std::mutex m_pending_nframe_;
+  std::condition_variable cv_pending_nframe_;
+  vio::SynchronizedNFrameImu::ConstPtr pending_nframe_imu_;
+  int64_t pending_nframe_received_time_ns_;
+  bool shutdown_requested_;
+  // Results may finish out of order, only newer ones are published.
+  std::mutex m_latest_published_timestamp_ns_;
+  int64_t latest_published_timestamp_ns_;
 };
 }  // namespace rovioli
 #endif  // ROVIOLI_LOCALIZER_FLOW_H_
@@ -1,9 +1,13 @@
 #ifndef ROVIOLI_LOCALIZER_H_
 #define ROVIOLI_LOCALIZER_H_
 
+#include <memory>
+
 #include <localization-summary-map/localization-summary-map-queries.h>
+#include <localization-summary-map/localization-summary-map-tiling.h>
 #include <localization-summary-map/localization-summary-map.h>
 #include <loop-closure-handler/loop-detector-node.h>
+#include <loop-closure-handler/summary-map-tile-cache.h>
 #include <maplab-common/localization-result.h>
 #include <maplab-common/macros.h>
 #include <vio-common/vio-types.h>
@@ -21,9 +25,17 @@ class Localizer {
   Localizer(
       const summary_map::LocalizationSummaryMap& localization_summary_map,
       const bool visualize_localization);
+  // Localizes against the tiles of the tiled map that are close to the last
+  // successful localization. The tiles are loaded and evicted in the
+  // background.
+  Localizer(
+      const summary_map::TiledLocalizationSummaryMap& tiled_localization_map,
+      const bool visualize_localization);
 
   LocalizationMode getCurrentLocalizationMode() const;
 
+  // Safe to call concurrently from multiple threads, the databases of the loop
+  // detectors are only read after construction.
   bool localizeNFrame(
       const aslam::VisualNFrame::ConstPtr& nframe,
       vio::LocalizationResult* localization_result) const;
@@ -32,6 +44,9 @@ class Localizer {
   bool localizeNFrameGlobal(
       const aslam::VisualNFrame::ConstPtr& nframe,
       vio::LocalizationResult* localization_result) const;
+  bool localizeNFrameInTiles(
+      const aslam::VisualNFrame::ConstPtr& nframe,
+      vio::LocalizationResult* localization_result) const;
   bool localizeNFrameMapTracking(
       const aslam::VisualNFrame::ConstPtr& nframe,
       vio::LocalizationResult* localization_result) const;
@@ -39,8 +54,13 @@ class Localizer {
   LocalizationMode current_localization_mode_;
   loop_detector_node::LoopDetectorNode::UniquePtr global_loop_detector_;
 
-  const summary_map::LocalizationSummaryMap& localization_summary_map_;
-  const summary_map::SummaryMapCachedLookups map_cached_lookup_;
+  // Only set if localizing against a single summary map.
+  const summary_map::LocalizationSummaryMap* const localization_summary_map_;
+  std::unique_ptr<const summary_map::SummaryMapCachedLookups>
+      map_cached_lookup_;
+
+  // Only set if localizing against a tiled summary map.
+  std::unique_ptr<loop_detector_node::SummaryMapTileCache> tile_cache_;
 };
 
 }  // namespace rovioli
@@ -1,5 +1,10 @@
 #include "rovioli/localizer-flow.h"
 
+#include <memory>
+#include <utility>
+
+#include <aslam/common/statistics/statistics.h>
+#include <aslam/common/time.h>
 #include <gflags/gflags.h>
 #include <localization-summary-map/localization-summary-map.h>
 #include <message-flow/message-flow.h>
@@ -11,16 +16,69 @@
 DEFINE_double(
     vio_max_localization_frequency_hz, 2.0,
     "Maximum localization frequency [hz].");
+DEFINE_bool(
+    vio_localization_latest_frame_wins, false,
+    "If enabled, localizations run on dedicated worker threads instead of the "
+    "subscriber queue. Nframes that arrive while all workers are busy replace "
+    "the one waiting for a worker, such that only the most recent nframe is "
+    "localized next.");
+DEFINE_int32(
+    vio_localization_num_workers, 2,
+    "Number of localizations that run concurrently if "
+    "--vio_localization_latest_frame_wins is enabled.");
+DEFINE_double(
+    vio_localization_max_result_age_s, 1.0,
+    "Localization results are discarded if their nframe is older than this "
+    "compared to the most recently received nframe once the localization has "
+    "finished. Only used if --vio_localization_latest_frame_wins is enabled.");
 
 namespace rovioli {
 LocalizerFlow::LocalizerFlow(
     const summary_map::LocalizationSummaryMap& localization_map,
     const bool visualize_localization)
-    : localizer_(localization_map, visualize_localization),
+    : LocalizerFlow(std::unique_ptr<Localizer>(
+          new Localizer(localization_map, visualize_localization))) {}
+
+LocalizerFlow::LocalizerFlow(
+    const summary_map::TiledLocalizationSummaryMap& tiled_localization_map,
+    const bool visualize_localization)
+    : LocalizerFlow(std::unique_ptr<Localizer>(
+          new Localizer(tiled_localization_map, visualize_localization))) {}
+
+LocalizerFlow::LocalizerFlow(std::unique_ptr<Localizer> localizer)
+    : localizer_(std::move(localizer)),
       min_localization_timestamp_diff_ns_(
           kSecondsToNanoSeconds / FLAGS_vio_max_localization_frequency_hz),
-      previous_nframe_timestamp_ns_(-1) {
+      previous_nframe_timestamp_ns_(-1),
+      latest_frame_wins_(FLAGS_vio_localization_latest_frame_wins),
+      max_result_age_ns_(
+          kSecondsToNanoSeconds * FLAGS_vio_localization_max_result_age_s),
+      latest_received_timestamp_ns_(-1),
+      pending_nframe_received_time_ns_(-1),
+      shutdown_requested_(false),
+      latest_published_timestamp_ns_(-1) {
+  CHECK(localizer_);
   CHECK_GT(FLAGS_vio_max_localization_frequency_hz, 0.);
+  if (latest_frame_wins_) {
+    CHECK_GT(FLAGS_vio_localization_num_workers, 0);
+    CHECK_GT(FLAGS_vio_localization_max_result_age_s, 0.);
+    for (int worker_idx = 0; worker_idx < FLAGS_vio_localization_num_workers;
+         ++worker_idx) {
+      localization_workers_.emplace_back(
+          &LocalizerFlow::localizationWorker, this);
+    }
+  }
+}
+
+LocalizerFlow::~LocalizerFlow() {
+  {
+    std::lock_guard<std::mutex> lock(m_pending_nframe_);
+    shutdown_requested_ = true;
+  }
+  cv_pending_nframe_.notify_all();
+  for (std::thread& worker : localization_workers_) {
+    worker.join();
+  }
 }
 
 void LocalizerFlow::attachToMessageFlow(message_flow::MessageFlow* flow) {
@@ -43,9 +101,11 @@ void LocalizerFlow::attachToMessageFlow(message_flow::MessageFlow* flow) {
 void LocalizerFlow::processTrackedNFrameAndImu(
     const vio::SynchronizedNFrameImu::ConstPtr& nframe_imu) {
   CHECK(nframe_imu);
+  const int64_t received_time_ns = aslam::time::nanoSecondsSinceEpoch();
   // Throttle the localization rate.
   const int64_t current_timestamp =
       nframe_imu->nframe->getMinTimestampNanoseconds();
+  latest_received_timestamp_ns_ = current_timestamp;
   {
     std::unique_lock<std::mutex> lock(m_previous_nframe_timestamp_ns_);
     if ((previous_nframe_timestamp_ns_ != -1) &&
@@ -58,12 +118,90 @@ void LocalizerFlow::processTrackedNFrameAndImu(
     previous_nframe_timestamp_ns_ = current_timestamp;
   }
 
-  // Localize this nframe.
+  if (!latest_frame_wins_) {
+    // Localize this nframe.
+    localizeAndPublish(nframe_imu, received_time_ns);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_pending_nframe_);
+    if (pending_nframe_imu_) {
+      statistics::StatsCollector stat_superseded(
+          "LocalizerFlow: superseded nframes");
+      stat_superseded.IncrementOne();
+    }
+    pending_nframe_imu_ = nframe_imu;
+    pending_nframe_received_time_ns_ = received_time_ns;
+  }
+  cv_pending_nframe_.notify_one();
+}
+
+void LocalizerFlow::localizationWorker() {
+  while (true) {
+    vio::SynchronizedNFrameImu::ConstPtr nframe_imu;
+    int64_t received_time_ns;
+    {
+      std::unique_lock<std::mutex> lock(m_pending_nframe_);
+      cv_pending_nframe_.wait(lock, [this]() {
+        return shutdown_requested_ || pending_nframe_imu_ != nullptr;
+      });
+      if (shutdown_requested_) {
+        return;
+      }
+      nframe_imu.swap(pending_nframe_imu_);
+      received_time_ns = pending_nframe_received_time_ns_;
+    }
+    localizeAndPublish(nframe_imu, received_time_ns);
+  }
+}
+
+void LocalizerFlow::localizeAndPublish(
+    const vio::SynchronizedNFrameImu::ConstPtr& nframe_imu,
+    const int64_t received_time_ns) {
+  CHECK(nframe_imu);
   vio::LocalizationResult::Ptr loc_result(new vio::LocalizationResult);
   const bool success =
-      this->localizer_.localizeNFrame(nframe_imu->nframe, loc_result.get());
-  if (success) {
+      localizer_->localizeNFrame(nframe_imu->nframe, loc_result.get());
+
+  statistics::StatsCollector stat_latency("LocalizerFlow: latency in ms");
+  stat_latency.AddSample(
+      (aslam::time::nanoSecondsSinceEpoch() - received_time_ns) * 1e-6);
+  if (!success) {
+    return;
+  }
+
+  if (latest_frame_wins_) {
+    // The age is measured in sensor time, such that it is independent of the
+    // playback speed.
+    const int64_t timestamp_ns =
+        nframe_imu->nframe->getMinTimestampNanoseconds();
+    const int64_t deadline_ns = timestamp_ns + max_result_age_ns_;
+    const int64_t latest_received_timestamp_ns =
+        latest_received_timestamp_ns_.load();
+    statistics::StatsCollector stat_age("LocalizerFlow: result age in s");
+    stat_age.AddSample(
+        aslam::time::nanoSecondsToSeconds(
+            latest_received_timestamp_ns - timestamp_ns));
+    if (latest_received_timestamp_ns > deadline_ns) {
+      statistics::StatsCollector stat_stale(
+          "LocalizerFlow: discarded stale results");
+      stat_stale.IncrementOne();
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_latest_published_timestamp_ns_);
+    if (timestamp_ns <= latest_published_timestamp_ns_) {
+      statistics::StatsCollector stat_out_of_order(
+          "LocalizerFlow: discarded out of order results");
+      stat_out_of_order.IncrementOne();
+      return;
+    }
+    latest_published_timestamp_ns_ = timestamp_ns;
     publish_localization_result_(loc_result);
+    return;
   }
+
+  publish_localization_result_(loc_result);
 }
 }  // namespace rovioli
@@ -18,8 +18,9 @@ namespace rovioli {
 Localizer::Localizer(
     const summary_map::LocalizationSummaryMap& localization_summary_map,
     const bool visualize_localization)
-    : localization_summary_map_(localization_summary_map),
-      map_cached_lookup_(localization_summary_map) {
+    : localization_summary_map_(&localization_summary_map),
+      map_cached_lookup_(
+          new summary_map::SummaryMapCachedLookups(localization_summary_map)) {
   current_localization_mode_ = Localizer::LocalizationMode::kGlobal;
 
   global_loop_detector_.reset(new loop_detector_node::LoopDetectorNode);
@@ -31,10 +32,23 @@ Localizer::Localizer(
 
   LOG(INFO) << "Building localization database...";
   global_loop_detector_->addLocalizationSummaryMapToDatabase(
-      localization_summary_map_);
+      *localization_summary_map_);
   LOG(INFO) << "Done.";
 }
 
+Localizer::Localizer(
+    const summary_map::TiledLocalizationSummaryMap& tiled_localization_map,
+    const bool visualize_localization)
+    : localization_summary_map_(nullptr) {
+  current_localization_mode_ = Localizer::LocalizationMode::kGlobal;
+
+  LOG(INFO) << "Localizing against a tiled summary map with "
+            << tiled_localization_map.numTiles() << " tiles of "
+            << tiled_localization_map.tileSizeMeters() << " m.";
+  tile_cache_.reset(new loop_detector_node::SummaryMapTileCache(
+      tiled_localization_map, visualize_localization));
+}
+
 Localizer::LocalizationMode Localizer::getCurrentLocalizationMode() const {
   return current_localization_mode_;
 }
@@ -48,7 +62,11 @@ bool Localizer::localizeNFrame(
   bool result = false;
   switch (current_localization_mode_) {
     case Localizer::LocalizationMode::kGlobal:
-      result = localizeNFrameGlobal(nframe, localization_result);
+      if (tile_cache_ != nullptr) {
+        result = localizeNFrameInTiles(nframe, localization_result);
+      } else {
+        result = localizeNFrameGlobal(nframe, localization_result);
+      }
       break;
     case Localizer::LocalizationMode::kMapTracking:
       result = localizeNFrameMapTracking(nframe, localization_result);
@@ -58,7 +76,9 @@ bool Localizer::localizeNFrame(
       break;
   }
 
-  localization_result->summary_map_id = localization_summary_map_.id();
+  if (localization_summary_map_ != nullptr) {
+    localization_result->summary_map_id = localization_summary_map_->id();
+  }
   localization_result->timestamp_ns = nframe->getMinTimestampNanoseconds();
   localization_result->nframe_id = nframe->getId();
   localization_result->localization_mode = current_localization_mode_;
@@ -74,7 +94,7 @@ bool Localizer::localizeNFrameGlobal(
   unsigned int num_lc_matches;
   vi_map::VertexKeyPointToStructureMatchList inlier_structure_matches;
   const bool success = global_loop_detector_->findNFrameInSummaryMapDatabase(
-      *nframe, kSkipUntrackedKeypoints, localization_summary_map_,
+      *nframe, kSkipUntrackedKeypoints, *localization_summary_map_,
       &localization_result->T_G_B, &num_lc_matches, &inlier_structure_matches);
 
   if (!success || inlier_structure_matches.empty()) {
@@ -86,12 +106,43 @@ bool Localizer::localizeNFrameGlobal(
   // rays of all observations of the landmark will be used as a score.
   if (FLAGS_rovioli_max_num_localization_constraints > 0) {
     subselectStructureMatches(
-        localization_summary_map_, map_cached_lookup_, *nframe,
+        *localization_summary_map_, *map_cached_lookup_, *nframe,
+        FLAGS_rovioli_max_num_localization_constraints,
+        &inlier_structure_matches);
+  }
+  convertVertexKeyPointToStructureMatchListToLocalizationResult(
+      *localization_summary_map_, *nframe, inlier_structure_matches,
+      localization_result);
+
+  return true;
+}
+
+bool Localizer::localizeNFrameInTiles(
+    const aslam::VisualNFrame::ConstPtr& nframe,
+    vio::LocalizationResult* localization_result) const {
+  CHECK_NOTNULL(localization_result);
+  CHECK(tile_cache_);
+
+  constexpr bool kSkipUntrackedKeypoints = false;
+  vi_map::VertexKeyPointToStructureMatchList inlier_structure_matches;
+  pose::Transformation T_G_B;
+  const loop_detector_node::SummaryMapTileCache::ResidentTile::ConstPtr tile =
+      tile_cache_->findNFrameInTiles(
+          *nframe, kSkipUntrackedKeypoints, &T_G_B, &inlier_structure_matches);
+  if (tile == nullptr) {
+    return false;
+  }
+  localization_result->T_G_B = T_G_B;
+  localization_result->summary_map_id = tile->summary_map->id();
+
+  if (FLAGS_rovioli_max_num_localization_constraints > 0) {
+    subselectStructureMatches(
+        *tile->summary_map, *tile->cached_lookups, *nframe,
         FLAGS_rovioli_max_num_localization_constraints,
         &inlier_structure_matches);
   }
   convertVertexKeyPointToStructureMatchListToLocalizationResult(
-      localization_summary_map_, *nframe, inlier_structure_matches,
+      *tile->summary_map, *nframe, inlier_structure_matches,
       localization_result);
 
   return true;
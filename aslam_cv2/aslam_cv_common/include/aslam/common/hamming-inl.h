@@ -82,6 +82,29 @@ __inline__ uint32_t Hamming::NEONPopcntofXORed(const uint8x16_t* signature1,
   }
   return result;
 }
+
+__inline__ void Hamming::NEONPopcntofXORedBatch(
+    const uint8x16_t* query, const uint8x16_t* candidates,
+    const int numberOf128BitWords, const int* candidateIndices,
+    const int numCandidates, int* distances) {
+  // The per-byte counters of the accumulator must not overflow.
+  DCHECK_LE(numberOf128BitWords, 31);
+
+  for (int i = 0; i < numCandidates; ++i) {
+    const uint8x16_t* candidate = candidates +
+        (candidateIndices == nullptr ? i : candidateIndices[i]) *
+            numberOf128BitWords;
+    uint8x16_t accumulator = vdupq_n_u8(0);
+    for (int j = 0; j < numberOf128BitWords; ++j) {
+      accumulator = vaddq_u8(
+          accumulator, vcntq_u8(veorq_u8(query[j], candidate[j])));
+    }
+    const uint64x2_t sums =
+        vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(accumulator)));
+    distances[i] =
+        static_cast<int>(vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1));
+  }
+}
 #else
 // - SSSE3 - better alorithm, minimized psadbw usage -
 // adapted from http://wm.ite.pl/articles/sse-popcount.html
@@ -135,6 +158,43 @@ const int numberOf128BitWords) {
   result = _mm_cvtsi128_si32(xmm0);
   return result;
 }
+
+// Same nibble lookup as above, but the lookup tables stay in registers for
+// all candidates.
+__inline__ void Hamming::SSSE3PopcntofXORedBatch(
+    const __m128i* query, const __m128i* candidates,
+    const int numberOf128BitWords, const int* candidateIndices,
+    const int numCandidates, int* distances) {
+  // The per-byte counters of the accumulator must not overflow.
+  DCHECK_LE(numberOf128BitWords, 31);
+
+  const __m128i popcount_4bit =
+      _mm_load_si128(reinterpret_cast<const __m128i*>(POPCOUNT_4bit));
+  const __m128i mask_4bit =
+      _mm_load_si128(reinterpret_cast<const __m128i*>(MASK_4bit));
+  const __m128i zero = _mm_setzero_si128();
+
+  for (int i = 0; i < numCandidates; ++i) {
+    const __m128i* candidate = candidates +
+        (candidateIndices == nullptr ? i : candidateIndices[i]) *
+            numberOf128BitWords;
+    __m128i accumulator = zero;
+    for (int j = 0; j < numberOf128BitWords; ++j) {
+      const __m128i xored = _mm_xor_si128(
+          _mm_load_si128(query + j), _mm_load_si128(candidate + j));
+      const __m128i lower_nibbles = _mm_and_si128(xored, mask_4bit);
+      const __m128i higher_nibbles =
+          _mm_and_si128(_mm_srli_epi16(xored, 4), mask_4bit);
+      accumulator = _mm_add_epi8(
+          accumulator, _mm_shuffle_epi8(popcount_4bit, lower_nibbles));
+      accumulator = _mm_add_epi8(
+          accumulator, _mm_shuffle_epi8(popcount_4bit, higher_nibbles));
+    }
+    // Sum up the bytes into two 64 bit counters.
+    const __m128i sums = _mm_sad_epu8(accumulator, zero);
+    distances[i] = _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+  }
+}
 #endif  // __ARM_NEON
 
 }  // namespace common
@@ -41,6 +41,10 @@
 #ifndef ASLAM_COMMON_HAMMING_H_
 #define ASLAM_COMMON_HAMMING_H_
 
+#include <cstdint>
+
+#include <glog/logging.h>
+
 #ifdef __ARM_NEON
 #include <arm_neon.h>
 #else
@@ -72,6 +76,10 @@ class  Hamming {
                                            const int numberOf128BitWords) {
     return NEONPopcntofXORed(signature1, signature2, numberOf128BitWords);
   }
+  static __inline__ void NEONPopcntofXORedBatch(
+      const uint8x16_t* query, const uint8x16_t* candidates,
+      const int numberOf128BitWords, const int* candidateIndices,
+      const int numCandidates, int* distances);
 #else
   static __inline__ uint32_t SSSE3PopcntofXORed(const __m128i* signature1,
                                                 const __m128i* signature2,
@@ -88,6 +96,10 @@ class  Hamming {
                               reinterpret_cast<const __m128i*>(signature2),
                               numberOf128BitWords);
   }
+  static __inline__ void SSSE3PopcntofXORedBatch(
+      const __m128i* query, const __m128i* candidates,
+      const int numberOf128BitWords, const int* candidateIndices,
+      const int numCandidates, int* distances);
 #endif  // __ARM_NEON
 
   typedef unsigned char ValueType;
@@ -110,6 +122,40 @@ class  Hamming {
 #endif  // __ARM_NEON
   }
 
+  // Computes the distances of the query to num_candidates descriptors that
+  // are stored contiguously in candidates. The descriptor size must be a
+  // multiple of 16 bytes and all descriptors must be 16 byte aligned.
+  static void evaluateBatch(const unsigned char* query,
+                            const unsigned char* candidates,
+                            const int size,
+                            const int num_candidates,
+                            ResultType* distances) {
+    evaluateBatch(query, candidates, size, nullptr, num_candidates,
+                  distances);
+  }
+
+  // Same as above, but only for the descriptors at candidate_indices, such
+  // that a sparse subset doesn't need to be copied. A null candidate_indices
+  // selects the first num_candidates descriptors.
+  static void evaluateBatch(const unsigned char* query,
+                            const unsigned char* candidates,
+                            const int size,
+                            const int* candidate_indices,
+                            const int num_candidates,
+                            ResultType* distances) {
+#ifdef __ARM_NEON
+    NEONPopcntofXORedBatch(reinterpret_cast<const uint8x16_t*>(query),
+                           reinterpret_cast<const uint8x16_t*>(candidates),
+                           size / 16, candidate_indices, num_candidates,
+                           distances);
+#else
+    SSSE3PopcntofXORedBatch(reinterpret_cast<const __m128i*>(query),
+                            reinterpret_cast<const __m128i*>(candidates),
+                            size / 16, candidate_indices, num_candidates,
+                            distances);
+#endif  // __ARM_NEON
+  }
+
   // This will count the bits in a ^ b.
   inline ResultType operator()(const unsigned char* a,
                                const unsigned char* b,
@@ -25,6 +25,7 @@
 //   3. This notice may not be removed or altered from any source
 //   distribution.
 #include <condition_variable>
+#include <deque>
 #include <future>
 #include <functional>
 #include <limits>
@@ -86,30 +87,54 @@ class ThreadPool {
   // This version is not threadsafe.
   size_t numQueuedTasksImpl() const;
 
+  // Adds a type-erased task to the queue of its group.
+  void enqueueTask(const size_t exclusivity_group_id,
+                   std::function<void()>&& function);
+
   /// \brief Run a single thread.
   void run();
   /// Need to keep track of threads so we can join them.
   std::vector<std::thread> workers_;
 
+  // Every task is tagged with the order in which it was enqueued, such that
+  // the oldest runnable task can be selected in constant time.
+  struct Task {
+    size_t sequence_number;
+    std::function<void()> function;
+  };
+  typedef std::deque<Task> TaskQueue;
+
   // The group id is a size_t where the number kGroupdIdNonExclusiveTask
   // represents a non-exclusive task that needs no guarantees on its execution
   // order. All tasks with other group ids have guaranteed execution order that
-  // corresponds to order of enqueing the task.
-  typedef std::deque<std::pair<size_t, std::function<void()>>> TaskDeque;
-  TaskDeque groupid_tasks_;
-  // The guard map should never contain negative group ids.
-  typedef std::unordered_map<size_t, bool> GuardMap;
-  GuardMap groupid_exclusivity_guards_;
-  // Count the number of non-exclusive tasks in groupid_tasks_;
-  // where groupid == kGroupdIdNonExclusiveTask.
-  size_t num_queued_nonexclusive_tasks = 0u;
+  // corresponds to order of enqueing the task. Therefore every group has its
+  // own FIFO queue and at most one of its tasks is executed at a time.
+  struct ExclusivityGroup {
+    TaskQueue tasks;
+    // True while a thread is executing a task of this group.
+    bool is_active = false;
+  };
+  // Like the exclusivity guards, groups are kept once created, such that
+  // groups that are used repeatedly don't need to be reallocated.
+  typedef std::unordered_map<size_t, ExclusivityGroup> GroupMap;
+  GroupMap exclusivity_groups_;
+  // Ids of all groups that have queued tasks but are not active, in the order
+  // they became ready.
+  std::deque<size_t> ready_group_ids_;
+  // Tasks with groupid == kGroupdIdNonExclusiveTask.
+  TaskQueue nonexclusive_tasks_;
+
+  size_t num_queued_tasks_;
+  size_t next_sequence_number_;
 
   // A mutex to protect the list of tasks of the group list.
   mutable std::mutex tasks_mutex_;
 
-  // A condition variable that signals a change in the task queue; either a
-  // removed or inserted element.
+  // A condition variable that signals that a task became available for
+  // processing.
   mutable std::condition_variable tasks_queue_change_;
+  // A condition variable that signals that a task has been completed.
+  mutable std::condition_variable task_completed_;
 
   // A counter of active threads
   unsigned active_threads_;
@@ -141,19 +166,7 @@ ThreadPool::enqueueOrdered(const size_t exclusivity_group_id,
       std::bind(function, std::forward<Args>(args)...));
 
   std::future<return_type> res = task->get_future();
-  {
-    std::unique_lock<std::mutex> lock(tasks_mutex_);
-    groupid_tasks_.emplace_back(exclusivity_group_id, [task](){ (*task)();});
-
-    // Initialize a group id exclusivity guard.
-    if (exclusivity_group_id == kGroupdIdNonExclusiveTask) {
-      ++num_queued_nonexclusive_tasks;
-    } else if (groupid_exclusivity_guards_.count(
-        exclusivity_group_id) == 0u) {
-      groupid_exclusivity_guards_.emplace(exclusivity_group_id, false);
-    }
-  }
-  tasks_queue_change_.notify_one();
+  enqueueTask(exclusivity_group_id, [task](){ (*task)();});
   return res;
 }
 
@@ -1,12 +1,12 @@
-#include <algorithm>
-
 #include <aslam/common/thread-pool.h>
 
 namespace aslam {
 
 // The constructor just launches some amount of workers.
 ThreadPool::ThreadPool(const size_t threads)
-    : active_threads_(0),
+    : num_queued_tasks_(0u),
+      next_sequence_number_(0u),
+      active_threads_(0),
       stop_(false) {
   for (size_t i = 0; i < threads; ++i)
     workers_.emplace_back(std::bind(&ThreadPool::run, this));
@@ -24,100 +24,104 @@ ThreadPool::~ThreadPool() {
   }
 }
 
+void ThreadPool::enqueueTask(const size_t exclusivity_group_id,
+                             std::function<void()>&& function) {
+  {
+    std::unique_lock<std::mutex> lock(tasks_mutex_);
+    Task task{next_sequence_number_++, std::move(function)};
+    if (exclusivity_group_id == kGroupdIdNonExclusiveTask) {
+      nonexclusive_tasks_.emplace_back(std::move(task));
+    } else {
+      ExclusivityGroup& group = exclusivity_groups_[exclusivity_group_id];
+      group.tasks.emplace_back(std::move(task));
+      // A group that is already active or ready is rescheduled once its
+      // current task completes.
+      if (!group.is_active && group.tasks.size() == 1u) {
+        ready_group_ids_.emplace_back(exclusivity_group_id);
+      }
+    }
+    ++num_queued_tasks_;
+  }
+  tasks_queue_change_.notify_one();
+}
+
 void ThreadPool::run() {
   while (true) {
     std::unique_lock<std::mutex> lock(this->tasks_mutex_);
 
-    // Here we need to select the next task from a queue that is not already
-    // serviced.
-    std::function<void()> task;
-    size_t group_id = kGroupdIdNonExclusiveTask;
-    while (true) {
-      const bool all_guards_active = std::all_of(
-          groupid_exclusivity_guards_.begin(),
-          groupid_exclusivity_guards_.end(),
-          [](const GuardMap::value_type& value) {
-            CHECK_NE(value.second, kGroupdIdNonExclusiveTask)
-              << "There should never be a guard for a non-exclusive task.";
-            return value.second;
-          });
-
-      if (!all_guards_active || num_queued_nonexclusive_tasks > 0u) {
-        // If not all guards are active, we select a task to process; otherwise
-        // we can go back to sleep until a thread reports back for work.
-        size_t index = 0u;
-        for (const TaskDeque::value_type& groupid_task : groupid_tasks_) {
-          // We have found a task to process if no thread is already working on
-          // this group id.
-          const bool is_exclusive_task =
-              groupid_task.first != kGroupdIdNonExclusiveTask;
-          bool guard_active = false;
-          if (is_exclusive_task) {
-            guard_active = groupid_exclusivity_guards_[groupid_task.first];
-          }
-
-          if (!(is_exclusive_task && guard_active)) {
-            group_id = groupid_task.first;
-            task = groupid_task.second;
-
-            groupid_tasks_.erase(groupid_tasks_.begin() + index);
-            if (!is_exclusive_task) {
-              --num_queued_nonexclusive_tasks;
-            }
-
-            // We jump out of the nested for-structure here, because we have
-            // found a task to process.
-            break;
-          }
-          ++index;
-        }
-      }
-      if (task) {
-        break;
-      }
-
-      // Wait until the queue has changed (addition/removal) before re-checking
-      // for new tasks to process.
-      if (this->stop_ && groupid_tasks_.size() == 0u) {
+    // Wait until there is a task that can be processed, i.e. a non-exclusive
+    // task or a task of a group that no other thread is working on.
+    while (nonexclusive_tasks_.empty() && ready_group_ids_.empty()) {
+      if (this->stop_ && num_queued_tasks_ == 0u) {
         return;
       }
-
       this->tasks_queue_change_.wait(lock);
     }
 
-    // We jump here if we found a task.
-    CHECK(task);
-    ++active_threads_;
+    // Select the oldest of the next non-exclusive task and the next task of
+    // the longest waiting ready group.
+    ExclusivityGroup* group = nullptr;
+    if (!ready_group_ids_.empty()) {
+      const GroupMap::iterator it_group =
+          exclusivity_groups_.find(ready_group_ids_.front());
+      CHECK(it_group != exclusivity_groups_.end());
+      CHECK(!it_group->second.is_active);
+      CHECK(!it_group->second.tasks.empty());
+      if (nonexclusive_tasks_.empty() ||
+          it_group->second.tasks.front().sequence_number <
+              nonexclusive_tasks_.front().sequence_number) {
+        group = &it_group->second;
+      }
+    }
 
-    // Make sure the no other thread is currently working on this exclusivity
-    // group.
-    if (group_id != kGroupdIdNonExclusiveTask) {
-      const GuardMap::iterator it_group_id_serviced =
-          groupid_exclusivity_guards_.find(group_id);
-      CHECK(it_group_id_serviced == groupid_exclusivity_guards_.end() ||
-            it_group_id_serviced->second == false);
-      it_group_id_serviced->second = true;
+    std::function<void()> task;
+    size_t group_id = kGroupdIdNonExclusiveTask;
+    if (group != nullptr) {
+      group_id = ready_group_ids_.front();
+      ready_group_ids_.pop_front();
+      // Make sure no other thread works on this exclusivity group until this
+      // task is completed.
+      group->is_active = true;
+      task = std::move(group->tasks.front().function);
+      group->tasks.pop_front();
+    } else {
+      task = std::move(nonexclusive_tasks_.front().function);
+      nonexclusive_tasks_.pop_front();
     }
+    CHECK(task);
+    --num_queued_tasks_;
+    ++active_threads_;
 
     // Unlock the queue while we execute the task.
     lock.unlock();
     task();
     lock.lock();
 
-    // Release the group for other threads.
-    if (group_id != kGroupdIdNonExclusiveTask) {
-      const GuardMap::iterator it_group_id_servied =
-          groupid_exclusivity_guards_.find(group_id);
-      CHECK(it_group_id_servied != groupid_exclusivity_guards_.end() &&
-            it_group_id_servied->second == true);
-      it_group_id_servied->second = false;
+    // Release the group for other threads. The pointer to the group is still
+    // valid since groups are never removed.
+    bool group_became_ready = false;
+    if (group != nullptr) {
+      CHECK(group->is_active);
+      group->is_active = false;
+      if (!group->tasks.empty()) {
+        ready_group_ids_.emplace_back(group_id);
+        group_became_ready = true;
+      }
     }
 
     --active_threads_;
+    // Idle threads of a stopped pool need to be woken up to terminate.
+    const bool wake_up_all_threads = stop_ && num_queued_tasks_ == 0u;
+    lock.unlock();
 
     // This is the secret to making the waitForEmptyQueue() function work.
     // After finishing a task, notify that this work is done.
-    tasks_queue_change_.notify_all();
+    task_completed_.notify_all();
+    if (wake_up_all_threads) {
+      tasks_queue_change_.notify_all();
+    } else if (group_became_ready) {
+      tasks_queue_change_.notify_one();
+    }
   }
 }
 
@@ -126,12 +130,21 @@ size_t ThreadPool::numActiveThreads() const {
   return active_threads_;
 }
 
+size_t ThreadPool::numQueuedTasks() const {
+  std::unique_lock<std::mutex> lock(this->tasks_mutex_);
+  return numQueuedTasksImpl();
+}
+
+size_t ThreadPool::numQueuedTasksImpl() const {
+  return num_queued_tasks_;
+}
+
 void ThreadPool::waitForEmptyQueue() const {
   std::unique_lock<std::mutex> lock(this->tasks_mutex_);
   // Only exit if all tasks are complete by tracking the number of
   // active threads.
-  while (active_threads_ > 0u || groupid_tasks_.size() > 0u) {
-    this->tasks_queue_change_.wait(lock);
+  while (active_threads_ > 0u || numQueuedTasksImpl() > 0u) {
+    this->task_completed_.wait(lock);
   }
 }
 }  // namespace aslam
@@ -177,6 +177,54 @@ TEST(ViwlsGraph, DescriptorClosestToMedianTestThreeDescriptors) {
   EXPECT_EQ(2u, closest_to_median_descriptor_index);
 }
 
+TEST(ViwlsGraph, HammingBatchEqualsPairwiseDistance) {
+  constexpr int kDescriptorSizeBytes = 64;
+  constexpr int kNumCandidates = 37;
+  DescriptorType query(kDescriptorSizeBytes, 1);
+  query.setRandom();
+  DescriptorsType candidates(kDescriptorSizeBytes, kNumCandidates);
+  candidates.setRandom();
+  candidates.col(0) = query;
+
+  std::vector<Hamming::ResultType> distances(kNumCandidates, -1);
+  Hamming::evaluateBatch(
+      query.data(), candidates.data(), kDescriptorSizeBytes, kNumCandidates,
+      distances.data());
+
+  Hamming hamming;
+  EXPECT_EQ(0, distances[0]);
+  for (int i = 0; i < kNumCandidates; ++i) {
+    EXPECT_EQ(
+        hamming(query.data(), candidates.col(i).data(), kDescriptorSizeBytes),
+        distances[i]);
+  }
+}
+
+TEST(ViwlsGraph, HammingBatchOfIndexedCandidates) {
+  constexpr int kDescriptorSizeBytes = 48;
+  constexpr int kNumDescriptors = 20;
+  DescriptorType query(kDescriptorSizeBytes, 1);
+  query.setRandom();
+  DescriptorsType descriptors(kDescriptorSizeBytes, kNumDescriptors);
+  descriptors.setRandom();
+
+  const std::vector<int> candidate_indices = {17, 2, 3, 11, 0};
+  const int num_candidates = static_cast<int>(candidate_indices.size());
+  std::vector<Hamming::ResultType> distances(num_candidates, -1);
+  Hamming::evaluateBatch(
+      query.data(), descriptors.data(), kDescriptorSizeBytes,
+      candidate_indices.data(), num_candidates, distances.data());
+
+  Hamming hamming;
+  for (int i = 0; i < num_candidates; ++i) {
+    EXPECT_EQ(
+        hamming(
+            query.data(), descriptors.col(candidate_indices[i]).data(),
+            kDescriptorSizeBytes),
+        distances[i]);
+  }
+}
+
 }  // namespace descriptor_utils
 }  // namespace common
 }  // namespace aslam
@@ -1,3 +1,8 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include <aslam/common/entrypoint.h>
@@ -81,4 +86,95 @@ TEST(ThreadPoolTests, ExecutionOrdering) {
   }
 }
 
+TEST(ThreadPoolTests, GroupExclusivityWithMixedTasks) {
+  constexpr size_t kNumThreads = 8u;
+  aslam::ThreadPool pool(kNumThreads);
+
+  constexpr size_t kNumGroups = 5u;
+  constexpr size_t kNumTasksPerGroup = 200u;
+  std::vector<std::atomic<int>> num_active_per_group(kNumGroups);
+  std::vector<std::vector<size_t>> receive_queues(kNumGroups);
+  std::atomic<int> num_exclusivity_violations(0);
+  std::atomic<size_t> num_nonexclusive_tasks_executed(0u);
+
+  auto exclusive_task = [&](size_t group_id, size_t value) {
+    if (++num_active_per_group[group_id] != 1) {
+      ++num_exclusivity_violations;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(rand() % 10));
+    receive_queues[group_id].emplace_back(value);
+    --num_active_per_group[group_id];
+  };
+  auto nonexclusive_task = [&]() { ++num_nonexclusive_tasks_executed; };
+
+  for (size_t number = 0u; number < kNumTasksPerGroup; ++number) {
+    for (size_t group_id = 0u; group_id < kNumGroups; ++group_id) {
+      pool.enqueueOrdered(group_id, exclusive_task, group_id, number);
+      pool.enqueue(nonexclusive_task);
+    }
+  }
+  pool.waitForEmptyQueue();
+
+  EXPECT_EQ(pool.numQueuedTasks(), 0u);
+  EXPECT_EQ(pool.numActiveThreads(), 0u);
+  EXPECT_EQ(num_exclusivity_violations, 0);
+  EXPECT_EQ(num_nonexclusive_tasks_executed, kNumGroups * kNumTasksPerGroup);
+  for (size_t group_id = 0u; group_id < kNumGroups; ++group_id) {
+    const std::vector<size_t>& receive_queue = receive_queues[group_id];
+    ASSERT_EQ(receive_queue.size(), kNumTasksPerGroup);
+    for (size_t number = 0u; number < kNumTasksPerGroup; ++number) {
+      EXPECT_EQ(receive_queue[number], number);
+    }
+  }
+}
+
+// Many exclusivity groups that each receive a burst of short tasks, which
+// resembles many message flow subscribers that each receive a burst of
+// messages. Picking a task must not degrade with the number of queued tasks
+// that belong to groups which are already being serviced.
+TEST(ThreadPoolTests, ManyGroupsContentionBenchmark) {
+  constexpr size_t kNumThreads = 8u;
+  constexpr size_t kNumGroups = 200u;
+  constexpr size_t kNumTasksPerGroup = 250u;
+
+  std::vector<size_t> last_value_per_group(kNumGroups, 0u);
+  std::atomic<size_t> num_order_violations(0u);
+  auto task = [&](size_t group_id, size_t value) {
+    // Only a single thread ever works on a group, no locking required.
+    if (value != last_value_per_group[group_id] + 1u) {
+      ++num_order_violations;
+    }
+    last_value_per_group[group_id] = value;
+  };
+
+  aslam::ThreadPool pool(kNumThreads);
+  // Block all threads until the whole burst is queued.
+  std::promise<void> start_promise;
+  std::shared_future<void> start_future = start_promise.get_future().share();
+  for (size_t thread_idx = 0u; thread_idx < kNumThreads; ++thread_idx) {
+    pool.enqueue([start_future]() { start_future.wait(); });
+  }
+  for (size_t group_id = 0u; group_id < kNumGroups; ++group_id) {
+    for (size_t value = 1u; value <= kNumTasksPerGroup; ++value) {
+      pool.enqueueOrdered(group_id, task, group_id, value);
+    }
+  }
+
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  start_promise.set_value();
+  pool.waitForEmptyQueue();
+  const double duration_s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  EXPECT_EQ(num_order_violations, 0u);
+  for (size_t group_id = 0u; group_id < kNumGroups; ++group_id) {
+    EXPECT_EQ(last_value_per_group[group_id], kNumTasksPerGroup);
+  }
+  const size_t kNumTasks = kNumGroups * kNumTasksPerGroup;
+  LOG(INFO) << "Processed " << kNumTasks << " tasks of " << kNumGroups
+            << " exclusivity groups with " << kNumThreads << " threads in "
+            << duration_s << "s (" << kNumTasks / duration_s << " tasks/s).";
+}
+
 ASLAM_UNITTEST_ENTRYPOINT
@@ -396,6 +396,11 @@ class VisualFrame  {
 
   void discardUntrackedObservations(std::vector<size_t>* discarded_indices);
 
+  /// Removes the keypoints with the given (ascending) indices from all keypoint
+  /// channels, including all descriptor blocks. The descriptor types are kept,
+  /// even if a block becomes empty.
+  void discardKeypoints(const std::vector<size_t>& ordered_discarded_indices);
+
   /* Additional functions for dealing with multiple different types of
      feature in the same channel, including different descriptor sizes */
 
@@ -422,6 +427,9 @@ class VisualFrame  {
       const Eigen::VectorXi& offsets_new, int default_value = -1);
   template <typename Derived>
   void extendDescriptors(const Derived& descriptors_new, int descriptor_type = 0);
+  /// Moves the descriptors into the new block instead of copying them.
+  void extendDescriptors(
+      DescriptorsT&& descriptors_new, int descriptor_type = 0);
   void extendTrackIds(const Eigen::VectorXi& track_ids_new, int default_value = -1);
 
   // Will serialize the multi-descriptor blocks into a single string
@@ -502,6 +510,10 @@ class VisualFrame  {
   int getTrackIdOfType(size_t index, int descriptor_type) const;
 
  private:
+  /// Appends the type of a new descriptor block and returns the descriptor
+  /// blocks the new block needs to be appended to.
+  std::vector<DescriptorsT>* addDescriptorBlockType(int descriptor_type);
+
   /// Timestamp in nanoseconds.
   int64_t timestamp_nanoseconds_;
 
@@ -1,5 +1,6 @@
 #include "aslam/frames/visual-frame.h"
 
+#include <algorithm>
 #include <memory>
 #include <aslam/common/channel-definitions.h>
 #include <aslam/common/stl-helpers.h>
@@ -581,39 +582,100 @@ void VisualFrame::discardUntrackedObservations(
       discarded_indices->emplace_back(i);
     }
   }
-  if (discarded_indices->empty()) {
+  discardKeypoints(*discarded_indices);
+}
+
+namespace {
+// Same as eraseIndicesFromContainer(), but also handles the removal of all
+// elements, which otherwise produces a warning.
+template <typename ContainerType>
+void eraseKeypointIndices(
+    const std::vector<size_t>& ordered_indices, const size_t original_count,
+    ContainerType* container) {
+  CHECK_NOTNULL(container);
+  if (ordered_indices.empty()) {
     return;
   }
+  if (ordered_indices.size() == original_count) {
+    common::stl_helpers::internal::resizeDynamicDimensionLike(
+        0, *container, container);
+    return;
+  }
+  common::stl_helpers::eraseIndicesFromContainer(
+      ordered_indices, original_count, container);
+}
+}  // namespace
 
-  if (hasKeypointMeasurements()) {
-    common::stl_helpers::eraseIndicesFromContainer(
-        *discarded_indices, original_count, getKeypointMeasurementsMutable());
+void VisualFrame::discardKeypoints(
+    const std::vector<size_t>& ordered_discarded_indices) {
+  if (ordered_discarded_indices.empty()) {
+    return;
   }
+  CHECK(hasKeypointMeasurements());
+  const size_t original_count = getNumKeypointMeasurements();
+  CHECK(std::is_sorted(
+      ordered_discarded_indices.begin(), ordered_discarded_indices.end()));
+  CHECK_LT(ordered_discarded_indices.back(), original_count);
+
+  eraseKeypointIndices(
+      ordered_discarded_indices, original_count,
+      getKeypointMeasurementsMutable());
   if (hasKeypointMeasurementUncertainties()) {
-    common::stl_helpers::eraseIndicesFromContainer(
-        *discarded_indices, original_count,
+    eraseKeypointIndices(
+        ordered_discarded_indices, original_count,
         getKeypointMeasurementUncertaintiesMutable());
   }
   if (hasKeypointOrientations()) {
-    common::stl_helpers::eraseIndicesFromContainer(
-        *discarded_indices, original_count, getKeypointOrientationsMutable());
+    eraseKeypointIndices(
+        ordered_discarded_indices, original_count,
+        getKeypointOrientationsMutable());
   }
   if (hasKeypointScores()) {
-    common::stl_helpers::eraseIndicesFromContainer(
-        *discarded_indices, original_count, getKeypointScoresMutable());
+    eraseKeypointIndices(
+        ordered_discarded_indices, original_count, getKeypointScoresMutable());
   }
   if (hasKeypointScales()) {
-    common::stl_helpers::eraseIndicesFromContainer(
-        *discarded_indices, original_count, getKeypointScalesMutable());
+    eraseKeypointIndices(
+        ordered_discarded_indices, original_count, getKeypointScalesMutable());
+  }
+  if (hasKeypoint3DPositions()) {
+    eraseKeypointIndices(
+        ordered_discarded_indices, original_count,
+        getKeypoint3DPositionsMutable());
+  }
+  if (hasKeypointTimeOffsets()) {
+    eraseKeypointIndices(
+        ordered_discarded_indices, original_count,
+        getKeypointTimeOffsetsMutable());
+  }
+  if (hasTrackIds()) {
+    eraseKeypointIndices(
+        ordered_discarded_indices, original_count, getTrackIdsMutable());
   }
   if (hasDescriptors()) {
-    common::stl_helpers::OneDimensionAdapter<unsigned char,
-    common::stl_helpers::kColumns> adapter(getDescriptorsMutable());
-    common::stl_helpers::eraseIndicesFromContainer(
-        *discarded_indices, original_count, &adapter);
+    // The keypoints of the descriptor blocks are stored consecutively, hence
+    // the indices need to be split up and shifted into every block.
+    std::vector<DescriptorsT>& descriptors =
+        aslam::channels::get_DESCRIPTORS_Data(channels_);
+    std::vector<size_t>::const_iterator it = ordered_discarded_indices.begin();
+    size_t block_start = 0u;
+    for (DescriptorsT& block_descriptors : descriptors) {
+      const size_t block_size = static_cast<size_t>(block_descriptors.cols());
+      std::vector<size_t> block_indices;
+      while (it != ordered_discarded_indices.end() &&
+             *it < block_start + block_size) {
+        block_indices.emplace_back(*it - block_start);
+        ++it;
+      }
+      common::stl_helpers::OneDimensionAdapter<
+          unsigned char, common::stl_helpers::kColumns>
+          adapter(&block_descriptors);
+      eraseKeypointIndices(block_indices, block_size, &adapter);
+      block_start += block_size;
+    }
+    CHECK(it == ordered_discarded_indices.end())
+        << "The descriptor blocks cover fewer keypoints than the frame has.";
   }
-  common::stl_helpers::eraseIndicesFromContainer(
-      *discarded_indices, original_count, getTrackIdsMutable());
 }
 
 void VisualFrame::extendKeypointMeasurements(
@@ -730,9 +792,8 @@ void VisualFrame::extendKeypointTimeOffsets(
       &data, offsets_new, getNumKeypointMeasurements(), default_value);
 }
 
-template <typename Derived>
-void VisualFrame::extendDescriptors(
-    const Derived& descriptors_new, int descriptor_type) {
+std::vector<VisualFrame::DescriptorsT>* VisualFrame::addDescriptorBlockType(
+    int descriptor_type) {
   if (!aslam::channels::has_DESCRIPTORS_Channel(channels_)) {
     aslam::channels::add_DESCRIPTORS_Channel(&channels_);
     aslam::channels::add_DESCRIPTOR_TYPES_Channel(&channels_);
@@ -743,16 +804,28 @@ void VisualFrame::extendDescriptors(
       aslam::channels::get_DESCRIPTOR_TYPES_Data(channels_);
   CHECK_EQ(descriptors.size(), static_cast<size_t>(descriptor_types.size()));
 
-  descriptors.emplace_back(descriptors_new);
   const size_t num_descriptor_types = descriptor_types.size();
   descriptor_types.conservativeResize(num_descriptor_types + 1);
   descriptor_types(num_descriptor_types) = descriptor_type;
+  return &descriptors;
+}
+
+template <typename Derived>
+void VisualFrame::extendDescriptors(
+    const Derived& descriptors_new, int descriptor_type) {
+  addDescriptorBlockType(descriptor_type)->emplace_back(descriptors_new);
 }
 template void VisualFrame::extendDescriptors(
     const DescriptorsT& descriptors_new, int descriptor_type);
 template void VisualFrame::extendDescriptors(
     const Eigen::Map<const DescriptorsT>& descriptors_new, int descriptor_type);
 
+void VisualFrame::extendDescriptors(
+    DescriptorsT&& descriptors_new, int descriptor_type) {
+  addDescriptorBlockType(descriptor_type)
+      ->emplace_back(std::move(descriptors_new));
+}
+
 void VisualFrame::extendTrackIds(
     const Eigen::VectorXi& track_ids_new, int default_value) {
   if (!aslam::channels::has_TRACK_IDS_Channel(channels_)) {
@@ -88,6 +88,20 @@ TEST(Frame, SetGetDescriptors) {
     EXPECT_EQ(data_2, frame.getDescriptorsOfType(0));
     EXPECT_EQ(data_3, frame.getDescriptorsOfType(1));
   }
+
+  // Test extending by moving the descriptors.
+  aslam::VisualFrame::DescriptorsT data_moved(32, 5);
+  data_moved.setRandom();
+  const aslam::VisualFrame::DescriptorsT data_moved_copy = data_moved;
+  const unsigned char* data_moved_ptr = data_moved.data();
+  frame.extendDescriptors(std::move(data_moved), 2);
+  {
+    const aslam::VisualFrame::DescriptorsT& data_4 =
+        frame.getDescriptors(2);
+    EXPECT_TRUE(EIGEN_MATRIX_EQUAL(data_moved_copy, data_4));
+    EXPECT_EQ(data_moved_ptr, data_4.data());
+    EXPECT_EQ(data_4, frame.getDescriptorsOfType(2));
+  }
 }
 
 TEST(Frame, SetGetKeypointMeasurements) {
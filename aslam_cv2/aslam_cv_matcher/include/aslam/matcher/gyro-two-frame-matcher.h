@@ -2,10 +2,11 @@
 #define MATCHER_GYRO_TWO_FRAME_MATCHER_H_
 
 #include <algorithm>
+#include <unordered_map>
 #include <vector>
 
+#include <aslam/common/hamming.h>
 #include <aslam/common/pose-types.h>
-#include <aslam/common/feature-descriptor-ref.h>
 #include <aslam/frames/visual-frame.h>
 #include <Eigen/Core>
 #include <glog/logging.h>
@@ -23,6 +24,9 @@ namespace aslam {
 /// using an interframe rotation matrix. Then a rectangular search window around
 /// that location is searched for the best match greater than a threshold.
 /// If the initial search was not successful, the search window is increased once.
+/// The descriptors of frame (k+1) are stored sorted by their y coordinate, such
+/// that the rows of a search window form a contiguous block. The distances to
+/// the candidates of both windows are computed in a single vectorized pass.
 /// The initial matcher is allowed to discard a previous match if the new one
 /// has a higher score. The discarded matches are called inferior matches and
 /// a second matcher tries to match them. The second matcher only tries
@@ -100,6 +104,11 @@ class GyroTwoFrameMatcher {
   /// already existing match.
   void matchKeypoint(const int idx_k);
 
+  /// \brief Compute the distances of a keypoint of frame k to the candidates
+  /// in window_candidate_indices_. The result is stored in window_distances_
+  /// in the same order.
+  void computeDistancesToWindowCandidates(const int idx_k);
+
   void getKeypointIteratorsInWindow(
       const Eigen::Vector2d& predicted_keypoint_position,
       const int window_half_side_length_px,
@@ -144,6 +153,8 @@ class GyroTwoFrameMatcher {
   const std::vector<unsigned char>& prediction_success_;
   // Descriptor size in bytes.
   const size_t kDescriptorSizeBytes;
+  // Descriptor size in bytes padded to the width of the SIMD registers.
+  const size_t kPackedDescriptorSizeBytes;
   // Number of keypoints/descriptors in frame (k+1).
   const int kNumPointsKp1;
   // Number of keypoints/descriptors in frame k.
@@ -153,12 +164,18 @@ class GyroTwoFrameMatcher {
   // Matches with indices corresponding to the ordering of
   // the keypoint/descriptors in the respective channels.
   FrameToFrameMatches* const matches_kp1_k_;
-  // Descriptors of frame (k+1).
-  std::vector<common::FeatureDescriptorConstRef> descriptors_kp1_wrapped_;
-  // Descriptors of frame k.
-  std::vector<common::FeatureDescriptorConstRef> descriptors_k_wrapped_;
   // Keypoints of frame (k+1) sorted from small to large y coordinates.
   Aligned<std::vector, KeypointData> keypoints_kp1_sorted_by_y_;
+  // Descriptors of frame (k+1) in the order of keypoints_kp1_sorted_by_y_ and
+  // descriptors of frame k, both zero padded to kPackedDescriptorSizeBytes.
+  Eigen::Matrix<unsigned char, Eigen::Dynamic, Eigen::Dynamic>
+      packed_descriptors_kp1_sorted_by_y_;
+  Eigen::Matrix<unsigned char, Eigen::Dynamic, Eigen::Dynamic>
+      packed_descriptors_k_;
+  // Indices into keypoints_kp1_sorted_by_y_ of the keypoints inside the
+  // current search window and their distances.
+  std::vector<int> window_candidate_indices_;
+  std::vector<common::Hamming::ResultType> window_distances_;
   // corner_row_LUT[i] is the number of keypoints that has y position
   // lower than i in the image.
   std::vector<int> corner_row_LUT_;
@@ -168,9 +185,6 @@ class GyroTwoFrameMatcher {
   // the corresponding match iterator.
   std::unordered_map<int, MatchesIterator> kp1_idx_to_matches_iterator_map_;
   std::unordered_map<int, double> kp1_idx_to_matches_score_map_;
-  // Keep track of processed keypoints s.t. we don't process them again in the
-  // large window. Set every element to false for each keypoint (of frame k) iteration!
-  std::vector<bool> iteration_processed_keypoints_kp1_;
   // The queried keypoints in frame (k+1) and the corresponding
   // matching score are stored for each attempted match.
   // A map from the keypoint in frame k to the corresponding
@@ -1,6 +1,9 @@
 #include "aslam/matcher/gyro-two-frame-matcher.h"
 
+#include <unordered_set>
+
 #include <aslam/common/statistics/statistics.h>
+#include <aslam/common/timer.h>
 #include <glog/logging.h>
 
 DEFINE_int32(gyro_matcher_small_search_distance_px, 10,
@@ -11,6 +14,16 @@ DEFINE_int32(gyro_matcher_large_search_distance_px, 20,
 
 namespace aslam {
 
+namespace {
+// Width of the SIMD registers used to compute the Hamming distances.
+constexpr size_t kSimdWidthBytes = 16u;
+
+inline size_t padToSimdWidth(const size_t size_bytes) {
+  return (size_bytes + kSimdWidthBytes - 1u) / kSimdWidthBytes *
+      kSimdWidthBytes;
+}
+}  // namespace
+
 GyroTwoFrameMatcher::GyroTwoFrameMatcher(
     const Quaternion& q_Ckp1_Ck,
     const VisualFrame& frame_kp1,
@@ -25,12 +38,12 @@ GyroTwoFrameMatcher::GyroTwoFrameMatcher(
     predicted_keypoint_positions_kp1_(predicted_keypoint_positions_kp1),
     prediction_success_(prediction_success),
     kDescriptorSizeBytes(frame_kp1.getDescriptorTypeSizeBytes(descriptor_type)),
+    kPackedDescriptorSizeBytes(padToSimdWidth(kDescriptorSizeBytes)),
     kNumPointsKp1(frame_kp1.getNumKeypointMeasurementsOfType(descriptor_type)),
     kNumPointsK(frame_k.getNumKeypointMeasurementsOfType(descriptor_type)),
     kImageHeight(image_height),
     matches_kp1_k_(matches_kp1_k),
     is_keypoint_kp1_matched_(kNumPointsKp1, false),
-    iteration_processed_keypoints_kp1_(kNumPointsKp1, false),
     small_search_distance_px_(FLAGS_gyro_matcher_small_search_distance_px),
     large_search_distance_px_(FLAGS_gyro_matcher_large_search_distance_px) {
   CHECK(frame_kp1.isValid());
@@ -49,38 +62,26 @@ GyroTwoFrameMatcher::GyroTwoFrameMatcher(
       "is less or equal to 512 bits. Adapt the following check if this "
       "framework uses larger binary descriptors.";
   CHECK_GT(kImageHeight, 0u);
-  CHECK_EQ(static_cast<int>(iteration_processed_keypoints_kp1_.size()), kNumPointsKp1);
   CHECK_EQ(static_cast<int>(is_keypoint_kp1_matched_.size()), kNumPointsKp1);
   CHECK_EQ(static_cast<int>(prediction_success_.size()), predicted_keypoint_positions_kp1_.cols());
   CHECK_GT(small_search_distance_px_, 0);
   CHECK_GT(large_search_distance_px_, 0);
   CHECK_GE(large_search_distance_px_, small_search_distance_px_);
 
-  descriptors_kp1_wrapped_.reserve(kNumPointsKp1);
   keypoints_kp1_sorted_by_y_.reserve(kNumPointsKp1);
-  descriptors_k_wrapped_.reserve(kNumPointsK);
+  window_candidate_indices_.reserve(kNumPointsKp1);
+  window_distances_.reserve(kNumPointsKp1);
   matches_kp1_k_->reserve(kNumPointsK);
   corner_row_LUT_.reserve(kImageHeight);
 }
 
 void GyroTwoFrameMatcher::initialize() {
-  // Prepare descriptors for efficient matching.
   const Eigen::Matrix<unsigned char, Eigen::Dynamic, Eigen::Dynamic>& descriptors_kp1 =
       frame_kp1_.getDescriptorsOfType(descriptor_type_);
   const Eigen::Matrix<unsigned char, Eigen::Dynamic, Eigen::Dynamic>& descriptors_k =
       frame_k_.getDescriptorsOfType(descriptor_type_);
-
-  for (int descriptor_kp1_idx = 0; descriptor_kp1_idx < kNumPointsKp1;
-      ++descriptor_kp1_idx) {
-    descriptors_kp1_wrapped_.emplace_back(
-        &(descriptors_kp1.coeffRef(0, descriptor_kp1_idx)), kDescriptorSizeBytes);
-  }
-
-  for (int descriptor_k_idx = 0; descriptor_k_idx < kNumPointsK;
-      ++descriptor_k_idx) {
-    descriptors_k_wrapped_.emplace_back(
-        &(descriptors_k.coeffRef(0, descriptor_k_idx)), kDescriptorSizeBytes);
-  }
+  CHECK_EQ(static_cast<size_t>(descriptors_kp1.rows()), kDescriptorSizeBytes);
+  CHECK_EQ(static_cast<size_t>(descriptors_k.rows()), kDescriptorSizeBytes);
 
   // Sort keypoints of frame (k+1) from small to large y coordinates.
   const Eigen::Block<const Eigen::Matrix2Xd> keypoints_kp1 =
@@ -95,6 +96,19 @@ void GyroTwoFrameMatcher::initialize() {
               return lhs.measurement(1) < rhs.measurement(1);
             });
 
+  // Pack the descriptors for the batched distance computation. Every column
+  // of the packed matrices is aligned as the padded size is a multiple of the
+  // alignment of the Eigen allocator. The zero padding doesn't change the
+  // distances.
+  packed_descriptors_kp1_sorted_by_y_.setZero(
+      kPackedDescriptorSizeBytes, kNumPointsKp1);
+  for (int i = 0; i < kNumPointsKp1; ++i) {
+    packed_descriptors_kp1_sorted_by_y_.col(i).head(kDescriptorSizeBytes) =
+        descriptors_kp1.col(keypoints_kp1_sorted_by_y_[i].channel_index);
+  }
+  packed_descriptors_k_.setZero(kPackedDescriptorSizeBytes, kNumPointsK);
+  packed_descriptors_k_.topRows(kDescriptorSizeBytes) = descriptors_k;
+
   // Lookup table construction.
   // TODO(magehrig):  Sort by y if image height >= image width,
   //                  otherwise sort by x.
@@ -110,21 +124,44 @@ void GyroTwoFrameMatcher::initialize() {
 }
 
 void GyroTwoFrameMatcher::match() {
+  timing::Timer timer("GyroTwoFrameMatcher: match");
+  timing::Timer timer_initialize("GyroTwoFrameMatcher: match - initialize");
   initialize();
+  timer_initialize.Stop();
 
-  if (kNumPointsK == 0 || kNumPointsKp1 == 0) {
-    return;
-  }
-
-  for (int i = 0; i < kNumPointsK; ++i) {
-    matchKeypoint(i);
+  if (kNumPointsK > 0 && kNumPointsKp1 > 0) {
+    timing::Timer timer_keypoints(
+        "GyroTwoFrameMatcher: match - match keypoints");
+    for (int i = 0; i < kNumPointsK; ++i) {
+      matchKeypoint(i);
+    }
+    timer_keypoints.Stop();
+
+    timing::Timer timer_inferior(
+        "GyroTwoFrameMatcher: match - match inferior matches");
+    std::vector<bool> is_inferior_keypoint_kp1_matched(
+        is_keypoint_kp1_matched_);
+    for (size_t i = 0u; i < kMaxNumInferiorIterations; ++i) {
+      if (!matchInferiorMatches(&is_inferior_keypoint_kp1_matched)) break;
+    }
+    timer_inferior.Stop();
   }
+  timer.Stop();
+}
 
-  std::vector<bool> is_inferior_keypoint_kp1_matched(
-      is_keypoint_kp1_matched_);
-  for (size_t i = 0u; i < kMaxNumInferiorIterations; ++i) {
-    if(!matchInferiorMatches(&is_inferior_keypoint_kp1_matched)) return;
+void GyroTwoFrameMatcher::computeDistancesToWindowCandidates(const int idx_k) {
+  CHECK_LT(idx_k, kNumPointsK);
+  const int num_candidates =
+      static_cast<int>(window_candidate_indices_.size());
+  window_distances_.resize(num_candidates);
+  if (num_candidates == 0) {
+    return;
   }
+  common::Hamming::evaluateBatch(
+      packed_descriptors_k_.col(idx_k).data(),
+      packed_descriptors_kp1_sorted_by_y_.data(), kPackedDescriptorSizeBytes,
+      window_candidate_indices_.data(), num_candidates,
+      window_distances_.data());
 }
 
 void GyroTwoFrameMatcher::matchKeypoint(const int idx_k) {
@@ -132,47 +169,68 @@ void GyroTwoFrameMatcher::matchKeypoint(const int idx_k) {
     return;
   }
 
-  std::fill(iteration_processed_keypoints_kp1_.begin(),
-            iteration_processed_keypoints_kp1_.end(),
-            false);
-
   bool found = false;
   bool passed_ratio_test = false;
   int n_processed_corners = 0;
   KeyPointIterator it_best;
-  const static unsigned int kDescriptorSizeBits = 8 * kDescriptorSizeBytes;
+  const unsigned int kDescriptorSizeBits = 8 * kDescriptorSizeBytes;
   int best_score = static_cast<int>(
       kDescriptorSizeBits * kMatchingThresholdBitsRatioRelaxed);
   unsigned int distance_best = kDescriptorSizeBits + 1;
   unsigned int distance_second_best = kDescriptorSizeBits + 1;
-  const common::FeatureDescriptorConstRef& descriptor_k =
-      descriptors_k_wrapped_[idx_k];
 
   Eigen::Vector2d predicted_keypoint_position_kp1 =
       predicted_keypoint_positions_kp1_.block<2, 1>(0, idx_k);
+
+  // The small window is contained in the large window. Hence, the candidates
+  // of both windows are collected in one pass over the rows of the large
+  // window and their distances are computed at once.
+  KeyPointIterator near_corners_begin, near_corners_end;
+  getKeypointIteratorsInWindow(
+      predicted_keypoint_position_kp1, large_search_distance_px_,
+      &near_corners_begin, &near_corners_end);
   KeyPointIterator nearest_corners_begin, nearest_corners_end;
   getKeypointIteratorsInWindow(
-      predicted_keypoint_position_kp1, small_search_distance_px_, &nearest_corners_begin, &nearest_corners_end);
+      predicted_keypoint_position_kp1, small_search_distance_px_,
+      &nearest_corners_begin, &nearest_corners_end);
+  CHECK(nearest_corners_begin >= near_corners_begin);
+  CHECK(nearest_corners_end <= near_corners_end);
 
   const int bound_left_nearest =
       predicted_keypoint_position_kp1(0) - small_search_distance_px_;
   const int bound_right_nearest =
       predicted_keypoint_position_kp1(0) + small_search_distance_px_;
-
-  MatchData current_match_data;
-
-  // First search small window.
-  for (KeyPointIterator it = nearest_corners_begin; it != nearest_corners_end; ++it) {
-    if (it->measurement(0) < bound_left_nearest ||
-        it->measurement(0) > bound_right_nearest) {
-      continue;
+  const int bound_left_near =
+      predicted_keypoint_position_kp1(0) - large_search_distance_px_;
+  const int bound_right_near =
+      predicted_keypoint_position_kp1(0) + large_search_distance_px_;
+
+  // Only the keypoints inside the large window are candidates, the rows of
+  // the window also contain keypoints left and right of it.
+  window_candidate_indices_.clear();
+  for (KeyPointIterator it = near_corners_begin; it != near_corners_end; ++it) {
+    if (it->measurement(0) >= bound_left_near &&
+        it->measurement(0) <= bound_right_near) {
+      window_candidate_indices_.push_back(
+          static_cast<int>(it - keypoints_kp1_sorted_by_y_.begin()));
     }
+  }
+  computeDistancesToWindowCandidates(idx_k);
+
+  auto is_in_small_window = [&](const KeyPointIterator it) -> bool {
+    return it >= nearest_corners_begin && it < nearest_corners_end &&
+        it->measurement(0) >= bound_left_nearest &&
+        it->measurement(0) <= bound_right_nearest;
+  };
 
+  MatchData current_match_data;
+  auto process_candidate = [&](const size_t candidate_idx) {
+    const KeyPointIterator it = keypoints_kp1_sorted_by_y_.begin() +
+        window_candidate_indices_[candidate_idx];
     CHECK_LT(it->channel_index, kNumPointsKp1);
     CHECK_GE(it->channel_index, 0);
-    const common::FeatureDescriptorConstRef& descriptor_kp1 =
-        descriptors_kp1_wrapped_[it->channel_index];
-    unsigned int distance = common::GetNumBitsDifferent(descriptor_k, descriptor_kp1);
+    const unsigned int distance =
+        static_cast<unsigned int>(window_distances_[candidate_idx]);
     int current_score = kDescriptorSizeBits - distance;
     if (current_score > best_score) {
       best_score = current_score;
@@ -185,54 +243,31 @@ void GyroTwoFrameMatcher::matchKeypoint(const int idx_k) {
       // to two descriptors that do not qualify as match.
       distance_second_best = distance;
     }
-    iteration_processed_keypoints_kp1_[it->channel_index] = true;
     ++n_processed_corners;
     const double current_matching_score =
         computeMatchingScore(current_score, kDescriptorSizeBits);
     current_match_data.addCandidate(it, current_matching_score);
+  };
+
+  auto is_candidate_in_small_window = [&](const size_t candidate_idx) {
+    return is_in_small_window(
+        keypoints_kp1_sorted_by_y_.begin() +
+        window_candidate_indices_[candidate_idx]);
+  };
+
+  // First search small window.
+  for (size_t i = 0u; i < window_candidate_indices_.size(); ++i) {
+    if (is_candidate_in_small_window(i)) {
+      process_candidate(i);
+    }
   }
 
-  // If no match in small window, increase window and search again.
+  // If no match in small window, continue with the rest of the large window.
   if (!found) {
-    const int bound_left_near =
-        predicted_keypoint_position_kp1(0) - large_search_distance_px_;
-    const int bound_right_near =
-        predicted_keypoint_position_kp1(0) + large_search_distance_px_;
-
-    KeyPointIterator near_corners_begin, near_corners_end;
-    getKeypointIteratorsInWindow(
-        predicted_keypoint_position_kp1, large_search_distance_px_, &near_corners_begin, &near_corners_end);
-
-    for (KeyPointIterator it = near_corners_begin; it != near_corners_end; ++it) {
-      if (iteration_processed_keypoints_kp1_[it->channel_index]) {
-        continue;
-      }
-      if (it->measurement(0) < bound_left_near ||
-          it->measurement(0) > bound_right_near) {
-        continue;
-      }
-      CHECK_LT(it->channel_index, kNumPointsKp1);
-      CHECK_GE(it->channel_index, 0);
-      const common::FeatureDescriptorConstRef& descriptor_kp1 =
-          descriptors_kp1_wrapped_[it->channel_index];
-      unsigned int distance =
-          common::GetNumBitsDifferent(descriptor_k, descriptor_kp1);
-      int current_score = kDescriptorSizeBits - distance;
-      if (current_score > best_score) {
-        best_score = current_score;
-        distance_second_best = distance_best;
-        distance_best = distance;
-        it_best = it;
-        found = true;
-      } else if (distance < distance_second_best) {
-        // The second best distance can also belong
-        // to two descriptors that do not qualify as match.
-        distance_second_best = distance;
+    for (size_t i = 0u; i < window_candidate_indices_.size(); ++i) {
+      if (!is_candidate_in_small_window(i)) {
+        process_candidate(i);
       }
-      ++n_processed_corners;
-      const double current_matching_score =
-          computeMatchingScore(current_score, kDescriptorSizeBits);
-      current_match_data.addCandidate(it, current_matching_score);
     }
   }
 
@@ -7,6 +7,7 @@
 #include <vector>
 
 #include <aslam/common/macros.h>
+#include <aslam/common/unique-id.h>
 #include <Eigen/Dense>
 #include <glog/logging.h>
 #include <opencv2/features2d/features2d.hpp>
@@ -40,6 +41,8 @@ struct GyroTrackerSettings {
 ///        while matching. It also tracks a subset of unmatched features with an optical
 ///        flow algorithm (Lucas-Kanade method).
 class GyroTracker : public FeatureTracker{
+  friend class GyroTrackerTest;
+
  public:
   ASLAM_DISALLOW_EVIL_CONSTRUCTORS(GyroTracker);
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -105,6 +108,11 @@ class GyroTracker : public FeatureTracker{
       const VisualFrame& frame_kp1,
       std::vector<int>* lk_candidate_indices_k) const;
 
+  /// Build the LK image pyramids of frame k and (k+1). The pyramid of frame k
+  /// is reused if it was built as frame (k+1) in the previous call.
+  void buildImagePyramids(
+      const VisualFrame& frame_k, const VisualFrame& frame_kp1);
+
   /// Compute matches from frame k and frame (k-1). They are called tracked
   /// matches since not all original matches get tracked (e.g. rejected by RANSAC).
   virtual void computeTrackedMatches(
@@ -159,6 +167,14 @@ class GyroTracker : public FeatureTracker{
   /// entire keypoint block use VisualFrame::getDescriptorBlockTypeStartAndSize
   int descriptor_type_;
 
+  // Image pyramids for the LK tracking. The pyramid of frame (k+1) becomes the
+  // pyramid of frame k in the next call, while the buffers of the previous
+  // frame k are recycled for the new frame (k+1).
+  std::vector<cv::Mat> image_pyramid_k_;
+  std::vector<cv::Mat> image_pyramid_kp1_;
+  FrameId image_pyramid_kp1_frame_id_;
+  int64_t image_pyramid_kp1_timestamp_ns_;
+
   const GyroTrackerSettings settings_;
 };
 
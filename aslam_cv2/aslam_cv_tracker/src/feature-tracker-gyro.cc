@@ -70,7 +70,8 @@ GyroTracker::GyroTracker(const Camera& camera,
       kMinDistanceToImageBorderPx(min_distance_to_image_border),
       extractor_(extractor_ptr),
       initialized_(false),
-      descriptor_type_(descriptor_type) {
+      descriptor_type_(descriptor_type),
+      image_pyramid_kp1_timestamp_ns_(-1) {
 }
 
 void GyroTracker::track(const Quaternion& q_Ckp1_Ck,
@@ -151,6 +152,27 @@ void GyroTracker::track(const Quaternion& q_Ckp1_Ck,
   }
 }
 
+void GyroTracker::buildImagePyramids(
+    const VisualFrame& frame_k, const VisualFrame& frame_kp1) {
+  const bool is_pyramid_of_frame_k_cached =
+      frame_k.getId().isValid() &&
+      frame_k.getId() == image_pyramid_kp1_frame_id_ &&
+      frame_k.getTimestampNanoseconds() == image_pyramid_kp1_timestamp_ns_;
+  if (is_pyramid_of_frame_k_cached) {
+    image_pyramid_k_.swap(image_pyramid_kp1_);
+  } else {
+    cv::buildOpticalFlowPyramid(
+        frame_k.getRawImage(), image_pyramid_k_, settings_.lk_window_size,
+        settings_.lk_max_pyramid_levels);
+  }
+  // The levels are reallocated only if the image size changes.
+  cv::buildOpticalFlowPyramid(
+      frame_kp1.getRawImage(), image_pyramid_kp1_, settings_.lk_window_size,
+      settings_.lk_max_pyramid_levels);
+  image_pyramid_kp1_frame_id_ = frame_kp1.getId();
+  image_pyramid_kp1_timestamp_ns_ = frame_kp1.getTimestampNanoseconds();
+}
+
 void GyroTracker::lkTracking(
       const Eigen::Matrix2Xd& predicted_keypoint_positions_kp1,
       const std::vector<unsigned char>& prediction_success,
@@ -210,8 +232,9 @@ void GyroTracker::lkTracking(
   std::vector<unsigned char> lk_tracking_success;
   std::vector<float> lk_tracking_errors;
 
+  buildImagePyramids(frame_k, *frame_kp1);
   cv::calcOpticalFlowPyrLK(
-      frame_k.getRawImage(), frame_kp1->getRawImage(), lk_cv_points_k,
+      image_pyramid_k_, image_pyramid_kp1_, lk_cv_points_k,
       lk_cv_points_kp1, lk_tracking_success, lk_tracking_errors,
       settings_.lk_window_size, settings_.lk_max_pyramid_levels,
       settings_.lk_termination_criteria, settings_.lk_operation_flag,
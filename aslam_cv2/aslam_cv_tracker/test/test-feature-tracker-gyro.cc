@@ -0,0 +1,153 @@
+#include <memory>
+#include <vector>
+
+#include <aslam/cameras/camera-pinhole.h>
+#include <aslam/common/entrypoint.h>
+#include <aslam/frames/visual-frame.h>
+#include <aslam/tracker/feature-tracker-gyro.h>
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/video/tracking.hpp>
+
+namespace aslam {
+
+class GyroTrackerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    camera_ = PinholeCamera::createTestCamera();
+    tracker_.reset(new GyroTracker(
+        *camera_, 0u, cv::Ptr<cv::DescriptorExtractor>()));
+  }
+
+  VisualFrame::Ptr createFrame(
+      const int64_t timestamp_ns, const int width, const int height) {
+    VisualFrame::Ptr frame =
+        VisualFrame::createEmptyTestVisualFrame(camera_, timestamp_ns);
+    cv::Mat image(height, width, CV_8UC1);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    frame->setRawImage(image);
+    return frame;
+  }
+
+  void buildImagePyramids(
+      const VisualFrame& frame_k, const VisualFrame& frame_kp1) {
+    tracker_->buildImagePyramids(frame_k, frame_kp1);
+  }
+
+  const std::vector<cv::Mat>& pyramidK() const {
+    return tracker_->image_pyramid_k_;
+  }
+
+  const std::vector<cv::Mat>& pyramidKp1() const {
+    return tracker_->image_pyramid_kp1_;
+  }
+
+  // Checks that the given pyramid matches one built from scratch.
+  void expectPyramidOfFrame(
+      const std::vector<cv::Mat>& pyramid, const VisualFrame& frame) const {
+    std::vector<cv::Mat> expected_pyramid;
+    cv::buildOpticalFlowPyramid(
+        frame.getRawImage(), expected_pyramid,
+        tracker_->settings_.lk_window_size,
+        tracker_->settings_.lk_max_pyramid_levels);
+    ASSERT_EQ(expected_pyramid.size(), pyramid.size());
+    for (size_t level = 0u; level < pyramid.size(); ++level) {
+      ASSERT_EQ(expected_pyramid[level].size(), pyramid[level].size());
+      ASSERT_EQ(expected_pyramid[level].type(), pyramid[level].type());
+      EXPECT_EQ(
+          0.0, cv::norm(expected_pyramid[level], pyramid[level],
+                        cv::NORM_INF));
+    }
+  }
+
+  Camera::Ptr camera_;
+  std::unique_ptr<GyroTracker> tracker_;
+};
+
+TEST_F(GyroTrackerTest, ReusesPyramidOfPreviousFrame) {
+  VisualFrame::Ptr frame_0 = createFrame(0, 640, 480);
+  VisualFrame::Ptr frame_1 = createFrame(1, 640, 480);
+  VisualFrame::Ptr frame_2 = createFrame(2, 640, 480);
+
+  buildImagePyramids(*frame_0, *frame_1);
+  expectPyramidOfFrame(pyramidK(), *frame_0);
+  expectPyramidOfFrame(pyramidKp1(), *frame_1);
+
+  // The pyramid of frame 1 is handed over without being rebuilt.
+  const uchar* pyramid_frame_1_data = pyramidKp1()[0].data;
+  const uchar* pyramid_frame_0_data = pyramidK()[0].data;
+  buildImagePyramids(*frame_1, *frame_2);
+  EXPECT_EQ(pyramid_frame_1_data, pyramidK()[0].data);
+  expectPyramidOfFrame(pyramidK(), *frame_1);
+  expectPyramidOfFrame(pyramidKp1(), *frame_2);
+
+  // The buffers of frame 0 are recycled for frame 2.
+  EXPECT_EQ(pyramid_frame_0_data, pyramidKp1()[0].data);
+}
+
+TEST_F(GyroTrackerTest, RebuildsPyramidOfUnknownFrame) {
+  VisualFrame::Ptr frame_0 = createFrame(0, 640, 480);
+  VisualFrame::Ptr frame_1 = createFrame(1, 640, 480);
+  VisualFrame::Ptr frame_2 = createFrame(2, 640, 480);
+  VisualFrame::Ptr frame_3 = createFrame(3, 640, 480);
+
+  buildImagePyramids(*frame_0, *frame_1);
+
+  // Frame k was not frame (k+1) of the previous call, e.g. after a dropped
+  // frame.
+  buildImagePyramids(*frame_2, *frame_3);
+  expectPyramidOfFrame(pyramidK(), *frame_2);
+  expectPyramidOfFrame(pyramidKp1(), *frame_3);
+}
+
+TEST_F(GyroTrackerTest, RebuildsPyramidOnTimestampMismatch) {
+  VisualFrame::Ptr frame_0 = createFrame(0, 640, 480);
+  VisualFrame::Ptr frame_1 = createFrame(1, 640, 480);
+  VisualFrame::Ptr frame_2 = createFrame(2, 640, 480);
+
+  buildImagePyramids(*frame_0, *frame_1);
+
+  // Same frame id, but a different timestamp and image.
+  VisualFrame::Ptr frame_1_modified = createFrame(5, 640, 480);
+  frame_1_modified->setId(frame_1->getId());
+  buildImagePyramids(*frame_1_modified, *frame_2);
+  expectPyramidOfFrame(pyramidK(), *frame_1_modified);
+  expectPyramidOfFrame(pyramidKp1(), *frame_2);
+}
+
+TEST_F(GyroTrackerTest, RebuildsPyramidOfFramesWithInvalidId) {
+  VisualFrame::Ptr frame_0 = createFrame(0, 640, 480);
+  VisualFrame::Ptr frame_1 = createFrame(1, 640, 480);
+  VisualFrame::Ptr frame_2 = createFrame(2, 640, 480);
+  frame_0->setId(FrameId());
+  frame_1->setId(FrameId());
+  frame_2->setId(FrameId());
+
+  // The cache starts with an invalid frame id, which must not match.
+  buildImagePyramids(*frame_0, *frame_1);
+  expectPyramidOfFrame(pyramidK(), *frame_0);
+  expectPyramidOfFrame(pyramidKp1(), *frame_1);
+
+  // Frames without an id are never taken from the cache.
+  VisualFrame::Ptr frame_1_modified = createFrame(1, 640, 480);
+  frame_1_modified->setId(FrameId());
+  buildImagePyramids(*frame_1_modified, *frame_2);
+  expectPyramidOfFrame(pyramidK(), *frame_1_modified);
+  expectPyramidOfFrame(pyramidKp1(), *frame_2);
+}
+
+TEST_F(GyroTrackerTest, RebuildsPyramidsOnImageSizeChange) {
+  VisualFrame::Ptr frame_0 = createFrame(0, 640, 480);
+  VisualFrame::Ptr frame_1 = createFrame(1, 640, 480);
+  VisualFrame::Ptr frame_2 = createFrame(2, 320, 240);
+  VisualFrame::Ptr frame_3 = createFrame(3, 320, 240);
+
+  buildImagePyramids(*frame_0, *frame_1);
+  buildImagePyramids(*frame_2, *frame_3);
+  expectPyramidOfFrame(pyramidK(), *frame_2);
+  expectPyramidOfFrame(pyramidKp1(), *frame_3);
+}
+
+}  // namespace aslam
+
+ASLAM_UNITTEST_ENTRYPOINT
@@ -1,6 +1,8 @@
 #ifndef MAP_MANAGER_MAP_MANAGER_INL_H_
 #define MAP_MANAGER_MAP_MANAGER_INL_H_
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>    // NOLINT
 #include <iostream>  // NOLINT
 #include <memory>
@@ -13,6 +15,7 @@
 #include <vector>
 
 #include <aslam/common/reader-writer-lock.h>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <maplab-common/file-system-tools.h>
 #include <maplab-common/map-manager-config.h>
@@ -23,6 +26,8 @@
 #include "map-manager/map-manager.h"
 #include "map-manager/map-storage.h"
 
+DECLARE_uint64(map_manager_max_num_parallel_map_loads);
+
 namespace backend {
 
 template <typename MapType>
@@ -331,7 +336,100 @@ bool MapManager<MapType>::loadAllMapsFromFolder(
   }
   VLOG(1) << maps_to_load_ss.str() << "\n";
 
-  aslam::ScopedWriteLock lock(map_storage_->getContainerMutex());
+  // Check the keys before loading anything. They are checked again when
+  // inserting the maps, as the storage isn't locked while loading.
+  if (!areKeysAvailableForLoading(folder_path, key_list)) {
+    return false;
+  }
+
+  // Load the maps into private instances, several at a time.
+  const size_t num_maps = map_list.size();
+  std::vector<AlignedUniquePtr<MapType>> loaded_maps(num_maps);
+  std::atomic<size_t> next_map_index(0u);
+  std::atomic<size_t> num_loaded_maps(0u);
+  std::atomic<bool> has_failed(false);
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  auto load_maps = [&]() {
+    for (size_t i = next_map_index++; i < num_maps && !has_failed;
+         i = next_map_index++) {
+      const std::string& map_folder = map_list[i];
+      const std::string& key_name = key_list[i];
+      CHECK(!map_folder.empty());
+      CHECK(!key_name.empty());
+      CHECK(isKeyValid(key_name));
+
+      const std::chrono::steady_clock::time_point map_start_time =
+          std::chrono::steady_clock::now();
+      AlignedUniquePtr<MapType> map = aligned_unique<MapType>();
+      if (!traits<MapType>::loadFromFolder(map_folder, map.get())) {
+        LOG(ERROR) << "Loading map " << map_folder << " failed.";
+        has_failed = true;
+        return;
+      }
+      loaded_maps[i] = std::move(map);
+      const double map_load_time_s =
+          std::chrono::duration<double>(
+              std::chrono::steady_clock::now() - map_start_time)
+              .count();
+      VLOG(1) << "Loaded map " << key_name << " (" << ++num_loaded_maps << "/"
+              << num_maps << ") in " << map_load_time_s << "s.";
+    }
+  };
+
+  const size_t num_threads = std::min<size_t>(
+      num_maps, std::max<size_t>(
+                    FLAGS_map_manager_max_num_parallel_map_loads, 1u));
+  std::vector<std::thread> threads;
+  for (size_t thread_idx = 1u; thread_idx < num_threads; ++thread_idx) {
+    threads.emplace_back(load_maps);
+  }
+  load_maps();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  // The maps that were loaded before the failure are discarded.
+  if (has_failed) {
+    LOG(ERROR) << "Not all maps in folder " << folder_path
+               << " could be loaded. No maps will be loaded.";
+    return false;
+  }
+  CHECK_EQ(num_loaded_maps.load(), num_maps);
+
+  const double load_time_s = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start_time)
+                                 .count();
+  VLOG(1) << "Loaded " << num_maps << " maps using " << num_threads
+          << " threads in " << load_time_s << "s ("
+          << num_maps / std::max(load_time_s, 1e-9) << " maps/s).";
+
+  {
+    aslam::ScopedWriteLock lock(map_storage_->getContainerMutex());
+    for (const std::string& map_key : key_list) {
+      if (map_storage_->hasMap(map_key)) {
+        LOG(ERROR) << "No maps will be loaded because a map with key \""
+                   << map_key << "\" was added to the storage while loading.";
+        return false;
+      }
+    }
+    for (size_t i = 0u; i < num_maps; ++i) {
+      CHECK(loaded_maps[i]);
+      map_storage_->addMap(key_list[i], loaded_maps[i]);
+    }
+  }
+
+  if (new_keys != nullptr) {
+    new_keys->insert(key_list.cbegin(), key_list.cend());
+  }
+  return true;
+}
+
+template <typename MapType>
+bool MapManager<MapType>::areKeysAvailableForLoading(
+    const std::string& folder_path,
+    const std::vector<std::string>& key_list) const {
+  aslam::ScopedReadLock lock(map_storage_->getContainerMutex());
   std::unordered_set<std::string> key_set;
   for (const std::string& map_key : key_list) {
     if (!key_set.emplace(map_key).second) {
@@ -345,27 +443,6 @@ bool MapManager<MapType>::loadAllMapsFromFolder(
       return false;
     }
   }
-
-  if (new_keys != nullptr) {
-    new_keys->insert(key_list.cbegin(), key_list.cend());
-  }
-
-  // Load and insert all maps.
-  CHECK_EQ(map_list.size(), key_list.size());
-  for (size_t i = 0u; i < map_list.size(); ++i) {
-    const std::string& map_folder = map_list[i];
-    const std::string& key_name = key_list[i];
-    CHECK(!map_folder.empty());
-    CHECK(!key_name.empty());
-    CHECK(isKeyValid(key_name));
-    CHECK(!map_storage_->hasMap(key_name));
-
-    AlignedUniquePtr<MapType> map = aligned_unique<MapType>();
-    CHECK(traits<MapType>::loadFromFolder(map_folder, map.get()))
-        << "Loading map " << map_folder << " failed.";
-    map_storage_->addMap(key_name, map);
-    VLOG(1) << "Loaded map " << key_name;
-  }
   return true;
 }
 
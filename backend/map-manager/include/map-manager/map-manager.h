@@ -235,6 +235,11 @@ class MapManager {
   /// The keys under which the maps are stored are determined by the filename.
   /// If a key already
   /// exists in the storage, this operation will fail.
+  ///
+  /// The maps are loaded concurrently (see the flag
+  /// map_manager_max_num_parallel_map_loads) without locking the storage,
+  /// which is only locked to insert all maps at once. If any map fails to
+  /// load, none of the maps are inserted.
   /// \param folder_path Path of the folder containing the maps to load.
   /// \returns True if all maps in the folder are successfully loaded and at
   /// least one map has been loaded.
@@ -322,6 +327,12 @@ class MapManager {
       const std::string& folder_path, std::vector<std::string>* map_list);
 
  protected:
+  /// Returns false if the list contains duplicate keys or keys that already
+  /// exist in the storage.
+  bool areKeysAvailableForLoading(
+      const std::string& folder_path,
+      const std::vector<std::string>& key_list) const;
+
   MapStorage<MapType>* map_storage_;
 };
 
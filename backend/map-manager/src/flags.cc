@@ -0,0 +1,8 @@
+#include <gflags/gflags.h>
+
+DEFINE_uint64(
+    map_manager_max_num_parallel_map_loads, 4u,
+    "Maximum number of maps that are loaded concurrently when loading all maps "
+    "of a folder. Loading a map is mostly bound by the disk and already uses "
+    "multiple threads per map, so this is limited independently from the "
+    "number of hardware threads. (0 or 1: load the maps sequentially)");
@@ -0,0 +1,105 @@
+#ifndef MAP_RESOURCES_IMAGE_CODEC_H_
+#define MAP_RESOURCES_IMAGE_CODEC_H_
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "map-resources/resource-common.h"
+
+namespace backend {
+
+// Describes how cv::Mat resources are encoded when they are stored. Resource
+// files are stored with the file extension of their codec, the format is
+// detected from the content when they are loaded again. Hence, changing the
+// codec does not affect the ability to load previously stored resources.
+struct ImageCodec {
+  enum class Format : int {
+    // Uncompressed PGM/PPM, the default format of the resource files.
+    kPnm = 0,
+    // Lossless, quality is the compression level [0, 9].
+    kPng,
+    // Lossy, quality is in [0, 100]. Only supports 8 bit images.
+    kJpeg,
+    // Lossy for quality [1, 100], lossless for quality > 100. Only supports 8
+    // bit images.
+    kWebp,
+    // Lossless, supports 16 bit images.
+    kTiff,
+    kCount
+  };
+
+  ImageCodec() : format(Format::kPnm), quality(-1) {}
+  ImageCodec(const Format _format, const int _quality)
+      : format(_format), quality(_quality) {}
+
+  // Parses a codec specification of the form "<format>[:<quality>]", e.g.
+  // "pnm", "png:1", "jpeg:90", "webp:101" or "tiff". Returns false if the
+  // specification is invalid.
+  static bool fromString(const std::string& specification, ImageCodec* codec);
+  std::string toString() const;
+
+  bool isLossless() const;
+  bool supportsImageDepth(const int cv_depth) const;
+
+  Format format;
+  // Format specific quality or compression parameter, -1 selects the OpenCV
+  // default of the format.
+  int quality;
+};
+
+// Encodes the image into an in-memory buffer using the given codec. For
+// kPnm, the file suffix of the resource type selects between PGM and PPM.
+bool encodeImage(
+    const cv::Mat& image, const ResourceType& type, const ImageCodec& codec,
+    std::vector<uchar>* buffer);
+
+// Returns the file extension of images encoded with this codec. For kPnm, this
+// is the file suffix of the resource type, i.e. .pgm or .ppm.
+std::string getImageFileExtension(
+    const ImageCodec& codec, const ResourceType& type);
+
+// Determines the format of an encoded image from its signature. Returns false
+// if the format is unknown.
+bool getImageFormatOfEncodedImage(
+    const char* data, const size_t num_bytes, ImageCodec::Format* format);
+
+// Returns the codec configured through the flags for this resource type. Only
+// defined for cv::Mat resource types.
+ImageCodec getDefaultImageCodec(const ResourceType& type);
+
+bool isImageResourceType(const ResourceType& type);
+
+// Returns the cv::imread/cv::imdecode flag and the expected cv::Mat type of a
+// cv::Mat resource type.
+void getImreadFlagAndMatType(
+    const ResourceType& type, int* imread_flag, int* mat_type);
+
+struct ImageCodecBenchmarkResult {
+  ImageCodec codec;
+  size_t num_images = 0u;
+  size_t num_raw_bytes = 0u;
+  size_t num_encoded_bytes = 0u;
+  double encoding_time_s = 0.0;
+  double decoding_time_s = 0.0;
+  // Maximum absolute difference of any pixel after the round trip.
+  double max_abs_error = 0.0;
+
+  double bytesPerImage() const;
+  // Throughput with respect to the decoded (raw) image size.
+  double decodingMegabytesPerSecond() const;
+  double encodingMegabytesPerSecond() const;
+};
+
+// Encodes and decodes all images with every codec and reports size, speed and
+// reconstruction error. Codecs that don't support the depth of an image skip
+// this image.
+void benchmarkImageCodecs(
+    const std::vector<cv::Mat>& images, const ResourceType& type,
+    const std::vector<ImageCodec>& codecs,
+    std::vector<ImageCodecBenchmarkResult>* results);
+
+}  // namespace backend
+
+#endif  // MAP_RESOURCES_IMAGE_CODEC_H_
@@ -0,0 +1,164 @@
+#ifndef MAP_RESOURCES_RESOURCE_ARCHIVE_H_
+#define MAP_RESOURCES_RESOURCE_ARCHIVE_H_
+
+#include <cstdint>
+#include <fstream>  // NOLINT
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "map-resources/resource-common.h"
+
+namespace backend {
+
+// Packed, append-only storage backend for the resources of one resource
+// folder. Instead of storing every resource as its own file, the resources are
+// appended as opaque blobs to large segment files inside
+// <resource_folder>/resource_archive/. An index maps every (type, id) pair to
+// its location (segment, offset, length) and codec. The index is persisted as
+// an append-only log of fixed size records, such that adding or removing a
+// resource never requires rewriting existing data. Deleted resources only
+// leave dead bytes behind in the segments, which can be reclaimed by calling
+// compact().
+//
+// Segments are read through read-only memory mappings, so retrieving a blob
+// does not copy any data until the caller decodes it.
+//
+// The class is thread-safe.
+class ResourceArchive {
+ public:
+  // Describes how a blob has been encoded.
+  enum class Codec : uint8_t {
+    // The blob is byte-identical to the file that would be stored for this
+    // resource in the file-per-resource layout.
+    kFileFormat = 0u,
+    kCount
+  };
+
+  struct Entry {
+    uint32_t segment_idx = 0u;
+    uint64_t offset = 0u;
+    uint64_t num_bytes = 0u;
+    Codec codec = Codec::kFileFormat;
+  };
+
+  // Read-only memory mapping of a segment, see the source file.
+  struct Mapping;
+
+  // Read-only view of a blob inside a memory mapped segment. The view shares
+  // the ownership of the mapping, hence it remains valid as long as the view
+  // exists, also after the archive has been compacted, cleared or destroyed.
+  struct BlobView {
+    const char* data = nullptr;
+    size_t num_bytes = 0u;
+    Codec codec = Codec::kFileFormat;
+    std::shared_ptr<const Mapping> mapping;
+  };
+
+  explicit ResourceArchive(const std::string& resource_folder);
+  ~ResourceArchive();
+
+  // Returns true if the resource folder contains a resource archive.
+  static bool archiveExists(const std::string& resource_folder);
+  static std::string getArchiveFolder(const std::string& resource_folder);
+
+  // Appends a blob to the current segment and registers it in the index. Will
+  // fail if a resource with this id and type is already part of the archive.
+  void append(
+      const ResourceId& id, const ResourceType& type, const char* data,
+      const size_t num_bytes, const Codec codec);
+  void append(
+      const ResourceId& id, const ResourceType& type, const std::string& blob,
+      const Codec codec);
+
+  bool contains(const ResourceId& id, const ResourceType& type) const;
+
+  // Zero-copy access to a stored blob.
+  bool getBlobView(
+      const ResourceId& id, const ResourceType& type, BlobView* view) const;
+
+  // Copies a stored blob.
+  bool getBlob(
+      const ResourceId& id, const ResourceType& type, std::string* blob,
+      Codec* codec) const;
+
+  // Removes the resource from the index. The blob itself is reclaimed during
+  // the next compaction. Returns false if the resource is not in the archive.
+  bool remove(const ResourceId& id, const ResourceType& type);
+
+  void getResourceIds(ResourceTypeToIdsMap* resource_ids) const;
+
+  size_t numResources() const;
+  // Total number of bytes of all segments.
+  size_t numTotalBytes() const;
+  // Number of bytes in the segments that belong to removed resources.
+  size_t numDeadBytes() const;
+
+  // Rewrites all live blobs into new, densely packed segments and rewrites the
+  // index accordingly.
+  void compact();
+
+  // Deletes all segments and the index from the file system.
+  void clear();
+
+ private:
+  typedef std::pair<ResourceType, ResourceId> Key;
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<ResourceId>()(key.second) ^
+             static_cast<size_t>(key.first);
+    }
+  };
+  typedef std::unordered_map<Key, Entry, KeyHash> Index;
+
+  typedef std::shared_ptr<const Mapping> MappingPtr;
+
+  std::string getSegmentPath(const uint32_t segment_idx) const;
+  std::string getIndexPath() const;
+
+  void loadIndex();
+  void appendIndexRecord(
+      const bool is_removal, const Key& key, const Entry& entry);
+  void closeIndex();
+  void rewriteIndex(const std::string& index_path, const Index& index) const;
+
+  void openSegmentForWriting(const uint32_t segment_idx);
+  void closeSegment();
+
+  // Returns a mapping of the given segment that covers at least
+  // required_num_bytes bytes, remapping the segment if it has grown.
+  MappingPtr getMapping(
+      const uint32_t segment_idx, const size_t required_num_bytes) const;
+  void releaseMappings();
+
+  bool getBlobViewImpl(const Key& key, BlobView* view) const;
+
+  const std::string resource_folder_;
+  const std::string archive_folder_;
+
+  Index index_;
+  size_t num_total_bytes_;
+  size_t num_dead_bytes_;
+
+  // Segment that is currently appended to.
+  uint32_t active_segment_idx_;
+  uint64_t active_segment_num_bytes_;
+  int active_segment_fd_;
+
+  // The index log is kept open for appending.
+  std::ofstream index_file_;
+
+  // Latest mapping of every segment. When a grown segment is mapped again,
+  // the previous mapping is unmapped as soon as the last BlobView into it is
+  // destroyed.
+  mutable std::unordered_map<uint32_t, MappingPtr> mappings_;
+
+  mutable std::mutex mutex_;
+};
+
+}  // namespace backend
+
+#endif  // MAP_RESOURCES_RESOURCE_ARCHIVE_H_
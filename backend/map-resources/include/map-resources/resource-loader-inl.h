@@ -20,11 +20,38 @@ void ResourceLoader::addResource(
     cache_.putResource<DataType>(id, type, resource);
   }
 
+  // Make sure a previous write of this resource doesn't overtake this one.
+  waitForPendingWrite(id);
+  if (!enqueueResourceWrite<DataType>(id, type, folder, resource)) {
+    writeResource<DataType>(id, type, folder, resource);
+  }
+}
+
+template <typename DataType>
+void ResourceLoader::writeResource(
+    const ResourceId& id, const ResourceType& type, const std::string& folder,
+    const DataType& resource) {
+  if (useArchiveForNewResources(type, folder)) {
+    std::string blob;
+    ResourceArchive::Codec codec;
+    encodeResource<DataType>(type, resource, folder, &blob, &codec);
+    getArchive(folder, true /*create_if_missing*/)
+        ->append(id, type, blob, codec);
+    return;
+  }
+
   std::string file_path;
   getResourceFilePath(id, type, folder, &file_path);
   saveResourceToFile(file_path, type, resource);
 }
 
+template <typename DataType>
+bool ResourceLoader::enqueueResourceWrite(
+    const ResourceId& /*id*/, const ResourceType& /*type*/,
+    const std::string& /*folder*/, const DataType& /*resource*/) {
+  return false;
+}
+
 template <typename DataType>
 void ResourceLoader::getResource(
     const ResourceId& id, const ResourceType& type, const std::string& folder,
@@ -33,6 +60,19 @@ void ResourceLoader::getResource(
   CHECK_NOTNULL(resource);
   if (cache_.getResource<DataType>(id, type, resource)) {
     return;
+  }
+  waitForPendingWrite(id);
+
+  const std::shared_ptr<const ResourceArchive> archive =
+      getArchiveContainingResource(id, type, folder);
+  if (archive != nullptr) {
+    ResourceArchive::BlobView blob;
+    CHECK(archive->getBlobView(id, type, &blob));
+    CHECK(decodeResource(type, blob, folder, resource))
+        << "Failed to load " << ResourceTypeNames[static_cast<size_t>(type)]
+        << " resource with id " << id.hexString()
+        << " from the resource archive in folder: " << folder;
+    cache_.putResource<DataType>(id, type, *resource);
   } else {
     std::string file_path;
     getResourceFilePath(id, type, folder, &file_path);
@@ -49,7 +89,15 @@ bool ResourceLoader::checkResourceFile(
     const ResourceId& id, const ResourceType& type,
     const std::string& folder) const {
   CHECK(!folder.empty());
+  waitForPendingWrite(id);
   DataType resource;
+  const std::shared_ptr<const ResourceArchive> archive =
+      getArchiveContainingResource(id, type, folder);
+  if (archive != nullptr) {
+    ResourceArchive::BlobView blob;
+    return archive->getBlobView(id, type, &blob) &&
+           decodeResource(type, blob, folder, &resource);
+  }
   std::string file_path;
   getResourceFilePath(id, type, folder, &file_path);
   return loadResourceFromFile(file_path, type, &resource);
@@ -86,6 +134,28 @@ bool ResourceLoader::loadResourceFromFile(
   return false;
 }
 
+template <typename DataType>
+void ResourceLoader::encodeResource(
+    const ResourceType& type, const DataType& /*resource*/,
+    const std::string& folder, std::string* /*blob*/,
+    ResourceArchive::Codec* /*codec*/) const {
+  LOG(FATAL) << "ResourceLoader::encodeResource() is not implemented for "
+             << "this DataType! Cannot add resource of type "
+             << ResourceTypeNames[static_cast<size_t>(type)]
+             << " to the resource archive in folder: " << folder;
+}
+
+template <typename DataType>
+bool ResourceLoader::decodeResource(
+    const ResourceType& type, const ResourceArchive::BlobView& /*blob*/,
+    const std::string& folder, DataType* /*resource*/) const {
+  LOG(FATAL) << "ResourceLoader::decodeResource() is not implemented for "
+             << "this DataType! Cannot load resource of type "
+             << ResourceTypeNames[static_cast<size_t>(type)]
+             << " from the resource archive in folder: " << folder;
+  return false;
+}
+
 template <typename DataType>
 void ResourceLoader::deleteResource(
     const ResourceId& id, const ResourceType& type, const std::string& folder) {
@@ -1,22 +1,76 @@
 #ifndef MAP_RESOURCES_RESOURCE_LOADER_H_
 #define MAP_RESOURCES_RESOURCE_LOADER_H_
 
+#include <array>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
+#include <aslam/common/reader-writer-lock.h>
+#include <aslam/common/thread-pool.h>
+#include <maplab-common/file-system-tools.h>
+
+#include "map-resources/image-codec.h"
+#include "map-resources/resource-archive.h"
 #include "map-resources/resource-cache.h"
 #include "map-resources/resource-common.h"
 
 namespace backend {
 
+// Bookkeeping of a single resource migration that allows to either finalize
+// or undo the migration.
+struct ResourceMigrationRecord {
+  ResourceId id;
+  ResourceType type;
+  std::string old_folder;
+  std::string new_folder;
+  bool move_resource = false;
+  bool from_archive = false;
+  bool to_archive = false;
+  common::FileTransferMethod method = common::FileTransferMethod::kFailed;
+  size_t num_bytes = 0u;
+};
+
 class ResourceLoader {
  public:
-  ResourceLoader() {}
+  ResourceLoader();
+  ~ResourceLoader();
+
+  // Codec used to encode the cv::Mat resources of this type that are added
+  // after this call. Resources that are already stored, or still queued for
+  // encoding, keep the codec they were added with. Initialized from the
+  // --resource_*_codec flags. Thread-safe.
+  void setImageCodec(const ResourceType& type, const ImageCodec& codec);
+  ImageCodec getImageCodec(const ResourceType& type) const;
+
+  // Image resources are encoded and written on a background thread pool if
+  // --resource_image_encoding_num_threads > 0. All accesses to a resource wait
+  // for its pending write, this function waits for all pending writes, e.g.
+  // before the resource folders are accessed by other means.
+  void waitForPendingWrites() const;
 
   void migrateResource(
       const ResourceId& id, const ResourceType& type,
       const std::string& old_folder, const std::string& new_folder,
       const bool move_resource);
 
+  // Migrates a resource in two phases. transferResource(...) makes the
+  // resource available in the new folder using the cheapest mechanism
+  // available (rename, hard link, reflink or in-kernel copy), but only removes
+  // it from the old folder if this happens atomically, i.e. through a rename.
+  // Afterwards either commitResourceMigration(...) removes the remaining
+  // source or rollbackResourceMigration(...) restores the previous state.
+  // Returns false if the resource could not be transferred, in which case
+  // nothing needs to be rolled back.
+  bool transferResource(
+      const ResourceId& id, const ResourceType& type,
+      const std::string& old_folder, const std::string& new_folder,
+      const bool move_resource, ResourceMigrationRecord* record);
+  void commitResourceMigration(const ResourceMigrationRecord& record);
+  void rollbackResourceMigration(const ResourceMigrationRecord& record);
+
   template <typename DataType>
   void deleteResource(
       const ResourceId& id, const ResourceType& type,
@@ -54,6 +108,14 @@ class ResourceLoader {
       const ResourceId& id, const ResourceType& type,
       const std::string& folder) const;
 
+  // Voxblox maps can only be saved and loaded through files by voxblox, hence
+  // they are always stored as individual files, also in folders that contain
+  // an archive.
+  static bool isArchivedResourceType(const ResourceType& type);
+
+  // Image resources that are encoded with a codec other than PNM are stored
+  // with the file extension of the codec. Returns the path of the existing
+  // file if there is one, otherwise the path with the suffix of the type.
   void getResourceFilePath(
       const ResourceId& id, const ResourceType& type, const std::string& folder,
       std::string* file_path) const;
@@ -74,12 +136,112 @@ class ResourceLoader {
       const std::string& file_path, const ResourceType& type,
       DataType* resource) const;
 
+  // Encodes/decodes a resource to/from the blob format used by the packed
+  // resource archive, without touching the file system. The blob is the
+  // content of the file that saveResourceToFile(...) would write.
+  // NOTE: [ADD_RESOURCE_DATA_TYPE] Implement and add declaration below, unless
+  // the resource type is excluded in isArchivedResourceType(...).
+  template <typename DataType>
+  void encodeResource(
+      const ResourceType& type, const DataType& resource,
+      const std::string& folder, std::string* blob,
+      ResourceArchive::Codec* codec) const;
+  template <typename DataType>
+  bool decodeResource(
+      const ResourceType& type, const ResourceArchive::BlobView& blob,
+      const std::string& folder, DataType* resource) const;
+
+  // Moves (or copies) the resource files of the given folder into the packed
+  // resource archive of this folder. Returns the number of packed resources.
+  size_t packResourcesIntoArchive(
+      const std::string& folder, const ResourceTypeToIdsMap& resource_ids,
+      const bool remove_files);
+
+  // Writes all resources of the packed resource archive of this folder back
+  // into individual resource files and removes the archive. Returns the
+  // number of unpacked resources.
+  size_t unpackResourcesFromArchive(const std::string& folder);
+
+  // Reclaims the space of deleted resources in the packed resource archive of
+  // this folder, if there is one.
+  void compactResourceArchive(const std::string& folder);
+
  private:
+  // Stores the resource in the archive or as a file, depending on the folder.
+  template <typename DataType>
+  void writeResource(
+      const ResourceId& id, const ResourceType& type, const std::string& folder,
+      const DataType& resource);
+
+  // Schedules writeResource(...) on the encoding thread pool. Returns false if
+  // the resource needs to be written synchronously, which is the case for all
+  // data types except cv::Mat, or if too many writes are pending already.
+  template <typename DataType>
+  bool enqueueResourceWrite(
+      const ResourceId& id, const ResourceType& type, const std::string& folder,
+      const DataType& resource);
+
+  void waitForPendingWrite(const ResourceId& id) const;
+
+  void getResourceFilePathWithExtension(
+      const ResourceId& id, const ResourceType& type, const std::string& folder,
+      const std::string& extension, std::string* file_path) const;
+  // Returns the path under which the blob of this resource is stored as a
+  // file, which for image resources depends on the format of the blob.
+  void getResourceFilePathForBlob(
+      const ResourceId& id, const ResourceType& type, const std::string& folder,
+      const std::string& blob, std::string* file_path) const;
+
+  // Returns the archive of the resource folder or a nullptr if the folder does
+  // not contain an archive and create_if_missing is false. The result is
+  // cached per folder, such that only the first lookup of a folder touches
+  // the file system.
+  std::shared_ptr<ResourceArchive> getArchive(
+      const std::string& folder, const bool create_if_missing) const;
+
+  // Returns the archive of the folder if it contains the resource.
+  std::shared_ptr<ResourceArchive> getArchiveContainingResource(
+      const ResourceId& id, const ResourceType& type,
+      const std::string& folder) const;
+
+  // New resources are added to the archive if the folder already contains an
+  // archive or if the packed resource storage is enabled, and if the resource
+  // type can be archived.
+  bool useArchiveForNewResources(
+      const ResourceType& type, const std::string& folder) const;
+
   mutable ResourceCache cache_;
+
+  // Archive of every folder that has been looked up, or a nullptr if the
+  // folder doesn't contain an archive. Archives are shared with the callers,
+  // such that unpacking an archive doesn't invalidate blobs that are still
+  // being read.
+  mutable std::unordered_map<std::string, std::shared_ptr<ResourceArchive>>
+      archives_;
+  mutable aslam::ReaderWriterMutex archives_mutex_;
+
+  std::array<ImageCodec, kNumResourceTypes> image_codecs_;
+  mutable std::mutex image_codecs_mutex_;
+
+  struct PendingWrite {
+    size_t write_idx;
+    std::shared_future<void> done;
+  };
+  mutable std::unordered_map<ResourceId, PendingWrite> pending_writes_;
+  size_t next_write_idx_;
+  mutable std::mutex pending_writes_mutex_;
+
+  // Declared last, such that it is destroyed (and all queued writes are
+  // completed) before any other member.
+  std::unique_ptr<aslam::ThreadPool> encoding_thread_pool_;
 };
 
 // Implementation for cv::Mat resources.
 template <>
+bool ResourceLoader::enqueueResourceWrite(
+    const ResourceId& id, const ResourceType& type, const std::string& folder,
+    const cv::Mat& resource);
+template <>
 void ResourceLoader::saveResourceToFile(
     const std::string& file_path, const ResourceType& type,
     const cv::Mat& resource) const;
@@ -87,6 +249,15 @@ template <>
 bool ResourceLoader::loadResourceFromFile(
     const std::string& file_path, const ResourceType& type,
     cv::Mat* resource) const;
+template <>
+void ResourceLoader::encodeResource(
+    const ResourceType& type, const cv::Mat& resource,
+    const std::string& folder, std::string* blob,
+    ResourceArchive::Codec* codec) const;
+template <>
+bool ResourceLoader::decodeResource(
+    const ResourceType& type, const ResourceArchive::BlobView& blob,
+    const std::string& folder, cv::Mat* resource) const;
 
 // Implementation for std::string resources.
 template <>
@@ -97,6 +268,15 @@ template <>
 bool ResourceLoader::loadResourceFromFile(
     const std::string& file_path, const ResourceType& type,
     std::string* resource) const;
+template <>
+void ResourceLoader::encodeResource(
+    const ResourceType& type, const std::string& resource,
+    const std::string& folder, std::string* blob,
+    ResourceArchive::Codec* codec) const;
+template <>
+bool ResourceLoader::decodeResource(
+    const ResourceType& type, const ResourceArchive::BlobView& blob,
+    const std::string& folder, std::string* resource) const;
 
 // Implementation for voxblox::TsdfMap resources.
 template <>
@@ -137,6 +317,15 @@ template <>
 bool ResourceLoader::loadResourceFromFile(
     const std::string& file_path, const ResourceType& type,
     resources::PointCloud* resource) const;
+template <>
+void ResourceLoader::encodeResource(
+    const ResourceType& type, const resources::PointCloud& resource,
+    const std::string& folder, std::string* blob,
+    ResourceArchive::Codec* codec) const;
+template <>
+bool ResourceLoader::decodeResource(
+    const ResourceType& type, const ResourceArchive::BlobView& blob,
+    const std::string& folder, resources::PointCloud* resource) const;
 
 // Implementation for ObjectInstanceBoundingBox resources.
 template <>
@@ -147,6 +336,17 @@ template <>
 bool ResourceLoader::loadResourceFromFile(
     const std::string& file_path, const ResourceType& type,
     resources::ObjectInstanceBoundingBoxes* resource) const;
+template <>
+void ResourceLoader::encodeResource(
+    const ResourceType& type,
+    const resources::ObjectInstanceBoundingBoxes& resource,
+    const std::string& folder, std::string* blob,
+    ResourceArchive::Codec* codec) const;
+template <>
+bool ResourceLoader::decodeResource(
+    const ResourceType& type, const ResourceArchive::BlobView& blob,
+    const std::string& folder,
+    resources::ObjectInstanceBoundingBoxes* resource) const;
 
 }  // namespace backend
 
@@ -75,9 +75,13 @@ class ResourceMap {
     std::vector<std::string> external_resource_folders;
   };
 
-  void migrateAllResourcesToFolder(
+  // Copies or moves all resources that are not yet in the given folder to it.
+  // The resources are transferred in parallel and without copying them if the
+  // file system allows it. If any resource fails to transfer, the migration is
+  // rolled back, the map remains unchanged and false is returned.
+  bool migrateAllResourcesToFolder(
       const std::string& resource_folder, const bool move_resources);
-  void migrateAllResourcesToMapResourceFolder(const bool move_resources);
+  bool migrateAllResourcesToMapResourceFolder(const bool move_resources);
 
   // Use this to change the map folder, e.g. when saving a map to a new folder
   // or when you simply want to change to a different map folder. Set the map
@@ -165,10 +169,23 @@ class ResourceMap {
   // merging them. After cleanup it will perform a check on all resources.
   void cleanupResourceFolders();
 
+  // Blocks until all image resources that are encoded in the background have
+  // been written to the file system.
+  void waitForPendingResourceWrites() const;
+
   // Check if all resource files are present. Does not check the content of the
   // resource files.
   bool checkResourceFileSystem() const;
 
+  // Converts the resources of all resource folders from the file-per-resource
+  // layout into packed resource archives (one per folder) and back. See
+  // ResourceArchive for details.
+  void packResourcesIntoArchives(const bool remove_files);
+  void unpackResourcesFromArchives();
+
+  // Reclaims the space of deleted resources in all packed resource archives.
+  void compactResourceArchives();
+
  protected:
   // Check if the resource file is present and attempt to load it to verify its
   // content.
@@ -241,6 +258,9 @@ class ResourceMap {
 
   bool resourceFileExists(const ResourceId& id, const ResourceType& type) const;
 
+  // Returns all folders that are in use by at least one resource.
+  void getResourceFoldersInUse(std::vector<std::string>* folders) const;
+
   MetaData meta_data_;
 
   typedef std::unordered_map<ResourceId, ResourceInfo> ResourceInfoMap;
@@ -0,0 +1,359 @@
+#include "map-resources/image-codec.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <opencv2/highgui/highgui.hpp>
+
+DEFINE_string(
+    resource_grayscale_image_codec, "pnm",
+    "Codec used to store grayscale image resources, in the form "
+    "<format>[:<quality>], with format pnm, png, jpeg, webp or tiff. E.g. "
+    "'png:1' or 'jpeg:95'.");
+DEFINE_string(
+    resource_color_image_codec, "pnm",
+    "Codec used to store color image resources, see "
+    "--resource_grayscale_image_codec for the format.");
+DEFINE_string(
+    resource_depth_map_codec, "pnm",
+    "Codec used to store 16 bit depth and disparity map resources. Only the "
+    "lossless formats pnm, png and tiff are supported.");
+
+namespace backend {
+
+namespace {
+
+const std::array<std::string, static_cast<size_t>(ImageCodec::Format::kCount)>
+    kImageCodecFormatNames = {{"pnm", "png", "jpeg", "webp", "tiff"}};
+
+const std::array<std::string, static_cast<size_t>(ImageCodec::Format::kCount)>
+    kImageCodecFileExtensions = {{"", ".png", ".jpg", ".webp", ".tiff"}};
+
+ImageCodec parseImageCodecFlag(
+    const std::string& flag_name, const std::string& specification,
+    const bool require_16_bit_support) {
+  ImageCodec codec;
+  CHECK(ImageCodec::fromString(specification, &codec))
+      << "Invalid image codec '" << specification << "' in --" << flag_name
+      << ".";
+  CHECK(!require_16_bit_support || codec.supportsImageDepth(CV_16U))
+      << "The image codec '" << specification << "' in --" << flag_name
+      << " does not support 16 bit images.";
+  return codec;
+}
+
+double getMaxAbsDifference(const cv::Mat& image_A, const cv::Mat& image_B) {
+  if (image_A.size() != image_B.size() || image_A.type() != image_B.type()) {
+    return std::numeric_limits<double>::infinity();
+  }
+  cv::Mat difference;
+  cv::absdiff(image_A, image_B, difference);
+  double max_abs_difference = 0.0;
+  cv::minMaxLoc(
+      difference.reshape(1), nullptr /*min*/, &max_abs_difference);
+  return max_abs_difference;
+}
+
+}  // namespace
+
+bool ImageCodec::fromString(
+    const std::string& specification, ImageCodec* codec) {
+  CHECK_NOTNULL(codec);
+  const size_t separator_pos = specification.find(':');
+  const std::string format_name = specification.substr(0u, separator_pos);
+
+  const std::array<std::string, static_cast<size_t>(Format::kCount)>::
+      const_iterator it = std::find(
+          kImageCodecFormatNames.begin(), kImageCodecFormatNames.end(),
+          format_name);
+  if (it == kImageCodecFormatNames.end()) {
+    return false;
+  }
+  codec->format = static_cast<Format>(
+      std::distance(kImageCodecFormatNames.begin(), it));
+  codec->quality = -1;
+
+  if (separator_pos != std::string::npos) {
+    const std::string quality_string = specification.substr(separator_pos + 1);
+    char* end = nullptr;
+    const long quality = std::strtol(quality_string.c_str(), &end, 10);
+    if (quality_string.empty() || *end != '\0' || quality < 0 ||
+        quality > 101) {
+      return false;
+    }
+    codec->quality = static_cast<int>(quality);
+  }
+
+  switch (codec->format) {
+    case Format::kPng:
+      return codec->quality <= 9;
+    case Format::kJpeg:
+      return codec->quality <= 100;
+    case Format::kPnm:
+    case Format::kTiff:
+      return codec->quality == -1;
+    default:
+      return true;
+  }
+}
+
+std::string ImageCodec::toString() const {
+  CHECK_LT(static_cast<size_t>(format), kImageCodecFormatNames.size());
+  std::string specification =
+      kImageCodecFormatNames[static_cast<size_t>(format)];
+  if (quality >= 0) {
+    specification += ":" + std::to_string(quality);
+  }
+  return specification;
+}
+
+bool ImageCodec::isLossless() const {
+  switch (format) {
+    case Format::kJpeg:
+      return false;
+    case Format::kWebp:
+      return quality > 100;
+    default:
+      return true;
+  }
+}
+
+bool ImageCodec::supportsImageDepth(const int cv_depth) const {
+  if (cv_depth == CV_8U) {
+    return true;
+  }
+  return cv_depth == CV_16U &&
+         (format == Format::kPnm || format == Format::kPng ||
+          format == Format::kTiff);
+}
+
+bool encodeImage(
+    const cv::Mat& image, const ResourceType& type, const ImageCodec& codec,
+    std::vector<uchar>* buffer) {
+  CHECK_NOTNULL(buffer)->clear();
+  if (!codec.supportsImageDepth(image.depth())) {
+    LOG(ERROR) << "Image codec " << codec.toString()
+               << " does not support images of depth " << image.depth() << ".";
+    return false;
+  }
+
+  std::vector<int> parameters;
+  switch (codec.format) {
+    case ImageCodec::Format::kPnm:
+      break;
+    case ImageCodec::Format::kPng:
+      if (codec.quality >= 0) {
+        parameters = {cv::IMWRITE_PNG_COMPRESSION, codec.quality};
+      }
+      break;
+    case ImageCodec::Format::kJpeg:
+      if (codec.quality >= 0) {
+        parameters = {cv::IMWRITE_JPEG_QUALITY, codec.quality};
+      }
+      break;
+    case ImageCodec::Format::kWebp:
+      if (codec.quality >= 0) {
+        parameters = {cv::IMWRITE_WEBP_QUALITY, codec.quality};
+      }
+      break;
+    case ImageCodec::Format::kTiff:
+      break;
+    default:
+      LOG(FATAL) << "Unknown image codec format: "
+                 << static_cast<int>(codec.format);
+  }
+  return cv::imencode(
+      getImageFileExtension(codec, type), image, *buffer, parameters);
+}
+
+std::string getImageFileExtension(
+    const ImageCodec& codec, const ResourceType& type) {
+  CHECK_LT(
+      static_cast<size_t>(codec.format), kImageCodecFileExtensions.size());
+  if (codec.format == ImageCodec::Format::kPnm) {
+    return ResourceTypeFileSuffix[static_cast<size_t>(type)];
+  }
+  return kImageCodecFileExtensions[static_cast<size_t>(codec.format)];
+}
+
+bool getImageFormatOfEncodedImage(
+    const char* data, const size_t num_bytes, ImageCodec::Format* format) {
+  CHECK(data != nullptr || num_bytes == 0u);
+  CHECK_NOTNULL(format);
+  const std::string signature(data, std::min<size_t>(num_bytes, 12u));
+  if (signature.compare(0u, 4u, "\x89PNG") == 0) {
+    *format = ImageCodec::Format::kPng;
+  } else if (signature.compare(0u, 2u, "\xFF\xD8") == 0) {
+    *format = ImageCodec::Format::kJpeg;
+  } else if (
+      signature.size() == 12u && signature.compare(0u, 4u, "RIFF") == 0 &&
+      signature.compare(8u, 4u, "WEBP") == 0) {
+    *format = ImageCodec::Format::kWebp;
+  } else if (
+      signature.compare(0u, 4u, std::string("II*\0", 4u)) == 0 ||
+      signature.compare(0u, 4u, std::string("MM\0*", 4u)) == 0) {
+    *format = ImageCodec::Format::kTiff;
+  } else if (
+      signature.size() >= 2u && signature[0] == 'P' && signature[1] >= '1' &&
+      signature[1] <= '6') {
+    *format = ImageCodec::Format::kPnm;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// NOTE: [ADD_RESOURCE_TYPE] Add case if you add a new cv::Mat resource type.
+ImageCodec getDefaultImageCodec(const ResourceType& type) {
+  static const ImageCodec kGrayscaleImageCodec = parseImageCodecFlag(
+      "resource_grayscale_image_codec", FLAGS_resource_grayscale_image_codec,
+      false /*require_16_bit_support*/);
+  static const ImageCodec kColorImageCodec = parseImageCodecFlag(
+      "resource_color_image_codec", FLAGS_resource_color_image_codec,
+      false /*require_16_bit_support*/);
+  static const ImageCodec kDepthMapCodec = parseImageCodecFlag(
+      "resource_depth_map_codec", FLAGS_resource_depth_map_codec,
+      true /*require_16_bit_support*/);
+
+  switch (type) {
+    case ResourceType::kRawImage:
+    case ResourceType::kUndistortedImage:
+    case ResourceType::kRectifiedImage:
+    case ResourceType::kImageForDepthMap:
+      return kGrayscaleImageCodec;
+    case ResourceType::kRawColorImage:
+    case ResourceType::kUndistortedColorImage:
+    case ResourceType::kRectifiedColorImage:
+    case ResourceType::kColorImageForDepthMap:
+      return kColorImageCodec;
+    case ResourceType::kRawDepthMap:
+    case ResourceType::kOptimizedDepthMap:
+    case ResourceType::kDisparityMap:
+      return kDepthMapCodec;
+    case ResourceType::kObjectInstanceMasks:
+      // Masks encode instance labels, which lossy codecs would corrupt.
+      return ImageCodec();
+    default:
+      LOG(FATAL) << "Unknown cv::Mat resource type: "
+                 << ResourceTypeNames[static_cast<size_t>(type)];
+  }
+  return ImageCodec();
+}
+
+// NOTE: [ADD_RESOURCE_TYPE] Add case if you add a new cv::Mat resource type.
+bool isImageResourceType(const ResourceType& type) {
+  switch (type) {
+    case ResourceType::kRawImage:
+    case ResourceType::kUndistortedImage:
+    case ResourceType::kRectifiedImage:
+    case ResourceType::kImageForDepthMap:
+    case ResourceType::kRawColorImage:
+    case ResourceType::kUndistortedColorImage:
+    case ResourceType::kRectifiedColorImage:
+    case ResourceType::kColorImageForDepthMap:
+    case ResourceType::kRawDepthMap:
+    case ResourceType::kOptimizedDepthMap:
+    case ResourceType::kDisparityMap:
+    case ResourceType::kObjectInstanceMasks:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// NOTE: [ADD_RESOURCE_TYPE] Add case if you add a new cv::Mat resource type.
+void getImreadFlagAndMatType(
+    const ResourceType& type, int* imread_flag, int* mat_type) {
+  CHECK_NOTNULL(imread_flag);
+  CHECK_NOTNULL(mat_type);
+  switch (type) {
+    case ResourceType::kRawDepthMap:
+    case ResourceType::kOptimizedDepthMap:
+      *imread_flag = cv::IMREAD_UNCHANGED;
+      *mat_type = CV_16UC1;
+      break;
+    case ResourceType::kUndistortedImage:
+    case ResourceType::kRectifiedImage:
+    case ResourceType::kImageForDepthMap:
+    case ResourceType::kRawImage:
+      *imread_flag = cv::IMREAD_GRAYSCALE;
+      *mat_type = CV_8UC1;
+      break;
+    case ResourceType::kUndistortedColorImage:
+    case ResourceType::kRectifiedColorImage:
+    case ResourceType::kColorImageForDepthMap:
+    case ResourceType::kRawColorImage:
+    case ResourceType::kObjectInstanceMasks:
+      *imread_flag = cv::IMREAD_COLOR;
+      *mat_type = CV_8UC3;
+      break;
+    case ResourceType::kDisparityMap:
+      *imread_flag = cv::IMREAD_UNCHANGED;
+      *mat_type = CV_16UC1;
+      break;
+    default:
+      LOG(FATAL) << "Unknown cv::Mat resource type: "
+                 << ResourceTypeNames[static_cast<size_t>(type)];
+  }
+}
+
+double ImageCodecBenchmarkResult::bytesPerImage() const {
+  return num_images > 0u ? static_cast<double>(num_encoded_bytes) / num_images
+                         : 0.0;
+}
+
+double ImageCodecBenchmarkResult::decodingMegabytesPerSecond() const {
+  return decoding_time_s > 0.0 ? num_raw_bytes / (decoding_time_s * 1e6) : 0.0;
+}
+
+double ImageCodecBenchmarkResult::encodingMegabytesPerSecond() const {
+  return encoding_time_s > 0.0 ? num_raw_bytes / (encoding_time_s * 1e6) : 0.0;
+}
+
+void benchmarkImageCodecs(
+    const std::vector<cv::Mat>& images, const ResourceType& type,
+    const std::vector<ImageCodec>& codecs,
+    std::vector<ImageCodecBenchmarkResult>* results) {
+  CHECK_NOTNULL(results)->clear();
+  int imread_flag;
+  int mat_type;
+  getImreadFlagAndMatType(type, &imread_flag, &mat_type);
+
+  typedef std::chrono::steady_clock Clock;
+  std::vector<uchar> buffer;
+  for (const ImageCodec& codec : codecs) {
+    ImageCodecBenchmarkResult result;
+    result.codec = codec;
+    for (const cv::Mat& image : images) {
+      if (!codec.supportsImageDepth(image.depth())) {
+        continue;
+      }
+      const Clock::time_point encoding_start = Clock::now();
+      CHECK(encodeImage(image, type, codec, &buffer));
+      const Clock::time_point decoding_start = Clock::now();
+      const cv::Mat decoded_image = cv::imdecode(buffer, imread_flag);
+      const Clock::time_point decoding_end = Clock::now();
+
+      result.encoding_time_s +=
+          std::chrono::duration<double>(decoding_start - encoding_start)
+              .count();
+      result.decoding_time_s +=
+          std::chrono::duration<double>(decoding_end - decoding_start).count();
+      ++result.num_images;
+      result.num_raw_bytes += image.total() * image.elemSize();
+      result.num_encoded_bytes += buffer.size();
+      result.max_abs_error = std::max(
+          result.max_abs_error, getMaxAbsDifference(image, decoded_image));
+    }
+    results->emplace_back(result);
+  }
+}
+
+}  // namespace backend
@@ -0,0 +1,577 @@
+#include "map-resources/resource-archive.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>  // NOLINT
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <maplab-common/file-system-tools.h>
+
+DEFINE_uint64(
+    resource_archive_max_segment_size_mb, 1024u,
+    "Maximum size of a single segment file of a packed resource archive. Once "
+    "a segment exceeds this size, a new segment is started.");
+
+namespace backend {
+
+namespace {
+
+const std::string kArchiveFolderName = "resource_archive";  // NOLINT
+const std::string kIndexFileName = "index.bin";             // NOLINT
+const std::string kCompactionFolderSuffix = "_compaction";  // NOLINT
+
+constexpr char kIndexMagic[4] = {'M', 'L', 'R', 'A'};
+constexpr uint32_t kIndexVersion = 1u;
+
+enum class IndexOperation : uint8_t { kAdd = 0u, kRemove = 1u };
+
+// Fixed size record of the index log:
+// [op:1][type:1][codec:1][pad:1][segment:4][id:16][offset:8][num_bytes:8]
+constexpr size_t kIndexRecordSize = 40u;
+
+void serializeIndexRecord(
+    const IndexOperation operation, const ResourceType& type,
+    const ResourceId& id, const ResourceArchive::Entry& entry,
+    char* record) {
+  CHECK_NOTNULL(record);
+  std::memset(record, 0, kIndexRecordSize);
+  record[0] = static_cast<char>(operation);
+  record[1] = static_cast<char>(static_cast<uint8_t>(type));
+  record[2] = static_cast<char>(entry.codec);
+  std::memcpy(record + 4, &entry.segment_idx, sizeof(entry.segment_idx));
+  aslam::HashId hash_id;
+  id.toHashId(&hash_id);
+  uint64_t id_values[2];
+  hash_id.toUint64(id_values);
+  std::memcpy(record + 8, id_values, sizeof(id_values));
+  std::memcpy(record + 24, &entry.offset, sizeof(entry.offset));
+  std::memcpy(record + 32, &entry.num_bytes, sizeof(entry.num_bytes));
+}
+
+void deserializeIndexRecord(
+    const char* record, IndexOperation* operation, ResourceType* type,
+    ResourceId* id, ResourceArchive::Entry* entry) {
+  CHECK_NOTNULL(record);
+  CHECK_NOTNULL(operation);
+  CHECK_NOTNULL(type);
+  CHECK_NOTNULL(id);
+  CHECK_NOTNULL(entry);
+  *operation = static_cast<IndexOperation>(static_cast<uint8_t>(record[0]));
+  *type = static_cast<ResourceType>(static_cast<uint8_t>(record[1]));
+  entry->codec =
+      static_cast<ResourceArchive::Codec>(static_cast<uint8_t>(record[2]));
+  std::memcpy(&entry->segment_idx, record + 4, sizeof(entry->segment_idx));
+  uint64_t id_values[2];
+  std::memcpy(id_values, record + 8, sizeof(id_values));
+  id->fromHashId(aslam::HashId(id_values));
+  std::memcpy(&entry->offset, record + 24, sizeof(entry->offset));
+  std::memcpy(&entry->num_bytes, record + 32, sizeof(entry->num_bytes));
+}
+
+void writeIndexHeader(std::ofstream* index_file) {
+  CHECK_NOTNULL(index_file);
+  index_file->write(kIndexMagic, sizeof(kIndexMagic));
+  index_file->write(
+      reinterpret_cast<const char*>(&kIndexVersion), sizeof(kIndexVersion));
+}
+
+void writeToFileDescriptor(
+    const int file_descriptor, const char* data, const size_t num_bytes) {
+  size_t num_bytes_written = 0u;
+  while (num_bytes_written < num_bytes) {
+    const ssize_t result = ::write(
+        file_descriptor, data + num_bytes_written,
+        num_bytes - num_bytes_written);
+    CHECK_GE(result, 0) << "Failed to write to resource archive segment: "
+                        << std::strerror(errno);
+    num_bytes_written += static_cast<size_t>(result);
+  }
+}
+
+size_t getFileSize(const std::string& file_path) {
+  struct stat file_stat;
+  CHECK_EQ(::stat(file_path.c_str(), &file_stat), 0)
+      << "Unable to stat file: " << file_path;
+  return static_cast<size_t>(file_stat.st_size);
+}
+
+}  // namespace
+
+struct ResourceArchive::Mapping {
+  Mapping(const char* _data, const size_t _num_bytes)
+      : data(_data), num_bytes(_num_bytes) {}
+  ~Mapping() {
+    if (data != nullptr && num_bytes > 0u) {
+      ::munmap(const_cast<char*>(data), num_bytes);
+    }
+  }
+  const char* const data;
+  const size_t num_bytes;
+};
+
+ResourceArchive::ResourceArchive(const std::string& resource_folder)
+    : resource_folder_(resource_folder),
+      archive_folder_(getArchiveFolder(resource_folder)),
+      num_total_bytes_(0u),
+      num_dead_bytes_(0u),
+      active_segment_idx_(0u),
+      active_segment_num_bytes_(0u),
+      active_segment_fd_(-1) {
+  CHECK(!resource_folder_.empty());
+  if (archiveExists(resource_folder_)) {
+    loadIndex();
+  }
+}
+
+ResourceArchive::~ResourceArchive() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  closeIndex();
+  closeSegment();
+  releaseMappings();
+}
+
+bool ResourceArchive::archiveExists(const std::string& resource_folder) {
+  return common::fileExists(common::concatenateFolderAndFileName(
+      getArchiveFolder(resource_folder), kIndexFileName));
+}
+
+std::string ResourceArchive::getArchiveFolder(
+    const std::string& resource_folder) {
+  CHECK(!resource_folder.empty());
+  return common::concatenateFolderAndFileName(
+      resource_folder, kArchiveFolderName);
+}
+
+std::string ResourceArchive::getSegmentPath(const uint32_t segment_idx) const {
+  char file_name[32];
+  std::snprintf(file_name, sizeof(file_name), "segment_%06u.bin", segment_idx);
+  return common::concatenateFolderAndFileName(archive_folder_, file_name);
+}
+
+std::string ResourceArchive::getIndexPath() const {
+  return common::concatenateFolderAndFileName(archive_folder_, kIndexFileName);
+}
+
+void ResourceArchive::loadIndex() {
+  const std::string index_path = getIndexPath();
+  std::ifstream index_file(index_path, std::ios::binary);
+  CHECK(index_file.is_open())
+      << "Unable to open resource archive index: " << index_path;
+
+  char magic[sizeof(kIndexMagic)];
+  uint32_t version = 0u;
+  index_file.read(magic, sizeof(magic));
+  index_file.read(reinterpret_cast<char*>(&version), sizeof(version));
+  CHECK(index_file.good() && std::memcmp(magic, kIndexMagic, 4u) == 0)
+      << "The resource archive index " << index_path << " is corrupted!";
+  CHECK_EQ(version, kIndexVersion)
+      << "Unsupported resource archive version in " << index_path;
+
+  // Replay the log. A truncated record at the end can only be the result of
+  // an interrupted append and is ignored.
+  char record[kIndexRecordSize];
+  size_t num_records = 0u;
+  while (index_file.read(record, kIndexRecordSize)) {
+    IndexOperation operation;
+    ResourceType type;
+    ResourceId id;
+    Entry entry;
+    deserializeIndexRecord(record, &operation, &type, &id, &entry);
+    CHECK_LT(static_cast<size_t>(type), kNumResourceTypes);
+    CHECK_LT(
+        static_cast<size_t>(entry.codec), static_cast<size_t>(Codec::kCount));
+    const Key key(type, id);
+    if (operation == IndexOperation::kAdd) {
+      index_[key] = entry;
+    } else {
+      CHECK(operation == IndexOperation::kRemove);
+      index_.erase(key);
+    }
+    ++num_records;
+  }
+  LOG_IF(WARNING, index_file.gcount() != 0)
+      << "Ignoring incomplete trailing record in resource archive index "
+      << index_path;
+
+  // Determine the size of all segments and continue appending to the last one.
+  uint32_t segment_idx = 0u;
+  while (common::fileExists(getSegmentPath(segment_idx))) {
+    num_total_bytes_ += getFileSize(getSegmentPath(segment_idx));
+    active_segment_idx_ = segment_idx;
+    ++segment_idx;
+  }
+
+  size_t num_live_bytes = 0u;
+  for (const Index::value_type& key_entry : index_) {
+    CHECK(common::fileExists(getSegmentPath(key_entry.second.segment_idx)))
+        << "The resource archive in " << archive_folder_
+        << " references a missing segment!";
+    num_live_bytes += key_entry.second.num_bytes;
+  }
+  CHECK_GE(num_total_bytes_, num_live_bytes);
+  num_dead_bytes_ = num_total_bytes_ - num_live_bytes;
+
+  VLOG(2) << "Loaded resource archive " << archive_folder_ << " with "
+          << index_.size() << " resources from " << num_records
+          << " index records, " << segment_idx << " segments and "
+          << num_dead_bytes_ << " dead bytes.";
+}
+
+void ResourceArchive::appendIndexRecord(
+    const bool is_removal, const Key& key, const Entry& entry) {
+  const std::string index_path = getIndexPath();
+  if (!index_file_.is_open()) {
+    const bool is_new_index = !common::fileExists(index_path);
+    index_file_.open(
+        index_path, std::ios::binary | std::ios::out | std::ios::app);
+    CHECK(index_file_.is_open())
+        << "Unable to open resource archive index: " << index_path;
+    if (is_new_index) {
+      writeIndexHeader(&index_file_);
+    }
+  }
+  char record[kIndexRecordSize];
+  serializeIndexRecord(
+      is_removal ? IndexOperation::kRemove : IndexOperation::kAdd, key.first,
+      key.second, entry, record);
+  index_file_.write(record, kIndexRecordSize);
+  // Flush every record, such that the index on disk is always complete.
+  index_file_.flush();
+  CHECK(index_file_.good())
+      << "Failed to write to resource archive index: " << index_path;
+}
+
+void ResourceArchive::closeIndex() {
+  if (index_file_.is_open()) {
+    index_file_.close();
+  }
+}
+
+void ResourceArchive::rewriteIndex(
+    const std::string& index_path, const Index& index) const {
+  std::ofstream index_file(
+      index_path, std::ios::binary | std::ios::out | std::ios::trunc);
+  CHECK(index_file.is_open())
+      << "Unable to open resource archive index: " << index_path;
+  writeIndexHeader(&index_file);
+  char record[kIndexRecordSize];
+  for (const Index::value_type& key_entry : index) {
+    serializeIndexRecord(
+        IndexOperation::kAdd, key_entry.first.first, key_entry.first.second,
+        key_entry.second, record);
+    index_file.write(record, kIndexRecordSize);
+  }
+  CHECK(index_file.good())
+      << "Failed to write resource archive index: " << index_path;
+}
+
+void ResourceArchive::openSegmentForWriting(const uint32_t segment_idx) {
+  closeSegment();
+  CHECK(common::createPath(archive_folder_))
+      << "Unable to create resource archive folder: " << archive_folder_;
+  const std::string segment_path = getSegmentPath(segment_idx);
+  active_segment_fd_ =
+      ::open(segment_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  CHECK_GE(active_segment_fd_, 0)
+      << "Unable to open resource archive segment: " << segment_path;
+  const off_t segment_size = ::lseek(active_segment_fd_, 0, SEEK_END);
+  CHECK_GE(segment_size, 0);
+  active_segment_idx_ = segment_idx;
+  active_segment_num_bytes_ = static_cast<uint64_t>(segment_size);
+}
+
+void ResourceArchive::closeSegment() {
+  if (active_segment_fd_ >= 0) {
+    ::close(active_segment_fd_);
+    active_segment_fd_ = -1;
+  }
+}
+
+void ResourceArchive::append(
+    const ResourceId& id, const ResourceType& type, const std::string& blob,
+    const Codec codec) {
+  append(id, type, blob.data(), blob.size(), codec);
+}
+
+void ResourceArchive::append(
+    const ResourceId& id, const ResourceType& type, const char* data,
+    const size_t num_bytes, const Codec codec) {
+  CHECK(id.isValid());
+  CHECK(data != nullptr || num_bytes == 0u);
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Key key(type, id);
+  CHECK_EQ(index_.count(key), 0u)
+      << "Resource " << id.hexString() << " of type "
+      << ResourceTypeNames[static_cast<size_t>(type)]
+      << " is already part of the resource archive " << archive_folder_;
+
+  const uint64_t max_segment_num_bytes =
+      FLAGS_resource_archive_max_segment_size_mb * 1024u * 1024u;
+  if (active_segment_fd_ < 0) {
+    openSegmentForWriting(active_segment_idx_);
+  }
+  if (active_segment_num_bytes_ > 0u &&
+      active_segment_num_bytes_ + num_bytes > max_segment_num_bytes) {
+    openSegmentForWriting(active_segment_idx_ + 1u);
+  }
+
+  Entry entry;
+  entry.segment_idx = active_segment_idx_;
+  entry.offset = active_segment_num_bytes_;
+  entry.num_bytes = num_bytes;
+  entry.codec = codec;
+
+  // Write the data before the index record, such that a crash in between
+  // leaves only dead bytes behind but never a dangling index entry.
+  writeToFileDescriptor(active_segment_fd_, data, num_bytes);
+  active_segment_num_bytes_ += num_bytes;
+  num_total_bytes_ += num_bytes;
+
+  appendIndexRecord(false /*is_removal*/, key, entry);
+  index_.emplace(key, entry);
+}
+
+bool ResourceArchive::contains(
+    const ResourceId& id, const ResourceType& type) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.count(Key(type, id)) > 0u;
+}
+
+ResourceArchive::MappingPtr ResourceArchive::getMapping(
+    const uint32_t segment_idx, const size_t required_num_bytes) const {
+  MappingPtr& segment_mapping = mappings_[segment_idx];
+  if (segment_mapping != nullptr &&
+      segment_mapping->num_bytes >= required_num_bytes) {
+    return segment_mapping;
+  }
+
+  const std::string segment_path = getSegmentPath(segment_idx);
+  const int file_descriptor = ::open(segment_path.c_str(), O_RDONLY);
+  CHECK_GE(file_descriptor, 0)
+      << "Unable to open resource archive segment: " << segment_path;
+  const off_t segment_size = ::lseek(file_descriptor, 0, SEEK_END);
+  CHECK_GE(static_cast<size_t>(segment_size), required_num_bytes)
+      << "Resource archive segment " << segment_path << " is truncated!";
+  void* data = ::mmap(
+      nullptr, static_cast<size_t>(segment_size), PROT_READ, MAP_SHARED,
+      file_descriptor, 0);
+  ::close(file_descriptor);
+  CHECK(data != MAP_FAILED) << "Unable to map resource archive segment "
+                            << segment_path << ": " << std::strerror(errno);
+
+  segment_mapping = std::make_shared<const Mapping>(
+      static_cast<const char*>(data), static_cast<size_t>(segment_size));
+  return segment_mapping;
+}
+
+void ResourceArchive::releaseMappings() {
+  mappings_.clear();
+}
+
+bool ResourceArchive::getBlobViewImpl(const Key& key, BlobView* view) const {
+  CHECK_NOTNULL(view);
+  const Index::const_iterator it = index_.find(key);
+  if (it == index_.cend()) {
+    return false;
+  }
+  const Entry& entry = it->second;
+  view->codec = entry.codec;
+  view->num_bytes = entry.num_bytes;
+  if (entry.num_bytes == 0u) {
+    view->data = nullptr;
+    view->mapping.reset();
+    return true;
+  }
+  view->mapping =
+      getMapping(entry.segment_idx, entry.offset + entry.num_bytes);
+  view->data = view->mapping->data + entry.offset;
+  return true;
+}
+
+bool ResourceArchive::getBlobView(
+    const ResourceId& id, const ResourceType& type, BlobView* view) const {
+  CHECK_NOTNULL(view);
+  std::lock_guard<std::mutex> lock(mutex_);
+  return getBlobViewImpl(Key(type, id), view);
+}
+
+bool ResourceArchive::getBlob(
+    const ResourceId& id, const ResourceType& type, std::string* blob,
+    Codec* codec) const {
+  CHECK_NOTNULL(blob)->clear();
+  CHECK_NOTNULL(codec);
+  std::lock_guard<std::mutex> lock(mutex_);
+  BlobView view;
+  if (!getBlobViewImpl(Key(type, id), &view)) {
+    return false;
+  }
+  blob->assign(view.data, view.num_bytes);
+  *codec = view.codec;
+  return true;
+}
+
+bool ResourceArchive::remove(const ResourceId& id, const ResourceType& type) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Key key(type, id);
+  const Index::iterator it = index_.find(key);
+  if (it == index_.end()) {
+    return false;
+  }
+  appendIndexRecord(true /*is_removal*/, key, it->second);
+  num_dead_bytes_ += it->second.num_bytes;
+  index_.erase(it);
+  return true;
+}
+
+void ResourceArchive::getResourceIds(
+    ResourceTypeToIdsMap* resource_ids) const {
+  CHECK_NOTNULL(resource_ids)->clear();
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const Index::value_type& key_entry : index_) {
+    (*resource_ids)[key_entry.first.first].insert(key_entry.first.second);
+  }
+}
+
+size_t ResourceArchive::numResources() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.size();
+}
+
+size_t ResourceArchive::numTotalBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_total_bytes_;
+}
+
+size_t ResourceArchive::numDeadBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_dead_bytes_;
+}
+
+void ResourceArchive::compact() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!common::fileExists(getIndexPath())) {
+    return;
+  }
+  closeIndex();
+  closeSegment();
+
+  // Copy the live blobs in the order they are stored, such that the old
+  // segments are read sequentially.
+  std::vector<std::pair<Key, Entry>> entries(index_.begin(), index_.end());
+  std::sort(
+      entries.begin(), entries.end(),
+      [](const std::pair<Key, Entry>& lhs, const std::pair<Key, Entry>& rhs) {
+        return std::make_pair(lhs.second.segment_idx, lhs.second.offset) <
+               std::make_pair(rhs.second.segment_idx, rhs.second.offset);
+      });
+
+  const std::string compaction_folder =
+      archive_folder_ + kCompactionFolderSuffix;
+  if (common::pathExists(compaction_folder)) {
+    CHECK(common::removePath(compaction_folder));
+  }
+  CHECK(common::createPath(compaction_folder))
+      << "Unable to create folder for compaction: " << compaction_folder;
+
+  const uint64_t max_segment_num_bytes =
+      FLAGS_resource_archive_max_segment_size_mb * 1024u * 1024u;
+  uint32_t new_segment_idx = 0u;
+  uint64_t new_segment_num_bytes = 0u;
+  int new_segment_fd = -1;
+  Index new_index;
+  for (const std::pair<Key, Entry>& key_entry : entries) {
+    const Entry& entry = key_entry.second;
+    if (new_segment_fd < 0 ||
+        (new_segment_num_bytes > 0u &&
+         new_segment_num_bytes + entry.num_bytes > max_segment_num_bytes)) {
+      if (new_segment_fd >= 0) {
+        ::close(new_segment_fd);
+        ++new_segment_idx;
+      }
+      char file_name[32];
+      std::snprintf(
+          file_name, sizeof(file_name), "segment_%06u.bin", new_segment_idx);
+      const std::string segment_path =
+          common::concatenateFolderAndFileName(compaction_folder, file_name);
+      new_segment_fd = ::open(
+          segment_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      CHECK_GE(new_segment_fd, 0)
+          << "Unable to create resource archive segment: " << segment_path;
+      new_segment_num_bytes = 0u;
+    }
+
+    if (entry.num_bytes > 0u) {
+      const MappingPtr mapping =
+          getMapping(entry.segment_idx, entry.offset + entry.num_bytes);
+      writeToFileDescriptor(
+          new_segment_fd, mapping->data + entry.offset, entry.num_bytes);
+    }
+
+    Entry new_entry = entry;
+    new_entry.segment_idx = new_segment_idx;
+    new_entry.offset = new_segment_num_bytes;
+    new_index.emplace(key_entry.first, new_entry);
+    new_segment_num_bytes += entry.num_bytes;
+  }
+  if (new_segment_fd >= 0) {
+    ::close(new_segment_fd);
+  }
+
+  rewriteIndex(
+      common::concatenateFolderAndFileName(compaction_folder, kIndexFileName),
+      new_index);
+
+  const size_t num_bytes_before = num_total_bytes_;
+  releaseMappings();
+
+  // Swap in the compacted archive. The old archive is only deleted once the
+  // new one is in place.
+  const std::string old_archive_folder = archive_folder_ + "_old";
+  CHECK_EQ(std::rename(archive_folder_.c_str(), old_archive_folder.c_str()), 0)
+      << "Unable to move resource archive " << archive_folder_;
+  CHECK_EQ(std::rename(compaction_folder.c_str(), archive_folder_.c_str()), 0)
+      << "Unable to move compacted resource archive to " << archive_folder_;
+  CHECK(common::removePath(old_archive_folder));
+
+  index_.swap(new_index);
+  num_total_bytes_ = 0u;
+  for (const Index::value_type& key_entry : index_) {
+    num_total_bytes_ += key_entry.second.num_bytes;
+  }
+  num_dead_bytes_ = 0u;
+  active_segment_idx_ = new_segment_idx;
+  active_segment_num_bytes_ = new_segment_num_bytes;
+
+  VLOG(1) << "Compacted resource archive " << archive_folder_ << " from "
+          << num_bytes_before << " to " << num_total_bytes_ << " bytes.";
+}
+
+void ResourceArchive::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  closeIndex();
+  closeSegment();
+  // The mappings of the removed segments stay readable as long as BlobViews
+  // into them exist.
+  releaseMappings();
+  index_.clear();
+  num_total_bytes_ = 0u;
+  num_dead_bytes_ = 0u;
+  active_segment_idx_ = 0u;
+  active_segment_num_bytes_ = 0u;
+  if (common::pathExists(archive_folder_)) {
+    CHECK(common::removePath(archive_folder_))
+        << "Unable to remove resource archive " << archive_folder_;
+  }
+}
+
+}  // namespace backend
@@ -1,7 +1,19 @@
 #include "map-resources/resource-loader.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <fstream>  // NOLINT
+#include <future>
+#include <istream>
+#include <sstream>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <aslam/common/unique-id.h>
+#include <gflags/gflags.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/text_format.h>
 #include <map-resources/resource_object_instance_bbox.pb.h>
 #include <maplab-common/file-system-tools.h>
 #include <maplab-common/proto-serialization-helper.h>
@@ -10,51 +22,405 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <voxblox/io/layer_io.h>
 
+#include "map-resources/image-codec.h"
+
+DEFINE_bool(
+    resource_use_packed_archive, false,
+    "If enabled, new resources are appended to a packed resource archive "
+    "inside the resource folder instead of being stored as one file per "
+    "resource. Folders that already contain an archive always use it.");
+DEFINE_bool(
+    resource_migration_allow_hard_links, false,
+    "If enabled, copying resources to a folder on the same file system creates "
+    "hard links instead of copies. Only enable this if the resource files are "
+    "never modified in place by any other tool.");
+DEFINE_int32(
+    resource_image_encoding_num_threads, 0,
+    "Number of threads used to encode and write image resources in the "
+    "background. If 0, image resources are written synchronously.");
+DEFINE_int32(
+    resource_image_encoding_max_queued_images, 64,
+    "Maximum number of image resources that are queued for background "
+    "encoding. Further images are written synchronously, which limits the "
+    "memory used by the queued image copies.");
+
 namespace backend {
 
+namespace {
+
+bool readFileToString(const std::string& file_path, std::string* content) {
+  CHECK_NOTNULL(content)->clear();
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  *content = buffer.str();
+  return true;
+}
+
+// Returns the part of the file name of a resource file that follows the id.
+std::string getResourceFileExtension(
+    const ResourceId& id, const std::string& file_path) {
+  const std::string id_string = id.hexString();
+  const size_t id_position = file_path.rfind(id_string);
+  CHECK_NE(id_position, std::string::npos)
+      << "The resource file " << file_path << " does not belong to resource "
+      << id_string << ".";
+  return file_path.substr(id_position + id_string.size());
+}
+
+void writeStringToFile(
+    const std::string& content, const std::string& file_path) {
+  CHECK(common::createPathToFile(file_path));
+  std::ofstream file(file_path, std::ios::binary);
+  CHECK(file.is_open()) << "Unable to write resource file: " << file_path;
+  file.write(content.data(), content.size());
+  CHECK(file.good()) << "Unable to write resource file: " << file_path;
+}
+
+// Read-only stream buffer over memory owned by someone else, used to decode
+// blobs directly from the mapped resource archive.
+class BlobStreamBuffer : public std::streambuf {
+ public:
+  explicit BlobStreamBuffer(const ResourceArchive::BlobView& blob) {
+    char* data = const_cast<char*>(blob.data);
+    setg(data, data, data + blob.num_bytes);
+  }
+};
+
+void boundingBoxesToProto(
+    const resources::ObjectInstanceBoundingBoxes& resource,
+    resources::proto::ObjectInstanceBoundingBoxes* object_instance_bboxes) {
+  CHECK_NOTNULL(object_instance_bboxes);
+  const size_t n_bboxes = resource.size();
+  object_instance_bboxes->mutable_object_instance_bbox()->Reserve(n_bboxes);
+
+  for (size_t idx = 0u; idx < n_bboxes; ++idx) {
+    const resources::ObjectInstanceBoundingBox bbox = resource[idx];
+    resources::proto::ObjectInstanceBoundingBox* object_bbox_proto_ptr =
+        object_instance_bboxes->add_object_instance_bbox();
+
+    object_bbox_proto_ptr->set_bbox_column(bbox.bounding_box.x);
+    object_bbox_proto_ptr->set_bbox_row(bbox.bounding_box.y);
+    object_bbox_proto_ptr->set_bbox_width(bbox.bounding_box.width);
+    object_bbox_proto_ptr->set_bbox_height(bbox.bounding_box.height);
+
+    object_bbox_proto_ptr->set_class_number(bbox.class_number);
+    object_bbox_proto_ptr->set_instance_number(bbox.instance_number);
+
+    object_bbox_proto_ptr->set_confidence(bbox.confidence);
+
+    object_bbox_proto_ptr->set_class_name(bbox.class_name);
+  }
+}
+
+void protoToBoundingBoxes(
+    const resources::proto::ObjectInstanceBoundingBoxes& object_instance_bboxes,
+    resources::ObjectInstanceBoundingBoxes* resource) {
+  CHECK_NOTNULL(resource);
+  const size_t n_bboxes = static_cast<size_t>(
+      object_instance_bboxes.object_instance_bbox_size());
+  resource->resize(n_bboxes);
+
+  for (size_t idx = 0u; idx < n_bboxes; ++idx) {
+    resources::ObjectInstanceBoundingBox& bbox = (*resource)[idx];
+    const resources::proto::ObjectInstanceBoundingBox& object_bbox_proto =
+        object_instance_bboxes.object_instance_bbox(idx);
+
+    bbox.bounding_box.x = object_bbox_proto.bbox_column();
+    bbox.bounding_box.y = object_bbox_proto.bbox_row();
+    bbox.bounding_box.width = object_bbox_proto.bbox_width();
+    bbox.bounding_box.height = object_bbox_proto.bbox_height();
+
+    bbox.class_number = object_bbox_proto.class_number();
+    bbox.instance_number = object_bbox_proto.instance_number();
+
+    bbox.confidence = object_bbox_proto.confidence();
+
+    bbox.class_name = object_bbox_proto.class_name();
+  }
+}
+
+}  // namespace
+
+ResourceLoader::ResourceLoader() : next_write_idx_(0u) {
+  for (size_t type_idx = 0u; type_idx < kNumResourceTypes; ++type_idx) {
+    const ResourceType type = static_cast<ResourceType>(type_idx);
+    if (isImageResourceType(type)) {
+      image_codecs_[type_idx] = getDefaultImageCodec(type);
+    }
+  }
+  if (FLAGS_resource_image_encoding_num_threads > 0) {
+    encoding_thread_pool_.reset(
+        new aslam::ThreadPool(FLAGS_resource_image_encoding_num_threads));
+  }
+}
+
+ResourceLoader::~ResourceLoader() {
+  waitForPendingWrites();
+}
+
+void ResourceLoader::setImageCodec(
+    const ResourceType& type, const ImageCodec& codec) {
+  CHECK(isImageResourceType(type))
+      << "Resource type " << ResourceTypeNames[static_cast<size_t>(type)]
+      << " is not an image resource type.";
+  if (type == ResourceType::kRawDepthMap ||
+      type == ResourceType::kOptimizedDepthMap ||
+      type == ResourceType::kDisparityMap) {
+    CHECK(codec.supportsImageDepth(CV_16U))
+        << "The image codec " << codec.toString()
+        << " does not support 16 bit images.";
+  }
+  // Resources that are still being encoded keep the codec they were added
+  // with.
+  waitForPendingWrites();
+  std::lock_guard<std::mutex> lock(image_codecs_mutex_);
+  image_codecs_[static_cast<size_t>(type)] = codec;
+}
+
+ImageCodec ResourceLoader::getImageCodec(const ResourceType& type) const {
+  std::lock_guard<std::mutex> lock(image_codecs_mutex_);
+  return image_codecs_[static_cast<size_t>(type)];
+}
+
+void ResourceLoader::waitForPendingWrites() const {
+  if (encoding_thread_pool_) {
+    encoding_thread_pool_->waitForEmptyQueue();
+  }
+}
+
+void ResourceLoader::waitForPendingWrite(const ResourceId& id) const {
+  std::shared_future<void> done;
+  {
+    std::lock_guard<std::mutex> lock(pending_writes_mutex_);
+    std::unordered_map<ResourceId, PendingWrite>::const_iterator it =
+        pending_writes_.find(id);
+    if (it == pending_writes_.end()) {
+      return;
+    }
+    done = it->second.done;
+  }
+  done.wait();
+}
+
+template <>
+bool ResourceLoader::enqueueResourceWrite(
+    const ResourceId& id, const ResourceType& type, const std::string& folder,
+    const cv::Mat& resource) {
+  if (!encoding_thread_pool_) {
+    return false;
+  }
+
+  std::shared_ptr<std::promise<void>> promise =
+      std::make_shared<std::promise<void>>();
+  size_t write_idx;
+  {
+    std::lock_guard<std::mutex> lock(pending_writes_mutex_);
+    if (pending_writes_.size() >=
+        static_cast<size_t>(
+            std::max(FLAGS_resource_image_encoding_max_queued_images, 0))) {
+      return false;
+    }
+    write_idx = next_write_idx_++;
+    pending_writes_[id] =
+        PendingWrite{write_idx, promise->get_future().share()};
+  }
+
+  // The caller may modify the image after adding it, hence the copy.
+  const cv::Mat image = resource.clone();
+  encoding_thread_pool_->enqueue(
+      [this, id, type, folder, image, promise, write_idx]() {
+        writeResource<cv::Mat>(id, type, folder, image);
+        {
+          std::lock_guard<std::mutex> lock(pending_writes_mutex_);
+          std::unordered_map<ResourceId, PendingWrite>::iterator it =
+              pending_writes_.find(id);
+          if (it != pending_writes_.end() &&
+              it->second.write_idx == write_idx) {
+            pending_writes_.erase(it);
+          }
+        }
+        promise->set_value();
+      });
+  return true;
+}
+
 void ResourceLoader::migrateResource(
     const ResourceId& id, const ResourceType& type,
     const std::string& old_folder, const std::string& new_folder,
     const bool move_resource) {
+  ResourceMigrationRecord record;
+  CHECK(transferResource(
+      id, type, old_folder, new_folder, move_resource, &record))
+      << "Failed to migrate resource " << id.hexString() << " from folder '"
+      << old_folder << "' to folder '" << new_folder << "'.";
+  commitResourceMigration(record);
+}
+
+bool ResourceLoader::transferResource(
+    const ResourceId& id, const ResourceType& type,
+    const std::string& old_folder, const std::string& new_folder,
+    const bool move_resource, ResourceMigrationRecord* record) {
   CHECK(!old_folder.empty());
   CHECK(!new_folder.empty());
+  CHECK_NOTNULL(record);
+  record->id = id;
+  record->type = type;
+  record->old_folder = old_folder;
+  record->new_folder = new_folder;
+  record->move_resource = move_resource;
+  record->method = common::FileTransferMethod::kFailed;
+  record->num_bytes = 0u;
+  waitForPendingWrite(id);
+
   std::string old_file_path;
   getResourceFilePath(id, type, old_folder, &old_file_path);
-  CHECK(common::fileExists(old_file_path))
-      << "path: \'" << old_file_path << "\'";
+  // The file of this resource that might already exist in the new folder,
+  // possibly with a different file extension.
+  std::string existing_new_file_path;
+  getResourceFilePath(id, type, new_folder, &existing_new_file_path);
+
+  std::shared_ptr<ResourceArchive> old_archive =
+      getArchiveContainingResource(id, type, old_folder);
+  record->from_archive = old_archive != nullptr;
+  record->to_archive = useArchiveForNewResources(type, new_folder);
+  if (record->from_archive || record->to_archive) {
+    // At least one side is a packed archive, hence we migrate the encoded
+    // blob instead of the file.
+    std::string blob;
+    ResourceArchive::Codec codec = ResourceArchive::Codec::kFileFormat;
+    if (record->from_archive) {
+      CHECK(old_archive->getBlob(id, type, &blob, &codec));
+    } else if (!readFileToString(old_file_path, &blob)) {
+      LOG(ERROR) << "Unable to read resource file: " << old_file_path;
+      return false;
+    }
+
+    if (record->to_archive) {
+      std::shared_ptr<ResourceArchive> new_archive =
+          getArchive(new_folder, true /*create_if_missing*/);
+      if (new_archive->remove(id, type)) {
+        LOG(WARNING) << "Overwriting resource " << id.hexString()
+                     << " in the resource archive of folder '" << new_folder
+                     << "' because it already exists!";
+      }
+      new_archive->append(id, type, blob, codec);
+    } else {
+      CHECK(codec == ResourceArchive::Codec::kFileFormat);
+      if (common::fileExists(existing_new_file_path)) {
+        common::deleteFile(existing_new_file_path);
+        LOG(WARNING) << "Overwriting resource file '"
+                     << existing_new_file_path
+                     << "' because it already exists!";
+      }
+      std::string new_file_path;
+      getResourceFilePathForBlob(id, type, new_folder, blob, &new_file_path);
+      writeStringToFile(blob, new_file_path);
+    }
+    record->method = common::FileTransferMethod::kStreamCopy;
+    record->num_bytes = blob.size();
+    return true;
+  }
 
+  struct stat old_file_stat;
+  if (stat(old_file_path.c_str(), &old_file_stat) != 0) {
+    LOG(ERROR) << "Resource file to migrate does not exist! path: '"
+               << old_file_path << "'";
+    return false;
+  }
+
+  // The file keeps its extension, which depends on the codec of images.
   std::string new_file_path;
-  getResourceFilePath(id, type, new_folder, &new_file_path);
+  getResourceFilePathWithExtension(
+      id, type, new_folder, getResourceFileExtension(id, old_file_path),
+      &new_file_path);
 
   // If we migrate to a map folder that was used before, we simply overwrite the
   // files. This should only happen if we save the map to the same folder twice
   // and have resource migration enabled.
-  if (common::fileExists(new_file_path)) {
-    common::deleteFile(new_file_path);
+  if (common::fileExists(existing_new_file_path)) {
+    common::deleteFile(existing_new_file_path);
     LOG(WARNING)
         << " Overwriting resource file to migrate resource from file: '"
-        << old_file_path << "' to file '" << new_file_path
+        << old_file_path << "' to file '" << existing_new_file_path
         << "' because the latter already exists!";
   }
 
-  CHECK(common::createPathToFile(new_file_path));
+  if (!common::createPathToFile(new_file_path)) {
+    LOG(ERROR) << "Unable to create path to file: " << new_file_path;
+    return false;
+  }
 
-  std::ifstream source_file(old_file_path, std::ios::binary);
-  std::ofstream destination_file(new_file_path, std::ios::binary);
-  CHECK(source_file.is_open());
-  CHECK(destination_file.is_open());
+  // Resources are never modified in place, hence a hard link is as good as a
+  // copy, as long as the user allows it.
+  record->method = common::transferFile(
+      old_file_path, new_file_path, move_resource,
+      FLAGS_resource_migration_allow_hard_links);
+  record->num_bytes = static_cast<size_t>(old_file_stat.st_size);
+  return record->method != common::FileTransferMethod::kFailed;
+}
 
-  // Copy the file.
-  destination_file << source_file.rdbuf();
+void ResourceLoader::commitResourceMigration(
+    const ResourceMigrationRecord& record) {
+  CHECK(record.method != common::FileTransferMethod::kFailed);
+  if (!record.move_resource ||
+      record.method == common::FileTransferMethod::kRename) {
+    return;
+  }
 
-  if (move_resource) {
+  if (record.from_archive) {
+    std::shared_ptr<ResourceArchive> old_archive =
+        getArchive(record.old_folder, false /*create_if_missing*/);
+    CHECK(old_archive);
+    old_archive->remove(record.id, record.type);
+  } else {
+    std::string old_file_path;
+    getResourceFilePath(
+        record.id, record.type, record.old_folder, &old_file_path);
     common::deleteFile(old_file_path);
   }
 }
 
+void ResourceLoader::rollbackResourceMigration(
+    const ResourceMigrationRecord& record) {
+  if (record.method == common::FileTransferMethod::kFailed) {
+    return;
+  }
+
+  std::string new_file_path;
+  getResourceFilePath(
+      record.id, record.type, record.new_folder, &new_file_path);
+  if (record.method == common::FileTransferMethod::kRename) {
+    std::string old_file_path;
+    getResourceFilePathWithExtension(
+        record.id, record.type, record.old_folder,
+        getResourceFileExtension(record.id, new_file_path), &old_file_path);
+    CHECK_EQ(std::rename(new_file_path.c_str(), old_file_path.c_str()), 0)
+        << "Unable to roll back the migration of resource file '"
+        << old_file_path << "'.";
+  } else if (record.to_archive) {
+    std::shared_ptr<ResourceArchive> new_archive =
+        getArchive(record.new_folder, false /*create_if_missing*/);
+    CHECK(new_archive);
+    new_archive->remove(record.id, record.type);
+  } else {
+    common::deleteFile(new_file_path);
+  }
+}
+
 void ResourceLoader::deleteResourceFile(
     const ResourceId& id, const ResourceType& type, const std::string& folder) {
   CHECK(!folder.empty());
+  waitForPendingWrite(id);
+  std::shared_ptr<ResourceArchive> archive =
+      getArchiveContainingResource(id, type, folder);
+  if (archive != nullptr) {
+    CHECK(archive->remove(id, type));
+    return;
+  }
   std::string file_path;
   getResourceFilePath(id, type, folder, &file_path);
   CHECK_EQ(std::remove(file_path.c_str()), 0);
@@ -63,38 +429,237 @@ void ResourceLoader::deleteResourceFile(
 void ResourceLoader::getResourceFilePath(
     const ResourceId& id, const ResourceType& type, const std::string& folder,
     std::string* file_path) const {
+  getResourceFilePathWithExtension(
+      id, type, folder, ResourceTypeFileSuffix[static_cast<size_t>(type)],
+      file_path);
+  if (!isImageResourceType(type) || common::fileExists(*file_path)) {
+    return;
+  }
+  for (int format_idx = 0;
+       format_idx < static_cast<int>(ImageCodec::Format::kCount);
+       ++format_idx) {
+    std::string codec_file_path;
+    getResourceFilePathWithExtension(
+        id, type, folder,
+        getImageFileExtension(
+            ImageCodec(static_cast<ImageCodec::Format>(format_idx), -1), type),
+        &codec_file_path);
+    if (common::fileExists(codec_file_path)) {
+      *file_path = codec_file_path;
+      return;
+    }
+  }
+}
+
+void ResourceLoader::getResourceFilePathWithExtension(
+    const ResourceId& id, const ResourceType& type, const std::string& folder,
+    const std::string& extension, std::string* file_path) const {
   CHECK(!folder.empty());
   CHECK_NOTNULL(file_path)->clear();
 
   common::concatenateFolderAndFileName(
       folder, ResourceTypeNames[static_cast<size_t>(type)], file_path);
 
-  const std::string filename =
-      id.hexString() + ResourceTypeFileSuffix[static_cast<size_t>(type)];
+  const std::string filename = id.hexString() + extension;
   common::concatenateFolderAndFileName(*file_path, filename, file_path);
 }
 
+void ResourceLoader::getResourceFilePathForBlob(
+    const ResourceId& id, const ResourceType& type, const std::string& folder,
+    const std::string& blob, std::string* file_path) const {
+  std::string extension = ResourceTypeFileSuffix[static_cast<size_t>(type)];
+  ImageCodec::Format format;
+  if (isImageResourceType(type) &&
+      getImageFormatOfEncodedImage(blob.data(), blob.size(), &format)) {
+    extension = getImageFileExtension(ImageCodec(format, -1), type);
+  }
+  getResourceFilePathWithExtension(id, type, folder, extension, file_path);
+}
+
 bool ResourceLoader::resourceFileExists(
     const ResourceId& id, const ResourceType& type,
     const std::string& folder) const {
   CHECK(!folder.empty());
+  waitForPendingWrite(id);
+  if (getArchiveContainingResource(id, type, folder) != nullptr) {
+    return true;
+  }
   std::string file_path;
   getResourceFilePath(id, type, folder, &file_path);
   return common::fileExists(file_path);
 }
 
+std::shared_ptr<ResourceArchive> ResourceLoader::getArchive(
+    const std::string& folder, const bool create_if_missing) const {
+  CHECK(!folder.empty());
+  {
+    aslam::ScopedReadLock lock(&archives_mutex_);
+    const std::unordered_map<
+        std::string, std::shared_ptr<ResourceArchive>>::const_iterator it =
+        archives_.find(folder);
+    if (it != archives_.cend() && (it->second || !create_if_missing)) {
+      return it->second;
+    }
+  }
+
+  aslam::ScopedWriteLock lock(&archives_mutex_);
+  std::shared_ptr<ResourceArchive>& archive = archives_[folder];
+  if (!archive &&
+      (create_if_missing || ResourceArchive::archiveExists(folder))) {
+    archive = std::make_shared<ResourceArchive>(folder);
+  }
+  return archive;
+}
+
+std::shared_ptr<ResourceArchive> ResourceLoader::getArchiveContainingResource(
+    const ResourceId& id, const ResourceType& type,
+    const std::string& folder) const {
+  std::shared_ptr<ResourceArchive> archive =
+      getArchive(folder, false /*create_if_missing*/);
+  if (archive != nullptr && archive->contains(id, type)) {
+    return archive;
+  }
+  return nullptr;
+}
+
+bool ResourceLoader::isArchivedResourceType(const ResourceType& type) {
+  switch (type) {
+    case ResourceType::kVoxbloxTsdfMap:
+    case ResourceType::kVoxbloxEsdfMap:
+    case ResourceType::kVoxbloxOccupancyMap:
+      return false;
+    default:
+      return true;
+  }
+}
+
+bool ResourceLoader::useArchiveForNewResources(
+    const ResourceType& type, const std::string& folder) const {
+  return isArchivedResourceType(type) &&
+         (FLAGS_resource_use_packed_archive ||
+          getArchive(folder, false /*create_if_missing*/) != nullptr);
+}
+
+size_t ResourceLoader::packResourcesIntoArchive(
+    const std::string& folder, const ResourceTypeToIdsMap& resource_ids,
+    const bool remove_files) {
+  CHECK(!folder.empty());
+  waitForPendingWrites();
+  std::shared_ptr<ResourceArchive> archive =
+      getArchive(folder, true /*create_if_missing*/);
+  size_t num_packed_resources = 0u;
+  for (const ResourceTypeToIdsMap::value_type& type_ids : resource_ids) {
+    const ResourceType& type = type_ids.first;
+    if (!isArchivedResourceType(type)) {
+      continue;
+    }
+    for (const ResourceId& id : type_ids.second) {
+      if (archive->contains(id, type)) {
+        continue;
+      }
+      std::string file_path;
+      getResourceFilePath(id, type, folder, &file_path);
+      std::string blob;
+      if (!readFileToString(file_path, &blob)) {
+        LOG(ERROR) << "Cannot pack resource " << id.hexString()
+                   << ", the resource file is missing: " << file_path;
+        continue;
+      }
+      archive->append(id, type, blob, ResourceArchive::Codec::kFileFormat);
+      if (remove_files) {
+        common::deleteFile(file_path);
+      }
+      ++num_packed_resources;
+    }
+  }
+  VLOG(1) << "Packed " << num_packed_resources
+          << " resources into the resource archive of folder " << folder;
+  return num_packed_resources;
+}
+
+size_t ResourceLoader::unpackResourcesFromArchive(const std::string& folder) {
+  CHECK(!folder.empty());
+  waitForPendingWrites();
+  std::shared_ptr<ResourceArchive> archive =
+      getArchive(folder, false /*create_if_missing*/);
+  if (archive == nullptr) {
+    return 0u;
+  }
+
+  ResourceTypeToIdsMap resource_ids;
+  archive->getResourceIds(&resource_ids);
+  size_t num_unpacked_resources = 0u;
+  for (const ResourceTypeToIdsMap::value_type& type_ids : resource_ids) {
+    const ResourceType& type = type_ids.first;
+    for (const ResourceId& id : type_ids.second) {
+      std::string blob;
+      ResourceArchive::Codec codec;
+      CHECK(archive->getBlob(id, type, &blob, &codec));
+      CHECK(codec == ResourceArchive::Codec::kFileFormat)
+          << "Resource " << id.hexString() << " is stored with codec "
+          << static_cast<int>(codec) << " and cannot be unpacked!";
+      std::string file_path;
+      getResourceFilePathForBlob(id, type, folder, blob, &file_path);
+      CHECK(!common::fileExists(file_path))
+          << "Cannot unpack resource, file already exists: " << file_path;
+      writeStringToFile(blob, file_path);
+      ++num_unpacked_resources;
+    }
+  }
+
+  // Readers that still hold the archive keep their mappings of the removed
+  // segments until they release it.
+  {
+    aslam::ScopedWriteLock lock(&archives_mutex_);
+    archives_[folder].reset();
+  }
+  archive->clear();
+  VLOG(1) << "Unpacked " << num_unpacked_resources
+          << " resources from the resource archive of folder " << folder;
+  return num_unpacked_resources;
+}
+
+void ResourceLoader::compactResourceArchive(const std::string& folder) {
+  waitForPendingWrites();
+  std::shared_ptr<ResourceArchive> archive =
+      getArchive(folder, false /*create_if_missing*/);
+  if (archive != nullptr) {
+    archive->compact();
+  }
+}
+
 template <>
 void ResourceLoader::saveResourceToFile<cv::Mat>(
-    const std::string& file_path, const ResourceType& /*type*/,
+    const std::string& file_path, const ResourceType& type,
     const cv::Mat& resource) const {
   CHECK(!file_path.empty());
-  CHECK(!common::fileExists(file_path));
-  CHECK(common::createPathToFile(file_path));
-  CHECK(cv::imwrite(file_path, resource))
-      << "Failed to store cv::Mat to " << file_path << ".";
+  // The suffix of the resource type is replaced by the file extension of the
+  // codec.
+  const std::string& suffix = ResourceTypeFileSuffix[static_cast<size_t>(type)];
+  CHECK_GE(file_path.size(), suffix.size());
+  CHECK_EQ(
+      file_path.compare(
+          file_path.size() - suffix.size(), suffix.size(), suffix),
+      0)
+      << "The resource file " << file_path << " does not have the suffix "
+      << suffix << ".";
+  const ImageCodec codec = getImageCodec(type);
+  const std::string codec_file_path =
+      file_path.substr(0u, file_path.size() - suffix.size()) +
+      getImageFileExtension(codec, type);
+  CHECK(!common::fileExists(codec_file_path));
+  CHECK(common::createPathToFile(codec_file_path));
+  std::vector<uchar> buffer;
+  CHECK(encodeImage(resource, type, codec, &buffer))
+      << "Failed to encode cv::Mat for " << codec_file_path << ".";
+  std::ofstream file(codec_file_path, std::ios::binary);
+  CHECK(file.is_open()) << "Unable to write resource file: "
+                        << codec_file_path;
+  file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  CHECK(file.good()) << "Failed to store cv::Mat to " << codec_file_path
+                     << ".";
 }
 
-// NOTE: [ADD_RESOURCE_TYPE] Add case if you add a new cv::Mat resource type.
 template <>
 bool ResourceLoader::loadResourceFromFile<cv::Mat>(
     const std::string& file_path, const ResourceType& type,
@@ -106,36 +671,11 @@ bool ResourceLoader::loadResourceFromFile<cv::Mat>(
     return false;
   }
 
-  bool wrong_type = false;
-  switch (type) {
-    case ResourceType::kRawDepthMap:
-    case ResourceType::kOptimizedDepthMap:
-      *resource = cv::imread(file_path, cv::IMREAD_UNCHANGED);
-      wrong_type = CV_MAT_TYPE(resource->type()) != CV_16UC1;
-      break;
-    case ResourceType::kUndistortedImage:
-    case ResourceType::kRectifiedImage:
-    case ResourceType::kImageForDepthMap:
-    case ResourceType::kRawImage:
-      *resource = cv::imread(file_path, cv::IMREAD_GRAYSCALE);
-      wrong_type = CV_MAT_TYPE(resource->type()) != CV_8UC1;
-      break;
-    case ResourceType::kUndistortedColorImage:
-    case ResourceType::kRectifiedColorImage:
-    case ResourceType::kColorImageForDepthMap:
-    case ResourceType::kRawColorImage:
-    case ResourceType::kObjectInstanceMasks:
-      *resource = cv::imread(file_path, cv::IMREAD_COLOR);
-      wrong_type = CV_MAT_TYPE(resource->type()) != CV_8UC3;
-      break;
-    case ResourceType::kDisparityMap:
-      *resource = cv::imread(file_path, cv::IMREAD_UNCHANGED);
-      wrong_type = CV_MAT_TYPE(resource->type()) != CV_16UC1;
-      break;
-    default:
-      LOG(FATAL) << "Unknown cv::Mat resource type: "
-                 << ResourceTypeNames[static_cast<size_t>(type)];
-  }
+  int imread_flag;
+  int mat_type;
+  getImreadFlagAndMatType(type, &imread_flag, &mat_type);
+  *resource = cv::imread(file_path, imread_flag);
+  const bool wrong_type = CV_MAT_TYPE(resource->type()) != mat_type;
   if (wrong_type) {
     VLOG(1) << "cv::Mat Resource at: " << file_path << " has wrong image type!";
     return false;
@@ -151,6 +691,41 @@ bool ResourceLoader::loadResourceFromFile<cv::Mat>(
   return true;
 }
 
+template <>
+void ResourceLoader::encodeResource<cv::Mat>(
+    const ResourceType& type, const cv::Mat& resource,
+    const std::string& /*folder*/, std::string* blob,
+    ResourceArchive::Codec* codec) const {
+  CHECK_NOTNULL(blob)->clear();
+  CHECK_NOTNULL(codec);
+  std::vector<uchar> buffer;
+  CHECK(encodeImage(resource, type, getImageCodec(type), &buffer))
+      << "Failed to encode cv::Mat of type "
+      << ResourceTypeNames[static_cast<size_t>(type)] << ".";
+  blob->assign(buffer.begin(), buffer.end());
+  *codec = ResourceArchive::Codec::kFileFormat;
+}
+
+template <>
+bool ResourceLoader::decodeResource<cv::Mat>(
+    const ResourceType& type, const ResourceArchive::BlobView& blob,
+    const std::string& /*folder*/, cv::Mat* resource) const {
+  CHECK_NOTNULL(resource);
+  if (blob.codec != ResourceArchive::Codec::kFileFormat ||
+      blob.num_bytes == 0u) {
+    return false;
+  }
+  int imread_flag;
+  int mat_type;
+  getImreadFlagAndMatType(type, &imread_flag, &mat_type);
+  // Wraps the mapped memory without copying it.
+  const cv::Mat encoded(
+      1, static_cast<int>(blob.num_bytes), CV_8UC1,
+      const_cast<char*>(blob.data));
+  *resource = cv::imdecode(encoded, imread_flag);
+  return !resource->empty() && CV_MAT_TYPE(resource->type()) == mat_type;
+}
+
 template <>
 void ResourceLoader::saveResourceToFile<std::string>(
     const std::string& file_path, const ResourceType& /*type*/,
@@ -209,6 +784,34 @@ bool ResourceLoader::loadResourceFromFile<std::string>(
   return true;
 }
 
+template <>
+void ResourceLoader::encodeResource<std::string>(
+    const ResourceType& /*type*/, const std::string& resource,
+    const std::string& /*folder*/, std::string* blob,
+    ResourceArchive::Codec* codec) const {
+  CHECK_NOTNULL(blob);
+  CHECK_NOTNULL(codec);
+  *blob = resource;
+  *codec = ResourceArchive::Codec::kFileFormat;
+}
+
+template <>
+bool ResourceLoader::decodeResource<std::string>(
+    const ResourceType& type, const ResourceArchive::BlobView& blob,
+    const std::string& /*folder*/, std::string* resource) const {
+  CHECK_NOTNULL(resource);
+  if (blob.codec != ResourceArchive::Codec::kFileFormat) {
+    return false;
+  }
+  resource->assign(blob.data, blob.num_bytes);
+  if (resource->empty()) {
+    VLOG(1) << "The std::string resource of type "
+            << ResourceTypeNames[static_cast<size_t>(type)] << " is empty!";
+    return false;
+  }
+  return true;
+}
+
 template <>
 void ResourceLoader::saveResourceToFile<voxblox::TsdfMap>(
     const std::string& file_path, const ResourceType& /*type*/,
@@ -322,6 +925,34 @@ bool ResourceLoader::loadResourceFromFile(
   return resource->loadFromFile(file_path);
 }
 
+template <>
+void ResourceLoader::encodeResource(
+    const ResourceType& /*type*/, const resources::PointCloud& resource,
+    const std::string& /*folder*/, std::string* blob,
+    ResourceArchive::Codec* codec) const {
+  CHECK_NOTNULL(blob);
+  CHECK_NOTNULL(codec);
+  std::ostringstream output_stream(std::ios::out | std::ios::binary);
+  resource.writeToStream(&output_stream);
+  *blob = output_stream.str();
+  *codec = ResourceArchive::Codec::kFileFormat;
+}
+
+template <>
+bool ResourceLoader::decodeResource(
+    const ResourceType& /*type*/, const ResourceArchive::BlobView& blob,
+    const std::string& /*folder*/, resources::PointCloud* resource) const {
+  CHECK_NOTNULL(resource);
+  if (blob.codec != ResourceArchive::Codec::kFileFormat ||
+      blob.num_bytes == 0u) {
+    return false;
+  }
+  BlobStreamBuffer blob_buffer(blob);
+  std::istream input_stream(&blob_buffer);
+  resource->loadFromStream(&input_stream);
+  return true;
+}
+
 template <>
 void ResourceLoader::saveResourceToFile(
     const std::string& file_path, const ResourceType& type,
@@ -340,28 +971,8 @@ void ResourceLoader::saveResourceToFile(
   CHECK(!folder_path.empty());
   CHECK(!file_name.empty());
 
-  const size_t n_bboxes = resource.size();
   resources::proto::ObjectInstanceBoundingBoxes object_instance_bboxes;
-  object_instance_bboxes.mutable_object_instance_bbox()->Reserve(
-      n_bboxes);
-
-  for (size_t idx = 0u; idx < n_bboxes; ++idx) {
-    const resources::ObjectInstanceBoundingBox bbox = resource[idx];
-    resources::proto::ObjectInstanceBoundingBox* object_bbox_proto_ptr =
-        object_instance_bboxes.add_object_instance_bbox();
-
-    object_bbox_proto_ptr->set_bbox_column(bbox.bounding_box.x);
-    object_bbox_proto_ptr->set_bbox_row(bbox.bounding_box.y);
-    object_bbox_proto_ptr->set_bbox_width(bbox.bounding_box.width);
-    object_bbox_proto_ptr->set_bbox_height(bbox.bounding_box.height);
-
-    object_bbox_proto_ptr->set_class_number(bbox.class_number);
-    object_bbox_proto_ptr->set_instance_number(bbox.instance_number);
-
-    object_bbox_proto_ptr->set_confidence(bbox.confidence);
-
-    object_bbox_proto_ptr->set_class_name(bbox.class_name);
-  }
+  boundingBoxesToProto(resource, &object_instance_bboxes);
 
   constexpr bool kParseAsTextFormat = true;
   CHECK(common::proto_serialization_helper::serializeProtoToFile(
@@ -402,28 +1013,56 @@ bool ResourceLoader::loadResourceFromFile(
     return false;
   }
 
-  const size_t n_bboxes = static_cast<size_t>(
-      object_instance_bboxes.object_instance_bbox_size());
-  resource->resize(n_bboxes);
-
-  for (size_t idx = 0u; idx < n_bboxes; ++idx) {
-    resources::ObjectInstanceBoundingBox& bbox = (*resource)[idx];
-    const resources::proto::ObjectInstanceBoundingBox& object_bbox_proto =
-        object_instance_bboxes.object_instance_bbox(idx);
+  protoToBoundingBoxes(object_instance_bboxes, resource);
 
-    bbox.bounding_box.x = object_bbox_proto.bbox_column();
-    bbox.bounding_box.y = object_bbox_proto.bbox_row();
-    bbox.bounding_box.width = object_bbox_proto.bbox_width();
-    bbox.bounding_box.height = object_bbox_proto.bbox_height();
+  return true;
+}
 
-    bbox.class_number = object_bbox_proto.class_number();
-    bbox.instance_number = object_bbox_proto.instance_number();
+template <>
+void ResourceLoader::encodeResource(
+    const ResourceType& type,
+    const resources::ObjectInstanceBoundingBoxes& resource,
+    const std::string& /*folder*/, std::string* blob,
+    ResourceArchive::Codec* codec) const {
+  CHECK_NOTNULL(blob);
+  CHECK_NOTNULL(codec);
+  CHECK(type == backend::ResourceType::kObjectInstanceBoundingBoxes)
+      << "The type '" << backend::ResourceTypeNames[static_cast<int>(type)]
+      << "' is not of data type ObjectInstanceBoundingBoxes!";
 
-    bbox.confidence = object_bbox_proto.confidence();
+  // Same text format as the proto files of this resource type.
+  resources::proto::ObjectInstanceBoundingBoxes object_instance_bboxes;
+  boundingBoxesToProto(resource, &object_instance_bboxes);
+  CHECK(google::protobuf::TextFormat::PrintToString(
+      object_instance_bboxes, blob))
+      << "Failed to encode the resource of data type "
+      << "ObjectInstanceBoundingBoxes.";
+  *codec = ResourceArchive::Codec::kFileFormat;
+}
 
-    bbox.class_name = object_bbox_proto.class_name();
+template <>
+bool ResourceLoader::decodeResource(
+    const ResourceType& type, const ResourceArchive::BlobView& blob,
+    const std::string& /*folder*/,
+    resources::ObjectInstanceBoundingBoxes* resource) const {
+  CHECK_NOTNULL(resource);
+  CHECK(type == backend::ResourceType::kObjectInstanceBoundingBoxes)
+      << "The type '" << backend::ResourceTypeNames[static_cast<int>(type)]
+      << "' is not of data type ObjectInstanceBoundingBoxes!";
+  if (blob.codec != ResourceArchive::Codec::kFileFormat) {
+    return false;
   }
 
+  resources::proto::ObjectInstanceBoundingBoxes object_instance_bboxes;
+  google::protobuf::io::ArrayInputStream blob_stream(
+      blob.data, static_cast<int>(blob.num_bytes));
+  if (!google::protobuf::TextFormat::Parse(
+          &blob_stream, &object_instance_bboxes)) {
+    LOG(ERROR) << "Failed to decode the resource of data type "
+               << "ObjectInstanceBoundingBoxes from the resource archive.";
+    return false;
+  }
+  protoToBoundingBoxes(object_instance_bboxes, resource);
   return true;
 }
 
@@ -82,14 +82,18 @@ bool saveMapToFolder(
   // Migrate resources if it is desired.
   switch (config.migrate_resources_settings) {
     case SaveConfig::MigrateResourcesSettings::kMigrateResourcesToMapFolder:
-      map->migrateAllResourcesToMapResourceFolder(
-          config.move_resources_when_migrating);
+      if (!map->migrateAllResourcesToMapResourceFolder(
+              config.move_resources_when_migrating)) {
+        return false;
+      }
       break;
     case SaveConfig::MigrateResourcesSettings::
         kMigrateResourcesToExternalFolder:
-      map->migrateAllResourcesToFolder(
-          config.external_folder_for_migration,
-          config.move_resources_when_migrating);
+      if (!map->migrateAllResourcesToFolder(
+              config.external_folder_for_migration,
+              config.move_resources_when_migrating)) {
+        return false;
+      }
       break;
     case SaveConfig::MigrateResourcesSettings::kDontMigrateResourceFolder:
     default:
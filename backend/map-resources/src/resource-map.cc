@@ -1,12 +1,25 @@
 #include "map-resources/resource-map.h"
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <sstream>
+
 #include <aslam/common/reader-writer-lock.h>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <maplab-common/file-system-tools.h>
+#include <maplab-common/multi-threaded-progress-bar.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
 
 #include "map-resources/resource_info_map.pb.h"
 #include "map-resources/resource_metadata.pb.h"
 
+DEFINE_int32(
+    resource_migration_num_threads, common::getNumHardwareThreads(),
+    "Number of threads used to migrate resources to a new resource folder.");
+
 namespace backend {
 
 ResourceMap::ResourceMap()
@@ -346,7 +359,7 @@ void ResourceMap::useMapResourceFolder() {
   meta_data_.resource_folder_in_use = kMapResourceFolder;
 }
 
-void ResourceMap::migrateAllResourcesToFolder(
+bool ResourceMap::migrateAllResourcesToFolder(
     const std::string& target_resource_folder, const bool move_resources) {
   CHECK(!target_resource_folder.empty());
   aslam::ScopedWriteLock lock(&resource_mutex_);
@@ -369,34 +382,119 @@ void ResourceMap::migrateAllResourcesToFolder(
     }
   }
 
-  // Loop over all resources in the resource maps and move them to the new
-  // folder if necessary.
+  // Collect all resources that are not in the target folder yet.
+  struct MigrationTask {
+    ResourceId id;
+    ResourceType type;
+    std::string old_folder;
+  };
+  std::vector<MigrationTask> tasks;
   for (size_t type_idx = 0u; type_idx < kNumResourceTypes; ++type_idx) {
-    ResourceInfoMap& info_map = resource_info_map_.at(type_idx);
-
-    ResourceInfoMap::iterator it = info_map.begin();
-    for (; it != info_map.end(); ++it) {
-      ResourceFolderIndex& folder_idx = it->second.folder_idx;
-      const bool resource_already_in_target_folder =
-          is_known_folder && folder_idx == target_folder_idx;
-      if (!resource_already_in_target_folder) {
-        // Find previous folder for this resource.
-        std::string old_folder;
-        getFolderFromIndex(folder_idx, &old_folder);
-        CHECK(common::pathExists(old_folder))
-            << "Cannot migrate resources, previous resource folder doesn't "
-            << "exist (anmore)! Folder: " << old_folder;
-
-        // Move/copy the resource and update the folder index.
-        resource_loader_.migrateResource(
-            it->first, static_cast<ResourceType>(type_idx), old_folder,
-            target_resource_folder, move_resources);
+    const ResourceType type = static_cast<ResourceType>(type_idx);
+    const ResourceInfoMap& info_map = resource_info_map_.at(type_idx);
+    if (info_map.empty()) {
+      continue;
+    }
+    // Create the type subfolder up front, such that the workers don't race to
+    // create it.
+    CHECK(common::createPath(
+        common::concatenateFolderAndFileName(
+            target_resource_folder, ResourceTypeNames[type_idx])));
+
+    for (const ResourceInfoMap::value_type& id_and_info : info_map) {
+      const ResourceFolderIndex folder_idx = id_and_info.second.folder_idx;
+      if (is_known_folder && folder_idx == target_folder_idx) {
+        continue;
+      }
+      MigrationTask task;
+      task.id = id_and_info.first;
+      task.type = type;
+      getFolderFromIndex(folder_idx, &task.old_folder);
+      CHECK(common::pathExists(task.old_folder))
+          << "Cannot migrate resources, previous resource folder doesn't "
+          << "exist (anmore)! Folder: " << task.old_folder;
+      tasks.emplace_back(task);
+    }
+  }
+
+  // Transfer the resources in parallel. Nothing is removed from the old
+  // folders in this phase, unless it was moved atomically by a rename, such
+  // that all transfers can be rolled back if one of them fails.
+  const size_t num_tasks = tasks.size();
+  std::vector<ResourceMigrationRecord> records(num_tasks);
+  std::vector<unsigned char> task_succeeded(num_tasks, 0u);
+  common::MultiThreadedProgressBar progress_bar;
+  std::function<void(const std::vector<size_t>&)> transfer_function =
+      [&](const std::vector<size_t>& batch) {
+        size_t num_processed = 0u;
+        progress_bar.setNumElements(batch.size());
+        for (const size_t task_idx : batch) {
+          const MigrationTask& task = tasks[task_idx];
+          task_succeeded[task_idx] = resource_loader_.transferResource(
+              task.id, task.type, task.old_folder, target_resource_folder,
+              move_resources, &records[task_idx]);
+          progress_bar.update(++num_processed);
+        }
+      };
+  const size_t num_threads = std::max<size_t>(
+      1u, static_cast<size_t>(FLAGS_resource_migration_num_threads));
+  const bool kAlwaysParallelize = false;
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  common::ParallelProcess(
+      num_tasks, transfer_function, kAlwaysParallelize, num_threads);
+  const double duration_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    start_time)
+          .count();
+
+  const size_t num_failed = static_cast<size_t>(std::count(
+      task_succeeded.begin(), task_succeeded.end(), 0u));
+  if (num_failed > 0u) {
+    LOG(ERROR) << "Failed to migrate " << num_failed << " out of " << num_tasks
+               << " resources to folder '" << target_resource_folder
+               << "', rolling back the migration.";
+    for (size_t task_idx = num_tasks; task_idx-- > 0u;) {
+      if (task_succeeded[task_idx]) {
+        resource_loader_.rollbackResourceMigration(records[task_idx]);
       }
+    }
+    return false;
+  }
+
+  // All resources are available in the target folder, finalize the migration
+  // and update the folder indices.
+  size_t num_bytes = 0u;
+  std::vector<size_t> num_per_method(
+      static_cast<size_t>(common::FileTransferMethod::kStreamCopy) + 1u, 0u);
+  for (const ResourceMigrationRecord& record : records) {
+    resource_loader_.commitResourceMigration(record);
+    num_bytes += record.num_bytes;
+    ++num_per_method[static_cast<size_t>(record.method)];
+  }
+  for (ResourceInfoMap& info_map : resource_info_map_) {
+    for (ResourceInfoMap::value_type& id_and_info : info_map) {
+      // If the new folder is the default folder, we need to set the
+      // appropriate folder idx.
+      id_and_info.second.folder_idx = is_map_folder ? kMapResourceFolder : 0u;
+    }
+  }
 
-      // If the new folder is the default folder, we need to set the appropriate
-      // folder idx.
-      folder_idx = is_map_folder ? kMapResourceFolder : 0u;
+  if (num_tasks > 0u) {
+    std::stringstream method_summary;
+    for (size_t method_idx = 1u; method_idx < num_per_method.size();
+         ++method_idx) {
+      if (num_per_method[method_idx] > 0u) {
+        method_summary << " " << common::fileTransferMethodToString(
+                                     static_cast<common::FileTransferMethod>(
+                                         method_idx))
+                       << ": " << num_per_method[method_idx];
+      }
     }
+    VLOG(1) << "Migrated " << num_tasks << " resources (" << num_bytes
+            << " bytes) in " << duration_s << "s, "
+            << (duration_s > 0.0 ? num_bytes / (duration_s * 1e6) : 0.0)
+            << " MB/s, using" << method_summary.str();
   }
 
   // Delete all previous external folder references.
@@ -407,14 +505,16 @@ void ResourceMap::migrateAllResourcesToFolder(
   if (!is_map_folder) {
     meta_data_.external_resource_folders.push_back(target_resource_folder);
   }
+  return true;
 }
 
-void ResourceMap::migrateAllResourcesToMapResourceFolder(
+bool ResourceMap::migrateAllResourcesToMapResourceFolder(
     const bool move_resources) {
   CHECK(!meta_data_.map_folder.empty())
       << "Cannot determine default resource folder because no map folder was "
       << "specified!";
-  migrateAllResourcesToFolder(meta_data_.map_resource_folder, move_resources);
+  return migrateAllResourcesToFolder(
+      meta_data_.map_resource_folder, move_resources);
 }
 
 ResourceMap::ResourceFolderIndex ResourceMap::registerNewExternalFolder(
@@ -689,7 +789,12 @@ bool ResourceMap::checkResourceFileSystem() const {
   return all_files_exist;
 }
 
+void ResourceMap::waitForPendingResourceWrites() const {
+  resource_loader_.waitForPendingWrites();
+}
+
 void ResourceMap::cleanupResourceFolders() {
+  waitForPendingResourceWrites();
   // Scoped lock is not covering the entire function to make sure we can do a
   // resource file system check afterwards.
   {
@@ -823,6 +928,69 @@ void ResourceMap::cleanupResourceFolders() {
   checkResourceFileSystem();
 }
 
+void ResourceMap::getResourceFoldersInUse(
+    std::vector<std::string>* folders) const {
+  CHECK_NOTNULL(folders)->clear();
+  std::unordered_set<ResourceFolderIndex> folder_indices;
+  for (const ResourceInfoMap& info_map : resource_info_map_) {
+    for (const ResourceInfoMap::value_type& info_entry : info_map) {
+      folder_indices.insert(info_entry.second.folder_idx);
+    }
+  }
+  for (const ResourceFolderIndex folder_idx : folder_indices) {
+    std::string folder;
+    getFolderFromIndex(folder_idx, &folder);
+    folders->emplace_back(folder);
+  }
+}
+
+void ResourceMap::packResourcesIntoArchives(const bool remove_files) {
+  aslam::ScopedWriteLock lock(&resource_mutex_);
+  std::unordered_map<ResourceFolderIndex, ResourceTypeToIdsMap>
+      folder_to_resource_ids;
+  for (size_t type_idx = 0u; type_idx < kNumResourceTypes; ++type_idx) {
+    const ResourceType type = static_cast<ResourceType>(type_idx);
+    for (const ResourceInfoMap::value_type& info_entry :
+         resource_info_map_[type_idx]) {
+      folder_to_resource_ids[info_entry.second.folder_idx][type].insert(
+          info_entry.first);
+    }
+  }
+
+  size_t num_packed_resources = 0u;
+  for (const std::pair<const ResourceFolderIndex, ResourceTypeToIdsMap>&
+           folder_resource_ids : folder_to_resource_ids) {
+    std::string folder;
+    getFolderFromIndex(folder_resource_ids.first, &folder);
+    num_packed_resources += resource_loader_.packResourcesIntoArchive(
+        folder, folder_resource_ids.second, remove_files);
+  }
+  VLOG(1) << "Packed " << num_packed_resources << " resources in "
+          << folder_to_resource_ids.size() << " resource folders.";
+}
+
+void ResourceMap::unpackResourcesFromArchives() {
+  aslam::ScopedWriteLock lock(&resource_mutex_);
+  std::vector<std::string> folders;
+  getResourceFoldersInUse(&folders);
+  size_t num_unpacked_resources = 0u;
+  for (const std::string& folder : folders) {
+    num_unpacked_resources +=
+        resource_loader_.unpackResourcesFromArchive(folder);
+  }
+  VLOG(1) << "Unpacked " << num_unpacked_resources << " resources in "
+          << folders.size() << " resource folders.";
+}
+
+void ResourceMap::compactResourceArchives() {
+  aslam::ScopedWriteLock lock(&resource_mutex_);
+  std::vector<std::string> folders;
+  getResourceFoldersInUse(&folders);
+  for (const std::string& folder : folders) {
+    resource_loader_.compactResourceArchive(folder);
+  }
+}
+
 bool ResourceMap::deleteResourceNoDataType(
     const ResourceId& id, const ResourceType& type) {
   constexpr bool kKeepResourceFile = false;
@@ -0,0 +1,235 @@
+#include <fstream>  // NOLINT
+#include <string>
+#include <vector>
+
+#include <aslam/common/unique-id.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <opencv2/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "map-resources/image-codec.h"
+#include "map-resources/resource-common.h"
+#include "map-resources/resource-loader.h"
+
+DECLARE_int32(resource_image_encoding_num_threads);
+
+namespace backend {
+
+namespace {
+
+cv::Mat createTestImage(const int type, const int seed) {
+  cv::Mat image(48, 64, type);
+  cv::RNG rng(seed);
+  // Smooth gradient plus noise, such that the compression ratio is somewhat
+  // realistic.
+  for (int row = 0; row < image.rows; ++row) {
+    for (int col = 0; col < image.cols; ++col) {
+      const int value = row * 3 + col * 2 + rng.uniform(0, 8);
+      if (type == CV_8UC1) {
+        image.at<uchar>(row, col) = cv::saturate_cast<uchar>(value);
+      } else if (type == CV_8UC3) {
+        image.at<cv::Vec3b>(row, col) = cv::Vec3b(
+            cv::saturate_cast<uchar>(value), cv::saturate_cast<uchar>(col),
+            cv::saturate_cast<uchar>(row));
+      } else {
+        CHECK_EQ(type, CV_16UC1);
+        image.at<uint16_t>(row, col) = static_cast<uint16_t>(value * 100);
+      }
+    }
+  }
+  return image;
+}
+
+size_t getFileSize(const std::string& file_path) {
+  std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+  CHECK(file.is_open()) << file_path;
+  return static_cast<size_t>(file.tellg());
+}
+
+double maxAbsDifference(const cv::Mat& image_A, const cv::Mat& image_B) {
+  cv::Mat difference;
+  cv::absdiff(image_A, image_B, difference);
+  double max_abs_difference = 0.0;
+  cv::minMaxLoc(difference.reshape(1), nullptr, &max_abs_difference);
+  return max_abs_difference;
+}
+
+}  // namespace
+
+TEST(ImageCodecTest, ParseCodecSpecifications) {
+  ImageCodec codec;
+  ASSERT_TRUE(ImageCodec::fromString("pnm", &codec));
+  EXPECT_EQ(codec.format, ImageCodec::Format::kPnm);
+  EXPECT_EQ(codec.quality, -1);
+
+  ASSERT_TRUE(ImageCodec::fromString("png:3", &codec));
+  EXPECT_EQ(codec.format, ImageCodec::Format::kPng);
+  EXPECT_EQ(codec.quality, 3);
+  EXPECT_EQ(codec.toString(), "png:3");
+  EXPECT_TRUE(codec.isLossless());
+
+  ASSERT_TRUE(ImageCodec::fromString("jpeg:90", &codec));
+  EXPECT_FALSE(codec.isLossless());
+  EXPECT_FALSE(codec.supportsImageDepth(CV_16U));
+
+  ASSERT_TRUE(ImageCodec::fromString("webp:101", &codec));
+  EXPECT_TRUE(codec.isLossless());
+
+  EXPECT_FALSE(ImageCodec::fromString("bmp", &codec));
+  EXPECT_FALSE(ImageCodec::fromString("png:10", &codec));
+  EXPECT_FALSE(ImageCodec::fromString("jpeg:", &codec));
+  EXPECT_FALSE(ImageCodec::fromString("jpeg:abc", &codec));
+  EXPECT_FALSE(ImageCodec::fromString("tiff:1", &codec));
+}
+
+TEST(ImageCodecTest, LosslessCodecsRoundTrip) {
+  const std::vector<std::string> codec_specifications = {"pnm", "png:1",
+                                                         "png:9", "tiff"};
+  const cv::Mat gray_image = createTestImage(CV_8UC1, 1);
+  const cv::Mat color_image = createTestImage(CV_8UC3, 2);
+  const cv::Mat depth_map = createTestImage(CV_16UC1, 3);
+
+  for (const std::string& specification : codec_specifications) {
+    ImageCodec codec;
+    ASSERT_TRUE(ImageCodec::fromString(specification, &codec));
+    std::vector<uchar> buffer;
+
+    ASSERT_TRUE(
+        encodeImage(gray_image, ResourceType::kRawImage, codec, &buffer));
+    EXPECT_EQ(
+        maxAbsDifference(
+            gray_image, cv::imdecode(buffer, cv::IMREAD_GRAYSCALE)),
+        0.0)
+        << specification;
+
+    ASSERT_TRUE(encodeImage(
+        color_image, ResourceType::kRawColorImage, codec, &buffer));
+    EXPECT_EQ(
+        maxAbsDifference(color_image, cv::imdecode(buffer, cv::IMREAD_COLOR)),
+        0.0)
+        << specification;
+
+    ASSERT_TRUE(
+        encodeImage(depth_map, ResourceType::kRawDepthMap, codec, &buffer));
+    EXPECT_EQ(
+        maxAbsDifference(
+            depth_map, cv::imdecode(buffer, cv::IMREAD_UNCHANGED)),
+        0.0)
+        << specification;
+  }
+}
+
+TEST(ImageCodecTest, LossyCodecRejectsDepthMaps) {
+  ImageCodec codec;
+  ASSERT_TRUE(ImageCodec::fromString("jpeg:95", &codec));
+  std::vector<uchar> buffer;
+  EXPECT_FALSE(encodeImage(
+      createTestImage(CV_16UC1, 4), ResourceType::kRawDepthMap, codec,
+      &buffer));
+
+  const cv::Mat gray_image = createTestImage(CV_8UC1, 5);
+  ASSERT_TRUE(encodeImage(gray_image, ResourceType::kRawImage, codec, &buffer));
+  EXPECT_LT(
+      maxAbsDifference(gray_image, cv::imdecode(buffer, cv::IMREAD_GRAYSCALE)),
+      32.0);
+}
+
+TEST(ImageCodecTest, BenchmarkImageCodecs) {
+  std::vector<cv::Mat> images;
+  for (int idx = 0; idx < 10; ++idx) {
+    images.emplace_back(createTestImage(CV_8UC1, idx));
+  }
+  std::vector<ImageCodec> codecs;
+  for (const std::string& specification :
+       {"pnm", "png:1", "png:6", "jpeg:95", "tiff"}) {
+    codecs.emplace_back();
+    ASSERT_TRUE(ImageCodec::fromString(specification, &codecs.back()));
+  }
+
+  std::vector<ImageCodecBenchmarkResult> results;
+  benchmarkImageCodecs(images, ResourceType::kRawImage, codecs, &results);
+  ASSERT_EQ(results.size(), codecs.size());
+  for (const ImageCodecBenchmarkResult& result : results) {
+    EXPECT_EQ(result.num_images, images.size());
+    EXPECT_EQ(result.num_raw_bytes, images.size() * 48u * 64u);
+    EXPECT_GT(result.num_encoded_bytes, 0u);
+    if (result.codec.isLossless()) {
+      EXPECT_EQ(result.max_abs_error, 0.0) << result.codec.toString();
+    }
+    LOG(INFO) << result.codec.toString() << ": " << result.bytesPerImage()
+              << " bytes/image, encoding "
+              << result.encodingMegabytesPerSecond() << " MB/s, decoding "
+              << result.decodingMegabytesPerSecond() << " MB/s, max error "
+              << result.max_abs_error;
+  }
+  // PNG needs to compress the smooth test images.
+  EXPECT_LT(results[1].num_encoded_bytes, results[0].num_encoded_bytes);
+}
+
+TEST(ImageCodecTest, ResourceLoaderUsesConfiguredCodec) {
+  const std::string resource_folder = "./image_codec_test/";
+  if (common::pathExists(resource_folder)) {
+    CHECK(common::removePath(resource_folder));
+  }
+  CHECK(common::createPath(resource_folder));
+
+  const cv::Mat image = createTestImage(CV_8UC1, 6);
+  ResourceId pnm_id;
+  aslam::generateId(&pnm_id);
+  ResourceId png_id;
+  aslam::generateId(&png_id);
+
+  // Encode the images in the background.
+  const int32_t original_num_threads =
+      FLAGS_resource_image_encoding_num_threads;
+  FLAGS_resource_image_encoding_num_threads = 2;
+
+  std::string pnm_file_path;
+  std::string png_file_path;
+  {
+    ResourceLoader loader;
+    EXPECT_EQ(
+        loader.getImageCodec(ResourceType::kRawImage).format,
+        ImageCodec::Format::kPnm);
+    loader.addResource(pnm_id, ResourceType::kRawImage, resource_folder, image);
+    loader.setImageCodec(
+        ResourceType::kRawImage, ImageCodec(ImageCodec::Format::kPng, 9));
+    loader.addResource(png_id, ResourceType::kRawImage, resource_folder, image);
+
+    // Reads wait for the background encoding of the resource.
+    cv::Mat loaded_image;
+    loader.getResource(
+        png_id, ResourceType::kRawImage, resource_folder, &loaded_image);
+    EXPECT_EQ(maxAbsDifference(image, loaded_image), 0.0);
+
+    loader.waitForPendingWrites();
+    loader.getResourceFilePath(
+        pnm_id, ResourceType::kRawImage, resource_folder, &pnm_file_path);
+    loader.getResourceFilePath(
+        png_id, ResourceType::kRawImage, resource_folder, &png_file_path);
+  }
+  FLAGS_resource_image_encoding_num_threads = original_num_threads;
+
+  // Each file carries the extension of its codec and the PNG encoded one is
+  // smaller.
+  EXPECT_EQ(
+      pnm_file_path.substr(pnm_file_path.size() - 4u),
+      ResourceTypeFileSuffix[static_cast<size_t>(ResourceType::kRawImage)]);
+  EXPECT_EQ(png_file_path.substr(png_file_path.size() - 4u), ".png");
+  ASSERT_TRUE(common::fileExists(pnm_file_path));
+  ASSERT_TRUE(common::fileExists(png_file_path));
+  EXPECT_LT(getFileSize(png_file_path), getFileSize(pnm_file_path));
+
+  ResourceLoader loader;
+  cv::Mat loaded_image;
+  loader.getResource(
+      png_id, ResourceType::kRawImage, resource_folder, &loaded_image);
+  EXPECT_EQ(maxAbsDifference(image, loaded_image), 0.0);
+}
+
+}  // namespace backend
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -0,0 +1,176 @@
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/test/testing-entrypoint.h>
+
+#include "map-resources/resource-archive.h"
+#include "map-resources/resource-common.h"
+
+namespace backend {
+
+class ResourceArchiveTest : public ::testing::Test {
+ public:
+  virtual void SetUp() {
+    resource_folder_ = "./resource_archive_test/";
+    if (common::pathExists(resource_folder_)) {
+      CHECK(common::removePath(resource_folder_));
+    }
+    CHECK(common::createPath(resource_folder_));
+
+    resource_ids_.resize(kNumResources);
+    blobs_.resize(kNumResources);
+    for (size_t idx = 0u; idx < kNumResources; ++idx) {
+      aslam::generateId(&resource_ids_[idx]);
+      blobs_[idx] = std::string(idx + 1u, static_cast<char>('a' + idx % 26u));
+    }
+  }
+
+  void fillArchive(ResourceArchive* archive) {
+    CHECK_NOTNULL(archive);
+    for (size_t idx = 0u; idx < kNumResources; ++idx) {
+      archive->append(
+          resource_ids_[idx], kType, blobs_[idx],
+          ResourceArchive::Codec::kFileFormat);
+    }
+  }
+
+  void expectBlob(const ResourceArchive& archive, const size_t idx) {
+    std::string blob;
+    ResourceArchive::Codec codec;
+    ASSERT_TRUE(archive.getBlob(resource_ids_[idx], kType, &blob, &codec));
+    EXPECT_EQ(blobs_[idx], blob);
+    EXPECT_EQ(ResourceArchive::Codec::kFileFormat, codec);
+
+    ResourceArchive::BlobView view;
+    ASSERT_TRUE(archive.getBlobView(resource_ids_[idx], kType, &view));
+    EXPECT_EQ(blobs_[idx], std::string(view.data, view.num_bytes));
+  }
+
+  static constexpr size_t kNumResources = 100u;
+  static constexpr ResourceType kType = ResourceType::kRawImage;
+
+  std::string resource_folder_;
+  ResourceIdList resource_ids_;
+  std::vector<std::string> blobs_;
+};
+
+constexpr size_t ResourceArchiveTest::kNumResources;
+constexpr ResourceType ResourceArchiveTest::kType;
+
+TEST_F(ResourceArchiveTest, TestAppendAndGet) {
+  ResourceArchive archive(resource_folder_);
+  EXPECT_FALSE(ResourceArchive::archiveExists(resource_folder_));
+  fillArchive(&archive);
+  EXPECT_TRUE(ResourceArchive::archiveExists(resource_folder_));
+  EXPECT_EQ(kNumResources, archive.numResources());
+  EXPECT_EQ(0u, archive.numDeadBytes());
+
+  for (size_t idx = 0u; idx < kNumResources; ++idx) {
+    EXPECT_TRUE(archive.contains(resource_ids_[idx], kType));
+    EXPECT_FALSE(archive.contains(resource_ids_[idx], ResourceType::kText));
+    expectBlob(archive, idx);
+  }
+}
+
+TEST_F(ResourceArchiveTest, TestReopen) {
+  {
+    ResourceArchive archive(resource_folder_);
+    fillArchive(&archive);
+    for (size_t idx = 0u; idx < kNumResources; idx += 2u) {
+      EXPECT_TRUE(archive.remove(resource_ids_[idx], kType));
+    }
+  }
+
+  ResourceArchive archive(resource_folder_);
+  EXPECT_EQ(kNumResources / 2u, archive.numResources());
+  EXPECT_GT(archive.numDeadBytes(), 0u);
+  for (size_t idx = 0u; idx < kNumResources; ++idx) {
+    if (idx % 2u == 0u) {
+      EXPECT_FALSE(archive.contains(resource_ids_[idx], kType));
+    } else {
+      expectBlob(archive, idx);
+    }
+  }
+}
+
+TEST_F(ResourceArchiveTest, TestCompaction) {
+  ResourceArchive archive(resource_folder_);
+  fillArchive(&archive);
+  for (size_t idx = 0u; idx < kNumResources / 2u; ++idx) {
+    EXPECT_TRUE(archive.remove(resource_ids_[idx], kType));
+  }
+  const size_t num_bytes_before = archive.numTotalBytes();
+  const size_t num_dead_bytes = archive.numDeadBytes();
+
+  archive.compact();
+  EXPECT_EQ(0u, archive.numDeadBytes());
+  EXPECT_EQ(num_bytes_before - num_dead_bytes, archive.numTotalBytes());
+  for (size_t idx = kNumResources / 2u; idx < kNumResources; ++idx) {
+    expectBlob(archive, idx);
+  }
+
+  // Appending after a compaction continues in the compacted segments.
+  archive.append(
+      resource_ids_[0u], kType, blobs_[0u],
+      ResourceArchive::Codec::kFileFormat);
+  ResourceArchive reopened_archive(resource_folder_);
+  expectBlob(reopened_archive, 0u);
+  for (size_t idx = kNumResources / 2u; idx < kNumResources; ++idx) {
+    expectBlob(reopened_archive, idx);
+  }
+}
+
+TEST_F(ResourceArchiveTest, TestInterleavedAppendAndRead) {
+  ResourceArchive archive(resource_folder_);
+  archive.append(
+      resource_ids_[0u], kType, blobs_[0u],
+      ResourceArchive::Codec::kFileFormat);
+  ResourceArchive::BlobView first_view;
+  ASSERT_TRUE(archive.getBlobView(resource_ids_[0u], kType, &first_view));
+
+  for (size_t idx = 1u; idx < kNumResources; ++idx) {
+    archive.append(
+        resource_ids_[idx], kType, blobs_[idx],
+        ResourceArchive::Codec::kFileFormat);
+    ResourceArchive::BlobView view;
+    ASSERT_TRUE(archive.getBlobView(resource_ids_[idx], kType, &view));
+    EXPECT_EQ(blobs_[idx], std::string(view.data, view.num_bytes));
+    // The grown segment has been mapped again and the archive only keeps the
+    // latest mapping, superseded mappings are owned by their views only.
+    EXPECT_NE(first_view.mapping, view.mapping);
+    EXPECT_EQ(2, view.mapping.use_count());
+  }
+  EXPECT_EQ(1, first_view.mapping.use_count());
+  EXPECT_EQ(blobs_[0u], std::string(first_view.data, first_view.num_bytes));
+}
+
+TEST_F(ResourceArchiveTest, TestClear) {
+  ResourceArchive archive(resource_folder_);
+  fillArchive(&archive);
+  constexpr size_t kViewIdx = kNumResources - 1u;
+  ResourceArchive::BlobView view;
+  ASSERT_TRUE(archive.getBlobView(resource_ids_[kViewIdx], kType, &view));
+
+  archive.clear();
+  EXPECT_FALSE(ResourceArchive::archiveExists(resource_folder_));
+  EXPECT_EQ(0u, archive.numResources());
+  EXPECT_FALSE(archive.contains(resource_ids_[0u], kType));
+
+  // Views into the deleted segments stay readable.
+  EXPECT_EQ(blobs_[kViewIdx], std::string(view.data, view.num_bytes));
+
+  // The archive can be filled again from scratch.
+  fillArchive(&archive);
+  ResourceArchive reopened_archive(resource_folder_);
+  EXPECT_EQ(kNumResources, reopened_archive.numResources());
+  for (size_t idx = 0u; idx < kNumResources; ++idx) {
+    expectBlob(archive, idx);
+    expectBlob(reopened_archive, idx);
+  }
+}
+
+}  // namespace backend
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -1,3 +1,7 @@
+#include <set>
+#include <string>
+
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <maplab-common/file-system-tools.h>
 #include <maplab-common/test/testing-entrypoint.h>
@@ -7,6 +11,8 @@
 #include "map-resources/resource-loader.h"
 #include "map-resources/test/resources-test.h"
 
+DECLARE_bool(resource_use_packed_archive);
+
 namespace backend {
 
 class ResourceLoaderTest : public ResourceTest {
@@ -380,6 +386,69 @@ TEST_F(ResourceLoaderTest, TestGetResource) {
   getAndCheckTemplatesFromResourceLoader(&loader, &templates_);
 }
 
+TEST_F(ResourceLoaderTest, TestGetResourceFromPackedArchive) {
+  constexpr bool kIsMapFolder = true;
+  createResourceTemplates(
+      "TestGetResourceFromPackedArchive", kTestMapFolderA, kIsMapFolder,
+      &templates_);
+
+  FLAGS_resource_use_packed_archive = true;
+  {
+    ResourceLoader loader;
+    addTemplatesToResourceLoader(&loader, &templates_);
+    getAndCheckTemplatesFromResourceLoader(&loader, &templates_);
+  }
+  FLAGS_resource_use_packed_archive = false;
+
+  std::set<std::string> folders;
+  size_t num_archived_resources = 0u;
+  for (const ResourceTemplateBase::Ptr& template_base : templates_) {
+    EXPECT_TRUE(ResourceArchive::archiveExists(template_base->folder));
+    folders.insert(template_base->folder);
+    if (ResourceLoader::isArchivedResourceType(template_base->type)) {
+      ++num_archived_resources;
+    }
+  }
+  EXPECT_GT(num_archived_resources, 0u);
+
+  // A loader with an empty cache needs to read from the archive, which is
+  // picked up even though the packed storage is disabled now.
+  {
+    ResourceLoader loader;
+    for (const ResourceTemplateBase::Ptr& template_base : templates_) {
+      std::string file_path;
+      loader.getResourceFilePath(
+          template_base->id, template_base->type, template_base->folder,
+          &file_path);
+      // Resource types that can't be archived are still stored as files.
+      EXPECT_NE(
+          ResourceLoader::isArchivedResourceType(template_base->type),
+          common::fileExists(file_path));
+      EXPECT_TRUE(loader.resourceFileExists(
+          template_base->id, template_base->type, template_base->folder));
+    }
+    getAndCheckTemplatesFromResourceLoader(&loader, &templates_);
+
+    size_t num_unpacked_resources = 0u;
+    for (const std::string& folder : folders) {
+      num_unpacked_resources += loader.unpackResourcesFromArchive(folder);
+      EXPECT_FALSE(ResourceArchive::archiveExists(folder));
+    }
+    EXPECT_EQ(num_archived_resources, num_unpacked_resources);
+  }
+
+  // After unpacking, the resources are back in the file-per-resource layout.
+  ResourceLoader loader;
+  for (const ResourceTemplateBase::Ptr& template_base : templates_) {
+    std::string file_path;
+    loader.getResourceFilePath(
+        template_base->id, template_base->type, template_base->folder,
+        &file_path);
+    EXPECT_TRUE(common::fileExists(file_path));
+  }
+  getAndCheckTemplatesFromResourceLoader(&loader, &templates_);
+}
+
 TEST_F(ResourceLoaderTest, TestGetInexistentResource) {
   constexpr bool kIsMapFolder = true;
   createResourceTemplates(
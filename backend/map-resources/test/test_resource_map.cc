@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <maplab-common/file-system-tools.h>
@@ -1163,6 +1167,60 @@ TEST_F(ResourceMapTest, TestResourceMapMigrateResourcesToExternalFolder) {
       default_resource_folder, test_result_folder_ + kTestExternalFolderZ));
 }
 
+TEST_F(ResourceMapTest, TestResourceMapMigrationRollback) {
+  createResourceTemplates(
+      "TestResourceMapMigrationRollback", kTestMapFolderA, kIsMapFolder,
+      &templates_map_A_);
+  createResourceTemplates(
+      "TestResourceMapMigrationRollback", kTestExternalFolderX,
+      kIsExternalFolder, &templates_external_folder_X_);
+
+  ResourceMap map(test_result_folder_ + kTestMapFolderA);
+  addResourceTemplatesToMap(&map, &templates_map_A_);
+  addResourceTemplatesToMap(&map, &templates_external_folder_X_);
+
+  // Remove the file of one of the external resources behind the back of the
+  // map, such that the migration of this resource fails.
+  ResourceTemplateBaseVector::iterator broken_template_it = std::find_if(
+      templates_external_folder_X_.begin(), templates_external_folder_X_.end(),
+      [](const ResourceTemplateBase::Ptr& template_base) {
+        return template_base->data_type == DataTypes::kCvMat;
+      });
+  ASSERT_NE(broken_template_it, templates_external_folder_X_.end());
+  const ResourceTemplateBase& broken_template = **broken_template_it;
+  const size_t type_idx = static_cast<size_t>(broken_template.type);
+  const std::string broken_file_path = common::concatenateFolderAndFileName(
+      common::concatenateFolderAndFileName(
+          broken_template.folder, ResourceTypeNames[type_idx]),
+      broken_template.id.hexString() + ResourceTypeFileSuffix[type_idx]);
+  ASSERT_TRUE(common::fileExists(broken_file_path));
+  common::deleteFile(broken_file_path);
+  templates_external_folder_X_.erase(broken_template_it);
+
+  constexpr bool kMoveResources = true;
+  EXPECT_FALSE(map.migrateAllResourcesToFolder(
+      test_result_folder_ + kTestExternalFolderZ, kMoveResources));
+
+  // The map still uses its previous resource folders and all remaining
+  // resources are available at their previous location.
+  std::vector<std::string> external_folders;
+  map.getExternalResourceFolders(&external_folders);
+  ASSERT_EQ(external_folders.size(), 1u);
+  EXPECT_TRUE(common::isSameRealPath(
+      external_folders[0], test_result_folder_ + kTestExternalFolderX));
+  getResourcesFromMapAndCheck(&map, templates_map_A_);
+  getResourcesFromMapAndCheck(&map, templates_external_folder_X_);
+  for (const ResourceTemplateBase::Ptr& template_base :
+       templates_external_folder_X_) {
+    const size_t idx = static_cast<size_t>(template_base->type);
+    EXPECT_FALSE(common::fileExists(common::concatenateFolderAndFileName(
+        common::concatenateFolderAndFileName(
+            test_result_folder_ + kTestExternalFolderZ,
+            ResourceTypeNames[idx]),
+        template_base->id.hexString() + ResourceTypeFileSuffix[idx])));
+  }
+}
+
 TEST_F(ResourceMapTest, TestMetaDataSerialization) {
   static const std::string kDummyMapDescription =
       "This is the most awesome map ever created!";
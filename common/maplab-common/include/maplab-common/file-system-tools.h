@@ -41,6 +41,36 @@ bool copyFile(
     const std::string& source, const std::string& destination, mode_t mode,
     bool overwrite);
 
+// Describes how transferFile(...) created the destination file.
+enum class FileTransferMethod : int {
+  kFailed = 0,
+  kRename,
+  kHardLink,
+  kReflink,
+  kCopyFileRange,
+  kStreamCopy
+};
+
+const char* fileTransferMethodToString(const FileTransferMethod method);
+
+// Creates the destination file from the source file using the cheapest
+// mechanism that is available, in this order:
+// * a rename, if allow_rename is true and both files are on the same file
+//   system. In this case the source file does not exist anymore afterwards.
+// * a hard link, if allow_hard_link is true and both files are on the same
+//   file system. Only use this if neither of the files is modified in place
+//   afterwards.
+// * a reflink (copy-on-write clone), if the file system supports it.
+// * copy_file_range, which copies the data inside the kernel.
+// * a regular buffered copy.
+// The parent folder of the destination has to exist and the destination file
+// must not exist. Returns kFailed if the file could not be transferred, in
+// which case the source is left untouched and no destination file is left
+// behind.
+FileTransferMethod transferFile(
+    const std::string& source, const std::string& destination,
+    const bool allow_rename, const bool allow_hard_link);
+
 // Traverse folder and subfolder and list all files and directories.
 // Sources:
 // https://stackoverflow.com/questions/612097/how-can-i-get-the-list-of-files-in-a-directory-using-c-or-c
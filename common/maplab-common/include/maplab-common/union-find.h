@@ -0,0 +1,159 @@
+#ifndef MAPLAB_COMMON_UNION_FIND_H_
+#define MAPLAB_COMMON_UNION_FIND_H_
+
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace common {
+
+// Disjoint sets of elements, which can be merged in amortized almost constant
+// time. Unlike in a textbook union-find, merging is directed: the set of the
+// first element is merged into the set of the second element, which keeps its
+// representative. This allows to replay a sequence of pairwise merges (e.g.
+// of landmarks) and to end up with the same surviving element per set as if
+// the merges had been executed one after the other.
+template <typename Type, typename Hash = std::hash<Type>>
+class UnionFind {
+ public:
+  UnionFind() = default;
+
+  inline void reserve(const size_t num_elements) {
+    element_to_index_.reserve(num_elements);
+    elements_.reserve(num_elements);
+    parents_.reserve(num_elements);
+    set_sizes_.reserve(num_elements);
+    representatives_.reserve(num_elements);
+  }
+
+  // Adds the element as a set of its own, if it is not known yet.
+  inline void add(const Type& element) {
+    getOrAddIndex(element);
+  }
+
+  inline bool contains(const Type& element) const {
+    return element_to_index_.count(element) > 0u;
+  }
+
+  // Number of elements, not the number of sets.
+  inline size_t size() const {
+    return elements_.size();
+  }
+
+  inline bool empty() const {
+    return elements_.empty();
+  }
+
+  inline size_t numSets() const {
+    return num_sets_;
+  }
+
+  // Returns the representative of the set of the element. Unknown elements
+  // are their own representative.
+  inline Type find(const Type& element) {
+    typename std::unordered_map<Type, size_t, Hash>::const_iterator it =
+        element_to_index_.find(element);
+    if (it == element_to_index_.end()) {
+      return element;
+    }
+    return elements_[representatives_[findRoot(it->second)]];
+  }
+
+  // Merges the set of element into the set of element_into. The
+  // representative of the set of element_into becomes the representative of
+  // the merged set. Returns false if both elements already are in the same
+  // set.
+  inline bool merge(const Type& element, const Type& element_into) {
+    const size_t root = findRoot(getOrAddIndex(element));
+    const size_t root_into = findRoot(getOrAddIndex(element_into));
+    if (root == root_into) {
+      return false;
+    }
+    const size_t representative = representatives_[root_into];
+    // Attach the smaller tree below the larger one to keep the trees flat.
+    if (set_sizes_[root] > set_sizes_[root_into]) {
+      parents_[root_into] = root;
+      set_sizes_[root] += set_sizes_[root_into];
+      representatives_[root] = representative;
+    } else {
+      parents_[root] = root_into;
+      set_sizes_[root_into] += set_sizes_[root];
+    }
+    --num_sets_;
+    return true;
+  }
+
+  // Calls the function with every element and the representative of its set,
+  // in the order in which the elements were added.
+  inline void forEachElement(
+      const std::function<void(const Type&, const Type&)>& function) {
+    for (size_t idx = 0u; idx < elements_.size(); ++idx) {
+      function(elements_[idx], elements_[representatives_[findRoot(idx)]]);
+    }
+  }
+
+  // Returns all sets with their representative, the elements of a set are
+  // in the order in which they were added.
+  inline void getSets(
+      std::unordered_map<Type, std::vector<Type>, Hash>* sets) {
+    CHECK_NOTNULL(sets)->clear();
+    sets->reserve(num_sets_);
+    forEachElement([sets](const Type& element, const Type& representative) {
+      (*sets)[representative].emplace_back(element);
+    });
+  }
+
+  inline void clear() {
+    element_to_index_.clear();
+    elements_.clear();
+    parents_.clear();
+    set_sizes_.clear();
+    representatives_.clear();
+    num_sets_ = 0u;
+  }
+
+ private:
+  inline size_t getOrAddIndex(const Type& element) {
+    const std::pair<
+        typename std::unordered_map<Type, size_t, Hash>::iterator, bool>
+        result = element_to_index_.emplace(element, elements_.size());
+    if (result.second) {
+      const size_t index = elements_.size();
+      elements_.emplace_back(element);
+      parents_.emplace_back(index);
+      set_sizes_.emplace_back(1u);
+      representatives_.emplace_back(index);
+      ++num_sets_;
+    }
+    return result.first->second;
+  }
+
+  inline size_t findRoot(size_t index) {
+    size_t root = index;
+    while (parents_[root] != root) {
+      root = parents_[root];
+    }
+    // Path compression.
+    while (parents_[index] != root) {
+      const size_t parent = parents_[index];
+      parents_[index] = root;
+      index = parent;
+    }
+    return root;
+  }
+
+  std::unordered_map<Type, size_t, Hash> element_to_index_;
+  std::vector<Type> elements_;
+  std::vector<size_t> parents_;
+  // Only valid for the roots of the trees.
+  std::vector<size_t> set_sizes_;
+  std::vector<size_t> representatives_;
+  size_t num_sets_ = 0u;
+};
+
+}  // namespace common
+
+#endif  // MAPLAB_COMMON_UNION_FIND_H_
@@ -3,6 +3,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -15,6 +16,10 @@
 
 #include <glog/logging.h>
 
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif
+
 namespace common {
 
 std::string getUniqueFolderName(const std::string& folder_name) {
@@ -578,6 +583,141 @@ bool copyFile(
   return true;
 }
 
+const char* fileTransferMethodToString(const FileTransferMethod method) {
+  switch (method) {
+    case FileTransferMethod::kFailed:
+      return "failed";
+    case FileTransferMethod::kRename:
+      return "rename";
+    case FileTransferMethod::kHardLink:
+      return "hard link";
+    case FileTransferMethod::kReflink:
+      return "reflink";
+    case FileTransferMethod::kCopyFileRange:
+      return "copy_file_range";
+    case FileTransferMethod::kStreamCopy:
+      return "copy";
+    default:
+      LOG(FATAL) << "Unknown file transfer method: "
+                 << static_cast<int>(method);
+  }
+  return "";
+}
+
+namespace {
+
+// Copies the content of the source into the (empty) destination file
+// descriptor. Tries to clone the file first and falls back to in-kernel and
+// finally to a buffered user space copy.
+FileTransferMethod copyFileContent(
+    const int source_fd, const int destination_fd, const size_t num_bytes) {
+#if defined(__linux__) && defined(FICLONE)
+  if (ioctl(destination_fd, FICLONE, source_fd) == 0) {
+    return FileTransferMethod::kReflink;
+  }
+#endif
+
+#if defined(__linux__) && defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+  {
+    size_t num_bytes_copied = 0u;
+    bool copy_file_range_supported = true;
+    while (num_bytes_copied < num_bytes) {
+      const ssize_t result = copy_file_range(
+          source_fd, nullptr, destination_fd, nullptr,
+          num_bytes - num_bytes_copied, 0u);
+      if (result <= 0) {
+        copy_file_range_supported = false;
+        break;
+      }
+      num_bytes_copied += static_cast<size_t>(result);
+    }
+    if (copy_file_range_supported) {
+      return FileTransferMethod::kCopyFileRange;
+    }
+    // Start over with a regular copy, copy_file_range might have failed after
+    // copying parts of the file.
+    if (ftruncate(destination_fd, 0) != 0 ||
+        lseek(source_fd, 0, SEEK_SET) != 0 ||
+        lseek(destination_fd, 0, SEEK_SET) != 0) {
+      return FileTransferMethod::kFailed;
+    }
+  }
+#endif
+
+  char buffer[BUFSIZ];
+  ssize_t size;
+  while ((size = read(source_fd, buffer, BUFSIZ)) > 0) {
+    ssize_t num_written = 0;
+    while (num_written < size) {
+      const ssize_t result =
+          write(destination_fd, buffer + num_written, size - num_written);
+      if (result < 0) {
+        return FileTransferMethod::kFailed;
+      }
+      num_written += result;
+    }
+  }
+  return size < 0 ? FileTransferMethod::kFailed
+                  : FileTransferMethod::kStreamCopy;
+}
+
+}  // namespace
+
+FileTransferMethod transferFile(
+    const std::string& source, const std::string& destination,
+    const bool allow_rename, const bool allow_hard_link) {
+  CHECK(!source.empty());
+  CHECK(!destination.empty());
+
+  if (fileExists(destination)) {
+    LOG(ERROR) << "Cannot transfer file " << source << ", the destination "
+               << destination << " already exists.";
+    return FileTransferMethod::kFailed;
+  }
+
+  // Renaming and linking only fail with EXDEV if the files are on different
+  // file systems, in which case we have to copy.
+  if (allow_rename && rename(source.c_str(), destination.c_str()) == 0) {
+    return FileTransferMethod::kRename;
+  }
+  if (allow_hard_link && link(source.c_str(), destination.c_str()) == 0) {
+    return FileTransferMethod::kHardLink;
+  }
+
+  const int source_fd = open(source.c_str(), O_RDONLY, 0);
+  if (source_fd < 0) {
+    LOG(ERROR) << "Unable to open source file " << source << ": "
+               << std::strerror(errno);
+    return FileTransferMethod::kFailed;
+  }
+  struct stat source_stat;
+  if (fstat(source_fd, &source_stat) != 0) {
+    LOG(ERROR) << "Unable to stat source file " << source;
+    close(source_fd);
+    return FileTransferMethod::kFailed;
+  }
+  const int destination_fd = open(
+      destination.c_str(), O_WRONLY | O_CREAT | O_EXCL,
+      source_stat.st_mode & 0777);
+  if (destination_fd < 0) {
+    LOG(ERROR) << "Unable to create destination file " << destination << ": "
+               << std::strerror(errno);
+    close(source_fd);
+    return FileTransferMethod::kFailed;
+  }
+
+  const FileTransferMethod method = copyFileContent(
+      source_fd, destination_fd, static_cast<size_t>(source_stat.st_size));
+  close(source_fd);
+  if (close(destination_fd) != 0 || method == FileTransferMethod::kFailed) {
+    LOG(ERROR) << "Failed to copy file " << source << " to " << destination;
+    unlink(destination.c_str());
+    return FileTransferMethod::kFailed;
+  }
+  return method;
+}
+
 bool isSameRealPath(
     const std::string& real_path_A, const std::string& real_path_B) {
   CHECK(!real_path_A.empty());
@@ -113,6 +113,40 @@ TEST(MaplabCommon, copyFileTest) {
   EXPECT_TRUE(deleteFile(kTargetFile));
 }
 
+TEST(MaplabCommon, transferFileTest) {
+  constexpr int kMode = 0777;
+  constexpr bool kOverwrite = true;
+  const std::string kSourceFile = "maplab_test_data/testfile.txt";
+  const std::string kTempFile = "maplab_test_data/testfile.txt-transfer";
+  const std::string kTargetFile = "maplab_test_data/testfile.txt-transferred";
+  ASSERT_TRUE(copyFile(kSourceFile, kTempFile, kMode, kOverwrite));
+
+  // Copies leave the source untouched.
+  constexpr bool kAllowRename = true;
+  constexpr bool kAllowHardLink = true;
+  FileTransferMethod method =
+      transferFile(kTempFile, kTargetFile, !kAllowRename, !kAllowHardLink);
+  EXPECT_NE(FileTransferMethod::kFailed, method);
+  EXPECT_NE(FileTransferMethod::kRename, method);
+  EXPECT_NE(FileTransferMethod::kHardLink, method);
+  EXPECT_TRUE(fileExists(kTempFile));
+  EXPECT_TRUE(fileExists(kTargetFile));
+
+  // The destination is never overwritten.
+  EXPECT_EQ(
+      FileTransferMethod::kFailed,
+      transferFile(kTempFile, kTargetFile, kAllowRename, kAllowHardLink));
+  EXPECT_TRUE(deleteFile(kTargetFile));
+
+  // Within the same file system a move is a rename.
+  method = transferFile(kTempFile, kTargetFile, kAllowRename, kAllowHardLink);
+  EXPECT_EQ(FileTransferMethod::kRename, method);
+  EXPECT_FALSE(fileExists(kTempFile));
+  EXPECT_TRUE(fileExists(kTargetFile));
+
+  EXPECT_TRUE(deleteFile(kTargetFile));
+}
+
 TEST(MaplabCommon, getCurrentWorkingDirectoryTest) {
   const std::string current_working_directory = getCurrentWorkingDirectory();
   EXPECT_FALSE(current_working_directory.empty());
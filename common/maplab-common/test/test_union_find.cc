@@ -0,0 +1,108 @@
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "maplab-common/test/testing-entrypoint.h"
+#include "maplab-common/union-find.h"
+
+namespace common {
+
+TEST(TestUnionFind, UnknownElementsAreTheirOwnRepresentative) {
+  UnionFind<int> union_find;
+  EXPECT_EQ(union_find.find(3), 3);
+  EXPECT_FALSE(union_find.contains(3));
+  EXPECT_TRUE(union_find.empty());
+
+  union_find.add(3);
+  EXPECT_TRUE(union_find.contains(3));
+  EXPECT_EQ(union_find.find(3), 3);
+  EXPECT_EQ(union_find.size(), 1u);
+  EXPECT_EQ(union_find.numSets(), 1u);
+}
+
+TEST(TestUnionFind, MergeKeepsRepresentativeOfTarget) {
+  UnionFind<int> union_find;
+  EXPECT_TRUE(union_find.merge(1, 2));
+  EXPECT_EQ(union_find.find(1), 2);
+  EXPECT_EQ(union_find.find(2), 2);
+
+  // The larger set is merged into the smaller one, the representative still
+  // follows the direction of the merge.
+  EXPECT_TRUE(union_find.merge(2, 3));
+  EXPECT_EQ(union_find.find(1), 3);
+  EXPECT_EQ(union_find.find(2), 3);
+  EXPECT_EQ(union_find.find(3), 3);
+
+  EXPECT_FALSE(union_find.merge(1, 3));
+  EXPECT_FALSE(union_find.merge(3, 1));
+  EXPECT_EQ(union_find.find(1), 3);
+
+  EXPECT_TRUE(union_find.merge(4, 5));
+  EXPECT_EQ(union_find.numSets(), 2u);
+  EXPECT_TRUE(union_find.merge(3, 4));
+  EXPECT_EQ(union_find.numSets(), 1u);
+  for (int element = 1; element <= 5; ++element) {
+    EXPECT_EQ(union_find.find(element), 5);
+  }
+}
+
+TEST(TestUnionFind, MatchesSequentialMerges) {
+  // Replays random merges and compares against relabeling all elements after
+  // every merge.
+  constexpr int kNumElements = 200;
+  constexpr int kNumMerges = 150;
+  std::vector<int> representatives(kNumElements);
+  for (int element = 0; element < kNumElements; ++element) {
+    representatives[element] = element;
+  }
+
+  UnionFind<int> union_find;
+  unsigned int seed = 42u;
+  for (int merge_idx = 0; merge_idx < kNumMerges; ++merge_idx) {
+    const int element = rand_r(&seed) % kNumElements;
+    const int element_into = rand_r(&seed) % kNumElements;
+    union_find.merge(element, element_into);
+
+    const int merged_representative = representatives[element];
+    const int representative_into = representatives[element_into];
+    for (int& representative : representatives) {
+      if (representative == merged_representative) {
+        representative = representative_into;
+      }
+    }
+  }
+
+  for (int element = 0; element < kNumElements; ++element) {
+    EXPECT_EQ(union_find.find(element), representatives[element]);
+  }
+
+  std::unordered_map<int, std::vector<int>> sets;
+  union_find.getSets(&sets);
+  EXPECT_EQ(sets.size(), union_find.numSets());
+  size_t num_elements = 0u;
+  for (const std::unordered_map<int, std::vector<int>>::value_type& set :
+       sets) {
+    for (const int element : set.second) {
+      EXPECT_EQ(representatives[element], set.first);
+    }
+    num_elements += set.second.size();
+  }
+  EXPECT_EQ(num_elements, union_find.size());
+}
+
+TEST(TestUnionFind, Clear) {
+  UnionFind<std::string> union_find;
+  union_find.merge("a", "b");
+  union_find.clear();
+  EXPECT_TRUE(union_find.empty());
+  EXPECT_EQ(union_find.numSets(), 0u);
+  EXPECT_EQ(union_find.find("a"), "a");
+}
+
+}  // namespace common
+
+MAPLAB_UNITTEST_ENTRYPOINT
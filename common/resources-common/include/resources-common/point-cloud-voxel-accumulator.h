@@ -0,0 +1,331 @@
+#ifndef RESOURCES_COMMON_POINT_CLOUD_VOXEL_ACCUMULATOR_H_
+#define RESOURCES_COMMON_POINT_CLOUD_VOXEL_ACCUMULATOR_H_
+
+#include <cmath>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/common/pose-types.h>
+#include <glog/logging.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
+
+#include "resources-common/point-cloud.h"
+
+namespace resources {
+
+// Accumulates point clouds into a voxel hash map, such that the memory
+// usage scales with the occupied volume instead of the number of inserted
+// point clouds. Every occupied voxel is reduced to a single point:
+//  - kMean: mean position, normal, color and scalar of all points in the
+//    voxel, the label of the first point.
+//  - kFirst: the first point that fell into the voxel.
+//  - kMaxScalar: the point with the largest scalar (e.g. intensity).
+// The voxels are distributed over shards that are filled concurrently. Only
+// the order of the exported points depends on the number of shards.
+class PointCloudVoxelAccumulator {
+ public:
+  enum class Reduction { kMean, kFirst, kMaxScalar };
+
+  PointCloudVoxelAccumulator(
+      const double voxel_size_m, const Reduction reduction)
+      : PointCloudVoxelAccumulator(
+            voxel_size_m, reduction, common::getNumHardwareThreads()) {}
+
+  PointCloudVoxelAccumulator(
+      const double voxel_size_m, const Reduction reduction,
+      const size_t num_shards)
+      : inverse_voxel_size_(1.0 / voxel_size_m),
+        reduction_(reduction),
+        shards_(num_shards),
+        is_empty_(true),
+        has_normals_(false),
+        has_colors_(false),
+        has_scalars_(false),
+        has_labels_(false) {
+    CHECK_GT(voxel_size_m, 0.0);
+    CHECK_GT(num_shards, 0u);
+  }
+
+  // Parses "mean", "first" or "max_intensity".
+  static bool reductionFromString(
+      const std::string& reduction_string, Reduction* reduction) {
+    CHECK_NOTNULL(reduction);
+    if (reduction_string == "mean") {
+      *reduction = Reduction::kMean;
+    } else if (reduction_string == "first") {
+      *reduction = Reduction::kFirst;
+    } else if (reduction_string == "max_intensity") {
+      *reduction = Reduction::kMaxScalar;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  // Transforms the point cloud, which is expressed in frame B, to frame A and
+  // inserts it. An attribute (normals, colors, scalars, labels) is only
+  // exported if all inserted point clouds have it.
+  inline void insertTransformed(
+      const PointCloud& points_B, const aslam::Transformation& T_A_B) {
+    if (points_B.empty()) {
+      return;
+    }
+    const size_t num_points = points_B.size();
+    const bool has_normals = points_B.hasNormals();
+    const bool has_colors = points_B.hasColor();
+    const bool has_scalars = points_B.hasScalars();
+    const bool has_labels = points_B.hasLabels();
+    if (is_empty_) {
+      has_normals_ = has_normals;
+      has_colors_ = has_colors;
+      has_scalars_ = has_scalars;
+      has_labels_ = has_labels;
+      is_empty_ = false;
+    } else {
+      has_normals_ &= has_normals;
+      has_colors_ &= has_colors;
+      has_scalars_ &= has_scalars;
+      has_labels_ &= has_labels;
+    }
+
+    // Transform the points and compute their voxel index in parallel.
+    const size_t num_threads = common::getNumHardwareThreads();
+    static constexpr bool kAlwaysParallelize = false;
+    std::vector<float> xyz_A(3u * num_points);
+    std::vector<float> normals_A(has_normals ? 3u * num_points : 0u);
+    std::vector<VoxelIndex> voxel_indices(num_points);
+    std::vector<unsigned char> is_valid(num_points);
+    std::function<void(const std::vector<size_t>&)> transform_function =
+        [&](const std::vector<size_t>& batch) {
+          const aslam::Quaternion& q_A_B = T_A_B.getRotation();
+          for (const size_t point_idx : batch) {
+            const size_t idx = 3u * point_idx;
+            const Eigen::Vector3d point_B(
+                points_B.xyz[idx], points_B.xyz[idx + 1u],
+                points_B.xyz[idx + 2u]);
+            const Eigen::Vector3d point_A = T_A_B * point_B;
+            is_valid[point_idx] = point_A.allFinite();
+            if (!is_valid[point_idx]) {
+              continue;
+            }
+            xyz_A[idx] = point_A.x();
+            xyz_A[idx + 1u] = point_A.y();
+            xyz_A[idx + 2u] = point_A.z();
+            voxel_indices[point_idx] = getVoxelIndex(point_A);
+
+            if (has_normals) {
+              const Eigen::Vector3d normal_B(
+                  points_B.normals[idx], points_B.normals[idx + 1u],
+                  points_B.normals[idx + 2u]);
+              const Eigen::Vector3f normal_A =
+                  q_A_B.rotate(normal_B).cast<float>();
+              normals_A[idx] = normal_A.x();
+              normals_A[idx + 1u] = normal_A.y();
+              normals_A[idx + 2u] = normal_A.z();
+            }
+          }
+        };
+    common::ParallelProcess(
+        num_points, transform_function, kAlwaysParallelize, num_threads);
+
+    // Bucket the points by shard, keeping their order, and fill the shards
+    // concurrently.
+    const size_t num_shards = shards_.size();
+    std::vector<std::vector<size_t>> points_per_shard(num_shards);
+    const VoxelIndexHash hasher;
+    for (size_t point_idx = 0u; point_idx < num_points; ++point_idx) {
+      if (is_valid[point_idx]) {
+        points_per_shard[hasher(voxel_indices[point_idx]) % num_shards]
+            .emplace_back(point_idx);
+      }
+    }
+    // There is one shard per thread by default, which ParallelProcess would
+    // process in a single block unless forced to parallelize.
+    static constexpr bool kAlwaysParallelizeShards = true;
+    std::function<void(const std::vector<size_t>&)> insert_function =
+        [&](const std::vector<size_t>& batch) {
+          for (const size_t shard_idx : batch) {
+            VoxelMap& shard = shards_[shard_idx];
+            for (const size_t point_idx : points_per_shard[shard_idx]) {
+              insertPoint(
+                  voxel_indices[point_idx], point_idx, xyz_A, normals_A,
+                  points_B, &shard);
+            }
+          }
+        };
+    common::ParallelProcess(
+        num_shards, insert_function, kAlwaysParallelizeShards, num_threads);
+  }
+
+  inline size_t numVoxels() const {
+    size_t num_voxels = 0u;
+    for (const VoxelMap& shard : shards_) {
+      num_voxels += shard.size();
+    }
+    return num_voxels;
+  }
+
+  inline bool empty() const {
+    return numVoxels() == 0u;
+  }
+
+  inline void clear() {
+    for (VoxelMap& shard : shards_) {
+      shard.clear();
+    }
+    is_empty_ = true;
+  }
+
+  // Exports one point per occupied voxel.
+  inline void exportPointCloud(PointCloud* point_cloud) const {
+    CHECK_NOTNULL(point_cloud);
+    *point_cloud = PointCloud();
+    point_cloud->resize(
+        numVoxels(), has_normals_, has_colors_, has_scalars_, has_labels_);
+
+    size_t point_idx = 0u;
+    for (const VoxelMap& shard : shards_) {
+      for (const VoxelMap::value_type& index_and_voxel : shard) {
+        const Voxel& voxel = index_and_voxel.second;
+        const double normalization =
+            reduction_ == Reduction::kMean ? 1.0 / voxel.num_points : 1.0;
+        const size_t idx = 3u * point_idx;
+        for (size_t i = 0u; i < 3u; ++i) {
+          point_cloud->xyz[idx + i] = voxel.xyz[i] * normalization;
+        }
+        if (has_normals_) {
+          const float norm = voxel.normal.norm();
+          for (size_t i = 0u; i < 3u; ++i) {
+            point_cloud->normals[idx + i] =
+                norm > 0.0f ? voxel.normal[i] / norm : 0.0f;
+          }
+        }
+        if (has_colors_) {
+          for (size_t i = 0u; i < 3u; ++i) {
+            point_cloud->colors[idx + i] = static_cast<unsigned char>(
+                std::round(voxel.color[i] * normalization));
+          }
+        }
+        if (has_scalars_) {
+          point_cloud->scalars[point_idx] = voxel.scalar * normalization;
+        }
+        if (has_labels_) {
+          point_cloud->labels[point_idx] = voxel.label;
+        }
+        ++point_idx;
+      }
+    }
+    CHECK(point_cloud->checkConsistency(true));
+  }
+
+ private:
+  typedef Eigen::Vector3i VoxelIndex;
+
+  struct VoxelIndexHash {
+    inline size_t operator()(const VoxelIndex& index) const {
+      // Hash function proposed in "Optimized Spatial Hashing for Collision
+      // Detection of Deformable Objects", Teschner et al.
+      return static_cast<size_t>(
+          (static_cast<unsigned int>(index.x()) * 73856093u) ^
+          (static_cast<unsigned int>(index.y()) * 19349669u) ^
+          (static_cast<unsigned int>(index.z()) * 83492791u));
+    }
+  };
+
+  // For kMean the position, color and scalar hold the sum over all points of
+  // the voxel, otherwise the values of the selected point.
+  struct Voxel {
+    Eigen::Vector3d xyz;
+    Eigen::Vector3f normal;
+    Eigen::Vector3f color;
+    float scalar;
+    uint32_t label;
+    uint32_t num_points;
+  };
+
+  typedef std::unordered_map<VoxelIndex, Voxel, VoxelIndexHash> VoxelMap;
+
+  inline VoxelIndex getVoxelIndex(const Eigen::Vector3d& point) const {
+    return (point * inverse_voxel_size_).array().floor().cast<int>();
+  }
+
+  inline void setVoxelToPoint(
+      const size_t point_idx, const std::vector<float>& xyz_A,
+      const std::vector<float>& normals_A, const PointCloud& points_B,
+      Voxel* voxel) const {
+    CHECK_NOTNULL(voxel);
+    const size_t idx = 3u * point_idx;
+    voxel->xyz = Eigen::Vector3d(xyz_A[idx], xyz_A[idx + 1u], xyz_A[idx + 2u]);
+    voxel->normal = normals_A.empty()
+                        ? Eigen::Vector3f::Zero()
+                        : Eigen::Vector3f(
+                              normals_A[idx], normals_A[idx + 1u],
+                              normals_A[idx + 2u]);
+    voxel->color = points_B.hasColor()
+                       ? Eigen::Vector3f(
+                             points_B.colors[idx], points_B.colors[idx + 1u],
+                             points_B.colors[idx + 2u])
+                       : Eigen::Vector3f::Zero();
+    voxel->scalar = points_B.hasScalars() ? points_B.scalars[point_idx] : 0.0f;
+  }
+
+  inline void insertPoint(
+      const VoxelIndex& voxel_index, const size_t point_idx,
+      const std::vector<float>& xyz_A, const std::vector<float>& normals_A,
+      const PointCloud& points_B, VoxelMap* shard) const {
+    CHECK_NOTNULL(shard);
+    std::pair<VoxelMap::iterator, bool> result =
+        shard->emplace(voxel_index, Voxel());
+    Voxel& voxel = result.first->second;
+    if (result.second) {
+      setVoxelToPoint(point_idx, xyz_A, normals_A, points_B, &voxel);
+      voxel.label = points_B.hasLabels() ? points_B.labels[point_idx] : 0u;
+      voxel.num_points = 1u;
+      return;
+    }
+
+    ++voxel.num_points;
+    switch (reduction_) {
+      case Reduction::kMean: {
+        Voxel point;
+        setVoxelToPoint(point_idx, xyz_A, normals_A, points_B, &point);
+        voxel.xyz += point.xyz;
+        voxel.normal += point.normal;
+        voxel.color += point.color;
+        voxel.scalar += point.scalar;
+        break;
+      }
+      case Reduction::kFirst:
+        break;
+      case Reduction::kMaxScalar:
+        if (points_B.hasScalars() &&
+            points_B.scalars[point_idx] > voxel.scalar) {
+          setVoxelToPoint(point_idx, xyz_A, normals_A, points_B, &voxel);
+          voxel.label =
+              points_B.hasLabels() ? points_B.labels[point_idx] : 0u;
+        }
+        break;
+      default:
+        LOG(FATAL) << "Unknown voxel reduction: "
+                   << static_cast<int>(reduction_);
+    }
+  }
+
+  const double inverse_voxel_size_;
+  const Reduction reduction_;
+  std::vector<VoxelMap> shards_;
+
+  bool is_empty_;
+  bool has_normals_;
+  bool has_colors_;
+  bool has_scalars_;
+  bool has_labels_;
+};
+
+}  // namespace resources
+
+#endif  // RESOURCES_COMMON_POINT_CLOUD_VOXEL_ACCUMULATOR_H_
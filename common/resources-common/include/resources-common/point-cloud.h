@@ -3,6 +3,7 @@
 
 #include <cstdio>
 #include <fstream>  // NOLINT
+#include <iostream>  // NOLINT
 #include <string>
 #include <vector>
 
@@ -269,6 +270,14 @@ struct PointCloud {
     CHECK(filebuf.is_open());
 
     std::ostream output_stream(&filebuf);
+    writeToStream(&output_stream);
+    filebuf.close();
+  }
+
+  // Writes the point cloud as binary PLY, which is the content of the file
+  // written by writeToFile(...).
+  inline void writeToStream(std::ostream* output_stream) const {
+    CHECK_NOTNULL(output_stream);
     tinyply::PlyFile ply_file;
 
     // Const-casting is necessary as tinyply requires non-const access to the
@@ -297,8 +306,7 @@ struct PointCloud {
     }
 
     ply_file.comments.push_back("generated by tinyply from maplab");
-    ply_file.write(output_stream, true);
-    filebuf.close();
+    ply_file.write(*output_stream, true);
   }
 
   inline bool loadFromFile(const std::string& file_path) {
@@ -309,45 +317,51 @@ struct PointCloud {
 
     std::ifstream stream_ply(file_path);
     if (stream_ply.is_open()) {
-      tinyply::PlyFile ply_file(stream_ply);
-      const int xyz_point_count = ply_file.request_properties_from_element(
-          "vertex", {"x", "y", "z"}, xyz);
-      const int colors_count = ply_file.request_properties_from_element(
-          "vertex", {"nx", "ny", "nz"}, normals);
-      const int normals_count = ply_file.request_properties_from_element(
-          "vertex", {"red", "green", "blue"}, colors);
-      const int scalar_count = ply_file.request_properties_from_element(
-          "vertex", {"scalar"}, scalars);
-      const int label_count =
-          ply_file.request_properties_from_element("vertex", {"label"}, labels);
-      if (xyz_point_count > 0) {
-        if (colors_count > 0) {
-          // If colors are present, their count should match the point count.
-          CHECK_EQ(xyz_point_count, colors_count);
-        }
-        if (normals_count > 0) {
-          // If normals are present, their count should match the point count.
-          CHECK_EQ(xyz_point_count, normals_count);
-        }
+      loadFromStream(&stream_ply);
+      stream_ply.close();
+      return true;
+    }
+    return false;
+  }
 
-        if (scalar_count > 0) {
-          // If a value attribute is present, its count should match the point
-          // count.
-          CHECK_EQ(xyz_point_count, scalar_count);
-        }
+  // Reads a point cloud in the PLY format from the stream.
+  inline void loadFromStream(std::istream* stream_ply) {
+    CHECK_NOTNULL(stream_ply);
+    tinyply::PlyFile ply_file(*stream_ply);
+    const int xyz_point_count = ply_file.request_properties_from_element(
+        "vertex", {"x", "y", "z"}, xyz);
+    const int colors_count = ply_file.request_properties_from_element(
+        "vertex", {"nx", "ny", "nz"}, normals);
+    const int normals_count = ply_file.request_properties_from_element(
+        "vertex", {"red", "green", "blue"}, colors);
+    const int scalar_count = ply_file.request_properties_from_element(
+        "vertex", {"scalar"}, scalars);
+    const int label_count =
+        ply_file.request_properties_from_element("vertex", {"label"}, labels);
+    if (xyz_point_count > 0) {
+      if (colors_count > 0) {
+        // If colors are present, their count should match the point count.
+        CHECK_EQ(xyz_point_count, colors_count);
+      }
+      if (normals_count > 0) {
+        // If normals are present, their count should match the point count.
+        CHECK_EQ(xyz_point_count, normals_count);
+      }
 
-        if (label_count > 0) {
-          // If a label attribute is present, its count should match the point
-          // count.
-          CHECK_EQ(xyz_point_count, label_count);
-        }
+      if (scalar_count > 0) {
+        // If a value attribute is present, its count should match the point
+        // count.
+        CHECK_EQ(xyz_point_count, scalar_count);
+      }
 
-        ply_file.read(stream_ply);
+      if (label_count > 0) {
+        // If a label attribute is present, its count should match the point
+        // count.
+        CHECK_EQ(xyz_point_count, label_count);
       }
-      stream_ply.close();
-      return true;
+
+      ply_file.read(*stream_ply);
     }
-    return false;
   }
 
   inline bool colorizePointCloud(
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/common/pose-types.h>
+#include <glog/logging.h>
+#include <maplab-common/test/testing-entrypoint.h>
+
+#include "resources-common/point-cloud-voxel-accumulator.h"
+#include "resources-common/point-cloud.h"
+
+namespace resources {
+
+namespace {
+
+void addPoint(
+    const Eigen::Vector3f& xyz, const Eigen::Vector3f& color,
+    const float scalar, const uint32_t label, PointCloud* point_cloud) {
+  CHECK_NOTNULL(point_cloud);
+  for (int i = 0; i < 3; ++i) {
+    point_cloud->xyz.push_back(xyz[i]);
+    point_cloud->normals.push_back(i == 2 ? 1.0f : 0.0f);
+    point_cloud->colors.push_back(static_cast<unsigned char>(color[i]));
+  }
+  point_cloud->scalars.push_back(scalar);
+  point_cloud->labels.push_back(label);
+}
+
+// Two points in the voxel at the origin and one point in another voxel.
+PointCloud createTestPointCloud() {
+  PointCloud point_cloud;
+  addPoint(
+      Eigen::Vector3f(0.2f, 0.2f, 0.2f), Eigen::Vector3f(10.f, 20.f, 30.f),
+      1.0f, 7u, &point_cloud);
+  addPoint(
+      Eigen::Vector3f(0.6f, 0.4f, 0.2f), Eigen::Vector3f(30.f, 40.f, 50.f),
+      3.0f, 8u, &point_cloud);
+  addPoint(
+      Eigen::Vector3f(2.5f, 0.5f, 0.5f), Eigen::Vector3f(0.f, 0.f, 0.f), 2.0f,
+      9u, &point_cloud);
+  return point_cloud;
+}
+
+// Returns the index of the exported point within the unit voxel at the
+// origin.
+size_t getPointInOriginVoxel(const PointCloud& point_cloud) {
+  for (size_t point_idx = 0u; point_idx < point_cloud.size(); ++point_idx) {
+    bool is_in_voxel = true;
+    for (size_t i = 0u; i < 3u; ++i) {
+      const float coordinate = point_cloud.xyz[3u * point_idx + i];
+      is_in_voxel &= coordinate >= 0.0f && coordinate < 1.0f;
+    }
+    if (is_in_voxel) {
+      return point_idx;
+    }
+  }
+  LOG(FATAL) << "No point in the voxel at the origin.";
+  return 0u;
+}
+
+PointCloud accumulate(
+    const PointCloudVoxelAccumulator::Reduction reduction,
+    const PointCloud& point_cloud) {
+  constexpr double kVoxelSizeM = 1.0;
+  PointCloudVoxelAccumulator accumulator(kVoxelSizeM, reduction);
+  accumulator.insertTransformed(point_cloud, aslam::Transformation());
+  PointCloud voxelized_point_cloud;
+  accumulator.exportPointCloud(&voxelized_point_cloud);
+  return voxelized_point_cloud;
+}
+
+typedef std::tuple<
+    float, float, float, float, float, float, unsigned char, unsigned char,
+    unsigned char, float, uint32_t>
+    PointTuple;
+
+// Sorted points with all their attributes, such that point clouds can be
+// compared independent of the point order.
+std::vector<PointTuple> getSortedPoints(const PointCloud& point_cloud) {
+  std::vector<PointTuple> points;
+  for (size_t point_idx = 0u; point_idx < point_cloud.size(); ++point_idx) {
+    const size_t idx = 3u * point_idx;
+    points.emplace_back(
+        point_cloud.xyz[idx], point_cloud.xyz[idx + 1u],
+        point_cloud.xyz[idx + 2u], point_cloud.normals[idx],
+        point_cloud.normals[idx + 1u], point_cloud.normals[idx + 2u],
+        point_cloud.colors[idx], point_cloud.colors[idx + 1u],
+        point_cloud.colors[idx + 2u], point_cloud.scalars[point_idx],
+        point_cloud.labels[point_idx]);
+  }
+  std::sort(points.begin(), points.end());
+  return points;
+}
+
+}  // namespace
+
+TEST(PointCloudVoxelAccumulatorTest, MeanReduction) {
+  const PointCloud voxelized_point_cloud =
+      accumulate(PointCloudVoxelAccumulator::Reduction::kMean,
+                 createTestPointCloud());
+  ASSERT_EQ(voxelized_point_cloud.size(), 2u);
+  const size_t point_idx = getPointInOriginVoxel(voxelized_point_cloud);
+  const size_t idx = 3u * point_idx;
+  EXPECT_NEAR(voxelized_point_cloud.xyz[idx], 0.4f, 1e-6f);
+  EXPECT_NEAR(voxelized_point_cloud.xyz[idx + 1u], 0.3f, 1e-6f);
+  EXPECT_NEAR(voxelized_point_cloud.xyz[idx + 2u], 0.2f, 1e-6f);
+  EXPECT_EQ(voxelized_point_cloud.normals[idx + 2u], 1.0f);
+  EXPECT_EQ(voxelized_point_cloud.colors[idx], 20u);
+  EXPECT_EQ(voxelized_point_cloud.colors[idx + 1u], 30u);
+  EXPECT_EQ(voxelized_point_cloud.colors[idx + 2u], 40u);
+  EXPECT_NEAR(voxelized_point_cloud.scalars[point_idx], 2.0f, 1e-6f);
+  // The label of the first point is kept.
+  EXPECT_EQ(voxelized_point_cloud.labels[point_idx], 7u);
+}
+
+TEST(PointCloudVoxelAccumulatorTest, FirstReduction) {
+  const PointCloud voxelized_point_cloud =
+      accumulate(PointCloudVoxelAccumulator::Reduction::kFirst,
+                 createTestPointCloud());
+  ASSERT_EQ(voxelized_point_cloud.size(), 2u);
+  const size_t point_idx = getPointInOriginVoxel(voxelized_point_cloud);
+  EXPECT_NEAR(voxelized_point_cloud.xyz[3u * point_idx], 0.2f, 1e-6f);
+  EXPECT_EQ(voxelized_point_cloud.colors[3u * point_idx], 10u);
+  EXPECT_EQ(voxelized_point_cloud.scalars[point_idx], 1.0f);
+  EXPECT_EQ(voxelized_point_cloud.labels[point_idx], 7u);
+}
+
+TEST(PointCloudVoxelAccumulatorTest, MaxScalarReduction) {
+  const PointCloud voxelized_point_cloud =
+      accumulate(PointCloudVoxelAccumulator::Reduction::kMaxScalar,
+                 createTestPointCloud());
+  ASSERT_EQ(voxelized_point_cloud.size(), 2u);
+  const size_t point_idx = getPointInOriginVoxel(voxelized_point_cloud);
+  EXPECT_NEAR(voxelized_point_cloud.xyz[3u * point_idx], 0.6f, 1e-6f);
+  EXPECT_EQ(voxelized_point_cloud.colors[3u * point_idx], 30u);
+  EXPECT_EQ(voxelized_point_cloud.scalars[point_idx], 3.0f);
+  EXPECT_EQ(voxelized_point_cloud.labels[point_idx], 8u);
+}
+
+TEST(PointCloudVoxelAccumulatorTest, TransformsAndDropsMissingAttributes) {
+  constexpr double kVoxelSizeM = 1.0;
+  PointCloudVoxelAccumulator accumulator(
+      kVoxelSizeM, PointCloudVoxelAccumulator::Reduction::kFirst);
+  const aslam::Transformation T_A_B(
+      aslam::Quaternion(), aslam::Position3D(10.0, 0.0, 0.0));
+  accumulator.insertTransformed(createTestPointCloud(), T_A_B);
+
+  // The second point cloud has neither normals nor colors.
+  PointCloud points_without_normals_and_colors = createTestPointCloud();
+  points_without_normals_and_colors.normals.clear();
+  points_without_normals_and_colors.colors.clear();
+  accumulator.insertTransformed(
+      points_without_normals_and_colors, aslam::Transformation());
+  EXPECT_EQ(accumulator.numVoxels(), 4u);
+
+  PointCloud voxelized_point_cloud;
+  accumulator.exportPointCloud(&voxelized_point_cloud);
+  ASSERT_EQ(voxelized_point_cloud.size(), 4u);
+  EXPECT_FALSE(voxelized_point_cloud.hasNormals());
+  EXPECT_FALSE(voxelized_point_cloud.hasColor());
+  EXPECT_TRUE(voxelized_point_cloud.hasScalars());
+  EXPECT_TRUE(voxelized_point_cloud.hasLabels());
+
+  // The points of the first point cloud are shifted by the transformation.
+  size_t num_shifted_points = 0u;
+  for (size_t point_idx = 0u; point_idx < voxelized_point_cloud.size();
+       ++point_idx) {
+    if (voxelized_point_cloud.xyz[3u * point_idx] >= 10.0f) {
+      ++num_shifted_points;
+    }
+  }
+  EXPECT_EQ(num_shifted_points, 2u);
+
+  accumulator.clear();
+  EXPECT_TRUE(accumulator.empty());
+  accumulator.insertTransformed(createTestPointCloud(), T_A_B);
+  accumulator.exportPointCloud(&voxelized_point_cloud);
+  EXPECT_TRUE(voxelized_point_cloud.hasNormals());
+  EXPECT_TRUE(voxelized_point_cloud.hasColor());
+}
+
+TEST(PointCloudVoxelAccumulatorTest, ResultIsIndependentOfNumberOfShards) {
+  constexpr size_t kNumPoints = 5000u;
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<float> position_distribution(-5.0f, 5.0f);
+  std::uniform_real_distribution<float> value_distribution(0.0f, 255.0f);
+  PointCloud point_cloud;
+  for (size_t point_idx = 0u; point_idx < kNumPoints; ++point_idx) {
+    addPoint(
+        Eigen::Vector3f(
+            position_distribution(generator), position_distribution(generator),
+            position_distribution(generator)),
+        Eigen::Vector3f(
+            value_distribution(generator), value_distribution(generator),
+            value_distribution(generator)),
+        value_distribution(generator), static_cast<uint32_t>(point_idx),
+        &point_cloud);
+  }
+  const aslam::Transformation T_A_B(
+      aslam::Quaternion(
+          aslam::AngleAxis(0.3, Eigen::Vector3d(0.1, 0.2, -0.3).normalized())),
+      aslam::Position3D(0.3, -0.2, 0.1));
+
+  constexpr double kVoxelSizeM = 0.5;
+  for (const PointCloudVoxelAccumulator::Reduction reduction :
+       {PointCloudVoxelAccumulator::Reduction::kMean,
+        PointCloudVoxelAccumulator::Reduction::kFirst,
+        PointCloudVoxelAccumulator::Reduction::kMaxScalar}) {
+    std::vector<PointTuple> reference_points;
+    for (const size_t num_shards : {1u, 3u, 8u}) {
+      PointCloudVoxelAccumulator accumulator(
+          kVoxelSizeM, reduction, num_shards);
+      accumulator.insertTransformed(point_cloud, aslam::Transformation());
+      accumulator.insertTransformed(point_cloud, T_A_B);
+      PointCloud voxelized_point_cloud;
+      accumulator.exportPointCloud(&voxelized_point_cloud);
+      ASSERT_GT(voxelized_point_cloud.size(), 0u);
+      ASSERT_LT(voxelized_point_cloud.size(), 2u * kNumPoints);
+
+      const std::vector<PointTuple> points =
+          getSortedPoints(voxelized_point_cloud);
+      if (num_shards == 1u) {
+        reference_points = points;
+      } else {
+        // Every voxel receives its points in the same order, hence the
+        // result is identical and not just close.
+        EXPECT_TRUE(points == reference_points)
+            << "Reduction " << static_cast<int>(reduction) << " with "
+            << num_shards << " shards differs from a single shard.";
+      }
+    }
+  }
+}
+
+}  // namespace resources
+
+MAPLAB_UNITTEST_ENTRYPOINT
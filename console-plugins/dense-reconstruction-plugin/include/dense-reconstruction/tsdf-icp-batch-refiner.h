@@ -0,0 +1,155 @@
+#ifndef DENSE_RECONSTRUCTION_TSDF_ICP_BATCH_REFINER_H_
+#define DENSE_RECONSTRUCTION_TSDF_ICP_BATCH_REFINER_H_
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+#include <voxblox/core/common.h>
+
+namespace dense_reconstruction {
+
+// Refines the poses of point clouds with ICP before they are integrated into a
+// TSDF map. Instead of aligning every point cloud against the TSDF layer one
+// after the other, the point clouds are buffered and every batch is aligned in
+// parallel against a local surface model. The surface model stores the
+// centroids of the points that fell into each voxel, grouped in blocks, and
+// only keeps the blocks that were updated by the recent batches. Once a batch
+// is aligned, its point clouds are passed to the integration function and
+// added to the surface model in their original order.
+class TsdfIcpBatchRefiner {
+ public:
+  struct Config {
+    // Number of point clouds that are aligned concurrently.
+    size_t batch_size = 16u;
+    size_t num_threads = 0u;  // 0 = number of hardware threads.
+
+    // Surface model.
+    voxblox::FloatingPoint voxel_size_m = 0.2;
+    size_t voxels_per_side = 16u;
+    // Blocks that were not updated by this many batches are dropped.
+    size_t max_block_age_batches = 10u;
+
+    // ICP.
+    size_t max_iterations = 20u;
+    size_t max_points_per_cloud = 2000u;
+    size_t min_num_correspondences = 50u;
+    voxblox::FloatingPoint max_correspondence_distance_m = 0.2;
+    voxblox::FloatingPoint convergence_translation_m = 1e-4;
+    voxblox::FloatingPoint convergence_rotation_rad = 1e-4;
+    bool refine_roll_pitch = false;
+    // The corresponding points need to extend in all three directions, the
+    // ratio of the smallest to the largest eigenvalue of their covariance
+    // must be at least this. Otherwise, e.g. for a single plane, the
+    // alignment is not constrained in all directions.
+    voxblox::FloatingPoint min_eigenvalue_ratio = 0.01;
+    // Fraction of the sampled points that need a correspondence at the
+    // refined pose.
+    voxblox::FloatingPoint min_inlier_ratio = 0.5;
+
+    // If enabled, the correction of the last point cloud of a batch is used
+    // as prior for the alignment of the next batch.
+    bool accumulate_corrections = false;
+  };
+
+  typedef std::function<void(
+      const voxblox::Transformation& T_G_C, const voxblox::Pointcloud& points,
+      const voxblox::Colors& colors)>
+      IntegrationFunction;
+
+  TsdfIcpBatchRefiner(
+      const Config& config, const IntegrationFunction& integration_function);
+
+  // Buffers the point cloud and aligns and integrates the buffered point
+  // clouds once a batch is full.
+  void addPointCloud(
+      const voxblox::Transformation& T_G_C, const voxblox::Pointcloud& points,
+      const voxblox::Colors& colors);
+
+  // Aligns and integrates all buffered point clouds.
+  void flush();
+
+  inline size_t numIntegratedPointClouds() const {
+    return num_integrated_point_clouds_;
+  }
+  inline size_t numAlignedPointClouds() const {
+    return num_aligned_point_clouds_;
+  }
+
+ private:
+  typedef Eigen::Vector3i GridIndex;
+
+  struct GridIndexHash {
+    inline size_t operator()(const GridIndex& index) const {
+      return static_cast<size_t>(
+          (static_cast<unsigned int>(index.x()) * 73856093u) ^
+          (static_cast<unsigned int>(index.y()) * 19349669u) ^
+          (static_cast<unsigned int>(index.z()) * 83492791u));
+    }
+  };
+
+  struct Centroid {
+    Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+    uint32_t num_points = 0u;
+  };
+
+  struct SurfaceBlock {
+    std::unordered_map<GridIndex, Centroid, GridIndexHash> voxels;
+    size_t last_updated_batch = 0u;
+  };
+
+  struct BufferedPointCloud {
+    voxblox::Transformation T_G_C;
+    voxblox::Pointcloud points;
+    voxblox::Colors colors;
+
+    voxblox::Transformation T_G_C_refined;
+    size_t num_correspondences = 0u;
+    voxblox::FloatingPoint inlier_ratio = 0.0;
+    bool aligned = false;
+  };
+
+  // Runs point-to-point ICP against the surface model, starting at
+  // T_G_C_refined. Returns false if there are not enough correspondences,
+  // their geometry is degenerate, ICP didn't converge within max_iterations
+  // or too few points have a correspondence at the refined pose.
+  bool alignPointCloud(BufferedPointCloud* point_cloud) const;
+  bool isDegenerate(const Eigen::Matrix3Xf& points_G) const;
+
+  bool findClosestCentroid(
+      const voxblox::Point& point_G, voxblox::Point* centroid_G) const;
+
+  void addToSurfaceModel(
+      const voxblox::Transformation& T_G_C, const voxblox::Pointcloud& points);
+  void removeOldSurfaceBlocks();
+
+  inline GridIndex getVoxelIndex(const voxblox::Point& point_G) const {
+    return (point_G / config_.voxel_size_m).array().floor().cast<int>();
+  }
+  inline GridIndex getBlockIndex(const GridIndex& voxel_index) const {
+    const int voxels_per_side = static_cast<int>(config_.voxels_per_side);
+    return GridIndex(
+        floorDivide(voxel_index.x(), voxels_per_side),
+        floorDivide(voxel_index.y(), voxels_per_side),
+        floorDivide(voxel_index.z(), voxels_per_side));
+  }
+  static inline int floorDivide(const int value, const int divisor) {
+    return (value >= 0) ? value / divisor : (value - divisor + 1) / divisor;
+  }
+
+  const Config config_;
+  const IntegrationFunction integration_function_;
+
+  std::vector<BufferedPointCloud> buffer_;
+  std::unordered_map<GridIndex, SurfaceBlock, GridIndexHash> surface_blocks_;
+  voxblox::Transformation T_G_C_correction_;
+
+  size_t num_batches_;
+  size_t num_integrated_point_clouds_;
+  size_t num_aligned_point_clouds_;
+};
+
+}  // namespace dense_reconstruction
+
+#endif  // DENSE_RECONSTRUCTION_TSDF_ICP_BATCH_REFINER_H_
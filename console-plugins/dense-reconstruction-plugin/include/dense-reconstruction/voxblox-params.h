@@ -14,6 +14,8 @@
 #include <voxblox_ros/esdf_server.h>
 #include <voxblox_ros/mesh_vis.h>
 
+#include "dense-reconstruction/tsdf-icp-batch-refiner.h"
+
 DECLARE_bool(dense_esdf_use_clear_sphere);
 DECLARE_bool(dense_tsdf_icp_accumulate_transformations);
 DECLARE_bool(dense_tsdf_icp_enabled);
@@ -32,6 +34,10 @@ DECLARE_double(dense_tsdf_truncation_distance_m);
 DECLARE_double(dense_tsdf_voxel_size_m);
 DECLARE_double(dense_tsdf_max_weight);
 DECLARE_double(dense_tsdf_clearing_ray_weight_factor);
+DECLARE_double(dense_tsdf_icp_batch_max_correspondence_distance_m);
+DECLARE_double(dense_tsdf_icp_batch_surface_voxel_size_m);
+DECLARE_int32(dense_tsdf_icp_batch_max_block_age);
+DECLARE_int32(dense_tsdf_icp_batch_size);
 DECLARE_int32(dense_tsdf_integrate_every_nth);
 DECLARE_int32(dense_tsdf_mesh_update_every_nth_cloud);
 DECLARE_string(dense_tsdf_integrator_type);
@@ -52,6 +58,8 @@ voxblox::MeshIntegratorConfig getTsdfMeshIntegratorConfigFromGflags();
 
 voxblox::ICP::Config getTsdfIcpConfigFromGflags();
 
+TsdfIcpBatchRefiner::Config getTsdfIcpBatchRefinerConfigFromGflags();
+
 voxblox::EsdfIntegrator::Config getEsdfIntegratorConfigFromGflags();
 
 voxblox::EsdfMap::Config getEsdfMapConfigFromGflags();
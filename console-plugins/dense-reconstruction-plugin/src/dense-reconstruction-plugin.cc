@@ -2,6 +2,7 @@
 
 #include <chrono>
 #include <cstring>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -30,6 +31,7 @@
 #include <voxblox_ros/esdf_server.h>
 #include <voxblox_ros/mesh_vis.h>
 
+#include "dense-reconstruction/tsdf-icp-batch-refiner.h"
 #include "dense-reconstruction/voxblox-params.h"
 
 DECLARE_string(map_mission_list);
@@ -311,19 +313,66 @@ DenseReconstructionPlugin::DenseReconstructionPlugin(
         size_t num_pointclouds_integrated = 0u;
         size_t num_points_integrated = 0u;
 
+        // Integrates a point cloud with its final pose into the TSDF map and
+        // updates the mesh.
+        TsdfIcpBatchRefiner::IntegrationFunction integrate_point_cloud =
+            [&integrator, &num_pointclouds_integrated, &color_mode,
+             &mesh_layer, &mesh_integrator, &num_points_integrated](
+                const voxblox::Transformation& T_G_C_refined,
+                const voxblox::Pointcloud& points,
+                const voxblox::Colors& colors) {
+              integrator->integratePointCloud(T_G_C_refined, points, colors);
+
+              ++num_pointclouds_integrated;
+              num_points_integrated += points.size();
+
+              if (num_pointclouds_integrated %
+                      FLAGS_dense_tsdf_mesh_update_every_nth_cloud ==
+                  0u) {
+                constexpr bool only_mesh_updated_blocks = true;
+                constexpr bool clear_updated_flag = true;
+                mesh_integrator.generateMesh(
+                    only_mesh_updated_blocks, clear_updated_flag);
+
+                // Publish mesh.
+                if (FLAGS_dense_tsdf_publish_mesh_ros) {
+                  voxblox_msgs::Mesh mesh_msg;
+                  voxblox::generateVoxbloxMeshMsg(
+                      &mesh_layer, color_mode, &mesh_msg);
+                  mesh_msg.header.frame_id = FLAGS_tf_map_frame;
+                  visualization::RVizVisualizationSink::publish(
+                      "surface", mesh_msg);
+                }
+              }
+            };
+
+        // If enabled, the point clouds are aligned in batches against a
+        // local surface model instead of the TSDF grid.
+        std::unique_ptr<TsdfIcpBatchRefiner> icp_batch_refiner;
+        if (FLAGS_dense_tsdf_icp_enabled &&
+            FLAGS_dense_tsdf_icp_batch_size > 0) {
+          icp_batch_refiner.reset(new TsdfIcpBatchRefiner(
+              getTsdfIcpBatchRefinerConfigFromGflags(), integrate_point_cloud));
+        }
+
+        size_t num_pointclouds_received = 0u;
         depth_integration::IntegrationFunctionPointCloudVoxblox
-            integration_function = [&integrator, &icp, &T_G_C_icp_correction,
-                                    &tsdf_map, &num_pointclouds_integrated,
-                                    &color_mode, &mesh_layer, &mesh_integrator,
-                                    &num_points_integrated](
+            integration_function = [&integrate_point_cloud, &icp,
+                                    &icp_batch_refiner, &T_G_C_icp_correction,
+                                    &tsdf_map, &num_pointclouds_received](
                                        const voxblox::Transformation& T_G_C,
                                        const voxblox::Pointcloud& points,
                                        const voxblox::Colors& colors) {
+              const size_t pointcloud_idx = num_pointclouds_received++;
               if (FLAGS_dense_tsdf_integrate_every_nth > 1 &&
-                  (static_cast<int>(num_pointclouds_integrated) %
+                  (static_cast<int>(pointcloud_idx) %
                        FLAGS_dense_tsdf_integrate_every_nth ==
                    0)) {
-                ++num_pointclouds_integrated;
+                return;
+              }
+
+              if (icp_batch_refiner) {
+                icp_batch_refiner->addPointCloud(T_G_C, points, colors);
                 return;
               }
 
@@ -350,29 +399,7 @@ DenseReconstructionPlugin::DenseReconstructionPlugin(
                 }
               }
 
-              integrator->integratePointCloud(T_G_C_refined, points, colors);
-
-              ++num_pointclouds_integrated;
-              num_points_integrated += points.size();
-
-              if (num_pointclouds_integrated %
-                      FLAGS_dense_tsdf_mesh_update_every_nth_cloud ==
-                  0u) {
-                constexpr bool only_mesh_updated_blocks = true;
-                constexpr bool clear_updated_flag = true;
-                mesh_integrator.generateMesh(
-                    only_mesh_updated_blocks, clear_updated_flag);
-
-                // Publish mesh.
-                if (FLAGS_dense_tsdf_publish_mesh_ros) {
-                  voxblox_msgs::Mesh mesh_msg;
-                  voxblox::generateVoxbloxMeshMsg(
-                      &mesh_layer, color_mode, &mesh_msg);
-                  mesh_msg.header.frame_id = FLAGS_tf_map_frame;
-                  visualization::RVizVisualizationSink::publish(
-                      "surface", mesh_msg);
-                }
-              }
+              integrate_point_cloud(T_G_C_refined, points, colors);
             };
 
         const backend::ResourceType input_resource_type =
@@ -391,6 +418,13 @@ DenseReconstructionPlugin::DenseReconstructionPlugin(
             mission_ids, input_resource_type,
             FLAGS_dense_depth_map_reprojection_use_undistorted_camera, *map,
             integration_function);
+        if (icp_batch_refiner) {
+          icp_batch_refiner->flush();
+          LOG(INFO) << "ICP aligned "
+                    << icp_batch_refiner->numAlignedPointClouds() << "/"
+                    << icp_batch_refiner->numIntegratedPointClouds()
+                    << " point clouds.";
+        }
         const double tsdf_integration_time_s = tsdf_timer.Stop();
 
         constexpr double kBytesToMegaBytes = 1e-6;
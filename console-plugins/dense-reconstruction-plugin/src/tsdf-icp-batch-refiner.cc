@@ -0,0 +1,288 @@
+#include "dense-reconstruction/tsdf-icp-batch-refiner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <Eigen/Eigenvalues>
+#include <Eigen/Geometry>
+#include <aslam/common/statistics/statistics.h>
+#include <glog/logging.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
+
+namespace dense_reconstruction {
+
+TsdfIcpBatchRefiner::TsdfIcpBatchRefiner(
+    const Config& config, const IntegrationFunction& integration_function)
+    : config_(config),
+      integration_function_(integration_function),
+      num_batches_(0u),
+      num_integrated_point_clouds_(0u),
+      num_aligned_point_clouds_(0u) {
+  CHECK(integration_function_);
+  CHECK_GT(config_.batch_size, 0u);
+  CHECK_GT(config_.voxel_size_m, 0.0);
+  CHECK_GT(config_.voxels_per_side, 0u);
+  CHECK_GT(config_.max_points_per_cloud, 0u);
+  CHECK_GE(config_.min_eigenvalue_ratio, 0.0);
+  CHECK_GE(config_.min_inlier_ratio, 0.0);
+  CHECK_LE(config_.min_inlier_ratio, 1.0);
+  buffer_.reserve(config_.batch_size);
+}
+
+void TsdfIcpBatchRefiner::addPointCloud(
+    const voxblox::Transformation& T_G_C, const voxblox::Pointcloud& points,
+    const voxblox::Colors& colors) {
+  buffer_.emplace_back();
+  BufferedPointCloud& point_cloud = buffer_.back();
+  point_cloud.T_G_C = T_G_C;
+  point_cloud.points = points;
+  point_cloud.colors = colors;
+
+  if (buffer_.size() >= config_.batch_size) {
+    flush();
+  }
+}
+
+void TsdfIcpBatchRefiner::flush() {
+  if (buffer_.empty()) {
+    return;
+  }
+  ++num_batches_;
+
+  // All point clouds of the batch start from the same prior correction and
+  // are aligned against the surface model of the previous batches, which is
+  // not modified while the alignment runs.
+  if (!config_.accumulate_corrections) {
+    T_G_C_correction_.setIdentity();
+  }
+  for (BufferedPointCloud& point_cloud : buffer_) {
+    point_cloud.T_G_C_refined = T_G_C_correction_ * point_cloud.T_G_C;
+  }
+  if (!surface_blocks_.empty()) {
+    const size_t num_threads = config_.num_threads > 0u
+                                   ? config_.num_threads
+                                   : common::getNumHardwareThreads();
+    // A batch usually holds fewer point clouds than twice the number of
+    // threads, ParallelProcess would align those in a single block.
+    constexpr bool kAlwaysParallelize = true;
+    std::function<void(const std::vector<size_t>&)> align_function =
+        [this](const std::vector<size_t>& batch) {
+          for (const size_t idx : batch) {
+            BufferedPointCloud& point_cloud = buffer_[idx];
+            point_cloud.aligned = alignPointCloud(&point_cloud);
+            if (!point_cloud.aligned) {
+              point_cloud.T_G_C_refined =
+                  T_G_C_correction_ * point_cloud.T_G_C;
+            }
+          }
+        };
+    common::ParallelProcess(
+        buffer_.size(), align_function, kAlwaysParallelize, num_threads);
+  }
+
+  // Integrate the point clouds in their original order and feed the
+  // corrections back.
+  size_t num_aligned = 0u;
+  double sum_translation_correction_m = 0.0;
+  double sum_rotation_correction_rad = 0.0;
+  for (const BufferedPointCloud& point_cloud : buffer_) {
+    integration_function_(
+        point_cloud.T_G_C_refined, point_cloud.points, point_cloud.colors);
+    addToSurfaceModel(point_cloud.T_G_C_refined, point_cloud.points);
+    ++num_integrated_point_clouds_;
+
+    if (!point_cloud.aligned) {
+      continue;
+    }
+    ++num_aligned;
+    const voxblox::Transformation correction =
+        point_cloud.T_G_C_refined * point_cloud.T_G_C.inverse();
+    sum_translation_correction_m += correction.getPosition().norm();
+    sum_rotation_correction_rad +=
+        std::abs(correction.getRotation().toImplementation().angularDistance(
+            Eigen::Quaternionf::Identity()));
+    T_G_C_correction_ = correction;
+  }
+  num_aligned_point_clouds_ += num_aligned;
+  removeOldSurfaceBlocks();
+
+  if (num_aligned > 0u) {
+    const double mean_translation_correction_m =
+        sum_translation_correction_m / num_aligned;
+    const double mean_rotation_correction_deg =
+        sum_rotation_correction_rad / num_aligned * 180.0 / M_PI;
+    statistics::StatsCollector(
+        "TSDF ICP batch refinement: mean translation correction [m]")
+        .AddSample(mean_translation_correction_m);
+    statistics::StatsCollector(
+        "TSDF ICP batch refinement: mean rotation correction [deg]")
+        .AddSample(mean_rotation_correction_deg);
+    VLOG(1) << "ICP batch " << num_batches_ << ": aligned " << num_aligned
+            << "/" << buffer_.size() << " point clouds, mean correction "
+            << mean_translation_correction_m << "m / "
+            << mean_rotation_correction_deg << "deg.";
+  } else {
+    VLOG(1) << "ICP batch " << num_batches_ << ": none of the "
+            << buffer_.size() << " point clouds could be aligned.";
+  }
+  buffer_.clear();
+}
+
+bool TsdfIcpBatchRefiner::alignPointCloud(
+    BufferedPointCloud* point_cloud) const {
+  CHECK_NOTNULL(point_cloud);
+  const voxblox::Pointcloud& points_C = point_cloud->points;
+  if (points_C.empty()) {
+    return false;
+  }
+  const size_t stride = std::max<size_t>(
+      1u, points_C.size() / config_.max_points_per_cloud);
+
+  voxblox::Transformation& T_G_C = point_cloud->T_G_C_refined;
+  Eigen::Matrix3Xf points_G(3, points_C.size() / stride + 1u);
+  Eigen::Matrix3Xf centroids_G(3, points_G.cols());
+  bool converged = false;
+  for (size_t iteration = 0u; iteration < config_.max_iterations;
+       ++iteration) {
+    size_t num_sampled_points = 0u;
+    size_t num_correspondences = 0u;
+    for (size_t idx = 0u; idx < points_C.size(); idx += stride) {
+      const voxblox::Point point_G = T_G_C * points_C[idx];
+      if (!point_G.allFinite()) {
+        continue;
+      }
+      ++num_sampled_points;
+      voxblox::Point centroid_G;
+      if (findClosestCentroid(point_G, &centroid_G)) {
+        points_G.col(num_correspondences) = point_G;
+        centroids_G.col(num_correspondences) = centroid_G;
+        ++num_correspondences;
+      }
+    }
+    point_cloud->num_correspondences = num_correspondences;
+    point_cloud->inlier_ratio =
+        num_sampled_points > 0u
+            ? static_cast<voxblox::FloatingPoint>(num_correspondences) /
+                  num_sampled_points
+            : 0.0;
+    if (num_correspondences < config_.min_num_correspondences ||
+        isDegenerate(points_G.leftCols(num_correspondences))) {
+      return false;
+    }
+
+    constexpr bool kEstimateScale = false;
+    const Eigen::Matrix4f T_delta_matrix = Eigen::umeyama(
+        points_G.leftCols(num_correspondences),
+        centroids_G.leftCols(num_correspondences), kEstimateScale);
+    Eigen::Matrix3f R_delta = T_delta_matrix.topLeftCorner<3, 3>();
+    Eigen::Vector3f t_delta = T_delta_matrix.topRightCorner<3, 1>();
+    if (!config_.refine_roll_pitch) {
+      // Only keep the yaw and recompute the translation accordingly.
+      const float yaw = std::atan2(R_delta(1, 0), R_delta(0, 0));
+      R_delta = Eigen::AngleAxisf(yaw, Eigen::Vector3f::UnitZ());
+      t_delta = centroids_G.leftCols(num_correspondences).rowwise().mean() -
+                R_delta *
+                    points_G.leftCols(num_correspondences).rowwise().mean();
+    }
+    const voxblox::Transformation T_delta(
+        voxblox::Rotation(Eigen::Quaternionf(R_delta).normalized()), t_delta);
+    T_G_C = T_delta * T_G_C;
+
+    if (t_delta.norm() < config_.convergence_translation_m &&
+        Eigen::AngleAxisf(R_delta).angle() <
+            config_.convergence_rotation_rad) {
+      converged = true;
+      break;
+    }
+  }
+  // The correspondences of the last iteration were found at a pose that
+  // differs by less than the convergence thresholds from the refined pose.
+  return converged && point_cloud->inlier_ratio >= config_.min_inlier_ratio;
+}
+
+bool TsdfIcpBatchRefiner::isDegenerate(
+    const Eigen::Matrix3Xf& points_G) const {
+  if (points_G.cols() < 3) {
+    return true;
+  }
+  const Eigen::Vector3f mean_G = points_G.rowwise().mean();
+  const Eigen::Matrix3Xf centered_points_G = points_G.colwise() - mean_G;
+  const Eigen::Matrix3f covariance =
+      centered_points_G * centered_points_G.transpose() / points_G.cols();
+  // The eigenvalues are sorted in increasing order.
+  const Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(
+      covariance, Eigen::EigenvaluesOnly);
+  const Eigen::Vector3f& eigenvalues = solver.eigenvalues();
+  return eigenvalues(2) <= 0.0f ||
+         eigenvalues(0) < config_.min_eigenvalue_ratio * eigenvalues(2);
+}
+
+bool TsdfIcpBatchRefiner::findClosestCentroid(
+    const voxblox::Point& point_G, voxblox::Point* centroid_G) const {
+  CHECK_NOTNULL(centroid_G);
+  const GridIndex voxel_index = getVoxelIndex(point_G);
+  const int search_radius = static_cast<int>(std::ceil(
+      config_.max_correspondence_distance_m / config_.voxel_size_m));
+  const voxblox::FloatingPoint max_squared_distance =
+      config_.max_correspondence_distance_m *
+      config_.max_correspondence_distance_m;
+
+  voxblox::FloatingPoint min_squared_distance =
+      std::numeric_limits<voxblox::FloatingPoint>::max();
+  for (int dx = -search_radius; dx <= search_radius; ++dx) {
+    for (int dy = -search_radius; dy <= search_radius; ++dy) {
+      for (int dz = -search_radius; dz <= search_radius; ++dz) {
+        const GridIndex neighbor_index = voxel_index + GridIndex(dx, dy, dz);
+        const auto block_it =
+            surface_blocks_.find(getBlockIndex(neighbor_index));
+        if (block_it == surface_blocks_.end()) {
+          continue;
+        }
+        const auto voxel_it = block_it->second.voxels.find(neighbor_index);
+        if (voxel_it == block_it->second.voxels.end()) {
+          continue;
+        }
+        const Centroid& centroid = voxel_it->second;
+        const voxblox::Point candidate_G = centroid.sum / centroid.num_points;
+        const voxblox::FloatingPoint squared_distance =
+            (candidate_G - point_G).squaredNorm();
+        if (squared_distance < min_squared_distance) {
+          min_squared_distance = squared_distance;
+          *centroid_G = candidate_G;
+        }
+      }
+    }
+  }
+  return min_squared_distance <= max_squared_distance;
+}
+
+void TsdfIcpBatchRefiner::addToSurfaceModel(
+    const voxblox::Transformation& T_G_C, const voxblox::Pointcloud& points) {
+  for (const voxblox::Point& point_C : points) {
+    const voxblox::Point point_G = T_G_C * point_C;
+    if (!point_G.allFinite()) {
+      continue;
+    }
+    const GridIndex voxel_index = getVoxelIndex(point_G);
+    SurfaceBlock& block = surface_blocks_[getBlockIndex(voxel_index)];
+    block.last_updated_batch = num_batches_;
+    Centroid& centroid = block.voxels[voxel_index];
+    centroid.sum += point_G;
+    ++centroid.num_points;
+  }
+}
+
+void TsdfIcpBatchRefiner::removeOldSurfaceBlocks() {
+  for (auto it = surface_blocks_.begin(); it != surface_blocks_.end();) {
+    if (it->second.last_updated_batch + config_.max_block_age_batches <
+        num_batches_) {
+      it = surface_blocks_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace dense_reconstruction
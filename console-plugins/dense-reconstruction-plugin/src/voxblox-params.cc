@@ -1,5 +1,7 @@
 #include "dense-reconstruction/voxblox-params.h"
 
+#include <glog/logging.h>
+
 DEFINE_bool(
     dense_esdf_use_clear_sphere, false,
     "If enabled, for every integrated point cloud, the unknown voxels in a "
@@ -75,6 +77,27 @@ DEFINE_bool(
     "If enabled, ICP will refine roll and pitch as well when integrating point "
     "clouds into the TSDF or ESDF maps.");
 
+DEFINE_int32(
+    dense_tsdf_icp_batch_size, 16,
+    "Number of point clouds that are aligned concurrently against a local "
+    "surface model of the recently integrated point clouds, before they are "
+    "integrated in order. If 0, every point cloud is aligned against the TSDF "
+    "grid one after the other using the Voxblox ICP.");
+
+DEFINE_double(
+    dense_tsdf_icp_batch_surface_voxel_size_m, 0.2,
+    "Voxel size of the local surface model used by the batched ICP [m].");
+
+DEFINE_double(
+    dense_tsdf_icp_batch_max_correspondence_distance_m, 0.2,
+    "Maximum distance between a point and the surface model to be used as "
+    "correspondence by the batched ICP [m].");
+
+DEFINE_int32(
+    dense_tsdf_icp_batch_max_block_age, 10,
+    "Blocks of the local surface model that have not been updated by this "
+    "many batches are removed from the batched ICP surface model.");
+
 DEFINE_double(
     dense_tsdf_voxel_size_m, 0.10, "Voxel size of the TSDF grid [m].");
 
@@ -190,6 +213,23 @@ voxblox::ICP::Config getTsdfIcpConfigFromGflags() {
   return config;
 }
 
+TsdfIcpBatchRefiner::Config getTsdfIcpBatchRefinerConfigFromGflags() {
+  CHECK_GT(FLAGS_dense_tsdf_icp_batch_size, 0);
+  CHECK_GE(FLAGS_dense_tsdf_icp_batch_max_block_age, 0);
+  TsdfIcpBatchRefiner::Config config;
+  config.batch_size = FLAGS_dense_tsdf_icp_batch_size;
+  config.voxel_size_m = static_cast<voxblox::FloatingPoint>(
+      FLAGS_dense_tsdf_icp_batch_surface_voxel_size_m);
+  config.voxels_per_side = FLAGS_dense_tsdf_voxels_per_side;
+  config.max_block_age_batches = FLAGS_dense_tsdf_icp_batch_max_block_age;
+  config.max_correspondence_distance_m = static_cast<voxblox::FloatingPoint>(
+      FLAGS_dense_tsdf_icp_batch_max_correspondence_distance_m);
+  config.refine_roll_pitch = FLAGS_dense_tsdf_icp_refine_roll_and_pitch;
+  config.accumulate_corrections =
+      FLAGS_dense_tsdf_icp_accumulate_transformations;
+  return config;
+}
+
 voxblox::EsdfIntegrator::Config getEsdfIntegratorConfigFromGflags() {
   voxblox::EsdfIntegrator::Config config;
   config.min_distance_m =
@@ -0,0 +1,149 @@
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+#include <glog/logging.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <voxblox/core/common.h>
+
+#include "dense-reconstruction/tsdf-icp-batch-refiner.h"
+
+namespace dense_reconstruction {
+
+namespace {
+constexpr voxblox::FloatingPoint kVoxelSizeM = 0.1;
+constexpr voxblox::FloatingPoint kPointSpacingM = 0.05;
+constexpr int kNumPointsPerSide = 40;
+// The planes pass through the voxel centers and every voxel holds the same
+// number of points, such that the voxel centroids are not biased.
+constexpr voxblox::FloatingPoint kPlaneOffsetM = 0.05;
+}  // namespace
+
+class TsdfIcpBatchRefinerTest : public ::testing::Test {
+ protected:
+  typedef std::vector<
+      voxblox::Transformation,
+      Eigen::aligned_allocator<voxblox::Transformation>>
+      TransformationVector;
+
+  TsdfIcpBatchRefinerTest() {
+    config_.batch_size = 1u;
+    config_.num_threads = 2u;
+    config_.voxel_size_m = kVoxelSizeM;
+    config_.max_iterations = 50u;
+    config_.max_points_per_cloud = 10000u;
+    config_.max_correspondence_distance_m = 0.3;
+  }
+
+  TsdfIcpBatchRefiner createRefiner() {
+    const TsdfIcpBatchRefiner::IntegrationFunction integration_function =
+        [this](
+            const voxblox::Transformation& T_G_C,
+            const voxblox::Pointcloud& /*points*/,
+            const voxblox::Colors& /*colors*/) {
+          integrated_poses_.emplace_back(T_G_C);
+        };
+    return TsdfIcpBatchRefiner(config_, integration_function);
+  }
+
+  // Samples the plane spanned by the two axes, offset along the third axis.
+  static void addPlane(
+      const int first_axis, const int second_axis,
+      voxblox::Pointcloud* points) {
+    CHECK_NOTNULL(points);
+    for (int i = 0; i < kNumPointsPerSide; ++i) {
+      for (int j = 0; j < kNumPointsPerSide; ++j) {
+        voxblox::Point point = voxblox::Point::Constant(kPlaneOffsetM);
+        point[first_axis] = kPointSpacingM * (i + 0.5f);
+        point[second_axis] = kPointSpacingM * (j + 0.5f);
+        points->emplace_back(point);
+      }
+    }
+  }
+
+  // The floor and two walls of a room corner constrain all directions.
+  static voxblox::Pointcloud createCorner() {
+    voxblox::Pointcloud points;
+    addPlane(0, 1, &points);
+    addPlane(1, 2, &points);
+    addPlane(0, 2, &points);
+    return points;
+  }
+
+  static voxblox::Pointcloud createFloor() {
+    voxblox::Pointcloud points;
+    addPlane(0, 1, &points);
+    return points;
+  }
+
+  static voxblox::Transformation createPerturbation() {
+    return voxblox::Transformation(
+        voxblox::Rotation(Eigen::Quaternionf(
+            Eigen::AngleAxisf(0.03f, Eigen::Vector3f::UnitZ()))),
+        voxblox::Point(0.06f, -0.05f, 0.04f));
+  }
+
+  void addPointCloud(
+      const voxblox::Transformation& T_G_C, const voxblox::Pointcloud& points,
+      TsdfIcpBatchRefiner* refiner) {
+    CHECK_NOTNULL(refiner);
+    refiner->addPointCloud(T_G_C, points, voxblox::Colors(points.size()));
+  }
+
+  TsdfIcpBatchRefiner::Config config_;
+  TransformationVector integrated_poses_;
+};
+
+TEST_F(TsdfIcpBatchRefinerTest, PerturbedPointCloudIsPulledBack) {
+  TsdfIcpBatchRefiner refiner = createRefiner();
+  const voxblox::Pointcloud points = createCorner();
+
+  // The first point cloud builds the surface model and can't be aligned.
+  addPointCloud(voxblox::Transformation(), points, &refiner);
+  ASSERT_EQ(integrated_poses_.size(), 1u);
+  EXPECT_EQ(refiner.numAlignedPointClouds(), 0u);
+
+  // The same point cloud with a perturbed pose is aligned back onto the
+  // surface model, i.e. to the identity.
+  const voxblox::Transformation T_G_C_perturbed = createPerturbation();
+  addPointCloud(T_G_C_perturbed, points, &refiner);
+  ASSERT_EQ(integrated_poses_.size(), 2u);
+  EXPECT_EQ(refiner.numIntegratedPointClouds(), 2u);
+  EXPECT_EQ(refiner.numAlignedPointClouds(), 1u);
+
+  const voxblox::Transformation& T_G_C_refined = integrated_poses_.back();
+  EXPECT_LT(
+      T_G_C_refined.getPosition().norm(),
+      0.1f * T_G_C_perturbed.getPosition().norm());
+  EXPECT_LT(
+      T_G_C_refined.getRotation().toImplementation().angularDistance(
+          Eigen::Quaternionf::Identity()),
+      0.1f * T_G_C_perturbed.getRotation().toImplementation().angularDistance(
+                 Eigen::Quaternionf::Identity()));
+}
+
+TEST_F(TsdfIcpBatchRefinerTest, DegeneratePointCloudIsNotRefined) {
+  TsdfIcpBatchRefiner refiner = createRefiner();
+  addPointCloud(voxblox::Transformation(), createCorner(), &refiner);
+
+  // A single plane doesn't constrain the translation within the plane, the
+  // point cloud is integrated with its original pose.
+  const voxblox::Transformation T_G_C_perturbed = createPerturbation();
+  addPointCloud(T_G_C_perturbed, createFloor(), &refiner);
+  ASSERT_EQ(integrated_poses_.size(), 2u);
+  EXPECT_EQ(refiner.numIntegratedPointClouds(), 2u);
+  EXPECT_EQ(refiner.numAlignedPointClouds(), 0u);
+
+  const voxblox::Transformation& T_G_C_integrated = integrated_poses_.back();
+  EXPECT_TRUE(
+      T_G_C_integrated.getPosition().isApprox(
+          T_G_C_perturbed.getPosition()));
+  EXPECT_TRUE(
+      T_G_C_integrated.getRotation().toImplementation().isApprox(
+          T_G_C_perturbed.getRotation().toImplementation()));
+}
+
+}  // namespace dense_reconstruction
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -5,6 +5,7 @@
 
 #include <console-common/console-plugin-base-with-plotter.h>
 #include <console-common/console.h>
+#include <vi-map-helpers/vi-map-landmark-quality-evaluation.h>
 #include <visualization/viwls-graph-plotter.h>
 
 namespace landmark_manipulation_plugin {
@@ -25,6 +26,11 @@ class LandmarkManipulationPlugin : public common::ConsolePluginBaseWithPlotter {
   int initTrackLandmarks();
   int removeBadLandmarks();
   int removeInvalidLandmarkObservations();
+  int compactVisualFrames();
+
+  // Kept across commands such that repeated evaluations only re-evaluate the
+  // landmarks that changed in the meantime.
+  vi_map_helpers::LandmarkQualityEvaluator landmark_quality_evaluator_;
 };
 
 }  // namespace landmark_manipulation_plugin
@@ -6,6 +6,7 @@
 #include <map-manager/map-manager.h>
 #include <vi-map-helpers/vi-map-landmark-quality-evaluation.h>
 #include <vi-map-helpers/vi-map-manipulation.h>
+#include <vi-map-helpers/vi-map-visual-frame-compaction.h>
 #include <vi-map/vi-map.h>
 #include <visualization/viwls-graph-plotter.h>
 
@@ -23,7 +24,9 @@ LandmarkManipulationPlugin::LandmarkManipulationPlugin(
   addCommand(
       {"evaluate_landmark_quality", "elq"},
       [this]() -> int { return evaluateLandmarkQuality(); },
-      "Evaluates and sets the landmark quality of all landmarks.",
+      "Evaluates and sets the landmark quality of all landmarks. Landmarks "
+      "whose position and observers didn't change since the last evaluation "
+      "keep their quality.",
       common::Processing::Sync);
   addCommand(
       {"reset_landmark_quality", "rlq"},
@@ -43,6 +46,14 @@ LandmarkManipulationPlugin::LandmarkManipulationPlugin(
       {"remove_invalid_observations", "rio"},
       [this]() -> int { return removeInvalidLandmarkObservations(); },
       "Removes invalid observations from landmarks.", common::Processing::Sync);
+  addCommand(
+      {"compact_visual_frames", "cvf"},
+      [this]() -> int { return compactVisualFrames(); },
+      "Removes all keypoints and descriptors that are not associated with a "
+      "landmark from the visual frames. See "
+      "--visual_frame_compaction_keep_tracked_keypoints and "
+      "--visual_frame_compaction_use_representative_descriptors.",
+      common::Processing::Sync);
 }
 
 int LandmarkManipulationPlugin::retriangulateLandmarks() {
@@ -94,7 +105,7 @@ int LandmarkManipulationPlugin::evaluateLandmarkQuality() {
     map->getAllMissionIds(&mission_ids_to_process);
   }
 
-  vi_map_helpers::evaluateLandmarkQuality(mission_ids_to_process, map.get());
+  landmark_quality_evaluator_.evaluate(mission_ids_to_process, map.get());
   return common::kSuccess;
 }
 
@@ -209,6 +220,36 @@ int LandmarkManipulationPlugin::removeInvalidLandmarkObservations() {
   return common::kSuccess;
 }
 
+int LandmarkManipulationPlugin::compactVisualFrames() {
+  std::string selected_map_key;
+  if (!getSelectedMapKeyIfSet(&selected_map_key)) {
+    return common::kStupidUserError;
+  }
+
+  vi_map::VIMapManager map_manager;
+  vi_map::VIMapManager::MapWriteAccess map =
+      map_manager.getMapWriteAccess(selected_map_key);
+
+  vi_map::MissionIdList mission_ids_to_process;
+  if (!FLAGS_map_mission.empty()) {
+    vi_map::MissionId mission_id;
+    map->ensureMissionIdValid(FLAGS_map_mission, &mission_id);
+    if (!mission_id.isValid()) {
+      return common::kStupidUserError;
+    }
+    mission_ids_to_process.emplace_back(mission_id);
+  } else {
+    map->getAllMissionIds(&mission_ids_to_process);
+  }
+
+  const vi_map_helpers::VisualFrameCompactionStatistics statistics =
+      vi_map_helpers::compactVisualFrames(
+          vi_map_helpers::VisualFrameCompactionOptions::getFromGflags(),
+          mission_ids_to_process, map.get());
+  LOG(INFO) << statistics.toString();
+  return common::kSuccess;
+}
+
 }  // namespace landmark_manipulation_plugin
 
 MAPLAB_CREATE_CONSOLE_PLUGIN_WITH_PLOTTER(
@@ -15,5 +15,12 @@ int keyframeMapBasedOnHeuristics(
     const vi_map::MissionId& mission_id,
     const visualization::ViwlsGraphRvizPlotter* plotter, vi_map::VIMap* map);
 
+// Keyframes all given missions, the vertices of all missions are removed in
+// one pass.
+int keyframeMapBasedOnHeuristics(
+    const map_sparsification::KeyframingHeuristicsOptions& options,
+    const vi_map::MissionIdList& mission_ids,
+    const visualization::ViwlsGraphRvizPlotter* plotter, vi_map::VIMap* map);
+
 }  // namespace map_sparsification_plugin
 #endif  // MAP_SPARSIFICATION_PLUGIN_KEYFRAME_PRUNING_H_
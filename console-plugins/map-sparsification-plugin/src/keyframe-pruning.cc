@@ -15,41 +15,55 @@ int keyframeMapBasedOnHeuristics(
     const map_sparsification::KeyframingHeuristicsOptions& options,
     const vi_map::MissionId& mission_id,
     const visualization::ViwlsGraphRvizPlotter* plotter, vi_map::VIMap* map) {
+  return keyframeMapBasedOnHeuristics(
+      options, vi_map::MissionIdList{mission_id}, plotter, map);
+}
+
+int keyframeMapBasedOnHeuristics(
+    const map_sparsification::KeyframingHeuristicsOptions& options,
+    const vi_map::MissionIdList& mission_ids,
+    const visualization::ViwlsGraphRvizPlotter* plotter, vi_map::VIMap* map) {
   // plotter is optional.
   CHECK_NOTNULL(map);
-  CHECK(mission_id.isValid());
-
-  const size_t num_initial_vertices = map->numVerticesInMission(mission_id);
-
-  pose_graph::VertexId root_vertex_id =
-      map->getMission(mission_id).getRootVertexId();
-  CHECK(root_vertex_id.isValid());
-  pose_graph::VertexId last_vertex_id =
-      map->getLastVertexIdOfMission(mission_id);
-
-  // Select keyframes along the mission. Unconditionally add the last vertex as
-  // a keyframe if it isn't a keyframe already.
-  pose_graph::VertexIdList keyframe_ids;
-  map_sparsification::selectKeyframesBasedOnHeuristics(
-      *map, root_vertex_id, last_vertex_id, options, &keyframe_ids);
-  if (keyframe_ids.empty()) {
-    LOG(ERROR) << "No keyframes found.";
-    return common::CommandStatus::kUnknownError;
-  }
 
+  size_t num_initial_vertices = 0u;
+  size_t num_keyframes = 0u;
+  std::vector<pose_graph::VertexIdList> keyframe_ids_per_mission;
+  keyframe_ids_per_mission.reserve(mission_ids.size());
+  for (const vi_map::MissionId& mission_id : mission_ids) {
+    CHECK(mission_id.isValid());
+    num_initial_vertices += map->numVerticesInMission(mission_id);
+
+    pose_graph::VertexId root_vertex_id =
+        map->getMission(mission_id).getRootVertexId();
+    CHECK(root_vertex_id.isValid());
+    pose_graph::VertexId last_vertex_id =
+        map->getLastVertexIdOfMission(mission_id);
+
+    // Select keyframes along the mission. Unconditionally add the last vertex
+    // as a keyframe if it isn't a keyframe already.
+    keyframe_ids_per_mission.emplace_back();
+    pose_graph::VertexIdList& keyframe_ids = keyframe_ids_per_mission.back();
+    map_sparsification::selectKeyframesBasedOnHeuristics(
+        *map, root_vertex_id, last_vertex_id, options, &keyframe_ids);
+    if (keyframe_ids.empty()) {
+      LOG(ERROR) << "No keyframes found in mission " << mission_id << '.';
+      return common::CommandStatus::kUnknownError;
+    }
+    num_keyframes += keyframe_ids.size();
+  }
 
   // Optionally, visualize the selected keyframes.
   if (plotter != nullptr) {
-    std::vector<pose_graph::VertexIdList> partitions;
-    partitions.emplace_back(keyframe_ids);
-    plotter->plotPartitioning(*map, partitions);
-    LOG(INFO) << "Selected " << keyframe_ids.size() << " keyframes of "
+    plotter->plotPartitioning(*map, keyframe_ids_per_mission);
+    LOG(INFO) << "Selected " << num_keyframes << " keyframes of "
               << num_initial_vertices << " vertices.";
   }
 
-  // Remove non-keyframe vertices.
+  // Remove non-keyframe vertices, all missions at once.
   const size_t num_removed_keyframes =
-      map_sparsification::removeVerticesBetweenKeyframes(keyframe_ids, map);
+      map_sparsification::removeVerticesBetweenKeyframes(
+          keyframe_ids_per_mission, map);
   LOG(INFO) << "Removed " << num_removed_keyframes << " vertices of "
             << num_initial_vertices << " vertices.";
   return common::CommandStatus::kSuccess;
@@ -70,14 +70,13 @@ MapSparsificationPlugin::MapSparsificationPlugin(
         using map_sparsification::KeyframingHeuristicsOptions;
         KeyframingHeuristicsOptions options =
             KeyframingHeuristicsOptions::initializeFromGFlags();
-        for (const vi_map::MissionId& mission_id : missions_to_keyframe) {
-          VLOG(1) << "Keyframing mission " << mission_id << '.';
-          if (keyframeMapBasedOnHeuristics(
-                  options, mission_id, getPlotterUnsafe(), map.get()) !=
-              common::kSuccess) {
-            LOG(ERROR) << "Keyframing of mission " << mission_id << " failed.";
-            return common::kUnknownError;
-          }
+        VLOG(1) << "Keyframing " << missions_to_keyframe.size()
+                << " missions.";
+        if (keyframeMapBasedOnHeuristics(
+                options, missions_to_keyframe, getPlotterUnsafe(),
+                map.get()) != common::kSuccess) {
+          LOG(ERROR) << "Keyframing failed.";
+          return common::kUnknownError;
         }
         return common::kSuccess;
       },
@@ -62,6 +62,10 @@ class VIMapBasicPlugin : public common::ConsolePluginBaseWithPlotter {
   int useExternalResourceFolder();
   int printResourceStatistics();
   int printResourceCacheStatistics();
+  int packResources();
+  int unpackResources();
+  int compactResourceArchives();
+  int benchmarkImageCodecs();
 
   int checkMapConsistency();
 
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <iostream>  // NOLINT
 #include <memory>
+#include <sstream>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -14,6 +15,7 @@
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <map-manager/map-manager.h>
+#include <map-resources/image-codec.h>
 #include <map-resources/resource-map.h>
 #include <maplab-common/file-system-tools.h>
 #include <maplab-common/map-manager-config.h>
@@ -58,6 +60,17 @@ DEFINE_string(
 DEFINE_string(
     maps_folder, "",
     "Folder which contains one or more maps on the filesystem.");
+DEFINE_int32(
+    image_codec_benchmark_resource_type, 0,
+    "Resource type number of the frame resources that are used by "
+    "benchmark_image_codecs, by default raw grayscale images.");
+DEFINE_string(
+    image_codec_benchmark_codecs, "pnm,png:1,png:3,png:6,jpeg:95,webp:101,tiff",
+    "CSV list of the image codecs that are compared by benchmark_image_codecs, "
+    "see --resource_grayscale_image_codec for the format.");
+DEFINE_int32(
+    image_codec_benchmark_max_num_images, 200,
+    "Maximum number of images benchmark_image_codecs loads from the map.");
 
 namespace vi_map {
 
@@ -267,6 +280,29 @@ VIMapBasicPlugin::VIMapBasicPlugin(
       [this]() -> int { return printResourceCacheStatistics(); },
       "Prints resource cache statistics for the selected map.",
       common::Processing::Sync);
+  addCommand(
+      {"pack_resources"}, [this]() -> int { return packResources(); },
+      "Moves all resources of the selected map from individual files into a "
+      "packed resource archive per resource folder.",
+      common::Processing::Sync);
+  addCommand(
+      {"unpack_resources"}, [this]() -> int { return unpackResources(); },
+      "Converts all packed resource archives of the selected map back into "
+      "individual resource files.",
+      common::Processing::Sync);
+  addCommand(
+      {"compact_resource_archives"},
+      [this]() -> int { return compactResourceArchives(); },
+      "Reclaims the space of deleted resources in the packed resource "
+      "archives of the selected map.",
+      common::Processing::Sync);
+  addCommand(
+      {"benchmark_image_codecs"},
+      [this]() -> int { return benchmarkImageCodecs(); },
+      "Compares size, encoding/decoding speed and reconstruction error of the "
+      "image codecs in --image_codec_benchmark_codecs on the frame resources "
+      "of type --image_codec_benchmark_resource_type of the selected map.",
+      common::Processing::Sync);
 
   addCommand(
       {"check_map_consistency"},
@@ -1135,6 +1171,120 @@ int VIMapBasicPlugin::useExternalResourceFolder() {
   return common::kSuccess;
 }
 
+int VIMapBasicPlugin::packResources() {
+  std::string selected_map_key;
+  if (!getSelectedMapKeyIfSet(&selected_map_key)) {
+    return common::kStupidUserError;
+  }
+
+  constexpr bool kRemoveFiles = true;
+  vi_map::VIMapManager map_manager;
+  map_manager.getMapWriteAccess(selected_map_key)
+      ->packResourcesIntoArchives(kRemoveFiles);
+  return common::kSuccess;
+}
+
+int VIMapBasicPlugin::unpackResources() {
+  std::string selected_map_key;
+  if (!getSelectedMapKeyIfSet(&selected_map_key)) {
+    return common::kStupidUserError;
+  }
+
+  vi_map::VIMapManager map_manager;
+  map_manager.getMapWriteAccess(selected_map_key)
+      ->unpackResourcesFromArchives();
+  return common::kSuccess;
+}
+
+int VIMapBasicPlugin::compactResourceArchives() {
+  std::string selected_map_key;
+  if (!getSelectedMapKeyIfSet(&selected_map_key)) {
+    return common::kStupidUserError;
+  }
+
+  vi_map::VIMapManager map_manager;
+  map_manager.getMapWriteAccess(selected_map_key)->compactResourceArchives();
+  return common::kSuccess;
+}
+
+int VIMapBasicPlugin::benchmarkImageCodecs() {
+  std::string selected_map_key;
+  if (!getSelectedMapKeyIfSet(&selected_map_key)) {
+    return common::kStupidUserError;
+  }
+
+  const int type_number = FLAGS_image_codec_benchmark_resource_type;
+  if (type_number < 0 ||
+      static_cast<size_t>(type_number) >= backend::kNumResourceTypes ||
+      !backend::isImageResourceType(
+          static_cast<backend::ResourceType>(type_number))) {
+    LOG(ERROR) << "--image_codec_benchmark_resource_type=" << type_number
+               << " is not an image resource type.";
+    return common::kStupidUserError;
+  }
+  const backend::ResourceType type =
+      static_cast<backend::ResourceType>(type_number);
+
+  std::vector<backend::ImageCodec> codecs;
+  std::stringstream codec_stream(FLAGS_image_codec_benchmark_codecs);
+  std::string codec_specification;
+  while (std::getline(codec_stream, codec_specification, ',')) {
+    codecs.emplace_back();
+    if (!backend::ImageCodec::fromString(codec_specification, &codecs.back())) {
+      LOG(ERROR) << "Invalid image codec: " << codec_specification;
+      return common::kStupidUserError;
+    }
+  }
+
+  std::vector<cv::Mat> images;
+  {
+    vi_map::VIMapManager map_manager;
+    vi_map::VIMapManager::MapReadAccess map =
+        map_manager.getMapReadAccess(selected_map_key);
+    pose_graph::VertexIdList vertex_ids;
+    map->getAllVertexIds(&vertex_ids);
+    const size_t max_num_images =
+        std::max(FLAGS_image_codec_benchmark_max_num_images, 0);
+    for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+      const vi_map::Vertex& vertex = map->getVertex(vertex_id);
+      for (unsigned int frame_idx = 0u; frame_idx < vertex.numFrames() &&
+                                        images.size() < max_num_images;
+           ++frame_idx) {
+        cv::Mat image;
+        if (map->getFrameResource(vertex, frame_idx, type, &image)) {
+          images.emplace_back(image);
+        }
+      }
+    }
+  }
+  if (images.empty()) {
+    LOG(ERROR) << "The selected map contains no frame resources of type "
+               << backend::ResourceTypeNames[type_number] << ".";
+    return common::kStupidUserError;
+  }
+
+  std::vector<backend::ImageCodecBenchmarkResult> results;
+  backend::benchmarkImageCodecs(images, type, codecs, &results);
+
+  std::cout << "Image codec benchmark on " << images.size() << " images of "
+            << "type " << backend::ResourceTypeNames[type_number] << ":"
+            << std::endl;
+  for (const backend::ImageCodecBenchmarkResult& result : results) {
+    if (result.num_images == 0u) {
+      std::cout << "  " << result.codec.toString()
+                << ": does not support this image type." << std::endl;
+      continue;
+    }
+    std::cout << "  " << result.codec.toString() << ": "
+              << result.bytesPerImage() / 1e3 << " kB/image ("
+              << 100.0 * result.num_encoded_bytes / result.num_raw_bytes
+              << "% of raw), encoding " << result.encodingMegabytesPerSecond()
+              << " MB/s, decoding " << result.decodingMegabytesPerSecond()
+              << " MB/s, max error " << result.max_abs_error << std::endl;
+  }
+  return common::kSuccess;
+}
+
 int VIMapBasicPlugin::printResourceStatistics() {
   const std::string& selected_map_key = console_->getSelectedMapKey();
   if (selected_map_key.empty()) {
@@ -5,6 +5,7 @@
 #include <unordered_set>
 
 #include <aslam/common/memory.h>
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 #include <map-manager/map-manager.h>
 #include <map-manager/test/test-strings.h>
@@ -15,6 +16,8 @@
 #include <vi-map/vi-map-serialization.h>
 #include <vi-map/vi-map.h>
 
+DECLARE_uint64(map_manager_max_num_parallel_map_loads);
+
 class MapManagerFileIOTest : public ::testing::Test {
  protected:
   MapManagerFileIOTest()
@@ -446,6 +449,48 @@ TEST_F(MapManagerFileIOTest, LoadAllMapsWithCollidingKeys) {
   EXPECT_FALSE(map_manager_.loadAllMapsFromFolder(kPathWithoutFileName));
 }
 
+TEST_F(MapManagerFileIOTest, LoadAllMapsSequentially) {
+  saveMapsToFileSystem();
+
+  const uint64_t max_num_parallel_map_loads =
+      FLAGS_map_manager_max_num_parallel_map_loads;
+  FLAGS_map_manager_max_num_parallel_map_loads = 1u;
+  std::unordered_set<std::string> new_keys;
+  EXPECT_TRUE(
+      map_manager_.loadAllMapsFromFolder(kPathWithoutFileName, &new_keys));
+  FLAGS_map_manager_max_num_parallel_map_loads = max_num_parallel_map_loads;
+
+  EXPECT_EQ(2u, new_keys.size());
+  EXPECT_TRUE(map_manager_.hasMap(TestStrings::kFirstMapKey));
+  EXPECT_TRUE(map_manager_.hasMap(TestStrings::kSecondMapKey));
+}
+
+// Loading the same folder from two threads must insert the maps only once.
+TEST_F(MapManagerFileIOTest, LoadAllMapsConcurrently) {
+  saveMapsToFileSystem();
+
+  bool first_succeeded = false;
+  bool second_succeeded = false;
+  std::unordered_set<std::string> first_new_keys;
+  std::unordered_set<std::string> second_new_keys;
+  std::thread first_thread([&]() {
+    first_succeeded = map_manager_.loadAllMapsFromFolder(
+        kPathWithoutFileName, &first_new_keys);
+  });
+  std::thread second_thread([&]() {
+    second_succeeded = map_manager_.loadAllMapsFromFolder(
+        kPathWithoutFileName, &second_new_keys);
+  });
+  first_thread.join();
+  second_thread.join();
+
+  EXPECT_NE(first_succeeded, second_succeeded);
+  EXPECT_EQ(2u, first_new_keys.size() + second_new_keys.size());
+  EXPECT_EQ(2u, map_manager_.numberOfMaps());
+  EXPECT_TRUE(map_manager_.hasMap(TestStrings::kFirstMapKey));
+  EXPECT_TRUE(map_manager_.hasMap(TestStrings::kSecondMapKey));
+}
+
 TEST_F(MapManagerFileIOTest, CheckSplitVIMapSerialization) {
   vi_map::test::generateMap<vi_map::TransformationEdge>(first_vi_map_.get());
   vi_map::proto::VIMap vertices_proto, edges_proto, missions_proto,
@@ -19,6 +19,8 @@ class SummarizationPlugin : public common::ConsolePluginBase {
 
  private:
   int saveSummaryMapToDisk() const;
+  int saveTiledSummaryMapToDisk() const;
+  int updateIncrementalSummaryMap() const;
 };
 
 }  // namespace summarization_plugin
@@ -2,12 +2,22 @@
 
 #include <console-common/console.h>
 #include <localization-summary-map/localization-summary-map-creation.h>
+#include <localization-summary-map/localization-summary-map-diff.h>
+#include <localization-summary-map/localization-summary-map-incremental-builder.h>
+#include <localization-summary-map/localization-summary-map-tiling.h>
 #include <localization-summary-map/localization-summary-map.h>
 #include <map-manager/map-manager.h>
 #include <maplab-common/file-system-tools.h>
 #include <vi-map/vi-map.h>
 
 DEFINE_string(summary_map_save_path, "", "Save path of the summary map.");
+DEFINE_double(
+    summary_map_tile_size_m, 50.0,
+    "Edge length of the tiles of a tiled summary map in meters.");
+DEFINE_string(
+    summary_map_incremental_state_path, "",
+    "Folder of the persistent state of an incrementally built summary map. "
+    "The diffs of every update are stored in the same folder.");
 DECLARE_bool(overwrite);
 
 namespace summarization_plugin {
@@ -20,6 +30,24 @@ SummarizationPlugin::SummarizationPlugin(common::Console* console)
       "Generate a summary map of the selected map and save it to the path "
       "given by --summary_map_save_path.",
       common::Processing::Sync);
+  addCommand(
+      {"generate_tiled_summary_map_and_save_to_disk", "tiled_summary_map"},
+      [this]() -> int { return saveTiledSummaryMapToDisk(); },
+      "Generate a summary map of the selected map, split it into tiles of "
+      "--summary_map_tile_size_m and save it to the path given by "
+      "--summary_map_save_path. The localizers only keep the tiles close to "
+      "the current position in memory.",
+      common::Processing::Sync);
+  addCommand(
+      {"update_incremental_summary_map"},
+      [this]() -> int { return updateIncrementalSummaryMap(); },
+      "Update the incrementally built summary map stored under "
+      "--summary_map_incremental_state_path with the selected map. Only the "
+      "descriptors of new observations are projected. The diff to the "
+      "previous version is stored in the same folder, such that localization "
+      "clients can update their summary map. If --summary_map_save_path is "
+      "set, the full summary map is saved there as well.",
+      common::Processing::Sync);
 }
 
 int SummarizationPlugin::saveSummaryMapToDisk() const {
@@ -51,6 +79,112 @@ int SummarizationPlugin::saveSummaryMapToDisk() const {
   return common::kSuccess;
 }
 
+int SummarizationPlugin::saveTiledSummaryMapToDisk() const {
+  std::string selected_map_key;
+  if (!getSelectedMapKeyIfSet(&selected_map_key)) {
+    return common::kStupidUserError;
+  }
+
+  if (FLAGS_summary_map_save_path.empty()) {
+    LOG(ERROR) << "No save path for the summary map has been provided. Use "
+               << "--summary_map_save_path to set one.";
+    return common::kStupidUserError;
+  }
+  if (FLAGS_summary_map_tile_size_m <= 0.0) {
+    LOG(ERROR) << "The tile size needs to be positive.";
+    return common::kStupidUserError;
+  }
+
+  vi_map::VIMapManager map_manager;
+  vi_map::VIMapManager::MapReadAccess map =
+      map_manager.getMapReadAccess(selected_map_key);
+  summary_map::LocalizationSummaryMap summary_map;
+  summary_map::createLocalizationSummaryMapForWellConstrainedLandmarks(
+      *map, &summary_map);
+
+  summary_map::SummaryMapTiles tiles;
+  summary_map::splitLocalizationSummaryMapIntoTiles(
+      summary_map, FLAGS_summary_map_tile_size_m, &tiles);
+  LOG(INFO) << "Split the summary map into " << tiles.size() << " tiles.";
+
+  backend::SaveConfig save_config;
+  save_config.overwrite_existing_files = FLAGS_overwrite;
+  if (!summary_map::TiledLocalizationSummaryMap::saveToFolder(
+          tiles, FLAGS_summary_map_tile_size_m, FLAGS_summary_map_save_path,
+          save_config)) {
+    LOG(ERROR) << "Saving tiled summary map failed.";
+    return common::kUnknownError;
+  }
+
+  return common::kSuccess;
+}
+
+int SummarizationPlugin::updateIncrementalSummaryMap() const {
+  std::string selected_map_key;
+  if (!getSelectedMapKeyIfSet(&selected_map_key)) {
+    return common::kStupidUserError;
+  }
+
+  if (FLAGS_summary_map_incremental_state_path.empty()) {
+    LOG(ERROR) << "No path for the incremental summary map has been provided. "
+               << "Use --summary_map_incremental_state_path to set one.";
+    return common::kStupidUserError;
+  }
+
+  summary_map::LocalizationSummaryMapIncrementalBuilder builder;
+  if (summary_map::LocalizationSummaryMapIncrementalBuilder::
+          hasStateOnFileSystem(FLAGS_summary_map_incremental_state_path)) {
+    if (!builder.loadFromFolder(FLAGS_summary_map_incremental_state_path)) {
+      LOG(ERROR) << "Loading the incremental summary map failed.";
+      return common::kUnknownError;
+    }
+  } else {
+    LOG(INFO) << "Creating a new incremental summary map.";
+  }
+
+  vi_map::VIMapManager map_manager;
+  vi_map::VIMapManager::MapReadAccess map =
+      map_manager.getMapReadAccess(selected_map_key);
+  summary_map::LocalizationSummaryMapDiff diff;
+  builder.updateWithWellConstrainedLandmarks(*map, &diff);
+
+  // The state is saved before the diff. Otherwise a failed state write would
+  // let the next update emit a second, different diff for the same base
+  // version.
+  backend::SaveConfig save_config;
+  save_config.overwrite_existing_files = true;
+  if (!builder.saveToFolder(
+          FLAGS_summary_map_incremental_state_path, save_config)) {
+    LOG(ERROR) << "Saving the incremental summary map failed.";
+    return common::kUnknownError;
+  }
+
+  if (diff.isEmpty()) {
+    LOG(INFO) << "The summary map is up to date at version "
+              << builder.version() << ".";
+  } else {
+    LOG(INFO) << "Updated the summary map from version " << diff.base_version
+              << " to " << diff.version << ".";
+    if (!diff.saveToFolder(FLAGS_summary_map_incremental_state_path)) {
+      LOG(ERROR) << "Saving the summary map diff failed, clients need to "
+                 << "reload the full summary map of version " << diff.version
+                 << ".";
+      return common::kUnknownError;
+    }
+  }
+
+  if (!FLAGS_summary_map_save_path.empty()) {
+    save_config.overwrite_existing_files = FLAGS_overwrite;
+    summary_map::LocalizationSummaryMap summary_map = builder.getSummaryMap();
+    if (!summary_map.saveToFolder(FLAGS_summary_map_save_path, save_config)) {
+      LOG(ERROR) << "Saving summary map failed.";
+      return common::kUnknownError;
+    }
+  }
+
+  return common::kSuccess;
+}
+
 }  // namespace summarization_plugin
 
 MAPLAB_CREATE_CONSOLE_PLUGIN(summarization_plugin::SummarizationPlugin);
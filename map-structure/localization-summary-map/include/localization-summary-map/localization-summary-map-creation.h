@@ -3,6 +3,7 @@
 
 #include <string>
 
+#include <Eigen/Core>
 #include <vi-map/unique-id.h>
 
 namespace vi_map {
@@ -29,6 +30,16 @@ void createLocalizationSummaryMapFromLandmarkList(
     LocalizationSummaryMapCache* summary_map_cache,
     summary_map::LocalizationSummaryMap* summary_map);
 
+// Loads the matrix that projects the raw descriptors into the space of the
+// summary map descriptors, as selected by the loop closure flags.
+void loadDescriptorProjectionMatrix(Eigen::MatrixXf* projection_matrix);
+
+// Projects the descriptor of the given observation into projected_descriptor.
+void projectObservationDescriptor(
+    const vi_map::VIMap& map, const vi_map::KeypointIdentifier& observation,
+    const Eigen::MatrixXf& projection_matrix,
+    Eigen::Ref<Eigen::VectorXf> projected_descriptor);
+
 // Load a LocalizationSummaryMap from a serialized map that can be either a
 // LocalizationSummaryMap or a VIMap. The latter will trigger a conversion.
 void loadLocalizationSummaryMapFromAnyMapFile(
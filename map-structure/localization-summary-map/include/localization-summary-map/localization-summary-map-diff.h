@@ -0,0 +1,75 @@
+#ifndef LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_DIFF_H_
+#define LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_DIFF_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "localization-summary-map/localization-summary-map.h"
+
+namespace summary_map {
+
+namespace proto {
+class LocalizationSummaryMapDiff;
+}  // namespace proto
+
+// Changes that bring a localization summary map from base_version to version.
+// Applying a diff is cheap compared to creating the summary map, as no
+// descriptors need to be projected. The diff is index based and is applied in
+// three steps:
+//  1. The removed landmarks, observers and observations are erased, the
+//     remaining ones keep their relative order. The removed indices refer to
+//     the base version and are sorted.
+//  2. The moved landmarks and observers are updated. The indices refer to the
+//     summary map after the removal.
+//  3. The added landmarks, observers and observations are appended. The
+//     observer and landmark indices of the added observations refer to the
+//     summary map after this step.
+struct LocalizationSummaryMapDiff {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  LocalizationSummaryMapDiff();
+
+  uint64_t base_version;
+  uint64_t version;
+
+  std::vector<unsigned int> removed_landmark_indices;
+  std::vector<unsigned int> removed_observer_indices;
+  std::vector<unsigned int> removed_observation_indices;
+
+  std::vector<unsigned int> moved_landmark_indices;
+  Eigen::Matrix3Xf moved_G_landmark_position;
+  std::vector<unsigned int> moved_observer_indices;
+  Eigen::Matrix3Xf moved_G_observer_position;
+
+  Eigen::Matrix3Xf added_G_landmark_position;
+  Eigen::Matrix3Xf added_G_observer_position;
+  Eigen::MatrixXf added_projected_descriptors;
+  Eigen::Matrix<unsigned int, Eigen::Dynamic, 1> added_observer_indices;
+  Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>
+      added_observation_to_landmark_index;
+
+  bool isEmpty() const;
+  void clear();
+
+  void serialize(proto::LocalizationSummaryMapDiff* proto) const;
+  void deserialize(const proto::LocalizationSummaryMapDiff& proto);
+
+  // The diff is stored in a file named after its version, such that the
+  // diffs of consecutive updates can be kept in the same folder.
+  bool saveToFolder(const std::string& folder_path) const;
+  bool loadFromFolder(const std::string& folder_path, const uint64_t version);
+  static std::string getFileName(const uint64_t version);
+};
+
+// Applies the diff to the summary map. Returns false and leaves the summary
+// map untouched if the diff doesn't fit the version or the size of the
+// summary map.
+bool applyLocalizationSummaryMapDiff(
+    const LocalizationSummaryMapDiff& diff,
+    LocalizationSummaryMap* summary_map);
+
+}  // namespace summary_map
+#endif  // LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_DIFF_H_
@@ -0,0 +1,84 @@
+#ifndef LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_INCREMENTAL_BUILDER_H_
+#define LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_INCREMENTAL_BUILDER_H_
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <maplab-common/macros.h>
+#include <maplab-common/map-manager-config.h>
+#include <vi-map/unique-id.h>
+
+#include "localization-summary-map/localization-summary-map-diff.h"
+#include "localization-summary-map/localization-summary-map.h"
+
+namespace vi_map {
+class VIMap;
+}  // namespace vi_map
+
+namespace summary_map {
+
+// Keeps a localization summary map in sync with a growing VIMap. Instead of
+// creating the summary map from scratch, every update only projects the
+// descriptors of new observations and emits the changes as a diff, such that
+// clients can update their copy of the summary map without reloading it.
+// Removed and merged landmarks, changed observations and moved vertices and
+// landmarks are detected by comparing against the map. Observations are
+// identified by their keypoint identifier and a fingerprint of the keypoint,
+// such that keypoints renumbered by a visual frame compaction are projected
+// again. The state can be saved and loaded to continue the incremental updates
+// across runs.
+class LocalizationSummaryMapIncrementalBuilder {
+ public:
+  MAPLAB_POINTER_TYPEDEFS(LocalizationSummaryMapIncrementalBuilder);
+
+  LocalizationSummaryMapIncrementalBuilder();
+
+  // Updates the summary map to contain the given landmarks of the map. The
+  // diff to the previous version is returned in diff, it is empty and the
+  // version unchanged if nothing changed.
+  void update(
+      const vi_map::VIMap& map, const vi_map::LandmarkIdList& landmark_ids,
+      LocalizationSummaryMapDiff* diff);
+  void updateWithWellConstrainedLandmarks(
+      const vi_map::VIMap& map, LocalizationSummaryMapDiff* diff);
+
+  inline const LocalizationSummaryMap& getSummaryMap() const {
+    return summary_map_;
+  }
+  inline uint64_t version() const {
+    return summary_map_.version();
+  }
+
+  bool saveToFolder(
+      const std::string& folder_path, const backend::SaveConfig& config) const;
+  bool loadFromFolder(const std::string& folder_path);
+  static bool hasStateOnFileSystem(const std::string& folder_path);
+
+ private:
+  static constexpr char kFileName[] = "incremental_localization_summary_map";
+
+  void computeDiff(
+      const vi_map::VIMap& map, const vi_map::LandmarkIdList& landmark_ids,
+      LocalizationSummaryMapDiff* diff, vi_map::LandmarkIdList* new_landmarks,
+      std::vector<vi_map::VisualFrameIdentifier>* new_observers,
+      vi_map::KeypointIdentifierList* new_observations,
+      std::vector<size_t>* new_observation_fingerprints);
+
+  // Map ids of the columns of the summary map.
+  LocalizationSummaryMap summary_map_;
+  vi_map::LandmarkIdList landmark_ids_;
+  std::vector<vi_map::VisualFrameIdentifier> observer_ids_;
+  vi_map::KeypointIdentifierList observation_ids_;
+  // Fingerprint of the keypoint of every observation, used to detect
+  // keypoints that were renumbered by a compaction or whose descriptor
+  // changed.
+  std::vector<size_t> observation_fingerprints_;
+
+  // Lazily loaded on the first projection.
+  Eigen::MatrixXf projection_matrix_;
+  const double position_tolerance_m_;
+};
+
+}  // namespace summary_map
+#endif  // LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_INCREMENTAL_BUILDER_H_
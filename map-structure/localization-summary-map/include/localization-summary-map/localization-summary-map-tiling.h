@@ -0,0 +1,121 @@
+#ifndef LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_TILING_H_
+#define LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_TILING_H_
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+#include <maplab-common/macros.h>
+#include <maplab-common/map-manager-config.h>
+
+#include "localization-summary-map/localization-summary-map.h"
+
+namespace summary_map {
+
+// Index of a square tile in the x-y plane of the global frame. Tile (x, y)
+// covers [x * tile_size, (x + 1) * tile_size) x [y * tile_size,
+// (y + 1) * tile_size).
+struct SummaryMapTileIndex {
+  SummaryMapTileIndex() : x(0), y(0) {}
+  SummaryMapTileIndex(const int _x, const int _y) : x(_x), y(_y) {}
+
+  static SummaryMapTileIndex fromPosition(
+      const Eigen::Vector3d& p_G, const double tile_size_m);
+
+  // Squared distance in the x-y plane from the position to the closest point
+  // of the tile, zero if the position lies within the tile.
+  double squaredDistanceToPosition(
+      const Eigen::Vector3d& p_G, const double tile_size_m) const;
+
+  std::string toString() const;
+
+  inline bool operator==(const SummaryMapTileIndex& other) const {
+    return x == other.x && y == other.y;
+  }
+  inline bool operator!=(const SummaryMapTileIndex& other) const {
+    return !(*this == other);
+  }
+
+  int x;
+  int y;
+};
+typedef std::vector<SummaryMapTileIndex> SummaryMapTileIndexList;
+
+}  // namespace summary_map
+
+namespace std {
+template <>
+struct hash<summary_map::SummaryMapTileIndex> {
+  size_t operator()(const summary_map::SummaryMapTileIndex& index) const {
+    return std::hash<int>()(index.x) ^ (std::hash<int>()(index.y) << 1);
+  }
+};
+}  // namespace std
+
+namespace summary_map {
+
+typedef std::unordered_map<SummaryMapTileIndex, LocalizationSummaryMap::Ptr>
+    SummaryMapTiles;
+
+// Partitions the summary map into tiles based on the position of the
+// observers. Every tile holds the observers that lie within it, all their
+// observations and the landmarks seen by these observations, i.e. landmarks
+// observed from several tiles are duplicated. Tiles without observations are
+// skipped.
+void splitLocalizationSummaryMapIntoTiles(
+    const LocalizationSummaryMap& summary_map, const double tile_size_m,
+    SummaryMapTiles* tiles);
+
+// A localization summary map that is stored as one summary map per tile
+// together with a small index. Only the index is kept in memory, the tiles are
+// loaded on demand.
+class TiledLocalizationSummaryMap {
+ public:
+  MAPLAB_POINTER_TYPEDEFS(TiledLocalizationSummaryMap);
+
+  struct TileInfo {
+    SummaryMapTileIndex index;
+    std::string folder;
+    size_t num_landmarks;
+    size_t num_observations;
+  };
+
+  TiledLocalizationSummaryMap();
+
+  bool loadFromFolder(const std::string& folder_path);
+  static bool saveToFolder(
+      const SummaryMapTiles& tiles, const double tile_size_m,
+      const std::string& folder_path, const backend::SaveConfig& config);
+  static bool hasMapOnFileSystem(const std::string& folder_path);
+
+  // Loads the summary map of the given tile from disk. Returns nullptr if the
+  // tile doesn't exist or couldn't be loaded.
+  LocalizationSummaryMap::Ptr loadTile(const SummaryMapTileIndex& index) const;
+
+  bool hasTile(const SummaryMapTileIndex& index) const;
+  void getAllTileIndices(SummaryMapTileIndexList* indices) const;
+  // Returns the tiles that are at most radius_m away from the position in the
+  // x-y plane, sorted by increasing distance.
+  void getTileIndicesWithinRadius(
+      const Eigen::Vector3d& p_G, const double radius_m,
+      SummaryMapTileIndexList* indices) const;
+
+  inline double tileSizeMeters() const {
+    return tile_size_m_;
+  }
+  inline size_t numTiles() const {
+    return tiles_.size();
+  }
+
+ private:
+  static constexpr char kIndexFileName[] = "tiled_localization_summary_map";
+
+  std::string folder_path_;
+  double tile_size_m_;
+  std::unordered_map<SummaryMapTileIndex, TileInfo> tiles_;
+};
+
+}  // namespace summary_map
+#endif  // LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_TILING_H_
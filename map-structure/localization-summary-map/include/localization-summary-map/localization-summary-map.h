@@ -1,6 +1,7 @@
 #ifndef LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_H_
 #define LOCALIZATION_SUMMARY_MAP_LOCALIZATION_SUMMARY_MAP_H_
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 
@@ -38,6 +39,15 @@ class LocalizationSummaryMap {
     return id_;
   }
 
+  // Version of the content, incremented by every applied diff.
+  inline void setVersion(const uint64_t version) {
+    version_ = version;
+  }
+
+  inline uint64_t version() const {
+    return version_;
+  }
+
   void serialize(proto::LocalizationSummaryMap* proto) const;
   void deserialize(
       const LocalizationSummaryMapId& localization_summary_map_id,
@@ -89,6 +99,7 @@ class LocalizationSummaryMap {
   // covisibility graph.
 
   LocalizationSummaryMapId id_;
+  uint64_t version_ = 0u;
   /// Mapping of landmark-ids to landmark indices.
   std::unordered_map<vi_map::LandmarkId, int> landmark_id_to_landmark_index_;
   /// The position of the landmarks in the global frame of reference.
@@ -19,6 +19,50 @@
 
 namespace summary_map {
 
+void loadDescriptorProjectionMatrix(Eigen::MatrixXf* projection_matrix) {
+  CHECK_NOTNULL(projection_matrix);
+  const char* loop_closure_files_path = getenv("MAPLAB_LOOPCLOSURE_DIR");
+  CHECK_NE(loop_closure_files_path, static_cast<char*>(nullptr))
+      << "MAPLAB_LOOPCLOSURE_DIR environment variable is not set.\n"
+      << "Source the MapLab environment from your workspace:\n"
+      << "  . devel/setup.bash";
+
+  if (FLAGS_feature_descriptor_type == loop_closure::kFeatureDescriptorFREAK) {
+    if (FLAGS_lc_projection_matrix_filename == "") {
+      FLAGS_lc_projection_matrix_filename =
+          std::string(loop_closure_files_path) + "/projection_matrix_freak.dat";
+    }
+  } else {
+    if (FLAGS_lc_projection_matrix_filename == "") {
+      FLAGS_lc_projection_matrix_filename =
+          std::string(loop_closure_files_path) + "/projection_matrix_brisk.dat";
+    }
+  }
+  std::ifstream deserializer(FLAGS_lc_projection_matrix_filename);
+  CHECK(deserializer.is_open()) << "Cannot load projection matrix from file: "
+                                << FLAGS_lc_projection_matrix_filename;
+  common::Deserialize(projection_matrix, &deserializer);
+}
+
+void projectObservationDescriptor(
+    const vi_map::VIMap& map, const vi_map::KeypointIdentifier& observation,
+    const Eigen::MatrixXf& projection_matrix,
+    Eigen::Ref<Eigen::VectorXf> projected_descriptor) {
+  const aslam::VisualFrame& frame =
+      map.getVertex(observation.frame_id.vertex_id)
+          .getVisualFrame(observation.frame_id.frame_index);
+
+  Eigen::Map<const Eigen::Matrix<unsigned char, Eigen::Dynamic, 1> >
+      raw_descriptor(
+          frame.getDescriptor(observation.keypoint_index),
+          frame.getDescriptorSizeBytes(), 1);
+
+  // Project the descriptors directly into the descriptor storage.
+  descriptor_projection::ProjectDescriptor(
+      raw_descriptor, projection_matrix, FLAGS_lc_target_dimensionality,
+      projected_descriptor);
+}
+
 void createLocalizationSummaryMapForWellConstrainedLandmarks(
     const vi_map::VIMap& map,
     summary_map::LocalizationSummaryMap* summary_map) {
@@ -112,28 +156,8 @@ void createLocalizationSummaryMapFromLandmarkList(
       Eigen::Map<const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1> >(
           observation_to_landmark.data(), observation_to_landmark.size(), 1);
 
-  const char* loop_closure_files_path = getenv("MAPLAB_LOOPCLOSURE_DIR");
-  CHECK_NE(loop_closure_files_path, static_cast<char*>(nullptr))
-      << "MAPLAB_LOOPCLOSURE_DIR environment variable is not set.\n"
-      << "Source the MapLab environment from your workspace:\n"
-      << "  . devel/setup.bash";
-
-  if (FLAGS_feature_descriptor_type == loop_closure::kFeatureDescriptorFREAK) {
-    if (FLAGS_lc_projection_matrix_filename == "") {
-      FLAGS_lc_projection_matrix_filename =
-          std::string(loop_closure_files_path) + "/projection_matrix_freak.dat";
-    }
-  } else {
-    if (FLAGS_lc_projection_matrix_filename == "") {
-      FLAGS_lc_projection_matrix_filename =
-          std::string(loop_closure_files_path) + "/projection_matrix_brisk.dat";
-    }
-  }
   Eigen::MatrixXf projection_matrix;
-  std::ifstream deserializer(FLAGS_lc_projection_matrix_filename);
-  CHECK(deserializer.is_open()) << "Cannot load projection matrix from file: "
-                                << FLAGS_lc_projection_matrix_filename;
-  common::Deserialize(&projection_matrix, &deserializer);
+  loadDescriptorProjectionMatrix(&projection_matrix);
 
   projected_descriptors.resize(
       FLAGS_lc_target_dimensionality, observations.size());
@@ -169,18 +193,8 @@ void createLocalizationSummaryMapFromLandmarkList(
             observation, landmark_id,
             projected_descriptors.col(observation_index))) {
       // No projected descriptor is stored yet, need to compute first.
-      const aslam::VisualFrame& frame =
-          map.getVertex(observation.frame_id.vertex_id)
-              .getVisualFrame(observation.frame_id.frame_index);
-
-      Eigen::Map<const Eigen::Matrix<unsigned char, Eigen::Dynamic, 1> >
-          raw_descriptor(
-              frame.getDescriptor(observation.keypoint_index),
-              frame.getDescriptorSizeBytes(), 1);
-
-      // Project the descriptors directly into the descriptor storage.
-      descriptor_projection::ProjectDescriptor(
-          raw_descriptor, projection_matrix, FLAGS_lc_target_dimensionality,
+      projectObservationDescriptor(
+          map, observation, projection_matrix,
           projected_descriptors.col(observation_index));
 
       if (summary_map_cache != nullptr) {
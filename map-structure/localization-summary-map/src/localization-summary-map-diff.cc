@@ -0,0 +1,364 @@
+#include "localization-summary-map/localization-summary-map-diff.h"
+
+#include <sstream>
+
+#include <glog/logging.h>
+#include <maplab-common/eigen-proto.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/proto-serialization-helper.h>
+
+#include "localization-summary-map/localization-summary-map.pb.h"
+
+namespace summary_map {
+
+namespace {
+
+// Maps the indices of the base version to the indices after the removal, -1
+// for removed entries. Returns false if the removed indices are not sorted,
+// not unique or out of bounds.
+bool computeIndexMapping(
+    const std::vector<unsigned int>& removed_indices, const size_t num_entries,
+    std::vector<int>* old_to_new_index) {
+  CHECK_NOTNULL(old_to_new_index)->assign(num_entries, -1);
+  size_t removed_idx = 0u;
+  int new_index = 0;
+  for (size_t i = 0u; i < num_entries; ++i) {
+    if (removed_idx < removed_indices.size() &&
+        removed_indices[removed_idx] == i) {
+      ++removed_idx;
+      continue;
+    }
+    if (removed_idx < removed_indices.size() &&
+        removed_indices[removed_idx] < i) {
+      return false;
+    }
+    (*old_to_new_index)[i] = new_index++;
+  }
+  return removed_idx == removed_indices.size();
+}
+
+bool areIndicesValid(
+    const std::vector<unsigned int>& indices, const size_t num_entries) {
+  for (const unsigned int index : indices) {
+    if (index >= num_entries) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void serializeIndices(
+    const std::vector<unsigned int>& indices,
+    google::protobuf::RepeatedField<google::protobuf::uint32>* proto) {
+  CHECK_NOTNULL(proto)->Reserve(indices.size());
+  for (const unsigned int index : indices) {
+    proto->Add(index);
+  }
+}
+
+void deserializeIndices(
+    const google::protobuf::RepeatedField<google::protobuf::uint32>& proto,
+    std::vector<unsigned int>* indices) {
+  CHECK_NOTNULL(indices)->assign(proto.begin(), proto.end());
+}
+
+}  // namespace
+
+LocalizationSummaryMapDiff::LocalizationSummaryMapDiff() {
+  clear();
+}
+
+bool LocalizationSummaryMapDiff::isEmpty() const {
+  return removed_landmark_indices.empty() && removed_observer_indices.empty() &&
+         removed_observation_indices.empty() &&
+         moved_landmark_indices.empty() && moved_observer_indices.empty() &&
+         added_G_landmark_position.cols() == 0 &&
+         added_G_observer_position.cols() == 0 &&
+         added_projected_descriptors.cols() == 0;
+}
+
+void LocalizationSummaryMapDiff::clear() {
+  base_version = 0u;
+  version = 0u;
+  removed_landmark_indices.clear();
+  removed_observer_indices.clear();
+  removed_observation_indices.clear();
+  moved_landmark_indices.clear();
+  moved_G_landmark_position.resize(Eigen::NoChange, 0);
+  moved_observer_indices.clear();
+  moved_G_observer_position.resize(Eigen::NoChange, 0);
+  added_G_landmark_position.resize(Eigen::NoChange, 0);
+  added_G_observer_position.resize(Eigen::NoChange, 0);
+  added_projected_descriptors.resize(0, 0);
+  added_observer_indices.resize(0);
+  added_observation_to_landmark_index.resize(0);
+}
+
+void LocalizationSummaryMapDiff::serialize(
+    proto::LocalizationSummaryMapDiff* proto) const {
+  CHECK_NOTNULL(proto);
+  proto->set_base_version(base_version);
+  proto->set_version(version);
+  serializeIndices(
+      removed_landmark_indices, proto->mutable_removed_landmark_indices());
+  serializeIndices(
+      removed_observer_indices, proto->mutable_removed_observer_indices());
+  serializeIndices(
+      removed_observation_indices,
+      proto->mutable_removed_observation_indices());
+  serializeIndices(
+      moved_landmark_indices, proto->mutable_moved_landmark_indices());
+  common::eigen_proto::serialize(
+      moved_G_landmark_position, proto->mutable_moved_g_landmark_position());
+  serializeIndices(
+      moved_observer_indices, proto->mutable_moved_observer_indices());
+  common::eigen_proto::serialize(
+      moved_G_observer_position, proto->mutable_moved_g_observer_position());
+  common::eigen_proto::serialize(
+      added_G_landmark_position, proto->mutable_added_g_landmark_position());
+  common::eigen_proto::serialize(
+      added_G_observer_position, proto->mutable_added_g_observer_position());
+  common::eigen_proto::serialize(
+      added_projected_descriptors, proto->mutable_added_descriptors());
+  common::eigen_proto::serialize(
+      added_observer_indices, proto->mutable_added_observer_indices());
+  common::eigen_proto::serialize(
+      added_observation_to_landmark_index,
+      proto->mutable_added_observation_to_landmark_index());
+}
+
+void LocalizationSummaryMapDiff::deserialize(
+    const proto::LocalizationSummaryMapDiff& proto) {
+  base_version = proto.base_version();
+  version = proto.version();
+  deserializeIndices(
+      proto.removed_landmark_indices(), &removed_landmark_indices);
+  deserializeIndices(
+      proto.removed_observer_indices(), &removed_observer_indices);
+  deserializeIndices(
+      proto.removed_observation_indices(), &removed_observation_indices);
+  deserializeIndices(proto.moved_landmark_indices(), &moved_landmark_indices);
+  common::eigen_proto::deserialize(
+      proto.moved_g_landmark_position(), &moved_G_landmark_position);
+  deserializeIndices(proto.moved_observer_indices(), &moved_observer_indices);
+  common::eigen_proto::deserialize(
+      proto.moved_g_observer_position(), &moved_G_observer_position);
+  common::eigen_proto::deserialize(
+      proto.added_g_landmark_position(), &added_G_landmark_position);
+  common::eigen_proto::deserialize(
+      proto.added_g_observer_position(), &added_G_observer_position);
+  if (proto.has_added_descriptors()) {
+    common::eigen_proto::deserialize(
+        proto.added_descriptors(), &added_projected_descriptors);
+  } else {
+    added_projected_descriptors.resize(0, 0);
+  }
+  common::eigen_proto::deserialize(
+      proto.added_observer_indices(), &added_observer_indices);
+  common::eigen_proto::deserialize(
+      proto.added_observation_to_landmark_index(),
+      &added_observation_to_landmark_index);
+}
+
+bool LocalizationSummaryMapDiff::saveToFolder(
+    const std::string& folder_path) const {
+  CHECK(!folder_path.empty());
+  if (!common::createPath(folder_path)) {
+    LOG(ERROR) << "Creating path to \"" << folder_path << "\" failed.";
+    return false;
+  }
+  proto::LocalizationSummaryMapDiff proto;
+  serialize(&proto);
+  return common::proto_serialization_helper::serializeProtoToFile(
+      folder_path, getFileName(version), proto);
+}
+
+bool LocalizationSummaryMapDiff::loadFromFolder(
+    const std::string& folder_path, const uint64_t version_to_load) {
+  CHECK(!folder_path.empty());
+  const std::string file_name = getFileName(version_to_load);
+  if (!common::fileExists(
+          common::concatenateFolderAndFileName(folder_path, file_name))) {
+    LOG(ERROR) << "No summary map diff to version " << version_to_load
+               << " found under \"" << folder_path << "\".";
+    return false;
+  }
+  proto::LocalizationSummaryMapDiff proto;
+  if (!common::proto_serialization_helper::parseProtoFromFile(
+          folder_path, file_name, &proto)) {
+    LOG(ERROR) << "Summary map diff under \"" << folder_path
+               << "\" couldn't be parsed by protobuf.";
+    return false;
+  }
+  deserialize(proto);
+  return true;
+}
+
+std::string LocalizationSummaryMapDiff::getFileName(const uint64_t version) {
+  std::stringstream ss;
+  ss << "localization_summary_map_diff_" << version;
+  return ss.str();
+}
+
+bool applyLocalizationSummaryMapDiff(
+    const LocalizationSummaryMapDiff& diff,
+    LocalizationSummaryMap* summary_map) {
+  CHECK_NOTNULL(summary_map);
+  if (diff.base_version != summary_map->version()) {
+    LOG(ERROR) << "The diff applies to version " << diff.base_version
+               << " but the summary map has version " << summary_map->version()
+               << ".";
+    return false;
+  }
+
+  const Eigen::Matrix3Xf& G_landmark_position =
+      summary_map->GLandmarkPosition();
+  const Eigen::Matrix3Xf& G_observer_position =
+      summary_map->GObserverPosition();
+  const Eigen::MatrixXf& projected_descriptors =
+      summary_map->projectedDescriptors();
+  const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>& observer_indices =
+      summary_map->observerIndices();
+  const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>&
+      observation_to_landmark_index =
+          summary_map->observationToLandmarkIndex();
+  CHECK_EQ(observer_indices.rows(), projected_descriptors.cols());
+  CHECK_EQ(observation_to_landmark_index.rows(), projected_descriptors.cols());
+
+  std::vector<int> landmark_mapping;
+  std::vector<int> observer_mapping;
+  std::vector<int> observation_mapping;
+  if (!computeIndexMapping(
+          diff.removed_landmark_indices, G_landmark_position.cols(),
+          &landmark_mapping) ||
+      !computeIndexMapping(
+          diff.removed_observer_indices, G_observer_position.cols(),
+          &observer_mapping) ||
+      !computeIndexMapping(
+          diff.removed_observation_indices, projected_descriptors.cols(),
+          &observation_mapping)) {
+    LOG(ERROR) << "The removed indices of the diff are invalid.";
+    return false;
+  }
+
+  const size_t num_kept_landmarks =
+      G_landmark_position.cols() - diff.removed_landmark_indices.size();
+  const size_t num_kept_observers =
+      G_observer_position.cols() - diff.removed_observer_indices.size();
+  const size_t num_kept_observations =
+      projected_descriptors.cols() - diff.removed_observation_indices.size();
+  const size_t num_landmarks =
+      num_kept_landmarks + diff.added_G_landmark_position.cols();
+  const size_t num_observers =
+      num_kept_observers + diff.added_G_observer_position.cols();
+  const size_t num_added_observations =
+      diff.added_projected_descriptors.cols();
+  const size_t num_observations =
+      num_kept_observations + num_added_observations;
+
+  if (num_landmarks == 0u) {
+    LOG(ERROR) << "Applying the diff would remove all landmarks.";
+    return false;
+  }
+  if (!areIndicesValid(diff.moved_landmark_indices, num_kept_landmarks) ||
+      diff.moved_landmark_indices.size() !=
+          static_cast<size_t>(diff.moved_G_landmark_position.cols()) ||
+      !areIndicesValid(diff.moved_observer_indices, num_kept_observers) ||
+      diff.moved_observer_indices.size() !=
+          static_cast<size_t>(diff.moved_G_observer_position.cols())) {
+    LOG(ERROR) << "The moved landmarks or observers of the diff are invalid.";
+    return false;
+  }
+  if (static_cast<size_t>(diff.added_observer_indices.rows()) !=
+          num_added_observations ||
+      static_cast<size_t>(diff.added_observation_to_landmark_index.rows()) !=
+          num_added_observations ||
+      (num_added_observations > 0u && num_kept_observations > 0u &&
+       diff.added_projected_descriptors.rows() !=
+           projected_descriptors.rows())) {
+    LOG(ERROR) << "The added observations of the diff are inconsistent.";
+    return false;
+  }
+  for (size_t i = 0u; i < num_added_observations; ++i) {
+    if (diff.added_observer_indices(i) >= num_observers ||
+        diff.added_observation_to_landmark_index(i) >= num_landmarks) {
+      LOG(ERROR) << "An added observation of the diff references an invalid "
+                 << "landmark or observer.";
+      return false;
+    }
+  }
+
+  const int descriptor_dimensions =
+      num_kept_observations > 0u ? projected_descriptors.rows()
+                                 : diff.added_projected_descriptors.rows();
+  Eigen::MatrixXf new_projected_descriptors(
+      descriptor_dimensions, num_observations);
+  Eigen::Matrix<unsigned int, Eigen::Dynamic, 1> new_observer_indices(
+      num_observations);
+  Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>
+      new_observation_to_landmark_index(num_observations);
+  for (int i = 0; i < projected_descriptors.cols(); ++i) {
+    const int new_index = observation_mapping[i];
+    if (new_index < 0) {
+      continue;
+    }
+    const int observer_index = observer_mapping[observer_indices(i)];
+    const int landmark_index =
+        landmark_mapping[observation_to_landmark_index(i)];
+    if (observer_index < 0 || landmark_index < 0) {
+      LOG(ERROR) << "The diff removes a landmark or observer that is still "
+                 << "referenced by an observation.";
+      return false;
+    }
+    new_projected_descriptors.col(new_index) = projected_descriptors.col(i);
+    new_observer_indices(new_index) = observer_index;
+    new_observation_to_landmark_index(new_index) = landmark_index;
+  }
+  if (num_added_observations > 0u) {
+    new_projected_descriptors.rightCols(num_added_observations) =
+        diff.added_projected_descriptors;
+    new_observer_indices.tail(num_added_observations) =
+        diff.added_observer_indices;
+    new_observation_to_landmark_index.tail(num_added_observations) =
+        diff.added_observation_to_landmark_index;
+  }
+
+  Eigen::Matrix3Xd new_G_landmark_position(3, num_landmarks);
+  for (int i = 0; i < G_landmark_position.cols(); ++i) {
+    if (landmark_mapping[i] >= 0) {
+      new_G_landmark_position.col(landmark_mapping[i]) =
+          G_landmark_position.col(i).cast<double>();
+    }
+  }
+  for (size_t i = 0u; i < diff.moved_landmark_indices.size(); ++i) {
+    new_G_landmark_position.col(diff.moved_landmark_indices[i]) =
+        diff.moved_G_landmark_position.col(i).cast<double>();
+  }
+  new_G_landmark_position.rightCols(diff.added_G_landmark_position.cols()) =
+      diff.added_G_landmark_position.cast<double>();
+
+  Eigen::Matrix3Xd new_G_observer_position(3, num_observers);
+  for (int i = 0; i < G_observer_position.cols(); ++i) {
+    if (observer_mapping[i] >= 0) {
+      new_G_observer_position.col(observer_mapping[i]) =
+          G_observer_position.col(i).cast<double>();
+    }
+  }
+  for (size_t i = 0u; i < diff.moved_observer_indices.size(); ++i) {
+    new_G_observer_position.col(diff.moved_observer_indices[i]) =
+        diff.moved_G_observer_position.col(i).cast<double>();
+  }
+  new_G_observer_position.rightCols(diff.added_G_observer_position.cols()) =
+      diff.added_G_observer_position.cast<double>();
+
+  summary_map->setGLandmarkPosition(new_G_landmark_position);
+  summary_map->setGObserverPosition(new_G_observer_position);
+  summary_map->setProjectedDescriptors(new_projected_descriptors);
+  summary_map->setObserverIndices(new_observer_indices);
+  summary_map->setObservationToLandmarkIndex(
+      new_observation_to_landmark_index);
+  summary_map->setVersion(diff.version);
+  return true;
+}
+
+}  // namespace summary_map
@@ -0,0 +1,477 @@
+#include "localization-summary-map/localization-summary-map-incremental-builder.h"
+
+#include <cstdio>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include <aslam/common/statistics/statistics.h>
+#include <aslam/common/timer.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <loopclosure-common/flags.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/proto-serialization-helper.h>
+#include <vi-map-helpers/vi-map-queries.h>
+#include <vi-map/vi-map.h>
+
+#include "localization-summary-map/localization-summary-map-creation.h"
+#include "localization-summary-map/localization-summary-map.pb.h"
+
+DEFINE_double(
+    summary_map_incremental_position_tolerance_m, 1e-3,
+    "Landmarks and observers of an incrementally built summary map that moved "
+    "by more than this distance are updated.");
+
+namespace summary_map {
+
+namespace {
+
+bool hasMoved(
+    const Eigen::Vector3f& old_position, const Eigen::Vector3d& new_position,
+    const double tolerance_m) {
+  return (new_position.cast<float>() - old_position).squaredNorm() >
+         tolerance_m * tolerance_m;
+}
+
+inline void combineHash(const size_t value, size_t* seed) {
+  *seed ^= value + 0x9e3779b9 + (*seed << 6) + (*seed >> 2);
+}
+
+// Fingerprint of the keypoint an observation refers to. Compacting or
+// discarding keypoints renumbers the keypoints of a frame, hence the
+// keypoint identifier alone doesn't tell whether the projected descriptor
+// still belongs to this observation.
+size_t hashObservedKeypoint(
+    const vi_map::VIMap& map, const vi_map::KeypointIdentifier& observation) {
+  const aslam::VisualFrame& frame =
+      map.getVertex(observation.frame_id.vertex_id)
+          .getVisualFrame(observation.frame_id.frame_index);
+  CHECK_LT(observation.keypoint_index, frame.getNumKeypointMeasurements());
+  size_t seed = 0u;
+  const std::hash<double> double_hasher;
+  const Eigen::Block<const Eigen::Matrix2Xd, 2, 1> measurement =
+      frame.getKeypointMeasurement(observation.keypoint_index);
+  combineHash(double_hasher(measurement(0)), &seed);
+  combineHash(double_hasher(measurement(1)), &seed);
+  const unsigned char* descriptor =
+      frame.getDescriptor(observation.keypoint_index);
+  const size_t descriptor_size_bytes = frame.getDescriptorTypeSizeBytes(
+      frame.getDescriptorType(observation.keypoint_index));
+  for (size_t i = 0u; i < descriptor_size_bytes; ++i) {
+    combineHash(descriptor[i], &seed);
+  }
+  return seed;
+}
+
+void positionsToMatrix(
+    const Aligned<std::vector, Eigen::Vector3f>& positions,
+    Eigen::Matrix3Xf* matrix) {
+  CHECK_NOTNULL(matrix)->resize(Eigen::NoChange, positions.size());
+  for (size_t i = 0u; i < positions.size(); ++i) {
+    matrix->col(i) = positions[i];
+  }
+}
+
+}  // namespace
+
+constexpr char LocalizationSummaryMapIncrementalBuilder::kFileName[];
+
+LocalizationSummaryMapIncrementalBuilder::
+    LocalizationSummaryMapIncrementalBuilder()
+    : position_tolerance_m_(
+          FLAGS_summary_map_incremental_position_tolerance_m) {
+  CHECK_GE(position_tolerance_m_, 0.0);
+  LocalizationSummaryMapId id;
+  aslam::generateId(&id);
+  summary_map_.setId(id);
+}
+
+void LocalizationSummaryMapIncrementalBuilder::
+    updateWithWellConstrainedLandmarks(
+        const vi_map::VIMap& map, LocalizationSummaryMapDiff* diff) {
+  vi_map_helpers::VIMapQueries queries(map);
+  vi_map::LandmarkIdList landmark_ids;
+  queries.getAllWellConstrainedLandmarkIds(&landmark_ids);
+  update(map, landmark_ids, diff);
+}
+
+void LocalizationSummaryMapIncrementalBuilder::update(
+    const vi_map::VIMap& map, const vi_map::LandmarkIdList& landmark_ids,
+    LocalizationSummaryMapDiff* diff) {
+  CHECK_NOTNULL(diff)->clear();
+  CHECK(!landmark_ids.empty());
+  timing::Timer timer("LocalizationSummaryMapIncrementalBuilder: update");
+
+  vi_map::LandmarkIdList new_landmark_ids;
+  std::vector<vi_map::VisualFrameIdentifier> new_observer_ids;
+  vi_map::KeypointIdentifierList new_observation_ids;
+  std::vector<size_t> new_observation_fingerprints;
+  computeDiff(
+      map, landmark_ids, diff, &new_landmark_ids, &new_observer_ids,
+      &new_observation_ids, &new_observation_fingerprints);
+
+  diff->base_version = summary_map_.version();
+  if (diff->isEmpty()) {
+    diff->version = diff->base_version;
+    return;
+  }
+  diff->version = diff->base_version + 1u;
+  CHECK(applyLocalizationSummaryMapDiff(*diff, &summary_map_));
+
+  landmark_ids_.swap(new_landmark_ids);
+  observer_ids_.swap(new_observer_ids);
+  observation_ids_.swap(new_observation_ids);
+  observation_fingerprints_.swap(new_observation_fingerprints);
+  CHECK_EQ(observation_ids_.size(), observation_fingerprints_.size());
+  CHECK_EQ(
+      static_cast<int>(landmark_ids_.size()),
+      summary_map_.GLandmarkPosition().cols());
+  CHECK_EQ(
+      static_cast<int>(observer_ids_.size()),
+      summary_map_.GObserverPosition().cols());
+  CHECK_EQ(
+      static_cast<int>(observation_ids_.size()),
+      summary_map_.projectedDescriptors().cols());
+
+  VLOG(1) << "Updated the summary map to version " << diff->version << ": "
+          << diff->removed_landmark_indices.size() << " removed, "
+          << diff->moved_landmark_indices.size() << " moved and "
+          << diff->added_G_landmark_position.cols() << " added landmarks, "
+          << diff->removed_observation_indices.size() << " removed and "
+          << diff->added_projected_descriptors.cols()
+          << " added observations.";
+}
+
+void LocalizationSummaryMapIncrementalBuilder::computeDiff(
+    const vi_map::VIMap& map, const vi_map::LandmarkIdList& landmark_ids,
+    LocalizationSummaryMapDiff* diff, vi_map::LandmarkIdList* new_landmark_ids,
+    std::vector<vi_map::VisualFrameIdentifier>* new_observer_ids,
+    vi_map::KeypointIdentifierList* new_observation_ids,
+    std::vector<size_t>* new_observation_fingerprints) {
+  CHECK_NOTNULL(diff);
+  CHECK_NOTNULL(new_landmark_ids)->clear();
+  CHECK_NOTNULL(new_observer_ids)->clear();
+  CHECK_NOTNULL(new_observation_ids)->clear();
+  CHECK_NOTNULL(new_observation_fingerprints)->clear();
+  CHECK_EQ(observation_ids_.size(), observation_fingerprints_.size());
+
+  // The landmarks and observations the summary map should contain.
+  std::unordered_set<vi_map::LandmarkId> desired_landmark_set;
+  vi_map::LandmarkIdList desired_landmark_ids;
+  desired_landmark_ids.reserve(landmark_ids.size());
+  std::unordered_map<vi_map::KeypointIdentifier, vi_map::LandmarkId>
+      desired_observations;
+  for (const vi_map::LandmarkId& landmark_id : landmark_ids) {
+    CHECK(map.hasLandmark(landmark_id));
+    if (!desired_landmark_set.insert(landmark_id).second) {
+      continue;
+    }
+    desired_landmark_ids.push_back(landmark_id);
+    for (const vi_map::KeypointIdentifier& observation :
+         map.getLandmark(landmark_id).getObservations()) {
+      desired_observations.emplace(observation, landmark_id);
+    }
+  }
+
+  // Landmarks: keep the order of the remaining ones and append the new ones.
+  std::unordered_map<vi_map::LandmarkId, unsigned int> landmark_id_to_index;
+  Aligned<std::vector, Eigen::Vector3f> moved_G_landmark_position;
+  for (size_t i = 0u; i < landmark_ids_.size(); ++i) {
+    const vi_map::LandmarkId& landmark_id = landmark_ids_[i];
+    if (desired_landmark_set.count(landmark_id) == 0u) {
+      diff->removed_landmark_indices.push_back(i);
+      continue;
+    }
+    const unsigned int new_index = new_landmark_ids->size();
+    landmark_id_to_index.emplace(landmark_id, new_index);
+    new_landmark_ids->push_back(landmark_id);
+
+    const Eigen::Vector3d G_p_fi = map.getLandmark_G_p_fi(landmark_id);
+    if (hasMoved(
+            summary_map_.GLandmarkPosition().col(i), G_p_fi,
+            position_tolerance_m_)) {
+      diff->moved_landmark_indices.push_back(new_index);
+      moved_G_landmark_position.emplace_back(G_p_fi.cast<float>());
+    }
+  }
+  positionsToMatrix(
+      moved_G_landmark_position, &diff->moved_G_landmark_position);
+
+  Aligned<std::vector, Eigen::Vector3f> added_G_landmark_position;
+  for (const vi_map::LandmarkId& landmark_id : desired_landmark_ids) {
+    if (landmark_id_to_index.emplace(landmark_id, new_landmark_ids->size())
+            .second) {
+      new_landmark_ids->push_back(landmark_id);
+      added_G_landmark_position.emplace_back(
+          map.getLandmark_G_p_fi(landmark_id).cast<float>());
+    }
+  }
+  positionsToMatrix(
+      added_G_landmark_position, &diff->added_G_landmark_position);
+
+  // Observations: an observation is kept if it still belongs to the same
+  // landmark and still refers to the same keypoint. Observations that moved
+  // to another landmark, e.g. through a merge, are removed and added again,
+  // reusing the projected descriptor if the keypoint is unchanged.
+  const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>& observer_indices =
+      summary_map_.observerIndices();
+  const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>&
+      observation_to_landmark_index = summary_map_.observationToLandmarkIndex();
+  std::unordered_set<vi_map::KeypointIdentifier> kept_observations;
+  std::unordered_map<vi_map::KeypointIdentifier, unsigned int>
+      removed_observation_to_index;
+  std::unordered_set<vi_map::VisualFrameIdentifier> referenced_observers;
+  for (size_t i = 0u; i < observation_ids_.size(); ++i) {
+    const vi_map::KeypointIdentifier& observation = observation_ids_[i];
+    const std::unordered_map<vi_map::KeypointIdentifier,
+                             vi_map::LandmarkId>::const_iterator it =
+        desired_observations.find(observation);
+    if (it != desired_observations.end() &&
+        it->second == landmark_ids_[observation_to_landmark_index(i)] &&
+        hashObservedKeypoint(map, observation) ==
+            observation_fingerprints_[i]) {
+      kept_observations.insert(observation);
+      referenced_observers.insert(observation.frame_id);
+      new_observation_ids->push_back(observation);
+      new_observation_fingerprints->push_back(observation_fingerprints_[i]);
+    } else {
+      diff->removed_observation_indices.push_back(i);
+      removed_observation_to_index.emplace(observation, i);
+    }
+  }
+
+  vi_map::KeypointIdentifierList added_observations;
+  for (const vi_map::LandmarkId& landmark_id : desired_landmark_ids) {
+    for (const vi_map::KeypointIdentifier& observation :
+         map.getLandmark(landmark_id).getObservations()) {
+      if (kept_observations.count(observation) == 0u &&
+          desired_observations.at(observation) == landmark_id) {
+        added_observations.push_back(observation);
+        referenced_observers.insert(observation.frame_id);
+      }
+    }
+  }
+
+  // Observers: keep the ones that are still referenced and append the new
+  // ones in the order of the added observations.
+  std::unordered_map<vi_map::VisualFrameIdentifier, unsigned int>
+      observer_id_to_index;
+  Aligned<std::vector, Eigen::Vector3f> moved_G_observer_position;
+  for (size_t i = 0u; i < observer_ids_.size(); ++i) {
+    const vi_map::VisualFrameIdentifier& observer_id = observer_ids_[i];
+    if (referenced_observers.count(observer_id) == 0u) {
+      diff->removed_observer_indices.push_back(i);
+      continue;
+    }
+    const unsigned int new_index = new_observer_ids->size();
+    observer_id_to_index.emplace(observer_id, new_index);
+    new_observer_ids->push_back(observer_id);
+
+    const Eigen::Vector3d G_p_I = map.getVertex_G_p_I(observer_id.vertex_id);
+    if (hasMoved(
+            summary_map_.GObserverPosition().col(i), G_p_I,
+            position_tolerance_m_)) {
+      diff->moved_observer_indices.push_back(new_index);
+      moved_G_observer_position.emplace_back(G_p_I.cast<float>());
+    }
+  }
+  positionsToMatrix(
+      moved_G_observer_position, &diff->moved_G_observer_position);
+
+  Aligned<std::vector, Eigen::Vector3f> added_G_observer_position;
+  for (const vi_map::KeypointIdentifier& observation : added_observations) {
+    if (observer_id_to_index
+            .emplace(observation.frame_id, new_observer_ids->size())
+            .second) {
+      new_observer_ids->push_back(observation.frame_id);
+      added_G_observer_position.emplace_back(
+          map.getVertex_G_p_I(observation.frame_id.vertex_id).cast<float>());
+    }
+  }
+  positionsToMatrix(
+      added_G_observer_position, &diff->added_G_observer_position);
+
+  // Only the descriptors of new observations need to be projected.
+  const size_t num_added_observations = added_observations.size();
+  diff->added_projected_descriptors.resize(
+      FLAGS_lc_target_dimensionality, num_added_observations);
+  diff->added_observer_indices.resize(num_added_observations);
+  diff->added_observation_to_landmark_index.resize(num_added_observations);
+  size_t num_reused_descriptors = 0u;
+  for (size_t i = 0u; i < num_added_observations; ++i) {
+    const vi_map::KeypointIdentifier& observation = added_observations[i];
+    const size_t fingerprint = hashObservedKeypoint(map, observation);
+    const std::unordered_map<vi_map::KeypointIdentifier,
+                             unsigned int>::const_iterator it =
+        removed_observation_to_index.find(observation);
+    if (it != removed_observation_to_index.end() &&
+        observation_fingerprints_[it->second] == fingerprint) {
+      diff->added_projected_descriptors.col(i) =
+          summary_map_.projectedDescriptors().col(it->second);
+      ++num_reused_descriptors;
+    } else {
+      if (projection_matrix_.size() == 0) {
+        loadDescriptorProjectionMatrix(&projection_matrix_);
+      }
+      projectObservationDescriptor(
+          map, observation, projection_matrix_,
+          diff->added_projected_descriptors.col(i));
+    }
+    diff->added_observer_indices(i) =
+        observer_id_to_index.at(observation.frame_id);
+    diff->added_observation_to_landmark_index(i) =
+        landmark_id_to_index.at(desired_observations.at(observation));
+    new_observation_ids->push_back(observation);
+    new_observation_fingerprints->push_back(fingerprint);
+  }
+
+  statistics::StatsCollector stat_projected(
+      "LocalizationSummaryMapIncrementalBuilder: projected descriptors");
+  stat_projected.AddSample(num_added_observations - num_reused_descriptors);
+  statistics::StatsCollector stat_reused(
+      "LocalizationSummaryMapIncrementalBuilder: reused descriptors");
+  stat_reused.AddSample(num_reused_descriptors);
+}
+
+bool LocalizationSummaryMapIncrementalBuilder::saveToFolder(
+    const std::string& folder_path, const backend::SaveConfig& config) const {
+  CHECK(!folder_path.empty());
+  if (!config.overwrite_existing_files && hasStateOnFileSystem(folder_path)) {
+    LOG(ERROR) << "An incremental summary map already exists under \""
+               << folder_path << "\".";
+    return false;
+  }
+  if (!common::createPath(folder_path)) {
+    LOG(ERROR) << "Creating path to \"" << folder_path << "\" failed.";
+    return false;
+  }
+
+  proto::IncrementalLocalizationSummaryMapState proto;
+  summary_map_.id().serialize(proto.mutable_summary_map_id());
+  summary_map_.serialize(proto.mutable_summary_map());
+  for (const vi_map::LandmarkId& landmark_id : landmark_ids_) {
+    landmark_id.serialize(proto.add_landmark_ids());
+  }
+  for (const vi_map::VisualFrameIdentifier& observer_id : observer_ids_) {
+    observer_id.vertex_id.serialize(proto.add_observer_vertex_ids());
+    proto.add_observer_frame_indices(observer_id.frame_index);
+  }
+  for (const vi_map::KeypointIdentifier& observation : observation_ids_) {
+    observation.frame_id.vertex_id.serialize(
+        proto.add_observation_vertex_ids());
+    proto.add_observation_frame_indices(observation.frame_id.frame_index);
+    proto.add_observation_keypoint_indices(observation.keypoint_index);
+  }
+  for (const size_t fingerprint : observation_fingerprints_) {
+    proto.add_observation_fingerprints(fingerprint);
+  }
+
+  // The state is written to a temporary file and then moved in place, such
+  // that a failed write keeps the previous state intact.
+  const std::string temporary_file_name = std::string(kFileName) + ".tmp";
+  if (!common::proto_serialization_helper::serializeProtoToFile(
+          folder_path, temporary_file_name, proto)) {
+    return false;
+  }
+  const std::string temporary_file_path =
+      common::concatenateFolderAndFileName(folder_path, temporary_file_name);
+  const std::string file_path =
+      common::concatenateFolderAndFileName(folder_path, kFileName);
+  if (std::rename(temporary_file_path.c_str(), file_path.c_str()) != 0) {
+    LOG(ERROR) << "Moving \"" << temporary_file_path << "\" to \""
+               << file_path << "\" failed.";
+    return false;
+  }
+  return true;
+}
+
+bool LocalizationSummaryMapIncrementalBuilder::loadFromFolder(
+    const std::string& folder_path) {
+  CHECK(!folder_path.empty());
+  if (!hasStateOnFileSystem(folder_path)) {
+    LOG(ERROR) << "No incremental summary map could be found under \""
+               << folder_path << "\".";
+    return false;
+  }
+
+  proto::IncrementalLocalizationSummaryMapState proto;
+  if (!common::proto_serialization_helper::parseProtoFromFile(
+          folder_path, kFileName, &proto)) {
+    LOG(ERROR) << "Incremental summary map under \"" << folder_path
+               << "\" couldn't be parsed by protobuf.";
+    return false;
+  }
+  CHECK_EQ(
+      proto.observer_vertex_ids_size(), proto.observer_frame_indices_size());
+  CHECK_EQ(
+      proto.observation_vertex_ids_size(),
+      proto.observation_frame_indices_size());
+  CHECK_EQ(
+      proto.observation_vertex_ids_size(),
+      proto.observation_keypoint_indices_size());
+
+  LocalizationSummaryMapId summary_map_id = summary_map_.id();
+  if (proto.has_summary_map_id()) {
+    summary_map_id.deserialize(proto.summary_map_id());
+  } else {
+    LOG(WARNING) << "The incremental summary map under \"" << folder_path
+                 << "\" has no id stored, it keeps the newly generated id.";
+  }
+  summary_map_.deserialize(summary_map_id, proto.summary_map());
+
+  landmark_ids_.resize(proto.landmark_ids_size());
+  for (int i = 0; i < proto.landmark_ids_size(); ++i) {
+    landmark_ids_[i].deserialize(proto.landmark_ids(i));
+  }
+  observer_ids_.resize(proto.observer_vertex_ids_size());
+  for (int i = 0; i < proto.observer_vertex_ids_size(); ++i) {
+    observer_ids_[i].vertex_id.deserialize(proto.observer_vertex_ids(i));
+    observer_ids_[i].frame_index = proto.observer_frame_indices(i);
+  }
+  observation_ids_.resize(proto.observation_vertex_ids_size());
+  for (int i = 0; i < proto.observation_vertex_ids_size(); ++i) {
+    observation_ids_[i].frame_id.vertex_id.deserialize(
+        proto.observation_vertex_ids(i));
+    observation_ids_[i].frame_id.frame_index =
+        proto.observation_frame_indices(i);
+    observation_ids_[i].keypoint_index = proto.observation_keypoint_indices(i);
+  }
+  if (proto.observation_fingerprints_size() ==
+      proto.observation_vertex_ids_size()) {
+    observation_fingerprints_.assign(
+        proto.observation_fingerprints().begin(),
+        proto.observation_fingerprints().end());
+  } else {
+    // The descriptors of all observations are projected again on the next
+    // update, as it is unknown which keypoints they were projected from.
+    LOG(WARNING) << "The incremental summary map under \"" << folder_path
+                 << "\" has no keypoint fingerprints stored.";
+    observation_fingerprints_.assign(observation_ids_.size(), 0u);
+  }
+
+  CHECK_EQ(
+      static_cast<int>(landmark_ids_.size()),
+      summary_map_.GLandmarkPosition().cols());
+  CHECK_EQ(
+      static_cast<int>(observer_ids_.size()),
+      summary_map_.GObserverPosition().cols());
+  CHECK_EQ(
+      static_cast<int>(observation_ids_.size()),
+      summary_map_.projectedDescriptors().cols());
+  return true;
+}
+
+bool LocalizationSummaryMapIncrementalBuilder::hasStateOnFileSystem(
+    const std::string& folder_path) {
+  CHECK(!folder_path.empty());
+  if (!common::pathExists(folder_path)) {
+    return false;
+  }
+  const std::string complete_file_name = common::concatenateFolderAndFileName(
+      common::getRealPath(folder_path), kFileName);
+  return common::fileExists(complete_file_name);
+}
+
+}  // namespace summary_map
@@ -0,0 +1,290 @@
+#include "localization-summary-map/localization-summary-map-tiling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <utility>
+
+#include <glog/logging.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/proto-serialization-helper.h>
+
+#include "localization-summary-map/localization-summary-map.pb.h"
+
+namespace summary_map {
+
+SummaryMapTileIndex SummaryMapTileIndex::fromPosition(
+    const Eigen::Vector3d& p_G, const double tile_size_m) {
+  CHECK_GT(tile_size_m, 0.0);
+  return SummaryMapTileIndex(
+      static_cast<int>(std::floor(p_G.x() / tile_size_m)),
+      static_cast<int>(std::floor(p_G.y() / tile_size_m)));
+}
+
+double SummaryMapTileIndex::squaredDistanceToPosition(
+    const Eigen::Vector3d& p_G, const double tile_size_m) const {
+  CHECK_GT(tile_size_m, 0.0);
+  const double min_x = x * tile_size_m;
+  const double min_y = y * tile_size_m;
+  const double dx =
+      std::max(0.0, std::max(min_x - p_G.x(), p_G.x() - min_x - tile_size_m));
+  const double dy =
+      std::max(0.0, std::max(min_y - p_G.y(), p_G.y() - min_y - tile_size_m));
+  return dx * dx + dy * dy;
+}
+
+std::string SummaryMapTileIndex::toString() const {
+  std::stringstream ss;
+  ss << "tile_" << x << "_" << y;
+  return ss.str();
+}
+
+namespace {
+
+// Observations of a single tile with the indices into the full summary map.
+struct TileObservations {
+  std::vector<unsigned int> observation_indices;
+  std::unordered_map<unsigned int, unsigned int> observer_to_tile_index;
+  std::unordered_map<unsigned int, unsigned int> landmark_to_tile_index;
+};
+
+}  // namespace
+
+void splitLocalizationSummaryMapIntoTiles(
+    const LocalizationSummaryMap& summary_map, const double tile_size_m,
+    SummaryMapTiles* tiles) {
+  CHECK_NOTNULL(tiles)->clear();
+  CHECK_GT(tile_size_m, 0.0);
+
+  const Eigen::Matrix3Xf& G_observer_position = summary_map.GObserverPosition();
+  const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>& observer_indices =
+      summary_map.observerIndices();
+  const Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>&
+      observation_to_landmark_index = summary_map.observationToLandmarkIndex();
+  CHECK_EQ(observer_indices.rows(), observation_to_landmark_index.rows());
+  CHECK_EQ(
+      observer_indices.rows(), summary_map.projectedDescriptors().cols());
+
+  std::unordered_map<SummaryMapTileIndex, TileObservations> tile_observations;
+  for (unsigned int observation_idx = 0u;
+       observation_idx < observer_indices.rows(); ++observation_idx) {
+    const unsigned int observer_idx = observer_indices(observation_idx);
+    CHECK_LT(observer_idx, G_observer_position.cols());
+    const SummaryMapTileIndex tile_index = SummaryMapTileIndex::fromPosition(
+        G_observer_position.col(observer_idx).cast<double>(), tile_size_m);
+
+    TileObservations& tile = tile_observations[tile_index];
+    tile.observation_indices.push_back(observation_idx);
+    tile.observer_to_tile_index.emplace(
+        observer_idx, tile.observer_to_tile_index.size());
+    tile.landmark_to_tile_index.emplace(
+        observation_to_landmark_index(observation_idx),
+        tile.landmark_to_tile_index.size());
+  }
+
+  for (const std::pair<const SummaryMapTileIndex, TileObservations>& value :
+       tile_observations) {
+    const TileObservations& tile = value.second;
+    const size_t num_observations = tile.observation_indices.size();
+
+    Eigen::Matrix3Xd G_tile_landmark_position(
+        3, tile.landmark_to_tile_index.size());
+    for (const std::pair<const unsigned int, unsigned int>& landmark :
+         tile.landmark_to_tile_index) {
+      G_tile_landmark_position.col(landmark.second) =
+          summary_map.GLandmarkPosition().col(landmark.first).cast<double>();
+    }
+    Eigen::Matrix3Xd G_tile_observer_position(
+        3, tile.observer_to_tile_index.size());
+    for (const std::pair<const unsigned int, unsigned int>& observer :
+         tile.observer_to_tile_index) {
+      G_tile_observer_position.col(observer.second) =
+          G_observer_position.col(observer.first).cast<double>();
+    }
+
+    Eigen::MatrixXf tile_descriptors(
+        summary_map.projectedDescriptors().rows(), num_observations);
+    Eigen::Matrix<unsigned int, Eigen::Dynamic, 1> tile_observer_indices(
+        num_observations);
+    Eigen::Matrix<unsigned int, Eigen::Dynamic, 1>
+        tile_observation_to_landmark_index(num_observations);
+    for (size_t i = 0u; i < num_observations; ++i) {
+      const unsigned int observation_idx = tile.observation_indices[i];
+      tile_descriptors.col(i) =
+          summary_map.projectedDescriptors().col(observation_idx);
+      tile_observer_indices(i) =
+          tile.observer_to_tile_index.at(observer_indices(observation_idx));
+      tile_observation_to_landmark_index(i) = tile.landmark_to_tile_index.at(
+          observation_to_landmark_index(observation_idx));
+    }
+
+    LocalizationSummaryMap::Ptr tile_map =
+        aligned_shared<LocalizationSummaryMap>();
+    LocalizationSummaryMapId tile_map_id;
+    aslam::generateId(&tile_map_id);
+    tile_map->setId(tile_map_id);
+    tile_map->setGLandmarkPosition(G_tile_landmark_position);
+    tile_map->setGObserverPosition(G_tile_observer_position);
+    tile_map->setProjectedDescriptors(tile_descriptors);
+    tile_map->setObserverIndices(tile_observer_indices);
+    tile_map->setObservationToLandmarkIndex(
+        tile_observation_to_landmark_index);
+    CHECK(tiles->emplace(value.first, tile_map).second);
+  }
+}
+
+constexpr char TiledLocalizationSummaryMap::kIndexFileName[];
+
+TiledLocalizationSummaryMap::TiledLocalizationSummaryMap()
+    : tile_size_m_(0.0) {}
+
+bool TiledLocalizationSummaryMap::loadFromFolder(
+    const std::string& folder_path) {
+  CHECK(!folder_path.empty());
+  if (!hasMapOnFileSystem(folder_path)) {
+    LOG(ERROR) << "No tiled summary map could be found under \""
+               << folder_path << "\".";
+    return false;
+  }
+
+  proto::TiledLocalizationSummaryMap proto;
+  if (!common::proto_serialization_helper::parseProtoFromFile(
+          folder_path, kIndexFileName, &proto)) {
+    LOG(ERROR) << "Tiled summary map index under \"" << folder_path
+               << "\" couldn't be parsed by protobuf.";
+    return false;
+  }
+  CHECK_GT(proto.tile_size_m(), 0.0);
+
+  folder_path_ = folder_path;
+  tile_size_m_ = proto.tile_size_m();
+  tiles_.clear();
+  for (const proto::LocalizationSummaryMapTile& tile_proto : proto.tiles()) {
+    TileInfo tile;
+    tile.index = SummaryMapTileIndex(tile_proto.x(), tile_proto.y());
+    tile.folder = tile_proto.folder();
+    tile.num_landmarks = tile_proto.num_landmarks();
+    tile.num_observations = tile_proto.num_observations();
+    CHECK(tiles_.emplace(tile.index, tile).second)
+        << "Duplicate tile " << tile.index.toString() << ".";
+  }
+  return true;
+}
+
+bool TiledLocalizationSummaryMap::saveToFolder(
+    const SummaryMapTiles& tiles, const double tile_size_m,
+    const std::string& folder_path, const backend::SaveConfig& config) {
+  CHECK(!folder_path.empty());
+  CHECK_GT(tile_size_m, 0.0);
+  if (!config.overwrite_existing_files && hasMapOnFileSystem(folder_path)) {
+    LOG(ERROR) << "A tiled summary map already exists under \"" << folder_path
+               << "\".";
+    return false;
+  }
+
+  if (!common::createPath(folder_path)) {
+    LOG(ERROR) << "Creating path to \"" << folder_path << "\" failed.";
+    return false;
+  }
+
+  proto::TiledLocalizationSummaryMap proto;
+  proto.set_tile_size_m(tile_size_m);
+  for (const SummaryMapTiles::value_type& value : tiles) {
+    CHECK(value.second);
+    const std::string tile_folder = value.first.toString();
+    if (!value.second->saveToFolder(
+            common::concatenateFolderAndFileName(folder_path, tile_folder),
+            config)) {
+      LOG(ERROR) << "Saving " << tile_folder << " failed.";
+      return false;
+    }
+
+    proto::LocalizationSummaryMapTile* tile_proto = proto.add_tiles();
+    tile_proto->set_x(value.first.x);
+    tile_proto->set_y(value.first.y);
+    tile_proto->set_folder(tile_folder);
+    tile_proto->set_num_landmarks(value.second->GLandmarkPosition().cols());
+    tile_proto->set_num_observations(
+        value.second->observationToLandmarkIndex().rows());
+  }
+  // The index is written last such that a partially written map isn't
+  // picked up.
+  return common::proto_serialization_helper::serializeProtoToFile(
+      folder_path, kIndexFileName, proto);
+}
+
+bool TiledLocalizationSummaryMap::hasMapOnFileSystem(
+    const std::string& folder_path) {
+  CHECK(!folder_path.empty());
+  if (!common::pathExists(folder_path)) {
+    return false;
+  }
+  const std::string complete_file_name = common::concatenateFolderAndFileName(
+      common::getRealPath(folder_path), kIndexFileName);
+  return common::fileExists(complete_file_name);
+}
+
+LocalizationSummaryMap::Ptr TiledLocalizationSummaryMap::loadTile(
+    const SummaryMapTileIndex& index) const {
+  const std::unordered_map<SummaryMapTileIndex, TileInfo>::const_iterator it =
+      tiles_.find(index);
+  if (it == tiles_.end()) {
+    return nullptr;
+  }
+  LocalizationSummaryMap::Ptr tile_map =
+      aligned_shared<LocalizationSummaryMap>();
+  if (!tile_map->loadFromFolder(common::concatenateFolderAndFileName(
+          folder_path_, it->second.folder))) {
+    return nullptr;
+  }
+  return tile_map;
+}
+
+bool TiledLocalizationSummaryMap::hasTile(
+    const SummaryMapTileIndex& index) const {
+  return tiles_.count(index) > 0u;
+}
+
+void TiledLocalizationSummaryMap::getAllTileIndices(
+    SummaryMapTileIndexList* indices) const {
+  CHECK_NOTNULL(indices)->clear();
+  indices->reserve(tiles_.size());
+  for (const std::pair<const SummaryMapTileIndex, TileInfo>& value : tiles_) {
+    indices->push_back(value.first);
+  }
+  // Sort to get a deterministic order independent of the hashing.
+  std::sort(
+      indices->begin(), indices->end(),
+      [](const SummaryMapTileIndex& lhs, const SummaryMapTileIndex& rhs) {
+        return lhs.x < rhs.x || (lhs.x == rhs.x && lhs.y < rhs.y);
+      });
+}
+
+void TiledLocalizationSummaryMap::getTileIndicesWithinRadius(
+    const Eigen::Vector3d& p_G, const double radius_m,
+    SummaryMapTileIndexList* indices) const {
+  CHECK_NOTNULL(indices)->clear();
+  CHECK_GE(radius_m, 0.0);
+  const double squared_radius = radius_m * radius_m;
+  std::vector<std::pair<double, SummaryMapTileIndex>> distance_and_index;
+  for (const std::pair<const SummaryMapTileIndex, TileInfo>& value : tiles_) {
+    const double squared_distance =
+        value.first.squaredDistanceToPosition(p_G, tile_size_m_);
+    if (squared_distance <= squared_radius) {
+      distance_and_index.emplace_back(squared_distance, value.first);
+    }
+  }
+  std::sort(
+      distance_and_index.begin(), distance_and_index.end(),
+      [](const std::pair<double, SummaryMapTileIndex>& lhs,
+         const std::pair<double, SummaryMapTileIndex>& rhs) {
+        return lhs.first < rhs.first;
+      });
+  indices->reserve(distance_and_index.size());
+  for (const std::pair<double, SummaryMapTileIndex>& value :
+       distance_and_index) {
+    indices->push_back(value.second);
+  }
+}
+
+}  // namespace summary_map
@@ -15,6 +15,7 @@ bool LocalizationSummaryMap::operator==(
     const LocalizationSummaryMap& other) const {
   bool is_same = true;
   is_same &= id_ == other.id_;
+  is_same &= version_ == other.version_;
   is_same &=
       landmark_id_to_landmark_index_ == other.landmark_id_to_landmark_index_;
   is_same &= G_landmark_position_ == other.G_landmark_position_;
@@ -34,6 +35,7 @@ void LocalizationSummaryMap::serialize(
     proto::LocalizationSummaryMap* proto) const {
   CHECK_NOTNULL(proto);
 
+  proto->set_version(version_);
   common::eigen_proto::serialize(
       G_landmark_position_, proto->mutable_g_landmark_position());
 
@@ -54,6 +56,7 @@ void LocalizationSummaryMap::deserialize(
     const LocalizationSummaryMapId& localization_summary_map_id,
     const proto::LocalizationSummaryMap& proto) {
   id_ = localization_summary_map_id;
+  version_ = proto.version();
 
   common::eigen_proto::deserialize(
       proto.g_landmark_position(), &G_landmark_position_);
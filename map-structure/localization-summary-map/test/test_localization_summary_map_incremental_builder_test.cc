@@ -0,0 +1,224 @@
+#include <string>
+
+#include <Eigen/Core>
+#include <aslam/common/unique-id.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/pose_types.h>
+#include <maplab-common/test/testing-entrypoint.h>
+#include <maplab-common/test/testing-predicates.h>
+#include <vi-map/test/vi-map-generator.h>
+#include <vi-map/unique-id.h>
+
+#include "localization-summary-map/localization-summary-map-creation.h"
+#include "localization-summary-map/localization-summary-map-diff.h"
+#include "localization-summary-map/localization-summary-map-incremental-builder.h"
+#include "localization-summary-map/localization-summary-map.h"
+
+namespace summary_map {
+
+class LocalizationSummaryMapIncrementalBuilderTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    constructProblem();
+  }
+  void constructProblem();
+
+  void expectSameContent(
+      const LocalizationSummaryMap& lhs,
+      const LocalizationSummaryMap& rhs) const;
+
+  vi_map::VIMap map_;
+  vi_map::LandmarkId landmark_1_id_;
+  vi_map::LandmarkId landmark_2_id_;
+  vi_map::LandmarkId landmark_3_id_;
+};
+
+void LocalizationSummaryMapIncrementalBuilderTest::constructProblem() {
+  vi_map::VIMapGenerator generator(map_, 42);
+
+  vi_map::MissionId mission_id =
+      generator.createMission(pose::Transformation());
+  pose_graph::VertexId v1 =
+      generator.createVertex(mission_id, pose::Transformation());
+  pose_graph::VertexId v2 =
+      generator.createVertex(mission_id, pose::Transformation());
+  pose_graph::VertexId v3 =
+      generator.createVertex(mission_id, pose::Transformation());
+  landmark_1_id_ =
+      generator.createLandmark(Eigen::Vector3d(0, 0, 1), v1, {v2, v3});
+  landmark_2_id_ = generator.createLandmark(Eigen::Vector3d(0, 0, 2), v2, {v3});
+  landmark_3_id_ = generator.createLandmark(Eigen::Vector3d(0, 0, 3), v1, {v2});
+
+  generator.generateMap();
+}
+
+void LocalizationSummaryMapIncrementalBuilderTest::expectSameContent(
+    const LocalizationSummaryMap& lhs,
+    const LocalizationSummaryMap& rhs) const {
+  EXPECT_EQ(lhs.GLandmarkPosition(), rhs.GLandmarkPosition());
+  EXPECT_EQ(lhs.GObserverPosition(), rhs.GObserverPosition());
+  EXPECT_EQ(lhs.projectedDescriptors(), rhs.projectedDescriptors());
+  EXPECT_EQ(lhs.observerIndices(), rhs.observerIndices());
+  EXPECT_EQ(lhs.observationToLandmarkIndex(), rhs.observationToLandmarkIndex());
+}
+
+TEST_F(LocalizationSummaryMapIncrementalBuilderTest, MatchesFullCreation) {
+  const vi_map::LandmarkIdList landmark_ids = {landmark_1_id_, landmark_2_id_};
+  LocalizationSummaryMapIncrementalBuilder builder;
+  LocalizationSummaryMapDiff diff;
+  builder.update(map_, landmark_ids, &diff);
+  EXPECT_EQ(diff.base_version, 0u);
+  EXPECT_EQ(diff.version, 1u);
+  EXPECT_EQ(builder.version(), 1u);
+
+  LocalizationSummaryMap summary_map;
+  createLocalizationSummaryMapFromLandmarkList(
+      map_, landmark_ids, &summary_map);
+  expectSameContent(builder.getSummaryMap(), summary_map);
+
+  // Nothing changed, so the diff is empty.
+  builder.update(map_, landmark_ids, &diff);
+  EXPECT_TRUE(diff.isEmpty());
+  EXPECT_EQ(builder.version(), 1u);
+}
+
+TEST_F(LocalizationSummaryMapIncrementalBuilderTest, ClientAppliesDiffs) {
+  LocalizationSummaryMapIncrementalBuilder builder;
+  LocalizationSummaryMap client_summary_map;
+  LocalizationSummaryMapDiff diff;
+
+  builder.update(map_, {landmark_1_id_, landmark_2_id_}, &diff);
+  ASSERT_TRUE(applyLocalizationSummaryMapDiff(diff, &client_summary_map));
+  expectSameContent(builder.getSummaryMap(), client_summary_map);
+  EXPECT_EQ(client_summary_map.version(), 1u);
+
+  // Replace a landmark and move another one.
+  vi_map::Landmark& landmark_1 = map_.getLandmark(landmark_1_id_);
+  landmark_1.set_p_B(landmark_1.get_p_B() + Eigen::Vector3d(1.0, 0.0, 0.0));
+  builder.update(map_, {landmark_1_id_, landmark_3_id_}, &diff);
+  ASSERT_EQ(diff.removed_landmark_indices.size(), 1u);
+  EXPECT_EQ(diff.removed_landmark_indices[0], 1u);
+  ASSERT_EQ(diff.moved_landmark_indices.size(), 1u);
+  EXPECT_EQ(diff.moved_landmark_indices[0], 0u);
+  EXPECT_EQ(diff.added_G_landmark_position.cols(), 1);
+  EXPECT_EQ(diff.removed_observation_indices.size(), 2u);
+  EXPECT_EQ(diff.added_projected_descriptors.cols(), 2);
+
+  // Transmit the diff through the file system.
+  const std::string kFolder = "./incremental_summary_map_diff_test";
+  ASSERT_TRUE(diff.saveToFolder(kFolder));
+  LocalizationSummaryMapDiff loaded_diff;
+  ASSERT_TRUE(loaded_diff.loadFromFolder(kFolder, diff.version));
+  common::removePath(kFolder);
+
+  ASSERT_TRUE(
+      applyLocalizationSummaryMapDiff(loaded_diff, &client_summary_map));
+  expectSameContent(builder.getSummaryMap(), client_summary_map);
+  EXPECT_EQ(client_summary_map.version(), 2u);
+  EXPECT_NEAR_EIGEN(
+      client_summary_map.GLandmarkPosition().col(0),
+      Eigen::Vector3f(1, 0, 1), 1e-6);
+
+  // A diff can't be applied twice.
+  EXPECT_FALSE(applyLocalizationSummaryMapDiff(diff, &client_summary_map));
+}
+
+TEST_F(LocalizationSummaryMapIncrementalBuilderTest, MergedLandmarks) {
+  LocalizationSummaryMapIncrementalBuilder builder;
+  LocalizationSummaryMap client_summary_map;
+  LocalizationSummaryMapDiff diff;
+  builder.update(
+      map_, {landmark_1_id_, landmark_2_id_, landmark_3_id_}, &diff);
+  ASSERT_TRUE(applyLocalizationSummaryMapDiff(diff, &client_summary_map));
+  const Eigen::MatrixXf descriptors_before =
+      builder.getSummaryMap().projectedDescriptors();
+
+  map_.mergeLandmarks(landmark_3_id_, landmark_2_id_);
+  builder.update(map_, {landmark_1_id_, landmark_2_id_}, &diff);
+  ASSERT_EQ(diff.removed_landmark_indices.size(), 1u);
+  EXPECT_EQ(diff.removed_landmark_indices[0], 2u);
+  EXPECT_EQ(diff.added_G_landmark_position.cols(), 0);
+  // The observations of the merged landmark are moved, not projected again.
+  ASSERT_EQ(diff.added_projected_descriptors.cols(), 2);
+  EXPECT_EQ(
+      diff.added_projected_descriptors, descriptors_before.rightCols(2));
+  for (int i = 0; i < diff.added_observation_to_landmark_index.rows(); ++i) {
+    EXPECT_EQ(diff.added_observation_to_landmark_index(i), 1u);
+  }
+
+  ASSERT_TRUE(applyLocalizationSummaryMapDiff(diff, &client_summary_map));
+  expectSameContent(builder.getSummaryMap(), client_summary_map);
+  EXPECT_EQ(client_summary_map.GLandmarkPosition().cols(), 2);
+  EXPECT_EQ(client_summary_map.projectedDescriptors().cols(), 7);
+}
+
+TEST_F(LocalizationSummaryMapIncrementalBuilderTest, ChangedKeypoints) {
+  const vi_map::LandmarkIdList landmark_ids = {landmark_1_id_, landmark_2_id_};
+  LocalizationSummaryMapIncrementalBuilder builder;
+  LocalizationSummaryMapDiff diff;
+  builder.update(map_, landmark_ids, &diff);
+  const Eigen::MatrixXf descriptors_before =
+      builder.getSummaryMap().projectedDescriptors();
+
+  // Compacting a frame renumbers its keypoints, such that an unchanged
+  // keypoint identifier refers to a different keypoint.
+  const vi_map::KeypointIdentifier& observation =
+      map_.getLandmark(landmark_1_id_).getObservations().front();
+  aslam::VisualFrame& frame =
+      map_.getVertex(observation.frame_id.vertex_id)
+          .getVisualFrame(observation.frame_id.frame_index);
+  frame.getKeypointMeasurementsMutable()->col(observation.keypoint_index) +=
+      Eigen::Vector2d(5.0, 5.0);
+  aslam::VisualFrame::DescriptorsT& descriptors =
+      *frame.getDescriptorsMutable();
+  for (int i = 0; i < descriptors.rows(); ++i) {
+    descriptors(i, observation.keypoint_index) ^= 0xff;
+  }
+
+  // Only this observation is removed and projected again.
+  builder.update(map_, landmark_ids, &diff);
+  EXPECT_TRUE(diff.removed_landmark_indices.empty());
+  EXPECT_EQ(diff.removed_observation_indices.size(), 1u);
+  ASSERT_EQ(diff.added_projected_descriptors.cols(), 1);
+  EXPECT_NE(
+      diff.added_projected_descriptors.col(0),
+      descriptors_before.col(diff.removed_observation_indices[0]));
+
+  builder.update(map_, landmark_ids, &diff);
+  EXPECT_TRUE(diff.isEmpty());
+}
+
+TEST_F(LocalizationSummaryMapIncrementalBuilderTest, SaveAndLoadState) {
+  const vi_map::LandmarkIdList landmark_ids = {landmark_1_id_, landmark_3_id_};
+  LocalizationSummaryMapIncrementalBuilder builder;
+  LocalizationSummaryMapDiff diff;
+  builder.update(map_, landmark_ids, &diff);
+
+  const std::string kFolder = "./incremental_summary_map_state_test";
+  backend::SaveConfig save_config;
+  save_config.overwrite_existing_files = true;
+  ASSERT_TRUE(builder.saveToFolder(kFolder, save_config));
+  ASSERT_TRUE(
+      LocalizationSummaryMapIncrementalBuilder::hasStateOnFileSystem(kFolder));
+
+  LocalizationSummaryMapIncrementalBuilder loaded_builder;
+  ASSERT_TRUE(loaded_builder.loadFromFolder(kFolder));
+  common::removePath(kFolder);
+  EXPECT_EQ(loaded_builder.version(), builder.version());
+  EXPECT_EQ(loaded_builder.getSummaryMap().id(), builder.getSummaryMap().id());
+  expectSameContent(loaded_builder.getSummaryMap(), builder.getSummaryMap());
+
+  // The loaded state continues where the previous run stopped.
+  loaded_builder.update(map_, landmark_ids, &diff);
+  EXPECT_TRUE(diff.isEmpty());
+  loaded_builder.update(
+      map_, {landmark_1_id_, landmark_2_id_, landmark_3_id_}, &diff);
+  EXPECT_EQ(diff.base_version, 1u);
+  EXPECT_TRUE(diff.removed_landmark_indices.empty());
+  EXPECT_EQ(diff.added_G_landmark_position.cols(), 1);
+  EXPECT_EQ(diff.added_projected_descriptors.cols(), 2);
+}
+
+}  // namespace summary_map
+
+MAPLAB_UNITTEST_ENTRYPOINT
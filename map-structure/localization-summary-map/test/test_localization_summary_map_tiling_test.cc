@@ -0,0 +1,140 @@
+#include <string>
+
+#include <Eigen/Core>
+#include <aslam/common/unique-id.h>
+#include <maplab-common/file-system-tools.h>
+#include <maplab-common/test/testing-entrypoint.h>
+
+#include "localization-summary-map/localization-summary-map-tiling.h"
+#include "localization-summary-map/localization-summary-map.h"
+
+namespace summary_map {
+
+namespace {
+constexpr double kTileSizeMeters = 10.0;
+constexpr int kNumKeyframes = 20;
+constexpr int kNumLandmarks = 30;
+constexpr int kNumObservations = 200;
+}  // namespace
+
+class LocalizationSummaryMapTilingTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    constructLocalizationSummaryMap();
+  }
+
+  void constructLocalizationSummaryMap();
+
+  LocalizationSummaryMap summary_map_;
+};
+
+void LocalizationSummaryMapTilingTest::constructLocalizationSummaryMap() {
+  LocalizationSummaryMapId id;
+  aslam::generateId(&id);
+  summary_map_.setId(id);
+
+  Eigen::Matrix3Xd G_landmark_position(3, kNumLandmarks);
+  G_landmark_position.setRandom();
+  summary_map_.setGLandmarkPosition(G_landmark_position * 20.0);
+
+  // The keyframes lie on a line along the x-axis and span several tiles.
+  Eigen::Matrix3Xd G_observer_position(3, kNumKeyframes);
+  for (int i = 0; i < kNumKeyframes; ++i) {
+    G_observer_position.col(i) << 2.5 * i - 5.0, 1.0, 0.0;
+  }
+  summary_map_.setGObserverPosition(G_observer_position);
+
+  Eigen::MatrixXf descriptors(10, kNumObservations);
+  descriptors.setRandom();
+  summary_map_.setProjectedDescriptors(descriptors);
+
+  Eigen::Matrix<unsigned int, Eigen::Dynamic, 1> observer_indices(
+      kNumObservations);
+  Eigen::Matrix<unsigned int, Eigen::Dynamic, 1> observation_to_landmark_index(
+      kNumObservations);
+  for (int i = 0; i < kNumObservations; ++i) {
+    observer_indices(i) = i % kNumKeyframes;
+    observation_to_landmark_index(i) = (i * 7) % kNumLandmarks;
+  }
+  summary_map_.setObserverIndices(observer_indices);
+  summary_map_.setObservationToLandmarkIndex(observation_to_landmark_index);
+}
+
+TEST_F(LocalizationSummaryMapTilingTest, SplitPreservesObservations) {
+  SummaryMapTiles tiles;
+  splitLocalizationSummaryMapIntoTiles(summary_map_, kTileSizeMeters, &tiles);
+  // x spans [-5, 42.5], i.e. tiles -1 to 4.
+  ASSERT_EQ(tiles.size(), 6u);
+
+  int num_observations = 0;
+  for (const SummaryMapTiles::value_type& value : tiles) {
+    const LocalizationSummaryMap& tile = *value.second;
+    EXPECT_EQ(value.first.y, 0);
+    num_observations += tile.observationToLandmarkIndex().rows();
+
+    // All observers lie within the tile.
+    for (int i = 0; i < tile.GObserverPosition().cols(); ++i) {
+      EXPECT_EQ(
+          SummaryMapTileIndex::fromPosition(
+              tile.GObserverPosition().col(i).cast<double>(), kTileSizeMeters),
+          value.first);
+    }
+    // Every observation references a valid landmark and observer.
+    for (int i = 0; i < tile.observationToLandmarkIndex().rows(); ++i) {
+      EXPECT_LT(
+          tile.observationToLandmarkIndex()(i),
+          static_cast<unsigned int>(tile.GLandmarkPosition().cols()));
+      EXPECT_LT(
+          tile.observerIndices()(i),
+          static_cast<unsigned int>(tile.GObserverPosition().cols()));
+    }
+    EXPECT_EQ(
+        tile.projectedDescriptors().cols(),
+        tile.observationToLandmarkIndex().rows());
+  }
+  EXPECT_EQ(num_observations, kNumObservations);
+}
+
+TEST_F(LocalizationSummaryMapTilingTest, SaveAndLoadTiles) {
+  SummaryMapTiles tiles;
+  splitLocalizationSummaryMapIntoTiles(summary_map_, kTileSizeMeters, &tiles);
+
+  const std::string kFolder = "./tiled_summary_map_test";
+  backend::SaveConfig save_config;
+  save_config.overwrite_existing_files = true;
+  ASSERT_TRUE(
+      TiledLocalizationSummaryMap::saveToFolder(
+          tiles, kTileSizeMeters, kFolder, save_config));
+  ASSERT_TRUE(TiledLocalizationSummaryMap::hasMapOnFileSystem(kFolder));
+
+  TiledLocalizationSummaryMap tiled_map;
+  ASSERT_TRUE(tiled_map.loadFromFolder(kFolder));
+  EXPECT_EQ(tiled_map.numTiles(), tiles.size());
+  EXPECT_DOUBLE_EQ(tiled_map.tileSizeMeters(), kTileSizeMeters);
+
+  for (const SummaryMapTiles::value_type& value : tiles) {
+    ASSERT_TRUE(tiled_map.hasTile(value.first));
+    LocalizationSummaryMap::Ptr loaded_tile = tiled_map.loadTile(value.first);
+    ASSERT_TRUE(loaded_tile != nullptr);
+    EXPECT_EQ(
+        loaded_tile->projectedDescriptors(),
+        value.second->projectedDescriptors());
+    EXPECT_EQ(
+        loaded_tile->observationToLandmarkIndex(),
+        value.second->observationToLandmarkIndex());
+  }
+  EXPECT_TRUE(tiled_map.loadTile(SummaryMapTileIndex(100, 100)) == nullptr);
+
+  // A position in tile (1, 0) is close to tiles 0 and 2 only.
+  SummaryMapTileIndexList nearby_tiles;
+  tiled_map.getTileIndicesWithinRadius(
+      Eigen::Vector3d(15.0, 5.0, 0.0), 6.0, &nearby_tiles);
+  ASSERT_EQ(nearby_tiles.size(), 3u);
+  EXPECT_EQ(nearby_tiles[0], SummaryMapTileIndex(1, 0));
+
+  common::removePath(kFolder);
+}
+
+}  // namespace summary_map
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -0,0 +1,118 @@
+#ifndef VI_MAP_COVISIBILITY_GRAPH_H_
+#define VI_MAP_COVISIBILITY_GRAPH_H_
+
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <posegraph/unique-id.h>
+
+#include "vi-map/unique-id.h"
+
+namespace vi_map {
+class Vertex;
+
+// Graph between the vertices that observe common landmarks, built from the
+// observed landmark ids of the keypoints of the vertices. The weight of the
+// edge from vertex A to vertex B is the number of keypoints of B that observe
+// a landmark that A also observes, which is what
+// VIMapQueries::getNumberOfCommonLandmarks(A, B) computes. The weight of a
+// vertex to itself is its number of keypoints with a valid landmark. All
+// weights are updated incrementally when observations are added or removed.
+class CovisibilityGraph {
+ public:
+  typedef std::pair<pose_graph::VertexId, size_t> VertexCount;
+  typedef std::vector<VertexCount> VertexCountList;
+
+  CovisibilityGraph() = default;
+  CovisibilityGraph(const CovisibilityGraph&) = delete;
+  CovisibilityGraph& operator=(const CovisibilityGraph&) = delete;
+
+  // Adds all observations of the keypoints of the vertex.
+  void addVertex(const Vertex& vertex);
+  // Removes the vertex together with all its observations.
+  void removeVertex(const pose_graph::VertexId& vertex_id);
+
+  void addObservation(
+      const pose_graph::VertexId& vertex_id, const LandmarkId& landmark_id);
+  void removeObservation(
+      const pose_graph::VertexId& vertex_id, const LandmarkId& landmark_id);
+
+  // Replaces all observations of the landmark by observations of
+  // landmark_id_into.
+  void mergeLandmarks(
+      const LandmarkId& landmark_id, const LandmarkId& landmark_id_into);
+  // Removes all observations of the landmark.
+  void removeLandmark(const LandmarkId& landmark_id);
+
+  void clear();
+
+  inline bool hasVertex(const pose_graph::VertexId& vertex_id) const {
+    return vertices_.count(vertex_id) > 0u;
+  }
+  inline size_t numVertices() const {
+    return vertices_.size();
+  }
+  inline size_t numLandmarks() const {
+    return landmark_observers_.size();
+  }
+
+  // Returns true if the graph holds exactly the observations of the
+  // keypoints of the vertex. Linear in the number of keypoints of the vertex.
+  bool isConsistentWithVertex(const Vertex& vertex) const;
+
+  // Constant time.
+  size_t getNumberOfCommonLandmarks(
+      const pose_graph::VertexId& vertex_id_1,
+      const pose_graph::VertexId& vertex_id_2) const;
+
+  // Returns the vertices (including the vertex itself) that share at least
+  // min_number_common_landmarks with the vertex, sorted by decreasing
+  // number of common landmarks. The list of a vertex is only sorted again
+  // after its weights changed, such that repeated queries are linear in the
+  // number of returned vertices.
+  void getCoobserverVertices(
+      const pose_graph::VertexId& vertex_id,
+      const size_t min_number_common_landmarks, const size_t max_num_vertices,
+      VertexCountList* coobserver_vertices) const;
+
+ private:
+  struct VertexEntry {
+    // Number of keypoints of this vertex observing each landmark.
+    std::unordered_map<LandmarkId, size_t> landmark_observation_counts;
+    // Weights of the edges from this vertex to all coobserving vertices.
+    std::unordered_map<pose_graph::VertexId, size_t> common_landmark_counts;
+
+    // Coobservers sorted by decreasing weight, sorted lazily by the queries.
+    mutable VertexCountList sorted_coobservers;
+    mutable bool are_sorted_coobservers_valid = false;
+  };
+
+  void addObservations(
+      const pose_graph::VertexId& vertex_id, const LandmarkId& landmark_id,
+      const size_t num_observations);
+  void removeObservations(
+      const pose_graph::VertexId& vertex_id, const LandmarkId& landmark_id,
+      const size_t num_observations);
+
+  static void addToWeight(
+      const pose_graph::VertexId& vertex_id, const size_t value,
+      VertexEntry* entry);
+  static void subtractFromWeight(
+      const pose_graph::VertexId& vertex_id, const size_t value,
+      VertexEntry* entry);
+
+  std::unordered_map<pose_graph::VertexId, VertexEntry> vertices_;
+  // Number of observing keypoints per vertex for each landmark.
+  std::unordered_map<
+      LandmarkId, std::unordered_map<pose_graph::VertexId, size_t>>
+      landmark_observers_;
+
+  // Guards the lazily sorted coobserver lists.
+  mutable std::mutex sorting_mutex_;
+};
+
+}  // namespace vi_map
+
+#endif  // VI_MAP_COVISIBILITY_GRAPH_H_
@@ -108,6 +108,15 @@ class LandmarkIndex {
     index_.erase(landmark_id);
   }
 
+  inline void removeLandmarks(const LandmarkIdList& landmark_ids) {
+    std::lock_guard<std::mutex> lock(access_mutex_);
+    for (const LandmarkId& landmark_id : landmark_ids) {
+      CHECK_EQ(index_.erase(landmark_id), 1u)
+          << "Tried to remove landmark " << landmark_id
+          << " that does not exist!";
+    }
+  }
+
   void setLandmarkToVertexMap(
       const LandmarkToVertexMap& landmark_to_vertex) {
     std::lock_guard<std::mutex> lock(access_mutex_);
@@ -33,6 +33,10 @@ bool isVisualLandmarkWellConstrained(
 bool isLiDARLandmarkWellConstrained(
     const vi_map::VIMap& map, const vi_map::Landmark& landmark);
 
+// Hash of all parameters that influence the landmark quality, it changes
+// whenever one of the quality flags is modified.
+size_t getLandmarkQualityParametersHash();
+
 }  // namespace vi_map
 
 #endif  // VI_MAP_LANDMARK_QUALITY_METRICS_H_
@@ -23,6 +23,8 @@ class LandmarkStore {
 
   void addLandmark(const Landmark& landmark);
   void removeLandmark(const LandmarkId& landmark_id);
+  // Removes all given landmarks in a single pass over the store.
+  void removeLandmarks(const LandmarkIdSet& landmark_ids);
   bool hasLandmark(const LandmarkId& landmark_id) const;
 
   unsigned int size() const;
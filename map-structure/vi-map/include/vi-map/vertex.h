@@ -4,6 +4,7 @@
 #include <posegraph/vertex.h>
 
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -292,6 +293,13 @@ class Vertex : public pose_graph::Vertex {
 
   size_t discardUntrackedObservations();
 
+  // Removes the given (ascending) keypoints from the frame and from the
+  // observed landmark ids of the frame. The keypoint indices of all following
+  // keypoints shift, hence the caller needs to update the landmark
+  // observations of this frame accordingly.
+  void discardKeypointsOfFrame(
+      const size_t frame_idx, const std::vector<size_t>& ordered_indices);
+
   inline int64_t getMinTimestampNanoseconds() const;
 
   // Updates an entry in the observed landmark ids list. This is needed after a
@@ -299,6 +307,11 @@ class Vertex : public pose_graph::Vertex {
   // replace it with the new id.
   void updateIdInObservedLandmarkIdList(
       const LandmarkId& old_landmark_id, const LandmarkId& new_landmark_id);
+  // Same as above for many landmarks at once, in a single pass over the
+  // observed landmark ids. Returns the number of updated entries.
+  size_t updateIdsInObservedLandmarkIdList(
+      const std::unordered_map<LandmarkId, LandmarkId>&
+          old_to_new_landmark_ids);
 
   void removeObservedLandmarkIdList(const LandmarkId& landmark_id);
 
@@ -314,6 +327,12 @@ class Vertex : public pose_graph::Vertex {
   void addObservedLandmarkId(
       unsigned int frame_idx, const LandmarkId& landmark_id);
 
+  // Erases the given (ascending) keypoint indices from the observed landmark
+  // ids of the frame, after the keypoints have been removed from the frame.
+  void eraseObservedLandmarkIdsOfFrame(
+      const size_t frame_idx, const std::vector<size_t>& ordered_indices,
+      const size_t original_count);
+
   pose_graph::VertexId id_;
   vi_map::MissionId mission_id_;
 
@@ -782,6 +782,9 @@ void VIMap::removeLandmark(const LandmarkId landmark_id) {
   // This is important for merged landmarks. We are just deleting one global
   // ID, we should remove all backlinks from the store landmark that point to
   // this specific one.
+  if (covisibility_graph_) {
+    covisibility_graph_->removeLandmark(landmark_id);
+  }
   KeypointIdentifierList observations = landmark.getObservations();
   for (const KeypointIdentifier& observation : observations) {
     vi_map::Vertex& observer_vertex = getVertex(observation.frame_id.vertex_id);
@@ -799,6 +802,9 @@ void VIMap::addVertex(vi_map::Vertex::UniquePtr vertex_ptr) {
   CHECK(!hasVertex(vertex_ptr->id()))
       << "A vertex with id " << vertex_ptr->id() << " already exists.";
 
+  if (covisibility_graph_) {
+    covisibility_graph_->addVertex(*vertex_ptr);
+  }
   posegraph.addVertex(std::move(vertex_ptr));
 }
 
@@ -911,6 +917,10 @@ void VIMap::removeVertex(pose_graph::VertexId vertex_id) {
     }
   }
 
+  // Drops the observations that were dereferenced before the removal.
+  if (covisibility_graph_) {
+    covisibility_graph_->removeVertex(vertex_id);
+  }
   posegraph.removeVertex(vertex_id);
 }
 
@@ -1084,6 +1094,7 @@ void VIMap::clear() {
   mission_base_frames.clear();
   landmark_index.clear();
   selected_missions_.clear();
+  invalidateCovisibilityGraph();
 }
 
 template <typename DataType>
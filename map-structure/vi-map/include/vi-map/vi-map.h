@@ -32,6 +32,7 @@
 #include <vector>
 
 #include "vi-map/cklam-edge.h"
+#include "vi-map/covisibility-graph.h"
 #include "vi-map/landmark-index.h"
 #include "vi-map/landmark.h"
 #include "vi-map/loopclosure-edge.h"
@@ -500,6 +501,33 @@ class VIMap : public backend::ResourceMap,
       const vi_map::LandmarkId landmark_id_to_merge,
       const vi_map::LandmarkId& landmark_id_into);
 
+  /// Merges many pairs of (to-merge, into) landmarks at once. The pairs are
+  /// grouped with a union-find, such that every group is merged into the
+  /// landmark that calling the function above for every pair in order (with
+  /// the ids of the already merged landmarks replaced) would keep. Observer
+  /// vertices are updated in one pass per vertex and the merged landmarks are
+  /// removed from the stores and the landmark index in one batch. Returns the
+  /// number of removed landmarks.
+  size_t mergeLandmarks(
+      const std::vector<std::pair<vi_map::LandmarkId, vi_map::LandmarkId>>&
+          landmark_ids_to_merge_into);
+
+  /// Covisibility graph of all vertices of the map (ignoring the mission
+  /// selection). It is built on first access and then kept up to date by
+  /// addVertex, removeVertex, removeLandmark, mergeLandmarks and
+  /// associateKeypointWithExistingLandmark. Operations that rewrite the
+  /// observations of many vertices drop it instead, such that it is rebuilt
+  /// on the next access. Code that changes the observed landmark ids of
+  /// vertices directly has to call invalidateCovisibilityGraph(), the queries
+  /// of VIMapQueries and the keyframe selection check the vertices they read
+  /// in debug builds.
+  const CovisibilityGraph& getCovisibilityGraph() const;
+  void invalidateCovisibilityGraph() const;
+  /// Returns true if there is no covisibility graph yet or if it holds
+  /// exactly the observations of the keypoints of all vertices. Linear in the
+  /// number of keypoints of the map.
+  bool isCovisibilityGraphConsistent() const;
+
   /// Moves a given landmark to be stored in the "to" vertex
   /// and updating all the references to it.
   void moveLandmarkToOtherVertex(
@@ -550,6 +578,16 @@ class VIMap : public backend::ResourceMap,
       const pose_graph::VertexId& vertex_id_to, bool merge_viwls_edges = true,
       bool merge_odometry_edges = true, bool merge_wheel_odometry_edges = true);
 
+  /// Removes all vertices between consecutive keyframes, given one list of
+  /// keyframes per mission ordered along the graph. The result is the same as
+  /// merging every vertex into its preceding keyframe with
+  /// mergeNeighboringVertices, but every composed edge is built at once and
+  /// the landmarks are moved and their observations are removed in a single
+  /// sweep. The keyframe intervals of all missions are prepared in parallel.
+  /// Returns the number of removed vertices.
+  size_t removeVerticesBetweenKeyframes(
+      const std::vector<pose_graph::VertexIdList>& keyframe_ids_per_mission);
+
   // Returns the number of edges of the given type between merge_into_vertex_id
   // and vertex_to_merge.
   template <typename Edge, vi_map::Edge::EdgeType EdgeType>
@@ -802,6 +840,10 @@ class VIMap : public backend::ResourceMap,
   mutable std::default_random_engine generator_;
 
   mutable std::recursive_mutex resource_mutex_;
+
+  // Derived from the vertices, deepCopy() and swap() drop it.
+  mutable std::unique_ptr<CovisibilityGraph> covisibility_graph_;
+  mutable std::mutex covisibility_graph_mutex_;
 };
 }  // namespace vi_map
 
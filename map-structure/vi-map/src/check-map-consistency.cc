@@ -508,6 +508,16 @@ bool checkMapConsistency(const vi_map::VIMap& vi_map) {
                  << "might not be possible.";
   }
 
+  VLOG(2) << "Verifying covisibility graph...";
+  if (!vi_map.isCovisibilityGraphConsistent()) {
+    LOG(ERROR) << "The covisibility graph doesn't match the observed "
+               << "landmark ids of the vertices. Observations were changed "
+               << "without calling VIMap::invalidateCovisibilityGraph().";
+    is_consistent = false;
+  } else {
+    VLOG(2) << "OK.";
+  }
+
   LOG_IF(INFO, is_consistent) << "VI-Map is consistent.";
   return is_consistent;
 }
@@ -0,0 +1,268 @@
+#include "vi-map/covisibility-graph.h"
+
+#include <algorithm>
+
+#include <glog/logging.h>
+#include <maplab-common/accessors.h>
+
+#include "vi-map/vertex.h"
+
+namespace vi_map {
+
+namespace {
+// Number of keypoints of the vertex observing each landmark.
+void countLandmarkObservations(
+    const Vertex& vertex,
+    std::unordered_map<LandmarkId, size_t>* landmark_observation_counts) {
+  CHECK_NOTNULL(landmark_observation_counts)->clear();
+  for (unsigned int frame_idx = 0u; frame_idx < vertex.numFrames();
+       ++frame_idx) {
+    if (!vertex.isVisualFrameSet(frame_idx)) {
+      continue;
+    }
+    for (const LandmarkId& landmark_id :
+         vertex.getFrameObservedLandmarkIds(frame_idx)) {
+      if (landmark_id.isValid()) {
+        ++(*landmark_observation_counts)[landmark_id];
+      }
+    }
+  }
+}
+}  // namespace
+
+void CovisibilityGraph::addVertex(const Vertex& vertex) {
+  const pose_graph::VertexId& vertex_id = vertex.id();
+  CHECK(!hasVertex(vertex_id))
+      << "Vertex " << vertex_id << " is already in the covisibility graph.";
+  vertices_.emplace(vertex_id, VertexEntry());
+
+  std::unordered_map<LandmarkId, size_t> landmark_observation_counts;
+  countLandmarkObservations(vertex, &landmark_observation_counts);
+  for (const std::pair<const LandmarkId, size_t>& landmark_and_count :
+       landmark_observation_counts) {
+    addObservations(
+        vertex_id, landmark_and_count.first, landmark_and_count.second);
+  }
+}
+
+void CovisibilityGraph::removeVertex(const pose_graph::VertexId& vertex_id) {
+  std::unordered_map<pose_graph::VertexId, VertexEntry>::iterator it =
+      vertices_.find(vertex_id);
+  if (it == vertices_.end()) {
+    return;
+  }
+  // Copy, the observation counts are modified while removing.
+  const std::unordered_map<LandmarkId, size_t> landmark_observation_counts =
+      it->second.landmark_observation_counts;
+  for (const std::pair<const LandmarkId, size_t>& landmark_and_count :
+       landmark_observation_counts) {
+    removeObservations(
+        vertex_id, landmark_and_count.first, landmark_and_count.second);
+  }
+  CHECK(it->second.common_landmark_counts.empty());
+  vertices_.erase(it);
+}
+
+void CovisibilityGraph::addObservation(
+    const pose_graph::VertexId& vertex_id, const LandmarkId& landmark_id) {
+  CHECK(landmark_id.isValid());
+  addObservations(vertex_id, landmark_id, 1u);
+}
+
+void CovisibilityGraph::removeObservation(
+    const pose_graph::VertexId& vertex_id, const LandmarkId& landmark_id) {
+  CHECK(landmark_id.isValid());
+  removeObservations(vertex_id, landmark_id, 1u);
+}
+
+void CovisibilityGraph::mergeLandmarks(
+    const LandmarkId& landmark_id, const LandmarkId& landmark_id_into) {
+  CHECK_NE(landmark_id, landmark_id_into);
+  CHECK(landmark_id_into.isValid());
+  std::unordered_map<
+      LandmarkId,
+      std::unordered_map<pose_graph::VertexId, size_t>>::const_iterator it =
+      landmark_observers_.find(landmark_id);
+  if (it == landmark_observers_.end()) {
+    return;
+  }
+  const std::unordered_map<pose_graph::VertexId, size_t> observers =
+      it->second;
+  for (const std::pair<const pose_graph::VertexId, size_t>& observer :
+       observers) {
+    removeObservations(observer.first, landmark_id, observer.second);
+    addObservations(observer.first, landmark_id_into, observer.second);
+  }
+}
+
+void CovisibilityGraph::removeLandmark(const LandmarkId& landmark_id) {
+  std::unordered_map<
+      LandmarkId,
+      std::unordered_map<pose_graph::VertexId, size_t>>::const_iterator it =
+      landmark_observers_.find(landmark_id);
+  if (it == landmark_observers_.end()) {
+    return;
+  }
+  const std::unordered_map<pose_graph::VertexId, size_t> observers =
+      it->second;
+  for (const std::pair<const pose_graph::VertexId, size_t>& observer :
+       observers) {
+    removeObservations(observer.first, landmark_id, observer.second);
+  }
+  CHECK_EQ(landmark_observers_.count(landmark_id), 0u);
+}
+
+void CovisibilityGraph::clear() {
+  vertices_.clear();
+  landmark_observers_.clear();
+}
+
+bool CovisibilityGraph::isConsistentWithVertex(const Vertex& vertex) const {
+  std::unordered_map<pose_graph::VertexId, VertexEntry>::const_iterator it =
+      vertices_.find(vertex.id());
+  if (it == vertices_.end()) {
+    return false;
+  }
+  std::unordered_map<LandmarkId, size_t> landmark_observation_counts;
+  countLandmarkObservations(vertex, &landmark_observation_counts);
+  return landmark_observation_counts ==
+         it->second.landmark_observation_counts;
+}
+
+size_t CovisibilityGraph::getNumberOfCommonLandmarks(
+    const pose_graph::VertexId& vertex_id_1,
+    const pose_graph::VertexId& vertex_id_2) const {
+  const VertexEntry& entry = common::getChecked(vertices_, vertex_id_1);
+  std::unordered_map<pose_graph::VertexId, size_t>::const_iterator it =
+      entry.common_landmark_counts.find(vertex_id_2);
+  return (it == entry.common_landmark_counts.end()) ? 0u : it->second;
+}
+
+void CovisibilityGraph::getCoobserverVertices(
+    const pose_graph::VertexId& vertex_id,
+    const size_t min_number_common_landmarks, const size_t max_num_vertices,
+    VertexCountList* coobserver_vertices) const {
+  CHECK_NOTNULL(coobserver_vertices)->clear();
+  const VertexEntry& entry = common::getChecked(vertices_, vertex_id);
+
+  std::lock_guard<std::mutex> lock(sorting_mutex_);
+  if (!entry.are_sorted_coobservers_valid) {
+    entry.sorted_coobservers.assign(
+        entry.common_landmark_counts.begin(),
+        entry.common_landmark_counts.end());
+    std::sort(
+        entry.sorted_coobservers.begin(), entry.sorted_coobservers.end(),
+        [](const VertexCount& lhs, const VertexCount& rhs) {
+          return (lhs.second != rhs.second) ? lhs.second > rhs.second
+                                            : lhs.first < rhs.first;
+        });
+    entry.are_sorted_coobservers_valid = true;
+  }
+
+  for (const VertexCount& coobserver : entry.sorted_coobservers) {
+    if (coobserver_vertices->size() >= max_num_vertices ||
+        coobserver.second < min_number_common_landmarks) {
+      break;
+    }
+    coobserver_vertices->emplace_back(coobserver);
+  }
+}
+
+void CovisibilityGraph::addObservations(
+    const pose_graph::VertexId& vertex_id, const LandmarkId& landmark_id,
+    const size_t num_observations) {
+  CHECK(vertex_id.isValid());
+  CHECK_GT(num_observations, 0u);
+  VertexEntry& entry = vertices_[vertex_id];
+  std::unordered_map<pose_graph::VertexId, size_t>& observers =
+      landmark_observers_[landmark_id];
+  const bool is_new_observer = observers.count(vertex_id) == 0u;
+
+  for (const std::pair<const pose_graph::VertexId, size_t>& observer :
+       observers) {
+    if (observer.first == vertex_id) {
+      continue;
+    }
+    VertexEntry& observer_entry = common::getChecked(vertices_, observer.first);
+    addToWeight(vertex_id, num_observations, &observer_entry);
+    if (is_new_observer) {
+      addToWeight(observer.first, observer.second, &entry);
+    }
+  }
+  addToWeight(vertex_id, num_observations, &entry);
+
+  observers[vertex_id] += num_observations;
+  entry.landmark_observation_counts[landmark_id] += num_observations;
+}
+
+void CovisibilityGraph::removeObservations(
+    const pose_graph::VertexId& vertex_id, const LandmarkId& landmark_id,
+    const size_t num_observations) {
+  CHECK_GT(num_observations, 0u);
+  std::unordered_map<
+      LandmarkId, std::unordered_map<pose_graph::VertexId, size_t>>::iterator
+      landmark_it = landmark_observers_.find(landmark_id);
+  CHECK(landmark_it != landmark_observers_.end())
+      << "Landmark " << landmark_id << " is not in the covisibility graph.";
+  std::unordered_map<pose_graph::VertexId, size_t>& observers =
+      landmark_it->second;
+  std::unordered_map<pose_graph::VertexId, size_t>::iterator observer_it =
+      observers.find(vertex_id);
+  CHECK(observer_it != observers.end())
+      << "Vertex " << vertex_id << " does not observe landmark "
+      << landmark_id << ".";
+  CHECK_GE(observer_it->second, num_observations);
+  const size_t num_remaining_observations =
+      observer_it->second - num_observations;
+
+  VertexEntry& entry = common::getChecked(vertices_, vertex_id);
+  for (const std::pair<const pose_graph::VertexId, size_t>& observer :
+       observers) {
+    if (observer.first == vertex_id) {
+      continue;
+    }
+    VertexEntry& observer_entry = common::getChecked(vertices_, observer.first);
+    subtractFromWeight(vertex_id, num_observations, &observer_entry);
+    if (num_remaining_observations == 0u) {
+      subtractFromWeight(observer.first, observer.second, &entry);
+    }
+  }
+  subtractFromWeight(vertex_id, num_observations, &entry);
+
+  if (num_remaining_observations == 0u) {
+    observers.erase(observer_it);
+    entry.landmark_observation_counts.erase(landmark_id);
+    if (observers.empty()) {
+      landmark_observers_.erase(landmark_it);
+    }
+  } else {
+    observer_it->second = num_remaining_observations;
+    entry.landmark_observation_counts[landmark_id] =
+        num_remaining_observations;
+  }
+}
+
+void CovisibilityGraph::addToWeight(
+    const pose_graph::VertexId& vertex_id, const size_t value,
+    VertexEntry* entry) {
+  CHECK_NOTNULL(entry);
+  entry->common_landmark_counts[vertex_id] += value;
+  entry->are_sorted_coobservers_valid = false;
+}
+
+void CovisibilityGraph::subtractFromWeight(
+    const pose_graph::VertexId& vertex_id, const size_t value,
+    VertexEntry* entry) {
+  CHECK_NOTNULL(entry);
+  std::unordered_map<pose_graph::VertexId, size_t>::iterator it =
+      entry->common_landmark_counts.find(vertex_id);
+  CHECK(it != entry->common_landmark_counts.end());
+  CHECK_GE(it->second, value);
+  it->second -= value;
+  if (it->second == 0u) {
+    entry->common_landmark_counts.erase(it);
+  }
+  entry->are_sorted_coobservers_valid = false;
+}
+
+}  // namespace vi_map
@@ -1,5 +1,6 @@
 #include "vi-map/landmark-quality-metrics.h"
 
+#include <functional>
 #include <limits>
 #include <vector>
 
@@ -214,4 +215,23 @@ bool isLiDARLandmarkWellConstrained(
   return true;
 }
 
+size_t getLandmarkQualityParametersHash() {
+  const std::hash<double> hasher;
+  const std::vector<double> parameters = {
+      static_cast<double>(FLAGS_elq_min_observers),
+      FLAGS_elq_min_observation_angle_deg,
+      FLAGS_elq_max_distance_from_closest_observer,
+      FLAGS_elq_min_distance_from_closest_observer,
+      FLAGS_elq_max_reprojection_error_px,
+      static_cast<double>(FLAGS_elq_lidar_min_observers),
+      FLAGS_elq_lidar_max_distance_from_closest_observer,
+      FLAGS_elq_lidar_min_distance_from_closest_observer,
+      FLAGS_elq_lidar_max_observation_error_m};
+  size_t seed = 0u;
+  for (const double parameter : parameters) {
+    seed ^= hasher(parameter) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+  }
+  return seed;
+}
+
 }  // namespace vi_map
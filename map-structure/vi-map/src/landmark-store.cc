@@ -1,5 +1,7 @@
 #include <vi-map/landmark-store.h>
 
+#include <utility>
+
 #include <glog/logging.h>
 
 namespace vi_map {
@@ -67,6 +69,30 @@ void LandmarkStore::removeLandmark(const LandmarkId& landmark_id) {
   CHECK_EQ(landmarks_.size(), landmark_id_map_.size());
 }
 
+void LandmarkStore::removeLandmarks(const LandmarkIdSet& landmark_ids) {
+  if (landmark_ids.empty()) {
+    return;
+  }
+  size_t num_kept_landmarks = 0u;
+  for (size_t idx = 0u; idx < landmarks_.size(); ++idx) {
+    const LandmarkId& landmark_id = landmarks_[idx].id();
+    if (landmark_ids.count(landmark_id) > 0u) {
+      landmark_id_map_.erase(landmark_id);
+      continue;
+    }
+    if (num_kept_landmarks != idx) {
+      landmarks_[num_kept_landmarks] = std::move(landmarks_[idx]);
+      landmark_id_map_[landmarks_[num_kept_landmarks].id()] =
+          num_kept_landmarks;
+    }
+    ++num_kept_landmarks;
+  }
+  CHECK_EQ(landmarks_.size() - num_kept_landmarks, landmark_ids.size())
+      << "Tried to remove landmarks that are not in the store!";
+  landmarks_.resize(num_kept_landmarks);
+  CHECK_EQ(landmarks_.size(), landmark_id_map_.size());
+}
+
 void LandmarkStore::serialize(vi_map::proto::LandmarkStore* proto) const {
   CHECK_NOTNULL(proto);
 
@@ -721,15 +721,45 @@ size_t Vertex::discardUntrackedObservations() {
   for (size_t i = 0u; i < num_frames; ++i) {
     const size_t original_count =
         getVisualFrame(i).getNumKeypointMeasurements();
+    CHECK_EQ(original_count, observed_landmark_ids_[i].size());
     std::vector<size_t> discarded_indices;
     getVisualFrame(i).discardUntrackedObservations(&discarded_indices);
-    aslam::common::stl_helpers::eraseIndicesFromContainer(
-        discarded_indices, original_count, &observed_landmark_ids_[i]);
+    eraseObservedLandmarkIdsOfFrame(i, discarded_indices, original_count);
     num_removed += discarded_indices.size();
   }
   return num_removed;
 }
 
+void Vertex::discardKeypointsOfFrame(
+    const size_t frame_idx, const std::vector<size_t>& ordered_indices) {
+  CHECK_LT(frame_idx, observed_landmark_ids_.size());
+  if (ordered_indices.empty()) {
+    return;
+  }
+  aslam::VisualFrame& frame = getVisualFrame(frame_idx);
+  const size_t original_count = frame.getNumKeypointMeasurements();
+  CHECK_EQ(original_count, observed_landmark_ids_[frame_idx].size());
+  frame.discardKeypoints(ordered_indices);
+  eraseObservedLandmarkIdsOfFrame(frame_idx, ordered_indices, original_count);
+}
+
+void Vertex::eraseObservedLandmarkIdsOfFrame(
+    const size_t frame_idx, const std::vector<size_t>& ordered_indices,
+    const size_t original_count) {
+  CHECK_LT(frame_idx, observed_landmark_ids_.size());
+  if (ordered_indices.empty()) {
+    return;
+  }
+  LandmarkIdList& landmark_ids = observed_landmark_ids_[frame_idx];
+  if (ordered_indices.size() == original_count) {
+    LandmarkIdList().swap(landmark_ids);
+  } else {
+    aslam::common::stl_helpers::eraseIndicesFromContainer(
+        ordered_indices, original_count, &landmark_ids);
+    landmark_ids.shrink_to_fit();
+  }
+}
+
 void Vertex::updateIdInObservedLandmarkIdList(
     const LandmarkId& old_landmark_id, const LandmarkId& new_landmark_id) {
   CHECK(old_landmark_id.isValid());
@@ -747,6 +777,28 @@ void Vertex::updateIdInObservedLandmarkIdList(
   }
 }
 
+size_t Vertex::updateIdsInObservedLandmarkIdList(
+    const std::unordered_map<LandmarkId, LandmarkId>& old_to_new_landmark_ids) {
+  if (old_to_new_landmark_ids.empty()) {
+    return 0u;
+  }
+  size_t num_updated_ids = 0u;
+  for (LandmarkIdList& landmark_ids : observed_landmark_ids_) {
+    for (LandmarkId& landmark_id : landmark_ids) {
+      if (!landmark_id.isValid()) {
+        continue;
+      }
+      const std::unordered_map<LandmarkId, LandmarkId>::const_iterator it =
+          old_to_new_landmark_ids.find(landmark_id);
+      if (it != old_to_new_landmark_ids.end()) {
+        landmark_id = it->second;
+        ++num_updated_ids;
+      }
+    }
+  }
+  return num_updated_ids;
+}
+
 void Vertex::checkConsistencyOfVisualObservationContainers() const {
   CHECK_EQ(n_frame_->getNumFrames(), observed_landmark_ids_.size());
   CHECK_EQ(n_frame_->getNumFrames(), n_frame_->getNumCameras());
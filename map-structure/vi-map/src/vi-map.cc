@@ -5,6 +5,10 @@
 #include <limits>
 #include <map-resources/resource_metadata.pb.h>
 #include <maplab-common/file-system-tools.h>
+#include <maplab-common/parallel-process.h>
+#include <maplab-common/threading-helpers.h>
+#include <maplab-common/union-find.h>
+#include <mutex>
 #include <queue>
 
 #include "vi-map/sensor-manager.h"
@@ -47,6 +51,8 @@ void VIMap::deepCopy(const VIMap& other) {
 
 bool VIMap::mergeAllMissionsFromMapWithoutResources(
     const vi_map::VIMap& other) {
+  invalidateCovisibilityGraph();
+
   // Get all missions from old map and add them into the new map.
   vi_map::MissionIdList other_mission_ids;
   other.getAllMissionIds(&other_mission_ids);
@@ -184,6 +190,8 @@ void VIMap::swap(VIMap* other) {
   mission_base_frames.swap(other->mission_base_frames);
   landmark_index.swap(&other->landmark_index);
   sensor_manager_.swap(&other->sensor_manager_);
+  invalidateCovisibilityGraph();
+  other->invalidateCovisibilityGraph();
 }
 
 bool VIMap::hexStringToMissionIdIfValid(
@@ -420,41 +428,99 @@ void VIMap::getStatisticsOfMission(
   getAllVertexIdsInMissionAlongGraph(mission_id, &vertex_ids);
   *num_vertices = vertex_ids.size();
 
-  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
-    const vi_map::Vertex& vertex = getVertex(vertex_id);
-    //*num_landmarks += vertex.getLandmarks().size();
-    for (const vi_map::Landmark& landmark : vertex.getLandmarks()) {
-      const KeypointIdentifierList& observations = landmark.getObservations();
-      if (!observations.empty()) {
-        const size_t frame_idx = observations.front().frame_id.frame_index;
-        CHECK_LT(frame_idx, num_cameras);
-
-        const int feature_type = static_cast<int>(landmark.getFeatureType());
-
-        if (landmark.getQuality() == vi_map::Landmark::Quality::kUnknown) {
-          ++((*num_unknown_landmarks_per_camera)[frame_idx][feature_type]);
-        } else if (landmark.getQuality() == vi_map::Landmark::Quality::kBad) {
-          ++((*num_bad_landmarks_per_camera)[frame_idx][feature_type]);
-        } else if (landmark.getQuality() == vi_map::Landmark::Quality::kGood) {
-          ++((*num_good_landmarks_per_camera)[frame_idx][feature_type]);
-        }
+  // Single pass over all vertices, every thread accumulates into its own
+  // zero-initialized counters which are reduced once the thread is done.
+  const std::vector<std::map<int, size_t>> zero_landmarks_per_camera =
+      *total_num_landmarks_per_camera;
+  const std::map<int, size_t> zero_observations = *num_observations;
+  std::mutex reducer_mutex;
+  std::function<void(const std::vector<size_t>&)> accumulator =
+      [&](const std::vector<size_t>& batch) {
+        std::vector<std::map<int, size_t>> thread_num_good_landmarks =
+            zero_landmarks_per_camera;
+        std::vector<std::map<int, size_t>> thread_num_bad_landmarks =
+            zero_landmarks_per_camera;
+        std::vector<std::map<int, size_t>> thread_num_unknown_landmarks =
+            zero_landmarks_per_camera;
+        std::vector<std::map<int, size_t>> thread_total_num_landmarks =
+            zero_landmarks_per_camera;
+        std::map<int, size_t> thread_num_observations = zero_observations;
+
+        for (const size_t idx : batch) {
+          const vi_map::Vertex& vertex = getVertex(vertex_ids[idx]);
+          for (const vi_map::Landmark& landmark : vertex.getLandmarks()) {
+            const KeypointIdentifierList& observations =
+                landmark.getObservations();
+            if (observations.empty()) {
+              continue;
+            }
+            const size_t frame_idx = observations.front().frame_id.frame_index;
+            CHECK_LT(frame_idx, num_cameras);
+
+            const int feature_type =
+                static_cast<int>(landmark.getFeatureType());
+
+            const vi_map::Landmark::Quality quality = landmark.getQuality();
+            if (quality == vi_map::Landmark::Quality::kUnknown) {
+              ++thread_num_unknown_landmarks[frame_idx][feature_type];
+            } else if (quality == vi_map::Landmark::Quality::kBad) {
+              ++thread_num_bad_landmarks[frame_idx][feature_type];
+            } else if (quality == vi_map::Landmark::Quality::kGood) {
+              ++thread_num_good_landmarks[frame_idx][feature_type];
+            }
 
-        ++((*total_num_landmarks_per_camera)[frame_idx][feature_type]);
-      }
-    }
+            ++thread_total_num_landmarks[frame_idx][feature_type];
+          }
 
-    const unsigned int num_frames = vertex.numFrames();
-    for (unsigned int frame_idx = 0; frame_idx < num_frames; ++frame_idx) {
-      if (vertex.isVisualFrameSet(frame_idx) &&
-          vertex.isVisualFrameValid(frame_idx)) {
-        for (const FeatureType& feature_type_ : feature_types) {
-          const int feature_type = static_cast<int>(feature_type_);
-          (*num_observations)[feature_type] +=
-              vertex.getVisualFrame(frame_idx).getNumKeypointMeasurementsOfType(
-                  feature_type);
+          const unsigned int num_frames = vertex.numFrames();
+          for (unsigned int frame_idx = 0; frame_idx < num_frames;
+               ++frame_idx) {
+            if (vertex.isVisualFrameSet(frame_idx) &&
+                vertex.isVisualFrameValid(frame_idx)) {
+              const aslam::VisualFrame& frame =
+                  vertex.getVisualFrame(frame_idx);
+              for (const FeatureType& feature_type_ : feature_types) {
+                const int feature_type = static_cast<int>(feature_type_);
+                thread_num_observations[feature_type] +=
+                    frame.getNumKeypointMeasurementsOfType(feature_type);
+              }
+            }
+          }
         }
-      }
-    }
+
+        std::lock_guard<std::mutex> lock(reducer_mutex);
+        for (size_t frame_idx = 0; frame_idx < num_cameras; ++frame_idx) {
+          for (const std::pair<const int, size_t>& count :
+               thread_num_good_landmarks[frame_idx]) {
+            (*num_good_landmarks_per_camera)[frame_idx][count.first] +=
+                count.second;
+          }
+          for (const std::pair<const int, size_t>& count :
+               thread_num_bad_landmarks[frame_idx]) {
+            (*num_bad_landmarks_per_camera)[frame_idx][count.first] +=
+                count.second;
+          }
+          for (const std::pair<const int, size_t>& count :
+               thread_num_unknown_landmarks[frame_idx]) {
+            (*num_unknown_landmarks_per_camera)[frame_idx][count.first] +=
+                count.second;
+          }
+          for (const std::pair<const int, size_t>& count :
+               thread_total_num_landmarks[frame_idx]) {
+            (*total_num_landmarks_per_camera)[frame_idx][count.first] +=
+                count.second;
+          }
+        }
+        for (const std::pair<const int, size_t>& count :
+             thread_num_observations) {
+          (*num_observations)[count.first] += count.second;
+        }
+      };
+  if (!vertex_ids.empty()) {
+    constexpr bool kAlwaysParallelize = false;
+    const size_t num_threads = common::getNumHardwareThreads();
+    common::ParallelProcess(
+        vertex_ids.size(), accumulator, kAlwaysParallelize, num_threads);
   }
 
   for (const FeatureType& feature_type_ : feature_types) {
@@ -1305,6 +1371,9 @@ void VIMap::associateKeypointWithExistingLandmark(
 
   // Update vertex.
   vertex.setObservedLandmarkId(frame_index, keypoint_index, landmark_id);
+  if (covisibility_graph_ && !existing_id.isValid()) {
+    covisibility_graph_->addObservation(keypoint_vertex_id, landmark_id);
+  }
 
   // Update landmark.
   vi_map::Landmark& landmark = getLandmark(landmark_id);
@@ -1533,9 +1602,445 @@ void VIMap::mergeNeighboringVertices(
     }
   }
   // Remove the vertex.
+  if (covisibility_graph_) {
+    covisibility_graph_->removeVertex(vertex_to_merge);
+  }
   posegraph.removeVertex(vertex_to_merge);
 }
 
+namespace {
+// Everything that is needed to remove the vertices between two consecutive
+// keyframes. It is prepared without modifying the map, such that the
+// intervals of all missions can be prepared in parallel.
+struct KeyframeInterval {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  pose_graph::VertexId keyframe_id;
+  pose_graph::VertexIdList vertex_ids_to_remove;
+  pose_graph::VertexId next_keyframe_id;
+
+  // Composed edges from the keyframe to the next keyframe.
+  bool merge_viwls_edges = false;
+  Eigen::Matrix<int64_t, 1, Eigen::Dynamic> imu_timestamps;
+  Eigen::Matrix<double, 6, Eigen::Dynamic> imu_data;
+  struct ComposedTransformationEdge {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    pose_graph::Edge::EdgeType edge_type;
+    pose::Transformation T_A_B;
+    aslam::TransformationCovariance T_A_B_covariance_p_q;
+    aslam::SensorId sensor_id;
+  };
+  Aligned<std::vector, ComposedTransformationEdge> transformation_edges;
+
+  // Landmarks stored in the removed vertices, in the order in which they are
+  // moved to the keyframe, with their position in the keyframe frame.
+  LandmarkIdList landmark_ids_to_move;
+  Aligned<std::vector, pose::Position3D> p_B_of_landmarks_to_move;
+
+  // All landmarks observed by the removed vertices, with duplicates.
+  LandmarkIdList observed_landmark_ids;
+};
+typedef Aligned<std::vector, KeyframeInterval> KeyframeIntervalList;
+
+// Returns the chain of edges of the given type from the keyframe through all
+// vertices in the list. Returns false if one of the vertices has no incoming
+// edge of this type.
+bool getEdgeChainOfType(
+    const VIMap& map, const pose_graph::VertexId& keyframe_id,
+    const pose_graph::VertexIdList& vertex_ids,
+    const pose_graph::Edge::EdgeType edge_type,
+    pose_graph::EdgeIdList* edge_ids) {
+  CHECK_NOTNULL(edge_ids)->clear();
+  edge_ids->reserve(vertex_ids.size());
+  pose_graph::EdgeIdSet incoming_edge_ids;
+  pose_graph::VertexId previous_vertex_id = keyframe_id;
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    map.getVertex(vertex_id).getIncomingEdges(&incoming_edge_ids);
+    size_t num_incoming_edges_of_type = 0u;
+    for (const pose_graph::EdgeId& incoming_edge_id : incoming_edge_ids) {
+      if (map.getEdgeType(incoming_edge_id) == edge_type) {
+        if (num_incoming_edges_of_type == 0u) {
+          edge_ids->emplace_back(incoming_edge_id);
+        }
+        ++num_incoming_edges_of_type;
+      }
+    }
+    if (num_incoming_edges_of_type == 0u) {
+      return false;
+    }
+    CHECK_EQ(num_incoming_edges_of_type, 1u)
+        << "A vertex must have at most one incoming edge of type "
+        << pose_graph::Edge::edgeTypeToString(edge_type);
+    CHECK_EQ(
+        map.getEdgeAs<pose_graph::Edge>(edge_ids->back()).from(),
+        previous_vertex_id);
+    previous_vertex_id = vertex_id;
+  }
+  return true;
+}
+
+// Concatenates the IMU data of the chain of edges, dropping the measurement
+// that two neighboring edges share, as PoseGraph::mergeNeighboringEdges does.
+void concatenateImuData(
+    const VIMap& map, const pose_graph::EdgeIdList& edge_ids,
+    Eigen::Matrix<int64_t, 1, Eigen::Dynamic>* imu_timestamps,
+    Eigen::Matrix<double, 6, Eigen::Dynamic>* imu_data) {
+  CHECK_NOTNULL(imu_timestamps);
+  CHECK_NOTNULL(imu_data);
+  CHECK(!edge_ids.empty());
+
+  int num_imu_measurements = 0;
+  for (size_t idx = 0u; idx < edge_ids.size(); ++idx) {
+    const ViwlsEdge& edge = map.getEdgeAs<ViwlsEdge>(edge_ids[idx]);
+    const int num_edge_measurements = edge.getImuTimestamps().cols();
+    CHECK_EQ(num_edge_measurements, edge.getImuData().cols());
+    if (idx + 1u < edge_ids.size()) {
+      CHECK_GT(num_edge_measurements, 0)
+          << "Cannot concatenate the empty IMU data of edge " << edge.id()
+          << ".";
+      num_imu_measurements += num_edge_measurements - 1;
+    } else {
+      num_imu_measurements += num_edge_measurements;
+    }
+  }
+  imu_timestamps->resize(Eigen::NoChange, num_imu_measurements);
+  imu_data->resize(Eigen::NoChange, num_imu_measurements);
+
+  int column = 0;
+  for (size_t idx = 0u; idx < edge_ids.size(); ++idx) {
+    const ViwlsEdge& edge = map.getEdgeAs<ViwlsEdge>(edge_ids[idx]);
+    const int num_columns_to_copy = (idx + 1u < edge_ids.size())
+                                        ? edge.getImuTimestamps().cols() - 1
+                                        : edge.getImuTimestamps().cols();
+    imu_timestamps->middleCols(column, num_columns_to_copy) =
+        edge.getImuTimestamps().leftCols(num_columns_to_copy);
+    imu_data->middleCols(column, num_columns_to_copy) =
+        edge.getImuData().leftCols(num_columns_to_copy);
+    column += num_columns_to_copy;
+  }
+  CHECK_EQ(column, num_imu_measurements);
+}
+
+// Composes the chain of transformation edges in the same order as
+// PoseGraph::mergeNeighboringEdges does, keeping the covariance of the first
+// edge.
+void composeTransformationEdges(
+    const VIMap& map, const pose_graph::EdgeIdList& edge_ids,
+    KeyframeInterval::ComposedTransformationEdge* composed_edge) {
+  CHECK_NOTNULL(composed_edge);
+  CHECK(!edge_ids.empty());
+  const TransformationEdge& first_edge =
+      map.getEdgeAs<TransformationEdge>(edge_ids.front());
+  composed_edge->edge_type = first_edge.getType();
+  composed_edge->T_A_B = first_edge.get_T_A_B();
+  composed_edge->T_A_B_covariance_p_q = first_edge.get_T_A_B_Covariance_p_q();
+  composed_edge->sensor_id = first_edge.getSensorId();
+  for (size_t idx = 1u; idx < edge_ids.size(); ++idx) {
+    const TransformationEdge& edge =
+        map.getEdgeAs<TransformationEdge>(edge_ids[idx]);
+    CHECK_EQ(composed_edge->sensor_id, edge.getSensorId());
+    CHECK(composed_edge->edge_type == edge.getType());
+    composed_edge->T_A_B = composed_edge->T_A_B * edge.get_T_A_B();
+  }
+}
+
+void prepareKeyframeInterval(
+    const VIMap& map, const pose_graph::VertexId& keyframe_id,
+    const pose_graph::VertexId& next_keyframe_id,
+    KeyframeInterval* interval) {
+  CHECK_NOTNULL(interval);
+  CHECK(keyframe_id.isValid());
+  CHECK(next_keyframe_id.isValid());
+  interval->keyframe_id = keyframe_id;
+  interval->next_keyframe_id = next_keyframe_id;
+
+  // All vertices after the keyframe up to and including the next keyframe.
+  pose_graph::VertexIdList vertex_ids_after_keyframe;
+  pose_graph::VertexId current_vertex_id = keyframe_id;
+  do {
+    CHECK(map.getNextVertex(current_vertex_id, &current_vertex_id))
+        << "Cannot merge vertice ids " << keyframe_id << " and "
+        << next_keyframe_id
+        << " since no traversable path between them in the graph was found!";
+    CHECK(current_vertex_id.isValid());
+    vertex_ids_after_keyframe.emplace_back(current_vertex_id);
+  } while (current_vertex_id != next_keyframe_id);
+  interval->vertex_ids_to_remove.assign(
+      vertex_ids_after_keyframe.begin(), vertex_ids_after_keyframe.end() - 1);
+  if (interval->vertex_ids_to_remove.empty()) {
+    return;
+  }
+
+  // An edge type is only merged if every vertex has an incoming edge of this
+  // type, the chain of these edges is composed into one edge.
+  const Mission::BackBone backbone_type =
+      map.getMissionForVertex(keyframe_id).backboneType();
+  pose_graph::EdgeIdList edge_ids;
+  interval->merge_viwls_edges = getEdgeChainOfType(
+      map, keyframe_id, vertex_ids_after_keyframe,
+      pose_graph::Edge::EdgeType::kViwls, &edge_ids);
+  CHECK(
+      backbone_type != Mission::BackBone::kViwls ||
+      interval->merge_viwls_edges);
+  if (interval->merge_viwls_edges) {
+    concatenateImuData(
+        map, edge_ids, &interval->imu_timestamps, &interval->imu_data);
+  }
+  for (const pose_graph::Edge::EdgeType edge_type :
+       {pose_graph::Edge::EdgeType::kOdometry,
+        pose_graph::Edge::EdgeType::kWheelOdometry}) {
+    const bool merge_edges = getEdgeChainOfType(
+        map, keyframe_id, vertex_ids_after_keyframe, edge_type, &edge_ids);
+    CHECK(
+        !(backbone_type == Mission::BackBone::kOdometry &&
+          edge_type == pose_graph::Edge::EdgeType::kOdometry) ||
+        merge_edges);
+    CHECK(
+        !(backbone_type == Mission::BackBone::kWheelOdometry &&
+          edge_type == pose_graph::Edge::EdgeType::kWheelOdometry) ||
+        merge_edges);
+    if (merge_edges) {
+      interval->transformation_edges.emplace_back();
+      composeTransformationEdges(
+          map, edge_ids, &interval->transformation_edges.back());
+    }
+  }
+
+  // Express the stored landmarks in the keyframe frame, in the same way as
+  // VIMap::moveLandmarksToOtherVertex does.
+  const pose::Transformation T_I_M =
+      map.getVertex(keyframe_id).get_T_M_I().inverse();
+  const MissionBaseFrame& mission_baseframe =
+      map.getMissionBaseFrameForVertex(keyframe_id);
+  for (const pose_graph::VertexId& vertex_id : interval->vertex_ids_to_remove) {
+    const Vertex& vertex = map.getVertex(vertex_id);
+    for (const Landmark& landmark : vertex.getLandmarks()) {
+      const Eigen::Vector3d p_G_fi = map.getLandmark_G_p_fi(landmark.id());
+      const Eigen::Vector3d p_M_fi =
+          mission_baseframe.transformPointInGlobalFrameToMissionFrame(p_G_fi);
+      interval->landmark_ids_to_move.emplace_back(landmark.id());
+      interval->p_B_of_landmarks_to_move.emplace_back(T_I_M * p_M_fi);
+    }
+
+    for (unsigned int frame_idx = 0u; frame_idx < vertex.numFrames();
+         ++frame_idx) {
+      if (!vertex.isVisualFrameSet(frame_idx)) {
+        continue;
+      }
+      for (const LandmarkId& landmark_id :
+           vertex.getFrameObservedLandmarkIds(frame_idx)) {
+        if (landmark_id.isValid()) {
+          interval->observed_landmark_ids.emplace_back(landmark_id);
+        }
+      }
+    }
+  }
+}
+}  // namespace
+
+size_t VIMap::removeVerticesBetweenKeyframes(
+    const std::vector<pose_graph::VertexIdList>& keyframe_ids_per_mission) {
+  const size_t num_threads = common::getNumHardwareThreads();
+  constexpr bool kAlwaysParallelize = false;
+
+  // Prepare the keyframe intervals of all missions in parallel. A map
+  // usually has only a few missions but many intervals per mission.
+  std::vector<KeyframeIntervalList> intervals_per_mission(
+      keyframe_ids_per_mission.size());
+  std::vector<MissionId> mission_ids(keyframe_ids_per_mission.size());
+  std::vector<std::pair<size_t, size_t>> mission_and_interval_indices;
+  for (size_t mission_idx = 0u; mission_idx < keyframe_ids_per_mission.size();
+       ++mission_idx) {
+    const pose_graph::VertexIdList& keyframe_ids =
+        keyframe_ids_per_mission[mission_idx];
+    if (keyframe_ids.size() < 2u) {
+      continue;
+    }
+    mission_ids[mission_idx] = getMissionIdForVertex(keyframe_ids.front());
+    intervals_per_mission[mission_idx].resize(keyframe_ids.size() - 1u);
+    for (size_t interval_idx = 0u; interval_idx < keyframe_ids.size() - 1u;
+         ++interval_idx) {
+      mission_and_interval_indices.emplace_back(mission_idx, interval_idx);
+    }
+  }
+  std::function<void(const std::vector<size_t>&)> prepare_function =
+      [&](const std::vector<size_t>& batch) {
+        for (const size_t idx : batch) {
+          const size_t mission_idx = mission_and_interval_indices[idx].first;
+          const size_t interval_idx = mission_and_interval_indices[idx].second;
+          const pose_graph::VertexIdList& keyframe_ids =
+              keyframe_ids_per_mission[mission_idx];
+          CHECK_EQ(
+              mission_ids[mission_idx],
+              getMissionIdForVertex(keyframe_ids[interval_idx + 1u]))
+              << "All keyframes of a list must be of the same mission.";
+          prepareKeyframeInterval(
+              *this, keyframe_ids[interval_idx],
+              keyframe_ids[interval_idx + 1u],
+              &intervals_per_mission[mission_idx][interval_idx]);
+        }
+      };
+  if (!mission_and_interval_indices.empty()) {
+    common::ParallelProcess(
+        mission_and_interval_indices.size(), prepare_function,
+        kAlwaysParallelize, num_threads);
+  }
+
+  pose_graph::VertexIdSet vertex_ids_to_remove;
+  LandmarkIdSet observed_landmark_ids;
+  for (const KeyframeIntervalList& intervals : intervals_per_mission) {
+    for (const KeyframeInterval& interval : intervals) {
+      for (const pose_graph::VertexId& vertex_id :
+           interval.vertex_ids_to_remove) {
+        CHECK(vertex_ids_to_remove.emplace(vertex_id).second)
+            << "Vertex " << vertex_id << " is part of more than one keyframe "
+            << "interval.";
+      }
+      observed_landmark_ids.insert(
+          interval.observed_landmark_ids.begin(),
+          interval.observed_landmark_ids.end());
+    }
+  }
+  if (vertex_ids_to_remove.empty()) {
+    return 0u;
+  }
+
+  // Landmarks that are only observed by removed vertices are removed, all
+  // other landmarks observed by removed vertices lose these observations.
+  // Every landmark is only touched by one thread.
+  const LandmarkIdList observed_landmark_id_list(
+      observed_landmark_ids.begin(), observed_landmark_ids.end());
+  std::vector<unsigned char> is_landmark_removed(
+      observed_landmark_id_list.size(), 0u);
+  const std::function<bool(const KeypointIdentifier&)>  // NOLINT
+      is_observation_of_removed_vertex =
+          [&vertex_ids_to_remove](const KeypointIdentifier& observation) {
+            return vertex_ids_to_remove.count(observation.frame_id.vertex_id) >
+                   0u;
+          };
+  std::function<void(const std::vector<size_t>&)> observations_function =
+      [&](const std::vector<size_t>& batch) {
+        for (const size_t idx : batch) {
+          Landmark& landmark = getLandmark(observed_landmark_id_list[idx]);
+          bool has_remaining_observer = false;
+          for (const KeypointIdentifier& observation :
+               landmark.getObservations()) {
+            if (!is_observation_of_removed_vertex(observation)) {
+              has_remaining_observer = true;
+              break;
+            }
+          }
+          if (has_remaining_observer) {
+            landmark.removeAllObservationsAccordingToPredicate(
+                is_observation_of_removed_vertex);
+          } else {
+            is_landmark_removed[idx] = 1u;
+          }
+        }
+      };
+  if (!observed_landmark_id_list.empty()) {
+    common::ParallelProcess(
+        observed_landmark_id_list.size(), observations_function,
+        kAlwaysParallelize, num_threads);
+  }
+
+  LandmarkIdList removed_landmark_ids;
+  LandmarkIdSet removed_landmark_id_set;
+  std::unordered_map<pose_graph::VertexId, LandmarkIdSet>
+      removed_landmark_ids_per_storing_vertex;
+  for (size_t idx = 0u; idx < observed_landmark_id_list.size(); ++idx) {
+    if (is_landmark_removed[idx] == 0u) {
+      continue;
+    }
+    const LandmarkId& landmark_id = observed_landmark_id_list[idx];
+    removed_landmark_ids.emplace_back(landmark_id);
+    removed_landmark_id_set.emplace(landmark_id);
+    const pose_graph::VertexId& storing_vertex_id =
+        landmark_index.getStoringVertexId(landmark_id);
+    // Landmarks stored in removed vertices are removed with the vertex.
+    if (vertex_ids_to_remove.count(storing_vertex_id) == 0u) {
+      removed_landmark_ids_per_storing_vertex[storing_vertex_id].emplace(
+          landmark_id);
+    }
+  }
+
+  // Move the remaining landmarks of the removed vertices to the keyframes,
+  // in the order in which the vertices are removed.
+  for (const KeyframeIntervalList& intervals : intervals_per_mission) {
+    for (const KeyframeInterval& interval : intervals) {
+      LandmarkStore& keyframe_landmark_store =
+          getVertex(interval.keyframe_id).getLandmarks();
+      for (size_t idx = 0u; idx < interval.landmark_ids_to_move.size();
+           ++idx) {
+        const LandmarkId& landmark_id = interval.landmark_ids_to_move[idx];
+        if (removed_landmark_id_set.count(landmark_id) > 0u) {
+          continue;
+        }
+        CHECK(!keyframe_landmark_store.hasLandmark(landmark_id));
+        keyframe_landmark_store.addLandmark(getLandmark(landmark_id));
+        keyframe_landmark_store.getLandmark(landmark_id)
+            .set_p_B(interval.p_B_of_landmarks_to_move[idx]);
+        landmark_index.updateVertexOfLandmark(
+            landmark_id, interval.keyframe_id);
+      }
+    }
+  }
+  for (const std::pair<const pose_graph::VertexId, LandmarkIdSet>&
+           storing_vertex_and_landmarks :
+       removed_landmark_ids_per_storing_vertex) {
+    getVertex(storing_vertex_and_landmarks.first)
+        .getLandmarks()
+        .removeLandmarks(storing_vertex_and_landmarks.second);
+  }
+  landmark_index.removeLandmarks(removed_landmark_ids);
+
+  // Replace all edges of the removed vertices by the composed edges.
+  pose_graph::EdgeIdSet edge_ids_to_remove;
+  pose_graph::EdgeIdSet vertex_edge_ids;
+  for (const pose_graph::VertexId& vertex_id : vertex_ids_to_remove) {
+    const Vertex& vertex = getVertex(vertex_id);
+    vertex.getIncomingEdges(&vertex_edge_ids);
+    edge_ids_to_remove.insert(vertex_edge_ids.begin(), vertex_edge_ids.end());
+    vertex.getOutgoingEdges(&vertex_edge_ids);
+    edge_ids_to_remove.insert(vertex_edge_ids.begin(), vertex_edge_ids.end());
+  }
+  for (const pose_graph::EdgeId& edge_id : edge_ids_to_remove) {
+    posegraph.removeEdge(edge_id);
+  }
+  for (const KeyframeIntervalList& intervals : intervals_per_mission) {
+    for (const KeyframeInterval& interval : intervals) {
+      if (interval.vertex_ids_to_remove.empty()) {
+        continue;
+      }
+      pose_graph::EdgeId edge_id;
+      if (interval.merge_viwls_edges) {
+        aslam::generateId(&edge_id);
+        posegraph.addVIEdge(
+            edge_id, interval.keyframe_id, interval.next_keyframe_id,
+            interval.imu_timestamps, interval.imu_data);
+      }
+      for (const KeyframeInterval::ComposedTransformationEdge& edge :
+           interval.transformation_edges) {
+        aslam::generateId(&edge_id);
+        posegraph.addEdge(
+            aligned_unique<TransformationEdge>(
+                edge.edge_type, edge_id, interval.keyframe_id,
+                interval.next_keyframe_id, edge.T_A_B,
+                edge.T_A_B_covariance_p_q, edge.sensor_id));
+      }
+    }
+  }
+  for (const pose_graph::VertexId& vertex_id : vertex_ids_to_remove) {
+    posegraph.removeVertex(vertex_id);
+  }
+  invalidateCovisibilityGraph();
+
+  VLOG(1) << "Removed " << vertex_ids_to_remove.size()
+          << " vertices between keyframes and " << removed_landmark_ids.size()
+          << " landmarks that were only observed by them.";
+  return vertex_ids_to_remove.size();
+}
+
 void VIMap::mergeLandmarks(
     const vi_map::LandmarkId landmark_id_to_merge,
     const vi_map::LandmarkId& landmark_id_into) {
@@ -1585,6 +2090,9 @@ void VIMap::mergeLandmarks(
         vertex.updateIdInObservedLandmarkIdList(
             landmark_id_to_merge, landmark_id_into);
       });
+  if (covisibility_graph_) {
+    covisibility_graph_->mergeLandmarks(landmark_id_to_merge, landmark_id_into);
+  }
 
   // Remove landmark object stored in a vertex.
   landmark_vertex_to_merge.getLandmarks().removeLandmark(landmark_id_to_merge);
@@ -1598,9 +2106,161 @@ void VIMap::mergeLandmarks(
   CHECK_EQ(landmark_index_size_before - 1, landmark_index.numLandmarks());
 }
 
+size_t VIMap::mergeLandmarks(
+    const std::vector<std::pair<vi_map::LandmarkId, vi_map::LandmarkId>>&
+        landmark_ids_to_merge_into) {
+  // Group the landmarks, the representative of every group is the landmark
+  // that survives the merges.
+  common::UnionFind<vi_map::LandmarkId> landmark_groups;
+  landmark_groups.reserve(2u * landmark_ids_to_merge_into.size());
+  for (const std::pair<vi_map::LandmarkId, vi_map::LandmarkId>& merge :
+       landmark_ids_to_merge_into) {
+    CHECK(hasLandmark(merge.first));
+    CHECK(hasLandmark(merge.second));
+    landmark_groups.merge(merge.first, merge.second);
+  }
+
+  std::unordered_map<vi_map::LandmarkId, vi_map::LandmarkId>
+      merged_to_surviving_landmark_ids;
+  vi_map::LandmarkIdList merged_landmark_ids;
+  landmark_groups.forEachElement(
+      [&](const vi_map::LandmarkId& landmark_id,
+          const vi_map::LandmarkId& surviving_landmark_id) {
+        if (landmark_id != surviving_landmark_id) {
+          merged_to_surviving_landmark_ids.emplace(
+              landmark_id, surviving_landmark_id);
+          merged_landmark_ids.emplace_back(landmark_id);
+        }
+      });
+  if (merged_landmark_ids.empty()) {
+    return 0u;
+  }
+  const size_t landmark_index_size_before = landmark_index.numLandmarks();
+
+  // Move the observations to the surviving landmarks and collect the
+  // vertices that need to be updated.
+  std::unordered_set<pose_graph::VertexId> observer_vertex_ids;
+  std::unordered_map<pose_graph::VertexId, vi_map::LandmarkIdSet>
+      merged_landmark_ids_per_storing_vertex;
+  for (const vi_map::LandmarkId& landmark_id : merged_landmark_ids) {
+    const pose_graph::VertexId storing_vertex_id =
+        landmark_index.getStoringVertexId(landmark_id);
+    CHECK(hasVertex(storing_vertex_id));
+    merged_landmark_ids_per_storing_vertex[storing_vertex_id].emplace(
+        landmark_id);
+
+    const vi_map::Landmark& landmark_to_merge =
+        getVertex(storing_vertex_id).getLandmarks().getLandmark(landmark_id);
+    vi_map::Landmark& landmark_into =
+        getLandmark(merged_to_surviving_landmark_ids.at(landmark_id));
+    landmark_into.addObservations(landmark_to_merge.getObservations());
+
+    if (landmark_into.getQuality() != Landmark::Quality::kGood) {
+      if (landmark_to_merge.getQuality() == Landmark::Quality::kGood) {
+        landmark_into.setQuality(Landmark::Quality::kGood);
+      } else {
+        landmark_into.setQuality(Landmark::Quality::kUnknown);
+      }
+    }
+
+    landmark_to_merge.forEachObservation(
+        [&](const KeypointIdentifier& observation) {
+          observer_vertex_ids.emplace(observation.frame_id.vertex_id);
+        });
+  }
+
+  // Update the observed landmark ids, every vertex is only visited once.
+  const pose_graph::VertexIdList observer_vertex_id_list(
+      observer_vertex_ids.begin(), observer_vertex_ids.end());
+  std::function<void(const std::vector<size_t>&)> update_function =
+      [&](const std::vector<size_t>& batch) {
+        for (const size_t idx : batch) {
+          getVertex(observer_vertex_id_list[idx])
+              .updateIdsInObservedLandmarkIdList(
+                  merged_to_surviving_landmark_ids);
+        }
+      };
+  if (!observer_vertex_id_list.empty()) {
+    constexpr bool kAlwaysParallelize = false;
+    const size_t num_threads = common::getNumHardwareThreads();
+    common::ParallelProcess(
+        observer_vertex_id_list.size(), update_function, kAlwaysParallelize,
+        num_threads);
+  }
+  if (covisibility_graph_) {
+    for (const vi_map::LandmarkId& landmark_id : merged_landmark_ids) {
+      covisibility_graph_->mergeLandmarks(
+          landmark_id, merged_to_surviving_landmark_ids.at(landmark_id));
+    }
+  }
+
+  // Remove the merged landmarks from the stores and the index.
+  for (const std::pair<const pose_graph::VertexId, vi_map::LandmarkIdSet>&
+           storing_vertex_and_landmarks :
+       merged_landmark_ids_per_storing_vertex) {
+    getVertex(storing_vertex_and_landmarks.first)
+        .getLandmarks()
+        .removeLandmarks(storing_vertex_and_landmarks.second);
+  }
+  landmark_index.removeLandmarks(merged_landmark_ids);
+
+  CHECK_EQ(
+      landmark_index_size_before - merged_landmark_ids.size(),
+      landmark_index.numLandmarks());
+  return merged_landmark_ids.size();
+}
+
+const CovisibilityGraph& VIMap::getCovisibilityGraph() const {
+  std::lock_guard<std::mutex> lock(covisibility_graph_mutex_);
+  if (!covisibility_graph_) {
+    std::unique_ptr<CovisibilityGraph> covisibility_graph(
+        new CovisibilityGraph);
+    pose_graph::VertexIdList all_vertex_ids;
+    posegraph.getAllVertexIds(&all_vertex_ids);
+    for (const pose_graph::VertexId& vertex_id : all_vertex_ids) {
+      covisibility_graph->addVertex(
+          posegraph.getVertexPtr(vertex_id)->getAs<const vi_map::Vertex>());
+    }
+    VLOG(3) << "Built the covisibility graph of " << all_vertex_ids.size()
+            << " vertices and " << covisibility_graph->numLandmarks()
+            << " landmarks.";
+    covisibility_graph_ = std::move(covisibility_graph);
+  }
+  return *covisibility_graph_;
+}
+
+void VIMap::invalidateCovisibilityGraph() const {
+  std::lock_guard<std::mutex> lock(covisibility_graph_mutex_);
+  covisibility_graph_.reset();
+}
+
+bool VIMap::isCovisibilityGraphConsistent() const {
+  std::lock_guard<std::mutex> lock(covisibility_graph_mutex_);
+  if (!covisibility_graph_) {
+    return true;
+  }
+  pose_graph::VertexIdList all_vertex_ids;
+  posegraph.getAllVertexIds(&all_vertex_ids);
+  bool is_consistent =
+      covisibility_graph_->numVertices() == all_vertex_ids.size();
+  LOG_IF(ERROR, !is_consistent)
+      << "The covisibility graph has " << covisibility_graph_->numVertices()
+      << " vertices, but the map has " << all_vertex_ids.size() << ".";
+  for (const pose_graph::VertexId& vertex_id : all_vertex_ids) {
+    if (!covisibility_graph_->isConsistentWithVertex(
+            posegraph.getVertexPtr(vertex_id)->getAs<const vi_map::Vertex>())) {
+      LOG(ERROR) << "The covisibility graph is out of date for vertex "
+                 << vertex_id << ".";
+      is_consistent = false;
+    }
+  }
+  return is_consistent;
+}
+
 const vi_map::MissionId VIMap::duplicateMission(
     const vi_map::MissionId& source_mission_id) {
   CHECK(hasMission(source_mission_id));
+  invalidateCovisibilityGraph();
 
   const vi_map::VIMission& source_mission = getMission(source_mission_id);
   const vi_map::MissionBaseFrame& source_baseframe =
@@ -2110,6 +2770,7 @@ void VIMap::removeMission(
   // Delete all the vertices and edges in the mission.
   CHECK(mission_id.isValid());
   CHECK(hasMission(mission_id));
+  invalidateCovisibilityGraph();
 
   vi_map::VIMission& mission = getMission(mission_id);
   pose_graph::VertexIdList vertices;
@@ -2890,6 +3551,8 @@ size_t VIMap::getNumAbsolute6DoFMeasurementsInMission(
 
 bool VIMap::mergeAllSubmapsFromMapWithoutResources(
     const vi_map::VIMap& submap) {
+  invalidateCovisibilityGraph();
+
   // Get all missions from old map and add them into the new map.
   vi_map::MissionIdList submap_mission_ids;
   submap.getAllMissionIds(&submap_mission_ids);
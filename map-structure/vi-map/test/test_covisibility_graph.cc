@@ -0,0 +1,370 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/common/unique-id.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <maplab-common/pose_types.h>
+#include <maplab-common/test/testing-entrypoint.h>
+
+#include "vi-map/covisibility-graph.h"
+#include "vi-map/test/vi-map-generator.h"
+#include "vi-map/vi-map.h"
+#include "vi-map/viwls-edge.h"
+
+DEFINE_int32(
+    covisibility_graph_test_num_vertices, 300,
+    "Number of simulated vertices. Set to 20000 to benchmark the covisibility "
+    "graph against counting the common landmarks from the observed landmark "
+    "ids of the vertices.");
+
+namespace vi_map {
+
+class CovisibilityGraphTest : public ::testing::Test {
+ protected:
+  // A single mission along a line where every landmark is observed by the
+  // vertex storing it and a random number of the following vertices.
+  void constructProblem(const size_t num_vertices);
+
+  // Counts the keypoints of vertex_id_2 that observe a landmark that is also
+  // observed by vertex_id_1, as VIMapQueries did without the graph.
+  static size_t countCommonLandmarks(
+      const VIMap& map, const pose_graph::VertexId& vertex_id_1,
+      const pose_graph::VertexId& vertex_id_2);
+
+  // Compares all weights and coobserver lists of the graph with the counts
+  // from the observed landmark ids of the vertices.
+  static void expectGraphMatchesMap(
+      const CovisibilityGraph& graph, const VIMap& map);
+
+  VIMap map_;
+  pose_graph::VertexIdList vertex_ids_;
+};
+
+void CovisibilityGraphTest::constructProblem(const size_t num_vertices) {
+  constexpr size_t kNumLandmarksPerVertex = 5u;
+  constexpr size_t kMaxNumObservers = 10u;
+  constexpr double kVertexDistanceM = 0.1;
+
+  VIMapGenerator generator(map_, 42);
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> offset_distribution(0.0, 2.0);
+  std::uniform_real_distribution<double> depth_distribution(4.0, 6.0);
+  std::uniform_int_distribution<size_t> num_observers_distribution(
+      0u, kMaxNumObservers);
+
+  const MissionId mission_id = generator.createMission();
+  for (size_t idx = 0u; idx < num_vertices; ++idx) {
+    const pose::Transformation T_G_I(
+        pose::Position3D(kVertexDistanceM * idx, 0.0, 0.0),
+        pose::Quaternion());
+    constexpr int64_t kVertexIntervalNs = 100000000;
+    vertex_ids_.emplace_back(generator.createVertex(
+        mission_id, T_G_I, (idx + 1) * kVertexIntervalNs));
+  }
+
+  for (size_t idx = 0u; idx < num_vertices; ++idx) {
+    for (size_t landmark_idx = 0u; landmark_idx < kNumLandmarksPerVertex;
+         ++landmark_idx) {
+      const Eigen::Vector3d p_G_fi(
+          kVertexDistanceM * idx + offset_distribution(rng),
+          offset_distribution(rng), depth_distribution(rng));
+      pose_graph::VertexIdList observer_ids;
+      const size_t num_observers = num_observers_distribution(rng);
+      for (size_t offset = 1u;
+           offset <= num_observers && idx + offset < num_vertices; ++offset) {
+        observer_ids.emplace_back(vertex_ids_[idx + offset]);
+      }
+      generator.createLandmark(p_G_fi, vertex_ids_[idx], observer_ids);
+    }
+  }
+  generator.generateMap<ViwlsEdge>();
+}
+
+size_t CovisibilityGraphTest::countCommonLandmarks(
+    const VIMap& map, const pose_graph::VertexId& vertex_id_1,
+    const pose_graph::VertexId& vertex_id_2) {
+  LandmarkIdList landmark_ids_1;
+  map.getVertex(vertex_id_1).getAllObservedLandmarkIds(&landmark_ids_1);
+  LandmarkIdSet landmark_id_set_1;
+  for (const LandmarkId& landmark_id : landmark_ids_1) {
+    if (landmark_id.isValid()) {
+      landmark_id_set_1.emplace(landmark_id);
+    }
+  }
+
+  LandmarkIdList landmark_ids_2;
+  map.getVertex(vertex_id_2).getAllObservedLandmarkIds(&landmark_ids_2);
+  size_t num_common_landmarks = 0u;
+  for (const LandmarkId& landmark_id : landmark_ids_2) {
+    if (landmark_id.isValid() && landmark_id_set_1.count(landmark_id) > 0u) {
+      ++num_common_landmarks;
+    }
+  }
+  return num_common_landmarks;
+}
+
+void CovisibilityGraphTest::expectGraphMatchesMap(
+    const CovisibilityGraph& graph, const VIMap& map) {
+  pose_graph::VertexIdList vertex_ids;
+  map.getAllVertexIds(&vertex_ids);
+  ASSERT_EQ(graph.numVertices(), vertex_ids.size());
+
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    ASSERT_TRUE(graph.hasVertex(vertex_id));
+
+    // All vertices sharing a landmark, found through the landmark backlinks.
+    LandmarkIdList landmark_ids;
+    map.getVertex(vertex_id).getAllObservedLandmarkIds(&landmark_ids);
+    pose_graph::VertexIdSet candidate_vertex_ids;
+    for (const LandmarkId& landmark_id : landmark_ids) {
+      if (landmark_id.isValid()) {
+        for (const KeypointIdentifier& observation :
+             map.getLandmark(landmark_id).getObservations()) {
+          candidate_vertex_ids.emplace(observation.frame_id.vertex_id);
+        }
+      }
+    }
+
+    CovisibilityGraph::VertexCountList expected_coobservers;
+    for (const pose_graph::VertexId& candidate_id : candidate_vertex_ids) {
+      const size_t num_common_landmarks =
+          countCommonLandmarks(map, vertex_id, candidate_id);
+      EXPECT_EQ(
+          graph.getNumberOfCommonLandmarks(vertex_id, candidate_id),
+          num_common_landmarks);
+      if (num_common_landmarks > 0u) {
+        expected_coobservers.emplace_back(candidate_id, num_common_landmarks);
+      }
+    }
+    std::sort(
+        expected_coobservers.begin(), expected_coobservers.end(),
+        [](const CovisibilityGraph::VertexCount& lhs,
+           const CovisibilityGraph::VertexCount& rhs) {
+          return (lhs.second != rhs.second) ? lhs.second > rhs.second
+                                            : lhs.first < rhs.first;
+        });
+
+    CovisibilityGraph::VertexCountList coobservers;
+    graph.getCoobserverVertices(
+        vertex_id, 1u, expected_coobservers.size() + 1u, &coobservers);
+    EXPECT_EQ(coobservers, expected_coobservers);
+
+    // The top-k list is a prefix of the full list.
+    constexpr size_t kNumBestCoobservers = 3u;
+    graph.getCoobserverVertices(
+        vertex_id, 1u, kNumBestCoobservers, &coobservers);
+    ASSERT_EQ(
+        coobservers.size(),
+        std::min(kNumBestCoobservers, expected_coobservers.size()));
+    EXPECT_TRUE(std::equal(
+        coobservers.begin(), coobservers.end(),
+        expected_coobservers.begin()));
+  }
+}
+
+TEST_F(CovisibilityGraphTest, MatchesCountsFromObservedLandmarks) {
+  const size_t num_vertices = FLAGS_covisibility_graph_test_num_vertices;
+  constructProblem(num_vertices);
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  const CovisibilityGraph& graph = map_.getCovisibilityGraph();
+  const double build_time_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  // The queries of the keyframing heuristics, between every vertex and the
+  // preceding vertices.
+  constexpr size_t kMaxQueryOffset = 10u;
+  size_t sum_counted = 0u;
+  start = std::chrono::steady_clock::now();
+  for (size_t idx = 1u; idx < num_vertices; ++idx) {
+    for (size_t offset = 1u; offset <= std::min(idx, kMaxQueryOffset);
+         ++offset) {
+      sum_counted += countCommonLandmarks(
+          map_, vertex_ids_[idx], vertex_ids_[idx - offset]);
+    }
+  }
+  const double counting_time_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  size_t sum_graph = 0u;
+  start = std::chrono::steady_clock::now();
+  for (size_t idx = 1u; idx < num_vertices; ++idx) {
+    for (size_t offset = 1u; offset <= std::min(idx, kMaxQueryOffset);
+         ++offset) {
+      sum_graph += graph.getNumberOfCommonLandmarks(
+          vertex_ids_[idx], vertex_ids_[idx - offset]);
+    }
+  }
+  const double graph_time_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  LOG(INFO) << "Common landmark queries of " << num_vertices
+            << " vertices: counting " << counting_time_s << "s, graph "
+            << graph_time_s << "s (+ " << build_time_s << "s to build).";
+  EXPECT_EQ(sum_graph, sum_counted);
+
+  expectGraphMatchesMap(graph, map_);
+}
+
+TEST_F(CovisibilityGraphTest, IsUpdatedIncrementally) {
+  constructProblem(50u);
+  const CovisibilityGraph* graph = &map_.getCovisibilityGraph();
+
+  LandmarkIdList landmark_ids;
+  map_.getAllLandmarkIds(&landmark_ids);
+  ASSERT_GE(landmark_ids.size(), 20u);
+
+  map_.mergeLandmarks(landmark_ids[0], landmark_ids[10]);
+  EXPECT_EQ(&map_.getCovisibilityGraph(), graph);
+  expectGraphMatchesMap(*graph, map_);
+
+  map_.mergeLandmarks(
+      {{landmark_ids[1], landmark_ids[2]},
+       {landmark_ids[2], landmark_ids[15]},
+       {landmark_ids[3], landmark_ids[16]}});
+  EXPECT_EQ(&map_.getCovisibilityGraph(), graph);
+  expectGraphMatchesMap(*graph, map_);
+
+  map_.removeLandmark(landmark_ids[4]);
+  EXPECT_EQ(&map_.getCovisibilityGraph(), graph);
+  expectGraphMatchesMap(*graph, map_);
+
+  map_.mergeNeighboringVertices(vertex_ids_[5], vertex_ids_[6]);
+  EXPECT_EQ(&map_.getCovisibilityGraph(), graph);
+  expectGraphMatchesMap(*graph, map_);
+
+  // Removing and adding back a vertex restores the weights.
+  CovisibilityGraph rebuilt_graph;
+  for (const pose_graph::VertexId& vertex_id : vertex_ids_) {
+    if (map_.hasVertex(vertex_id)) {
+      rebuilt_graph.addVertex(map_.getVertex(vertex_id));
+    }
+  }
+  expectGraphMatchesMap(rebuilt_graph, map_);
+  rebuilt_graph.removeVertex(vertex_ids_[10]);
+  EXPECT_FALSE(rebuilt_graph.hasVertex(vertex_ids_[10]));
+  rebuilt_graph.addVertex(map_.getVertex(vertex_ids_[10]));
+  expectGraphMatchesMap(rebuilt_graph, map_);
+  EXPECT_EQ(rebuilt_graph.numLandmarks(), graph->numLandmarks());
+
+  map_.invalidateCovisibilityGraph();
+  expectGraphMatchesMap(map_.getCovisibilityGraph(), map_);
+}
+
+TEST_F(CovisibilityGraphTest, IsUpdatedByNewLandmarksAndAssociations) {
+  constructProblem(50u);
+  const CovisibilityGraph* graph = &map_.getCovisibilityGraph();
+
+  // A landmark observed by the storing vertex and at least two more.
+  LandmarkIdList landmark_ids;
+  map_.getAllLandmarkIds(&landmark_ids);
+  LandmarkId landmark_id;
+  for (const LandmarkId& candidate_id : landmark_ids) {
+    if (map_.getLandmark(candidate_id).numberOfObservations() >= 3u) {
+      landmark_id = candidate_id;
+      break;
+    }
+  }
+  ASSERT_TRUE(landmark_id.isValid());
+  const KeypointIdentifierList observations =
+      map_.getLandmark(landmark_id).getObservations();
+  const FeatureType feature_type =
+      map_.getLandmark(landmark_id).getFeatureType();
+  const pose_graph::VertexId& vertex_id_1 =
+      observations[0].frame_id.vertex_id;
+  const pose_graph::VertexId& vertex_id_2 =
+      observations[1].frame_id.vertex_id;
+  const size_t num_common_landmarks =
+      graph->getNumberOfCommonLandmarks(vertex_id_1, vertex_id_2);
+  ASSERT_GT(num_common_landmarks, 0u);
+
+  map_.removeLandmark(landmark_id);
+  EXPECT_EQ(&map_.getCovisibilityGraph(), graph);
+  EXPECT_TRUE(map_.isCovisibilityGraphConsistent());
+  expectGraphMatchesMap(*graph, map_);
+  EXPECT_LT(
+      graph->getNumberOfCommonLandmarks(vertex_id_1, vertex_id_2),
+      num_common_landmarks);
+
+  // Observe a new landmark with the same keypoints.
+  LandmarkId new_landmark_id;
+  aslam::generateId(&new_landmark_id);
+  map_.addNewLandmark(new_landmark_id, observations[0], feature_type);
+  EXPECT_EQ(&map_.getCovisibilityGraph(), graph);
+  EXPECT_TRUE(map_.isCovisibilityGraphConsistent());
+  expectGraphMatchesMap(*graph, map_);
+
+  for (size_t idx = 1u; idx < observations.size(); ++idx) {
+    map_.associateKeypointWithExistingLandmark(
+        observations[idx], new_landmark_id);
+    EXPECT_EQ(&map_.getCovisibilityGraph(), graph);
+    EXPECT_TRUE(map_.isCovisibilityGraphConsistent());
+  }
+  expectGraphMatchesMap(*graph, map_);
+  EXPECT_EQ(
+      graph->getNumberOfCommonLandmarks(vertex_id_1, vertex_id_2),
+      num_common_landmarks);
+}
+
+TEST_F(CovisibilityGraphTest, IsUpdatedWhenVerticesAreRemoved) {
+  constructProblem(50u);
+  const CovisibilityGraph* graph = &map_.getCovisibilityGraph();
+
+  // The last vertex observes landmarks of the preceding vertices and stores
+  // landmarks that only it observes.
+  const pose_graph::VertexId vertex_id = vertex_ids_.back();
+  Vertex& vertex = map_.getVertex(vertex_id);
+  LandmarkIdList stored_landmark_ids;
+  vertex.getStoredLandmarkIdList(&stored_landmark_ids);
+  ASSERT_FALSE(stored_landmark_ids.empty());
+  for (const LandmarkId& landmark_id : stored_landmark_ids) {
+    map_.removeLandmark(landmark_id);
+  }
+  EXPECT_TRUE(map_.isCovisibilityGraphConsistent());
+
+  // Dereference the remaining observations on the vertex directly, as the
+  // callers of removeVertex do. The graph only catches up once the vertex is
+  // removed.
+  size_t num_dereferenced_observations = 0u;
+  for (unsigned int frame_idx = 0u; frame_idx < vertex.numFrames();
+       ++frame_idx) {
+    LandmarkIdList frame_landmark_ids;
+    vertex.getFrameObservedLandmarkIds(frame_idx, &frame_landmark_ids);
+    for (size_t idx = 0u; idx < frame_landmark_ids.size(); ++idx) {
+      if (frame_landmark_ids[idx].isValid()) {
+        map_.getLandmark(frame_landmark_ids[idx])
+            .removeAllObservationsOfVertex(vertex_id);
+        vertex.setObservedLandmarkId(
+            frame_idx, static_cast<int>(idx), LandmarkId());
+        ++num_dereferenced_observations;
+      }
+    }
+  }
+  ASSERT_GT(num_dereferenced_observations, 0u);
+  EXPECT_FALSE(map_.isCovisibilityGraphConsistent());
+
+  pose_graph::EdgeIdSet incoming_edge_ids;
+  vertex.getIncomingEdges(&incoming_edge_ids);
+  for (const pose_graph::EdgeId& edge_id : incoming_edge_ids) {
+    map_.removeEdge(edge_id);
+  }
+  map_.removeVertex(vertex_id);
+  EXPECT_EQ(&map_.getCovisibilityGraph(), graph);
+  EXPECT_FALSE(graph->hasVertex(vertex_id));
+  EXPECT_TRUE(map_.isCovisibilityGraphConsistent());
+  expectGraphMatchesMap(*graph, map_);
+}
+
+}  // namespace vi_map
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -0,0 +1,331 @@
+#include <chrono>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+#include <aslam/common/memory.h>
+#include <aslam/common/unique-id.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <maplab-common/pose_types.h>
+#include <maplab-common/test/testing-entrypoint.h>
+
+#include "vi-map/test/vi-map-generator.h"
+#include "vi-map/transformation-edge.h"
+#include "vi-map/vi-map.h"
+#include "vi-map/viwls-edge.h"
+
+DEFINE_int32(
+    keyframe_compaction_test_num_vertices, 2000,
+    "Number of simulated vertices per mission. Set to 100000 to benchmark the "
+    "keyframe compaction against merging the vertices one by one.");
+
+namespace vi_map {
+
+class KeyframeCompactionTest : public ::testing::Test {
+ protected:
+  // Two missions along the same trajectory. A few landmarks of the first
+  // mission are also observed by the second mission and only the first
+  // mission has wheel odometry edges.
+  void constructProblem(const size_t num_vertices_per_mission);
+  void addWheelOdometryEdges(const MissionId& mission_id);
+  void selectKeyframes();
+
+  // Merges the vertices one by one into the preceding keyframe, as
+  // map_sparsification::removeVerticesBetweenKeyframes used to do.
+  static size_t removeVerticesSequentially(
+      const std::vector<pose_graph::VertexIdList>& keyframe_ids_per_mission,
+      VIMap* map);
+
+  static void expectSameMaps(const VIMap& lhs, const VIMap& rhs);
+
+  VIMap map_;
+  std::vector<pose_graph::VertexIdList> keyframe_ids_per_mission_;
+};
+
+void KeyframeCompactionTest::constructProblem(
+    const size_t num_vertices_per_mission) {
+  constexpr size_t kNumMissions = 2u;
+  constexpr size_t kNumLandmarksPerVertex = 3u;
+  constexpr size_t kMaxObserverOffset = 8u;
+  constexpr double kVertexDistanceM = 0.1;
+
+  VIMapGenerator generator(map_, 42);
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> offset_distribution(0.0, 2.0);
+  std::uniform_real_distribution<double> depth_distribution(4.0, 6.0);
+  std::uniform_int_distribution<size_t> num_observers_distribution(
+      0u, kMaxObserverOffset);
+  std::uniform_int_distribution<size_t> percent_distribution(0u, 99u);
+
+  std::vector<pose_graph::VertexIdList> vertex_ids(kNumMissions);
+  for (size_t mission_idx = 0u; mission_idx < kNumMissions; ++mission_idx) {
+    const MissionId mission_id = generator.createMission();
+    for (size_t idx = 0u; idx < num_vertices_per_mission; ++idx) {
+      const pose::Transformation T_G_I(
+          pose::Position3D(
+              kVertexDistanceM * idx, 0.01 * offset_distribution(rng),
+              0.01 * offset_distribution(rng)),
+          pose::Quaternion());
+      constexpr int64_t kVertexIntervalNs = 100000000;
+      vertex_ids[mission_idx].emplace_back(generator.createVertex(
+          mission_id, T_G_I, (idx + 1) * kVertexIntervalNs));
+    }
+  }
+
+  for (size_t mission_idx = 0u; mission_idx < kNumMissions; ++mission_idx) {
+    const pose_graph::VertexIdList& mission_vertex_ids =
+        vertex_ids[mission_idx];
+    for (size_t idx = 0u; idx < num_vertices_per_mission; ++idx) {
+      for (size_t landmark_idx = 0u; landmark_idx < kNumLandmarksPerVertex;
+           ++landmark_idx) {
+        const Eigen::Vector3d p_G_fi(
+            kVertexDistanceM * idx + offset_distribution(rng),
+            offset_distribution(rng), depth_distribution(rng));
+        pose_graph::VertexIdList observer_ids;
+        const size_t num_observers = num_observers_distribution(rng);
+        for (size_t offset = 1u; offset <= num_observers &&
+                                 idx + offset < num_vertices_per_mission;
+             ++offset) {
+          observer_ids.emplace_back(mission_vertex_ids[idx + offset]);
+        }
+        if (mission_idx == 0u && percent_distribution(rng) < 10u) {
+          observer_ids.emplace_back(vertex_ids[1u][idx]);
+        }
+        generator.createLandmark(
+            p_G_fi, mission_vertex_ids[idx], observer_ids);
+      }
+    }
+  }
+  generator.generateMap<ViwlsEdge>();
+
+  MissionIdList mission_ids;
+  map_.getAllMissionIds(&mission_ids);
+  ASSERT_EQ(mission_ids.size(), kNumMissions);
+  addWheelOdometryEdges(map_.getMissionIdForVertex(vertex_ids[0u].front()));
+  selectKeyframes();
+}
+
+void KeyframeCompactionTest::addWheelOdometryEdges(
+    const MissionId& mission_id) {
+  WheelOdometry::UniquePtr wheel_odometry_sensor(new WheelOdometry());
+  wheel_odometry_sensor->setRandom();
+  const aslam::SensorId wheel_odometry_sensor_id =
+      wheel_odometry_sensor->getId();
+  aslam::Transformation T_B_S;
+  T_B_S.setIdentity();
+  map_.getSensorManager().addSensor<WheelOdometry>(
+      std::move(wheel_odometry_sensor), wheel_odometry_sensor_id, T_B_S);
+  map_.getMission(mission_id).setWheelOdometrySensor(wheel_odometry_sensor_id);
+
+  pose_graph::VertexId vertex_id_k =
+      map_.getMission(mission_id).getRootVertexId();
+  pose_graph::VertexId vertex_id_kp1;
+  while (map_.getNextVertex(vertex_id_k, &vertex_id_kp1)) {
+    const aslam::Transformation T_Ik_Ikp1 =
+        map_.getVertex_T_G_I(vertex_id_k).inverse() *
+        map_.getVertex_T_G_I(vertex_id_kp1);
+    map_.addEdge(
+        aligned_unique<TransformationEdge>(
+            Edge::EdgeType::kWheelOdometry,
+            aslam::createRandomId<pose_graph::EdgeId>(), vertex_id_k,
+            vertex_id_kp1, T_Ik_Ikp1,
+            aslam::TransformationCovariance::Identity(),
+            wheel_odometry_sensor_id));
+    vertex_id_k = vertex_id_kp1;
+  }
+}
+
+void KeyframeCompactionTest::selectKeyframes() {
+  std::mt19937 rng(7);
+  // Include direct neighbors, which leave nothing to remove.
+  std::uniform_int_distribution<size_t> stride_distribution(1u, 10u);
+
+  MissionIdList mission_ids;
+  map_.getAllMissionIds(&mission_ids);
+  for (const MissionId& mission_id : mission_ids) {
+    pose_graph::VertexIdList vertex_ids;
+    map_.getAllVertexIdsInMissionAlongGraph(mission_id, &vertex_ids);
+    keyframe_ids_per_mission_.emplace_back();
+    pose_graph::VertexIdList& keyframe_ids = keyframe_ids_per_mission_.back();
+    for (size_t idx = 0u; idx < vertex_ids.size();
+         idx += stride_distribution(rng)) {
+      keyframe_ids.emplace_back(vertex_ids[idx]);
+    }
+    if (keyframe_ids.back() != vertex_ids.back()) {
+      keyframe_ids.emplace_back(vertex_ids.back());
+    }
+  }
+}
+
+size_t KeyframeCompactionTest::removeVerticesSequentially(
+    const std::vector<pose_graph::VertexIdList>& keyframe_ids_per_mission,
+    VIMap* map) {
+  CHECK_NOTNULL(map);
+  size_t num_removed_vertices = 0u;
+  for (const pose_graph::VertexIdList& keyframe_ids :
+       keyframe_ids_per_mission) {
+    for (size_t idx = 0u; idx + 1u < keyframe_ids.size(); ++idx) {
+      const pose_graph::VertexId& start_kf_id = keyframe_ids[idx];
+      const pose_graph::VertexId& end_kf_id = keyframe_ids[idx + 1u];
+
+      bool merge_viwls_edges = true;
+      bool merge_odometry_edges = true;
+      bool merge_wheel_odometry_edges = true;
+      pose_graph::VertexId current_vertex_id = start_kf_id;
+      do {
+        CHECK(map->getNextVertex(current_vertex_id, &current_vertex_id));
+        pose_graph::EdgeIdSet incoming_edge_ids;
+        map->getVertex(current_vertex_id).getIncomingEdges(&incoming_edge_ids);
+        bool found_viwls_edge = false;
+        bool found_odometry_edge = false;
+        bool found_wheel_odometry_edge = false;
+        for (const pose_graph::EdgeId& edge_id : incoming_edge_ids) {
+          const pose_graph::Edge::EdgeType edge_type =
+              map->getEdgeType(edge_id);
+          found_viwls_edge |= edge_type == pose_graph::Edge::EdgeType::kViwls;
+          found_odometry_edge |=
+              edge_type == pose_graph::Edge::EdgeType::kOdometry;
+          found_wheel_odometry_edge |=
+              edge_type == pose_graph::Edge::EdgeType::kWheelOdometry;
+        }
+        merge_viwls_edges &= found_viwls_edge;
+        merge_odometry_edges &= found_odometry_edge;
+        merge_wheel_odometry_edges &= found_wheel_odometry_edge;
+      } while (current_vertex_id != end_kf_id);
+
+      while (map->getNextVertex(start_kf_id, &current_vertex_id) &&
+             current_vertex_id != end_kf_id) {
+        map->mergeNeighboringVertices(
+            start_kf_id, current_vertex_id, merge_viwls_edges,
+            merge_odometry_edges, merge_wheel_odometry_edges);
+        ++num_removed_vertices;
+      }
+    }
+  }
+  return num_removed_vertices;
+}
+
+void KeyframeCompactionTest::expectSameMaps(
+    const VIMap& lhs, const VIMap& rhs) {
+  pose_graph::VertexIdList lhs_vertex_ids;
+  pose_graph::VertexIdList rhs_vertex_ids;
+  lhs.getAllVertexIds(&lhs_vertex_ids);
+  rhs.getAllVertexIds(&rhs_vertex_ids);
+  ASSERT_EQ(
+      pose_graph::VertexIdSet(lhs_vertex_ids.begin(), lhs_vertex_ids.end()),
+      pose_graph::VertexIdSet(rhs_vertex_ids.begin(), rhs_vertex_ids.end()));
+  EXPECT_EQ(lhs.numEdges(), rhs.numEdges());
+  EXPECT_EQ(lhs.numLandmarks(), rhs.numLandmarks());
+
+  for (const pose_graph::VertexId& vertex_id : lhs_vertex_ids) {
+    // The composed edges only differ in their ids.
+    pose_graph::EdgeIdSet lhs_edge_ids;
+    pose_graph::EdgeIdSet rhs_edge_ids;
+    lhs.getVertex(vertex_id).getOutgoingEdges(&lhs_edge_ids);
+    rhs.getVertex(vertex_id).getOutgoingEdges(&rhs_edge_ids);
+    ASSERT_EQ(lhs_edge_ids.size(), rhs_edge_ids.size());
+    for (const pose_graph::EdgeId& lhs_edge_id : lhs_edge_ids) {
+      const pose_graph::Edge::EdgeType edge_type = lhs.getEdgeType(lhs_edge_id);
+      size_t num_matching_edges = 0u;
+      for (const pose_graph::EdgeId& rhs_edge_id : rhs_edge_ids) {
+        if (rhs.getEdgeType(rhs_edge_id) != edge_type) {
+          continue;
+        }
+        ++num_matching_edges;
+        if (edge_type == pose_graph::Edge::EdgeType::kViwls) {
+          const ViwlsEdge& lhs_edge = lhs.getEdgeAs<ViwlsEdge>(lhs_edge_id);
+          const ViwlsEdge& rhs_edge = rhs.getEdgeAs<ViwlsEdge>(rhs_edge_id);
+          EXPECT_EQ(lhs_edge.to(), rhs_edge.to());
+          EXPECT_TRUE(
+              lhs_edge.getImuTimestamps() == rhs_edge.getImuTimestamps());
+          EXPECT_TRUE(lhs_edge.getImuData() == rhs_edge.getImuData());
+        } else {
+          const TransformationEdge& lhs_edge =
+              lhs.getEdgeAs<TransformationEdge>(lhs_edge_id);
+          const TransformationEdge& rhs_edge =
+              rhs.getEdgeAs<TransformationEdge>(rhs_edge_id);
+          EXPECT_EQ(lhs_edge.to(), rhs_edge.to());
+          EXPECT_EQ(lhs_edge.getSensorId(), rhs_edge.getSensorId());
+          EXPECT_TRUE(
+              lhs_edge.get_T_A_B().getTransformationMatrix() ==
+              rhs_edge.get_T_A_B().getTransformationMatrix());
+          EXPECT_TRUE(
+              lhs_edge.get_T_A_B_Covariance_p_q() ==
+              rhs_edge.get_T_A_B_Covariance_p_q());
+        }
+      }
+      EXPECT_EQ(num_matching_edges, 1u);
+    }
+
+    // Landmarks must be stored in the same order, at the same position and
+    // with the same observations.
+    const Vertex& lhs_vertex = lhs.getVertex(vertex_id);
+    const Vertex& rhs_vertex = rhs.getVertex(vertex_id);
+    const LandmarkStore& lhs_landmarks = lhs_vertex.getLandmarks();
+    const LandmarkStore& rhs_landmarks = rhs_vertex.getLandmarks();
+    ASSERT_EQ(lhs_landmarks.size(), rhs_landmarks.size());
+    LandmarkStore::LandmarkVector::const_iterator rhs_it =
+        rhs_landmarks.begin();
+    for (const Landmark& lhs_landmark : lhs_landmarks) {
+      const Landmark& rhs_landmark = *(rhs_it++);
+      ASSERT_EQ(lhs_landmark.id(), rhs_landmark.id());
+      EXPECT_TRUE(lhs_landmark.get_p_B() == rhs_landmark.get_p_B());
+      EXPECT_EQ(lhs_landmark.getObservations(), rhs_landmark.getObservations());
+      EXPECT_EQ(
+          lhs.getLandmarkStoreVertexId(lhs_landmark.id()),
+          rhs.getLandmarkStoreVertexId(rhs_landmark.id()));
+    }
+
+    ASSERT_EQ(lhs_vertex.numFrames(), rhs_vertex.numFrames());
+    for (unsigned int frame_idx = 0u; frame_idx < lhs_vertex.numFrames();
+         ++frame_idx) {
+      EXPECT_EQ(
+          lhs_vertex.getFrameObservedLandmarkIds(frame_idx),
+          rhs_vertex.getFrameObservedLandmarkIds(frame_idx));
+    }
+  }
+}
+
+TEST_F(KeyframeCompactionTest, CompactionMatchesSequentialMerging) {
+  const size_t num_vertices = FLAGS_keyframe_compaction_test_num_vertices;
+  constructProblem(num_vertices);
+  const size_t num_vertices_before = map_.numVertices();
+
+  VIMap sequential_map;
+  sequential_map.deepCopy(map_);
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  const size_t num_sequentially_removed_vertices =
+      removeVerticesSequentially(keyframe_ids_per_mission_, &sequential_map);
+  const double sequential_time_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  start = std::chrono::steady_clock::now();
+  const size_t num_removed_vertices =
+      map_.removeVerticesBetweenKeyframes(keyframe_ids_per_mission_);
+  const double compaction_time_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  LOG(INFO) << "Removed " << num_removed_vertices << " of "
+            << num_vertices_before << " vertices: sequential "
+            << sequential_time_s << "s, compaction " << compaction_time_s
+            << "s.";
+
+  EXPECT_GT(num_removed_vertices, 0u);
+  EXPECT_EQ(num_removed_vertices, num_sequentially_removed_vertices);
+  EXPECT_EQ(map_.numVertices(), num_vertices_before - num_removed_vertices);
+  expectSameMaps(map_, sequential_map);
+
+  // Only keyframes are left, compacting again does nothing.
+  EXPECT_EQ(map_.removeVerticesBetweenKeyframes(keyframe_ids_per_mission_), 0u);
+}
+
+}  // namespace vi_map
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -0,0 +1,221 @@
+#include <chrono>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <maplab-common/test/testing-entrypoint.h>
+
+#include "vi-map/test/vi-map-generator.h"
+#include "vi-map/vi-map.h"
+
+DEFINE_int32(
+    landmark_merging_test_num_tracks, 2000,
+    "Number of simulated feature tracks. Set to 1000000 to benchmark the bulk "
+    "landmark merging against the sequential merging on a large map.");
+
+namespace vi_map {
+
+typedef std::vector<std::pair<LandmarkId, LandmarkId>> LandmarkMergeList;
+
+class LandmarkMergingTest : public ::testing::Test {
+ protected:
+  // Every track is split into several landmarks, which are merged again. A
+  // few tracks are additionally merged with the following track, as it would
+  // happen for loop closures.
+  void constructProblem(const size_t num_tracks);
+
+  // Applies the merges one by one, replacing the ids of already merged
+  // landmarks, as the current callers of VIMap::mergeLandmarks do.
+  static size_t mergeSequentially(const LandmarkMergeList& merges, VIMap* map);
+
+  static void expectSameLandmarks(const VIMap& lhs, const VIMap& rhs);
+
+  VIMap map_;
+  LandmarkMergeList merges_;
+};
+
+void LandmarkMergingTest::constructProblem(const size_t num_tracks) {
+  constexpr size_t kNumFragmentsPerTrack = 3u;
+  constexpr size_t kNumTracksPerVertex = 100u;
+  constexpr size_t kLoopClosureEveryNthTrack = 10u;
+
+  VIMapGenerator generator(map_, 42);
+  const MissionId mission_id = generator.createMission();
+  const size_t num_vertices = 2u + num_tracks / kNumTracksPerVertex;
+  pose_graph::VertexIdList vertex_ids;
+  for (size_t idx = 0u; idx < num_vertices; ++idx) {
+    vertex_ids.emplace_back(
+        generator.createVertex(mission_id, pose::Transformation()));
+  }
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> position_distribution(0.0, 10.0);
+  std::uniform_int_distribution<size_t> vertex_distribution(
+      0u, num_vertices - 1u);
+  std::vector<LandmarkIdList> tracks(num_tracks);
+  for (LandmarkIdList& track : tracks) {
+    for (size_t fragment = 0u; fragment < kNumFragmentsPerTrack; ++fragment) {
+      const size_t storing_vertex_idx = vertex_distribution(rng);
+      const size_t observer_vertex_idx =
+          (storing_vertex_idx + 1u) % num_vertices;
+      track.emplace_back(generator.createLandmark(
+          Eigen::Vector3d(
+              position_distribution(rng), position_distribution(rng), 1.0),
+          vertex_ids[storing_vertex_idx], {vertex_ids[observer_vertex_idx]}));
+    }
+  }
+  generator.generateMap();
+
+  for (size_t track_idx = 0u; track_idx < num_tracks; ++track_idx) {
+    const LandmarkIdList& track = tracks[track_idx];
+    map_.getLandmark(track[0]).setQuality(
+        track_idx % 3u == 0u ? Landmark::Quality::kGood
+                             : Landmark::Quality::kBad);
+    for (size_t fragment = 1u; fragment < track.size(); ++fragment) {
+      merges_.emplace_back(track[fragment], track[fragment - 1u]);
+    }
+    // Redundant merge within the same track.
+    merges_.emplace_back(track.back(), track.front());
+    if (track_idx % kLoopClosureEveryNthTrack == 0u &&
+        track_idx + 1u < num_tracks) {
+      merges_.emplace_back(track.front(), tracks[track_idx + 1u].back());
+    }
+  }
+}
+
+size_t LandmarkMergingTest::mergeSequentially(
+    const LandmarkMergeList& merges, VIMap* map) {
+  CHECK_NOTNULL(map);
+  std::unordered_map<LandmarkId, LandmarkId> merged_into;
+  auto resolve = [&merged_into](LandmarkId landmark_id) {
+    std::unordered_map<LandmarkId, LandmarkId>::const_iterator it;
+    while ((it = merged_into.find(landmark_id)) != merged_into.end()) {
+      landmark_id = it->second;
+    }
+    return landmark_id;
+  };
+
+  size_t num_merges = 0u;
+  for (const std::pair<LandmarkId, LandmarkId>& merge : merges) {
+    const LandmarkId landmark_id_to_merge = resolve(merge.first);
+    const LandmarkId landmark_id_into = resolve(merge.second);
+    if (landmark_id_to_merge != landmark_id_into) {
+      map->mergeLandmarks(landmark_id_to_merge, landmark_id_into);
+      merged_into.emplace(landmark_id_to_merge, landmark_id_into);
+      ++num_merges;
+    }
+  }
+  return num_merges;
+}
+
+void LandmarkMergingTest::expectSameLandmarks(
+    const VIMap& lhs, const VIMap& rhs) {
+  LandmarkIdSet lhs_landmark_ids;
+  LandmarkIdSet rhs_landmark_ids;
+  lhs.getAllLandmarkIds(&lhs_landmark_ids);
+  rhs.getAllLandmarkIds(&rhs_landmark_ids);
+  ASSERT_EQ(lhs_landmark_ids, rhs_landmark_ids);
+
+  for (const LandmarkId& landmark_id : lhs_landmark_ids) {
+    const Landmark& lhs_landmark = lhs.getLandmark(landmark_id);
+    const Landmark& rhs_landmark = rhs.getLandmark(landmark_id);
+    EXPECT_EQ(lhs_landmark.getQuality(), rhs_landmark.getQuality());
+    EXPECT_EQ(
+        lhs.getLandmarkStoreVertexId(landmark_id),
+        rhs.getLandmarkStoreVertexId(landmark_id));
+    const KeypointIdentifierList& lhs_observations =
+        lhs_landmark.getObservations();
+    const KeypointIdentifierList& rhs_observations =
+        rhs_landmark.getObservations();
+    EXPECT_EQ(
+        std::unordered_set<KeypointIdentifier>(
+            lhs_observations.begin(), lhs_observations.end()),
+        std::unordered_set<KeypointIdentifier>(
+            rhs_observations.begin(), rhs_observations.end()));
+  }
+
+  pose_graph::VertexIdList vertex_ids;
+  lhs.getAllVertexIds(&vertex_ids);
+  for (const pose_graph::VertexId& vertex_id : vertex_ids) {
+    const Vertex& lhs_vertex = lhs.getVertex(vertex_id);
+    const Vertex& rhs_vertex = rhs.getVertex(vertex_id);
+    ASSERT_EQ(lhs_vertex.numFrames(), rhs_vertex.numFrames());
+    for (unsigned int frame_idx = 0u; frame_idx < lhs_vertex.numFrames();
+         ++frame_idx) {
+      const LandmarkIdList& lhs_observed_ids =
+          lhs_vertex.getFrameObservedLandmarkIds(frame_idx);
+      EXPECT_EQ(
+          lhs_observed_ids, rhs_vertex.getFrameObservedLandmarkIds(frame_idx));
+      for (const LandmarkId& landmark_id : lhs_observed_ids) {
+        if (landmark_id.isValid()) {
+          EXPECT_TRUE(lhs.hasLandmark(landmark_id));
+        }
+      }
+    }
+  }
+}
+
+TEST_F(LandmarkMergingTest, BulkMergeMatchesSequentialMerges) {
+  const size_t num_tracks = FLAGS_landmark_merging_test_num_tracks;
+  constructProblem(num_tracks);
+  const size_t num_landmarks_before = map_.numLandmarks();
+
+  VIMap sequential_map;
+  sequential_map.deepCopy(map_);
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  const size_t num_sequential_merges =
+      mergeSequentially(merges_, &sequential_map);
+  const double sequential_time_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  start = std::chrono::steady_clock::now();
+  const size_t num_bulk_merges = map_.mergeLandmarks(merges_);
+  const double bulk_time_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  LOG(INFO) << "Merged " << num_bulk_merges << " landmarks of " << num_tracks
+            << " tracks: sequential " << sequential_time_s << "s, bulk "
+            << bulk_time_s << "s.";
+
+  EXPECT_EQ(num_bulk_merges, num_sequential_merges);
+  EXPECT_EQ(map_.numLandmarks(), num_landmarks_before - num_bulk_merges);
+  expectSameLandmarks(map_, sequential_map);
+
+  // Merging again does nothing.
+  EXPECT_EQ(map_.mergeLandmarks(LandmarkMergeList()), 0u);
+}
+
+TEST_F(LandmarkMergingTest, MergeChainKeepsTargetOfLastMerge) {
+  constructProblem(10u);
+  LandmarkIdList landmark_ids;
+  map_.getAllLandmarkIds(&landmark_ids);
+  ASSERT_GE(landmark_ids.size(), 3u);
+
+  const LandmarkId& a = landmark_ids[0];
+  const LandmarkId& b = landmark_ids[1];
+  const LandmarkId& c = landmark_ids[2];
+  const size_t num_observations =
+      map_.getLandmark(a).numberOfObservations() +
+      map_.getLandmark(b).numberOfObservations() +
+      map_.getLandmark(c).numberOfObservations();
+
+  EXPECT_EQ(map_.mergeLandmarks({{a, b}, {b, c}, {a, c}}), 2u);
+  EXPECT_FALSE(map_.hasLandmark(a));
+  EXPECT_FALSE(map_.hasLandmark(b));
+  ASSERT_TRUE(map_.hasLandmark(c));
+  EXPECT_EQ(map_.getLandmark(c).numberOfObservations(), num_observations);
+}
+
+}  // namespace vi_map
+
+MAPLAB_UNITTEST_ENTRYPOINT
@@ -311,6 +311,7 @@ void VIMappingTestApp::addCorruptDuplicateLandmarkObservations(int every_nth) {
       ++index;
     }
   }
+  map->invalidateCovisibilityGraph();
 }
 
 void VIMappingTestApp::addAbsolute6DoFConstraints(
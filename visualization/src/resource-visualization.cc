@@ -12,8 +12,10 @@
 #include <depth-integration/depth-integration.h>
 #include <glog/logging.h>
 #include <maplab-common/progress-bar.h>
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <resources-common/point-cloud-voxel-accumulator.h>
 #include <thread>
 #include <vi-map/vertex.h>
 #include <vi-map/vi-map.h>
@@ -48,6 +50,16 @@ DEFINE_string(
     "visualization is accumulating the point cloud, therefore enable "
     "--vis_pointcloud_accumulated_before_publishing=true.");
 
+DEFINE_double(
+    vis_pointcloud_accumulation_voxel_size_m, 0.0,
+    "If larger than 0, accumulated point clouds are downsampled on the fly to "
+    "a voxel grid of this resolution, such that their size scales with the "
+    "covered volume instead of the number of point clouds.");
+DEFINE_string(
+    vis_pointcloud_accumulation_voxel_reduction, "mean",
+    "How the points within a voxel of the accumulated point cloud are reduced "
+    "to a single point: 'mean', 'first' or 'max_intensity'.");
+
 DEFINE_int32(
     vis_pointcloud_sleep_between_point_clouds_ms, 1u,
     "Time the visualization sleeps between publishing point clouds.");
@@ -73,6 +85,69 @@ DEFINE_int32(
 
 namespace visualization {
 
+namespace {
+// Returns nullptr if the accumulated point clouds should not be downsampled.
+std::unique_ptr<resources::PointCloudVoxelAccumulator>
+createVoxelAccumulatorFromGFlags() {
+  if (FLAGS_vis_pointcloud_accumulation_voxel_size_m <= 0.0) {
+    return nullptr;
+  }
+  resources::PointCloudVoxelAccumulator::Reduction reduction;
+  CHECK(resources::PointCloudVoxelAccumulator::reductionFromString(
+      FLAGS_vis_pointcloud_accumulation_voxel_reduction, &reduction))
+      << "Unknown voxel reduction '"
+      << FLAGS_vis_pointcloud_accumulation_voxel_reduction << "'!";
+  return std::unique_ptr<resources::PointCloudVoxelAccumulator>(
+      new resources::PointCloudVoxelAccumulator(
+          FLAGS_vis_pointcloud_accumulation_voxel_size_m, reduction));
+}
+
+// Transforms the point cloud to the global frame and adds it to the voxel
+// accumulator if there is one, otherwise to the accumulated point cloud.
+void accumulatePointCloud(
+    const resources::PointCloud& points_S, const aslam::Transformation& T_G_S,
+    const bool colorize, const uint8_t r, const uint8_t g, const uint8_t b,
+    resources::PointCloudVoxelAccumulator* voxel_accumulator,
+    resources::PointCloud* accumulated_point_cloud_G) {
+  CHECK_NOTNULL(accumulated_point_cloud_G);
+  if (voxel_accumulator == nullptr) {
+    const size_t previous_size = accumulated_point_cloud_G->size();
+    accumulated_point_cloud_G->appendTransformed(points_S, T_G_S);
+    const size_t new_size = accumulated_point_cloud_G->size();
+
+    if (colorize) {
+      accumulated_point_cloud_G->colorizePointCloud(
+          previous_size, new_size, r, g, b);
+    }
+    return;
+  }
+
+  if (!colorize || !points_S.hasColor()) {
+    voxel_accumulator->insertTransformed(points_S, T_G_S);
+    return;
+  }
+  resources::PointCloud points_S_colorized = points_S;
+  for (size_t idx = 0u; idx < points_S_colorized.colors.size(); idx += 3u) {
+    points_S_colorized.colors[idx] = r;
+    points_S_colorized.colors[idx + 1u] = g;
+    points_S_colorized.colors[idx + 2u] = b;
+  }
+  voxel_accumulator->insertTransformed(points_S_colorized, T_G_S);
+}
+
+void exportVoxelAccumulator(
+    const resources::PointCloudVoxelAccumulator* voxel_accumulator,
+    resources::PointCloud* accumulated_point_cloud_G) {
+  CHECK_NOTNULL(accumulated_point_cloud_G);
+  if (voxel_accumulator == nullptr) {
+    return;
+  }
+  resources::PointCloud voxelized_point_cloud_G;
+  voxel_accumulator->exportPointCloud(&voxelized_point_cloud_G);
+  accumulated_point_cloud_G->append(voxelized_point_cloud_G);
+}
+}  // namespace
+
 bool visualizeCvMatResources(
     const vi_map::VIMap& map, backend::ResourceType type) {
   CHECK_GT(FLAGS_vis_resource_visualization_frequency, 0.0);
@@ -226,13 +301,15 @@ void visualizeReprojectedDepthResource(
         FLAGS_vis_pointcloud_publish_in_sensor_frame_with_tf));
 
   resources::PointCloud accumulated_point_cloud_G;
+  std::unique_ptr<resources::PointCloudVoxelAccumulator> voxel_accumulator =
+      createVoxelAccumulatorFromGFlags();
 
   size_t point_cloud_counter = 0u;
 
   srand(time(NULL));
 
   depth_integration::IntegrationFunctionPointCloudMaplab integration_function =
-      [&accumulated_point_cloud_G, &point_cloud_counter](
+      [&accumulated_point_cloud_G, &voxel_accumulator, &point_cloud_counter](
           const aslam::Transformation& T_G_S,
           const resources::PointCloud& points_S) {
         if (FLAGS_vis_pointcloud_visualize_every_nth > 0 &&
@@ -254,14 +331,9 @@ void visualizeReprojectedDepthResource(
 
         // If we just accumulate, transform to global frame and append.
         if (FLAGS_vis_pointcloud_accumulated_before_publishing) {
-          const size_t previous_size = accumulated_point_cloud_G.size();
-          accumulated_point_cloud_G.appendTransformed(points_S, T_G_S);
-          const size_t new_size = accumulated_point_cloud_G.size();
-
-          if (FLAGS_vis_pointcloud_color_random) {
-            accumulated_point_cloud_G.colorizePointCloud(
-                previous_size, new_size, r, g, b);
-          }
+          accumulatePointCloud(
+              points_S, T_G_S, FLAGS_vis_pointcloud_color_random, r, g, b,
+              voxel_accumulator.get(), &accumulated_point_cloud_G);
           return;
         }
 
@@ -303,6 +375,7 @@ void visualizeReprojectedDepthResource(
       mission_ids, input_resource_type,
       FLAGS_vis_pointcloud_reproject_depth_maps_with_undistorted_camera, vi_map,
       integration_function);
+  exportVoxelAccumulator(voxel_accumulator.get(), &accumulated_point_cloud_G);
 
   // If we are done and we did not accumulate the point cloud there is nothing
   // left to do.
@@ -331,7 +404,9 @@ void visualizeReprojectedDepthResource(
 static void createAndAppendAccumulatedPointCloudMessageForMission(
     const backend::ResourceType input_resource_type,
     const vi_map::MissionId& mission_id, const vi_map::VIMap& vi_map,
+    resources::PointCloudVoxelAccumulator* voxel_accumulator,
     resources::PointCloud* accumulated_point_cloud_G) {
+  // voxel_accumulator is optional.
   CHECK_NOTNULL(accumulated_point_cloud_G);
   CHECK(mission_id.isValid());
   CHECK(vi_map.hasMission(mission_id));
@@ -341,7 +416,7 @@ static void createAndAppendAccumulatedPointCloudMessageForMission(
   srand(time(NULL));
 
   depth_integration::IntegrationFunctionPointCloudMaplab integration_function =
-      [&accumulated_point_cloud_G, &point_cloud_counter](
+      [&accumulated_point_cloud_G, voxel_accumulator, &point_cloud_counter](
           const aslam::Transformation& T_G_S,
           const resources::PointCloud& points_S) {
         if (FLAGS_vis_pointcloud_visualize_every_nth > 0 &&
@@ -361,14 +436,9 @@ static void createAndAppendAccumulatedPointCloudMessageForMission(
 
         ++point_cloud_counter;
 
-        const size_t previous_size = accumulated_point_cloud_G->size();
-        accumulated_point_cloud_G->appendTransformed(points_S, T_G_S);
-        const size_t new_size = accumulated_point_cloud_G->size();
-
-        if (FLAGS_vis_pointcloud_color_random) {
-          accumulated_point_cloud_G->colorizePointCloud(
-              previous_size, new_size, r, g, b);
-        }
+        accumulatePointCloud(
+            points_S, T_G_S, FLAGS_vis_pointcloud_color_random, r, g, b,
+            voxel_accumulator, accumulated_point_cloud_G);
         return;
       };
 
@@ -403,6 +473,8 @@ void visualizeReprojectedDepthResourcePerRobot(
     }
 
     resources::PointCloud accumulated_point_cloud_G;
+    std::unique_ptr<resources::PointCloudVoxelAccumulator> voxel_accumulator =
+        createVoxelAccumulatorFromGFlags();
     for (const vi_map::MissionId& mission_id : mission_ids) {
       if (!mission_id.isValid()) {
         LOG(ERROR) << "Cannot visualize one mission of robot '" << robot_name
@@ -417,8 +489,11 @@ void visualizeReprojectedDepthResourcePerRobot(
         continue;
       }
       createAndAppendAccumulatedPointCloudMessageForMission(
-          input_resource_type, mission_id, vi_map, &accumulated_point_cloud_G);
+          input_resource_type, mission_id, vi_map, voxel_accumulator.get(),
+          &accumulated_point_cloud_G);
     }
+    exportVoxelAccumulator(
+        voxel_accumulator.get(), &accumulated_point_cloud_G);
 
     // Publish accumulated point cloud in global frame.
     sensor_msgs::PointCloud2 ros_point_cloud_G;
@@ -504,8 +579,12 @@ void visualizeReprojectedDepthResourceFromMission(
 
   srand(time(NULL));
   resources::PointCloud accumulated_point_cloud_G;
+  std::unique_ptr<resources::PointCloudVoxelAccumulator> voxel_accumulator =
+      createVoxelAccumulatorFromGFlags();
   createAndAppendAccumulatedPointCloudMessageForMission(
-      input_resource_type, mission_id, vi_map, &accumulated_point_cloud_G);
+      input_resource_type, mission_id, vi_map, voxel_accumulator.get(),
+      &accumulated_point_cloud_G);
+  exportVoxelAccumulator(voxel_accumulator.get(), &accumulated_point_cloud_G);
 
   sensor_msgs::PointCloud2 ros_point_cloud_G;
   backend::convertPointCloudType(